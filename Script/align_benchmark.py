@@ -0,0 +1,180 @@
+#!/usr/bin/env python
+# Aligner accuracy and throughput benchmark driven by 'biokanga simreads'
+# Simulated readsets are generated with a fixed seed so the same readsets are aligned by each build being benchmarked
+# Each readset is aligned with 'biokanga align' under each of the requested processing modes and the following are recorded:
+#	reads/sec - from the 'align_reads' phase of the '--metrics' file, this phase ends when align's worker threads have all completed
+#	peak RSS  - from the 'total' phase of the '--metrics' file
+#	sensitivity and precision - from the simulated read loci which 'biokanga align' checks each accepted alignment against
+# Results are appended as CSV rows labeled with the build name so results from multiple builds can be accumulated into the one file
+# and then compared with '--compare'
+#
+# Example usage:
+#	align_benchmark.py --biokanga=./biokanga --genome=genome.fa --workdir=bench --build=v4.4.1 --results=bench.csv
+#	align_benchmark.py --biokanga=./biokanga.new --genome=genome.fa --workdir=bench --build=new --results=bench.csv
+#	align_benchmark.py --results=bench.csv --compare=v4.4.1,new
+
+from __future__ import print_function
+from subprocess import *
+import os
+import re
+import sys
+import csv
+import argparse
+
+# simulated sequencer error profiles, as 'biokanga simreads' parameters
+# note: micro-InDels ('-X<rate>') are not simulated as simreads reports antisense read loci offset by the InDel size range ('-x<size>')
+# so accuracy would be understated
+ErrProfiles = {"none" : ["-g0"],
+	"static" : ["-g2"],
+	"dyn1pct" : ["-g3","-z0.01"],
+	"dyn5pct" : ["-g3","-z0.05"]}
+
+# alignment processing modes, 'biokanga align -m<mode>'
+PModes = {"standard" : 0, "sensitive" : 1, "ultra" : 2, "quick" : 3}
+
+ResultsHdr = ["Build","Dataset","NumReads","ReadLen","ErrProfile","PE","PMode","Threads",
+	"Accepted","Correct","Misaligned","Sensitivity","Precision",
+	"WallSecs","AlignSecs","ReadsPerSec","PeakRSSKB"]
+
+def RunCmd(Args,LogFile):
+	print(" ".join(Args))
+	with open(LogFile,"w") as Log:
+		Rslt = call(Args,stdout=Log,stderr=STDOUT)
+	if Rslt != 0:
+		raise RuntimeError("'%s' failed with exit code %d, see '%s'" % (Args[1],Rslt,LogFile))
+
+def ParseList(Txt,Conv=str):
+	return [Conv(Val.strip()) for Val in Txt.split(",") if Val.strip() != ""]
+
+# generate readset if not already present from a previous run, simreads is single threaded so the readset only depends on the seed
+def SimReadset(Opts,Dataset,NumReads,ReadLen,ErrProfile,bPE):
+	PE1File = os.path.join(Opts.workdir,Dataset + ("_1.fa" if bPE else ".fa"))
+	PE2File = os.path.join(Opts.workdir,Dataset + "_2.fa") if bPE else None
+	if os.path.exists(PE1File) and (PE2File is None or os.path.exists(PE2File)):
+		return PE1File,PE2File
+	Args = [Opts.biokanga,"simreads","-i",Opts.genome,"-o",PE1File,"-n",str(NumReads),"-l",str(ReadLen),
+			"-y",str(Opts.seed),"-T","1","-M3"] + ErrProfiles[ErrProfile]
+	if bPE:
+		Args += ["-p","-O",PE2File,"-j",str(ReadLen * 2),"-J",str(ReadLen * 3)]
+	RunCmd(Args,os.path.join(Opts.workdir,Dataset + ".simreads.log"))
+	return PE1File,PE2File
+
+# returns name->row dictionary of phases in the '--metrics' CSV file
+def LoadMetrics(MetricsFile):
+	Phases = {}
+	with open(MetricsFile) as Metrics:
+		for Row in csv.DictReader(Metrics):
+			Phases[Row["Phase"]] = Row
+	return Phases
+
+# number of source reads, accepted alignments, and correctly and incorrectly aligned simulated reads as reported in align log
+def ParseAlignLog(LogFile):
+	NumReads = Accepted = Correct = Misaligned = 0
+	with open(LogFile) as Log:
+		for Line in Log:
+			Match = re.search(r"From (\d+) source reads there are (\d+) accepted alignments",Line)
+			if Match:
+				NumReads = int(Match.group(1))
+				Accepted = int(Match.group(2))
+			Match = re.search(r"There are (\d+) \(.*\) high confidence aligned simulated reads with (\d+) misaligned",Line)
+			if Match:
+				Correct = int(Match.group(1))
+				Misaligned = int(Match.group(2))
+	return NumReads,Accepted,Correct,Misaligned
+
+def Benchmark(Opts):
+	if not os.path.exists(Opts.workdir):
+		os.makedirs(Opts.workdir)
+	SfxFile = os.path.join(Opts.workdir,"bench.sfx")
+	if not os.path.exists(SfxFile):
+		RunCmd([Opts.biokanga,"index","-i",Opts.genome,"-o",SfxFile,"-r","bench"],os.path.join(Opts.workdir,"index.log"))
+
+	bNewResults = not os.path.exists(Opts.results)
+	with open(Opts.results,"a") as Results:
+		Writer = csv.writer(Results,quoting=csv.QUOTE_NONNUMERIC,lineterminator="\n")
+		if bNewResults:
+			Writer.writerow(ResultsHdr)
+		for NumReads in ParseList(Opts.sizes,int):
+			for ReadLen in ParseList(Opts.readlens,int):
+				for ErrProfile in ParseList(Opts.errprofiles):
+					for bPE in [PE == "pe" for PE in ParseList(Opts.pemodes)]:
+						Dataset = "sim_%d_%d_%s_%s" % (NumReads,ReadLen,ErrProfile,"pe" if bPE else "se")
+						PE1File,PE2File = SimReadset(Opts,Dataset,NumReads,ReadLen,ErrProfile,bPE)
+						for PMode in ParseList(Opts.pmodes):
+							Prefix = os.path.join(Opts.workdir,"%s_%s_%s" % (Opts.build,Dataset,PMode))
+							Args = [Opts.biokanga,"align","-I",SfxFile,"-i",PE1File,"-o",Prefix + ".csv",
+									"-m",str(PModes[PMode]),"-T",str(Opts.threads),"--metrics=" + Prefix + ".metrics.csv"]
+							if bPE:
+								Args += ["-U","1","-u",PE2File,"-d",str(ReadLen * 2),"-D",str(ReadLen * 3)]
+							RunCmd(Args,Prefix + ".log")
+							Phases = LoadMetrics(Prefix + ".metrics.csv")
+							SrcReads,Accepted,Correct,Misaligned = ParseAlignLog(Prefix + ".log")
+							Writer.writerow([Opts.build,Dataset,SrcReads,ReadLen,ErrProfile,"pe" if bPE else "se",PMode,Opts.threads,
+									Accepted,Correct,Misaligned,
+									round(Correct / float(SrcReads),5) if SrcReads else 0.0,
+									round(Correct / float(Correct + Misaligned),5) if Correct + Misaligned else 0.0,
+									float(Phases["total"]["WallSecs"]),float(Phases["align_reads"]["WallSecs"]),
+									float(Phases["align_reads"]["ItemsPerSec"]),int(Phases["total"]["PeakRSSKB"])])
+							Results.flush()
+							if not Opts.keep:
+								os.remove(Prefix + ".csv")
+
+# compare the results of two builds, rows are matched on readset, processing mode and threads
+def Compare(Opts):
+	Builds = ParseList(Opts.compare)
+	if len(Builds) != 2:
+		raise RuntimeError("'--compare' requires exactly two build names, e.g. --compare=old,new")
+	Rows = {}
+	with open(Opts.results) as Results:
+		for Row in csv.DictReader(Results):
+			if Row["Build"] in Builds:
+				Rows[(Row["Build"],Row["Dataset"],Row["PMode"],Row["Threads"])] = Row
+	print("%-40s %-10s %12s %12s %12s %12s" % ("Dataset","PMode","dSens","dPrec","ReadsPerSec%","PeakRSS%"))
+	NumRegressed = 0
+	for Key in sorted(Rows):
+		if Key[0] != Builds[0] or (Builds[1],) + Key[1:] not in Rows:
+			continue
+		Base = Rows[Key]
+		New = Rows[(Builds[1],) + Key[1:]]
+		dSens = float(New["Sensitivity"]) - float(Base["Sensitivity"])
+		dPrec = float(New["Precision"]) - float(Base["Precision"])
+		RateRatio = 100.0 * (float(New["ReadsPerSec"]) / float(Base["ReadsPerSec"]) - 1.0) if float(Base["ReadsPerSec"]) > 0 else 0.0
+		RSSRatio = 100.0 * (float(New["PeakRSSKB"]) / float(Base["PeakRSSKB"]) - 1.0) if float(Base["PeakRSSKB"]) > 0 else 0.0
+		bRegressed = dSens < -Opts.tolerance or dPrec < -Opts.tolerance
+		NumRegressed += 1 if bRegressed else 0
+		print("%-40s %-10s %+12.5f %+12.5f %+11.1f%% %+11.1f%%%s" % (Key[1],Key[2],dSens,dPrec,RateRatio,RSSRatio," <<< accuracy regressed" if bRegressed else ""))
+	return NumRegressed
+
+def main():
+	Parser = argparse.ArgumentParser(description="Benchmark 'biokanga align' accuracy and throughput on simulated readsets")
+	Parser.add_argument("--biokanga",default="biokanga",help="biokanga executable to benchmark")
+	Parser.add_argument("--genome",help="target genome multifasta from which reads are simulated and which is indexed")
+	Parser.add_argument("--workdir",default="align_benchmark",help="directory for readsets, index and alignments, readsets and index are reused if present")
+	Parser.add_argument("--results",default="align_benchmark.csv",help="append results to this CSV file")
+	Parser.add_argument("--build",default="current",help="label results with this build name")
+	Parser.add_argument("--seed",type=int,default=20161218,help="simreads random number generator seed")
+	Parser.add_argument("--threads",type=int,default=0,help="align threads, 0 for all cores")
+	Parser.add_argument("--sizes",default="100000,1000000",help="comma separated readset sizes")
+	Parser.add_argument("--readlens",default="50,100,150",help="comma separated read lengths")
+	Parser.add_argument("--errprofiles",default=",".join(sorted(ErrProfiles)),help="comma separated error profiles from: " + ",".join(sorted(ErrProfiles)))
+	Parser.add_argument("--pemodes",default="se,pe",help="comma separated 'se' and/or 'pe'")
+	Parser.add_argument("--pmodes",default=",".join(sorted(PModes,key=PModes.get)),help="comma separated align modes from: " + ",".join(sorted(PModes,key=PModes.get)))
+	Parser.add_argument("--keep",action="store_true",help="keep alignment files")
+	Parser.add_argument("--compare",help="compare results of two builds, e.g. --compare=old,new, exits with count of readsets with regressed accuracy")
+	Parser.add_argument("--tolerance",type=float,default=0.0005,help="sensitivity or precision decrease greater than this is reported as a regression")
+	Opts = Parser.parse_args()
+
+	if Opts.compare:
+		sys.exit(min(Compare(Opts),255))
+	if not Opts.genome:
+		Parser.error("'--genome' is required when benchmarking")
+	for ErrProfile in ParseList(Opts.errprofiles):
+		if ErrProfile not in ErrProfiles:
+			Parser.error("unknown error profile '%s'" % ErrProfile)
+	for PMode in ParseList(Opts.pmodes):
+		if PMode not in PModes:
+			Parser.error("unknown align mode '%s'" % PMode)
+	Benchmark(Opts)
+
+if __name__ == "__main__":
+	main()
@@ -15,8 +15,10 @@
 #if _WIN32
 #include <process.h>
 #include "../libbiokanga/commhdrs.h"
+#include <psapi.h>
 #else
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <pthread.h>
 #include "../libbiokanga/commhdrs.h"
 #endif
@@ -52,13 +54,43 @@ sNAR CAligner::m_NARdesc[] = {{eNARUnaligned,(char *)"NA",(char *)"Not processed
 
 CAligner::CAligner(void)
 {
+m_pResidentSfxArray = NULL;
+m_bRetainPools = false;
+m_PoolIdentNodes = 0;
+m_pPoolIdentNodes = NULL;
 Init();
 }
 
+// SetResidentSfx
+// Use an already loaded suffix array, e.g. resident when processing spooled alignment jobs, instead of loading from file
+// Caller retains ownership, resident suffix array will not be deleted by this instance
+void
+CAligner::SetResidentSfx(CSfxArrayV3 *pSfxArray)
+{
+m_pResidentSfxArray = pSfxArray;
+}
+
+// RetainPools
+// When an instance is reused for multiple alignment runs, e.g. resident server processing spooled jobs, then allocations which are
+// independent of the reads being aligned are retained for reuse by subsequent runs instead of being reallocated for each run
+void
+CAligner::RetainPools(bool bRetain)
+{
+m_bRetainPools = bRetain;
+if(!bRetain && m_pPoolIdentNodes != NULL && m_pPoolIdentNodes != m_pAllocsIdentNodes)
+	{
+	delete []m_pPoolIdentNodes;
+	m_pPoolIdentNodes = NULL;
+	m_PoolIdentNodes = 0;
+	}
+}
+
 
 CAligner::~CAligner(void)
 {
 Reset(false);
+if(m_pPoolIdentNodes != NULL)
+	delete []m_pPoolIdentNodes;
 }
 
 
@@ -103,6 +135,9 @@ CAligner::Align(etPMode PMode,			// processing mode
 		teSAMFormat SAMFormat,			// if SAM output format then could be SAM or BAM compressed dependent on the file extension used
 		int SitePrefsOfs,				// offset read start sites when processing  octamer preferencing, range -100..100
 		int NumThreads,					// number of worker threads to use
+		UINT32 StreamBatchReads,		// if > 0 then stream reads through alignment and reporting in batches of at most this many reads
+		bool bMemoReadSeqs,				// if true then each distinct read sequence is aligned once with duplicate read sequences reusing that alignment
+		etNUMAMode NUMAMode,			// NUMA placement of alignment threads and suffix array index memory
 		char *pszTrackTitle,			// track title if output format is UCSC BED
 		int NumPE1InputFiles,			// number of input PE1 or single ended file specs
 		char *pszPE1InputFiles[],		// names of input files (wildcards allowed unless processing paired ends) containing raw reads
@@ -115,7 +150,10 @@ CAligner::Align(etPMode PMode,			// processing mode
 		char *pszMarkerFile,			// Output markers to this file
 		char *pszSNPCentroidFile,		// Output SNP centroids (CSV format) to this file (default is for no centroid processing)
 		char *pszSfxFile,				// target as suffix array
+		teSfxLoadMode SfxLoadMode,		// how the suffix array is to be loaded: private memory, or read only shared mapping
+		int SfxKMerIdxLen,				// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
 		char *pszStatsFile,				// aligner induced substitutions stats file
+		char *pszMetricsFile,			// per processing phase timings and counters to this file
 		char *pszMultiAlignFile,		// file to contain reads which are aligned to multiple locations
 		char *pszNoneAlignFile,			// file to contain reads which were non-alignable
 		char *pszSitePrefsFile,			// file to contain aligned reads octamer preferencing
@@ -133,7 +171,12 @@ int BuffOfs = 0;
 int SeqIdx;
 char szPEInsertDistFile[_MAX_PATH];
 char szOutBAIFile[_MAX_PATH];
+int PhaseIdx;
+int TotalPhaseIdx;
 Init();
+m_MetricsStopWatch.Reset();
+m_MetricsStopWatch.Start();
+TotalPhaseIdx = BeginPhase("total");
 
 if(MinChimericLen > 0)					// too confusing if trimming chimeric and then PCR primer trimming or flank exact trimming. Chimeric trimming should handle both PCR and flank exacts
 	PCRPrimerCorrect = 0;
@@ -170,6 +213,7 @@ m_ppszPE2InputFiles = pszPE2InputFiles;
 m_pszMultiAlignFile = pszMultiAlignFile;
 m_pszNoneAlignFile = pszNoneAlignFile;
 m_pszStatsFile = pszStatsFile;
+m_pszMetricsFile = pszMetricsFile;
 m_pszSfxFile = pszSfxFile;
 
 if(bPEInsertLenDist && m_pszStatsFile != NULL && m_pszStatsFile[0] != '\0')
@@ -199,6 +243,9 @@ m_SAMFormat = SAMFormat;
 m_PEproc = PEproc;
 m_QMethod = Quality;
 m_NumThreads = NumThreads;
+m_StreamBatchReads = StreamBatchReads;
+m_bMemoReadSeqs = bMemoReadSeqs;
+m_NUMAMode = NUMAMode;
 m_bBisulfite = bBisulfite;
 m_MaxMLmatches = MaxMLmatches;
 m_bClampMaxMLmatches = bClampMaxMLmatches;
@@ -248,6 +295,7 @@ if(CreateMutexes()!=eBSFSuccess)
 	}
 
 m_mtqsort.SetMaxThreads(NumThreads);
+m_MTRadixSort.SetMaxThreads(NumThreads);
 
 // load contaminants if user has specified a contaminant sequence file
 if(pszContamFile != NULL && pszContamFile[0] != '\0')
@@ -300,20 +348,39 @@ if(pszPriorityRegionFile != NULL && pszPriorityRegionFile[0] != '\0')
 
 
 // open bioseq file containing suffix array for targeted assembly to align reads against
-gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading suffix array file '%s'", pszSfxFile);
-if((m_pSfxArray = new CSfxArrayV3()) == NULL)
+m_SfxKMerIdxLen = SfxKMerIdxLen;
+if(m_NUMAMode != eNUMAoff)
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"NUMA placement: alignment threads will be bound round robin over %d NUMA nodes%s",m_NUMA.Discover(),
+						m_NUMAMode == eNUMAinterleave ? ", suffix array pages interleaved over all nodes" : "");
+
+if(m_pResidentSfxArray != NULL)
 	{
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to instantiate CSfxArrayV3");
-	Reset(false);
-	return(eBSFerrObj);
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Using resident suffix array loaded from file '%s'", pszSfxFile);
+	m_pSfxArray = m_pResidentSfxArray;
 	}
-if((Rslt=m_pSfxArray->Open(pszSfxFile,false,bBisulfite,bSOLiD))!=eBSFSuccess)
+else
 	{
-	while(m_pSfxArray->NumErrMsgs())
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,m_pSfxArray->GetErrMsg());
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to open input bioseq suffix array file '%s'",pszSfxFile);
-	Reset(false);
-	return(Rslt);
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading suffix array file '%s'", pszSfxFile);
+	if((m_pSfxArray = new CSfxArrayV3()) == NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to instantiate CSfxArrayV3");
+		Reset(false);
+		return(eBSFerrObj);
+		}
+	m_pSfxArray->SetLoadMode(SfxLoadMode);
+	m_pSfxArray->AcceptSampledSfx(true);
+	if(m_NUMAMode == eNUMAinterleave)
+		m_pSfxArray->SetNUMAInterleave(true);
+	PhaseIdx = BeginPhase("load_index");
+	if((Rslt=m_pSfxArray->Open(pszSfxFile,false,bBisulfite,bSOLiD))!=eBSFSuccess)
+		{
+		while(m_pSfxArray->NumErrMsgs())
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,m_pSfxArray->GetErrMsg());
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to open input bioseq suffix array file '%s'",pszSfxFile);
+		Reset(false);
+		return(Rslt);
+		}
+	EndPhase(PhaseIdx,0);
 	}
 
 // report to user some sfx array metadata as conformation the targeted assembly is correct
@@ -355,7 +422,8 @@ switch(PMode) {
 	}
 m_pSfxArray->SetMaxIter(MaxIter);
 
-// reads are loaded asynchronously to the alignment processing
+// reads are loaded asynchronously to the alignment processing, loading phase is ended by the reads loader thread
+m_LoadReadsPhaseIdx = BeginPhase("load_reads");
 if((Rslt=InitiateLoadingReads()) < eBSFSuccess)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Failed to load reads");
@@ -398,7 +466,7 @@ if(m_MLMode > eMLrand && m_MLMode < eMLall)
 // if outputting multiloci all then need to allocate memory for these
 if(m_MLMode >= eMLall || m_FMode == eFMsamAll)
 	{
-	size_t memreq = (size_t)(sizeof(tsReadHit) + 150) * 5 * cAllocMultihits;	// read sizes not known yet so assume 100bp reads plus long descriptors plus many multiloci - realloc'd as may be required
+	size_t memreq = cInitAllocMultiAllMem;	// alignments are captured into per thread arenas, this allocation is extended as required when those arenas are merged
 
 #ifdef _WIN32
 	m_pMultiAll = (tsReadHit *) malloc(memreq);	// initial and perhaps the only allocation
@@ -431,7 +499,9 @@ if((Rslt=CreateOrTruncResultFiles())!=eBSFSuccess)
 	{
 	// problems.. need to ensure all background threads (at this stage should only be the reads loading or sfx loading thread) are cleanly terminated
 	m_TermBackgoundThreads = 1;	// need to immediately self-terminate?
-	m_pSfxArray->Reset(false);
+	SignalReadsAvail();
+	if(m_pSfxArray != m_pResidentSfxArray)
+		m_pSfxArray->Reset(false);
 #ifdef _WIN32
 	if(m_hThreadLoadReads != NULL)
 		{
@@ -462,6 +532,19 @@ if((Rslt=CreateOrTruncResultFiles())!=eBSFSuccess)
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Creating/truncating result files completed");
 m_CurReadsSortMode = eRSMReadID;			// reads were loaded and assigned ascending read identifiers so that is their initial sort order
 
+// if streaming then reads are aligned and reported in bounded batches as they are loaded
+if(m_StreamBatchReads > 0)
+	{
+	Rslt = AlignStreamed(PEproc,MinEditDist,PairMinLen,PairMaxLen,bPairStrand,PCRPrimerCorrect,MinFlankExacts,NumIncludeChroms,NumExcludeChroms);
+	if(Rslt >= eBSFSuccess)
+		{
+		EndPhase(TotalPhaseIdx,m_OrigNumReadsLoaded);
+		Rslt = WritePhaseMetrics();
+		}
+	Reset(Rslt >= eBSFSuccess ? true : false);
+	return(Rslt);
+	}
+
 // locate all read matches
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Aligning in %s...",bSOLiD ? "colorspace" : "basespace");
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Aligning for %s cored matches...",bBisulfite ? "bisulfite" : "normal");
@@ -583,11 +666,13 @@ if(PEproc != ePEdefault)
 if(PEproc == ePEdefault && m_MLMode > eMLrand && m_MLMode != eMLall)
 	{
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Multialignment processing started..");
+	PhaseIdx = BeginPhase("multi_matches");
 	if((Rslt = AssignMultiMatches()) < eBSFSuccess)
 		{
 		Reset(false);
 		return(Rslt);
 		}
+	EndPhase(PhaseIdx,m_NumMultiHits);
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Multialignment processing completed");
 	}
 
@@ -597,11 +682,13 @@ IdentifyConstraintViolations(PEproc != ePEdefault);
 if(PEproc == ePEdefault && PCRartefactWinLen >= 0)
 	{
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing to reduce PCR differential amplification artefacts processing started..");
+	PhaseIdx = BeginPhase("pcr_dedupe");
 	if((Rslt=ReducePCRduplicates(PCRartefactWinLen)) < eBSFSuccess)
 		{
 		Reset(false);
 		return(Rslt);
 		}
+	EndPhase(PhaseIdx,m_NumReadsLoaded);
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"PCR differential amplification artefacts processing completed");
 	}
 
@@ -708,6 +795,7 @@ if(m_NARAccepted && m_hSitePrefsFile != -1)
 
 // now time to write out the read hits
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Reporting of aligned result set started...");
+PhaseIdx = BeginPhase("write_hits");
 if(FMode >= eFMsam)
 	{
 	if(m_hJctOutFile != -1 || m_hIndOutFile != -1)	// even though SAM for read alignments, splice and indels are reported as BED format
@@ -729,6 +817,7 @@ if(Rslt < eBSFSuccess)
 	Reset(false);
 	return(Rslt);
 	}
+EndPhase(PhaseIdx,m_NumReadsLoaded);
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Reporting of aligned result set completed");
 
 if(m_bPEInsertLenDist && m_NARAccepted)
@@ -755,7 +844,9 @@ if(Rslt >= eBSFSuccess && m_NARAccepted && MinSNPreads > 0 && m_hSNPfile != -1)
 		}
 	else
 		bMarkers = false;
-	Rslt = ProcessSNPs();			// track title if output format is to be UCSC BED, will have '_SNPs' appended
+	PhaseIdx = BeginPhase("snps");
+	Rslt = ProcessSNPs(PhaseIdx);	// track title if output format is to be UCSC BED, will have '_SNPs' appended
+	EndPhase(PhaseIdx,m_LociBasesCovered);
 	if(Rslt >= eBSFSuccess)
 		{
 		if(bMarkers)
@@ -766,10 +857,417 @@ if(Rslt >= eBSFSuccess && m_NARAccepted && MinSNPreads > 0 && m_hSNPfile != -1)
 	}
 if(gProcessingID != 0)
 	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"SNPs",ePTInt32,sizeof(AvReadsLen),"Cnt",&m_TotNumSNPs);
+if(Rslt >= eBSFSuccess)
+	{
+	EndPhase(TotalPhaseIdx,m_OrigNumReadsLoaded);
+	Rslt = WritePhaseMetrics();
+	}
 Reset(Rslt >= eBSFSuccess ? true : false);
 return(Rslt);
 }
 
+// AlignStreamed
+// Reads are aligned and reported in bounded batches, as each batch is loaded by the reads loader thread, so that memory
+// requirements are independent of the total number of reads. SAM/BAM coordinate sorted output and SNP processing require all reads, so
+// each batch's alignments and accepted reads are spilled as sorted runs into temporary files and these runs are processed once all batches
+// have been aligned. Other phases requiring all reads to be concurrently loaded (multiloci clustering, PCR artefact reduction, orphan splice
+// junction or microInDel removal, stats and site preference processing) will have been excluded by the caller
+int
+CAligner::AlignStreamed(etPEproc PEproc,	// paired reads alignment processing mode
+				  int MinEditDist,		// accepted alignments must be at least this Hamming away from other putative alignments
+				  int PairMinLen,		// only accept paired reads with a combined sequence length of at least this
+				  int PairMaxLen,		// only accept paired reads with a combined sequence length of no more than this
+				  bool bPairStrand,		// accept paired ends if on same strand
+				  int PCRPrimerCorrect,	// if > 0 then correct substitutions in 5' 12bp until overall sub rate within m_MaxSubs
+				  int MinFlankExacts,	// trim matched reads on 5' and 3' flanks until at least this number of exactly matching bases in flanks
+				  int NumIncludeChroms,	// number of chromosome regular expressions to include
+				  int NumExcludeChroms)	// number of chromosome expressions to exclude
+{
+int Rslt;
+int PhaseIdx;
+UINT32 Idx;
+tsReadHit *pReadHit;
+size_t TotReadsLen;
+int AvReadsLen;
+int MinReadsLen;
+int MaxReadsLen;
+
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Aligning in %s...",m_bIsSOLiD ? "colorspace" : "basespace");
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Aligning for %s cored matches, streaming reads in batches of %u...",m_bBisulfite ? "bisulfite" : "normal",m_StreamBatchReads);
+
+TotReadsLen = 0;
+MinReadsLen = -1;
+MaxReadsLen = 0;
+m_StreamBatchID = 0;
+m_bStreamFinalBatch = false;
+Rslt = eBSFSuccess;
+do {
+	m_StreamBatchID += 1;
+	if((Rslt = LocateCoredApprox(MinEditDist,m_InitalAlignSubs)) < eBSFSuccess)
+		break;
+	m_OrigNumReadsLoaded = m_StreamReadIDBase + m_NumReadsLoaded;
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing streamed batch %u containing %u reads, %u reads loaded in all batches",m_StreamBatchID,m_NumReadsLoaded,m_OrigNumReadsLoaded);
+	if(m_NumReadsLoaded == 0)
+		break;
+
+	pReadHit = m_pReadHits;
+	for(Idx = 0; Idx < m_NumReadsLoaded; Idx++)
+		{
+		TotReadsLen += pReadHit->ReadLen;
+		if(MinReadsLen > pReadHit->ReadLen || MinReadsLen == -1)
+			MinReadsLen = pReadHit->ReadLen;
+		if(MaxReadsLen < pReadHit->ReadLen)
+			MaxReadsLen = pReadHit->ReadLen;
+		pReadHit = (tsReadHit *)((UINT8 *)pReadHit + sizeof(tsReadHit) + pReadHit->ReadLen + pReadHit->DescrLen);
+		}
+	m_MaxReadsLen = MaxReadsLen;
+	m_MinReadsLen = MinReadsLen;
+	m_AvReadsLen = (int)(TotReadsLen/m_OrigNumReadsLoaded);
+
+	if(PEproc != ePEdefault)
+		{
+		if((Rslt=ProcessPairedEnds(PEproc,MinEditDist,PairMinLen,PairMaxLen,bPairStrand,m_InitalAlignSubs)) < eBSFSuccess)
+			break;
+		}
+
+	IdentifyConstraintViolations(PEproc != ePEdefault);
+
+	if(PCRPrimerCorrect > 0)
+		{
+		if((Rslt=PCR5PrimerCorrect(m_MaxSubs)) < eBSFSuccess)
+			break;
+		}
+
+	if(MinFlankExacts > 0)
+		{
+		if((Rslt=AutoTrimFlanks(MinFlankExacts)) < eBSFSuccess)
+			break;
+		}
+
+	if(NumExcludeChroms || NumIncludeChroms)
+		{
+		if((Rslt=FiltByChroms()) < eBSFSuccess)
+			break;
+		}
+
+	if(m_pPriorityRegionBED != NULL && m_bFiltPriorityRegions)
+		FiltByPriorityRegions();
+
+	if(m_hNoneAlignFile != -1 || m_gzNoneAlignFile != NULL)
+		{
+		if((Rslt=ReportNoneAligned()) < eBSFSuccess)
+			break;
+		}
+
+	if(m_hMultiAlignFile != -1 || m_gzMultiAlignFile != NULL)
+		{
+		if((Rslt=ReportMultiAlign()) < eBSFSuccess)
+			break;
+		}
+
+	if((Rslt=ReportAlignStats()) < eBSFSuccess)
+		break;
+
+	if((Rslt = WriteReadHits(PEproc == ePEdefault ? false : true)) < eBSFSuccess)
+		break;
+
+	// SAM/BAM alignments and reads for SNP processing are spilled as sorted runs, these runs are processed once all batches have been aligned
+	if(m_FMode >= eFMsam)
+		{
+		if((Rslt = SpillStreamBAMReads(PEproc == ePEdefault ? false : true)) < eBSFSuccess)
+			break;
+		}
+
+	if(m_MinSNPreads > 0 && m_hSNPfile != -1)
+		{
+		if((Rslt = SpillStreamSNPReads()) < eBSFSuccess)
+			break;
+		}
+
+	// when reporting all SAM reads, but not all multiloci, then the captured multiloci alignments are not used so are discarded with each batch
+	if(m_MLMode < eMLall && m_pMultiAll != NULL)
+		{
+		m_NumMultiAll = 0;
+		m_NxtMultiAllOfs = 0;
+		}
+
+	if(!m_bStreamFinalBatch)
+		ReleaseStreamBatch();
+	}
+while(!m_bStreamFinalBatch);
+
+// if terminating early then reads loader could be waiting on a batch to be released, require it to self-terminate
+if(!m_bStreamFinalBatch)
+	{
+	m_TermBackgoundThreads = 1;
+	SignalReadsAvail();
+#ifdef _WIN32
+	if(m_hThreadLoadReads != NULL)
+		{
+		while(WAIT_TIMEOUT == WaitForSingleObject(m_hThreadLoadReads, 5000))
+			{
+			gDiagnostics.DiagOut(eDLInfo,gszProcName,"Progress: waiting for reads load thread to terminate");
+			}
+		CloseHandle(m_hThreadLoadReads);
+		m_hThreadLoadReads = NULL;
+		}
+#else
+	if(m_ThreadLoadReadsID != 0)
+		{
+		struct timespec ts;
+		int JoinRlt;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += 5;
+		while((JoinRlt = pthread_timedjoin_np(m_ThreadLoadReadsID, NULL, &ts)) != 0)
+			{
+			gDiagnostics.DiagOut(eDLInfo,gszProcName,"Progress: waiting for reads load thread to terminate");
+			ts.tv_sec += 60;
+			}
+		m_ThreadLoadReadsID = 0;
+		}
+#endif
+	}
+
+if(Rslt < eBSFSuccess || m_OrigNumReadsLoaded == 0)
+	return(Rslt);
+
+if(m_FMode >= eFMsam)
+	{
+	PhaseIdx = BeginPhase("write_hits");
+	if((Rslt = MergeStreamBAMReads()) < eBSFSuccess)
+		return(Rslt);
+	EndPhase(PhaseIdx,m_OrigNumReadsLoaded);
+	}
+
+m_TotNumSNPs = 0;
+if(m_NARAccepted && m_MinSNPreads > 0 && m_hSNPfile != -1)
+	{
+	bool bMarkers;
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing for SNPs and writing out SNPs to file '%s",m_pszSNPRsltsFile);
+	if(m_hMarkerFile != -1)
+		{
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing for Markers and writing out marker sequences to file '%s",m_pszMarkerFile);
+		bMarkers = true;
+		}
+	else
+		bMarkers = false;
+	PhaseIdx = BeginPhase("snps");
+	if((Rslt = ProcessStreamedSNPs(PhaseIdx)) < eBSFSuccess)
+		return(Rslt);
+	EndPhase(PhaseIdx,m_LociBasesCovered);
+	if(bMarkers)
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Marker processing completed with %d marker sequences writtten to file '%s",m_MarkerID,m_pszMarkerFile);
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"SNP processing completed with %d putative SNPs discovered",m_TotNumSNPs);
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"There are %lld aligned loci bases which are covered by %lld read bases with mean coverage of %1.2f",m_LociBasesCovered,m_LociBasesCoverage,m_LociBasesCoverage/(double)m_LociBasesCovered);
+	}
+if(gProcessingID != 0)
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"SNPs",ePTInt32,sizeof(m_TotNumSNPs),"Cnt",&m_TotNumSNPs);
+DeleteStreamSpills();
+
+AvReadsLen = m_AvReadsLen;
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Average length of all reads was: %d (min: %d, max: %d)",AvReadsLen,MinReadsLen,MaxReadsLen);
+if(gProcessingID > 0)
+	{
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadLen",ePTInt32,sizeof(AvReadsLen),"MeanLen",&AvReadsLen);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadLen",ePTInt32,sizeof(MinReadsLen),"MinLen",&MinReadsLen);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadLen",ePTInt32,sizeof(MaxReadsLen),"MaxLen",&MaxReadsLen);
+	}
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Provisionally accepted %d aligned reads (%d uniquely, %d aligning to multiloci) aligning to a total of %d loci", m_TotAcceptedAsAligned,m_TotAcceptedAsUniqueAligned,m_TotAcceptedAsMultiAligned,m_TotLociAligned);
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Reporting of aligned result set completed, %u reads were streamed in %u batches",m_OrigNumReadsLoaded,m_StreamBatchID);
+return(eBSFSuccess);
+}
+
+// ProcessResources
+// Returns process CPU time (user + system, summed over all threads) and peak resident set size
+void
+CAligner::ProcessResources(double *pCPUSecs,		// returned process CPU time (user + system over all threads)
+				  INT64 *pPeakRSSKB)				// returned process peak resident set size in KB
+{
+#ifdef _WIN32
+FILETIME CreationTime;
+FILETIME ExitTime;
+FILETIME KernelTime;
+FILETIME UserTime;
+PROCESS_MEMORY_COUNTERS MemCounters;
+*pCPUSecs = 0.0;
+*pPeakRSSKB = 0;
+if(GetProcessTimes(GetCurrentProcess(),&CreationTime,&ExitTime,&KernelTime,&UserTime))
+	*pCPUSecs = ((((UINT64)KernelTime.dwHighDateTime << 32) | KernelTime.dwLowDateTime) +
+				(((UINT64)UserTime.dwHighDateTime << 32) | UserTime.dwLowDateTime)) / 10000000.0;	// FILETIMEs are in 100ns units
+if(GetProcessMemoryInfo(GetCurrentProcess(),&MemCounters,sizeof(MemCounters)))
+	*pPeakRSSKB = (INT64)(MemCounters.PeakWorkingSetSize / 1024);
+#else
+struct rusage Usage;
+*pCPUSecs = 0.0;
+*pPeakRSSKB = 0;
+if(getrusage(RUSAGE_SELF,&Usage) == 0)
+	{
+	*pCPUSecs = (double)Usage.ru_utime.tv_sec + (Usage.ru_utime.tv_usec / 1000000.0) +
+				(double)Usage.ru_stime.tv_sec + (Usage.ru_stime.tv_usec / 1000000.0);
+	*pPeakRSSKB = (INT64)Usage.ru_maxrss;	// Linux reports in KB
+	}
+#endif
+}
+
+double
+CAligner::MetricsWallSecs(void)		// returns wall time in seconds since metrics stopwatch started
+{
+unsigned long Secs;
+unsigned long USecs;
+Secs = m_MetricsStopWatch.ReadUSecs(&USecs);
+return((double)Secs + (USecs / 1000000.0));
+}
+
+// BeginPhase
+// Start timing named processing phase; if phase has previously been timed then metrics will be accumulated
+// Returns phase index to be used when ending the phase, or -1 if no more phases can be timed
+int
+CAligner::BeginPhase(const char *pszPhase)
+{
+int PhaseIdx;
+tsPhaseMetrics *pPhase;
+
+pPhase = m_PhaseMetrics;
+for(PhaseIdx = 0; PhaseIdx < m_NumPhaseMetrics; PhaseIdx++,pPhase++)
+	if(!stricmp(pPhase->szPhase,pszPhase))
+		break;
+if(PhaseIdx == m_NumPhaseMetrics)
+	{
+	if(m_NumPhaseMetrics == cMaxPhaseMetrics)
+		return(-1);
+	memset(pPhase,0,sizeof(tsPhaseMetrics));
+	strncpy(pPhase->szPhase,pszPhase,cMaxPhaseNameLen);
+	pPhase->szPhase[cMaxPhaseNameLen] = '\0';
+	pPhase->StartSecs = MetricsWallSecs();
+	m_NumPhaseMetrics += 1;
+	}
+pPhase->NumEntered += 1;
+pPhase->bActive = true;
+pPhase->EnteredSecs = MetricsWallSecs();
+ProcessResources(&pPhase->EnteredCPUSecs,&pPhase->PeakRSSKB);
+return(PhaseIdx);
+}
+
+void
+CAligner::EndPhase(int PhaseIdx,	// end timing this processing phase
+				  INT64 NumItems)	// which processed this many items
+{
+tsPhaseMetrics *pPhase;
+double CPUSecs;
+if(PhaseIdx < 0 || PhaseIdx >= m_NumPhaseMetrics)
+	return;
+pPhase = &m_PhaseMetrics[PhaseIdx];
+if(!pPhase->bActive)
+	return;
+ProcessResources(&CPUSecs,&pPhase->PeakRSSKB);
+pPhase->WallSecs += MetricsWallSecs() - pPhase->EnteredSecs;
+pPhase->CPUSecs += CPUSecs - pPhase->EnteredCPUSecs;
+pPhase->NumItems += NumItems;
+pPhase->bActive = false;
+}
+
+void
+CAligner::AddPhaseThreadWork(int PhaseIdx,	// accumulate per thread work counts for this processing phase
+				  int ThreadIdx,			// work count is for this thread (0..N)
+				  INT64 Work)				// thread processed this many items
+{
+tsPhaseMetrics *pPhase;
+if(PhaseIdx < 0 || PhaseIdx >= m_NumPhaseMetrics || ThreadIdx < 0 || ThreadIdx >= cMaxWorkerThreads)
+	return;
+pPhase = &m_PhaseMetrics[PhaseIdx];
+pPhase->ThreadWork[ThreadIdx] += Work;
+if(pPhase->NumThreads <= ThreadIdx)
+	pPhase->NumThreads = ThreadIdx + 1;
+}
+
+// WritePhaseMetrics
+// Writes per processing phase metrics to m_pszMetricsFile, as JSON if file extension is '.json' otherwise as CSV
+// Any phases still being timed, e.g. 'total', are ended prior to writing
+int
+CAligner::WritePhaseMetrics(void)
+{
+int hMetricsFile;
+int PhaseIdx;
+int ThreadIdx;
+int BuffIdx;
+int NameLen;
+bool bJSON;
+double ItemsPerSec;
+tsPhaseMetrics *pPhase;
+char szLineBuff[cMaxWorkerThreads * 24 + 1024];
+
+if(m_pszMetricsFile == NULL || m_pszMetricsFile[0] == '\0' || m_NumPhaseMetrics == 0)
+	return(eBSFSuccess);
+
+NameLen = (int)strlen(m_pszMetricsFile);
+bJSON = NameLen >= 5 && !stricmp(".json",&m_pszMetricsFile[NameLen-5]);
+
+#ifdef _WIN32
+hMetricsFile = open(m_pszMetricsFile,( O_WRONLY | _O_BINARY | _O_SEQUENTIAL | _O_CREAT | _O_TRUNC),(_S_IREAD | _S_IWRITE) );
+#else
+if((hMetricsFile = open(m_pszMetricsFile,O_WRONLY | O_CREAT,S_IREAD | S_IWRITE))!=-1)
+	if(ftruncate(hMetricsFile,0)!=0)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to truncate metrics %s - %s",m_pszMetricsFile,strerror(errno));
+		close(hMetricsFile);
+		return(eBSFerrCreateFile);
+		}
+#endif
+if(hMetricsFile < 0)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: unable to create/truncate output metrics file '%s'",m_pszMetricsFile);
+	return(eBSFerrCreateFile);
+	}
+
+if(bJSON)
+	BuffIdx = snprintf(szLineBuff,sizeof(szLineBuff),"{\n \"threads\": %d,\n \"phases\": [",m_NumThreads);
+else
+	BuffIdx = snprintf(szLineBuff,sizeof(szLineBuff),"\"Phase\",\"Entered\",\"StartSecs\",\"WallSecs\",\"CPUSecs\",\"PeakRSSKB\",\"Items\",\"ItemsPerSec\",\"ThreadWork\"\n");
+CUtility::SafeWrite(hMetricsFile,szLineBuff,BuffIdx);
+
+pPhase = m_PhaseMetrics;
+for(PhaseIdx = 0; PhaseIdx < m_NumPhaseMetrics; PhaseIdx++,pPhase++)
+	{
+	EndPhase(PhaseIdx,0);
+	ItemsPerSec = pPhase->WallSecs > 0.0 ? pPhase->NumItems / pPhase->WallSecs : 0.0;
+	if(bJSON)
+		{
+		BuffIdx = snprintf(szLineBuff,sizeof(szLineBuff),"%s\n  {\"phase\": \"%s\", \"entered\": %d, \"start_secs\": %.3f, \"wall_secs\": %.3f, \"cpu_secs\": %.3f, \"peak_rss_kb\": %lld, \"items\": %lld, \"items_per_sec\": %.1f, \"thread_work\": [",
+							PhaseIdx == 0 ? "" : ",",pPhase->szPhase,pPhase->NumEntered,pPhase->StartSecs,pPhase->WallSecs,pPhase->CPUSecs,pPhase->PeakRSSKB,pPhase->NumItems,ItemsPerSec);
+		for(ThreadIdx = 0; ThreadIdx < pPhase->NumThreads && BuffIdx < (int)sizeof(szLineBuff) - 32; ThreadIdx++)
+			BuffIdx += snprintf(&szLineBuff[BuffIdx],sizeof(szLineBuff) - BuffIdx,"%s%lld",ThreadIdx == 0 ? "" : ",",pPhase->ThreadWork[ThreadIdx]);
+		if(BuffIdx < (int)sizeof(szLineBuff) - 32)
+			BuffIdx += snprintf(&szLineBuff[BuffIdx],sizeof(szLineBuff) - BuffIdx,"]}");
+		}
+	else
+		{
+		BuffIdx = snprintf(szLineBuff,sizeof(szLineBuff),"\"%s\",%d,%.3f,%.3f,%.3f,%lld,%lld,%.1f,\"",
+							pPhase->szPhase,pPhase->NumEntered,pPhase->StartSecs,pPhase->WallSecs,pPhase->CPUSecs,pPhase->PeakRSSKB,pPhase->NumItems,ItemsPerSec);
+		for(ThreadIdx = 0; ThreadIdx < pPhase->NumThreads && BuffIdx < (int)sizeof(szLineBuff) - 32; ThreadIdx++)
+			BuffIdx += snprintf(&szLineBuff[BuffIdx],sizeof(szLineBuff) - BuffIdx,"%s%lld",ThreadIdx == 0 ? "" : ";",pPhase->ThreadWork[ThreadIdx]);
+		if(BuffIdx < (int)sizeof(szLineBuff) - 32)
+			BuffIdx += snprintf(&szLineBuff[BuffIdx],sizeof(szLineBuff) - BuffIdx,"\"\n");
+		}
+	if(BuffIdx >= (int)sizeof(szLineBuff))		// snprintf returns the untruncated length
+		BuffIdx = (int)sizeof(szLineBuff) - 1;
+	CUtility::SafeWrite(hMetricsFile,szLineBuff,BuffIdx);
+	}
+if(bJSON)
+	{
+	BuffIdx = snprintf(szLineBuff,sizeof(szLineBuff),"\n ]\n}\n");
+	CUtility::SafeWrite(hMetricsFile,szLineBuff,BuffIdx);
+	}
+
+#ifdef _WIN32
+_commit(hMetricsFile);
+#else
+fsync(hMetricsFile);
+#endif
+close(hMetricsFile);
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Per processing phase metrics written to file '%s'",m_pszMetricsFile);
+return(eBSFSuccess);
+}
+
 void
 CAligner::Init(void)
 {
@@ -808,13 +1306,16 @@ m_ppReadHitsIdx = NULL;
 m_ppReadHitsIdx = NULL;
 m_pMultiHits = NULL;
 m_pMultiAll = NULL;
-m_pLociPValues = NULL;
+m_pSNPChromSpans = NULL;
 m_pSfxArray = NULL;
+m_SfxKMerIdxLen = 0;
+m_pszMetricsFile = NULL;
+m_NumPhaseMetrics = 0;
+m_LoadReadsPhaseIdx = -1;
 m_pPriorityRegionBED = NULL;
 m_pAllocsIdentNodes = NULL;
 m_pAllocsMultiHitLoci = NULL;
 m_pAllocsMultiHitBuff = NULL;
-m_pChromSNPs = NULL;
 m_pszLineBuff = NULL;
 m_pLenDist = NULL;
 m_pSNPCentroids = NULL;
@@ -827,6 +1328,29 @@ m_bSNPsVCF = false;
 m_LociBasesCovered = 0;
 m_LociBasesCoverage = 0;
 m_PrevSizeOf = 0;
+m_StreamBatchReads = 0;
+m_bMemoReadSeqs = false;
+m_NUMAMode = eNUMAoff;
+m_TotMemoReused = 0;
+m_StreamBatchID = 0;
+m_bStreamBatchReady = false;
+m_bStreamFinalBatch = false;
+m_StreamReadIDBase = 0;
+memset(m_StreamAlignCnts,0,sizeof(m_StreamAlignCnts));
+m_bStreamSimReads = false;
+m_pStreamSpillBuff = NULL;
+m_hStreamBAMFile = -1;
+m_szStreamBAMFile[0] = '\0';
+m_StreamBAMFileLen = 0;
+m_NumStreamBAMRuns = 0;
+m_AllocStreamBAMRuns = 0;
+m_pStreamBAMRuns = NULL;
+m_hStreamSNPFile = -1;
+m_szStreamSNPFile[0] = '\0';
+m_StreamSNPFileLen = 0;
+m_NumStreamSNPRuns = 0;
+m_AllocStreamSNPRuns = 0;
+m_pStreamSNPRuns = NULL;
 m_NumMultiAll = 0;
 m_NxtMultiAllOfs = 0;
 m_AllocMultiAllMem = 0;
@@ -860,12 +1384,18 @@ m_AlignStrand = eALSnone;
 m_MinChimericLen = 0;
 m_microInDelLen = 0;
 m_SpliceJunctLen = 0;
-m_AllocLociPValuesMem = 0;
-m_NumLociPValues = 0;
+m_AllocSNPChromSpans = 0;
+m_NumSNPChromSpans = 0;
+m_NxtSNPChromSpan = 0;
+m_NxtSNPCommitSpan = 0;
+m_bSNPTermThreads = false;
+m_NumWriteHitsChunks = 0;
+m_NxtWriteHitsChunk = 0;
+m_NxtWriteHitsCommit = 0;
+m_bWriteHitsTermThreads = false;
 m_QValue = 0.0;
 m_MinSNPreads = 0;
 m_SNPNonRefPcnt = 0.0; 
-m_MaxDiSNPSep = cDfltMaxDiSNPSep;
 m_MarkerID = 0;	
 m_Marker5Len = 0;
 m_Marker3Len = 0;
@@ -901,6 +1431,12 @@ m_bFiltPriorityRegions = false;
 m_SAMFormat = etSAMFformat;
 m_CurReadsSortMode = eRSMunsorted;
 m_ThreadCoredApproxRslt = 0;
+m_NumReadsWaiting = 0;
+m_ReadsQueueWaits = 0;
+m_ReadsQueueIdleUSecs = 0;
+m_ReadsQueueBlocks = 0;
+m_ReadsQueueDepthSum = 0;
+m_ReadsQueueDepthMax = 0;
 
 #ifdef _WIN32
 m_hThreadLoadReads = NULL;
@@ -921,6 +1457,12 @@ if(m_hInFile != -1)
 	close(m_hInFile);
 	m_hInFile = -1;
 	}
+if(m_gzOutFile != NULL)			// closed before m_hOutFile as both share the same output file
+	{
+	gzclose(m_gzOutFile);
+	m_gzOutFile = NULL;
+	}
+
 if(m_hOutFile != -1)
 	{
 	if(bSync)
@@ -1098,12 +1640,6 @@ if(m_pConstraintLoci != NULL)
 	m_pConstraintLoci = NULL;
 	}
 
-if(m_gzOutFile != NULL)
-	{
-	gzclose(m_gzOutFile);
-	m_gzOutFile = NULL;
-	}
-
 if(m_gzIndOutFile != NULL)
 	{
 	gzclose(m_gzIndOutFile);
@@ -1147,7 +1683,8 @@ if(m_pszLineBuff != NULL)
 	}
 if(m_pAllocsIdentNodes != NULL)
 	{
-	delete m_pAllocsIdentNodes;
+	if(m_pAllocsIdentNodes != m_pPoolIdentNodes)
+		delete []m_pAllocsIdentNodes;
 	m_pAllocsIdentNodes = NULL;
 	}
 
@@ -1164,7 +1701,8 @@ if(m_pAllocsMultiHitLoci != NULL)
 	}
 if(m_pSfxArray != NULL)
 	{
-	delete m_pSfxArray;
+	if(m_pSfxArray != m_pResidentSfxArray)
+		delete m_pSfxArray;
 	m_pSfxArray = NULL;
 	}
 if(m_pPriorityRegionBED != NULL)
@@ -1211,22 +1749,15 @@ if(m_pMultiHits != NULL)
 	m_pMultiHits = NULL;
 	}
 
-if(m_pLociPValues != NULL)
+if(m_pSNPChromSpans != NULL)
 	{
-#ifdef _WIN32
-	free(m_pLociPValues);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
-#else
-	if(m_pLociPValues != MAP_FAILED)
-		munmap(m_pLociPValues,m_AllocLociPValuesMem);
-#endif
-	m_pLociPValues = NULL;
+	free(m_pSNPChromSpans);
+	m_pSNPChromSpans = NULL;
 	}
+m_AllocSNPChromSpans = 0;
+m_NumSNPChromSpans = 0;
 
-if(m_pChromSNPs != NULL)
-	{
-	delete m_pChromSNPs;
-	m_pChromSNPs = NULL;
-	}
+DeleteStreamSpills();
 
 if(m_pLenDist != NULL)
 	{
@@ -1620,8 +2151,11 @@ if((Rslt=SortReadHits(eRSMHitMatch,false)) < eBSFSuccess)
 	return(Rslt);
 	}
 
-m_ElimPlusTrimed = 0;
-m_ElimMinusTrimed = 0;
+if(m_StreamBatchID <= 1)		// if streaming batches then trimming counts are accumulated over all batches
+	{
+	m_ElimPlusTrimed = 0;
+	m_ElimMinusTrimed = 0;
+	}
 if(MinFlankExacts > 0)	// do  3' and 5' autotrim? Note that currently can't trim multiseg hits
 	{
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Starting 5' and 3' flank sequence autotrim processing...");
@@ -2894,7 +3428,9 @@ int NumFilteredByChrom = 0;
 
 int AcceptedNumPaired = 0;
 int AcceptedNumSE = 0;
+int PhaseIdx;
 
+PhaseIdx = BeginPhase("paired_ends");
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Generating paired reads index over %d paired reads", m_NumReadsLoaded/2);
 SortReadHits(eRSMPairReadID,false,true);
 
@@ -2954,12 +3490,15 @@ for (ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++, NumThreadsUsed += 1)
 		}
 	}
 
-// allow threads a few seconds to startup
+// allow threads a few seconds to startup, not worth the latency if processing a spooled job
+if(m_pResidentSfxArray == NULL)
+	{
 #ifdef _WIN32
-Sleep(5000);
+	Sleep(5000);
 #else
-sleep(5);
+	sleep(5);
 #endif
+	}
 
 UINT32 ReportProgressSecs;
 ReportProgressSecs = 60;
@@ -2995,7 +3534,9 @@ for (ThreadIdx = 0; ThreadIdx < NumThreadsUsed; ThreadIdx++)
 	UnalignedPairs += WorkerThreads[ThreadIdx].UnalignedPairs;
 	AcceptedNumSE += WorkerThreads[ThreadIdx].AcceptedNumSE;
 	PartnerUnpaired += WorkerThreads[ThreadIdx].PartnerUnpaired;
+	AddPhaseThreadWork(PhaseIdx,ThreadIdx,WorkerThreads[ThreadIdx].NumPairsToProcess);
 	}
+EndPhase(PhaseIdx,m_NumReadsLoaded / 2);
 
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Completed association of Paired End reads from %u pairs, accepted %u pairs", m_NumReadsLoaded /2,AcceptedNumPaired);
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"From %d Paired End pairs there were %d accepted (of which %d pairs were from recovered orphans)",
@@ -3532,6 +4073,7 @@ UINT32 NARPEStrand = 0;					// not accepted as aligned because PE aligning and a
 UINT32 NARPEChrom = 0;					// not accepted as aligned because PE aligning and although able to align this read other read was aligned to different chromosome
 UINT32 NARPEUnalign = 0;				// not accepted as aligned because PE aligning and unable to accept this alignment
 UINT32 NARLociConstrained = 0;			// not accepted as aligned because alignment violated loci base constraints
+int CntIdx;
 if((Rslt=SortReadHits(eRSMHitMatch,false)) < eBSFSuccess)
 	{
 	Reset(false);
@@ -3719,6 +4261,27 @@ while((pReadHit = IterReads(pReadHit))!=NULL)
 		}
 	}
 
+// if streaming batches then counts are accumulated over all batches with reporting only after the final batch has been processed
+if(m_StreamBatchReads > 0)
+	{
+	UINT32 *pCnts[cNumStreamAlignCnts] = {&NumUniques,&NumPlusHits,&NumNoMatches,&NumChimeric,&NumMultiMatches,&NumHamming,
+								&NumReads1EdgeAligned,&NumReads2EdgeAligned,&NumReadsMisaligned,&NumIndels,&NumSpliced,&NumTrimmed,
+								&NARUnaligned,&NARAccepted,&NARNoHit,&NARMMDelta,&NARMultiAlign,&NARTrim,&NARSpliceJctn,&NARmicroInDel,
+								&NARPCRdup,&NARNonUnique,&NARChromFilt,&NARRegionFilt,&NARPEInsertMin,&NARPEInsertMax,&NARPENoHit,
+								&NARPEStrand,&NARPEChrom,&NARPEUnalign,&NARLociConstrained};
+	for(CntIdx = 0; CntIdx < cNumStreamAlignCnts; CntIdx++)
+		{
+		m_StreamAlignCnts[CntIdx] += *pCnts[CntIdx];
+		*pCnts[CntIdx] = m_StreamAlignCnts[CntIdx];
+		}
+	if(bSimReads)
+		m_bStreamSimReads = true;
+	bSimReads = m_bStreamSimReads;
+	m_NARAccepted = NARAccepted;
+	if(!m_bStreamFinalBatch)
+		return(eBSFSuccess);
+	}
+
 if(m_MLMode >= eMLall)
 	NumNoMatches = m_TotNonAligned;
 NumNoMatches += m_NumSloughedNs;
@@ -3772,7 +4335,7 @@ if(gProcessingID > 0)
 	{
 	UINT32 Cricks;
 	Cricks = NumUniques-NumPlusHits;
-	if(m_MLMode >= eMLall)
+	if(m_MLMode >= eMLall || m_StreamBatchReads > 0)
 		gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"Alignments",ePTUint32,sizeof(m_OrigNumReadsLoaded),"NumLoaded",&m_OrigNumReadsLoaded);
 	else
 		gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"Alignments",ePTUint32,sizeof(m_NumReadsLoaded),"NumLoaded",&m_NumReadsLoaded);
@@ -3856,7 +4419,7 @@ if(m_hNoneAlignFile != -1 || m_gzNoneAlignFile != NULL)
 		for(SeqIdx = 0; SeqIdx < pReadHit->ReadLen; SeqIdx++,pSeq++,pSeqVal++)
 			*pSeq = (*pSeqVal & 0x07);
 
-		LineLen += sprintf(&m_pszLineBuff[LineLen],">lcl|na|%d %s %d|%d|%d\n",pReadHit->ReadID,pReadHit->Read,pReadHit->ReadID,pReadHit->NumReads,pReadHit->ReadLen);
+		LineLen += sprintf(&m_pszLineBuff[LineLen],">lcl|na|%d %s %d|%d|%d\n",m_StreamReadIDBase + pReadHit->ReadID,pReadHit->Read,m_StreamReadIDBase + pReadHit->ReadID,pReadHit->NumReads,pReadHit->ReadLen);
 		if((LineLen + (2 * cMaxFastQSeqLen)) > cAllocLineBuffSize)
 			{
 			if(m_hNoneAlignFile != -1)
@@ -3901,6 +4464,9 @@ if(m_hNoneAlignFile != -1 || m_gzNoneAlignFile != NULL)
 			CUtility::SafeWrite_gz(m_gzNoneAlignFile,m_pszLineBuff,LineLen);
 		}
 
+	if(m_StreamBatchReads > 0)		// streamed batches are appended, file is closed by Reset() after the final batch
+		return(eBSFSuccess);
+
 	if(m_hNoneAlignFile != -1)
 		{
 #ifdef _WIN32
@@ -3949,7 +4515,7 @@ if(m_hMultiAlignFile != -1 || m_gzMultiAlignFile != NULL)
 		for(SeqIdx = 0; SeqIdx < pReadHit->ReadLen; SeqIdx++,pSeq++,pSeqVal++)
 			*pSeq = (*pSeqVal & 0x07);
 
-		LineLen += sprintf(&m_pszLineBuff[LineLen],">lcl|ml|%d %s %d|%d|%d\n",pReadHit->ReadID,pReadHit->Read,pReadHit->ReadID,pReadHit->NumReads,pReadHit->ReadLen);
+		LineLen += sprintf(&m_pszLineBuff[LineLen],">lcl|ml|%d %s %d|%d|%d\n",m_StreamReadIDBase + pReadHit->ReadID,pReadHit->Read,m_StreamReadIDBase + pReadHit->ReadID,pReadHit->NumReads,pReadHit->ReadLen);
 		if((LineLen + (2 * cMaxFastQSeqLen)) > cAllocLineBuffSize)
 			{
 			if(m_hMultiAlignFile != -1)
@@ -3994,6 +4560,9 @@ if(m_hMultiAlignFile != -1 || m_gzMultiAlignFile != NULL)
 			CUtility::SafeWrite_gz(m_gzMultiAlignFile,m_pszLineBuff,LineLen);
 		}
 
+	if(m_StreamBatchReads > 0)		// streamed batches are appended, file is closed by Reset() after the final batch
+		return(eBSFSuccess);
+
 	if(m_hMultiAlignFile != -1)
 		{
 #ifdef _WIN32
@@ -4361,27 +4930,27 @@ m_bgzMultiAlignFile = FileReqWriteCompr(m_pszMultiAlignFile);
 // create/truncate all output reporting files
 if(m_FMode < eFMsam)
 	{
-	if(!m_bgzOutFile)
-		{
 #ifdef _WIN32
-		m_hOutFile = open(m_pszOutFile,( O_WRONLY | _O_BINARY | _O_SEQUENTIAL | _O_CREAT | _O_TRUNC),(_S_IREAD | _S_IWRITE));
+	m_hOutFile = open(m_pszOutFile,( O_WRONLY | _O_BINARY | _O_SEQUENTIAL | _O_CREAT | _O_TRUNC),(_S_IREAD | _S_IWRITE));
 #else
-		if((m_hOutFile = open(m_pszOutFile,O_WRONLY | O_CREAT,S_IREAD | S_IWRITE))!=-1)
-			if(ftruncate(m_hOutFile,0)!=0)
-					{
-					gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to truncate %s - %s",m_pszOutFile,strerror(errno));
-					return(eBSFerrCreateFile);
-					}
+	if((m_hOutFile = open(m_pszOutFile,O_WRONLY | O_CREAT,S_IREAD | S_IWRITE))!=-1)
+		if(ftruncate(m_hOutFile,0)!=0)
+				{
+				gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to truncate %s - %s",m_pszOutFile,strerror(errno));
+				return(eBSFerrCreateFile);
+				}
 #endif
-		if(m_hOutFile < 0)
-			{
-			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: unable to create/truncate output file '%s'",m_pszOutFile);
-			return(eBSFerrCreateFile);
-			}
+	if(m_hOutFile < 0)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: unable to create/truncate output file '%s'",m_pszOutFile);
+		return(eBSFerrCreateFile);
 		}
-	else
+
+	// when compressing then m_gzOutFile shares the file offset with m_hOutFile so that CSV and BED formatting threads
+	// are able to directly write their pre-compressed gzip members, see WriteSortedReadHits()
+	if(m_bgzOutFile)
 		{
-		m_gzOutFile = gzopen(m_pszOutFile,"wb");
+		m_gzOutFile = gzdopen(dup(m_hOutFile),"wb");
 		if(m_gzOutFile == NULL)
 			{
 			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: unable to create/truncate output file '%s'",m_pszOutFile);
@@ -4808,6 +5377,7 @@ tsLoadReadsThreadPars *pPars = (tsLoadReadsThreadPars *)pThreadPars;			// makes
 CAligner *pAligner = (CAligner *)pPars->pThis;
 Rslt = pAligner->ProcLoadReadFiles(pPars);
 pPars->Rslt = Rslt;
+pAligner->SignalReadsAvail();		// any aligner threads waiting on more reads need to know that loading has completed
 #ifdef _WIN32
 _endthreadex(0);
 return(eBSFSuccess);
@@ -5125,7 +5695,7 @@ if(m_MLMode <= eMLrand)		// nothing to do?
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Assigning %d reads which aligned to multiple loci to a single loci",m_NumProvMultiAligned);
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Sorting...");
 SortReadHits(eRSMReadID,false);
-m_mtqsort.qsort(m_pMultiHits,m_NumMultiHits,sizeof(tsReadHit),SortMultiHits);
+m_mtqsort.qsort<tsReadHit,SortMultiHits>(m_pMultiHits,m_NumMultiHits);
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Sorting completed, now clustering...");
 
 RunClusteringThreads(m_NumThreads);
@@ -5133,7 +5703,7 @@ RunClusteringThreads(m_NumThreads);
 // sort now by ascending ReadID and descending scores
 // and assign the read match with the highest score to that read
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Assigning...");
-m_mtqsort.qsort(m_pMultiHits,m_NumMultiHits,sizeof(tsReadHit),SortMultiHitReadIDs);
+m_mtqsort.qsort<tsReadHit,SortMultiHitReadIDs>(m_pMultiHits,m_NumMultiHits);
 UINT32 CurReadID = 0;
 UINT32 BestScore;
 UINT32 NxtBestScore;
@@ -5182,7 +5752,7 @@ for(HitIdx=0;HitIdx < m_NumMultiHits; HitIdx++,pCurHit++)
 // need to ensure that as a result of the assignments no assigned multialigned read is now actually an orphan
 // orphans are those assigned as eHLclustany if within the window there are no other assigned multireads...
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Checking for orphans (unclustered) from %d putative assignments..",NumAssigned);
-m_mtqsort.qsort(m_pMultiHits,m_NumMultiHits,sizeof(tsReadHit),SortMultiHits);
+m_mtqsort.qsort<tsReadHit,SortMultiHits>(m_pMultiHits,m_NumMultiHits);
 NumUnlocated = 0;
 ClusterUniqueAssigned = 0;
 ClusterAllAssigned = 0;
@@ -5583,7 +6153,7 @@ switch(SAMFormat) {
 		break;
 	}
 
-if((Rslt = pSAMfile->Create(FileType,m_pszOutFile,ComprLev,(char *)cpszProgVer)) < eBSFSuccess)
+if((Rslt = pSAMfile->Create(FileType,m_pszOutFile,ComprLev,(char *)cpszProgVer,m_NumThreads)) < eBSFSuccess)
 	{
 	delete pSAMfile;
 	return(Rslt);
@@ -6335,914 +6905,1042 @@ return(eBSFSuccess);
 int
 CAligner::WriteReadHits(bool bPEProc)		   // true if processing paired ends	
 {
-const char *pszBsMap;
 int LineLen;
-char szChromName[128];
-int SeqIdx;
-etSeqBase ReadSeq[cMaxFastQSeqLen+1];	// to hold sequence (sans quality scores) for current read
-etSeqBase AssembSeq[cMaxFastQSeqLen+1];	// to hold targeted genome assembly sequence
-
-UINT8 *pSeqVal;
-etSeqBase *pReadSeq;
-
-tsReadHit *pReadHit;
-tBSFEntryID PrevTargEntry;
 
 if(m_FMode > eFMbed && (m_hJctOutFile == -1 && m_hIndOutFile == -1))
 	return(0);
 
 m_MaxAlignLen = 0;
 
-if(m_FMode == eFMbed)
-	{
-	LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"%s\" description=\"%s\"\n",m_pszTrackTitle,m_pszTrackTitle);
-	if(!m_bgzOutFile)
-		CUtility::SafeWrite(m_hOutFile,m_pszLineBuff,LineLen);
-	else
-		CUtility::SafeWrite_gz(m_gzOutFile,m_pszLineBuff,LineLen);
-	}
-
-if(m_hJctOutFile != -1)
-	{
-	LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"JCT_%s\" description=\"%s\"\n",m_pszTrackTitle,m_pszTrackTitle);
-	CUtility::SafeWrite(m_hJctOutFile,m_pszLineBuff,LineLen);
-	}
-
-if(m_hIndOutFile != -1)
-	{
-	LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"IND_%s\" description=\"%s\"\n",m_pszTrackTitle,m_pszTrackTitle);
-	CUtility::SafeWrite(m_hIndOutFile,m_pszLineBuff,LineLen);
-	}
-LineLen = 0;
-
-pReadHit = NULL;
-LineLen = 0;
-PrevTargEntry = 0;
-const char *pszAlignType;
-
-bool bPrevInDelSeg = false;
-bool bPrevJunctSeg = false;
-bool bPrevAlignSeg = false;
-bool bSkipBEDformat = false;;
-
-while((pReadHit = IterSortedReads(pReadHit))!=NULL)
-	{
-	bSkipBEDformat = false;
-	if(pReadHit->NAR == eNARAccepted)
-		{
-		if(pReadHit->HitLoci.Hit.FlgInDel)
-			pszAlignType = "ari";
-		else
-			if(pReadHit->HitLoci.Hit.FlgSplice)
-				pszAlignType = "arj";
-			else
-				{
-				pszAlignType = "ar";
-				if(m_FMode > eFMbed)
-					bSkipBEDformat = true;
-				}
-
-		if(pReadHit->HitLoci.FlagIA == 1)
-			{
-			if(pReadHit->HitLoci.Hit.FlgInDel)
-				pszAlignType = "iari";
-			else
-				if(pReadHit->HitLoci.Hit.FlgSplice)
-					pszAlignType = "iarj";
-				else
-					{
-					pszAlignType = "iar";
-					if(m_FMode > eFMbed)
-						bSkipBEDformat = true;
-					}
-			}
-		else
-			{
-			if(pReadHit->HitLoci.Hit.FlgInDel)
-				pszAlignType = "ari";
-			else
-				if(pReadHit->HitLoci.Hit.FlgSplice)
-					pszAlignType = "arj";
-				else
-					{
-					pszAlignType = "ar";
-					if(m_FMode > eFMbed)
-						bSkipBEDformat = true;
-					}
-			}
-
-		tsSegLoci *pSeg;
-		int SegIdx;
-
-		pSeg = &pReadHit->HitLoci.Hit.Seg[0];
-		if(pSeg->ChromID != (UINT32)PrevTargEntry)
-			{
-			m_pSfxArray->GetIdentName(pSeg->ChromID,sizeof(szChromName),szChromName);
-			PrevTargEntry = pSeg->ChromID;
-			}
-
-		if(pSeg->Strand == '\0')	// default strand to be sense if not specified
-			pSeg->Strand = '+';
-
-		int Score = (int)min(1000.0,(999 * m_OctSitePrefs[pSeg->Strand == '+' ? 0 : 1][pReadHit->SiteIdx].RelScale));
-
-		if(m_FMode >= eFMbed)
-			{
-			if(pReadHit->HitLoci.FlagSegs==0)
-				{
-				if(bPrevInDelSeg || bPrevJunctSeg)
-					{
-					if(LineLen > 0)
-						{
-						if(bPrevInDelSeg && m_hIndOutFile != -1)
-							CUtility::SafeWrite(m_hIndOutFile,m_pszLineBuff,LineLen);
-						else
-							if(bPrevJunctSeg && m_hJctOutFile != -1)
-								CUtility::SafeWrite(m_hJctOutFile,m_pszLineBuff,LineLen);
-						LineLen = 0;
-						}
-					bPrevInDelSeg = false;
-					bPrevJunctSeg = false;
-					}
-				pSeg = &pReadHit->HitLoci.Hit.Seg[0];
-
-				if(!bSkipBEDformat)
-					LineLen+=sprintf(&m_pszLineBuff[LineLen],"%s\t%d\t%d\t%s\t%d\t%c\n",
-								szChromName,AdjStartLoci(pSeg),AdjEndLoci(pSeg) + 1,pszAlignType,Score,pSeg->Strand);
-				bPrevAlignSeg = true;
-				}
-			else // segmented alignment
-				{
-				if(bPrevAlignSeg)
-					{
-					if(LineLen > 0)
-						{
-						if(m_FMode == eFMbed)
-							{
-							if(!m_bgzOutFile)
-								CUtility::SafeWrite(m_hOutFile,m_pszLineBuff,LineLen);
-							else
-								CUtility::SafeWrite_gz(m_gzOutFile,m_pszLineBuff,LineLen);
-							}
-						LineLen = 0;
-						}
-					bPrevAlignSeg = false;
-					}
-				if(pReadHit->HitLoci.Hit.FlgInDel)
-					{
-					if(bPrevJunctSeg && m_hJctOutFile != -1)
-						{
-						if(LineLen > 0)
-							CUtility::SafeWrite(m_hJctOutFile,m_pszLineBuff,LineLen);
-						LineLen = 0;
-						}
-					bPrevJunctSeg = false;
-					bPrevInDelSeg = true;
-					}
-				else
-					{
-					if(bPrevInDelSeg && m_hIndOutFile != -1)
-						{
-						if(LineLen > 0)
-							{
-							CUtility::SafeWrite(m_hIndOutFile,m_pszLineBuff,LineLen);
-							LineLen = 0;
-							}
-						}
-					bPrevInDelSeg = false;
-					bPrevJunctSeg = true;
-					}
-
-			    int AjAlignStartLoci;
-				int AjAlignEndLoci;
-
-				if(!bSkipBEDformat)
-					{
-					AjAlignStartLoci = AdjAlignStartLoci(&pReadHit->HitLoci.Hit);
-					AjAlignEndLoci = AdjAlignEndLoci(&pReadHit->HitLoci.Hit);
-					LineLen+=sprintf(&m_pszLineBuff[LineLen],"%s\t%d\t%d\t%s\t%d\t%c\t%d\t%d\t0\t2\t%d,%d\t0,%d\n",
-									szChromName,AjAlignStartLoci,AjAlignEndLoci+1,pszAlignType,Score,pSeg->Strand,AjAlignStartLoci,AjAlignEndLoci+1,
-									AdjHitLen(pSeg),AdjHitLen(&pSeg[1]),AdjStartLoci(&pSeg[1])-AdjStartLoci(pSeg));
-					}
-				}
-
-			if((cAllocLineBuffSize - LineLen) < 1000)
-				{
-				if(bPrevAlignSeg)
-					{
-					if(m_FMode == eFMbed)
-						{
-						if(!m_bgzOutFile)
-							CUtility::SafeWrite(m_hOutFile,m_pszLineBuff,LineLen);
-						else
-							CUtility::SafeWrite_gz(m_gzOutFile,m_pszLineBuff,LineLen);
-						}
-					LineLen = 0;
-					bPrevAlignSeg = false;
-					}
-				else
-					{
-					if(bPrevInDelSeg && m_hIndOutFile != -1)
-						CUtility::SafeWrite(m_hIndOutFile,m_pszLineBuff,LineLen);
-					else
-						if(bPrevJunctSeg && m_hJctOutFile != -1)
-							CUtility::SafeWrite(m_hJctOutFile,m_pszLineBuff,LineLen);
-					LineLen = 0;
-					bPrevInDelSeg = false;
-					bPrevJunctSeg = false;
-					}
-				}
-			continue;
-			}
-
-		// m_FMode < eFMbed)
-		if(!m_bIsSOLiD && m_FMode >= eFMread)
-			{
-			pSeqVal = &pReadHit->Read[pReadHit->DescrLen+1];
-			pReadSeq = ReadSeq;
-			for(SeqIdx = 0; SeqIdx < pReadHit->ReadLen; SeqIdx++,pReadSeq++,pSeqVal++)
-				*pReadSeq = (*pSeqVal & 0x07);
-			}
-		bPrevAlignSeg = true;
-		for(SegIdx = 0; SegIdx < 2; SegIdx++)
-			{
-			pSeg = &pReadHit->HitLoci.Hit.Seg[SegIdx];
-			if(pSeg->ChromID == 0)
-				continue;
-			if(pSeg->Strand == '\0')	// default strand to be sense if not specified
-				pSeg->Strand = '+';
-			if(pSeg->ChromID != (UINT32)PrevTargEntry)
-				{
-				m_pSfxArray->GetIdentName(pSeg->ChromID,sizeof(szChromName),szChromName);
-				PrevTargEntry = pSeg->ChromID;
-				}
-
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],0,pReadHit->ReadID,',');
-			LineLen += AppendStr(&m_pszLineBuff[LineLen],0,'"',(char *)pszAlignType,',');
-			LineLen += AppendStr(&m_pszLineBuff[LineLen],0,'"',m_szTargSpecies,',');
-			LineLen += AppendStr(&m_pszLineBuff[LineLen],0,'"',szChromName,',');
-
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],0,AdjStartLoci(pSeg),',');
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],0,AdjEndLoci(pSeg),',');
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],0,AdjHitLen(pSeg),',');
-			LineLen += AppendChrs(&m_pszLineBuff[LineLen],0,'"',1,(char *)&pSeg->Strand,',');
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],0,Score,',');
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],0,0,'\0');
-
-			if(m_bBisulfite) {
-				switch(pReadHit->HitLoci.Hit.BisBase) {
-					case eBaseT:
-						pszBsMap = "TC:C";
-						break;
-					case eBaseA:
-						pszBsMap = "AG:T";
-						break;
-					default:
-						pszBsMap = "?:?";
-					}
-				}
-			else
-				pszBsMap = "N/A";
-
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],',',pReadHit->NumReads,',');
-			LineLen += AppendUInt(&m_pszLineBuff[LineLen],0,pSeg->TrimMismatches,',');
-			LineLen += AppendStr(&m_pszLineBuff[LineLen],0,'"',(char *)pszBsMap,',');
-			LineLen += AppendStr(&m_pszLineBuff[LineLen],0,'"',(char *)pReadHit->Read,'\0');
-
-			if(m_FMode >= eFMread)
-				LineLen += AppendStr(&m_pszLineBuff[LineLen],',','"',CSeqTrans::MapSeq2Ascii(&ReadSeq[pSeg->ReadOfs+pSeg->TrimLeft],AdjHitLen(pSeg)),0);
-			if(m_FMode == eFMmatch || m_FMode == eFMreadmatch)
-				{
-				m_pSfxArray->GetSeq(pSeg->ChromID,AdjStartLoci(pSeg),AssembSeq,AdjHitLen(pSeg));	// get sequence for entry starting at offset and of length len
-				if(pSeg->Strand == '-')
-					CSeqTrans::ReverseComplement(AdjHitLen(pSeg),AssembSeq);
-				LineLen += AppendStr(&m_pszLineBuff[LineLen],',','"',CSeqTrans::MapSeq2Ascii(AssembSeq,AdjHitLen(pSeg)),0);
-				}
-
-			LineLen += AppendStr(&m_pszLineBuff[LineLen],0,0,(char *)"\n",0);
-			if(LineLen + ((cMaxFastQSeqLen * 2) + 1024) > cAllocLineBuffSize)
-				{
-				if(!m_bgzOutFile)
-					CUtility::SafeWrite(m_hOutFile,m_pszLineBuff,LineLen);
-				else
-					CUtility::SafeWrite_gz(m_gzOutFile,m_pszLineBuff,LineLen);
-				LineLen = 0;
-				}
-			}
-
-		// user may be interested in the distribution of the aligner induced substitutions, after any auto-trimming of flanks,
-		// along the length of the reads and how this distribution relates to the quality scores
-		if(m_hStatsFile != -1 && m_FMode <= eFMbed)
-			WriteSubDist(pReadHit);
-		}
-	}
-if(LineLen)
+if(m_StreamBatchID <= 1)		// when streaming batches then track headers are only written with the first batch
 	{
-	if(bPrevAlignSeg && m_FMode <= eFMbed)
+	if(m_FMode == eFMbed)
 		{
+		LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"%s\" description=\"%s\"\n",m_pszTrackTitle,m_pszTrackTitle);
 		if(!m_bgzOutFile)
 			CUtility::SafeWrite(m_hOutFile,m_pszLineBuff,LineLen);
 		else
 			CUtility::SafeWrite_gz(m_gzOutFile,m_pszLineBuff,LineLen);
+		}
 
-		LineLen = 0;
-		bPrevAlignSeg = false;
+	if(m_hJctOutFile != -1)
+		{
+		LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"JCT_%s\" description=\"%s\"\n",m_pszTrackTitle,m_pszTrackTitle);
+		CUtility::SafeWrite(m_hJctOutFile,m_pszLineBuff,LineLen);
 		}
-	else
+
+	if(m_hIndOutFile != -1)
 		{
-		if(bPrevInDelSeg && m_hIndOutFile != -1)
-			CUtility::SafeWrite(m_hIndOutFile,m_pszLineBuff,LineLen);
-		else
-			if(bPrevJunctSeg && m_hJctOutFile != -1)
-				CUtility::SafeWrite(m_hJctOutFile,m_pszLineBuff,LineLen);
-		LineLen = 0;
-		bPrevInDelSeg = false;
-		bPrevJunctSeg = false;
+		LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"IND_%s\" description=\"%s\"\n",m_pszTrackTitle,m_pszTrackTitle);
+		CUtility::SafeWrite(m_hIndOutFile,m_pszLineBuff,LineLen);
 		}
 	}
-return(eBSFSuccess);
-}
 
+// CSV and BED formatting is over multiple threads
+return(WriteSortedReadHits());
+}
 
-int
-CAligner::AddMultiHit(tsReadHit *pReadHit)
-{
-int NumMultiHits;
-int CopyLen;
-size_t HitLen;
-tsReadHit *pMultiHit;
-
-HitLen = sizeof(tsReadHit) + pReadHit->ReadLen + pReadHit->DescrLen; 
 #ifdef _WIN32
-DWORD WaitRslt = WaitForSingleObject(m_hMtxMultiMatches,INFINITE);
+unsigned __stdcall WriteSortedReadHitsThread(void * pThreadPars)
 #else
-pthread_mutex_lock(&m_hMtxMultiMatches);
+void *WriteSortedReadHitsThread(void * pThreadPars)
 #endif
-if(m_NxtMultiAllOfs + (2 * HitLen) >= m_AllocMultiAllMem)
-	{
-	size_t memreq = m_AllocMultiAllMem + (cAllocMultihits * HitLen);
+{
+	int Rslt;
+	tsWriteHitsThreadPars *pPars = (tsWriteHitsThreadPars *)pThreadPars;			// makes it easier not having to deal with casts!
+	CAligner *pAligner = (CAligner *)pPars->pThis;
+	Rslt = pAligner->WriteSortedReadHits(pPars);
+	pPars->Rslt = Rslt;
 #ifdef _WIN32
-	pMultiHit = (tsReadHit *) realloc(m_pMultiAll,memreq);
+	_endthreadex(0);
+	return(eBSFSuccess);
 #else
-	pMultiHit = (tsReadHit *)mremap(m_pMultiAll,m_AllocMultiAllMem,memreq,MREMAP_MAYMOVE);
-	if(pMultiHit == MAP_FAILED)
-		pMultiHit = NULL;
+	pthread_exit(NULL);
 #endif
-	if(pMultiHit == NULL)
-		{
+}
+
+// WriteSortedReadHits
+// Sorted reads are partitioned into chunks of cWriteHitsChunkReads with each chunk then formatted as CSV or BED by one of up to cMaxWriteHitsThreads
+// threads into that thread's own buffers. If the primary results file is being compressed then each formatted chunk is also compressed by the formatting
+// thread as an independent gzip member. Formatted chunks are written out in chunk order so output is the same as if all reads had been formatted serially
+int
+CAligner::WriteSortedReadHits(void)
+{
+int Rslt;
+int ThreadIdx;
+int NumThreads;
+tsWriteHitsThreadPars WorkerThreads[cMaxWriteHitsThreads];
+
+if(m_NumReadsLoaded == 0)
+	return(eBSFSuccess);
+
+// formatting threads write pre-compressed gzip members directly to the primary results file so any alignments previously written through m_gzOutFile must be completed as a gzip member
+if(m_bgzOutFile && m_FMode <= eFMbed)
+	gzflush(m_gzOutFile,Z_FINISH);
+
+m_NumWriteHitsChunks = (m_NumReadsLoaded + cWriteHitsChunkReads - 1) / cWriteHitsChunkReads;
+m_NxtWriteHitsChunk = 0;
+m_NxtWriteHitsCommit = 0;
+m_bWriteHitsTermThreads = false;
+
+Rslt = eBSFSuccess;
+NumThreads = min(m_NumThreads,min(cMaxWriteHitsThreads,(int)m_NumWriteHitsChunks));
+memset(WorkerThreads,0,sizeof(WorkerThreads));
+for(ThreadIdx = 0; ThreadIdx < NumThreads; ThreadIdx++)
+	{
+	WorkerThreads[ThreadIdx].ThreadIdx = ThreadIdx + 1;
+	WorkerThreads[ThreadIdx].pThis = this;
 #ifdef _WIN32
-ReleaseMutex(m_hMtxMultiMatches);
+	WorkerThreads[ThreadIdx].threadHandle = (HANDLE)_beginthreadex(NULL, 0x0fffff, WriteSortedReadHitsThread, &WorkerThreads[ThreadIdx], 0, &WorkerThreads[ThreadIdx].threadID);
+	if(WorkerThreads[ThreadIdx].threadHandle == NULL)
 #else
-pthread_mutex_unlock(&m_hMtxMultiMatches);
+	WorkerThreads[ThreadIdx].threadRslt = pthread_create(&WorkerThreads[ThreadIdx].threadID, NULL, WriteSortedReadHitsThread, &WorkerThreads[ThreadIdx]);
+	if(WorkerThreads[ThreadIdx].threadRslt != 0)
 #endif
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,"AddMultiHit: Memory re-allocation to %lld bytes - %s",memreq,strerror(errno));
-		return(eBSFerrMem);
+		break;
+	}
+if(ThreadIdx < NumThreads)			// chunks are claimed in order so formatting can continue with those threads which were started
+	{
+	if(ThreadIdx == 0)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"WriteSortedReadHits: Unable to start any alignment formatting threads");
+		m_NumWriteHitsChunks = 0;
+		return(eBSFerrInternal);
 		}
-	m_pMultiAll = pMultiHit;
-	m_AllocMultiAllMem = memreq;
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"WriteSortedReadHits: Only able to start %d of %d alignment formatting threads",ThreadIdx,NumThreads);
+	NumThreads = ThreadIdx;
 	}
-pMultiHit = (tsReadHit *)((UINT8 *)m_pMultiAll + m_NxtMultiAllOfs);
 
-CopyLen = sizeof(tsReadHit) + pReadHit->DescrLen + pReadHit->ReadLen;
-memcpy(pMultiHit,pReadHit,CopyLen);
+UINT32 ReportProgressSecs;
+ReportProgressSecs = 60;
 
-m_NxtMultiAllOfs += CopyLen;
-m_NumMultiAll += 1;
-pMultiHit->ReadID = m_NumMultiAll;
-NumMultiHits = m_NumMultiAll;
+// wait for all threads to have completed
+for (ThreadIdx = 0; ThreadIdx < NumThreads; ThreadIdx++)
+	{
 #ifdef _WIN32
-ReleaseMutex(m_hMtxMultiMatches);
+	while (WAIT_TIMEOUT == WaitForSingleObject(WorkerThreads[ThreadIdx].threadHandle, (DWORD)ReportProgressSecs * 1000))
+		{
+		gDiagnostics.DiagOut(eDLInfo, gszProcName, "Progress: Still writing alignments, %u of %u chunks written ...",m_NxtWriteHitsCommit,m_NumWriteHitsChunks);
+		}
+	CloseHandle(WorkerThreads[ThreadIdx].threadHandle);
 #else
-pthread_mutex_unlock(&m_hMtxMultiMatches);
+	struct timespec ts;
+	int JoinRlt;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ReportProgressSecs;
+	while ((JoinRlt = pthread_timedjoin_np(WorkerThreads[ThreadIdx].threadID, NULL, &ts)) != 0)
+		{
+		gDiagnostics.DiagOut(eDLInfo, gszProcName, "Progress: Still writing alignments, %u of %u chunks written ...",m_NxtWriteHitsCommit,m_NumWriteHitsChunks);
+		ts.tv_sec += ReportProgressSecs;
+		}
 #endif
-return((int)NumMultiHits);
+	if(WorkerThreads[ThreadIdx].Rslt < eBSFSuccess && Rslt >= eBSFSuccess)
+		Rslt = WorkerThreads[ThreadIdx].Rslt;
+	}
+m_NumWriteHitsChunks = 0;
+return(Rslt);
 }
 
-int				// normally NumHits, but will be actual number of hits if unable to accept any of the loci hit because of chromosome filtering
-CAligner::WriteHitLoci(tsThreadMatchPars *pThreadPars,tsReadHit *pReadHit,int NumHits,tsHitLoci *pHits)
+int
+CAligner::WriteSortedReadHits(tsWriteHitsThreadPars *pPars)
 {
 int Rslt;
-tsHitLoci *pHit;
-tsSegLoci *pSeg;
-
-int ReadHitBuffIdx;						// index into output szReadHits
-
-tBSFEntryID PrevTargEntry;
-UINT8 ReadHit[sizeof(tsReadHit) + cMaxDescrLen + cMaxFastQSeqLen + 10];
-tsReadHit *pMultiHit;
+int BuffIdx;
+bool bTermThreads;
+bool bStrmInit;
+UINT32 ChunkIdx;
+UINT32 ReadIdx;
+size_t MinFreeBuff;
+tsReadHit *pReadHit;
+z_stream Strm;
 
-m_MaxAlignLen = 0;
-PrevTargEntry = 0;
-ReadHitBuffIdx = 0;
+MinFreeBuff = 2 * ((cMaxFastQSeqLen * 2) + cMaxDescrLen + 1024);	// a read with two segments could generate two lines
+Rslt = eBSFSuccess;
+bStrmInit = false;
+memset(&Strm,0,sizeof(Strm));
+for(BuffIdx = 0; BuffIdx < eWHBplaceholder; BuffIdx++)
+	{
+	pPars->AllocBuff[BuffIdx] = 0;
+	pPars->pszBuff[BuffIdx] = NULL;
+	}
+pPars->AllocGzBuff = 0;
+pPars->pGzBuff = NULL;
+pPars->PrevTargEntry = 0;
 
-// check if hits are to chromosomes which are to be retained
-if(NumHits > 0 && (m_NumExcludeChroms || m_NumIncludeChroms))
+if(m_bgzOutFile && m_FMode <= eFMbed)
 	{
-	tsHitLoci *pAcceptHit;
-	int AcceptHits;
-	AcceptHits = 0;
-	pHit = pHits;
-	pAcceptHit = pHit;
-	for(int HitIdx = 0; HitIdx < NumHits; HitIdx++,pHit++)
+	// same compression level as used by gzopen() with "wb"
+	if(deflateInit2(&Strm,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15 + 16,8,Z_DEFAULT_STRATEGY) != Z_OK)
 		{
-		pSeg = &pHit->Seg[0];
-		if(AcceptThisChromID(pSeg->ChromID))
-			{
-			AcceptHits += 1;
-			if(pAcceptHit != pHit)
-				*pAcceptHit++ = *pHit;
-			}
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"WriteSortedReadHits: Unable to initialise for compression");
+		Rslt = eBSFerrInternal;
 		}
-	NumHits = AcceptHits;
-	if(m_FMode != eFMsamAll && NumHits == 0)
-		return(0);
+	else
+		bStrmInit = true;
 	}
 
-PrevTargEntry = 0;
-pHit = pHits;
-
-pMultiHit = (tsReadHit *)&ReadHit;
-memmove(&ReadHit,pReadHit,sizeof(tsReadHit) + pReadHit->ReadLen + pReadHit->DescrLen);
-if(NumHits == 0)
+while(Rslt >= eBSFSuccess)
 	{
-	pMultiHit->NumHits = 0;
-	NumHits = 1;
-	}
-else
-	pMultiHit->NumHits = 1;
+	AcquireSerialise();
+	bTermThreads = m_bWriteHitsTermThreads;
+	ChunkIdx = m_NxtWriteHitsChunk;
+	if(!bTermThreads && ChunkIdx < m_NumWriteHitsChunks)
+		m_NxtWriteHitsChunk += 1;
+	ReleaseSerialise();
+	if(bTermThreads || ChunkIdx >= m_NumWriteHitsChunks)
+		break;
+
+	pPars->ChunkIdx = ChunkIdx;
+	pPars->StartIdx = ChunkIdx * cWriteHitsChunkReads;
+	pPars->EndIdx = min(m_NumReadsLoaded,pPars->StartIdx + cWriteHitsChunkReads);
+	for(BuffIdx = 0; BuffIdx < eWHBplaceholder; BuffIdx++)
+		pPars->BuffLen[BuffIdx] = 0;
+	pPars->GzBuffLen = 0;
+	for(ReadIdx = pPars->StartIdx; ReadIdx < pPars->EndIdx; ReadIdx++)
+		{
+		pReadHit = m_ppReadHitsIdx[ReadIdx];
+		if(pReadHit->NAR != eNARAccepted)
+			continue;
+		if(m_FMode < eFMbed)
+			{
+			if(!ReserveWriteHitsBuff(pPars,eWHBprimary,MinFreeBuff))
+				{
+				Rslt = eBSFerrMem;
+				break;
+				}
+			Rslt = FormatCSVReadHit(pPars,pReadHit);
+			}
+		else
+			Rslt = FormatBEDReadHit(pPars,pReadHit);
+		if(Rslt < eBSFSuccess)
+			break;
+		}
+	if(Rslt < eBSFSuccess)
+		break;
 
+	if(bStrmInit && pPars->BuffLen[eWHBprimary] > 0)
+		if((Rslt = CompressWriteHitsChunk(pPars,&Strm)) < eBSFSuccess)
+			break;
 
-for(int HitIdx = 0; HitIdx < NumHits; HitIdx++,pHit++)
-	{
-	if(pMultiHit->NumHits > 0)
+	// wait until all prior chunks have been written out
+	AcquireSerialise();
+	while(!m_bWriteHitsTermThreads && m_NxtWriteHitsCommit != pPars->ChunkIdx)
+		WaitReadsAvail();
+	bTermThreads = m_bWriteHitsTermThreads;
+	ReleaseSerialise();
+	if(bTermThreads)
+		break;
+
+	if(bStrmInit)
 		{
-		memmove(&pMultiHit->HitLoci.Hit,pHit,sizeof(tsHitLoci));
-		pMultiHit->HitLoci.FlagSegs = (pHit->FlgInDel == 1 || pHit->FlgSplice == 1) ? 1 : 0;
+		if(pPars->GzBuffLen)
+			CUtility::SafeWrite(m_hOutFile,pPars->pGzBuff,pPars->GzBuffLen);
 		}
 	else
-		pMultiHit->HitLoci.FlagSegs = 0;
+		if(pPars->BuffLen[eWHBprimary])
+			CUtility::SafeWrite(m_hOutFile,pPars->pszBuff[eWHBprimary],pPars->BuffLen[eWHBprimary]);
+	if(pPars->BuffLen[eWHBInDel])
+		CUtility::SafeWrite(m_hIndOutFile,pPars->pszBuff[eWHBInDel],pPars->BuffLen[eWHBInDel]);
+	if(pPars->BuffLen[eWHBJunct])
+		CUtility::SafeWrite(m_hJctOutFile,pPars->pszBuff[eWHBJunct],pPars->BuffLen[eWHBJunct]);
+
+	// user may be interested in the distribution of the aligner induced substitutions, after any auto-trimming of flanks,
+	// along the length of the reads and how this distribution relates to the quality scores
+	// distributions are shared by all threads so are only updated by the thread currently committing its chunk
+	if(m_FMode < eFMbed && m_hStatsFile != -1)
+		for(ReadIdx = pPars->StartIdx; ReadIdx < pPars->EndIdx; ReadIdx++)
+			WriteSubDist(m_ppReadHitsIdx[ReadIdx]);
 
-	if((Rslt = AddMultiHit(pMultiHit)) < eBSFSuccess)
-		return(Rslt);
+	AcquireSerialise();
+	m_NxtWriteHitsCommit += 1;
+	ReleaseSerialise();
+	SignalReadsAvail();				// wake thread waiting to write out the next chunk
+	pPars->NumChunksProc += 1;
 	}
 
-return(NumHits);
+if(Rslt < eBSFSuccess)
+	{
+	AcquireSerialise();
+	m_bWriteHitsTermThreads = true;
+	ReleaseSerialise();
+	SignalReadsAvail();
+	}
+
+if(bStrmInit)
+	deflateEnd(&Strm);
+for(BuffIdx = 0; BuffIdx < eWHBplaceholder; BuffIdx++)
+	{
+	if(pPars->pszBuff[BuffIdx] != NULL)
+		{
+		free(pPars->pszBuff[BuffIdx]);
+		pPars->pszBuff[BuffIdx] = NULL;
+		}
+	pPars->AllocBuff[BuffIdx] = 0;
+	}
+if(pPars->pGzBuff != NULL)
+	{
+	free(pPars->pGzBuff);
+	pPars->pGzBuff = NULL;
+	}
+pPars->AllocGzBuff = 0;
+return(Rslt);
 }
 
+// ReserveWriteHitsBuff
+// Ensures that the thread's buffer for an output file has at least MinFree chars available, buffers are allocated on first use and then doubled as required
+bool
+CAligner::ReserveWriteHitsBuff(tsWriteHitsThreadPars *pPars,	// formatting thread
+					etWriteHitsBuff BuffIdx,	// buffer for this output file
+					size_t MinFree)		   // ensure at least this many chars are available for appending
+{
+char *pTmp;
+size_t memreq;
+if((pPars->BuffLen[BuffIdx] + MinFree) <= pPars->AllocBuff[BuffIdx])
+	return(true);
+memreq = pPars->AllocBuff[BuffIdx] == 0 ? max((size_t)cAllocWriteHitsBuff,MinFree * 2) : pPars->AllocBuff[BuffIdx] * 2;
+if((pTmp = (char *)realloc(pPars->pszBuff[BuffIdx],memreq))==NULL)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"ReserveWriteHitsBuff: Memory reallocation to %lld bytes failed",(INT64)memreq);
+	return(false);
+	}
+pPars->pszBuff[BuffIdx] = pTmp;
+pPars->AllocBuff[BuffIdx] = memreq;
+return(true);
+}
 
-// OutputSNPs
-// Currently can't process for SNPs in InDels or splice junctions
-// FDR: BenjaminiHochberg
-// QValue == acceptable FDR e.g. 0.05% or 0.01%
-// PValue == 1.0 - Stats.Binomial(TotBasesInColumn,NumBasesInColMismatching+1,GlobalSeqErrRate);
-// PValueIdx == sorted index of PValue and locus pairs, 1..k
-// Generate PValues for all alignment columns meeting minimum constraints into an array of structures containing column loci and associated PValues
-// Sort array of structures ascending on PValues
-// Iterate array 1 to k and accept as SNPs those elements with PValues < (PValueIdx/k) * QValue
+// CompressWriteHitsChunk
+// Compresses the thread's formatted primary alignments as a complete gzip member, concatenated gzip members are themselves a valid gzip file
 int
-CAligner::OutputSNPs(void)
+CAligner::CompressWriteHitsChunk(tsWriteHitsThreadPars *pPars,	// formatting thread
+					z_stream *pStrm)		   // compress pPars->pszBuff[eWHBprimary] as a gzip member into pPars->pGzBuff
 {
-double PValue;
-double GlobalSeqErrRate;
-double LocalSeqErrRate;
-tsSNPcnts *pSNP;
-UINT32 Loci;
-int Idx;
-int NumSNPs;
-int TotBases;
-char szChromName[cMaxDatasetSpeciesChrom+1];
-int LineLen;
-double Proportion;
-double AdjPValue;
-int RelRank;
-tsLociPValues *pLociPValues;
+UINT8 *pTmp;
 size_t memreq;
-tsSNPcnts *pSNPWinL;
-tsSNPcnts *pSNPWinR;
-UINT32 LocalBkgndRateWindow;
-UINT32 LocalBkgndRateWinFlank;
-UINT32 LocalTotMismatches;
-UINT32 LocalTotMatches;
-UINT32 LocTMM;
-UINT32 LocTM;
-CStats Stats;
-
-tsMonoSNP sMonoSNP;
-tsDiSNP sDiSNP;
-tsTriSNP sTriSNP;
-
-tsSNPcnts PrevSNPs[3]; // to hold counts for prev 2 plus currrent SNP - used when reporting Di/TriSNPs
 
-int CurDiSNPLoci;
-int PrevDiSNPLoci;
-int DiSNPBuffIdx;
-char szDiSNPs[4000];
-
-int CurTriSNPLoci;
-int PrevTriSNPLoci;
-int FirstTriSNPLoci;
-int TriSNPBuffIdx;
-char szTriSNPs[4000];
-int TotNumDiSNPs;
-int TotNumTriSNPs;
+deflateReset(pStrm);
+memreq = deflateBound(pStrm,(uLong)pPars->BuffLen[eWHBprimary]);
+if(memreq > pPars->AllocGzBuff)
+	{
+	memreq += memreq / 4;
+	if((pTmp = (UINT8 *)realloc(pPars->pGzBuff,memreq))==NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"CompressWriteHitsChunk: Memory reallocation to %lld bytes failed",(INT64)memreq);
+		return(eBSFerrMem);
+		}
+	pPars->pGzBuff = pTmp;
+	pPars->AllocGzBuff = memreq;
+	}
+pStrm->next_in = (Bytef *)pPars->pszBuff[eWHBprimary];
+pStrm->avail_in = (uInt)pPars->BuffLen[eWHBprimary];
+pStrm->next_out = (Bytef *)pPars->pGzBuff;
+pStrm->avail_out = (uInt)pPars->AllocGzBuff;
+if(deflate(pStrm,Z_FINISH) != Z_STREAM_END)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"CompressWriteHitsChunk: Compression of formatted alignments failed");
+	return(eBSFerrInternal);
+	}
+pPars->GzBuffLen = pPars->AllocGzBuff - pStrm->avail_out;
+return(eBSFSuccess);
+}
 
-UINT8 SNPFlanks[9];
-UINT8 *pSNPFlank;
-int SNPFlankIdx;
-int SNPCentroidIdx;
-UINT8 Base;
-tsSNPCentroid *pCentroid;
+// FormatBEDReadHit
+// Appends the BED formatted alignment for an accepted read to the thread's buffer for the output file to which the alignment belongs:
+// unsegmented alignments to the primary results file (BED output only), segmented microInDel alignments to the InDel file, and other
+// segmented alignments to the splice junctions file. Alignments are not formatted if their output file is not being generated
+int
+CAligner::FormatBEDReadHit(tsWriteHitsThreadPars *pPars,	// formatting thread
+					tsReadHit *pReadHit)	   // append this read's alignment as BED to the pPars->pszBuff[] for the output file to which it belongs
+{
+const char *pszAlignType;
+etWriteHitsBuff BuffIdx;
+int Score;
+int AjAlignStartLoci;
+int AjAlignEndLoci;
+tsSegLoci *pSeg;
 
-if(m_pLociPValues == NULL)					// will be NULL first time in
+if(pReadHit->HitLoci.FlagSegs == 0)
 	{
-	memreq = cAllocLociPValues * sizeof(tsLociPValues);
-#ifdef _WIN32
-	m_pLociPValues = (tsLociPValues *) malloc((size_t)memreq);
-	if(m_pLociPValues == NULL)
+	if(m_FMode != eFMbed)
+		return(eBSFSuccess);
+	BuffIdx = eWHBprimary;
+	}
+else
+	{
+	if(pReadHit->HitLoci.Hit.FlgInDel)
 		{
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,"OutputSNPs: Memory allocation of %lld bytes failed",(INT64)memreq);
-		return(eBSFerrMem);
+		if(m_hIndOutFile == -1)
+			return(eBSFSuccess);
+		BuffIdx = eWHBInDel;
 		}
-#else
-	// gnu malloc is still in the 32bit world and can't handle more than 2GB allocations
-	m_pLociPValues = (tsLociPValues *)mmap(NULL,(size_t)memreq, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, -1,0);
-	if(m_pLociPValues == MAP_FAILED)
+	else
 		{
-		m_pLociPValues = NULL;
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,"OutputSNPs: Memory allocation of %lld bytes through mmap()  failed",(INT64)memreq,strerror(errno));
-		return(eBSFerrMem);
+		if(m_hJctOutFile == -1 || (m_FMode > eFMbed && !pReadHit->HitLoci.Hit.FlgSplice))
+			return(eBSFSuccess);
+		BuffIdx = eWHBJunct;
 		}
-#endif
-	m_AllocLociPValuesMem = memreq;
-	m_NumLociPValues = 0;
 	}
 
-// NOTE: set a floor on the global (whole chromosome) sequencing error rate
-GlobalSeqErrRate = max(cMinSeqErrRate,(double)m_pChromSNPs->TotMismatch / (double)(1 + m_pChromSNPs->TotMatch + m_pChromSNPs->TotMismatch));
+if(!ReserveWriteHitsBuff(pPars,BuffIdx,1000))
+	return(eBSFerrMem);
+
+if(pReadHit->HitLoci.Hit.FlgInDel)
+	pszAlignType = pReadHit->HitLoci.FlagIA == 1 ? "iari" : "ari";
+else
+	if(pReadHit->HitLoci.Hit.FlgSplice)
+		pszAlignType = pReadHit->HitLoci.FlagIA == 1 ? "iarj" : "arj";
+	else
+		pszAlignType = pReadHit->HitLoci.FlagIA == 1 ? "iar" : "ar";
 
-m_pSfxArray->GetIdentName(m_pChromSNPs->ChromID,sizeof(szChromName),szChromName);
+pSeg = &pReadHit->HitLoci.Hit.Seg[0];
+if(pSeg->ChromID != (UINT32)pPars->PrevTargEntry)
+	{
+	m_pSfxArray->GetIdentName(pSeg->ChromID,sizeof(pPars->szChromName),pPars->szChromName);
+	pPars->PrevTargEntry = pSeg->ChromID;
+	}
 
-pSNPWinR = &m_pChromSNPs->Cnts[0];
-LocalBkgndRateWinFlank = cSNPBkgndRateWindow / 2;
-LocalBkgndRateWindow = (LocalBkgndRateWinFlank * 2) + 1;
-LocalTotMismatches = 0;
-LocalTotMatches = 0;
+if(pSeg->Strand == '\0')	// default strand to be sense if not specified
+	pSeg->Strand = '+';
 
+Score = (int)min(1000.0,(999 * m_OctSitePrefs[pSeg->Strand == '+' ? 0 : 1][pReadHit->SiteIdx].RelScale));
 
-for(Loci = 0; Loci < min(LocalBkgndRateWindow,m_pChromSNPs->ChromLen); Loci++,pSNPWinR++)
+if(BuffIdx == eWHBprimary)
+	pPars->BuffLen[BuffIdx] += sprintf(&pPars->pszBuff[BuffIdx][pPars->BuffLen[BuffIdx]],"%s\t%d\t%d\t%s\t%d\t%c\n",
+								pPars->szChromName,AdjStartLoci(pSeg),AdjEndLoci(pSeg) + 1,pszAlignType,Score,pSeg->Strand);
+else
 	{
-	LocalTotMismatches += pSNPWinR->NumNonRefBases;
-	LocalTotMatches += pSNPWinR->NumRefBases;
+	AjAlignStartLoci = AdjAlignStartLoci(&pReadHit->HitLoci.Hit);
+	AjAlignEndLoci = AdjAlignEndLoci(&pReadHit->HitLoci.Hit);
+	pPars->BuffLen[BuffIdx] += sprintf(&pPars->pszBuff[BuffIdx][pPars->BuffLen[BuffIdx]],"%s\t%d\t%d\t%s\t%d\t%c\t%d\t%d\t0\t2\t%d,%d\t0,%d\n",
+								pPars->szChromName,AjAlignStartLoci,AjAlignEndLoci+1,pszAlignType,Score,pSeg->Strand,AjAlignStartLoci,AjAlignEndLoci+1,
+								AdjHitLen(pSeg),AdjHitLen(&pSeg[1]),AdjStartLoci(&pSeg[1])-AdjStartLoci(pSeg));
 	}
+return(eBSFSuccess);
+}
 
-pLociPValues = m_pLociPValues;
-m_NumLociPValues = 0;
-pSNP = &m_pChromSNPs->Cnts[0];
-pSNPWinL = pSNP;
-LineLen = 0;
+// FormatCSVReadHit
+// Appends the CSV formatted alignment(s) for an accepted read to the thread's buffer, caller is responsible for ensuring sufficient buffer space
+int
+CAligner::FormatCSVReadHit(tsWriteHitsThreadPars *pPars,	// formatting thread
+					tsReadHit *pReadHit)	   // append this read's alignment(s) as CSV to pPars->pszBuff
+{
+const char *pszBsMap;
+const char *pszAlignType;
+size_t LineLen;
+char *pszLineBuff;
+int SeqIdx;
+int SegIdx;
+int Score;
+tsSegLoci *pSeg;
+etSeqBase ReadSeq[cMaxFastQSeqLen+1];	// to hold sequence (sans quality scores) for current read
+etSeqBase AssembSeq[cMaxFastQSeqLen+1];	// to hold targeted genome assembly sequence
+char szAsciiSeq[cMaxFastQSeqLen+1];		// CSeqTrans::MapSeq2Ascii() internal buffer is shared by all threads so map into this buffer
 
+UINT8 *pSeqVal;
+etSeqBase *pReadSeq;
 
-m_MaxDiSNPSep = m_pChromSNPs->MeanReadLen;
-for(Loci = 0; Loci < m_pChromSNPs->ChromLen;Loci++, pSNP++)
+if(pReadHit->HitLoci.FlagIA == 1)
 	{
-	// determine background expected error rate from window surrounding the current loci
-	if(Loci > LocalBkgndRateWinFlank && (Loci + LocalBkgndRateWinFlank) < m_pChromSNPs->ChromLen)
-		{
-		// need to ensure that LocalTotMismatches and LocalTotMismatches will never underflow
-		if(LocalTotMismatches >= pSNPWinL->NumNonRefBases)
-			LocalTotMismatches -= pSNPWinL->NumNonRefBases;
+	if(pReadHit->HitLoci.Hit.FlgInDel)
+		pszAlignType = "iari";
+	else
+		if(pReadHit->HitLoci.Hit.FlgSplice)
+			pszAlignType = "iarj";
 		else
-			LocalTotMismatches = 0;
-		if(LocalTotMatches >= pSNPWinL->NumRefBases)
-			LocalTotMatches -= pSNPWinL->NumRefBases;
+			pszAlignType = "iar";
+	}
+else
+	{
+	if(pReadHit->HitLoci.Hit.FlgInDel)
+		pszAlignType = "ari";
+	else
+		if(pReadHit->HitLoci.Hit.FlgSplice)
+			pszAlignType = "arj";
 		else
-			LocalTotMatches = 0;
-		LocalTotMismatches += pSNPWinR->NumNonRefBases;
-		LocalTotMatches += pSNPWinR->NumRefBases;
-		pSNPWinL += 1;
-		pSNPWinR += 1;
-		}
+			pszAlignType = "ar";
+	}
 
-	TotBases = pSNP->NumNonRefBases + pSNP->NumRefBases;
-	if(TotBases > 0)
-		{
-		m_LociBasesCovered += 1;
-		m_LociBasesCoverage += TotBases;
-		}
+pSeg = &pReadHit->HitLoci.Hit.Seg[0];
+if(pSeg->Strand == '\0')	// default strand to be sense if not specified
+	pSeg->Strand = '+';
 
-	if(TotBases < m_MinSNPreads)
-		continue;
+Score = (int)min(1000.0,(999 * m_OctSitePrefs[pSeg->Strand == '+' ? 0 : 1][pReadHit->SiteIdx].RelScale));
 
-	if(m_hSNPCentsfile != -1)
-		{
-		// get 4bases up/dn stream from loci with SNP and use these to inc centroid counts of from/to counts
-		if(Loci >= cSNPCentfFlankLen && Loci < (m_pChromSNPs->ChromLen - cSNPCentfFlankLen))
-			{
-			m_pSfxArray->GetSeq(m_pChromSNPs->ChromID,Loci-(UINT32)cSNPCentfFlankLen,SNPFlanks,cSNPCentroidLen);
-			pSNPFlank = &SNPFlanks[cSNPCentroidLen-1];
-			SNPCentroidIdx = 0;
-			for(SNPFlankIdx = 0; SNPFlankIdx < cSNPCentroidLen; SNPFlankIdx++,pSNPFlank--)
-				{
-				Base = *pSNPFlank & 0x07;
-				if(Base > eBaseT)
-					break;
-				SNPCentroidIdx |= (Base << (SNPFlankIdx * 2));
-				}
-			if(SNPFlankIdx == cSNPCentroidLen)
-				m_pSNPCentroids[SNPCentroidIdx].NumInsts += 1;
+if(!m_bIsSOLiD && m_FMode >= eFMread)
+	{
+	pSeqVal = &pReadHit->Read[pReadHit->DescrLen+1];
+	pReadSeq = ReadSeq;
+	for(SeqIdx = 0; SeqIdx < pReadHit->ReadLen; SeqIdx++,pReadSeq++,pSeqVal++)
+		*pReadSeq = (*pSeqVal & 0x07);
+	}
+
+pszLineBuff = pPars->pszBuff[eWHBprimary];
+LineLen = pPars->BuffLen[eWHBprimary];
+for(SegIdx = 0; SegIdx < 2; SegIdx++)
+	{
+	pSeg = &pReadHit->HitLoci.Hit.Seg[SegIdx];
+	if(pSeg->ChromID == 0)
+		continue;
+	if(pSeg->Strand == '\0')	// default strand to be sense if not specified
+		pSeg->Strand = '+';
+	if(pSeg->ChromID != (UINT32)pPars->PrevTargEntry)
+		{
+		m_pSfxArray->GetIdentName(pSeg->ChromID,sizeof(pPars->szChromName),pPars->szChromName);
+		pPars->PrevTargEntry = pSeg->ChromID;
+		}
+
+	LineLen += AppendUInt(&pszLineBuff[LineLen],0,m_StreamReadIDBase + pReadHit->ReadID,',');
+	LineLen += AppendStr(&pszLineBuff[LineLen],0,'"',(char *)pszAlignType,',');
+	LineLen += AppendStr(&pszLineBuff[LineLen],0,'"',m_szTargSpecies,',');
+	LineLen += AppendStr(&pszLineBuff[LineLen],0,'"',pPars->szChromName,',');
+
+	LineLen += AppendUInt(&pszLineBuff[LineLen],0,AdjStartLoci(pSeg),',');
+	LineLen += AppendUInt(&pszLineBuff[LineLen],0,AdjEndLoci(pSeg),',');
+	LineLen += AppendUInt(&pszLineBuff[LineLen],0,AdjHitLen(pSeg),',');
+	LineLen += AppendChrs(&pszLineBuff[LineLen],0,'"',1,(char *)&pSeg->Strand,',');
+	LineLen += AppendUInt(&pszLineBuff[LineLen],0,Score,',');
+	LineLen += AppendUInt(&pszLineBuff[LineLen],0,0,'\0');
+
+	if(m_bBisulfite) {
+		switch(pReadHit->HitLoci.Hit.BisBase) {
+			case eBaseT:
+				pszBsMap = "TC:C";
+				break;
+			case eBaseA:
+				pszBsMap = "AG:T";
+				break;
+			default:
+				pszBsMap = "?:?";
 			}
 		}
+	else
+		pszBsMap = "N/A";
 
+	LineLen += AppendUInt(&pszLineBuff[LineLen],',',pReadHit->NumReads,',');
+	LineLen += AppendUInt(&pszLineBuff[LineLen],0,pSeg->TrimMismatches,',');
+	LineLen += AppendStr(&pszLineBuff[LineLen],0,'"',(char *)pszBsMap,',');
+	LineLen += AppendStr(&pszLineBuff[LineLen],0,'"',(char *)pReadHit->Read,'\0');
 
-	if(pSNP->NumNonRefBases < cMinSNPreads)
-		continue; 
-	Proportion = (double)pSNP->NumNonRefBases/TotBases;
-	if(Proportion < m_SNPNonRefPcnt)	// needs to be at least this proportion of non-ref bases to be worth exploring as being SNP
-		continue;
-
-	// needing to allocate more memory? NOTE: allowing small safety margin of 10 tsLociPValues
-	if(m_AllocLociPValuesMem  < (sizeof(tsLociPValues) * (m_NumLociPValues + 10)))
+	if(m_FMode >= eFMread)
+		LineLen += AppendStr(&pszLineBuff[LineLen],',','"',CSeqTrans::MapSeq2Ascii(&ReadSeq[pSeg->ReadOfs+pSeg->TrimLeft],AdjHitLen(pSeg),szAsciiSeq),0);
+	if(m_FMode == eFMmatch || m_FMode == eFMreadmatch)
 		{
-		size_t memreq = m_AllocLociPValuesMem + (cAllocLociPValues * sizeof(tsLociPValues));
-#ifdef _WIN32
-		pLociPValues = (tsLociPValues *) realloc(m_pLociPValues,memreq);
-		if(pLociPValues == NULL)
-			{
-#else
-		pLociPValues = (tsLociPValues *)mremap(m_pLociPValues,m_AllocLociPValuesMem,memreq,MREMAP_MAYMOVE);
-		if(pLociPValues == MAP_FAILED)
-			{
-#endif
-			gDiagnostics.DiagOut(eDLFatal,gszProcName,"OutputSNPs: Memory reallocation to %lld bytes failed - %s",memreq,strerror(errno));
-			return(eBSFerrMem);
-			}
-		m_pLociPValues = pLociPValues;
-		m_AllocLociPValuesMem = memreq;
-		pLociPValues = &m_pLociPValues[m_NumLociPValues];
+		m_pSfxArray->GetSeq(pSeg->ChromID,AdjStartLoci(pSeg),AssembSeq,AdjHitLen(pSeg));	// get sequence for entry starting at offset and of length len
+		if(pSeg->Strand == '-')
+			CSeqTrans::ReverseComplement(AdjHitLen(pSeg),AssembSeq);
+		LineLen += AppendStr(&pszLineBuff[LineLen],',','"',CSeqTrans::MapSeq2Ascii(AssembSeq,AdjHitLen(pSeg),szAsciiSeq),0);
 		}
 
+	LineLen += AppendStr(&pszLineBuff[LineLen],0,0,(char *)"\n",0);
+	}
+pPars->BuffLen[eWHBprimary] = LineLen;
+return(eBSFSuccess);
+}
 
 
-	if(pSNP->NumNonRefBases <= LocalTotMismatches)
-		LocTMM = LocalTotMismatches - pSNP->NumNonRefBases;
-	else
-		LocTMM = 0;
+// AddMultiHit
+// Captures multiloci alignment into the calling thread's arena, no serialisation is required as arenas are only merged into m_pMultiAll
+// after the thread has completed; read identifiers are assigned when merged
+int
+CAligner::AddMultiHit(tsThreadMatchPars *pPars,	// capture into this thread's arena
+					tsReadHit *pReadHit)		// this multiloci alignment
+{
+size_t CopyLen;
+size_t memreq;
+UINT8 *pRealloc;
 
-	if(pSNP->NumRefBases < LocalTotMatches)
-		LocTM = LocalTotMatches - pSNP->NumRefBases;
-	else
-		LocTM = 0;
-
-
-	if((LocTMM + LocTM) == 0)
-		LocalSeqErrRate = GlobalSeqErrRate;
-	else
+CopyLen = sizeof(tsReadHit) + pReadHit->DescrLen + pReadHit->ReadLen;
+if((pPars->MultiAllLen + CopyLen) > pPars->AllocMultiAll)
+	{
+	memreq = pPars->AllocMultiAll == 0 ? cAllocThreadMultiAll : pPars->AllocMultiAll * 2;
+	if((pRealloc = (UINT8 *)realloc(pPars->pMultiAll,memreq)) == NULL)
 		{
-		LocalSeqErrRate = (double)LocTMM / (double)(LocTMM + LocTM);
-		if(LocalSeqErrRate < GlobalSeqErrRate)
-			LocalSeqErrRate = GlobalSeqErrRate;
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"AddMultiHit: Memory re-allocation to %lld bytes - %s",(INT64)memreq,strerror(errno));
+		return(eBSFerrMem);
 		}
-	if(LocalSeqErrRate > cMaxBkgdNoiseThres)	// don't bother attempting to call if the background is too noisy
-		continue;
+	pPars->pMultiAll = pRealloc;
+	pPars->AllocMultiAll = memreq;
+	}
+memcpy(&pPars->pMultiAll[pPars->MultiAllLen],pReadHit,CopyLen);
+pPars->MultiAllLen += CopyLen;
+pPars->NumMultiAll += 1;
+return((int)pPars->NumMultiAll);
+}
 
-	// accepting as being a putative SNP
-	// if outputting as marker sequence then get SNP up/dnstream sequence and report
-	int MarkerStartLoci;
-	int MarkerSeqIdx;
-	int AllelicIdx;
-	tsSNPcnts *pMarkerBase;
-	etSeqBase MarkerSequence[2000];
-	etSeqBase *pMarkerSeq;
-	int TotMarkerLociBases;
-	double MarkerLociBaseProportion;
-	int MarkerLen;
-	int NumPolymorphicSites;
-	if(m_hMarkerFile != -1)			// output marker sequences? 
-		{
-		// ensure putative marker sequence would be completely contained within the chromosome
-		if(Loci < (UINT32)m_Marker5Len)
-			continue;
-		if((Loci + m_Marker3Len) >= m_pChromSNPs->ChromLen)
-			continue;
-		TotMarkerLociBases = pSNP->NumNonRefBases + pSNP->NumRefBases;
-		MarkerLociBaseProportion = (double)pSNP->NumNonRefBases/TotMarkerLociBases;
-		if(MarkerLociBaseProportion < 0.5)
-			continue;
+int				// normally NumHits, but will be actual number of hits if unable to accept any of the loci hit because of chromosome filtering
+CAligner::WriteHitLoci(tsThreadMatchPars *pThreadPars,tsReadHit *pReadHit,int NumHits,tsHitLoci *pHits)
+{
+int Rslt;
+tsHitLoci *pHit;
+tsSegLoci *pSeg;
 
-		NumPolymorphicSites = 0;
-		MarkerLen = 1 + m_Marker5Len + m_Marker3Len;
-		MarkerStartLoci = Loci - m_Marker5Len;
-		pMarkerSeq = MarkerSequence;
-		pMarkerBase = &m_pChromSNPs->Cnts[MarkerStartLoci];
-		// check there are alignments covering the complete putative marker sequence
-		// and that at any loci covered by the marker has a significant allelic base
-		for(MarkerSeqIdx = 0; MarkerSeqIdx < MarkerLen; MarkerSeqIdx++,pMarkerBase++,pMarkerSeq++)
-			{
-			if((TotMarkerLociBases = pMarkerBase->NumNonRefBases + pMarkerBase->NumRefBases) < m_MinSNPreads)	// must be at least enough reads covering to have confidence in base call
-				break;
-			MarkerLociBaseProportion = (double)pMarkerBase->NumNonRefBases/TotMarkerLociBases;
-			if(MarkerLociBaseProportion <= m_MarkerPolyThres)													// if no more than polymorphic threshold then can simply accept RefBase
-				{
-				if(MarkerLociBaseProportion > 0.1)
-					NumPolymorphicSites += 1;
-				*pMarkerSeq = CSeqTrans::MapBase2Ascii(pMarkerBase->RefBase); 
-				continue;
-				}
-			// need to find a major allelic base - base must account for very high proportion of counts
-			for(AllelicIdx = 0; AllelicIdx < 5; AllelicIdx++)
-				if(pMarkerBase->NonRefBaseCnts[AllelicIdx] > 0 && (MarkerLociBaseProportion = ((double)pMarkerBase->NonRefBaseCnts[AllelicIdx]/TotMarkerLociBases)) >= (1.0 - m_MarkerPolyThres))
-					{
-					if(MarkerLociBaseProportion < 0.9)
-						NumPolymorphicSites += 1;
-					*pMarkerSeq = CSeqTrans::MapBase2Ascii(AllelicIdx); 
-					break;
-					}
-			if(AllelicIdx == 5)
-				break;
-			}
-		if(MarkerSeqIdx != MarkerLen)			// only reporting SNPs which are consistent with reported markers
-			continue;
-		char SNPbase;
-		char RefBase;
-		RefBase = CSeqTrans::MapBase2Ascii(pSNP->RefBase);
-		SNPbase = MarkerSequence[m_Marker5Len];
-		if(RefBase == SNPbase)					// double check that the reference base is not being called as being the SNP base
-			continue;
-		MarkerSequence[MarkerLen] = '\0';
+int ReadHitBuffIdx;						// index into output szReadHits
 
-		// accepted marker sequence
-		m_MarkerID += 1;
-		pLociPValues->MarkerID = m_MarkerID;
-		pLociPValues->NumPolymorphicSites = NumPolymorphicSites;
-		// >MarkerNNN  Chrom StartLoci|MarkerLen|SNPLoci|Marker5Len,SNPbase|RefBase|NumPolymorphicSites
-		LineLen+=sprintf(&m_pszLineBuff[LineLen],">Marker%d %s %d|%d|%d|%d|%c|%c|%d\n%s\n",
-										m_MarkerID,szChromName,MarkerStartLoci,MarkerLen,Loci,m_Marker5Len,SNPbase,RefBase,NumPolymorphicSites,MarkerSequence);
+tBSFEntryID PrevTargEntry;
+UINT8 ReadHit[sizeof(tsReadHit) + cMaxDescrLen + cMaxFastQSeqLen + 10];
+tsReadHit *pMultiHit;
 
-		if((LineLen + cMaxSeqLen) > cAllocLineBuffSize)
+m_MaxAlignLen = 0;
+PrevTargEntry = 0;
+ReadHitBuffIdx = 0;
+
+// check if hits are to chromosomes which are to be retained
+if(NumHits > 0 && (m_NumExcludeChroms || m_NumIncludeChroms))
+	{
+	tsHitLoci *pAcceptHit;
+	int AcceptHits;
+	AcceptHits = 0;
+	pHit = pHits;
+	pAcceptHit = pHit;
+	for(int HitIdx = 0; HitIdx < NumHits; HitIdx++,pHit++)
+		{
+		pSeg = &pHit->Seg[0];
+		if(AcceptThisChromID(pSeg->ChromID))
 			{
-			CUtility::SafeWrite(m_hMarkerFile,m_pszLineBuff,LineLen);
-			LineLen = 0;
+			AcceptHits += 1;
+			if(pAcceptHit != pHit)
+				*pAcceptHit++ = *pHit;
 			}
 		}
+	NumHits = AcceptHits;
+	if(m_FMode != eFMsamAll && NumHits == 0)
+		return(0);
+	}
+
+PrevTargEntry = 0;
+pHit = pHits;
+
+pMultiHit = (tsReadHit *)&ReadHit;
+memmove(&ReadHit,pReadHit,sizeof(tsReadHit) + pReadHit->ReadLen + pReadHit->DescrLen);
+if(NumHits == 0)
+	{
+	pMultiHit->NumHits = 0;
+	NumHits = 1;
+	}
+else
+	pMultiHit->NumHits = 1;
 
-	if(m_hMarkerFile == -1)
+
+for(int HitIdx = 0; HitIdx < NumHits; HitIdx++,pHit++)
+	{
+	if(pMultiHit->NumHits > 0)
 		{
-		pLociPValues->MarkerID = 0;
-		pLociPValues->NumPolymorphicSites = 0;
+		memmove(&pMultiHit->HitLoci.Hit,pHit,sizeof(tsHitLoci));
+		pMultiHit->HitLoci.FlagSegs = (pHit->FlgInDel == 1 || pHit->FlgSplice == 1) ? 1 : 0;
 		}
-	PValue = 1.0 - Stats.Binomial(TotBases,pSNP->NumNonRefBases,LocalSeqErrRate);
-	pLociPValues->PValue = PValue;
-	pLociPValues->Loci = Loci;
-	pLociPValues->Rank = 0;
-	pLociPValues->LocalBkGndSubRate = LocalSeqErrRate;
-	pLociPValues->LocalReads = LocTMM + LocTM;
-	pLociPValues->LocalSubs = LocTMM;
-	pLociPValues->NumReads = TotBases;
-	pLociPValues->SNPcnts = *pSNP;
-	pLociPValues->NumSubs = pSNP->NumNonRefBases;
-	pLociPValues += 1;
-	m_NumLociPValues += 1;
+	else
+		pMultiHit->HitLoci.FlagSegs = 0;
+
+	if((Rslt = AddMultiHit(pThreadPars,pMultiHit)) < eBSFSuccess)
+		return(Rslt);
 	}
 
-if(m_hMarkerFile != -1 && LineLen)
+return(NumHits);
+}
+
+
+#ifdef _WIN32
+unsigned __stdcall ProcessSNPsThread(void * pThreadPars)
+#else
+void *ProcessSNPsThread(void * pThreadPars)
+#endif
+{
+	int Rslt;
+	tsSNPThreadPars *pPars = (tsSNPThreadPars *)pThreadPars;			// makes it easier not having to deal with casts!
+	CAligner *pAligner = (CAligner *)pPars->pThis;
+	Rslt = pAligner->ProcessSNPs(pPars);
+	pPars->Rslt = Rslt;
+#ifdef _WIN32
+	_endthreadex(0);
+	return(eBSFSuccess);
+#else
+	pthread_exit(NULL);
+#endif
+}
+
+// ExtendSNPsBuff
+// Extends, or initially allocates, a thread's DiSNPs or TriSNPs buffer
+int
+CAligner::ExtendSNPsBuff(char **ppszBuff,		// extend this DiSNPs or TriSNPs buffer
+				size_t *pAllocBuff)				// currently allocated to hold this many chars, updated with extended size
+{
+char *pTmp;
+size_t memreq;
+memreq = *pAllocBuff == 0 ? (size_t)cAllocSNPsBuff : *pAllocBuff * 2;
+if((pTmp = (char *)realloc(*ppszBuff,memreq))==NULL)
 	{
-	CUtility::SafeWrite(m_hMarkerFile,m_pszLineBuff,LineLen);
-	LineLen = 0;
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"ExtendSNPsBuff: Memory reallocation to %lld bytes failed",(INT64)memreq);
+	return(eBSFerrMem);
 	}
+*ppszBuff = pTmp;
+*pAllocBuff = memreq;
+return(eBSFSuccess);
+}
 
+// GenSNPMarkerSeq
+// Generates marker sequence, as ascii bases, with the putative SNP at Loci being centralised
+// Returns the number of polymorphic sites within the marker sequence, or -1 if unable to generate an acceptable marker sequence
+int
+CAligner::GenSNPMarkerSeq(tsChromSNPs *pChromSNPs,	// base counts for chromosome containing putative SNP
+				UINT32 Loci,						// putative SNP at this loci
+				char *pszMarkerSeq)					// returned marker sequence, must be allocated by caller to hold at least (m_Marker5Len + m_Marker3Len + 2) chars
+{
+int MarkerStartLoci;
+int MarkerSeqIdx;
+int AllelicIdx;
+tsSNPcnts *pSNP;
+tsSNPcnts *pMarkerBase;
+char *pMarkerSeq;
+int TotMarkerLociBases;
+double MarkerLociBaseProportion;
+int MarkerLen;
+int NumPolymorphicSites;
+char SNPbase;
+char RefBase;
+
+// ensure putative marker sequence would be completely contained within the chromosome
+if(Loci < (UINT32)m_Marker5Len)
+	return(-1);
+if((Loci + m_Marker3Len) >= pChromSNPs->ChromLen)
+	return(-1);
+pSNP = &pChromSNPs->Cnts[Loci];
+TotMarkerLociBases = pSNP->NumNonRefBases + pSNP->NumRefBases;
+MarkerLociBaseProportion = (double)pSNP->NumNonRefBases/TotMarkerLociBases;
+if(MarkerLociBaseProportion < 0.5)
+	return(-1);
 
-if(m_NumLociPValues == 0)
-	return(eBSFSuccess);
-if(m_NumLociPValues > 1)
-	m_mtqsort.qsort(m_pLociPValues,m_NumLociPValues,sizeof(tsLociPValues),SortLociPValues);
-pLociPValues = m_pLociPValues;
-NumSNPs = 0;
-for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
+NumPolymorphicSites = 0;
+MarkerLen = 1 + m_Marker5Len + m_Marker3Len;
+MarkerStartLoci = Loci - m_Marker5Len;
+pMarkerSeq = pszMarkerSeq;
+pMarkerBase = &pChromSNPs->Cnts[MarkerStartLoci];
+// check there are alignments covering the complete putative marker sequence
+// and that at any loci covered by the marker has a significant allelic base
+for(MarkerSeqIdx = 0; MarkerSeqIdx < MarkerLen; MarkerSeqIdx++,pMarkerBase++,pMarkerSeq++)
 	{
-	AdjPValue = ((Idx+1)/(double)m_NumLociPValues) * m_QValue;
-	if(pLociPValues->PValue >= AdjPValue)
+	if((TotMarkerLociBases = pMarkerBase->NumNonRefBases + pMarkerBase->NumRefBases) < m_MinSNPreads)	// must be at least enough reads covering to have confidence in base call
+		break;
+	MarkerLociBaseProportion = (double)pMarkerBase->NumNonRefBases/TotMarkerLociBases;
+	if(MarkerLociBaseProportion <= m_MarkerPolyThres)													// if no more than polymorphic threshold then can simply accept RefBase
+		{
+		if(MarkerLociBaseProportion > 0.1)
+			NumPolymorphicSites += 1;
+		*pMarkerSeq = CSeqTrans::MapBase2Ascii(pMarkerBase->RefBase); 
+		continue;
+		}
+	// need to find a major allelic base - base must account for very high proportion of counts
+	for(AllelicIdx = 0; AllelicIdx < 5; AllelicIdx++)
+		if(pMarkerBase->NonRefBaseCnts[AllelicIdx] > 0 && (MarkerLociBaseProportion = ((double)pMarkerBase->NonRefBaseCnts[AllelicIdx]/TotMarkerLociBases)) >= (1.0 - m_MarkerPolyThres))
+			{
+			if(MarkerLociBaseProportion < 0.9)
+				NumPolymorphicSites += 1;
+			*pMarkerSeq = CSeqTrans::MapBase2Ascii(AllelicIdx); 
+			break;
+			}
+	if(AllelicIdx == 5)
 		break;
-	NumSNPs += 1;
-	pLociPValues->Rank = Idx + 1;
 	}
-m_NumLociPValues = NumSNPs;
-if(m_NumLociPValues > 1)
-	m_mtqsort.qsort(m_pLociPValues,m_NumLociPValues,sizeof(tsLociPValues),SortPValuesLoci);
+if(MarkerSeqIdx != MarkerLen)			// only reporting SNPs which are consistent with reported markers
+	return(-1);
+RefBase = CSeqTrans::MapBase2Ascii(pSNP->RefBase);
+SNPbase = pszMarkerSeq[m_Marker5Len];
+if(RefBase == SNPbase)					// double check that the reference base is not being called as being the SNP base
+	return(-1);
+pszMarkerSeq[MarkerLen] = '\0';
+return(NumPolymorphicSites);
+}
 
-DiSNPBuffIdx = 0;
-TriSNPBuffIdx = 0;
-CurDiSNPLoci = 0;
-PrevDiSNPLoci = -1;
-CurTriSNPLoci = 0;
-PrevTriSNPLoci = -1;
-FirstTriSNPLoci = -1;
-TotNumDiSNPs = 0;
-TotNumTriSNPs = 0;
-LineLen = 0;
-pLociPValues = m_pLociPValues;
-for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
+// IdentifySNPs
+// Identifies putative SNPs from the base counts accumulated by CountChromSNPs() for the chromosome span currently being processed by thread
+// Currently can't process for SNPs in InDels or splice junctions
+// FDR: BenjaminiHochberg
+// QValue == acceptable FDR e.g. 0.05% or 0.01%
+// PValue == 1.0 - Stats.Binomial(TotBasesInColumn,NumBasesInColMismatching+1,GlobalSeqErrRate);
+// PValueIdx == sorted index of PValue and locus pairs, 1..k
+// Generate PValues for all alignment columns meeting minimum constraints into an array of structures containing column loci and associated PValues
+// Sort array of structures ascending on PValues
+// Iterate array 1 to k and accept as SNPs those elements with PValues < (PValueIdx/k) * QValue
+// Accepted SNPs are left sorted by loci in pPars->pLociPValues for subsequent output by OutputSNPs(), DiSNPs and TriSNPs are buffered in pPars->pszDiSNPs and pPars->pszTriSNPs
+int
+CAligner::IdentifySNPs(tsSNPThreadPars *pPars)
+{
+int Rslt;
+double PValue;
+double GlobalSeqErrRate;
+double LocalSeqErrRate;
+tsChromSNPs *pChromSNPs;
+tsSNPcnts *pSNP;
+UINT32 Loci;
+int Idx;
+int NumSNPs;
+int TotBases;
+double Proportion;
+double AdjPValue;
+tsLociPValues *pLociPValues;
+size_t memreq;
+tsSNPcnts *pSNPWinL;
+tsSNPcnts *pSNPWinR;
+UINT32 LocalBkgndRateWindow;
+UINT32 LocalBkgndRateWinFlank;
+UINT32 LocalTotMismatches;
+UINT32 LocalTotMatches;
+UINT32 LocTMM;
+UINT32 LocTM;
+CStats Stats;
+
+tsDiSNP sDiSNP;
+tsTriSNP sTriSNP;
+
+tsSNPcnts PrevSNPs[3]; // to hold counts for prev 2 plus currrent SNP - used when reporting Di/TriSNPs
+
+int CurDiSNPLoci;
+int PrevDiSNPLoci;
+size_t DiSNPBuffIdx;
+char *szDiSNPs;
+
+int CurTriSNPLoci;
+int PrevTriSNPLoci;
+int FirstTriSNPLoci;
+size_t TriSNPBuffIdx;
+char *szTriSNPs;
+int TotNumDiSNPs;
+int TotNumTriSNPs;
+
+int NumPolymorphicSites;
+char szMarkerSeq[cMaxMarkerLen * 2 + 2];
+
+UINT8 SNPFlanks[9];
+UINT8 *pSNPFlank;
+int SNPFlankIdx;
+int SNPCentroidIdx;
+UINT8 Base;
+tsSNPCentroid *pCentroid;
+
+pChromSNPs = pPars->pChromSNPs;
+pPars->NumCandidates = 0;
+pPars->NumLociPValues = 0;
+pPars->DiSNPsLen = 0;
+pPars->TriSNPsLen = 0;
+
+if(pPars->pLociPValues == NULL)					// will be NULL first time in
 	{
-	m_TotNumSNPs += 1;
-	RelRank = max(1,999 - ((999 * pLociPValues->Rank) / m_NumLociPValues));
-	if(m_FMode == eFMbed)
+	memreq = cAllocLociPValues * sizeof(tsLociPValues);
+#ifdef _WIN32
+	pPars->pLociPValues = (tsLociPValues *) malloc((size_t)memreq);
+	if(pPars->pLociPValues == NULL)
 		{
-		LineLen+=sprintf(&m_pszLineBuff[LineLen],"%s\t%d\t%d\tSNP_%d\t%d\t+\n",
-				szChromName,pLociPValues->Loci,pLociPValues->Loci+1,m_TotNumSNPs,RelRank);
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"IdentifySNPs: Memory allocation of %lld bytes failed",(INT64)memreq);
+		return(eBSFerrMem);
 		}
-	else   // else could be either CSV or VCF
+#else
+	// gnu malloc is still in the 32bit world and can't handle more than 2GB allocations
+	pPars->pLociPValues = (tsLociPValues *)mmap(NULL,(size_t)memreq, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, -1,0);
+	if(pPars->pLociPValues == MAP_FAILED)
 		{
-		if (m_bSNPsVCF)
-			{
-			char szALTs[100];
-			char szAltFreq[100];
-			int AltOfs;
-			int SNPPhred;
-			int AltFreqOfs;
-			int AltIdx;
-			UINT32 CntsThres;		// only reporting cnts which are at least 10% of the highest non-ref base counts. 
-									// otherwise too many noise cnt bases are reported 
+		pPars->pLociPValues = NULL;
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"IdentifySNPs: Memory allocation of %lld bytes through mmap()  failed",(INT64)memreq,strerror(errno));
+		return(eBSFerrMem);
+		}
+#endif
+	pPars->AllocLociPValuesMem = memreq;
+	}
 
-			CntsThres = 0;
-			for (AltIdx = 0; AltIdx < eBaseN; AltIdx++)
-				{
-				if (AltIdx == pLociPValues->SNPcnts.RefBase)
-					continue;
-				if (pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx] > CntsThres)
-					CntsThres = pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx];
-				}
-			CntsThres = max((CntsThres + 5) / 10, 1);
-			AltOfs = 0;
-			AltFreqOfs = 0;
-			for (AltIdx = 0; AltIdx < eBaseN; AltIdx++)
+if(!m_bIsSOLiD && m_hDiSNPfile != -1)
+	{
+	if(pPars->pszDiSNPs == NULL && (Rslt = ExtendSNPsBuff(&pPars->pszDiSNPs,&pPars->AllocDiSNPs)) < eBSFSuccess)
+		return(Rslt);
+	if(pPars->pszTriSNPs == NULL && (Rslt = ExtendSNPsBuff(&pPars->pszTriSNPs,&pPars->AllocTriSNPs)) < eBSFSuccess)
+		return(Rslt);
+	}
+
+// NOTE: set a floor on the global (whole chromosome) sequencing error rate
+GlobalSeqErrRate = max(cMinSeqErrRate,(double)pChromSNPs->TotMismatch / (double)(1 + pChromSNPs->TotMatch + pChromSNPs->TotMismatch));
+
+
+pSNPWinR = &pChromSNPs->Cnts[0];
+LocalBkgndRateWinFlank = cSNPBkgndRateWindow / 2;
+LocalBkgndRateWindow = (LocalBkgndRateWinFlank * 2) + 1;
+LocalTotMismatches = 0;
+LocalTotMatches = 0;
+
+
+for(Loci = 0; Loci < min(LocalBkgndRateWindow,pChromSNPs->ChromLen); Loci++,pSNPWinR++)
+	{
+	LocalTotMismatches += pSNPWinR->NumNonRefBases;
+	LocalTotMatches += pSNPWinR->NumRefBases;
+	}
+
+pLociPValues = pPars->pLociPValues;
+pPars->NumLociPValues = 0;
+pSNP = &pChromSNPs->Cnts[0];
+pSNPWinL = pSNP;
+
+
+for(Loci = 0; Loci < pChromSNPs->ChromLen;Loci++, pSNP++)
+	{
+	// determine background expected error rate from window surrounding the current loci
+	if(Loci > LocalBkgndRateWinFlank && (Loci + LocalBkgndRateWinFlank) < pChromSNPs->ChromLen)
+		{
+		// need to ensure that LocalTotMismatches and LocalTotMismatches will never underflow
+		if(LocalTotMismatches >= pSNPWinL->NumNonRefBases)
+			LocalTotMismatches -= pSNPWinL->NumNonRefBases;
+		else
+			LocalTotMismatches = 0;
+		if(LocalTotMatches >= pSNPWinL->NumRefBases)
+			LocalTotMatches -= pSNPWinL->NumRefBases;
+		else
+			LocalTotMatches = 0;
+		LocalTotMismatches += pSNPWinR->NumNonRefBases;
+		LocalTotMatches += pSNPWinR->NumRefBases;
+		pSNPWinL += 1;
+		pSNPWinR += 1;
+		}
+
+	TotBases = pSNP->NumNonRefBases + pSNP->NumRefBases;
+	if(TotBases > 0)
+		{
+		pPars->LociBasesCovered += 1;
+		pPars->LociBasesCoverage += TotBases;
+		}
+
+	if(TotBases < m_MinSNPreads)
+		continue;
+
+	if(m_hSNPCentsfile != -1)
+		{
+		// get 4bases up/dn stream from loci with SNP and use these to inc centroid counts of from/to counts
+		if(Loci >= cSNPCentfFlankLen && Loci < (pChromSNPs->ChromLen - cSNPCentfFlankLen))
+			{
+			m_pSfxArray->GetSeq(pChromSNPs->ChromID,Loci-(UINT32)cSNPCentfFlankLen,SNPFlanks,cSNPCentroidLen);
+			pSNPFlank = &SNPFlanks[cSNPCentroidLen-1];
+			SNPCentroidIdx = 0;
+			for(SNPFlankIdx = 0; SNPFlankIdx < cSNPCentroidLen; SNPFlankIdx++,pSNPFlank--)
 				{
-				if (AltIdx == pLociPValues->SNPcnts.RefBase)
-					continue;
-				if (pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx] >= CntsThres)
-					{
-					if (AltOfs > 0)
-						{
-						szALTs[AltOfs++] = ',';
-						szAltFreq[AltFreqOfs++] = ',';
-						}
-					szALTs[AltOfs++] = CSeqTrans::MapBase2Ascii(AltIdx);
-					szALTs[AltOfs] = '\0';
-					AltFreqOfs += sprintf(&szAltFreq[AltFreqOfs], "%1.4f", (double)pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx] / pLociPValues->NumReads);
-					}
+				Base = *pSNPFlank & 0x07;
+				if(Base > eBaseT)
+					break;
+				SNPCentroidIdx |= (Base << (SNPFlankIdx * 2));
 				}
-			if (pLociPValues->PValue < 0.0000000001)
-				SNPPhred = 100;
-			else
-				SNPPhred = (int)(0.5 + (10.0*log10(1.0 / pLociPValues->PValue)));
-			LineLen += sprintf(&m_pszLineBuff[LineLen], "%s\t%u\tSNP%d\t%c\t%s\t%d\tPASS\tAF=%s;DP=%d\n",
-				szChromName, pLociPValues->Loci + 1, m_TotNumSNPs, CSeqTrans::MapBase2Ascii(pLociPValues->SNPcnts.RefBase),
-				szALTs, SNPPhred, szAltFreq, pLociPValues->NumReads);
+			if(SNPFlankIdx == cSNPCentroidLen)
+				pPars->pSNPCentroids[SNPCentroidIdx].NumInsts += 1;
 			}
-		else
+		}
+
+
+	if(pSNP->NumNonRefBases < cMinSNPreads)
+		continue; 
+	Proportion = (double)pSNP->NumNonRefBases/TotBases;
+	if(Proportion < m_SNPNonRefPcnt)	// needs to be at least this proportion of non-ref bases to be worth exploring as being SNP
+		continue;
+
+	// needing to allocate more memory? NOTE: allowing small safety margin of 10 tsLociPValues
+	if(pPars->AllocLociPValuesMem  < (sizeof(tsLociPValues) * (pPars->NumLociPValues + 10)))
+		{
+		size_t memreq = pPars->AllocLociPValuesMem + (cAllocLociPValues * sizeof(tsLociPValues));
+#ifdef _WIN32
+		pLociPValues = (tsLociPValues *) realloc(pPars->pLociPValues,memreq);
+		if(pLociPValues == NULL)
 			{
-			// for consistency now including refbase counts as if nonref - totals accross all nonref bases will sum to be same as numreads covering the SNP loci
-			pLociPValues->SNPcnts.NonRefBaseCnts[pLociPValues->SNPcnts.RefBase] = pLociPValues->NumReads - pLociPValues->NumSubs;
-			LineLen += sprintf(&m_pszLineBuff[LineLen], "%d,\"SNP\",\"%s\",\"%s\",%d,%d,1,\"+\",%d,%f,%d,%d,\"%c\",%d,%d,%d,%d,%d,%f,%d,%d,%d,%d\n",
-				m_TotNumSNPs, m_szTargSpecies, szChromName, pLociPValues->Loci, pLociPValues->Loci, RelRank, pLociPValues->PValue,
-				pLociPValues->NumReads, pLociPValues->NumSubs,
-				CSeqTrans::MapBase2Ascii(pLociPValues->SNPcnts.RefBase),
-				pLociPValues->SNPcnts.NonRefBaseCnts[0], pLociPValues->SNPcnts.NonRefBaseCnts[1], pLociPValues->SNPcnts.NonRefBaseCnts[2], pLociPValues->SNPcnts.NonRefBaseCnts[3], pLociPValues->SNPcnts.NonRefBaseCnts[4],
-				pLociPValues->LocalBkGndSubRate, pLociPValues->LocalReads, pLociPValues->LocalSubs, pLociPValues->MarkerID, pLociPValues->NumPolymorphicSites);
+#else
+		pLociPValues = (tsLociPValues *)mremap(pPars->pLociPValues,pPars->AllocLociPValuesMem,memreq,MREMAP_MAYMOVE);
+		if(pLociPValues == MAP_FAILED)
+			{
+#endif
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"IdentifySNPs: Memory reallocation to %lld bytes failed - %s",memreq,strerror(errno));
+			return(eBSFerrMem);
 			}
+		pPars->pLociPValues = pLociPValues;
+		pPars->AllocLociPValuesMem = memreq;
+		pLociPValues = &pPars->pLociPValues[pPars->NumLociPValues];
 		}
-	if((LineLen + cMaxSeqLen + 1) > cAllocLineBuffSize)
+
+
+
+	if(pSNP->NumNonRefBases <= LocalTotMismatches)
+		LocTMM = LocalTotMismatches - pSNP->NumNonRefBases;
+	else
+		LocTMM = 0;
+
+	if(pSNP->NumRefBases < LocalTotMatches)
+		LocTM = LocalTotMatches - pSNP->NumRefBases;
+	else
+		LocTM = 0;
+
+
+	if((LocTMM + LocTM) == 0)
+		LocalSeqErrRate = GlobalSeqErrRate;
+	else
 		{
-		CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
-		LineLen = 0;
+		LocalSeqErrRate = (double)LocTMM / (double)(LocTMM + LocTM);
+		if(LocalSeqErrRate < GlobalSeqErrRate)
+			LocalSeqErrRate = GlobalSeqErrRate;
 		}
+	if(LocalSeqErrRate > cMaxBkgdNoiseThres)	// don't bother attempting to call if the background is too noisy
+		continue;
 
-	if (gProcessingID > 0)
+	// accepting as being a putative SNP
+	// if outputting as marker sequence then get SNP up/dnstream sequence and report
+	if(m_hMarkerFile != -1)			// output marker sequences? 
 		{
-		sMonoSNP.MonoSnpPID = m_TotNumSNPs;						// SNP instance, processing instance unique
-		strcpy(sMonoSNP.szElType, "SNP");						// SNP type
-		strcpy(sMonoSNP.szSpecies, m_szTargSpecies);			// SNP located for alignments againts this target/species assembly	
-		strcpy(sMonoSNP.szChrom, szChromName);					// SNP is on this chrom
-		sMonoSNP.StartLoci = pLociPValues->Loci;				// offset (0..N) at which SNP located
-		sMonoSNP.EndLoci = pLociPValues->Loci;					// offset (0..N) at which SNP located - allowing for future polymorphic varation covering multiple bases
-		sMonoSNP.Len = 1;										// polymorphic variation is of this length
-		sMonoSNP.szStrand[0] = '+'; sMonoSNP.szStrand[1] = '\0'; // SNP relative to this strand
-		sMonoSNP.Rank = RelRank;								// ranking confidence in thisSNP - min 0, max 1000
-		sMonoSNP.PValue = pLociPValues->PValue;					// probability of this SNP being a false positive
-		sMonoSNP.Bases = pLociPValues->NumReads;				// total number of bases aligning over the SNP loci
-		sMonoSNP.Mismatches = pLociPValues->NumSubs;			// aligned bases were aligning with this many mismatches
-		sMonoSNP.szRefBase[0] = CSeqTrans::MapBase2Ascii(pLociPValues->SNPcnts.RefBase); sMonoSNP.szRefBase[1] = '\0';			// target sequence base at the SNP locai
-		sMonoSNP.MMBaseA = pLociPValues->SNPcnts.NonRefBaseCnts[0];			// this many mismatched bases were A
-		sMonoSNP.MMBaseC = pLociPValues->SNPcnts.NonRefBaseCnts[1];			// this many mismatched bases were C
-		sMonoSNP.MMBaseG = pLociPValues->SNPcnts.NonRefBaseCnts[2];			// this many mismatched bases were G
-		sMonoSNP.MMBaseT = pLociPValues->SNPcnts.NonRefBaseCnts[3];			// this many mismatched bases were T
-		sMonoSNP.MMBaseN = pLociPValues->SNPcnts.NonRefBaseCnts[4];			// this many mismatched bases were N
-		sMonoSNP.BackgroundSubRate = pLociPValues->LocalBkGndSubRate;		// background substitution rate within a window centered at SNP loci
-		sMonoSNP.TotWinBases = pLociPValues->LocalReads;					// total number of bases within centeredwindow
-		sMonoSNP.TotWinMismatches = pLociPValues->LocalSubs;				// total number of mismatched bases within centered window
-		sMonoSNP.MarkerID = pLociPValues->MarkerID;							// marker identifier
-		sMonoSNP.NumPolymorphicSites = pLociPValues->NumPolymorphicSites;	// number of polymorphic sites within marker
-		gSQLiteSummaries.AddMonoSNP(gExperimentID, gProcessingID,&sMonoSNP);
+		// marker identifiers are assigned, and marker sequences written, by OutputSNPs() so as to maintain chromosome ordering
+		if((NumPolymorphicSites = GenSNPMarkerSeq(pChromSNPs,Loci,szMarkerSeq)) < 0)
+			continue;
+		pLociPValues->MarkerID = 1;
+		pLociPValues->NumPolymorphicSites = NumPolymorphicSites;
+		}
+	else
+		{
+		pLociPValues->MarkerID = 0;
+		pLociPValues->NumPolymorphicSites = 0;
 		}
+	PValue = 1.0 - Stats.Binomial(TotBases,pSNP->NumNonRefBases,LocalSeqErrRate);
+	pLociPValues->PValue = PValue;
+	pLociPValues->Loci = Loci;
+	pLociPValues->Rank = 0;
+	pLociPValues->LocalBkGndSubRate = LocalSeqErrRate;
+	pLociPValues->LocalReads = LocTMM + LocTM;
+	pLociPValues->LocalSubs = LocTMM;
+	pLociPValues->NumReads = TotBases;
+	pLociPValues->SNPcnts = *pSNP;
+	pLociPValues->NumSubs = pSNP->NumNonRefBases;
+	pLociPValues += 1;
+	pPars->NumLociPValues += 1;
+	}
+pPars->NumCandidates = pPars->NumLociPValues;
+if(pPars->NumLociPValues == 0)
+	return(eBSFSuccess);
+if(pPars->NumLociPValues > 1)
+	qsort(pPars->pLociPValues,pPars->NumLociPValues,sizeof(tsLociPValues),SortLociPValues);
+pLociPValues = pPars->pLociPValues;
+NumSNPs = 0;
+for(Idx = 0; Idx < (int)pPars->NumLociPValues; Idx++,pLociPValues++)
+	{
+	AdjPValue = ((Idx+1)/(double)pPars->NumLociPValues) * m_QValue;
+	if(pLociPValues->PValue >= AdjPValue)
+		break;
+	NumSNPs += 1;
+	pLociPValues->Rank = Idx + 1;
+	}
+pPars->NumLociPValues = NumSNPs;
+if(pPars->NumLociPValues > 1)
+	qsort(pPars->pLociPValues,pPars->NumLociPValues,sizeof(tsLociPValues),SortPValuesLoci);
+// marker sequences are reported for all putative SNPs, not just those accepted, so these are also required to be in loci order
+if(m_hMarkerFile != -1 && (pPars->NumCandidates - pPars->NumLociPValues) > 1)
+	qsort(&pPars->pLociPValues[pPars->NumLociPValues],pPars->NumCandidates - pPars->NumLociPValues,sizeof(tsLociPValues),SortPValuesLoci);
 
+DiSNPBuffIdx = 0;
+TriSNPBuffIdx = 0;
+szDiSNPs = pPars->pszDiSNPs;
+szTriSNPs = pPars->pszTriSNPs;
+CurDiSNPLoci = 0;
+PrevDiSNPLoci = -1;
+CurTriSNPLoci = 0;
+PrevTriSNPLoci = -1;
+FirstTriSNPLoci = -1;
+TotNumDiSNPs = 0;
+TotNumTriSNPs = 0;
+pLociPValues = pPars->pLociPValues;
+for(Idx = 0; Idx < (int)pPars->NumLociPValues; Idx++,pLociPValues++)
+	{
 #ifdef _DISNPS_
 	if (!m_bIsSOLiD && m_hDiSNPfile != -1)
 		{
@@ -7263,23 +7961,23 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 
 		Loci = pLociPValues->Loci;
 		CurDiSNPLoci = Loci;
-		pSNP = &m_pChromSNPs->Cnts[Loci];
-		if (PrevDiSNPLoci != -1 && CurDiSNPLoci > 0 && ((CurDiSNPLoci - PrevDiSNPLoci) <= m_MaxDiSNPSep))
+		pSNP = &pChromSNPs->Cnts[Loci];
+		if (PrevDiSNPLoci != -1 && CurDiSNPLoci > 0 && ((CurDiSNPLoci - PrevDiSNPLoci) <= pPars->MaxDiSNPSep))
 			{
 			NumReadsOverlapping = 0;
 			NumReadsAntisense = 0;
 			memset(DiSNPCnts, 0, sizeof(DiSNPCnts));
 			memset(PrevSNPs, 0, sizeof(PrevSNPs));
 			PrevSNPs[0].RefBase = pSNP->RefBase;
-			PrevSNPs[1].RefBase = (&m_pChromSNPs->Cnts[PrevDiSNPLoci])->RefBase;
+			PrevSNPs[1].RefBase = (&pChromSNPs->Cnts[PrevDiSNPLoci])->RefBase;
 
-			while ((pCurOverlappingRead = IterateReadsOverlapping(false, m_pChromSNPs, PrevDiSNPLoci, CurDiSNPLoci)) != NULL)
+			while ((pCurOverlappingRead = IterateReadsOverlapping(false, pChromSNPs, PrevDiSNPLoci, CurDiSNPLoci)) != NULL)
 				{
 				// get bases at both SNP loci for current overlapping read
-				PrevDiSNPBase = AdjAlignSNPBase(pCurOverlappingRead, m_pChromSNPs->ChromID, PrevDiSNPLoci);
+				PrevDiSNPBase = AdjAlignSNPBase(pCurOverlappingRead, pChromSNPs->ChromID, PrevDiSNPLoci);
 				if (PrevDiSNPBase > eBaseT)
 					continue;
-				CurDiSNPBase = AdjAlignSNPBase(pCurOverlappingRead, m_pChromSNPs->ChromID, CurDiSNPLoci);
+				CurDiSNPBase = AdjAlignSNPBase(pCurOverlappingRead, pChromSNPs->ChromID, CurDiSNPLoci);
 				if (CurDiSNPBase > eBaseT)
 					continue;
 				PrevSNPs[1].NonRefBaseCnts[PrevDiSNPBase] += 1;
@@ -7306,14 +8004,14 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 					if (DiSNPCnts[DiSNPIdx] >= HaplotypeCntThres)
 						NumHaplotypes += 1;
 				TotNumDiSNPs += 1;
-				DiSNPBuffIdx += sprintf(&szDiSNPs[DiSNPBuffIdx], "%d,\"DiSNPs\",\"%s\",\"%s\",", TotNumDiSNPs, m_szTargSpecies, szChromName);
+				DiSNPBuffIdx += sprintf(&szDiSNPs[DiSNPBuffIdx], "%d,\"DiSNPs\",\"%s\",\"%s\",", TotNumDiSNPs, m_szTargSpecies, pPars->szChromName);
 
 				if (gProcessingID > 0)
 					{
 					sDiSNP.DiSnpPID = TotNumDiSNPs;		// SNP instance, processing instance unique
 					strcpy(sDiSNP.szElType, "DiSNPs");		// SNP type
 					strcpy(sDiSNP.szSpecies, m_szTargSpecies);		// SNP located for alignments againts this target/species assembly	
-					strcpy(sDiSNP.szChrom, szChromName);		// SNP is on this chrom
+					strcpy(sDiSNP.szChrom, pPars->szChromName);		// SNP is on this chrom
 					}
 
 				char SNPrefBases[2];
@@ -7388,16 +8086,17 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 				if (gProcessingID > 0)
 					gSQLiteSummaries.AddDiSNP(gExperimentID, gProcessingID, &sDiSNP);
 
-				if ((DiSNPBuffIdx + 200) > sizeof(szDiSNPs))
+				if ((DiSNPBuffIdx + cMinFreeSNPsBuff) > pPars->AllocDiSNPs)
 					{
-					CUtility::SafeWrite(m_hDiSNPfile, szDiSNPs, DiSNPBuffIdx);
-					DiSNPBuffIdx = 0;
+					if((Rslt = ExtendSNPsBuff(&pPars->pszDiSNPs,&pPars->AllocDiSNPs)) < eBSFSuccess)
+						return(Rslt);
+					szDiSNPs = pPars->pszDiSNPs;
 					}
 				}
 			}
 
 		CurTriSNPLoci = Loci;
-		if (FirstTriSNPLoci != -1 && PrevTriSNPLoci > 0 && CurTriSNPLoci > 0 && ((CurTriSNPLoci - FirstTriSNPLoci) <= m_MaxDiSNPSep))
+		if (FirstTriSNPLoci != -1 && PrevTriSNPLoci > 0 && CurTriSNPLoci > 0 && ((CurTriSNPLoci - FirstTriSNPLoci) <= pPars->MaxDiSNPSep))
 			{
 			NumReadsOverlapping = 0;
 			NumReadsAntisense = 0;
@@ -7405,19 +8104,19 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 
 			memset(PrevSNPs, 0, sizeof(PrevSNPs));
 			PrevSNPs[0].RefBase = pSNP->RefBase;
-			PrevSNPs[1].RefBase = (&m_pChromSNPs->Cnts[PrevTriSNPLoci])->RefBase;
-			PrevSNPs[2].RefBase = (&m_pChromSNPs->Cnts[FirstTriSNPLoci])->RefBase;
+			PrevSNPs[1].RefBase = (&pChromSNPs->Cnts[PrevTriSNPLoci])->RefBase;
+			PrevSNPs[2].RefBase = (&pChromSNPs->Cnts[FirstTriSNPLoci])->RefBase;
 
-			while ((pCurOverlappingRead = IterateReadsOverlapping(true, m_pChromSNPs, FirstTriSNPLoci, CurTriSNPLoci)) != NULL)
+			while ((pCurOverlappingRead = IterateReadsOverlapping(true, pChromSNPs, FirstTriSNPLoci, CurTriSNPLoci)) != NULL)
 				{
 				// get bases at all three SNP loci
-				FirstTriSNPBase = AdjAlignSNPBase(pCurOverlappingRead, m_pChromSNPs->ChromID, FirstTriSNPLoci);
+				FirstTriSNPBase = AdjAlignSNPBase(pCurOverlappingRead, pChromSNPs->ChromID, FirstTriSNPLoci);
 				if (FirstTriSNPBase > eBaseT)
 					continue;
-				PrevTriSNPBase = AdjAlignSNPBase(pCurOverlappingRead, m_pChromSNPs->ChromID, PrevTriSNPLoci);
+				PrevTriSNPBase = AdjAlignSNPBase(pCurOverlappingRead, pChromSNPs->ChromID, PrevTriSNPLoci);
 				if (PrevTriSNPBase > eBaseT)
 					continue;
-				CurTriSNPBase = AdjAlignSNPBase(pCurOverlappingRead, m_pChromSNPs->ChromID, CurTriSNPLoci);
+				CurTriSNPBase = AdjAlignSNPBase(pCurOverlappingRead, pChromSNPs->ChromID, CurTriSNPLoci);
 				if (CurTriSNPBase > eBaseT)
 					continue;
 
@@ -7452,13 +8151,13 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 						NumHaplotypes += 1;
 				TotNumTriSNPs += 1;
 
-				TriSNPBuffIdx += sprintf(&szTriSNPs[TriSNPBuffIdx], "%d,\"TriSNPs\",\"%s\",\"%s\",", TotNumTriSNPs, m_szTargSpecies, szChromName);
+				TriSNPBuffIdx += sprintf(&szTriSNPs[TriSNPBuffIdx], "%d,\"TriSNPs\",\"%s\",\"%s\",", TotNumTriSNPs, m_szTargSpecies, pPars->szChromName);
 				if (gProcessingID > 0)
 					{
 					sTriSNP.TriSnpPID = TotNumTriSNPs;		// SNP instance, processing instance unique
 					strcpy(sTriSNP.szElType, "TriSNPs");		// SNP type
 					strcpy(sTriSNP.szSpecies, m_szTargSpecies);		// SNP located for alignments againts this target/species assembly	
-					strcpy(sTriSNP.szChrom, szChromName);		// SNP is on this chrom
+					strcpy(sTriSNP.szChrom, pPars->szChromName);		// SNP is on this chrom
 					}
 				char SNPrefBases[3];
 				int RefBasesIdx;
@@ -7543,10 +8242,11 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 				TriSNPBuffIdx += sprintf(&szTriSNPs[TriSNPBuffIdx], "\n");
 				if (gProcessingID > 0)
 					gSQLiteSummaries.AddTriSNP(gExperimentID, gProcessingID, &sTriSNP);
-				if ((TriSNPBuffIdx + 500) > sizeof(szTriSNPs))
+				if ((TriSNPBuffIdx + cMinFreeSNPsBuff) > pPars->AllocTriSNPs)
 					{
-					CUtility::SafeWrite(m_hTriSNPfile, szTriSNPs, TriSNPBuffIdx);
-					TriSNPBuffIdx = 0;
+					if((Rslt = ExtendSNPsBuff(&pPars->pszTriSNPs,&pPars->AllocTriSNPs)) < eBSFSuccess)
+						return(Rslt);
+					szTriSNPs = pPars->pszTriSNPs;
 					}
 				}
 			}
@@ -7559,9 +8259,9 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 	if(m_hSNPCentsfile != -1)
 		{
 		// get 4bases up/dn stream from loci with SNP and use these to inc centroid counts of from/to counts
-		if(pLociPValues->Loci >= cSNPCentfFlankLen && pLociPValues->Loci < (m_pChromSNPs->ChromLen - cSNPCentfFlankLen))
+		if(pLociPValues->Loci >= cSNPCentfFlankLen && pLociPValues->Loci < (pChromSNPs->ChromLen - cSNPCentfFlankLen))
 			{
-			m_pSfxArray->GetSeq(m_pChromSNPs->ChromID,pLociPValues->Loci-(UINT32)cSNPCentfFlankLen,SNPFlanks,cSNPCentroidLen);
+			m_pSfxArray->GetSeq(pChromSNPs->ChromID,pLociPValues->Loci-(UINT32)cSNPCentfFlankLen,SNPFlanks,cSNPCentroidLen);
 			pSNPFlank = &SNPFlanks[cSNPCentroidLen-1];
 			SNPCentroidIdx = 0;
 			for(SNPFlankIdx = 0; SNPFlankIdx < cSNPCentroidLen; SNPFlankIdx++,pSNPFlank--)
@@ -7574,8 +8274,8 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 			if(SNPFlankIdx != cSNPCentroidLen)
 				continue;
 
-			pSNP = &m_pChromSNPs->Cnts[pLociPValues->Loci];
-			pCentroid = &m_pSNPCentroids[SNPCentroidIdx];
+			pSNP = &pChromSNPs->Cnts[pLociPValues->Loci];
+			pCentroid = &pPars->pSNPCentroids[SNPCentroidIdx];
 			pCentroid->CentroidID = SNPCentroidIdx;
 			pCentroid->RefBaseCnt += pSNP->NumRefBases;
 			pCentroid->NonRefBaseCnts[0] += pSNP->NonRefBaseCnts[0];
@@ -7586,516 +8286,954 @@ for(Idx = 0; Idx < (int)m_NumLociPValues; Idx++,pLociPValues++)
 			pCentroid->NumSNPs += 1;
 			}
 		}
-
-	}
-if (m_hDiSNPfile != -1 && DiSNPBuffIdx > 0)
-	{
-	CUtility::SafeWrite(m_hDiSNPfile, szDiSNPs, DiSNPBuffIdx);
-	DiSNPBuffIdx = 0;
 	}
-if (m_hTriSNPfile != -1 && TriSNPBuffIdx > 0)
-	{
-	CUtility::SafeWrite(m_hTriSNPfile, szTriSNPs, TriSNPBuffIdx);
-	DiSNPBuffIdx = 0;
-	}
-
-if(LineLen)
-	CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
+pPars->DiSNPsLen = DiSNPBuffIdx;
+pPars->TriSNPsLen = TriSNPBuffIdx;
 return(eBSFSuccess);
 }
 
-
+// OutputSNPs
+// Writes out the marker sequences, SNPs, DiSNPs and TriSNPs identified by IdentifySNPs() for the chromosome span currently being processed by thread
+// Called only when all prior chromosome spans have been written out so SNP and marker identifiers are sequential over all chromosomes
 int
-CAligner::ProcessSNPs(void)
+CAligner::OutputSNPs(tsSNPThreadPars *pPars)
 {
-int Rslt;
+tsChromSNPs *pChromSNPs;
+int Idx;
 int LineLen;
+int RelRank;
+int MarkerLen;
+tsLociPValues *pLociPValues;
+tsLociPValues *pAccepted;
+tsLociPValues *pAcceptedEnd;
+tsLociPValues *pRejected;
+tsLociPValues *pRejectedEnd;
+char szMarkerSeq[cMaxMarkerLen * 2 + 2];
+tsMonoSNP sMonoSNP;
 
-UINT32 SeqIdx;
-etSeqBase ReadSeq[cMaxFastQSeqLen+1];	// to hold sequence (sans quality scores) for current read
-etSeqBase AssembSeq[cMaxFastQSeqLen+1];	// to hold targeted genome assembly sequence
+pChromSNPs = pPars->pChromSNPs;
+LineLen = 0;
+if(m_hMarkerFile != -1 && pPars->NumCandidates > 0)
+	{
+	// marker sequences were generated for all putative SNPs, those accepted are sorted by loci in pLociPValues[0..NumLociPValues-1]
+	// and those not accepted are sorted by loci in pLociPValues[NumLociPValues..NumCandidates-1], merge these to report in loci order
+	MarkerLen = 1 + m_Marker5Len + m_Marker3Len;
+	pAccepted = pPars->pLociPValues;
+	pAcceptedEnd = &pPars->pLociPValues[pPars->NumLociPValues];
+	pRejected = pAcceptedEnd;
+	pRejectedEnd = &pPars->pLociPValues[pPars->NumCandidates];
+	while(pAccepted < pAcceptedEnd || pRejected < pRejectedEnd)
+		{
+		if(pRejected == pRejectedEnd || (pAccepted < pAcceptedEnd && pAccepted->Loci < pRejected->Loci))
+			pLociPValues = pAccepted++;
+		else
+			pLociPValues = pRejected++;
+		if(GenSNPMarkerSeq(pChromSNPs,pLociPValues->Loci,szMarkerSeq) < 0)		// marker sequence was accepted by IdentifySNPs() so should never fail!
+			continue;
 
-etSeqBase TargBases[3];
-etSeqBase ReadBase;
-tsSNPcnts *pSNP;
-UINT8 *pSeqVal;
-etSeqBase *pReadSeq;
-etSeqBase *pAssembSeq;
-tsSegLoci *pSeg;
-tsReadHit *pReadHit;
-tBSFEntryID PrevTargEntry;
-UINT32 ChromLen;
-UINT32 HitLoci;
-UINT32 MatchLen;
-UINT32 PrevMMChromID;
-UINT32 PrevMMLoci;
+		m_MarkerID += 1;
+		pLociPValues->MarkerID = m_MarkerID;
+		// >MarkerNNN  Chrom StartLoci|MarkerLen|SNPLoci|Marker5Len,SNPbase|RefBase|NumPolymorphicSites
+		LineLen+=sprintf(&m_pszLineBuff[LineLen],">Marker%d %s %d|%d|%d|%d|%c|%c|%d\n%s\n",
+										m_MarkerID,pPars->szChromName,pLociPValues->Loci - m_Marker5Len,MarkerLen,pLociPValues->Loci,m_Marker5Len,
+										szMarkerSeq[m_Marker5Len],CSeqTrans::MapBase2Ascii(pLociPValues->SNPcnts.RefBase),pLociPValues->NumPolymorphicSites,szMarkerSeq);
 
-if(m_FMode == eFMbed)
-	{
-	LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"%s_SNPs\" description=\"%s SNPs\"\n",m_pszTrackTitle,m_pszTrackTitle);
-	CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
-	LineLen = 0;
+		if((LineLen + cMaxSeqLen) > cAllocLineBuffSize)
+			{
+			CUtility::SafeWrite(m_hMarkerFile,m_pszLineBuff,LineLen);
+			LineLen = 0;
+			}
+		}
+	if(LineLen)
+		{
+		CUtility::SafeWrite(m_hMarkerFile,m_pszLineBuff,LineLen);
+		LineLen = 0;
+		}
 	}
-else			// else must be either CSV or VCF
+
+pLociPValues = pPars->pLociPValues;
+for(Idx = 0; Idx < (int)pPars->NumLociPValues; Idx++,pLociPValues++)
 	{
-	if(m_bSNPsVCF)
+	m_TotNumSNPs += 1;
+	RelRank = max(1,999 - ((999 * pLociPValues->Rank) / pPars->NumLociPValues));
+	if(m_FMode == eFMbed)
 		{
-		LineLen = sprintf(m_pszLineBuff,"##fileformat=VCFv4.2\n##source=biokangaV%s\n##reference=%s\n##INFO=<ID=AF,Number=A,Type=Float,Description=\"Allele Frequency\">\n##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Read Depth\">\n",
-													cpszProgVer,m_pszSfxFile);
-		LineLen += sprintf(&m_pszLineBuff[LineLen],"#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n");
+		LineLen+=sprintf(&m_pszLineBuff[LineLen],"%s\t%d\t%d\tSNP_%d\t%d\t+\n",
+				pPars->szChromName,pLociPValues->Loci,pLociPValues->Loci+1,m_TotNumSNPs,RelRank);
 		}
-	else
-		LineLen = sprintf(m_pszLineBuff,"\"SNP_ID\",\"ElType\",\"Species\",\"Chrom\",\"StartLoci\",\"EndLoci\",\"Len\",\"Strand\",\"Rank\",\"PValue\",\"Bases\",\"Mismatches\",\"RefBase\",\"MMBaseA\",\"MMBaseC\",\"MMBaseG\",\"MMBaseT\",\"MMBaseN\",\"BackgroundSubRate\",\"TotWinBases\",\"TotWinMismatches\",\"MarkerID\",\"NumPolymorphicSites\"\n");
-	CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
-	LineLen = 0;
-	}
-
-if(m_hDiSNPfile != -1)
-	{
-	int Idx;
-	char szDiSNPs[3];
-	LineLen = sprintf(m_pszLineBuff,"\"DiSNPs_ID\",\"ElType\",\"Species\",\"Chrom\",\"SNP1Loci\",\"SNP1RefBase\",\"SNP1BaseAcnt\",\"SNP1BaseCcnt\",\"SNP1BaseGcnt\",\"SNP1BaseTcnt\",\"SNP1BaseNcnt\",\"SNP2Loci\",\"SNP2RefBase\",\"SNP2BaseAcnt\",\"SNP2BaseCcnt\",\"SNP2BaseGcnt\",\"SNP2BaseTcnt\",\"SNP2BaseNcnt\",\"Depth\",\"Antisense\",\"Haplotypes\"");
-	for(Idx = 0; Idx < 16; Idx++)
+	else   // else could be either CSV or VCF
 		{
-		switch(Idx & 0x03) {
-			case 0: szDiSNPs[1] = 'a'; break;
-			case 1: szDiSNPs[1] = 'c'; break;
-			case 2: szDiSNPs[1] = 'g'; break;
-			case 3: szDiSNPs[1] = 't'; break;
+		if (m_bSNPsVCF)
+			{
+			char szALTs[100];
+			char szAltFreq[100];
+			int AltOfs;
+			int SNPPhred;
+			int AltFreqOfs;
+			int AltIdx;
+			UINT32 CntsThres;		// only reporting cnts which are at least 10% of the highest non-ref base counts. 
+									// otherwise too many noise cnt bases are reported 
+
+			CntsThres = 0;
+			for (AltIdx = 0; AltIdx < eBaseN; AltIdx++)
+				{
+				if (AltIdx == pLociPValues->SNPcnts.RefBase)
+					continue;
+				if (pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx] > CntsThres)
+					CntsThres = pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx];
+				}
+			CntsThres = max((CntsThres + 5) / 10, 1);
+			AltOfs = 0;
+			AltFreqOfs = 0;
+			for (AltIdx = 0; AltIdx < eBaseN; AltIdx++)
+				{
+				if (AltIdx == pLociPValues->SNPcnts.RefBase)
+					continue;
+				if (pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx] >= CntsThres)
+					{
+					if (AltOfs > 0)
+						{
+						szALTs[AltOfs++] = ',';
+						szAltFreq[AltFreqOfs++] = ',';
+						}
+					szALTs[AltOfs++] = CSeqTrans::MapBase2Ascii(AltIdx);
+					szALTs[AltOfs] = '\0';
+					AltFreqOfs += sprintf(&szAltFreq[AltFreqOfs], "%1.4f", (double)pLociPValues->SNPcnts.NonRefBaseCnts[AltIdx] / pLociPValues->NumReads);
+					}
+				}
+			if (pLociPValues->PValue < 0.0000000001)
+				SNPPhred = 100;
+			else
+				SNPPhred = (int)(0.5 + (10.0*log10(1.0 / pLociPValues->PValue)));
+			LineLen += sprintf(&m_pszLineBuff[LineLen], "%s\t%u\tSNP%d\t%c\t%s\t%d\tPASS\tAF=%s;DP=%d\n",
+				pPars->szChromName, pLociPValues->Loci + 1, m_TotNumSNPs, CSeqTrans::MapBase2Ascii(pLociPValues->SNPcnts.RefBase),
+				szALTs, SNPPhred, szAltFreq, pLociPValues->NumReads);
 			}
-		switch((Idx >> 2) & 0x03) {
-			case 0: szDiSNPs[0] = 'a'; break;
-			case 1: szDiSNPs[0] = 'c'; break;
-			case 2: szDiSNPs[0] = 'g'; break;
-			case 3: szDiSNPs[0] = 't'; break;
+		else
+			{
+			// for consistency now including refbase counts as if nonref - totals accross all nonref bases will sum to be same as numreads covering the SNP loci
+			pLociPValues->SNPcnts.NonRefBaseCnts[pLociPValues->SNPcnts.RefBase] = pLociPValues->NumReads - pLociPValues->NumSubs;
+			LineLen += sprintf(&m_pszLineBuff[LineLen], "%d,\"SNP\",\"%s\",\"%s\",%d,%d,1,\"+\",%d,%f,%d,%d,\"%c\",%d,%d,%d,%d,%d,%f,%d,%d,%d,%d\n",
+				m_TotNumSNPs, m_szTargSpecies, pPars->szChromName, pLociPValues->Loci, pLociPValues->Loci, RelRank, pLociPValues->PValue,
+				pLociPValues->NumReads, pLociPValues->NumSubs,
+				CSeqTrans::MapBase2Ascii(pLociPValues->SNPcnts.RefBase),
+				pLociPValues->SNPcnts.NonRefBaseCnts[0], pLociPValues->SNPcnts.NonRefBaseCnts[1], pLociPValues->SNPcnts.NonRefBaseCnts[2], pLociPValues->SNPcnts.NonRefBaseCnts[3], pLociPValues->SNPcnts.NonRefBaseCnts[4],
+				pLociPValues->LocalBkGndSubRate, pLociPValues->LocalReads, pLociPValues->LocalSubs, pLociPValues->MarkerID, pLociPValues->NumPolymorphicSites);
 			}
-		szDiSNPs[2] = '\0';
-		LineLen += sprintf(&m_pszLineBuff[LineLen],",\"%s\"",szDiSNPs);
 		}
-	LineLen += sprintf(&m_pszLineBuff[LineLen],"\n");
-	CUtility::SafeWrite(m_hDiSNPfile,m_pszLineBuff,LineLen);
-	LineLen = 0;
-	}
+	if((LineLen + cMaxSeqLen + 1) > cAllocLineBuffSize)
+		{
+		CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
+		LineLen = 0;
+		}
 
-if(m_hTriSNPfile != -1)
-	{
-	int Idx;
-	char szTriSNPs[4];
-	LineLen = sprintf(m_pszLineBuff,"\"TriSNPs_ID\",\"ElType\",\"Species\",\"Chrom\",\"SNP1Loci\",\"SNP1RefBase\",\"SNP1BaseAcnt\",\"SNP1BaseCcnt\",\"SNP1BaseGcnt\",\"SNP1BaseTcnt\",\"SNP1BaseNcnt\",\"SNP2Loci\",\"SNP2RefBase\",\"SNP2BaseAcnt\",\"SNP2BaseCcnt\",\"SNP2BaseGcnt\",\"SNP2BaseTcnt\",\"SNP2BaseNcnt\",\"SNP3Loci\",\"SNP3RefBase\",\"SNP3BaseAcnt\",\"SNP3BaseCcnt\",\"SNP3BaseGcnt\",\"SNP3BaseTcnt\",\"SNP3BaseNcnt\",\"Depth\",\"Antisense\",\"Haplotypes\"");
-	for(Idx = 0; Idx < 64; Idx++)
+	if (gProcessingID > 0)
 		{
-		switch(Idx & 0x03) {
-			case 0: szTriSNPs[2] = 'a'; break;
-			case 1: szTriSNPs[2] = 'c'; break;
-			case 2: szTriSNPs[2] = 'g'; break;
-			case 3: szTriSNPs[2] = 't'; break;
-			}
-		switch((Idx >> 2) & 0x03) {
-			case 0: szTriSNPs[1] = 'a'; break;
-			case 1: szTriSNPs[1] = 'c'; break;
-			case 2: szTriSNPs[1] = 'g'; break;
-			case 3: szTriSNPs[1] = 't'; break;
-			}
-		switch((Idx >> 4) & 0x03) {
-			case 0: szTriSNPs[0] = 'a'; break;
-			case 1: szTriSNPs[0] = 'c'; break;
-			case 2: szTriSNPs[0] = 'g'; break;
-			case 3: szTriSNPs[0] = 't'; break;
-			}
-		szTriSNPs[3] = '\0';
-		LineLen += sprintf(&m_pszLineBuff[LineLen],",\"%s\"",szTriSNPs);
+		sMonoSNP.MonoSnpPID = m_TotNumSNPs;						// SNP instance, processing instance unique
+		strcpy(sMonoSNP.szElType, "SNP");						// SNP type
+		strcpy(sMonoSNP.szSpecies, m_szTargSpecies);			// SNP located for alignments againts this target/species assembly	
+		strcpy(sMonoSNP.szChrom, pPars->szChromName);					// SNP is on this chrom
+		sMonoSNP.StartLoci = pLociPValues->Loci;				// offset (0..N) at which SNP located
+		sMonoSNP.EndLoci = pLociPValues->Loci;					// offset (0..N) at which SNP located - allowing for future polymorphic varation covering multiple bases
+		sMonoSNP.Len = 1;										// polymorphic variation is of this length
+		sMonoSNP.szStrand[0] = '+'; sMonoSNP.szStrand[1] = '\0'; // SNP relative to this strand
+		sMonoSNP.Rank = RelRank;								// ranking confidence in thisSNP - min 0, max 1000
+		sMonoSNP.PValue = pLociPValues->PValue;					// probability of this SNP being a false positive
+		sMonoSNP.Bases = pLociPValues->NumReads;				// total number of bases aligning over the SNP loci
+		sMonoSNP.Mismatches = pLociPValues->NumSubs;			// aligned bases were aligning with this many mismatches
+		sMonoSNP.szRefBase[0] = CSeqTrans::MapBase2Ascii(pLociPValues->SNPcnts.RefBase); sMonoSNP.szRefBase[1] = '\0';			// target sequence base at the SNP locai
+		sMonoSNP.MMBaseA = pLociPValues->SNPcnts.NonRefBaseCnts[0];			// this many mismatched bases were A
+		sMonoSNP.MMBaseC = pLociPValues->SNPcnts.NonRefBaseCnts[1];			// this many mismatched bases were C
+		sMonoSNP.MMBaseG = pLociPValues->SNPcnts.NonRefBaseCnts[2];			// this many mismatched bases were G
+		sMonoSNP.MMBaseT = pLociPValues->SNPcnts.NonRefBaseCnts[3];			// this many mismatched bases were T
+		sMonoSNP.MMBaseN = pLociPValues->SNPcnts.NonRefBaseCnts[4];			// this many mismatched bases were N
+		sMonoSNP.BackgroundSubRate = pLociPValues->LocalBkGndSubRate;		// background substitution rate within a window centered at SNP loci
+		sMonoSNP.TotWinBases = pLociPValues->LocalReads;					// total number of bases within centeredwindow
+		sMonoSNP.TotWinMismatches = pLociPValues->LocalSubs;				// total number of mismatched bases within centered window
+		sMonoSNP.MarkerID = pLociPValues->MarkerID;							// marker identifier
+		sMonoSNP.NumPolymorphicSites = pLociPValues->NumPolymorphicSites;	// number of polymorphic sites within marker
+		gSQLiteSummaries.AddMonoSNP(gExperimentID, gProcessingID,&sMonoSNP);
 		}
-	LineLen += sprintf(&m_pszLineBuff[LineLen],"\n");
-	CUtility::SafeWrite(m_hTriSNPfile,m_pszLineBuff,LineLen);
-	LineLen = 0;
 	}
+if(LineLen)
+	CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
+if (m_hDiSNPfile != -1 && pPars->DiSNPsLen > 0)
+	CUtility::SafeWrite(m_hDiSNPfile, pPars->pszDiSNPs, pPars->DiSNPsLen);
+if (m_hTriSNPfile != -1 && pPars->TriSNPsLen > 0)
+	CUtility::SafeWrite(m_hTriSNPfile, pPars->pszTriSNPs, pPars->TriSNPsLen);
+return(eBSFSuccess);
+}
 
-// need to check that there are accepted aligned reads to process for SNPs!!!
-if(m_hSNPCentsfile != -1)
+// CountChromSNPs
+// Accumulates base counts, over all loci in the chromosome span currently being processed by thread, from the accepted aligned reads in that span
+int
+CAligner::CountChromSNPs(tsSNPThreadPars *pPars)
+{
+UINT32 SeqIdx;
+etSeqBase ReadSeq[cMaxFastQSeqLen+1];	// to hold sequence (sans quality scores) for current read
+etSeqBase AssembSeq[cMaxFastQSeqLen+1];	// to hold targeted genome assembly sequence
+
+etSeqBase TargBases[3];
+etSeqBase ReadBase;
+tsSNPcnts *pSNP;
+UINT8 *pSeqVal;
+etSeqBase *pReadSeq;
+etSeqBase *pAssembSeq;
+tsSegLoci *pSeg;
+tsReadHit *pReadHit;
+tsSNPChromSpan *pSpan;
+tsChromSNPs *pChromSNPs;
+UINT32 ChromLen;
+UINT32 HitLoci;
+UINT32 MatchLen;
+UINT32 PrevMMChromID;
+UINT32 PrevMMLoci;
+
+pSpan = pPars->pSpan;
+ChromLen = m_pSfxArray->GetSeqLen(pSpan->ChromID);
+if(pPars->pChromSNPs == NULL || (ChromLen + 16) > pPars->pChromSNPs->AllocChromLen)
 	{
-	if(m_pSNPCentroids == NULL)
+	if(pPars->pChromSNPs != NULL)
 		{
-		int CentroidIdx;
-		tsSNPCentroid *pCentroid;
-		if((m_pSNPCentroids = new tsSNPCentroid[cSNPCentroidEls + 16])==NULL)
-			{
-			gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessSNPs: Memory allocation of %d SNP centroid elements failed",cSNPCentroidEls + 16);
-			Reset(false);
-			return(eBSFerrMem);
-			}
-		memset(m_pSNPCentroids,0,sizeof(tsSNPCentroid) * (cSNPCentroidEls+16));
-		pCentroid = m_pSNPCentroids;
-		for(CentroidIdx = 1; CentroidIdx <= cSNPCentroidEls; CentroidIdx++,pCentroid++)
-			pCentroid->CentroidID = CentroidIdx;
+		delete pPars->pChromSNPs;
+		pPars->pChromSNPs = NULL;
 		}
-	}
+	size_t AllocSize = sizeof(tsChromSNPs) + ((ChromLen + 16) * sizeof(tsSNPcnts));
+	if((pPars->pChromSNPs = (tsChromSNPs *)new UINT8[AllocSize])==NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"CountChromSNPs: Memory allocation of %lld bytes - %s",(INT64)AllocSize,strerror(errno));
+		return(eBSFerrMem);
+		}
+	pPars->pChromSNPs->AllocChromLen = ChromLen + 16;
+	}
+pChromSNPs = pPars->pChromSNPs;
+memset(&pChromSNPs->Cnts,0,((ChromLen + 16) * sizeof(tsSNPcnts)));
+pChromSNPs->ChromLen = (UINT32)ChromLen;
+pChromSNPs->ChromID = pSpan->ChromID;
+pChromSNPs->TotMatch = 0;
+pChromSNPs->TotMismatch = 0;
+pChromSNPs->MeanReadLen = 0;
+pChromSNPs->NumReads = 0;
+pChromSNPs->TotReadLen = 0;
+pChromSNPs->AdjacentSNPs[0].StartLoci = 0;
+pChromSNPs->AdjacentSNPs[0].EndLoci = 0;
+pChromSNPs->AdjacentSNPs[0].pFirstIterReadHit = NULL;
+pChromSNPs->AdjacentSNPs[0].pPrevIterReadHit = 0;
+pChromSNPs->AdjacentSNPs[1].StartLoci = 0;
+pChromSNPs->AdjacentSNPs[1].EndLoci = 0;
+pChromSNPs->AdjacentSNPs[1].pFirstIterReadHit = NULL;
+pChromSNPs->AdjacentSNPs[1].pPrevIterReadHit = 0;
+pChromSNPs->pFirstReadHit = NULL;
+pChromSNPs->pLastReadHit = NULL;
+m_pSfxArray->GetIdentName(pSpan->ChromID,sizeof(pPars->szChromName),pPars->szChromName);
+PrevMMChromID = 0;
+PrevMMLoci = -1;
+
+for(pReadHit = pSpan->pFirstReadHit; pReadHit != NULL; pReadHit = pReadHit == pSpan->pLastReadHit ? NULL : IterSortedReads(pReadHit))
+	{
+	if(pReadHit->NAR != eNARAccepted || pReadHit->HitLoci.Hit.FlgInDel || pReadHit->HitLoci.Hit.FlgSplice)
+		continue;
 
-pReadHit = NULL;
-LineLen = 0;
-PrevTargEntry = 0;
+	pSeg = &pReadHit->HitLoci.Hit.Seg[0];
 
-m_TotNumSNPs = 0;
-while((pReadHit = IterSortedReads(pReadHit))!=NULL)
-	{
-	if(pReadHit->NAR == eNARAccepted)
+	// get target genome sequence
+	if(m_bIsSOLiD)
 		{
-		if(pReadHit->HitLoci.Hit.FlgInDel || pReadHit->HitLoci.Hit.FlgSplice)
-			continue;
+		MatchLen = AdjHitLen(pSeg);
+		HitLoci = AdjStartLoci(pSeg);
+		HitLoci += 1;
+		MatchLen -= 1;
+		m_pSfxArray->GetColorspaceSeq(pSeg->ChromID,
+								HitLoci,
+								AssembSeq,MatchLen);	// get colorspace sequence
 
-		pSeg = &pReadHit->HitLoci.Hit.Seg[0];
-		if(pSeg->ChromID != (UINT32)PrevTargEntry)
-			{
-			if(m_pChromSNPs != NULL)
-				{
-				// this is where the SNPs for the previously processed chrom need to saved off as new chrom is about to be processed
-				m_pChromSNPs->MeanReadLen = (UINT32)(((m_pChromSNPs->TotReadLen + m_pChromSNPs->NumReads - 1) / m_pChromSNPs->NumReads));
-				if((Rslt=OutputSNPs())!=eBSFSuccess)
-					{
-					Reset(false);
-					return(Rslt);
-					}
-				}
 
-    		PrevTargEntry = pSeg->ChromID;
-			ChromLen = m_pSfxArray->GetSeqLen(PrevTargEntry);
-			if(m_pChromSNPs == NULL || (m_pChromSNPs != NULL && (ChromLen + 16) > m_pChromSNPs->AllocChromLen))
-				{
-				if(m_pChromSNPs != NULL)
-					{
-					delete m_pChromSNPs;
-					m_pChromSNPs = NULL;
-					}
-				size_t AllocSize = sizeof(tsChromSNPs) + ((ChromLen + 16) * sizeof(tsSNPcnts));
-				if((m_pChromSNPs = (tsChromSNPs *)new UINT8[AllocSize])==NULL)
-					{
-					gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessSNPs: Memory allocation of %lld bytes - %s",(INT64)AllocSize,strerror(errno));
-					Reset(false);
-					return(eBSFerrMem);
-					}
-				m_pChromSNPs->AllocChromLen = ChromLen + 16;
-				}
-			memset(&m_pChromSNPs->Cnts,0,((ChromLen + 16) * sizeof(tsSNPcnts)));
-			m_pChromSNPs->ChromLen = (UINT32)ChromLen;
-			m_pChromSNPs->ChromID = pSeg->ChromID;
-			m_pChromSNPs->TotMatch = 0;
-			m_pChromSNPs->TotMismatch = 0;
-			m_pChromSNPs->MeanReadLen = 0;
-			m_pChromSNPs->NumReads = 0;
-			m_pChromSNPs->TotReadLen = 0;
-			m_pChromSNPs->AdjacentSNPs[0].StartLoci = 0;
-			m_pChromSNPs->AdjacentSNPs[0].EndLoci = 0;
-			m_pChromSNPs->AdjacentSNPs[0].pFirstIterReadHit = NULL;
-			m_pChromSNPs->AdjacentSNPs[0].pPrevIterReadHit = 0;
-			m_pChromSNPs->AdjacentSNPs[1].StartLoci = 0;
-			m_pChromSNPs->AdjacentSNPs[1].EndLoci = 0;
-			m_pChromSNPs->AdjacentSNPs[1].pFirstIterReadHit = NULL;
-			m_pChromSNPs->AdjacentSNPs[1].pPrevIterReadHit = 0;
-			m_pChromSNPs->pFirstReadHit = NULL;
-			m_pChromSNPs->pLastReadHit = NULL;
-			PrevTargEntry = m_pChromSNPs->ChromID;
-			PrevMMChromID = 0;
-			PrevMMLoci = -1;
-			}
-
-		// get target genome sequence
-		if(m_bIsSOLiD)
-			{
-			MatchLen = AdjHitLen(pSeg);
-			HitLoci = AdjStartLoci(pSeg);
-			HitLoci += 1;
-			MatchLen -= 1;
-			m_pSfxArray->GetColorspaceSeq(pSeg->ChromID,
-									HitLoci,
-									AssembSeq,MatchLen);	// get colorspace sequence
+		}
+	else
+		{
+		// get target assembly sequence for entry starting at offset and of length len
+		MatchLen = AdjHitLen(pSeg);
+		HitLoci = AdjStartLoci(pSeg);
+		m_pSfxArray->GetSeq(pSeg->ChromID,HitLoci,AssembSeq,MatchLen);
+		pAssembSeq = AssembSeq;
+		for(SeqIdx = 0; SeqIdx < MatchLen; SeqIdx++,pAssembSeq++)
+			*pAssembSeq = *pAssembSeq & 0x07;
+		}
 
+		// get accepted aligned read sequence
+	pSeqVal = &pReadHit->Read[pReadHit->DescrLen+1];
+	pSeqVal += pSeg->ReadOfs + pSeg->TrimLeft;
+	pReadSeq = ReadSeq;
 
-			}
-		else
+	if(m_bIsSOLiD)
+		{
+		// convert read sequence into colorspace
+		UINT8 PrvBase = *pSeqVal & 0x07;
+		for(SeqIdx = 1; SeqIdx <= MatchLen; SeqIdx++,pReadSeq++,pSeqVal++)
 			{
-			// get target assembly sequence for entry starting at offset and of length len
-			MatchLen = AdjHitLen(pSeg);
-			HitLoci = AdjStartLoci(pSeg);
-			m_pSfxArray->GetSeq(pSeg->ChromID,HitLoci,AssembSeq,MatchLen);
-			pAssembSeq = AssembSeq;
-			for(SeqIdx = 0; SeqIdx < MatchLen; SeqIdx++,pAssembSeq++)
-				*pAssembSeq = *pAssembSeq & 0x07;
+			*pReadSeq = SOLiDmap[PrvBase][pSeqVal[1] & 0x07];
+			PrvBase = pSeqVal[1] & 0x07;
 			}
+		// reverse, not complement, sequence if hit was onto '-' strand
+		if(pSeg->Strand == '-')
+			CSeqTrans::ReverseSeq(MatchLen,ReadSeq);
+		}
+	else
+		{
+		for(SeqIdx = 0; SeqIdx < MatchLen; SeqIdx++,pReadSeq++,pSeqVal++)
+			*pReadSeq = *pSeqVal & 0x07;
+		if(pSeg->Strand == '-')
+			CSeqTrans::ReverseComplement(MatchLen,ReadSeq);
+		}
 
-			// get accepted aligned read sequence
-		pSeqVal = &pReadHit->Read[pReadHit->DescrLen+1];
-		pSeqVal += pSeg->ReadOfs + pSeg->TrimLeft;
-		pReadSeq = ReadSeq;
+	// double check not about to update snp counts past the expected chrom length
+	if((HitLoci + MatchLen) > ChromLen)
+		{
+		if((MatchLen = (int)ChromLen - HitLoci) < 10)
+			continue;
+		}
 
-		if(m_bIsSOLiD)
-			{
-			// convert read sequence into colorspace
-			UINT8 PrvBase = *pSeqVal & 0x07;
-			for(SeqIdx = 1; SeqIdx <= MatchLen; SeqIdx++,pReadSeq++,pSeqVal++)
-				{
-				*pReadSeq = SOLiDmap[PrvBase][pSeqVal[1] & 0x07];
-				PrvBase = pSeqVal[1] & 0x07;
-				}
-			// reverse, not complement, sequence if hit was onto '-' strand
-			if(pSeg->Strand == '-')
-				CSeqTrans::ReverseSeq(MatchLen,ReadSeq);
-			}
-		else
-			{
-			for(SeqIdx = 0; SeqIdx < MatchLen; SeqIdx++,pReadSeq++,pSeqVal++)
-				*pReadSeq = *pSeqVal & 0x07;
-			if(pSeg->Strand == '-')
-				CSeqTrans::ReverseComplement(MatchLen,ReadSeq);
-			}
+	if(pChromSNPs->pFirstReadHit == NULL)
+		pChromSNPs->pFirstReadHit = pReadHit;
+	pChromSNPs->pLastReadHit = pReadHit;
+	pChromSNPs->TotReadLen += MatchLen;
+	pChromSNPs->NumReads += 1;
 
-		// double check not about to update snp counts past the expected chrom length
-		if((HitLoci + MatchLen) > ChromLen)
+	// now iterate read bases and if mismatch then update appropriate counts
+	pSNP = &pChromSNPs->Cnts[HitLoci];
+	pAssembSeq = &AssembSeq[0];
+	pReadSeq = &ReadSeq[0];
+	UINT32 Loci = HitLoci;
+	bool bPairMM = false;
+	int SeqMM = 0;
+	for(SeqIdx = 0; SeqIdx < MatchLen; SeqIdx++, Loci++,pReadSeq++, pAssembSeq++,pSNP++)
+		{
+		if(*pAssembSeq >= eBaseN || (m_bIsSOLiD && *pReadSeq >= eBaseN) || *pReadSeq > eBaseN)
 			{
-			if((MatchLen = (int)ChromLen - HitLoci) < 10)
-				continue;
+			SeqMM += 1;
+			continue;
 			}
 
-		if(m_pChromSNPs->pFirstReadHit == NULL)
-			m_pChromSNPs->pFirstReadHit = pReadHit;
-		m_pChromSNPs->pLastReadHit = pReadHit;
-		m_pChromSNPs->TotReadLen += MatchLen;
-		m_pChromSNPs->NumReads += 1;
-
-		// now iterate read bases and if mismatch then update appropriate counts
-		pSNP = &m_pChromSNPs->Cnts[HitLoci];
-		pAssembSeq = &AssembSeq[0];
-		pReadSeq = &ReadSeq[0];
-		UINT32 Loci = HitLoci;
-		bool bPairMM = false;
-		int SeqMM = 0;
-		for(SeqIdx = 0; SeqIdx < MatchLen; SeqIdx++, Loci++,pReadSeq++, pAssembSeq++,pSNP++)
+		if(m_bIsSOLiD)		// in colorspace, unpaired mismatches assumed to be sequencer errors and simply sloughed when identifying SNPs
 			{
-			if(*pAssembSeq >= eBaseN || (m_bIsSOLiD && *pReadSeq >= eBaseN) || *pReadSeq > eBaseN)
-				{
-				SeqMM += 1;
+			if(Loci == 0)	// too problematic with SNPs in colorspace at the start of the target sequence, simply slough
 				continue;
-				}
 
-			if(m_bIsSOLiD)		// in colorspace, unpaired mismatches assumed to be sequencer errors and simply sloughed when identifying SNPs
+			if(!bPairMM && *pAssembSeq != *pReadSeq)
 				{
-				if(Loci == 0)	// too problematic with SNPs in colorspace at the start of the target sequence, simply slough
-					continue;
-
-				if(!bPairMM && *pAssembSeq != *pReadSeq)
+				if(SeqIdx < (1+MatchLen))
 					{
-					if(SeqIdx < (1+MatchLen))
+					if(pReadSeq[1] == pAssembSeq[1])
 						{
-						if(pReadSeq[1] == pAssembSeq[1])
-							{
-							pSNP->NumRefBases += 1;
-							m_pChromSNPs->TotMatch += 1;
-							SeqMM += 1;
-							continue;
-							}
+						pSNP->NumRefBases += 1;
+						pChromSNPs->TotMatch += 1;
+						SeqMM += 1;
+						continue;
 						}
+					}
 
-					// get the previous target sequence base and use this + read colorspace space to derive the mismatch in basespace
-					if(pSeg->ChromID != PrevMMChromID || Loci != PrevMMLoci)
-						{
-						PrevMMChromID = pSeg->ChromID;
-						PrevMMLoci = Loci;
-						m_pSfxArray->GetSeq(pSeg->ChromID,Loci-1,&TargBases[0],2);
-						if(TargBases[0] > eBaseN)
-							TargBases[0] = eBaseN;
-						if(TargBases[1] > eBaseN)
-							TargBases[1] = eBaseN;
-						pSNP->RefBase = TargBases[1];
-						}
+				// get the previous target sequence base and use this + read colorspace space to derive the mismatch in basespace
+				if(pSeg->ChromID != PrevMMChromID || Loci != PrevMMLoci)
+					{
+					PrevMMChromID = pSeg->ChromID;
+					PrevMMLoci = Loci;
+					m_pSfxArray->GetSeq(pSeg->ChromID,Loci-1,&TargBases[0],2);
+					if(TargBases[0] > eBaseN)
+						TargBases[0] = eBaseN;
+					if(TargBases[1] > eBaseN)
+						TargBases[1] = eBaseN;
+					pSNP->RefBase = TargBases[1];
+					}
 
-					ReadBase = *pReadSeq;
-					if(ReadBase > eBaseT)
-						ReadBase = eBaseN;
+				ReadBase = *pReadSeq;
+				if(ReadBase > eBaseT)
+					ReadBase = eBaseN;
 
-					if(SeqMM == 0)
-						ReadBase = SOLiDmap[TargBases[0]][ReadBase];
-					else
-						ReadBase = eBaseN;
-
-					// sometimes it seems that a colorspace read may have had a sequencing error earlier in the read
-					// or some mismatch such that the current loci mismatches in colorspace but matches in basespace
-					// these strange bases are treated as though they are undefined and accrue counts as being eBaseN's
-					if(ReadBase == pSNP->RefBase)
-						ReadBase = eBaseN;
-					pSNP->NonRefBaseCnts[ReadBase] += 1;
-					pSNP->NumNonRefBases += 1;
-					m_pChromSNPs->TotMismatch += 1;
-					bPairMM = true;
-					SeqMM += 1;
-					}
+				if(SeqMM == 0)
+					ReadBase = SOLiDmap[TargBases[0]][ReadBase];
 				else
-					{
-					pSNP->NumRefBases += 1;
-					m_pChromSNPs->TotMatch += 1;
-					bPairMM = false;
-					SeqMM = 0;
-					}
+					ReadBase = eBaseN;
+
+				// sometimes it seems that a colorspace read may have had a sequencing error earlier in the read
+				// or some mismatch such that the current loci mismatches in colorspace but matches in basespace
+				// these strange bases are treated as though they are undefined and accrue counts as being eBaseN's
+				if(ReadBase == pSNP->RefBase)
+					ReadBase = eBaseN;
+				pSNP->NonRefBaseCnts[ReadBase] += 1;
+				pSNP->NumNonRefBases += 1;
+				pChromSNPs->TotMismatch += 1;
+				bPairMM = true;
+				SeqMM += 1;
 				}
-			else				// in basespace any mismatch is counted as a NonRefCnt
+			else
 				{
-				ReadBase = *pReadSeq & 0x07;
-				TargBases[0] = *pAssembSeq & 0x07;
+				pSNP->NumRefBases += 1;
+				pChromSNPs->TotMatch += 1;
+				bPairMM = false;
+				SeqMM = 0;
+				}
+			}
+		else				// in basespace any mismatch is counted as a NonRefCnt
+			{
+			ReadBase = *pReadSeq & 0x07;
+			TargBases[0] = *pAssembSeq & 0x07;
 
-				pSNP->RefBase = TargBases[0];
-				if(TargBases[0] == ReadBase)
-					{
-					pSNP->NumRefBases += 1;
-					m_pChromSNPs->TotMatch += 1;
-					}
-				else
-					{
-					if(ReadBase > eBaseT)
-						ReadBase = eBaseN;
-					pSNP->NonRefBaseCnts[ReadBase] += 1;
-					pSNP->NumNonRefBases += 1;
-					m_pChromSNPs->TotMismatch += 1;
-					}
+			pSNP->RefBase = TargBases[0];
+			if(TargBases[0] == ReadBase)
+				{
+				pSNP->NumRefBases += 1;
+				pChromSNPs->TotMatch += 1;
+				}
+			else
+				{
+				if(ReadBase > eBaseT)
+					ReadBase = eBaseN;
+				pSNP->NonRefBaseCnts[ReadBase] += 1;
+				pSNP->NumNonRefBases += 1;
+				pChromSNPs->TotMismatch += 1;
 				}
 			}
 		}
 	}
 
-if(m_pChromSNPs != NULL)
+if(pChromSNPs->NumReads > 0)
+	pChromSNPs->MeanReadLen = (UINT32)(((pChromSNPs->TotReadLen + pChromSNPs->NumReads - 1) / pChromSNPs->NumReads));
+return(eBSFSuccess);
+}
+
+// ProcessSNPs
+// Thread processing chromosome spans for SNPs; spans are claimed in ascending order, processed independently of other threads,
+// and then written out only after all prior spans have been written out
+int
+CAligner::ProcessSNPs(tsSNPThreadPars *pPars)
+{
+int Rslt;
+bool bTermThreads;
+UINT32 SpanIdx;
+
+Rslt = eBSFSuccess;
+if(m_hSNPCentsfile != -1)
 	{
-	m_pChromSNPs->MeanReadLen = (UINT32)(((m_pChromSNPs->TotReadLen + m_pChromSNPs->NumReads - 1) / m_pChromSNPs->NumReads));
-	if((Rslt=OutputSNPs())!=eBSFSuccess)
+	if((pPars->pSNPCentroids = new tsSNPCentroid[cSNPCentroidEls + 16])==NULL)
 		{
-		Reset(false);
-		return(Rslt);
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessSNPs: Memory allocation of %d SNP centroid elements failed",cSNPCentroidEls + 16);
+		Rslt = eBSFerrMem;
 		}
+	else
+		memset(pPars->pSNPCentroids,0,sizeof(tsSNPCentroid) * (cSNPCentroidEls+16));
 	}
-if(m_hSNPfile != -1)
+
+while(Rslt >= eBSFSuccess)
 	{
-#ifdef _WIN32
-	_commit(m_hSNPfile);
-#else
-	fsync(m_hSNPfile);
-#endif
-	close(m_hSNPfile);
-	m_hSNPfile = -1;
+	AcquireSerialise();
+	bTermThreads = m_bSNPTermThreads;
+	SpanIdx = m_NxtSNPChromSpan;
+	if(!bTermThreads && SpanIdx < m_NumSNPChromSpans)
+		m_NxtSNPChromSpan += 1;
+	ReleaseSerialise();
+	if(bTermThreads || SpanIdx >= m_NumSNPChromSpans)
+		break;
+
+	pPars->SpanIdx = SpanIdx;
+	pPars->pSpan = &m_pSNPChromSpans[SpanIdx];
+	if((Rslt = CountChromSNPs(pPars)) < eBSFSuccess)
+		break;
+	pPars->MaxDiSNPSep = pPars->pChromSNPs->MeanReadLen;
+	if((Rslt = IdentifySNPs(pPars)) < eBSFSuccess)
+		break;
+
+	// wait until SNPs for all prior chromosome spans have been written out
+	AcquireSerialise();
+	while(!m_bSNPTermThreads && m_NxtSNPCommitSpan != pPars->SpanIdx)
+		WaitReadsAvail();
+	bTermThreads = m_bSNPTermThreads;
+	ReleaseSerialise();
+	if(bTermThreads)
+		break;
+	Rslt = OutputSNPs(pPars);
+	AcquireSerialise();
+	m_NxtSNPCommitSpan += 1;
+	ReleaseSerialise();
+	SignalReadsAvail();				// wake thread waiting to write out the next span
+	pPars->NumChromsProc += 1;
 	}
 
-if(m_hDiSNPfile != -1)
+if(Rslt < eBSFSuccess)
 	{
-#ifdef _WIN32
-	_commit(m_hDiSNPfile);
-#else
-	fsync(m_hDiSNPfile);
-#endif
-	close(m_hDiSNPfile);
-	m_hDiSNPfile = -1;
+	AcquireSerialise();
+	m_bSNPTermThreads = true;
+	ReleaseSerialise();
+	SignalReadsAvail();
 	}
 
-if(m_hTriSNPfile != -1)
+if(pPars->pChromSNPs != NULL)
+	{
+	delete pPars->pChromSNPs;
+	pPars->pChromSNPs = NULL;
+	}
+if(pPars->pLociPValues != NULL)
 	{
 #ifdef _WIN32
-	_commit(m_hTriSNPfile);
+	free(pPars->pLociPValues);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
 #else
-	fsync(m_hTriSNPfile);
+	if(pPars->pLociPValues != MAP_FAILED)
+		munmap(pPars->pLociPValues,pPars->AllocLociPValuesMem);
 #endif
-	close(m_hTriSNPfile);
-	m_hTriSNPfile = -1;
+	pPars->pLociPValues = NULL;
 	}
-
-if(m_hSNPCentsfile != -1)
+if(pPars->pszDiSNPs != NULL)
 	{
-	// report on the SNP centroid distributions
-	int SNPCentroidIdx;
-	int CentroidSeq;
-	UINT8 Bases[cSNPCentroidLen];
-	int BaseIdx;
-	tsSNPCentroid *pCentroid;
-	char szCentroids[4096];
-	int BuffIdx;
-
-	BuffIdx = sprintf(szCentroids,"\"CentroidID\",\"Seq\",\"NumInsts\",\"NumSNPs\",\"RefBase\",\"RefBaseCnt\",\"BaseA\",\"BaseC\",\"BaseG\",\"BaseT\",\"BaseN\"\n");
-	pCentroid = m_pSNPCentroids;
-	for(SNPCentroidIdx = 0; SNPCentroidIdx < cSNPCentroidEls; SNPCentroidIdx++, pCentroid++)
-		{
-		CentroidSeq = SNPCentroidIdx;
-		for(BaseIdx = cSNPCentroidLen-1; BaseIdx >= 0; BaseIdx--)
-			{
-			Bases[BaseIdx] = CentroidSeq & 0x03;
-			CentroidSeq >>= 2;
-			}
+	free(pPars->pszDiSNPs);
+	pPars->pszDiSNPs = NULL;
+	}
+if(pPars->pszTriSNPs != NULL)
+	{
+	free(pPars->pszTriSNPs);
+	pPars->pszTriSNPs = NULL;
+	}
+return(Rslt);
+}
 
-		BuffIdx += sprintf(&szCentroids[BuffIdx],"%d,\"%s\",%d,%d,\"%c\",%d,%d,%d,%d,%d,%d\n",
-							SNPCentroidIdx+1,CSeqTrans::MapSeq2Ascii(Bases,cSNPCentroidLen),pCentroid->NumInsts,pCentroid->NumSNPs,CSeqTrans::MapBase2Ascii(Bases[cSNPCentfFlankLen]),
-							pCentroid->RefBaseCnt,pCentroid->NonRefBaseCnts[0],pCentroid->NonRefBaseCnts[1],pCentroid->NonRefBaseCnts[2],pCentroid->NonRefBaseCnts[3],pCentroid->NonRefBaseCnts[4]);
+// ProcessSNPs
+// Accepted aligned reads, sorted by chromosome and loci, are processed for SNPs with SNPs, DiSNPs, TriSNPs and any markers and centroids written out
+int
+CAligner::ProcessSNPs(int PhaseIdx)			// SNP processing is timed as this processing phase
+{
+int Rslt;
+if((Rslt = BeginSNPs()) < eBSFSuccess)
+	return(Rslt);
+if((Rslt = ProcessSNPChromSpans(PhaseIdx)) < eBSFSuccess)
+	return(Rslt);
+return(EndSNPs());
+}
 
+// BeginSNPs
+// Writes SNP, DiSNP and TriSNP file headers, and initialises SNP centroids, prior to any chromosome spans being processed for SNPs
+int
+CAligner::BeginSNPs(void)
+{
+int LineLen;
 
-		if(BuffIdx + 200 > sizeof(szCentroids))
-			{
-			CUtility::SafeWrite(m_hSNPCentsfile,szCentroids,BuffIdx);
-			BuffIdx = 0;
-			}
+if(m_FMode == eFMbed)
+	{
+	LineLen = sprintf(m_pszLineBuff,"track type=bed name=\"%s_SNPs\" description=\"%s SNPs\"\n",m_pszTrackTitle,m_pszTrackTitle);
+	CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
+	LineLen = 0;
+	}
+else			// else must be either CSV or VCF
+	{
+	if(m_bSNPsVCF)
+		{
+		LineLen = sprintf(m_pszLineBuff,"##fileformat=VCFv4.2\n##source=biokangaV%s\n##reference=%s\n##INFO=<ID=AF,Number=A,Type=Float,Description=\"Allele Frequency\">\n##FORMAT=<ID=DP,Number=1,Type=Integer,Description=\"Read Depth\">\n",
+													cpszProgVer,m_pszSfxFile);
+		LineLen += sprintf(&m_pszLineBuff[LineLen],"#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n");
 		}
-	if(BuffIdx)
-		CUtility::SafeWrite(m_hSNPCentsfile,szCentroids,BuffIdx);
+	else
+		LineLen = sprintf(m_pszLineBuff,"\"SNP_ID\",\"ElType\",\"Species\",\"Chrom\",\"StartLoci\",\"EndLoci\",\"Len\",\"Strand\",\"Rank\",\"PValue\",\"Bases\",\"Mismatches\",\"RefBase\",\"MMBaseA\",\"MMBaseC\",\"MMBaseG\",\"MMBaseT\",\"MMBaseN\",\"BackgroundSubRate\",\"TotWinBases\",\"TotWinMismatches\",\"MarkerID\",\"NumPolymorphicSites\"\n");
+	CUtility::SafeWrite(m_hSNPfile,m_pszLineBuff,LineLen);
+	LineLen = 0;
 	}
 
-if(m_hSNPCentsfile != -1)
+if(m_hDiSNPfile != -1)
 	{
-#ifdef _WIN32
-	_commit(m_hSNPCentsfile);
-#else
-	fsync(m_hSNPCentsfile);
-#endif
-	close(m_hSNPCentsfile);
-	m_hSNPCentsfile = -1;
+	int Idx;
+	char szDiSNPs[3];
+	LineLen = sprintf(m_pszLineBuff,"\"DiSNPs_ID\",\"ElType\",\"Species\",\"Chrom\",\"SNP1Loci\",\"SNP1RefBase\",\"SNP1BaseAcnt\",\"SNP1BaseCcnt\",\"SNP1BaseGcnt\",\"SNP1BaseTcnt\",\"SNP1BaseNcnt\",\"SNP2Loci\",\"SNP2RefBase\",\"SNP2BaseAcnt\",\"SNP2BaseCcnt\",\"SNP2BaseGcnt\",\"SNP2BaseTcnt\",\"SNP2BaseNcnt\",\"Depth\",\"Antisense\",\"Haplotypes\"");
+	for(Idx = 0; Idx < 16; Idx++)
+		{
+		switch(Idx & 0x03) {
+			case 0: szDiSNPs[1] = 'a'; break;
+			case 1: szDiSNPs[1] = 'c'; break;
+			case 2: szDiSNPs[1] = 'g'; break;
+			case 3: szDiSNPs[1] = 't'; break;
+			}
+		switch((Idx >> 2) & 0x03) {
+			case 0: szDiSNPs[0] = 'a'; break;
+			case 1: szDiSNPs[0] = 'c'; break;
+			case 2: szDiSNPs[0] = 'g'; break;
+			case 3: szDiSNPs[0] = 't'; break;
+			}
+		szDiSNPs[2] = '\0';
+		LineLen += sprintf(&m_pszLineBuff[LineLen],",\"%s\"",szDiSNPs);
+		}
+	LineLen += sprintf(&m_pszLineBuff[LineLen],"\n");
+	CUtility::SafeWrite(m_hDiSNPfile,m_pszLineBuff,LineLen);
+	LineLen = 0;
 	}
 
-if(m_hMarkerFile != -1)
+if(m_hTriSNPfile != -1)
 	{
-#ifdef _WIN32
-	_commit(m_hMarkerFile);
-#else
-	fsync(m_hMarkerFile);
-#endif
-	close(m_hMarkerFile);
-	m_hMarkerFile = -1;
+	int Idx;
+	char szTriSNPs[4];
+	LineLen = sprintf(m_pszLineBuff,"\"TriSNPs_ID\",\"ElType\",\"Species\",\"Chrom\",\"SNP1Loci\",\"SNP1RefBase\",\"SNP1BaseAcnt\",\"SNP1BaseCcnt\",\"SNP1BaseGcnt\",\"SNP1BaseTcnt\",\"SNP1BaseNcnt\",\"SNP2Loci\",\"SNP2RefBase\",\"SNP2BaseAcnt\",\"SNP2BaseCcnt\",\"SNP2BaseGcnt\",\"SNP2BaseTcnt\",\"SNP2BaseNcnt\",\"SNP3Loci\",\"SNP3RefBase\",\"SNP3BaseAcnt\",\"SNP3BaseCcnt\",\"SNP3BaseGcnt\",\"SNP3BaseTcnt\",\"SNP3BaseNcnt\",\"Depth\",\"Antisense\",\"Haplotypes\"");
+	for(Idx = 0; Idx < 64; Idx++)
+		{
+		switch(Idx & 0x03) {
+			case 0: szTriSNPs[2] = 'a'; break;
+			case 1: szTriSNPs[2] = 'c'; break;
+			case 2: szTriSNPs[2] = 'g'; break;
+			case 3: szTriSNPs[2] = 't'; break;
+			}
+		switch((Idx >> 2) & 0x03) {
+			case 0: szTriSNPs[1] = 'a'; break;
+			case 1: szTriSNPs[1] = 'c'; break;
+			case 2: szTriSNPs[1] = 'g'; break;
+			case 3: szTriSNPs[1] = 't'; break;
+			}
+		switch((Idx >> 4) & 0x03) {
+			case 0: szTriSNPs[0] = 'a'; break;
+			case 1: szTriSNPs[0] = 'c'; break;
+			case 2: szTriSNPs[0] = 'g'; break;
+			case 3: szTriSNPs[0] = 't'; break;
+			}
+		szTriSNPs[3] = '\0';
+		LineLen += sprintf(&m_pszLineBuff[LineLen],",\"%s\"",szTriSNPs);
+		}
+	LineLen += sprintf(&m_pszLineBuff[LineLen],"\n");
+	CUtility::SafeWrite(m_hTriSNPfile,m_pszLineBuff,LineLen);
+	LineLen = 0;
 	}
 
-if(m_pChromSNPs != NULL)
+// need to check that there are accepted aligned reads to process for SNPs!!!
+if(m_hSNPCentsfile != -1)
 	{
-	delete m_pChromSNPs;
-	m_pChromSNPs = NULL;
+	if(m_pSNPCentroids == NULL)
+		{
+		int CentroidIdx;
+		tsSNPCentroid *pCentroid;
+		if((m_pSNPCentroids = new tsSNPCentroid[cSNPCentroidEls + 16])==NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessSNPs: Memory allocation of %d SNP centroid elements failed",cSNPCentroidEls + 16);
+			Reset(false);
+			return(eBSFerrMem);
+			}
+		memset(m_pSNPCentroids,0,sizeof(tsSNPCentroid) * (cSNPCentroidEls+16));
+		pCentroid = m_pSNPCentroids;
+		for(CentroidIdx = 1; CentroidIdx <= cSNPCentroidEls; CentroidIdx++,pCentroid++)
+			pCentroid->CentroidID = CentroidIdx;
+		}
 	}
+
+m_TotNumSNPs = 0;
 return(eBSFSuccess);
 }
 
-//--- the following function ProcessSiteProbabilites() is targeted for use in RNA-seq processing
-// which should help in identifying differentially expressed transcripts
+// ProcessSNPChromSpans
+// Accepted aligned reads, sorted by chromosome and loci, are partitioned into chromosome spans with each span then processed for SNPs by one of up
+// to cMaxSNPThreads threads. Each thread accumulates base counts into its own tsChromSNPs and identifies SNPs, DiSNPs and TriSNPs independently
+// of other threads, but SNPs are written out in chromosome span order so output is the same as if all spans had been processed serially
+// When streaming this is called for each set of chromosomes reloaded from the spilled reads, SNPs continue to be appended to the SNP files
+// NOTE: each thread holds base counts for a complete chromosome so memory requirements scale with number of threads, the number of threads is
+// limited so that base counts for the longest chromosome can be concurrently held by all threads in the physical memory currently available
 int
-CAligner::ProcessSiteProbabilites(int RelSiteStartOfs)	// offset the site octamer by this relative start offset (read start base == 0)
+CAligner::ProcessSNPChromSpans(int PhaseIdx)	// SNP processing is timed as this processing phase
 {
-int LineLen;
-
-int SeqIdx;
-int SiteIdx;
-etSeqBase AssembSeq[cMaxFastQSeqLen+1];	// to hold genome assembly sequence for current read loci
-
-tsOctSitePrefs *pSitePrefs;
-tsOctSitePrefs *pSitePref;
-etSeqBase *pAssembSeq;
-tsReadHit *pReadHit;
+int Rslt;
+int ThreadIdx;
+int NumThreads;
+int MemThreads;
+UINT32 SpanIdx;
+UINT32 ChromLen;
+UINT32 MaxChromLen;
+UINT64 ThreadMem;
+UINT64 AvailMem;
+int CentroidIdx;
 tsSegLoci *pSeg;
+tsReadHit *pReadHit;
+tsSNPChromSpan *pSpan;
+tsSNPCentroid *pCentroid;
+tsSNPCentroid *pThreadCentroid;
 tBSFEntryID PrevTargEntry;
-UINT32 HitLoci;
-UINT32 PrevLoci;
-UINT32 MatchLen;
-UINT32 CurChromLen;
-
-int TotOccs;
-int TotSites;
-
-gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing for alignment site probabilities...");
+tsSNPThreadPars WorkerThreads[cMaxSNPThreads];
+
+// partition accepted reads into chromosome spans
+m_NumSNPChromSpans = 0;
+m_NxtSNPChromSpan = 0;
+m_NxtSNPCommitSpan = 0;
+m_bSNPTermThreads = false;
+pSpan = NULL;
+pReadHit = NULL;
+PrevTargEntry = 0;
+while((pReadHit = IterSortedReads(pReadHit))!=NULL)
+	{
+	if(pReadHit->NAR != eNARAccepted || pReadHit->HitLoci.Hit.FlgInDel || pReadHit->HitLoci.Hit.FlgSplice)
+		continue;
 
-TotOccs = 0;
-TotSites = 0;
+	pSeg = &pReadHit->HitLoci.Hit.Seg[0];
+	if(pSeg->ChromID != (UINT32)PrevTargEntry)
+		{
+		if(m_pSNPChromSpans == NULL || m_NumSNPChromSpans == m_AllocSNPChromSpans)
+			{
+			size_t memreq = (m_AllocSNPChromSpans + cAllocSNPChromSpans) * sizeof(tsSNPChromSpan);
+			if((pSpan = (tsSNPChromSpan *)realloc(m_pSNPChromSpans,memreq))==NULL)
+				{
+				gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessSNPs: Memory allocation of %lld bytes for chromosome spans failed",(INT64)memreq);
+				Reset(false);
+				return(eBSFerrMem);
+				}
+			m_pSNPChromSpans = pSpan;
+			m_AllocSNPChromSpans += cAllocSNPChromSpans;
+			}
+		pSpan = &m_pSNPChromSpans[m_NumSNPChromSpans++];
+		pSpan->ChromID = pSeg->ChromID;
+		pSpan->NumReads = 0;
+		pSpan->pFirstReadHit = pReadHit;
+		PrevTargEntry = pSeg->ChromID;
+		}
+	pSpan->pLastReadHit = pReadHit;
+	pSpan->NumReads += 1;
+	}
+
+Rslt = eBSFSuccess;
+if(m_NumSNPChromSpans > 0)
+	{
+	NumThreads = min(m_NumThreads,min(cMaxSNPThreads,(int)m_NumSNPChromSpans));
+
+	// each thread will require base counts for up to the longest chromosome
+	MaxChromLen = 0;
+	for(SpanIdx = 0; SpanIdx < m_NumSNPChromSpans; SpanIdx++)
+		{
+		ChromLen = m_pSfxArray->GetSeqLen(m_pSNPChromSpans[SpanIdx].ChromID);
+		if(ChromLen > MaxChromLen)
+			MaxChromLen = ChromLen;
+		}
+	ThreadMem = (UINT64)sizeof(tsChromSNPs) + (((UINT64)MaxChromLen + 16) * sizeof(tsSNPcnts));
+	AvailMem = CUtility::AvailPhysMem();
+	if(NumThreads > 1 && AvailMem != 0)
+		{
+		MemThreads = (int)min((UINT64)NumThreads,AvailMem / (ThreadMem + ThreadMem/cSNPThreadMemMarginDiv));
+		if(MemThreads < 1)
+			MemThreads = 1;
+		if(MemThreads < NumThreads)
+			{
+			gDiagnostics.DiagOut(eDLInfo,gszProcName,"Limiting SNP processing to %d threads as each thread requires %llu bytes and only %llu bytes are available",MemThreads,ThreadMem,AvailMem);
+			NumThreads = MemThreads;
+			}
+		}
+
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing %u chromosomes for SNPs using %d threads",m_NumSNPChromSpans,NumThreads);
+	memset(WorkerThreads,0,sizeof(WorkerThreads));
+	for(ThreadIdx = 0; ThreadIdx < NumThreads; ThreadIdx++)
+		{
+		WorkerThreads[ThreadIdx].ThreadIdx = ThreadIdx + 1;
+		WorkerThreads[ThreadIdx].pThis = this;
+#ifdef _WIN32
+		WorkerThreads[ThreadIdx].threadHandle = (HANDLE)_beginthreadex(NULL, 0x0fffff, ProcessSNPsThread, &WorkerThreads[ThreadIdx], 0, &WorkerThreads[ThreadIdx].threadID);
+		if(WorkerThreads[ThreadIdx].threadHandle == NULL)
+#else
+		WorkerThreads[ThreadIdx].threadRslt = pthread_create(&WorkerThreads[ThreadIdx].threadID, NULL, ProcessSNPsThread, &WorkerThreads[ThreadIdx]);
+		if(WorkerThreads[ThreadIdx].threadRslt != 0)
+#endif
+			break;
+		}
+	if(ThreadIdx < NumThreads)			// chromosome spans are claimed in order so processing can continue with those threads which were started
+		{
+		if(ThreadIdx == 0)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessSNPs: Unable to start any SNP processing threads");
+			Reset(false);
+			return(eBSFerrInternal);
+			}
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"ProcessSNPs: Only able to start %d of %d SNP processing threads",ThreadIdx,NumThreads);
+		NumThreads = ThreadIdx;
+		}
+
+	UINT32 ReportProgressSecs;
+	ReportProgressSecs = 60;
+
+	// wait for all threads to have completed
+	for (ThreadIdx = 0; ThreadIdx < NumThreads; ThreadIdx++)
+		{
+#ifdef _WIN32
+		while (WAIT_TIMEOUT == WaitForSingleObject(WorkerThreads[ThreadIdx].threadHandle, (DWORD)ReportProgressSecs * 1000))
+			{
+			gDiagnostics.DiagOut(eDLInfo, gszProcName, "Progress: Still processing for SNPs, %u of %u chromosomes written ...",m_NxtSNPCommitSpan,m_NumSNPChromSpans);
+			}
+		CloseHandle(WorkerThreads[ThreadIdx].threadHandle);
+#else
+		struct timespec ts;
+		int JoinRlt;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += ReportProgressSecs;
+		while ((JoinRlt = pthread_timedjoin_np(WorkerThreads[ThreadIdx].threadID, NULL, &ts)) != 0)
+			{
+			gDiagnostics.DiagOut(eDLInfo, gszProcName, "Progress: Still processing for SNPs, %u of %u chromosomes written ...",m_NxtSNPCommitSpan,m_NumSNPChromSpans);
+			ts.tv_sec += ReportProgressSecs;
+			}
+#endif
+		if(WorkerThreads[ThreadIdx].Rslt < eBSFSuccess && Rslt >= eBSFSuccess)
+			Rslt = WorkerThreads[ThreadIdx].Rslt;
+		m_LociBasesCovered += WorkerThreads[ThreadIdx].LociBasesCovered;
+		m_LociBasesCoverage += WorkerThreads[ThreadIdx].LociBasesCoverage;
+		if(WorkerThreads[ThreadIdx].pSNPCentroids != NULL)
+			{
+			pCentroid = m_pSNPCentroids;
+			pThreadCentroid = WorkerThreads[ThreadIdx].pSNPCentroids;
+			for(CentroidIdx = 0; CentroidIdx < cSNPCentroidEls; CentroidIdx++,pCentroid++,pThreadCentroid++)
+				{
+				pCentroid->NumInsts += pThreadCentroid->NumInsts;
+				pCentroid->NumSNPs += pThreadCentroid->NumSNPs;
+				pCentroid->RefBaseCnt += pThreadCentroid->RefBaseCnt;
+				pCentroid->NonRefBaseCnts[0] += pThreadCentroid->NonRefBaseCnts[0];
+				pCentroid->NonRefBaseCnts[1] += pThreadCentroid->NonRefBaseCnts[1];
+				pCentroid->NonRefBaseCnts[2] += pThreadCentroid->NonRefBaseCnts[2];
+				pCentroid->NonRefBaseCnts[3] += pThreadCentroid->NonRefBaseCnts[3];
+				pCentroid->NonRefBaseCnts[4] += pThreadCentroid->NonRefBaseCnts[4];
+				}
+			delete WorkerThreads[ThreadIdx].pSNPCentroids;
+			WorkerThreads[ThreadIdx].pSNPCentroids = NULL;
+			}
+		AddPhaseThreadWork(PhaseIdx,ThreadIdx,WorkerThreads[ThreadIdx].LociBasesCovered);
+		}
+	}
+
+if(m_pSNPChromSpans != NULL)
+	{
+	free(m_pSNPChromSpans);
+	m_pSNPChromSpans = NULL;
+	}
+m_AllocSNPChromSpans = 0;
+m_NumSNPChromSpans = 0;
+
+if(Rslt < eBSFSuccess)
+	{
+	Reset(false);
+	return(Rslt);
+	}
+
+return(eBSFSuccess);
+}
+
+// EndSNPs
+// Closes SNP, DiSNP, TriSNP and marker files, and reports SNP centroid distributions, after all chromosome spans have been processed for SNPs
+int
+CAligner::EndSNPs(void)
+{
+if(m_hSNPfile != -1)
+	{
+#ifdef _WIN32
+	_commit(m_hSNPfile);
+#else
+	fsync(m_hSNPfile);
+#endif
+	close(m_hSNPfile);
+	m_hSNPfile = -1;
+	}
+
+if(m_hDiSNPfile != -1)
+	{
+#ifdef _WIN32
+	_commit(m_hDiSNPfile);
+#else
+	fsync(m_hDiSNPfile);
+#endif
+	close(m_hDiSNPfile);
+	m_hDiSNPfile = -1;
+	}
+
+if(m_hTriSNPfile != -1)
+	{
+#ifdef _WIN32
+	_commit(m_hTriSNPfile);
+#else
+	fsync(m_hTriSNPfile);
+#endif
+	close(m_hTriSNPfile);
+	m_hTriSNPfile = -1;
+	}
+
+if(m_hSNPCentsfile != -1)
+	{
+	// report on the SNP centroid distributions
+	int SNPCentroidIdx;
+	int CentroidSeq;
+	UINT8 Bases[cSNPCentroidLen];
+	int BaseIdx;
+	tsSNPCentroid *pCentroid;
+	char szCentroids[4096];
+	int BuffIdx;
+
+	BuffIdx = sprintf(szCentroids,"\"CentroidID\",\"Seq\",\"NumInsts\",\"NumSNPs\",\"RefBase\",\"RefBaseCnt\",\"BaseA\",\"BaseC\",\"BaseG\",\"BaseT\",\"BaseN\"\n");
+	pCentroid = m_pSNPCentroids;
+	for(SNPCentroidIdx = 0; SNPCentroidIdx < cSNPCentroidEls; SNPCentroidIdx++, pCentroid++)
+		{
+		CentroidSeq = SNPCentroidIdx;
+		for(BaseIdx = cSNPCentroidLen-1; BaseIdx >= 0; BaseIdx--)
+			{
+			Bases[BaseIdx] = CentroidSeq & 0x03;
+			CentroidSeq >>= 2;
+			}
+
+		BuffIdx += sprintf(&szCentroids[BuffIdx],"%d,\"%s\",%d,%d,\"%c\",%d,%d,%d,%d,%d,%d\n",
+							SNPCentroidIdx+1,CSeqTrans::MapSeq2Ascii(Bases,cSNPCentroidLen),pCentroid->NumInsts,pCentroid->NumSNPs,CSeqTrans::MapBase2Ascii(Bases[cSNPCentfFlankLen]),
+							pCentroid->RefBaseCnt,pCentroid->NonRefBaseCnts[0],pCentroid->NonRefBaseCnts[1],pCentroid->NonRefBaseCnts[2],pCentroid->NonRefBaseCnts[3],pCentroid->NonRefBaseCnts[4]);
+
+
+		if(BuffIdx + 200 > sizeof(szCentroids))
+			{
+			CUtility::SafeWrite(m_hSNPCentsfile,szCentroids,BuffIdx);
+			BuffIdx = 0;
+			}
+		}
+	if(BuffIdx)
+		CUtility::SafeWrite(m_hSNPCentsfile,szCentroids,BuffIdx);
+	}
+
+if(m_hSNPCentsfile != -1)
+	{
+#ifdef _WIN32
+	_commit(m_hSNPCentsfile);
+#else
+	fsync(m_hSNPCentsfile);
+#endif
+	close(m_hSNPCentsfile);
+	m_hSNPCentsfile = -1;
+	}
+
+if(m_hMarkerFile != -1)
+	{
+#ifdef _WIN32
+	_commit(m_hMarkerFile);
+#else
+	fsync(m_hMarkerFile);
+#endif
+	close(m_hMarkerFile);
+	m_hMarkerFile = -1;
+	}
+
+return(eBSFSuccess);
+}
+
+
+//--- the following function ProcessSiteProbabilites() is targeted for use in RNA-seq processing
+// which should help in identifying differentially expressed transcripts
+int
+CAligner::ProcessSiteProbabilites(int RelSiteStartOfs)	// offset the site octamer by this relative start offset (read start base == 0)
+{
+int LineLen;
+
+int SeqIdx;
+int SiteIdx;
+etSeqBase AssembSeq[cMaxFastQSeqLen+1];	// to hold genome assembly sequence for current read loci
+
+tsOctSitePrefs *pSitePrefs;
+tsOctSitePrefs *pSitePref;
+etSeqBase *pAssembSeq;
+tsReadHit *pReadHit;
+tsSegLoci *pSeg;
+tBSFEntryID PrevTargEntry;
+UINT32 HitLoci;
+UINT32 PrevLoci;
+UINT32 MatchLen;
+UINT32 CurChromLen;
+
+int TotOccs;
+int TotSites;
+
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing for alignment site probabilities...");
+
+TotOccs = 0;
+TotSites = 0;
 memset(m_OctSitePrefs,0,sizeof(m_OctSitePrefs));
 pSitePrefs = m_OctSitePrefs[0];
 pSitePref = m_OctSitePrefs[1];
@@ -8584,6 +9722,23 @@ if(pthread_mutex_init (&m_hMtxMHReads,NULL)!=0)
 #endif
 	return(eBSFerrInternal);
 	}
+
+#ifdef _WIN32
+if((m_hEvntReadsAvail = CreateEvent(NULL,true,false,NULL))==NULL)
+	{
+	CloseHandle(m_hMtxIterReads);
+	CloseHandle(m_hMtxMHReads);
+#else
+if(pthread_cond_init (&m_hCondReadsAvail,NULL)!=0)
+	{
+	pthread_rwlock_destroy(&m_hRwLock);
+	pthread_mutex_destroy(&m_hMtxIterReads);
+	pthread_mutex_destroy(&m_hMtxMHReads);
+#endif
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to create condition variable");
+	return(eBSFerrInternal);
+	}
+
 if(m_MLMode != eMLdefault)
 	{
 #ifdef _WIN32
@@ -8591,11 +9746,13 @@ if(m_MLMode != eMLdefault)
 		{
 		CloseHandle(m_hMtxIterReads);
 		CloseHandle(m_hMtxMHReads);
+		CloseHandle(m_hEvntReadsAvail);
 #else
 	if(pthread_mutex_init (&m_hMtxMultiMatches,NULL)!=0)
 		{
 		pthread_mutex_destroy(&m_hMtxIterReads);
 		pthread_mutex_destroy(&m_hMtxMHReads);
+		pthread_cond_destroy(&m_hCondReadsAvail);
 		pthread_rwlock_destroy(&m_hRwLock);
 #endif
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to create mutex");
@@ -8614,11 +9771,13 @@ if(!m_bMutexesCreated)
 #ifdef _WIN32
 CloseHandle(m_hMtxIterReads);
 CloseHandle(m_hMtxMHReads);
+CloseHandle(m_hEvntReadsAvail);
 if(m_MLMode != eMLdefault)
 	CloseHandle(m_hMtxMultiMatches);
 #else
 pthread_mutex_destroy(&m_hMtxIterReads);
 pthread_mutex_destroy(&m_hMtxMHReads);
+pthread_cond_destroy(&m_hCondReadsAvail);
 pthread_rwlock_destroy(&m_hRwLock);
 if(m_MLMode != eMLdefault)
 	pthread_mutex_destroy(&m_hMtxMultiMatches);
@@ -8664,37 +9823,63 @@ UINT32 PrevReadsProcessed;
 UINT32 CurReadsLoaded;
 UINT32 PrevReadsLoaded;
 int MaxNumSlides;
+int PhaseIdx;
 
 int ThreadIdx;
 tsThreadMatchPars WorkerThreads[cMaxWorkerThreads];
 
 m_PerThreadAllocdIdentNodes = cMaxNumIdentNodes;
-m_TotAllocdIdentNodes = m_PerThreadAllocdIdentNodes * m_NumThreads;
-if((m_pAllocsIdentNodes = new tsIdentNode [m_TotAllocdIdentNodes])==NULL)
+// if NUMA placement then each thread allocates it's own scratch memory after binding to it's node, that memory is then local to the node
+if(m_NUMAMode != eNUMAoff)
 	{
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to allocate memory for %d tsIdentNodes",m_TotAllocdIdentNodes);
-	Reset(false);
-	return(eBSFerrMem);
+	m_TotAllocdIdentNodes = 0;
+	m_pAllocsMultiHitBuff = NULL;
 	}
-
-if((m_pAllocsMultiHitLoci = new tsHitLoci [m_NumThreads * (m_MaxMLmatches + cPriorityExacts)])==NULL)
+else
 	{
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to allocate memory for %d tsHitLoci",m_NumThreads * m_MaxMLmatches);
-	Reset(false);
-	return(eBSFerrMem);
-	}
+	m_TotAllocdIdentNodes = m_PerThreadAllocdIdentNodes * m_NumThreads;
+	if(m_pPoolIdentNodes != NULL && m_PoolIdentNodes >= m_TotAllocdIdentNodes)	// retained from a prior alignment run?
+		m_pAllocsIdentNodes = m_pPoolIdentNodes;
+	else
+		{
+		if(m_pPoolIdentNodes != NULL)
+			{
+			delete []m_pPoolIdentNodes;
+			m_pPoolIdentNodes = NULL;
+			m_PoolIdentNodes = 0;
+			}
+		if((m_pAllocsIdentNodes = new tsIdentNode [m_TotAllocdIdentNodes])==NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to allocate memory for %d tsIdentNodes",m_TotAllocdIdentNodes);
+			Reset(false);
+			return(eBSFerrMem);
+			}
+		if(m_bRetainPools)
+			{
+			m_pPoolIdentNodes = m_pAllocsIdentNodes;
+			m_PoolIdentNodes = m_TotAllocdIdentNodes;
+			}
+		}
 
-if(m_MLMode == eMLall)
-	{
-	if((m_pAllocsMultiHitBuff = new UINT8 [m_NumThreads * cReadHitBuffLen])==NULL)
+	if((m_pAllocsMultiHitLoci = new tsHitLoci [m_NumThreads * (m_MaxMLmatches + cPriorityExacts)])==NULL)
 		{
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to allocate memory for %d multihit record buffering",m_NumThreads * cReadHitBuffLen);
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to allocate memory for %d tsHitLoci",m_NumThreads * m_MaxMLmatches);
 		Reset(false);
 		return(eBSFerrMem);
 		}
+
+	if(m_MLMode == eMLall)
+		{
+		if((m_pAllocsMultiHitBuff = new UINT8 [m_NumThreads * cReadHitBuffLen])==NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to allocate memory for %d multihit record buffering",m_NumThreads * cReadHitBuffLen);
+			Reset(false);
+			return(eBSFerrMem);
+			}
+		}
+	else
+		m_pAllocsMultiHitBuff = NULL;
 	}
-else
-	m_pAllocsMultiHitBuff = NULL;
 
 
 
@@ -8709,14 +9894,36 @@ PrevReadsLoaded = 0;
 
 CurChromID = 0;
 CurBlockID = 1;
-if((Rslt=m_pSfxArray->SetTargBlock(CurBlockID))<0)
+// resident suffix arrays have already been loaded, and any interval lookup table generated, when the server started
+if(m_pSfxArray != m_pResidentSfxArray)
 	{
-	while(m_pSfxArray->NumErrMsgs())
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,m_pSfxArray->GetErrMsg());
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to load genome assembly suffix array");
-	return(Rslt);
+	PhaseIdx = BeginPhase("load_index");
+	if((Rslt=m_pSfxArray->SetTargBlock(CurBlockID))<0)
+		{
+		while(m_pSfxArray->NumErrMsgs())
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,m_pSfxArray->GetErrMsg());
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to load genome assembly suffix array");
+		return(Rslt);
+		}
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Genome assembly suffix array loaded");
+
+	if(m_SfxKMerIdxLen > 0 && !m_bBisulfite)
+		{
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Generating suffix array interval lookup table ...");
+		if((Rslt = m_pSfxArray->GenSfxKMerIdx(m_SfxKMerIdxLen)) < 0)
+			{
+			while(m_pSfxArray->NumErrMsgs())
+				gDiagnostics.DiagOut(eDLFatal,gszProcName,m_pSfxArray->GetErrMsg());
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: unable to generate suffix array interval lookup table");
+			return(Rslt);
+			}
+		if(Rslt == 0)
+			gDiagnostics.DiagOut(eDLInfo,gszProcName,"Suffix array interval lookup table not generated, suffix array too small or not fully sorted");
+		else
+			gDiagnostics.DiagOut(eDLInfo,gszProcName,"Generated suffix array interval lookup table for %d-mers",Rslt);
+		}
+	EndPhase(PhaseIdx,0);
 	}
-gDiagnostics.DiagOut(eDLInfo,gszProcName,"Genome assembly suffix array loaded");
 
 	// determine minimum core length from targeted sequence length
 	// core length is a balance between sensitivity and throughput
@@ -8738,6 +9945,9 @@ else
 			else
 				m_MinCoreLen = cMinCoreLen + 11; 		// covers the big plant guys...
 
+// if suffix array sampled then cores are located by their suffixes starting up to SampleStep-1 bases into the core, these suffixes need to be at least cMinCoreLen
+if(m_MinCoreLen < cMinCoreLen + m_pSfxArray->GetSfxSampleStep() - 1)
+	m_MinCoreLen = cMinCoreLen + m_pSfxArray->GetSfxSampleStep() - 1;
 
 // MaxNumSlides is per 100bp of read length
 // more slides enables higher sensitivity but negatively impacts on alignment throughput
@@ -8761,6 +9971,7 @@ switch(m_PMode) {
 m_MaxNumSlides = MaxNumSlides;
 
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Now aligning with minimum core size of %dbp...\n",m_MinCoreLen);
+PhaseIdx = BeginPhase("align_reads");
 m_ThreadCoredApproxRslt = 0;
 ResetThreadedIterReads();
 memset(WorkerThreads,0,sizeof(WorkerThreads));
@@ -8769,8 +9980,12 @@ for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
 	WorkerThreads[ThreadIdx].ThreadIdx = ThreadIdx + 1;
 	WorkerThreads[ThreadIdx].pThis = this;
 	WorkerThreads[ThreadIdx].NumIdentNodes = m_PerThreadAllocdIdentNodes;
-	WorkerThreads[ThreadIdx].pIdentNodes = &m_pAllocsIdentNodes[m_PerThreadAllocdIdentNodes * ThreadIdx];
-	WorkerThreads[ThreadIdx].pMultiHits = &m_pAllocsMultiHitLoci[(m_MaxMLmatches + cPriorityExacts) * ThreadIdx];
+	WorkerThreads[ThreadIdx].NUMANode = m_NUMAMode != eNUMAoff ? m_NUMA.NodeForThread(ThreadIdx) : -1;
+	if(WorkerThreads[ThreadIdx].NUMANode < 0)
+		{
+		WorkerThreads[ThreadIdx].pIdentNodes = &m_pAllocsIdentNodes[m_PerThreadAllocdIdentNodes * ThreadIdx];
+		WorkerThreads[ThreadIdx].pMultiHits = &m_pAllocsMultiHitLoci[(m_MaxMLmatches + cPriorityExacts) * ThreadIdx];
+		}
 	WorkerThreads[ThreadIdx].CurBlockID = CurBlockID;
 	WorkerThreads[ThreadIdx].MinEditDist = MinEditDist;
 	WorkerThreads[ThreadIdx].MaxSubs = MaxSubs;
@@ -8780,7 +9995,7 @@ for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
 	WorkerThreads[ThreadIdx].MinCoreLen = m_MinCoreLen;
 	WorkerThreads[ThreadIdx].MaxNumSlides = MaxNumSlides;
 	WorkerThreads[ThreadIdx].MinChimericLen = m_MinChimericLen;			
-	if(m_MLMode == eMLall)
+	if(m_MLMode == eMLall && WorkerThreads[ThreadIdx].NUMANode < 0)
 		WorkerThreads[ThreadIdx].pszOutBuff = &m_pAllocsMultiHitBuff[cReadHitBuffLen * ThreadIdx];
 	else
 		WorkerThreads[ThreadIdx].pszOutBuff = NULL;
@@ -8792,13 +10007,7 @@ for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
 #endif
 	}
 
-// allow threads a few seconds to startup
-#ifdef _WIN32
-	Sleep(5000);
-#else
-	sleep(5);
-#endif
-
+// no startup delay required, worker threads wait on the reads loader until reads are available
 UINT32 ReportProgressSecs;
 ReportProgressSecs = 60;
 if(m_SampleNthRawRead > 1)
@@ -8841,6 +10050,8 @@ for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
 	MinusHits += WorkerThreads[ThreadIdx].MinusHits;
 	ChimericHits += WorkerThreads[ThreadIdx].ChimericHits;
 	TotNumReadsProc += WorkerThreads[ThreadIdx].NumReadsProc;
+	AddPhaseThreadWork(PhaseIdx,ThreadIdx,WorkerThreads[ThreadIdx].NumReadsProc);
+	FreeAlignMemos(&WorkerThreads[ThreadIdx]);
 
 	if(WorkerThreads[ThreadIdx].OutBuffIdx != 0)
 		{
@@ -8866,20 +10077,60 @@ for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
 #endif
 		WorkerThreads[ThreadIdx].OutBuffIdx = 0;
 		}
+	FreeNUMAScratch(&WorkerThreads[ThreadIdx]);
+	if((Rslt = MergeThreadArenas(&WorkerThreads[ThreadIdx])) < eBSFSuccess && m_ThreadCoredApproxRslt >= 0)
+		m_ThreadCoredApproxRslt = Rslt;
 	}
+EndPhase(PhaseIdx,TotNumReadsProc);		// alignment phase ends when all worker threads have been joined
 
-// pickup the read loader thread, if the reads processing threads all finished then the loader thread should also have finished
-#ifdef _WIN32
-if(m_hThreadLoadReads != NULL)
+// if NUMA placement then report per node alignment rates, lower per thread rates on a node are indicative of that node's threads
+// being delayed by remote memory accesses
+if(m_NUMAMode != eNUMAoff)
 	{
-	while(WAIT_TIMEOUT == WaitForSingleObject(m_hThreadLoadReads, 5000))
+	int NodeIdx;
+	int NodeThreads;
+	UINT32 NodeReads;
+	double NodeSecs;
+	for(NodeIdx = 0; NodeIdx < m_NUMA.NumNodes(); NodeIdx++)
+		{
+		NodeThreads = 0;
+		NodeReads = 0;
+		NodeSecs = 0.0;
+		for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
+			{
+			if(WorkerThreads[ThreadIdx].NUMANode != NodeIdx)
+				continue;
+			NodeThreads += 1;
+			NodeReads += WorkerThreads[ThreadIdx].NumReadsProc;
+			NodeSecs += WorkerThreads[ThreadIdx].AlignSecs;
+			}
+		if(NodeThreads == 0)
+			continue;
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"NUMA node %d: %d threads aligned %u reads in %.1f thread secs, %.1f reads/sec per thread",
+							m_NUMA.NodeID(NodeIdx),NodeThreads,NodeReads,NodeSecs,NodeSecs > 0.0 ? NodeReads / NodeSecs : 0.0);
+		}
+	}
+
+// if streaming batches and loader has yet to load all reads then loader will be waiting for this batch to be reported before loading the next batch
+if(m_StreamBatchReads > 0)
+	{
+	AcquireSerialise();
+	m_bStreamFinalBatch = m_bAllReadsLoaded;
+	ReleaseSerialise();
+	}
+
+// pickup the read loader thread, if the reads processing threads all finished then the loader thread should also have finished
+#ifdef _WIN32
+if(m_hThreadLoadReads != NULL && (m_StreamBatchReads == 0 || m_bStreamFinalBatch))
+	{
+	while(WAIT_TIMEOUT == WaitForSingleObject(m_hThreadLoadReads, 5000))
 		{
 		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Progress: waiting");
 		}
 	CloseHandle(m_hThreadLoadReads);
 	}
 #else
-if(m_ThreadLoadReadsID != 0)
+if(m_ThreadLoadReadsID != 0 && (m_StreamBatchReads == 0 || m_bStreamFinalBatch))
 	{
 	struct timespec ts;
 	int JoinRlt;
@@ -8894,7 +10145,8 @@ if(m_ThreadLoadReadsID != 0)
 #endif
 
 // Checking here that the reads were all loaded w/o any major dramas!
-if(m_ThreadLoadReadsRslt < 0 || m_ThreadCoredApproxRslt < 0)
+// if streaming batches then loader is still active and will only have a result code after the final batch
+if(((m_StreamBatchReads == 0 || m_bStreamFinalBatch) && m_ThreadLoadReadsRslt < 0) || m_ThreadCoredApproxRslt < 0)
 	{
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Progress: Early terminated");
 	Reset(false);
@@ -8902,12 +10154,16 @@ if(m_ThreadLoadReadsRslt < 0 || m_ThreadCoredApproxRslt < 0)
 	}
 ApproxNumReadsProcessed(&CurReadsProcessed,&CurReadsLoaded);
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"Alignment of %u from %u loaded completed",CurReadsProcessed,CurReadsLoaded);
+if(m_bMemoReadSeqs)
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Alignments of prior reads with identical sequences were reused by %u reads",m_TotMemoReused);
+ReportReadsQueueStats();
 
 m_PerThreadAllocdIdentNodes = 0;
 m_TotAllocdIdentNodes = 0;
 if(m_pAllocsIdentNodes != NULL)
 	{
-	delete m_pAllocsIdentNodes;
+	if(m_pAllocsIdentNodes != m_pPoolIdentNodes)
+		delete []m_pAllocsIdentNodes;
 	m_pAllocsIdentNodes = NULL;
 	}
 if(m_pAllocsMultiHitLoci != NULL)
@@ -8995,6 +10251,12 @@ int NumSloughedNs;
 
 UINT32 ExtdProcFlags;
 
+bool bNewAlignment;						// set true if read sequence requires aligning, false if reusing a prior alignment
+UINT32 MemoHash;						// hash over read sequence when memoising alignments
+int InNxtLowMMCnt;						// read's next to lowest number of mismatches prior to alignment
+tsAlignMemo *pAlignMemo;				// unused slot into which a new alignment is to be memoised
+double StartSecs;						// thread started aligning at this wall time
+
 tsReadHit HitReads[cMaxMultiHits];
 int MultiHitDist[cMaxMultiHits];		// used to record the multihit distribution
 
@@ -9016,6 +10278,47 @@ ExtdProcFlags = 0;
 pPrevReadHit = NULL;
 PrevMatchLen = 0;
 MaxIter = m_pSfxArray->GetMaxIter();
+StartSecs = MetricsWallSecs();
+pPars->AlignSecs = 0.0;
+
+// if NUMA placement then bind to this thread's node before allocating scratch memory so that memory is first touched, and hence
+// physically allocated, on the node; binding failures are not fatal, thread will then simply be placed by the operating system
+if(pPars->NUMANode >= 0)
+	{
+	if(m_NUMA.BindThreadToNode(pPars->NUMANode) != eBSFSuccess)
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"ProcCoredApprox: Unable to bind thread %d to NUMA node %d",pPars->ThreadIdx,m_NUMA.NodeID(pPars->NUMANode));
+	pPars->pIdentNodes = new tsIdentNode [pPars->NumIdentNodes];
+	pPars->pMultiHits = new tsHitLoci [m_MaxMLmatches + cPriorityExacts];
+	if(m_MLMode == eMLall)
+		pPars->pszOutBuff = new UINT8 [cReadHitBuffLen];
+	if(pPars->pIdentNodes == NULL || pPars->pMultiHits == NULL || (m_MLMode == eMLall && pPars->pszOutBuff == NULL))
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcCoredApprox: Unable to allocate scratch memory for thread %d",pPars->ThreadIdx);
+		AcquireSerialise();
+		m_ThreadCoredApproxRslt = eBSFerrMem;
+		ReleaseSerialise();
+		SignalReadsAvail();
+		return(-1);
+		}
+	}
+
+// memoised alignments are specific to the suffix array block being aligned against so are allocated for each alignment pass and freed by the
+// caller after this thread has completed; if unable to allocate then this thread simply aligns every read
+pPars->NumMemoReused = 0;
+if(m_bMemoReadSeqs)
+	{
+	pPars->NumAlignMemos = 0;
+	pPars->MemoSeqsLen = 0;
+	pPars->NumMemoHits = 0;
+	pPars->pAlignMemos = (tsAlignMemo *)calloc(cAlignMemoSlots,sizeof(tsAlignMemo));
+	pPars->pMemoSeqs = (UINT8 *)malloc(cAlignMemoSeqBytes);
+	pPars->pMemoHits = (tsHitLoci *)malloc(cAlignMemoHits * sizeof(tsHitLoci));
+	if(pPars->pAlignMemos == NULL || pPars->pMemoSeqs == NULL || pPars->pMemoHits == NULL)
+		{
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"ProcCoredApprox: Unable to allocate memory for memoising alignments, thread %d will align every read",pPars->ThreadIdx);
+		FreeAlignMemos(pPars);
+		}
+	}
 
 
 // m_hRwLock will be released and regained within ThreadedIterReads so need to always have acquired a read lock before calling ThreadedIterReads
@@ -9114,7 +10417,38 @@ while(ThreadedIterReads(&ReadsHitBlock))
 			
 		// Heuristic is that if read sequence is identical to previously processed sequence then
 		// simply reuse previously AlignReads() hit results - saves a lot of processing time
-		if(pPrevReadHit == NULL || bForceNewAlignment || MatchLen != PrevMatchLen || memcmp(Sequence,PrevSequence,MatchLen))
+		bNewAlignment = (pPrevReadHit == NULL || bForceNewAlignment || MatchLen != PrevMatchLen || memcmp(Sequence,PrevSequence,MatchLen)) ? true : false;
+
+		// if memoising then an identical read sequence may have been aligned earlier by this thread, if so then that alignment is
+		// reused exactly as if it had been for the immediately preceding read
+		pAlignMemo = NULL;
+		MemoHash = 0;
+		InNxtLowMMCnt = 0;
+		if(bNewAlignment && pPars->pAlignMemos != NULL)
+			{
+			InNxtLowMMCnt = NxtLowMMCnt;
+			MemoHash = 2166136261;					// FNV-1a
+			for(SeqIdx = 0; SeqIdx < MatchLen; SeqIdx++)
+				MemoHash = (MemoHash ^ Sequence[SeqIdx]) * 16777619;
+			pAlignMemo = LocateAlignMemo(pPars,MemoHash,InNxtLowMMCnt,MatchLen,Sequence);
+			if(pAlignMemo->SeqLen != 0)
+				{
+				PrevHitRslt = pAlignMemo->HitRslt;
+				PrevLowHitInstances = pAlignMemo->LowHitInstances;
+				PrevLowMMCnt = pAlignMemo->LowMMCnt;
+				PrevNxtLowMMCnt = pAlignMemo->NxtLowMMCnt;
+				if(pAlignMemo->NumHits)
+					memcpy(pPars->pMultiHits,&pPars->pMemoHits[pAlignMemo->HitsOfs],pAlignMemo->NumHits * sizeof(tsHitLoci));
+				PrevMatchLen = MatchLen;
+				pPrevReadHit = pReadHit;
+				memmove(PrevSequence,Sequence,MatchLen);
+				pPars->NumMemoReused += 1;
+				pAlignMemo = NULL;
+				bNewAlignment = false;
+				}
+			}
+
+		if(bNewAlignment)
 			{
 			memset(pPars->pMultiHits,0,sizeof(tsHitLoci));
 			bProcNorm = true;
@@ -9417,7 +10751,7 @@ while(ThreadedIterReads(&ReadsHitBlock))
 						pMHit->HitLoci.FlagMH = LowHitInstances > 1 ? 1 : 0;
 						pMHit->HitLoci.FlagMHA = 0;
 						}
-					if((Rslt=AddMHitReads(LowHitInstances,&HitReads[0])) < 0)		// pts to array of hit loci
+					if((Rslt=AddMHitReads(pPars,LowHitInstances,&HitReads[0])) < 0)		// pts to array of hit loci
 						break;
 					}
 // finish handling multiply aligned reads
@@ -9461,6 +10795,7 @@ while(ThreadedIterReads(&ReadsHitBlock))
 			AcquireSerialise();
 			m_ThreadCoredApproxRslt = Rslt;
 			ReleaseSerialise(); 
+			SignalReadsAvail();
 			return(-1);
 			}
 			
@@ -9501,6 +10836,12 @@ while(ThreadedIterReads(&ReadsHitBlock))
 					break;
 				}
 			}
+
+		// memoise this alignment for reuse by any later reads with identical sequence, but only if the alignment would have been
+		// reused by an immediately following read with identical sequence
+		if(pAlignMemo != NULL && !bForceNewAlignment)
+			AddAlignMemo(pPars,pAlignMemo,MemoHash,InNxtLowMMCnt,MatchLen,Sequence,PrevHitRslt,PrevLowHitInstances,PrevLowMMCnt,PrevNxtLowMMCnt,
+							PrevLowHitInstances > 0 ? min(PrevLowHitInstances,m_MaxMLmatches) : 0,pPars->pMultiHits);
 		}
 	}
 
@@ -9514,6 +10855,7 @@ m_TotAcceptedAsAligned += NumAcceptedAsAligned;
 m_TotLociAligned += NumLociAligned;
 m_TotNotAcceptedDelta += NumNotAcceptedDelta;
 m_TotAcceptedHitInsts += NumAcceptedHitInsts;
+m_TotMemoReused += pPars->NumMemoReused;
 
 if(m_MLMode != eMLall)
 	{
@@ -9523,6 +10865,7 @@ if(m_MLMode != eMLall)
 	}
 
 ReleaseSerialise();
+pPars->AlignSecs = MetricsWallSecs() - StartSecs;
 return(1);
 }
 
@@ -9559,49 +10902,147 @@ return(NULL);
 }
 
 
+// AddMHitReads
+// Captures multihit reads into the calling thread's arena, no serialisation is required as arenas are only merged into m_pMultiHits
+// after the thread has completed
 int
-CAligner::AddMHitReads(UINT32 NumHits,	// number of multimatches loci in pHits
+CAligner::AddMHitReads(tsThreadMatchPars *pPars,	// capture into this thread's arena
+		UINT32 NumHits,			// number of multimatches loci in pHits
 		tsReadHit *pHits)		// pts to array of hit loci
 {
-size_t memreq;
+UINT32 ReqAllocd;
 tsReadHit *pDstHits;
 // ensure actually processing multihits
 if(m_MLMode <= eMLrand)
 	return(0);					// silently slough these hits
 
-AcquireSerialiseMH();
-
-if((m_AllocdMultiHits - m_NumMultiHits) < (NumHits+1000))	// need to realloc? -- added 1000 to provide a little safety margin
+if((pPars->NumMHitReads + NumHits) > pPars->AllocdMHitReads)
 	{
-	memreq = (m_AllocdMultiHits + cAllocMultihits) * sizeof(tsReadHit);
-#ifdef _WIN32
-	pDstHits = (tsReadHit *) realloc(m_pMultiHits,memreq);
-#else
-	pDstHits = (tsReadHit *)mremap(m_pMultiHits,m_AllocdMultiHitsMem,memreq,MREMAP_MAYMOVE);
-	if(pDstHits == MAP_FAILED)
-		pDstHits = NULL;
-#endif
-	if(pDstHits == NULL)
+	ReqAllocd = pPars->AllocdMHitReads == 0 ? cAllocThreadMHitReads : pPars->AllocdMHitReads * 2;
+	if(ReqAllocd < pPars->NumMHitReads + NumHits)
+		ReqAllocd = pPars->NumMHitReads + NumHits + cAllocThreadMHitReads;
+	if((pDstHits = (tsReadHit *)realloc(pPars->pMHitReads,(size_t)ReqAllocd * sizeof(tsReadHit))) == NULL)
 		{
-		ReleaseSerialiseMH();
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,"AddMHitReads: Memory re-allocation to %lld bytes - %s",memreq,strerror(errno));
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"AddMHitReads: Memory re-allocation to %lld bytes - %s",(INT64)ReqAllocd * sizeof(tsReadHit),strerror(errno));
 		return(eBSFerrMem);
 		}
-	m_pMultiHits = pDstHits;
-	m_AllocdMultiHitsMem = memreq;
-	m_AllocdMultiHits += cAllocMultihits;
+	pPars->pMHitReads = pDstHits;
+	pPars->AllocdMHitReads = ReqAllocd;
 	}
-pDstHits = &m_pMultiHits[m_NumMultiHits];
-memmove(pDstHits,pHits,sizeof(tsReadHit) * NumHits);
-m_NumMultiHits += NumHits;
+memcpy(&pPars->pMHitReads[pPars->NumMHitReads],pHits,sizeof(tsReadHit) * NumHits);
+pPars->NumMHitReads += NumHits;
 if(NumHits == 1)
-	m_NumUniqueMultiHits += 1;
+	pPars->NumUniqueMHits += 1;
 else
-	m_NumProvMultiAligned += 1;
-ReleaseSerialiseMH();
+	pPars->NumProvMAligned += 1;
 return((int)NumHits);
 }
 
+// MergeThreadArenas
+// Merges completed thread's captured multiloci alignments into m_pMultiAll, and multihit reads into m_pMultiHits, then frees that thread's arenas
+// Only called by the thread which started the alignment threads, once per completed thread, so no serialisation is required
+int
+CAligner::MergeThreadArenas(tsThreadMatchPars *pPars)
+{
+int Rslt;
+size_t memreq;
+size_t CopyLen;
+UINT8 *pRealloc;
+tsReadHit *pMultiHit;
+UINT32 HitIdx;
+
+Rslt = eBSFSuccess;
+if(pPars->NumMultiAll > 0 && m_pMultiAll != NULL)
+	{
+	if((m_NxtMultiAllOfs + pPars->MultiAllLen) >= m_AllocMultiAllMem)
+		{
+		memreq = m_NxtMultiAllOfs + pPars->MultiAllLen + (m_AllocMultiAllMem / 2);
+#ifdef _WIN32
+		pRealloc = (UINT8 *)realloc(m_pMultiAll,memreq);
+#else
+		pRealloc = (UINT8 *)mremap(m_pMultiAll,m_AllocMultiAllMem,memreq,MREMAP_MAYMOVE);
+		if(pRealloc == MAP_FAILED)
+			pRealloc = NULL;
+#endif
+		if(pRealloc == NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"MergeThreadArenas: Memory re-allocation to %lld bytes - %s",(INT64)memreq,strerror(errno));
+			Rslt = eBSFerrMem;
+			}
+		else
+			{
+			m_pMultiAll = (tsReadHit *)pRealloc;
+			m_AllocMultiAllMem = memreq;
+			}
+		}
+	if(Rslt == eBSFSuccess)
+		{
+		pMultiHit = (tsReadHit *)((UINT8 *)m_pMultiAll + m_NxtMultiAllOfs);
+		memcpy(pMultiHit,pPars->pMultiAll,pPars->MultiAllLen);
+		for(HitIdx = 0; HitIdx < pPars->NumMultiAll; HitIdx++)
+			{
+			CopyLen = sizeof(tsReadHit) + pMultiHit->DescrLen + pMultiHit->ReadLen;
+			m_NumMultiAll += 1;
+			pMultiHit->ReadID = m_NumMultiAll;
+			pMultiHit = (tsReadHit *)((UINT8 *)pMultiHit + CopyLen);
+			}
+		m_NxtMultiAllOfs += pPars->MultiAllLen;
+		}
+	}
+
+if(Rslt == eBSFSuccess && pPars->NumMHitReads > 0 && m_pMultiHits != NULL)
+	{
+	if((m_AllocdMultiHits - m_NumMultiHits) < (pPars->NumMHitReads + 1000))	// need to realloc? -- added 1000 to provide a little safety margin
+		{
+		memreq = (m_AllocdMultiHits + pPars->NumMHitReads + cAllocMultihits) * sizeof(tsReadHit);
+#ifdef _WIN32
+		pRealloc = (UINT8 *)realloc(m_pMultiHits,memreq);
+#else
+		pRealloc = (UINT8 *)mremap(m_pMultiHits,m_AllocdMultiHitsMem,memreq,MREMAP_MAYMOVE);
+		if(pRealloc == MAP_FAILED)
+			pRealloc = NULL;
+#endif
+		if(pRealloc == NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"MergeThreadArenas: Memory re-allocation to %lld bytes - %s",(INT64)memreq,strerror(errno));
+			Rslt = eBSFerrMem;
+			}
+		else
+			{
+			m_pMultiHits = (tsReadHit *)pRealloc;
+			m_AllocdMultiHitsMem = memreq;
+			m_AllocdMultiHits += pPars->NumMHitReads + cAllocMultihits;
+			}
+		}
+	if(Rslt == eBSFSuccess)
+		{
+		memcpy(&m_pMultiHits[m_NumMultiHits],pPars->pMHitReads,sizeof(tsReadHit) * pPars->NumMHitReads);
+		m_NumMultiHits += pPars->NumMHitReads;
+		m_NumUniqueMultiHits += pPars->NumUniqueMHits;
+		m_NumProvMultiAligned += pPars->NumProvMAligned;
+		}
+	}
+
+if(pPars->pMultiAll != NULL)
+	{
+	free(pPars->pMultiAll);
+	pPars->pMultiAll = NULL;
+	}
+pPars->AllocMultiAll = 0;
+pPars->MultiAllLen = 0;
+pPars->NumMultiAll = 0;
+if(pPars->pMHitReads != NULL)
+	{
+	free(pPars->pMHitReads);
+	pPars->pMHitReads = NULL;
+	}
+pPars->AllocdMHitReads = 0;
+pPars->NumMHitReads = 0;
+pPars->NumUniqueMHits = 0;
+pPars->NumProvMAligned = 0;
+return(Rslt);
+}
+
 
 // ThreadedIterReads
 // use to return a block of reads reserved for processing by calling thread instance
@@ -9612,8 +11053,196 @@ CAligner::ResetThreadedIterReads(void) // must be called by master thread prior
 m_NumReadsProc = 0;
 m_NxtReadProcOfs = 0;
 m_ProcessingStartSecs = gStopWatch.ReadUSecs();
+m_NumReadsWaiting = 0;
+m_ReadsQueueWaits = 0;
+m_ReadsQueueIdleUSecs = 0;
+m_ReadsQueueBlocks = 0;
+m_ReadsQueueDepthSum = 0;
+m_ReadsQueueDepthMax = 0;
+}
+
+// SignalReadsAvail
+// Wakes all threads waiting in WaitReadsAvail(), called whenever more reads have been made available, all reads have been loaded,
+// a streamed batch has been released, SNPs for a chromosome span have been written, or processing is to be terminated
+void
+CAligner::SignalReadsAvail(void)
+{
+if(!m_bMutexesCreated)
+	return;
+AcquireSerialise();
+#ifdef _WIN32
+SetEvent(m_hEvntReadsAvail);
+#else
+pthread_cond_broadcast(&m_hCondReadsAvail);
+#endif
+ReleaseSerialise();
+}
+
+// WaitReadsAvail
+// Must be called with serialisation acquired, serialisation is released whilst waiting and reacquired before returning
+// Waits are limited to cWaitReadsAvailMS so callers will always recheck state even if a signal was missed
+void
+CAligner::WaitReadsAvail(void)
+{
+#ifdef _WIN32
+ResetEvent(m_hEvntReadsAvail);
+ReleaseSerialise();
+WaitForSingleObject(m_hEvntReadsAvail,cWaitReadsAvailMS);
+AcquireSerialise();
+#else
+struct timespec ts;
+clock_gettime(CLOCK_REALTIME, &ts);
+ts.tv_sec += cWaitReadsAvailMS / 1000;
+ts.tv_nsec += (cWaitReadsAvailMS % 1000) * 1000000;
+if(ts.tv_nsec >= 1000000000)
+	{
+	ts.tv_sec += 1;
+	ts.tv_nsec -= 1000000000;
+	}
+pthread_cond_timedwait(&m_hCondReadsAvail,&m_hMtxIterReads,&ts);
+#endif
 }
 
+// ReportReadsQueueStats
+// Reports how well the reads loader was keeping the aligner threads supplied with reads
+void
+CAligner::ReportReadsQueueStats(void)
+{
+UINT32 MeanDepth;
+UINT32 IdleMSecs;
+MeanDepth = m_ReadsQueueBlocks == 0 ? 0 : (UINT32)(m_ReadsQueueDepthSum / m_ReadsQueueBlocks);
+IdleMSecs = (UINT32)(m_ReadsQueueIdleUSecs / 1000);
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Reads queue: %u blocks handed out, mean depth %u and max depth %u reads, aligner threads waited %u times for total of %u.%03u secs",
+				m_ReadsQueueBlocks,MeanDepth,m_ReadsQueueDepthMax,m_ReadsQueueWaits,IdleMSecs/1000,IdleMSecs%1000);
+if(gProcessingID > 0)
+	{
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadsQueue",ePTUint32,sizeof(m_ReadsQueueBlocks),"Blocks",&m_ReadsQueueBlocks);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadsQueue",ePTUint32,sizeof(MeanDepth),"MeanDepth",&MeanDepth);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadsQueue",ePTUint32,sizeof(m_ReadsQueueDepthMax),"MaxDepth",&m_ReadsQueueDepthMax);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadsQueue",ePTUint32,sizeof(m_ReadsQueueWaits),"Waits",&m_ReadsQueueWaits);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"ReadsQueue",ePTUint32,sizeof(IdleMSecs),"IdleMSecs",&IdleMSecs);
+	}
+}
+
+
+// LocateAlignMemo
+// Locates the memoised alignment for a read sequence, if not memoised then returns the unused slot into which it can be memoised
+tsAlignMemo *
+CAligner::LocateAlignMemo(tsThreadMatchPars *pPars,	// thread's memoised alignments
+				UINT32 SeqHash,						// hash over read sequence
+				int InNxtLowMMCnt,					// read's next to lowest number of mismatches prior to alignment
+				int SeqLen,							// read sequence length
+				etSeqBase *pSeq)					// read sequence
+{
+UINT32 SlotIdx;
+tsAlignMemo *pAlignMemo;
+SlotIdx = SeqHash & (cAlignMemoSlots - 1);
+while(1)
+	{
+	pAlignMemo = &pPars->pAlignMemos[SlotIdx];
+	if(pAlignMemo->SeqLen == 0)
+		return(pAlignMemo);
+	if(pAlignMemo->SeqHash == SeqHash && pAlignMemo->SeqLen == (UINT32)SeqLen && pAlignMemo->InNxtLowMMCnt == InNxtLowMMCnt &&
+			!memcmp(&pPars->pMemoSeqs[pAlignMemo->SeqOfs],pSeq,SeqLen))
+		return(pAlignMemo);
+	SlotIdx = (SlotIdx + 1) & (cAlignMemoSlots - 1);
+	}
+}
+
+// AddAlignMemo
+// Memoises a read sequence alignment; if the thread's memoised alignments are full then all are discarded and memoisation restarts
+void
+CAligner::AddAlignMemo(tsThreadMatchPars *pPars,		// thread's memoised alignments
+				tsAlignMemo *pAlignMemo,			// unused slot as returned by LocateAlignMemo()
+				UINT32 SeqHash,						// hash over read sequence
+				int InNxtLowMMCnt,					// read's next to lowest number of mismatches prior to alignment
+				int SeqLen,							// read sequence length
+				etSeqBase *pSeq,					// read sequence
+				int HitRslt,						// alignment result
+				int LowHitInstances,				// number of match instances for lowest number of mismatches
+				int LowMMCnt,						// lowest number of mismatches
+				int NxtLowMMCnt,					// next to lowest number of mismatches
+				int NumHits,						// number of hit loci in pHits
+				tsHitLoci *pHits)					// hit loci
+{
+if(SeqLen < 1 || SeqLen > cAlignMemoSeqBytes || NumHits > cAlignMemoHits)
+	return;
+
+if(pPars->NumAlignMemos >= (cAlignMemoSlots * 3) / 4 ||
+	(pPars->MemoSeqsLen + SeqLen) > (UINT32)cAlignMemoSeqBytes ||
+	(pPars->NumMemoHits + NumHits) > (UINT32)cAlignMemoHits)
+	{
+	memset(pPars->pAlignMemos,0,sizeof(tsAlignMemo) * cAlignMemoSlots);
+	pPars->NumAlignMemos = 0;
+	pPars->MemoSeqsLen = 0;
+	pPars->NumMemoHits = 0;
+	pAlignMemo = &pPars->pAlignMemos[SeqHash & (cAlignMemoSlots - 1)];
+	}
+
+pAlignMemo->SeqHash = SeqHash;
+pAlignMemo->SeqLen = SeqLen;
+pAlignMemo->SeqOfs = pPars->MemoSeqsLen;
+pAlignMemo->HitsOfs = pPars->NumMemoHits;
+pAlignMemo->NumHits = (INT16)NumHits;
+pAlignMemo->HitRslt = (INT16)HitRslt;
+pAlignMemo->LowHitInstances = (INT16)LowHitInstances;
+pAlignMemo->LowMMCnt = (INT8)LowMMCnt;
+pAlignMemo->NxtLowMMCnt = (INT8)NxtLowMMCnt;
+pAlignMemo->InNxtLowMMCnt = (INT8)InNxtLowMMCnt;
+memcpy(&pPars->pMemoSeqs[pPars->MemoSeqsLen],pSeq,SeqLen);
+pPars->MemoSeqsLen += SeqLen;
+if(NumHits)
+	{
+	memcpy(&pPars->pMemoHits[pPars->NumMemoHits],pHits,NumHits * sizeof(tsHitLoci));
+	pPars->NumMemoHits += NumHits;
+	}
+pPars->NumAlignMemos += 1;
+}
+
+void
+CAligner::FreeAlignMemos(tsThreadMatchPars *pPars)	// free thread's memoised alignments
+{
+if(pPars->pAlignMemos != NULL)
+	{
+	free(pPars->pAlignMemos);
+	pPars->pAlignMemos = NULL;
+	}
+if(pPars->pMemoSeqs != NULL)
+	{
+	free(pPars->pMemoSeqs);
+	pPars->pMemoSeqs = NULL;
+	}
+if(pPars->pMemoHits != NULL)
+	{
+	free(pPars->pMemoHits);
+	pPars->pMemoHits = NULL;
+	}
+pPars->NumAlignMemos = 0;
+pPars->MemoSeqsLen = 0;
+pPars->NumMemoHits = 0;
+}
+
+void
+CAligner::FreeNUMAScratch(tsThreadMatchPars *pPars)	// free scratch memory allocated by a NUMA node bound thread
+{
+if(pPars->NUMANode < 0)		// scratch memory was allocated by caller
+	return;
+if(pPars->pIdentNodes != NULL)
+	{
+	delete []pPars->pIdentNodes;
+	pPars->pIdentNodes = NULL;
+	}
+if(pPars->pMultiHits != NULL)
+	{
+	delete []pPars->pMultiHits;
+	pPars->pMultiHits = NULL;
+	}
+if(pPars->pszOutBuff != NULL)
+	{
+	delete []pPars->pszOutBuff;
+	pPars->pszOutBuff = NULL;
+	}
+}
 
 UINT32		// Returns the number of reads thus far loaded and processed for alignment
 CAligner::ApproxNumReadsProcessed(UINT32 *pNumProcessed,UINT32 *pNumLoaded)
@@ -9646,25 +11275,31 @@ if(m_SampleNthRawRead > 1)
 	AdjReadsPerBlock = min(100,AdjReadsPerBlock/m_SampleNthRawRead);
 
 ReleaseLock(false);
+AcquireSerialise();
 while(1) {
-	AcquireSerialise();
 	AcquireLock(false);
-	if(m_bAllReadsLoaded || ((m_NumReadsLoaded - m_NumReadsProc) >= (UINT32)min(AdjReadsPerBlock,(UINT32)pRetBlock->MaxReads)) || m_ThreadCoredApproxRslt < 0)
+	if(m_bAllReadsLoaded || m_bStreamBatchReady || ((m_NumReadsLoaded - m_NumReadsProc) >= (UINT32)min(AdjReadsPerBlock,(UINT32)pRetBlock->MaxReads)) || m_ThreadCoredApproxRslt < 0 || m_TermBackgoundThreads != 0)
     	break;
 
 	ReleaseLock(false);
-	ReleaseSerialise();
-#ifdef _WIN32
-	Sleep(2000);			// must have caught up to the reads loader, allow it some breathing space to parse and load some more reads...
-#else
-	sleep(2);
-#endif
+	// must have caught up to the reads loader, wait until loader signals that more reads are available
+	unsigned long WaitStartSecs;
+	unsigned long WaitStartUSecs;
+	unsigned long WaitEndSecs;
+	unsigned long WaitEndUSecs;
+	WaitStartSecs = gStopWatch.ReadUSecs(&WaitStartUSecs);
+	m_NumReadsWaiting += 1;
+	m_ReadsQueueWaits += 1;
+	WaitReadsAvail();
+	m_NumReadsWaiting -= 1;
+	WaitEndSecs = gStopWatch.ReadUSecs(&WaitEndUSecs);
+	m_ReadsQueueIdleUSecs += (((INT64)WaitEndSecs * 1000000) + WaitEndUSecs) - (((INT64)WaitStartSecs * 1000000) + WaitStartUSecs);
 	}
 
 if(m_pReadHits == NULL ||
-	m_ThreadCoredApproxRslt < 0 ||
+	m_ThreadCoredApproxRslt < 0 || m_TermBackgoundThreads != 0 ||
 	(m_bAllReadsLoaded && (m_LoadReadsRslt != eBSFSuccess)) ||
-	m_bAllReadsLoaded && (m_NumReadsLoaded == 0 || m_NumReadsProc == m_NumReadsLoaded)) // if all reads have been loaded and all processed then time to move onto next processing phase
+	(m_bAllReadsLoaded || m_bStreamBatchReady) && (m_NumReadsLoaded == 0 || m_NumReadsProc == m_NumReadsLoaded)) // if all reads (or streamed batch) have been loaded and all processed then time to move onto next processing phase
 	{
 	pRetBlock->NumReads = 0;
 	pRetBlock->pReadHits[0] = NULL;
@@ -9676,6 +11311,10 @@ if(m_pReadHits == NULL ||
 // idea is to maximise the number of threads still processing when most reads have been processed so that
 // the last thread processing doesn't end up with a large block of reads needing lengthly processing
 NumReadsLeft = m_NumReadsLoaded - m_NumReadsProc;
+m_ReadsQueueBlocks += 1;
+m_ReadsQueueDepthSum += NumReadsLeft;
+if(NumReadsLeft > m_ReadsQueueDepthMax)
+	m_ReadsQueueDepthMax = NumReadsLeft;
 if(NumReadsLeft < AdjReadsPerBlock/4)	// if < cMaxReadsPerBlock/4 yet to be processed then give it all to the one thread
 	MaxReads2Proc = NumReadsLeft;
 else
@@ -9959,24 +11598,26 @@ else
 		}
 	}
 
-switch(SortMode) {
+// sort modes other than eRSMSeq have fixed size keys which can be radix sorted, if insufficient memory for keys then fall back to qsort
+if(SortMode == eRSMSeq || SortReadHitsKeyed(SortMode) != eBSFSuccess)
+  switch(SortMode) {
 	case eRSMReadID:
-		m_mtqsort.qsort(m_ppReadHitsIdx,m_NumReadsLoaded,sizeof(tsReadHit *),SortReadIDs);
+		m_mtqsort.qsort<tsReadHit *,SortReadIDs>(m_ppReadHitsIdx,m_NumReadsLoaded);
 		break;
 	case eRSMPairReadID:
-		m_mtqsort.qsort(m_ppReadHitsIdx,m_NumReadsLoaded,sizeof(tsReadHit *),SortPairReadIDs);
+		m_mtqsort.qsort<tsReadHit *,SortPairReadIDs>(m_ppReadHitsIdx,m_NumReadsLoaded);
 		break;
 	case eRSMHitMatch:
-		m_mtqsort.qsort(m_ppReadHitsIdx,m_NumReadsLoaded,sizeof(tsReadHit *),SortHitMatch);
+		m_mtqsort.qsort<tsReadHit *,SortHitMatch>(m_ppReadHitsIdx,m_NumReadsLoaded);
 		break;
 
 	case eRSMPEHitMatch:
-		m_mtqsort.qsort(m_ppReadHitsIdx,m_NumReadsLoaded,sizeof(tsReadHit *),SortPEHitMatch);
+		m_mtqsort.qsort<tsReadHit *,SortPEHitMatch>(m_ppReadHitsIdx,m_NumReadsLoaded);
 		break;		
 
 	case eRSMSeq:
 		if(!bSeqSorted)
-			m_mtqsort.qsort(m_ppReadHitsIdx,m_NumReadsLoaded,sizeof(tsReadHit *),SortReadSeqs);
+			m_mtqsort.qsort<tsReadHit *,SortReadSeqs>(m_ppReadHitsIdx,m_NumReadsLoaded);
 		break;
 	default:
 		break;
@@ -9991,6 +11632,116 @@ return(eBSFSuccess);
 }
 
 
+// HitMatchKey
+// Returns the fixed size key which orders reads as SortHitMatch orders reads
+// NAR (6bits), NumHits ranked 1,0,2,3.. (17bits), then if a single hit ChromID (32bits), start loci (32bits), hit length (25bits), strand (8bits) and LowMMCnt (8bits)
+void
+CAligner::HitMatchKey(tsReadHit *pReadHit,		// key for this read
+					UINT64 *pKeyHi,				// returned key high order 64bits
+					UINT64 *pKeyLo)				// returned key low order 64bits
+{
+UINT32 Rank;
+UINT32 StartLoci;
+UINT32 HitLen;
+tsSegLoci *pSeg;
+
+if(pReadHit->NumHits == 1)
+	Rank = 0;
+else
+	Rank = (UINT32)((INT32)pReadHit->NumHits + 0x8001);
+*pKeyHi = ((UINT64)pReadHit->NAR << 58) | ((UINT64)Rank << 41);
+*pKeyLo = 0;
+if(Rank == 0)
+	{
+	pSeg = &pReadHit->HitLoci.Hit.Seg[0];
+	StartLoci = AdjStartLoci(pSeg);
+	HitLen = min(AdjHitLen(pSeg),(UINT32)0x01ffffff);
+	*pKeyHi |= ((UINT64)pSeg->ChromID << 9) | (StartLoci >> 23);
+	*pKeyLo = ((UINT64)(StartLoci & 0x07fffff) << 41) | ((UINT64)HitLen << 16) | ((UINT64)pSeg->Strand << 8) | (UINT8)(pReadHit->LowMMCnt ^ 0x80);
+	}
+}
+
+// SortReadHitsKeyed
+// Sorts m_ppReadHitsIdx by first extracting a fixed size key from each read, radix sorting the keys, and then permuting m_ppReadHitsIdx into key order
+// Avoids the cache misses of comparison sorts which dereference two scattered reads on every comparison
+// Keys order reads as the corresponding comparison functions (SortReadIDs, SortPairReadIDs, SortHitMatch, SortPEHitMatch) order reads
+// with reads ordered equally by these functions retaining their relative m_ppReadHitsIdx ordering
+int
+CAligner::SortReadHitsKeyed(etReadsSortMode SortMode)	// sort mode required, can't be eRSMSeq as sequences are variable length
+{
+int Rslt;
+UINT32 Idx;
+UINT64 KeysMem;
+UINT64 AvailMem;
+tsReadHit *pReadHit;
+tsSegLoci *pSeg;
+tsRadixSortEl *pKeys;
+tsRadixSortEl *pKey;
+
+if(SortMode != eRSMReadID && SortMode != eRSMPairReadID && SortMode != eRSMHitMatch && SortMode != eRSMPEHitMatch)
+	return(eBSFerrParams);
+
+// keys plus the radix sort scatter buffer, with overcommitted memory allocations could succeed and the process subsequently be OOM
+// killed whilst sorting, so if not physically available then caller falls back to qsort which sorts m_ppReadHitsIdx inplace
+KeysMem = (UINT64)sizeof(tsRadixSortEl) * 2 * (UINT64)m_NumReadsLoaded;
+AvailMem = CUtility::AvailPhysMem();
+if(AvailMem != 0 && (KeysMem + KeysMem/cKeyedSortMemMarginDiv) > AvailMem)
+	{
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"SortReadHitsKeyed: keyed sorting requires %llu bytes but only %llu bytes available, will use qsort",KeysMem,AvailMem);
+	return(eBSFerrMem);
+	}
+
+if((pKeys = (tsRadixSortEl *)malloc(sizeof(tsRadixSortEl) * (size_t)m_NumReadsLoaded))==NULL)
+	return(eBSFerrMem);
+
+pKey = pKeys;
+for(Idx = 0; Idx < m_NumReadsLoaded; Idx++, pKey++)
+	{
+	pReadHit = m_ppReadHitsIdx[Idx];
+	pSeg = &pReadHit->HitLoci.Hit.Seg[0];
+	pKey->pEl = pReadHit;
+	pKey->KeyHi = 0;
+	switch(SortMode) {
+		case eRSMReadID:				// ReadID
+			pKey->KeyLo = pReadHit->ReadID;
+			break;
+
+		case eRSMPairReadID:			// PairReadID with 5' read before 3' read
+			pKey->KeyLo = ((UINT64)(pReadHit->PairReadID & 0x7fffffff) << 1) | (pReadHit->PairReadID >> 31);
+			break;
+
+		case eRSMPEHitMatch:			// eNARAccepted and FlgPEAligned, then ChromID, PairReadID, 5' read before 3' read
+			if(pReadHit->NAR == eNARAccepted && pReadHit->FlgPEAligned)
+				{
+				pKey->KeyHi = pSeg->ChromID;
+				pKey->KeyLo = ((UINT64)(pReadHit->PairReadID & 0x7fffffff) << 1) | (pReadHit->PairReadID >> 31);
+				}
+			else
+				{
+				pKey->KeyHi = (UINT64)1 << 32;
+				pKey->KeyLo = 0;
+				}
+			break;
+
+		case eRSMHitMatch:
+			HitMatchKey(pReadHit,&pKey->KeyHi,&pKey->KeyLo);
+			break;
+
+		default:						// other sort modes were rejected above
+			break;
+		}
+	}
+
+if((Rslt = m_MTRadixSort.Sort(pKeys,m_NumReadsLoaded)) == eBSFSuccess)
+	{
+	pKey = pKeys;
+	for(Idx = 0; Idx < m_NumReadsLoaded; Idx++, pKey++)
+		m_ppReadHitsIdx[Idx] = (tsReadHit *)pKey->pEl;
+	}
+free(pKeys);
+return(Rslt);
+}
+
 // SortReadIDs
 // Sort reads by ascending read identifiers
 int
@@ -10258,6 +12009,10 @@ if(pEl1->PValue < pEl2->PValue)
 		return(-1);
 if(pEl1->PValue > pEl2->PValue)
 	return(1);
+if(pEl1->Loci < pEl2->Loci)			// PValue ties are ordered by loci so FDR ranking is independent of sort implementation
+		return(-1);
+if(pEl1->Loci > pEl2->Loci)
+	return(1);
 return(0);
 }
 
@@ -10286,287 +12041,1111 @@ if(pEl1->RelScale > pEl2->RelScale)
 return(0);
 }
 
-int
-CAligner::SortSiteRelOctamer(const void *arg1, const void *arg2)
-{
-tsOctSitePrefs *pEl1 = (tsOctSitePrefs *)arg1;
-tsOctSitePrefs *pEl2 = (tsOctSitePrefs *)arg2;
-if(pEl1->Octamer < pEl2->Octamer)
-		return(-1);
-if(pEl1->Octamer > pEl2->Octamer)
-	return(1);
-return(0);
-}
+int
+CAligner::SortSiteRelOctamer(const void *arg1, const void *arg2)
+{
+tsOctSitePrefs *pEl1 = (tsOctSitePrefs *)arg1;
+tsOctSitePrefs *pEl2 = (tsOctSitePrefs *)arg2;
+if(pEl1->Octamer < pEl2->Octamer)
+		return(-1);
+if(pEl1->Octamer > pEl2->Octamer)
+	return(1);
+return(0);
+}
+
+int
+CAligner::SortConstraintLoci(const void *arg1, const void *arg2)
+{
+tsConstraintLoci *pEl1 = (tsConstraintLoci *)arg1;
+tsConstraintLoci *pEl2 = (tsConstraintLoci *)arg2;
+if(pEl1->ChromID < pEl2->ChromID)
+		return(-1);
+if(pEl1->ChromID > pEl2->ChromID)
+	return(1);
+
+if(pEl1->StartLoci < pEl2->StartLoci)
+		return(-1);
+if(pEl1->StartLoci > pEl2->StartLoci)
+	return(1);
+
+if(pEl1->EndLoci < pEl2->EndLoci)
+		return(-1);
+if(pEl1->EndLoci > pEl2->EndLoci)
+	return(1);
+return(0);
+}
+
+void
+CAligner::AcquireSerialise(void)
+{
+#ifdef _WIN32
+WaitForSingleObject(m_hMtxIterReads,INFINITE);
+#else
+pthread_mutex_lock(&m_hMtxIterReads);
+#endif
+}
+
+void
+CAligner::ReleaseSerialise(void)
+{
+#ifdef _WIN32
+ReleaseMutex(m_hMtxIterReads);
+#else
+pthread_mutex_unlock(&m_hMtxIterReads);
+#endif
+}
+
+void
+CAligner::AcquireSerialiseMH(void)
+{
+#ifdef _WIN32
+WaitForSingleObject(m_hMtxMHReads,INFINITE);
+#else
+pthread_mutex_lock(&m_hMtxMHReads);
+#endif
+}
+
+void
+CAligner::ReleaseSerialiseMH(void)
+{
+#ifdef _WIN32
+ReleaseMutex(m_hMtxMHReads);
+#else
+pthread_mutex_unlock(&m_hMtxMHReads);
+#endif
+}
+
+void
+CAligner::AcquireLock(bool bExclusive)
+{
+#ifdef _WIN32
+if(bExclusive)
+	AcquireSRWLockExclusive(&m_hRwLock);
+else
+	AcquireSRWLockShared(&m_hRwLock);
+#else
+if(bExclusive)
+	pthread_rwlock_wrlock(&m_hRwLock);
+else
+	pthread_rwlock_rdlock(&m_hRwLock);
+#endif
+}
+
+void
+CAligner::ReleaseLock(bool bExclusive)
+{
+
+#ifdef _WIN32
+if(bExclusive)
+	ReleaseSRWLockExclusive(&m_hRwLock);
+else
+	ReleaseSRWLockShared(&m_hRwLock);
+#else
+pthread_rwlock_unlock(&m_hRwLock);
+#endif
+}
+
+int
+CAligner::ProcLoadReadFiles(tsLoadReadsThreadPars *pPars)
+{
+teBSFrsltCodes Rslt;
+int *pRslt = pPars->pRslt;
+int Idx;
+char *pszInfile;
+
+int NumInputFilesProcessed;
+
+AcquireLock(true);
+m_bAllReadsLoaded = false;
+m_LoadReadsRslt = eBSFSuccess;
+ReleaseLock(true);
+
+// first try to load as pre-processed reads '.rds' (as generated by 'kangar' or 'genreads')
+// if unable to load as a '.rds' then try to load as raw fasta/fastq
+
+if(((Rslt = (teBSFrsltCodes)LoadReads(m_ppszPE1InputFiles[0])) < eBSFSuccess) && Rslt != eBSFerrNotBioseq )
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to load reads from %s",m_ppszPE1InputFiles[0]);
+	AcquireLock(true);
+	*pRslt = Rslt;
+	m_bAllReadsLoaded = true;
+	ReleaseLock(true);
+	return(Rslt);
+	}
+
+if(Rslt != eBSFerrNotBioseq)
+	{
+	if(Rslt == 0)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"There were no reads in %s",m_ppszPE1InputFiles[0]);
+		Rslt = eBSFerrNoEntries;
+		}
+	else
+		Rslt = eBSFSuccess;
+	AcquireLock(true);
+	*pRslt = Rslt;
+	m_bAllReadsLoaded = true;
+	ReleaseLock(true);
+	return(Rslt);
+	}
+
+if(m_hInFile != -1)
+	{
+	close(m_hInFile);
+	m_hInFile = -1;
+	}
+
+AcquireLock(true);
+m_bAllReadsLoaded = false;
+memset(&m_FileHdr,0,sizeof(tsBSFRdsHdr));
+m_FileHdr.Magic[0] = 'b'; m_FileHdr.Magic[1] = 'i'; m_FileHdr.Magic[2] = 'o'; m_FileHdr.Magic[3] = 'r';
+m_FileHdr.Version = cBSFRdsVersion;
+m_FileHdr.FlagsK = 1;
+m_FileHdr.FlagsCS = m_bIsSOLiD;
+m_FileHdr.FlagsPR = m_PEproc == ePEdefault ? 0 : 1;
+m_FileHdr.PMode = (UINT8)0;
+m_FileHdr.QMode = m_QMethod;
+m_FileHdr.Trim5 = m_Trim5;
+m_FileHdr.Trim3 = m_Trim3;
+m_pReadHits = NULL;
+m_AllocdReadHitsMem = 0;
+m_NumReadsLoaded = 0;
+m_UsedReadHitsMem = 0;
+m_FinalReadID = 0;
+m_NumDescrReads = 0;
+ReleaseLock(true);
+
+if(m_FileHdr.FlagsPR && (m_NumPE1InputFiles < 1 || (m_NumPE1InputFiles != m_NumPE2InputFiles)))
+	{
+	Rslt = eBSFerrParams;
+	AcquireLock(true);
+	*pRslt = Rslt;
+	m_bAllReadsLoaded = true;
+	ReleaseLock(true);
+	return(Rslt);
+	}
+
+NumInputFilesProcessed = 0;
+if(!m_FileHdr.FlagsPR)
+	{
+	CSimpleGlob glob(SG_GLOB_FULLSORT);
+	for(Idx = 0; Idx < m_NumPE1InputFiles; Idx++)
+		{
+		glob.Init();
+		if(glob.Add(m_ppszPE1InputFiles[Idx]) < SG_SUCCESS)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to glob '%s",m_ppszPE1InputFiles[Idx]);
+			Rslt = eBSFerrOpnFile;
+			AcquireLock(true);
+			*pRslt = Rslt;
+			m_bAllReadsLoaded = true;
+			m_LoadReadsRslt = Rslt;
+			ReleaseLock(true);
+			return(Rslt);	// treat as though unable to open file
+			}
+
+		if(glob.FileCount() <= 0)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to locate any source raw reads file matching '%s",m_ppszPE1InputFiles[Idx]);
+			continue;
+			}
+
+		Rslt = eBSFSuccess;
+		for (int FileID = 0; Rslt >= eBSFSuccess &&  FileID < glob.FileCount(); ++FileID)
+			{
+			pszInfile = glob.File(FileID);
+
+			gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading and parsing reads from raw sequence file '%s'\n",pszInfile);
+			Rslt = LoadRawReads(false,NumInputFilesProcessed+1,pszInfile,NULL);
+			if(Rslt != eBSFSuccess)
+				{
+				if(m_TermBackgoundThreads == 0)
+					gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: Load failed for input raw sequence file '%s'\n",pszInfile);
+				AcquireLock(true);
+				*pRslt = Rslt;
+				m_bAllReadsLoaded = true;
+				m_LoadReadsRslt = Rslt;
+				ReleaseLock(true);
+				return(Rslt);
+				}
+			NumInputFilesProcessed += 1;
+			}
+		}
+	}
+else
+	{
+	Rslt = eBSFSuccess;
+	NumInputFilesProcessed = 0;
+	for(int FileID = 0; Rslt >= eBSFSuccess &&  FileID < m_NumPE1InputFiles; ++FileID)
+		{
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading and parsing reads from 5' PE1 raw sequence file '%s'",m_ppszPE1InputFiles[FileID]);
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading and parsing reads from 3' PE2 raw sequence file '%s'",m_ppszPE2InputFiles[FileID]);
+
+		Rslt = LoadRawReads(true,NumInputFilesProcessed+1,m_ppszPE1InputFiles[FileID],m_ppszPE2InputFiles[FileID]);
+		if(Rslt != eBSFSuccess)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: Load failed for input raw sequence PE files '%s' and '%s'\n",m_ppszPE1InputFiles[FileID],m_ppszPE2InputFiles[FileID]);
+			AcquireLock(true);
+			*pRslt = Rslt;
+			m_bAllReadsLoaded = true;
+			m_LoadReadsRslt = Rslt;
+			ReleaseLock(true);
+			return(Rslt);
+			}
+		NumInputFilesProcessed += 2;
+		}
+	}
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"%d raw sequence file%s parsed and reads loaded for aligning", NumInputFilesProcessed, NumInputFilesProcessed == 1 ? " was" : "s were");
+if(NumInputFilesProcessed == 0)
+	{
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Nothing to do, no raw sequence files to be filtered");
+	AcquireLock(true);
+	*pRslt = Rslt;
+	m_bAllReadsLoaded = true;
+	m_LoadReadsRslt = eBSFerrNoEntries;
+	ReleaseLock(true);
+	return(Rslt);
+	}
+
+// can now update header with final numbers
+AcquireLock(true);
+m_FileHdr.NumRds = m_NumDescrReads;
+m_FileHdr.OrigNumReads = m_NumDescrReads;
+m_FileHdr.TotReadsLen = m_DataBuffOfs;
+m_FinalReadID = m_NumDescrReads;
+m_NumReadsLoaded = m_NumDescrReads;
+m_LoadReadsRslt = (m_NumReadsLoaded + m_StreamReadIDBase) > 0 ? eBSFSuccess : eBSFerrNoEntries;
+EndPhase(m_LoadReadsPhaseIdx,(INT64)m_NumReadsLoaded + m_StreamReadIDBase);
+m_bAllReadsLoaded = true;
+*pRslt = Rslt;
+ReleaseLock(true);
+return(Rslt);
+}
+
 
+// StreamBatchLoaded
+// Called by the reads loader thread when streaming and a full batch of reads has been loaded
+// Makes the batch available to the aligner threads and then waits until the batch has been aligned and reported
+// On return the reads buffer has been emptied, ready for loading the next batch
 int
-CAligner::SortConstraintLoci(const void *arg1, const void *arg2)
-{
-tsConstraintLoci *pEl1 = (tsConstraintLoci *)arg1;
-tsConstraintLoci *pEl2 = (tsConstraintLoci *)arg2;
-if(pEl1->ChromID < pEl2->ChromID)
-		return(-1);
-if(pEl1->ChromID > pEl2->ChromID)
-	return(1);
-
-if(pEl1->StartLoci < pEl2->StartLoci)
-		return(-1);
-if(pEl1->StartLoci > pEl2->StartLoci)
-	return(1);
-
-if(pEl1->EndLoci < pEl2->EndLoci)
-		return(-1);
-if(pEl1->EndLoci > pEl2->EndLoci)
-	return(1);
-return(0);
-}
-
-void
-CAligner::AcquireSerialise(void)
+CAligner::StreamBatchLoaded(void)
 {
+AcquireSerialise();
+m_FinalReadID = m_NumDescrReads;
+m_NumReadsLoaded = m_NumDescrReads;
+m_bStreamBatchReady = true;
 #ifdef _WIN32
-WaitForSingleObject(m_hMtxIterReads,INFINITE);
+SetEvent(m_hEvntReadsAvail);
 #else
-pthread_mutex_lock(&m_hMtxIterReads);
+pthread_cond_broadcast(&m_hCondReadsAvail);
 #endif
+
+while(m_bStreamBatchReady)
+	{
+	if(m_TermBackgoundThreads != 0)	// need to immediately self-terminate?
+		{
+		ReleaseSerialise();
+		return(eBSErrSession);
+		}
+	WaitReadsAvail();
+	}
+ReleaseSerialise();
+return(eBSFSuccess);
 }
 
+// ReleaseStreamBatch
+// Called by the master thread after a streamed batch has been aligned and reported
+// Reads buffer is reset, but not freed, and reused by the reads loader thread for the next batch
 void
-CAligner::ReleaseSerialise(void)
+CAligner::ReleaseStreamBatch(void)
 {
+AcquireSerialise();
+AcquireLock(true);
+m_StreamReadIDBase += m_NumDescrReads;		// ReadIDs in the next batch start from 1 so this offset is used to report unique ReadIDs
+m_DataBuffOfs = 0;
+m_PrevSizeOf = 0;
+m_NumDescrReads = 0;
+m_NumReadsLoaded = 0;
+m_FinalReadID = 0;
+m_CurReadsSortMode = eRSMunsorted;
+m_bStreamBatchReady = false;
+ReleaseLock(true);
 #ifdef _WIN32
-ReleaseMutex(m_hMtxIterReads);
+SetEvent(m_hEvntReadsAvail);
 #else
-pthread_mutex_unlock(&m_hMtxIterReads);
+pthread_cond_broadcast(&m_hCondReadsAvail);
 #endif
+ReleaseSerialise();
 }
 
-void
-CAligner::AcquireSerialiseMH(void)
+// CreateStreamSpill
+// Creates/truncates the temporary file into which, when streaming, either SAM/BAM alignments or accepted reads for SNP processing are spilled
+// Temporary files are named after the primary output file and are deleted once all batches have been processed
+int
+CAligner::CreateStreamSpill(bool bSNPs)	// false if spilling SAM/BAM alignments, true if spilling reads for SNP processing
 {
+int hFile;
+char *pszFile;
+
+if(m_pStreamSpillBuff == NULL)
+	{
+	if((m_pStreamSpillBuff = new UINT8 [cStreamSpillBuffSize])==NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"CreateStreamSpill: unable to allocate memory (%d bytes) for spill buffer",cStreamSpillBuffSize);
+		return(eBSFerrMem);
+		}
+	}
+
+pszFile = bSNPs ? m_szStreamSNPFile : m_szStreamBAMFile;
+sprintf(pszFile,"%s.%s.tmp",m_pszOutFile,bSNPs ? "streamsnps" : "streamsam");
 #ifdef _WIN32
-WaitForSingleObject(m_hMtxMHReads,INFINITE);
+hFile = open(pszFile,( O_RDWR | _O_BINARY | _O_SEQUENTIAL | _O_CREAT | _O_TRUNC),(_S_IREAD | _S_IWRITE));
 #else
-pthread_mutex_lock(&m_hMtxMHReads);
+if((hFile = open(pszFile,O_RDWR | O_CREAT,S_IREAD | S_IWRITE))!=-1)
+	if(ftruncate(hFile,0)!=0)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"CreateStreamSpill: unable to truncate %s - %s",pszFile,strerror(errno));
+		close(hFile);
+		return(eBSFerrCreateFile);
+		}
 #endif
+if(hFile < 0)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"CreateStreamSpill: unable to create/truncate temporary file '%s'",pszFile);
+	return(eBSFerrCreateFile);
+	}
+if(bSNPs)
+	{
+	m_hStreamSNPFile = hFile;
+	m_StreamSNPFileLen = 0;
+	}
+else
+	{
+	m_hStreamBAMFile = hFile;
+	m_StreamBAMFileLen = 0;
+	}
+return(eBSFSuccess);
 }
 
-void
-CAligner::ReleaseSerialiseMH(void)
+// FlushStreamSpill
+// Writes the records buffered in m_pStreamSpillBuff to the end of the spill file
+int
+CAligner::FlushStreamSpill(bool bSNPs,	// false if spilling SAM/BAM alignments, true if spilling reads for SNP processing
+						size_t BuffLen)	// write this many buffered bytes
 {
-#ifdef _WIN32
-ReleaseMutex(m_hMtxMHReads);
-#else
-pthread_mutex_unlock(&m_hMtxMHReads);
-#endif
+if(BuffLen == 0)
+	return(eBSFSuccess);
+if(!CUtility::SafeWrite(bSNPs ? m_hStreamSNPFile : m_hStreamBAMFile,m_pStreamSpillBuff,BuffLen))
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"FlushStreamSpill: write to temporary file '%s' failed",bSNPs ? m_szStreamSNPFile : m_szStreamBAMFile);
+	return(eBSFerrFileAccess);
+	}
+if(bSNPs)
+	m_StreamSNPFileLen += BuffLen;
+else
+	m_StreamBAMFileLen += BuffLen;
+return(eBSFSuccess);
 }
 
-void
-CAligner::AcquireLock(bool bExclusive)
+// AddStreamRun
+// Records the file offset and length of a spilled run
+int
+CAligner::AddStreamRun(bool bSNPs,		// false if a run of SAM/BAM alignments, true if a run of reads for SNP processing
+					INT64 FileOfs,		// run starts at this spill file offset
+					INT64 RunLen,		// and is this many bytes long
+					UINT32 NumRecs,		// containing this many records
+					UINT32 ChromID)		// if reads for SNP processing then all aligned onto this chromosome
 {
-#ifdef _WIN32
-if(bExclusive)
-	AcquireSRWLockExclusive(&m_hRwLock);
-else
-	AcquireSRWLockShared(&m_hRwLock);
-#else
-if(bExclusive)
-	pthread_rwlock_wrlock(&m_hRwLock);
+tsStreamRun *pRun;
+tsStreamRun **ppRuns;
+UINT32 *pNumRuns;
+UINT32 *pAllocRuns;
+
+if(bSNPs)
+	{
+	ppRuns = &m_pStreamSNPRuns;
+	pNumRuns = &m_NumStreamSNPRuns;
+	pAllocRuns = &m_AllocStreamSNPRuns;
+	}
 else
-	pthread_rwlock_rdlock(&m_hRwLock);
-#endif
+	{
+	ppRuns = &m_pStreamBAMRuns;
+	pNumRuns = &m_NumStreamBAMRuns;
+	pAllocRuns = &m_AllocStreamBAMRuns;
+	}
+
+if(*ppRuns == NULL || *pNumRuns == *pAllocRuns)
+	{
+	size_t memreq = (*pAllocRuns + cAllocStreamRuns) * sizeof(tsStreamRun);
+	if((pRun = (tsStreamRun *)realloc(*ppRuns,memreq))==NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"AddStreamRun: Memory allocation of %lld bytes for spilled runs failed",(INT64)memreq);
+		return(eBSFerrMem);
+		}
+	*ppRuns = pRun;
+	*pAllocRuns += cAllocStreamRuns;
+	}
+pRun = &(*ppRuns)[*pNumRuns];
+*pNumRuns += 1;
+pRun->FileOfs = FileOfs;
+pRun->RunLen = RunLen;
+pRun->NumRecs = NumRecs;
+pRun->ChromID = ChromID;
+return(eBSFSuccess);
 }
 
+// DeleteStreamSpills
+// Closes and deletes any temporary spill files, and frees spilled run tracking
 void
-CAligner::ReleaseLock(bool bExclusive)
+CAligner::DeleteStreamSpills(void)
 {
-
-#ifdef _WIN32
-if(bExclusive)
-	ReleaseSRWLockExclusive(&m_hRwLock);
-else
-	ReleaseSRWLockShared(&m_hRwLock);
-#else
-pthread_rwlock_unlock(&m_hRwLock);
-#endif
+if(m_hStreamBAMFile != -1)
+	{
+	close(m_hStreamBAMFile);
+	m_hStreamBAMFile = -1;
+	remove(m_szStreamBAMFile);
+	}
+if(m_hStreamSNPFile != -1)
+	{
+	close(m_hStreamSNPFile);
+	m_hStreamSNPFile = -1;
+	remove(m_szStreamSNPFile);
+	}
+if(m_pStreamBAMRuns != NULL)
+	{
+	free(m_pStreamBAMRuns);
+	m_pStreamBAMRuns = NULL;
+	}
+if(m_pStreamSNPRuns != NULL)
+	{
+	free(m_pStreamSNPRuns);
+	m_pStreamSNPRuns = NULL;
+	}
+if(m_pStreamSpillBuff != NULL)
+	{
+	delete []m_pStreamSpillBuff;
+	m_pStreamSpillBuff = NULL;
+	}
+m_szStreamBAMFile[0] = '\0';
+m_szStreamSNPFile[0] = '\0';
+m_StreamBAMFileLen = 0;
+m_StreamSNPFileLen = 0;
+m_NumStreamBAMRuns = 0;
+m_AllocStreamBAMRuns = 0;
+m_NumStreamSNPRuns = 0;
+m_AllocStreamSNPRuns = 0;
 }
 
-int
-CAligner::ProcLoadReadFiles(tsLoadReadsThreadPars *pPars)
+// PackBAMalign
+// Packs an alignment into pDst, only the used portions of the variable length fields are packed
+int								// returned packed length
+CAligner::PackBAMalign(tsBAMalign *pBAMalign,	// alignment to pack
+					UINT8 *pDst)				// into this buffer, caller ensures at least sizeof(tsBAMalign) bytes available
 {
-teBSFrsltCodes Rslt;
-int *pRslt = pPars->pRslt;
 int Idx;
-char *pszInfile;
+int ValLen;
+UINT8 *pPack;
+tsBAMauxData *pAuxData;
+
+pPack = pDst;
+memcpy(pPack,pBAMalign,offsetof(tsBAMalign,szRefSeqName));	// fixed length fields; reference sequence names are regenerated when unpacking
+pPack += offsetof(tsBAMalign,szRefSeqName);
+memcpy(pPack,pBAMalign->read_name,pBAMalign->NumReadNameBytes);
+pPack += pBAMalign->NumReadNameBytes;
+memcpy(pPack,pBAMalign->cigar,pBAMalign->NumCigarBytes);
+pPack += pBAMalign->NumCigarBytes;
+memcpy(pPack,pBAMalign->seq,pBAMalign->NumSeqBytes);
+pPack += pBAMalign->NumSeqBytes;
+memcpy(pPack,pBAMalign->qual,pBAMalign->l_seq);
+pPack += pBAMalign->l_seq;
+pAuxData = pBAMalign->auxData;
+for(Idx = 0; Idx < pBAMalign->NumAux; Idx++,pAuxData++)
+	{
+	if(pAuxData->val_type == 'Z')
+		ValLen = (int)strlen((char *)pAuxData->value) + 1;
+	else
+		ValLen = sizeof(pAuxData->value);
+	memcpy(pPack,pAuxData,offsetof(tsBAMauxData,value));
+	pPack += offsetof(tsBAMauxData,value);
+	memcpy(pPack,pAuxData->value,ValLen);
+	pPack += ValLen;
+	}
+return((int)(pPack - pDst));
+}
 
-int NumInputFilesProcessed;
+// UnpackBAMalign
+// Unpacks an alignment previously packed by PackBAMalign
+int								// returned packed length
+CAligner::UnpackBAMalign(UINT8 *pSrc,			// packed alignment
+					tsBAMalign *pBAMalign)		// unpack into this alignment
+{
+int Idx;
+int ValLen;
+UINT8 *pPack;
+tsBAMauxData *pAuxData;
+
+pPack = pSrc;
+memcpy(pBAMalign,pPack,offsetof(tsBAMalign,szRefSeqName));
+pPack += offsetof(tsBAMalign,szRefSeqName);
+pBAMalign->szRefSeqName[0] = '\0';
+pBAMalign->szMateRefSeqName[0] = '\0';
+memcpy(pBAMalign->read_name,pPack,pBAMalign->NumReadNameBytes);
+pPack += pBAMalign->NumReadNameBytes;
+memcpy(pBAMalign->cigar,pPack,pBAMalign->NumCigarBytes);
+pPack += pBAMalign->NumCigarBytes;
+memcpy(pBAMalign->seq,pPack,pBAMalign->NumSeqBytes);
+pPack += pBAMalign->NumSeqBytes;
+memcpy(pBAMalign->qual,pPack,pBAMalign->l_seq);
+pPack += pBAMalign->l_seq;
+pAuxData = pBAMalign->auxData;
+for(Idx = 0; Idx < pBAMalign->NumAux; Idx++,pAuxData++)
+	{
+	memcpy(pAuxData,pPack,offsetof(tsBAMauxData,value));
+	pPack += offsetof(tsBAMauxData,value);
+	if(pAuxData->val_type == 'Z')
+		ValLen = (int)strlen((char *)pPack) + 1;
+	else
+		ValLen = sizeof(pAuxData->value);
+	memcpy(pAuxData->value,pPack,ValLen);
+	pPack += ValLen;
+	}
+return((int)(pPack - pSrc));
+}
 
-AcquireLock(true);
-m_bAllReadsLoaded = false;
-m_LoadReadsRslt = eBSFSuccess;
-ReleaseLock(true);
+// SpillStreamBAMReads
+// SAM/BAM output is coordinate sorted over all reads so can't be written batch by batch. Instead each streamed batch's alignments are
+// formatted as SAM/BAM alignments, whilst any paired reads are still resident, and spilled in eRSMHitMatch order as a sorted run
+// into a temporary file. Once all batches have been processed the sorted runs are merged into the SAM/BAM file by MergeStreamBAMReads()
+int
+CAligner::SpillStreamBAMReads(bool bPEProc)		// true if processing paired ends
+{
+int Rslt;
+int ReadIs;
+int PackedLen;
+size_t BuffLen;
+INT64 RunStart;
+UINT32 NumRecs;
+UINT32 CurChromID;
+tsReadHit *pReadHit;
+tsStreamBAMHdr *pHdr;
+tsBAMalign BAMalign;
 
-// first try to load as pre-processed reads '.rds' (as generated by 'kangar' or 'genreads')
-// if unable to load as a '.rds' then try to load as raw fasta/fastq
+if(m_hStreamBAMFile == -1 && (Rslt = CreateStreamSpill(false)) < eBSFSuccess)
+	return(Rslt);
 
-if(((Rslt = (teBSFrsltCodes)LoadReads(m_ppszPE1InputFiles[0])) < eBSFSuccess) && Rslt != eBSFerrNotBioseq )
-	{
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to load reads from %s",m_ppszPE1InputFiles[0]);
-	AcquireLock(true);
-	*pRslt = Rslt;
-	m_bAllReadsLoaded = true;
-	ReleaseLock(true);
+if((Rslt = SortReadHits(eRSMHitMatch,false)) < eBSFSuccess)
 	return(Rslt);
-	}
 
-if(Rslt != eBSFerrNotBioseq)
+BuffLen = 0;
+NumRecs = 0;
+CurChromID = 0;
+RunStart = m_StreamBAMFileLen;
+pReadHit = NULL;
+while((pReadHit = IterSortedReads(pReadHit))!=NULL)
 	{
-	if(Rslt == 0)
+	if(!(pReadHit->NAR == eNARAccepted || m_FMode == eFMsamAll))
+		continue;
+
+	if(!bPEProc)
+		ReadIs = 0;
+	else
+		ReadIs = pReadHit->PairReadID & 0x080000000 ? 0x02 : 0x01;
+
+	if((Rslt = ReportBAMread(pReadHit,pReadHit->NAR == eNARAccepted ? 0 : -1,ReadIs,&BAMalign)) < eBSFSuccess)
+		return(Rslt);
+
+	// mark chroms with at least one alignment as only these are written to the SAM or BAM header
+	if(pReadHit->NAR == eNARAccepted && pReadHit->HitLoci.Hit.Seg[0].ChromID != CurChromID)
 		{
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,"There were no reads in %s",m_ppszPE1InputFiles[0]);
-		Rslt = eBSFerrNoEntries;
+		CurChromID = pReadHit->HitLoci.Hit.Seg[0].ChromID;
+		m_pSfxArray->SetResetIdentFlags(CurChromID,0x01,0x00);
 		}
-	else
-		Rslt = eBSFSuccess;
-	AcquireLock(true);
-	*pRslt = Rslt;
-	m_bAllReadsLoaded = true;
-	ReleaseLock(true);
+
+	if((BuffLen + sizeof(tsStreamBAMHdr) + sizeof(tsBAMalign)) > cStreamSpillBuffSize)
+		{
+		if((Rslt = FlushStreamSpill(false,BuffLen)) < eBSFSuccess)
+			return(Rslt);
+		BuffLen = 0;
+		}
+	pHdr = (tsStreamBAMHdr *)&m_pStreamSpillBuff[BuffLen];
+	HitMatchKey(pReadHit,&pHdr->KeyHi,&pHdr->KeyLo);
+	pHdr->FlgAccepted = pReadHit->NAR == eNARAccepted ? 1 : 0;
+	pHdr->ChromID = pHdr->FlgAccepted ? pReadHit->HitLoci.Hit.Seg[0].ChromID : 0;
+	PackedLen = PackBAMalign(&BAMalign,(UINT8 *)pHdr + sizeof(tsStreamBAMHdr));
+	pHdr->RecLen = (UINT32)(sizeof(tsStreamBAMHdr) + PackedLen);
+	BuffLen += pHdr->RecLen;
+	NumRecs += 1;
+	}
+
+if((Rslt = FlushStreamSpill(false,BuffLen)) < eBSFSuccess)
 	return(Rslt);
+if(NumRecs > 0)
+	Rslt = AddStreamRun(false,RunStart,m_StreamBAMFileLen - RunStart,NumRecs,0);
+return(Rslt);
+}
+
+// LoadStreamMergeRec
+// Ensures that the current spilled alignment in a run being merged is completely contained within that run's read buffer
+int								// < 0 if errors, 0 if no more alignments in run, 1 if current alignment is available at pRun->BuffOfs
+CAligner::LoadStreamMergeRec(tsStreamMergeRun *pRun,	// run being merged
+						UINT32 BuffSize)				// run read buffer size
+{
+UINT32 Remain;
+int ToRead;
+tsStreamBAMHdr *pHdr;
+
+Remain = pRun->BuffLen - pRun->BuffOfs;
+pHdr = (tsStreamBAMHdr *)&pRun->pBuff[pRun->BuffOfs];
+if(Remain >= sizeof(tsStreamBAMHdr) && Remain >= pHdr->RecLen)
+	return(1);
+if(pRun->RemainLen == 0)
+	{
+	if(Remain == 0)
+		return(0);
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadStreamMergeRec: truncated alignment in temporary file '%s'",m_szStreamBAMFile);
+	return(eBSFerrFileAccess);
+	}
+
+// shift the partial alignment to the start of buffer and refill
+if(Remain > 0)
+	memmove(pRun->pBuff,&pRun->pBuff[pRun->BuffOfs],Remain);
+pRun->BuffOfs = 0;
+pRun->BuffLen = Remain;
+ToRead = (int)min((INT64)(BuffSize - Remain),pRun->RemainLen);
+if(_lseeki64(m_hStreamBAMFile,pRun->FileOfs,SEEK_SET) != pRun->FileOfs ||
+	read(m_hStreamBAMFile,&pRun->pBuff[Remain],ToRead) != ToRead)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadStreamMergeRec: unable to read %d bytes from temporary file '%s' - %s",ToRead,m_szStreamBAMFile,strerror(errno));
+	return(eBSFerrFileAccess);
 	}
+pRun->FileOfs += ToRead;
+pRun->RemainLen -= ToRead;
+pRun->BuffLen += ToRead;
+pHdr = (tsStreamBAMHdr *)pRun->pBuff;
+if(pRun->BuffLen < sizeof(tsStreamBAMHdr) || pRun->BuffLen < pHdr->RecLen)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadStreamMergeRec: inconsistent alignment in temporary file '%s'",m_szStreamBAMFile);
+	return(eBSFerrFileAccess);
+	}
+return(1);
+}
+
+// StreamMergeLess
+// Alignments are merged in ascending key order, alignments with the same keys are merged in run (batch) order
+bool
+CAligner::StreamMergeLess(tsStreamMergeRun *pRun1,tsStreamMergeRun *pRun2)
+{
+tsStreamBAMHdr *pHdr1 = (tsStreamBAMHdr *)&pRun1->pBuff[pRun1->BuffOfs];
+tsStreamBAMHdr *pHdr2 = (tsStreamBAMHdr *)&pRun2->pBuff[pRun2->BuffOfs];
+if(pHdr1->KeyHi != pHdr2->KeyHi)
+	return(pHdr1->KeyHi < pHdr2->KeyHi);
+if(pHdr1->KeyLo != pHdr2->KeyLo)
+	return(pHdr1->KeyLo < pHdr2->KeyLo);
+return(pRun1->RunIdx < pRun2->RunIdx);
+}
+
+// StreamMergeSiftDown
+// Restores merge heap ordering after the run at Idx has had its current alignment replaced
+void
+CAligner::StreamMergeSiftDown(tsStreamMergeRun **ppHeap,	// heap of runs being merged
+						UINT32 NumHeap,						// heap contains this many runs
+						UINT32 Idx)							// sift down starting from this heap index
+{
+UINT32 ChildIdx;
+tsStreamMergeRun *pRun;
+
+pRun = ppHeap[Idx];
+while((ChildIdx = (Idx * 2) + 1) < NumHeap)
+	{
+	if((ChildIdx + 1) < NumHeap && StreamMergeLess(ppHeap[ChildIdx+1],ppHeap[ChildIdx]))
+		ChildIdx += 1;
+	if(!StreamMergeLess(ppHeap[ChildIdx],pRun))
+		break;
+	ppHeap[Idx] = ppHeap[ChildIdx];
+	Idx = ChildIdx;
+	}
+ppHeap[Idx] = pRun;
+}
+
+// MergeStreamBAMReads
+// Merges all spilled sorted runs of SAM/BAM alignments into the SAM/BAM output file
+// Alignments are written in the same order, and with the same header reference sequences, as WriteBAMReadHits() would have written if all reads had been concurrently loaded
+int
+CAligner::MergeStreamBAMReads(void)
+{
+int Rslt;
+int ChromID;
+int NumChroms;
+int NumSeqsInHdr;
+int NumAlignedToSeqs;
+bool bRptAllChroms;
+bool bLastAligned;
+bool bAccepted;
+UINT16 EntryFlags;
+UINT32 ChromSeqLen;
+UINT32 CurChromID;
+UINT32 RunIdx;
+UINT32 NumHeap;
+UINT32 BuffSize;
+UINT32 NumReportedBAMreads;
+UINT32 PrevNumReportedBAMreads;
+char szChromName[128];
+eSAMFileType FileType;
+CSAMfile *pSAMfile;
+tsBAMalign BAMalign;
+tsStreamBAMHdr *pHdr;
+tsStreamMergeRun *pRuns;
+tsStreamMergeRun *pRun;
+tsStreamMergeRun **ppHeap;
+UINT8 *pBuffs;
 
-if(m_hInFile != -1)
+if((pSAMfile = new CSAMfile) == NULL)
 	{
-	close(m_hInFile);
-	m_hInFile = -1;
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"MergeStreamBAMReads: Unable to instantiate class CSAMfile");
+	return(eBSFerrInternal);
 	}
 
-AcquireLock(true);
-m_bAllReadsLoaded = false;
-memset(&m_FileHdr,0,sizeof(tsBSFRdsHdr));
-m_FileHdr.Magic[0] = 'b'; m_FileHdr.Magic[1] = 'i'; m_FileHdr.Magic[2] = 'o'; m_FileHdr.Magic[3] = 'r';
-m_FileHdr.Version = cBSFRdsVersion;
-m_FileHdr.FlagsK = 1;
-m_FileHdr.FlagsCS = m_bIsSOLiD;
-m_FileHdr.FlagsPR = m_PEproc == ePEdefault ? 0 : 1;
-m_FileHdr.PMode = (UINT8)0;
-m_FileHdr.QMode = m_QMethod;
-m_FileHdr.Trim5 = m_Trim5;
-m_FileHdr.Trim3 = m_Trim3;
-m_pReadHits = NULL;
-m_AllocdReadHitsMem = 0;
-m_NumReadsLoaded = 0;
-m_UsedReadHitsMem = 0;
-m_FinalReadID = 0;
-m_NumDescrReads = 0;
-ReleaseLock(true);
+switch(m_SAMFormat) {
+	case etSAMFformat:			// output SAM
+		if(m_bgzOutFile)
+			FileType = eSFTSAMgz;
+		else
+			FileType = eSFTSAM;
+		break;
+	case etSAMFBAM:				// output as BAM compressed with bgzf
+	default:
+		FileType = eSFTBAM_BAI;
+		break;
+	}
 
-if(m_FileHdr.FlagsPR && (m_NumPE1InputFiles < 1 || (m_NumPE1InputFiles != m_NumPE2InputFiles)))
+if((Rslt = pSAMfile->Create(FileType,m_pszOutFile,6,(char *)cpszProgVer,m_NumThreads)) < eBSFSuccess)	// default to compression level 6
 	{
-	Rslt = eBSFerrParams;
-	AcquireLock(true);
-	*pRslt = Rslt;
-	m_bAllReadsLoaded = true;
-	ReleaseLock(true);
+	delete pSAMfile;
 	return(Rslt);
 	}
 
-NumInputFilesProcessed = 0;
-if(!m_FileHdr.FlagsPR)
+// header references those chroms marked as having at least one alignment whilst spilling, unless reporting all chroms
+NumChroms = m_pSfxArray->GetNumEntries();
+bRptAllChroms = m_MaxRptSAMSeqsThres >= NumChroms ? true : false;
+NumAlignedToSeqs = 0;
+NumSeqsInHdr = 0;
+for(ChromID = 1; ChromID <= NumChroms; ChromID++)
 	{
-	CSimpleGlob glob(SG_GLOB_FULLSORT);
-	for(Idx = 0; Idx < m_NumPE1InputFiles; Idx++)
+	EntryFlags = m_pSfxArray->GetIdentFlags(ChromID);
+	if(EntryFlags & 0x01 || bRptAllChroms)
 		{
-		glob.Init();
-		if(glob.Add(m_ppszPE1InputFiles[Idx]) < SG_SUCCESS)
+		m_pSfxArray->GetIdentName(ChromID,sizeof(szChromName),szChromName);
+		ChromSeqLen=m_pSfxArray->GetSeqLen(ChromID);
+		if((Rslt = pSAMfile->AddRefSeq(m_szTargSpecies,szChromName,ChromSeqLen)) < 1)
 			{
-			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to glob '%s",m_ppszPE1InputFiles[Idx]);
-			Rslt = eBSFerrOpnFile;
-			AcquireLock(true);
-			*pRslt = Rslt;
-			m_bAllReadsLoaded = true;
-			m_LoadReadsRslt = Rslt;
-			ReleaseLock(true);
-			return(Rslt);	// treat as though unable to open file
+			delete pSAMfile;
+			return(Rslt);
 			}
+		NumSeqsInHdr += 1;
+		if(EntryFlags & 0x01)
+			NumAlignedToSeqs += 1;
+		}
+	}
+pSAMfile->StartAlignments();
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Header written with references to %d sequences of which %d have at least 1 alignments",NumSeqsInHdr, NumAlignedToSeqs);
 
-		if(glob.FileCount() <= 0)
+NumReportedBAMreads = 0;
+PrevNumReportedBAMreads = 0;
+Rslt = eBSFSuccess;
+if(m_NumStreamBAMRuns > 0)
+	{
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Merging %u sorted runs of spilled %s alignments",m_NumStreamBAMRuns,m_SAMFormat == etSAMFformat ? "SAM" : "BAM");
+	// run read buffers share a bounded memory allocation, but each must be able to hold at least one alignment
+	BuffSize = (UINT32)min(cStreamMergeMem / m_NumStreamBAMRuns,(size_t)cStreamSpillBuffSize);
+	BuffSize = max(BuffSize,(UINT32)max((size_t)cStreamMergeMinBuff,sizeof(tsStreamBAMHdr) + sizeof(tsBAMalign)));
+	pBuffs = new UINT8 [(size_t)BuffSize * m_NumStreamBAMRuns];
+	pRuns = new tsStreamMergeRun [m_NumStreamBAMRuns];
+	ppHeap = new tsStreamMergeRun * [m_NumStreamBAMRuns];
+	if(pBuffs == NULL || pRuns == NULL || ppHeap == NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"MergeStreamBAMReads: Memory allocation for %u run read buffers of %u bytes failed",m_NumStreamBAMRuns,BuffSize);
+		Rslt = eBSFerrMem;
+		}
+
+	NumHeap = 0;
+	for(RunIdx = 0; Rslt >= eBSFSuccess && RunIdx < m_NumStreamBAMRuns; RunIdx++)
+		{
+		pRun = &pRuns[RunIdx];
+		pRun->RunIdx = RunIdx;
+		pRun->FileOfs = m_pStreamBAMRuns[RunIdx].FileOfs;
+		pRun->RemainLen = m_pStreamBAMRuns[RunIdx].RunLen;
+		pRun->pBuff = &pBuffs[(size_t)BuffSize * RunIdx];
+		pRun->BuffLen = 0;
+		pRun->BuffOfs = 0;
+		if((Rslt = LoadStreamMergeRec(pRun,BuffSize)) > 0)
+			ppHeap[NumHeap++] = pRun;
+		}
+	if(Rslt >= eBSFSuccess && NumHeap > 1)
+		{
+		RunIdx = NumHeap / 2;
+		while(RunIdx-- > 0)
+			StreamMergeSiftDown(ppHeap,NumHeap,RunIdx);
+		}
+
+	CurChromID = 0;
+	time_t Started = time(0);
+	while(Rslt >= eBSFSuccess && NumHeap > 0)
+		{
+		pRun = ppHeap[0];
+		pHdr = (tsStreamBAMHdr *)&pRun->pBuff[pRun->BuffOfs];
+		UnpackBAMalign((UINT8 *)pHdr + sizeof(tsStreamBAMHdr),&BAMalign);
+		bAccepted = pHdr->FlgAccepted ? true : false;
+		if(bAccepted)
 			{
-			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to locate any source raw reads file matching '%s",m_ppszPE1InputFiles[Idx]);
-			continue;
+			if(pHdr->ChromID != CurChromID)
+				{
+				m_pSfxArray->GetIdentName(pHdr->ChromID,sizeof(m_szSAMTargChromName),m_szSAMTargChromName);
+				CurChromID = pHdr->ChromID;
+				}
+			strcpy(BAMalign.szRefSeqName,m_szSAMTargChromName);
 			}
+		else
+			strcpy(BAMalign.szRefSeqName,"*");
 
-		Rslt = eBSFSuccess;
-		for (int FileID = 0; Rslt >= eBSFSuccess &&  FileID < glob.FileCount(); ++FileID)
+		// advance run to its next alignment
+		pRun->BuffOfs += pHdr->RecLen;
+		if((Rslt = LoadStreamMergeRec(pRun,BuffSize)) < eBSFSuccess)
+			break;
+		if(Rslt == 0)
+			ppHeap[0] = ppHeap[--NumHeap];
+		if(NumHeap > 1)
+			StreamMergeSiftDown(ppHeap,NumHeap,0);
+
+		// check if current alignment is the last accepted aligned read
+		bLastAligned = false;
+		if(bAccepted)
 			{
-			pszInfile = glob.File(FileID);
+			if(NumHeap == 0 || !((tsStreamBAMHdr *)&ppHeap[0]->pBuff[ppHeap[0]->BuffOfs])->FlgAccepted)
+				bLastAligned = true;
+			}
 
-			gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading and parsing reads from raw sequence file '%s'\n",pszInfile);
-			Rslt = LoadRawReads(false,NumInputFilesProcessed+1,pszInfile,NULL);
-			if(Rslt != eBSFSuccess)
+		if((Rslt = pSAMfile->AddAlignment(&BAMalign,bLastAligned)) < eBSFSuccess)
+			break;
+		NumReportedBAMreads += 1;
+
+		if(NumReportedBAMreads > (PrevNumReportedBAMreads + 50000))
+			{
+			time_t Now = time(0);
+			unsigned long ElapsedSecs = (unsigned long) (Now - Started);
+			if(ElapsedSecs >= 60)
 				{
-				if(m_TermBackgoundThreads == 0)
-					gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: Load failed for input raw sequence file '%s'\n",pszInfile);
-				AcquireLock(true);
-				*pRslt = Rslt;
-				m_bAllReadsLoaded = true;
-				m_LoadReadsRslt = Rslt;
-				ReleaseLock(true);
-				return(Rslt);
+				gDiagnostics.DiagOut(eDLInfo,gszProcName,"Reported %s %u read alignments",m_SAMFormat == etSAMFformat ? "SAM" : "BAM",NumReportedBAMreads);
+				Started = Now;
 				}
-			NumInputFilesProcessed += 1;
+			PrevNumReportedBAMreads = NumReportedBAMreads;
 			}
 		}
+
+	if(pBuffs != NULL)
+		delete []pBuffs;
+	if(pRuns != NULL)
+		delete []pRuns;
+	if(ppHeap != NULL)
+		delete []ppHeap;
 	}
-else
+
+if(Rslt >= eBSFSuccess)
 	{
-	Rslt = eBSFSuccess;
-	NumInputFilesProcessed = 0;
-	for(int FileID = 0; Rslt >= eBSFSuccess &&  FileID < m_NumPE1InputFiles; ++FileID)
+	pSAMfile->Close();
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Completed reporting %s %u read alignments",m_SAMFormat == etSAMFformat ? "SAM" : "BAM",NumReportedBAMreads);
+	}
+delete pSAMfile;
+return(Rslt < eBSFSuccess ? Rslt : eBSFSuccess);
+}
+
+// SpillStreamSNPReads
+// SNP processing requires all reads aligned onto a chromosome so can't be completed batch by batch. Instead each streamed batch's accepted reads,
+// excluding InDel and splice junction alignments which are not processed for SNPs, are spilled in eRSMHitMatch order into a temporary file
+// as a sorted run per chromosome. Once all batches have been processed the runs are reloaded, a bounded number of chromosomes at a time, by ProcessStreamedSNPs()
+int
+CAligner::SpillStreamSNPReads(void)
+{
+int Rslt;
+size_t RecLen;
+size_t BuffLen;
+INT64 RunStart;
+UINT32 NumRecs;
+UINT32 RunChromID;
+tsReadHit *pReadHit;
+
+if(m_hStreamSNPFile == -1 && (Rslt = CreateStreamSpill(true)) < eBSFSuccess)
+	return(Rslt);
+
+if((Rslt = SortReadHits(eRSMHitMatch,false)) < eBSFSuccess)
+	return(Rslt);
+
+BuffLen = 0;
+NumRecs = 0;
+RunChromID = 0;
+RunStart = m_StreamSNPFileLen;
+pReadHit = NULL;
+while((pReadHit = IterSortedReads(pReadHit))!=NULL)
+	{
+	if(pReadHit->NAR != eNARAccepted || pReadHit->HitLoci.Hit.FlgInDel || pReadHit->HitLoci.Hit.FlgSplice)
+		continue;
+
+	if(pReadHit->HitLoci.Hit.Seg[0].ChromID != RunChromID)
 		{
-		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading and parsing reads from 5' PE1 raw sequence file '%s'",m_ppszPE1InputFiles[FileID]);
-		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading and parsing reads from 3' PE2 raw sequence file '%s'",m_ppszPE2InputFiles[FileID]);
+		if(NumRecs > 0 && (Rslt = AddStreamRun(true,RunStart,(m_StreamSNPFileLen + BuffLen) - RunStart,NumRecs,RunChromID)) < eBSFSuccess)
+			return(Rslt);
+		RunChromID = pReadHit->HitLoci.Hit.Seg[0].ChromID;
+		RunStart = m_StreamSNPFileLen + BuffLen;
+		NumRecs = 0;
+		}
 
-		Rslt = LoadRawReads(true,NumInputFilesProcessed+1,m_ppszPE1InputFiles[FileID],m_ppszPE2InputFiles[FileID]);
-		if(Rslt != eBSFSuccess)
-			{
-			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Process: Load failed for input raw sequence PE files '%s' and '%s'\n",m_ppszPE1InputFiles[FileID],m_ppszPE2InputFiles[FileID]);
-			AcquireLock(true);
-			*pRslt = Rslt;
-			m_bAllReadsLoaded = true;
-			m_LoadReadsRslt = Rslt;
-			ReleaseLock(true);
+	RecLen = sizeof(tsReadHit) + pReadHit->ReadLen + pReadHit->DescrLen;
+	if((BuffLen + RecLen) > cStreamSpillBuffSize)
+		{
+		if((Rslt = FlushStreamSpill(true,BuffLen)) < eBSFSuccess)
 			return(Rslt);
-			}
-		NumInputFilesProcessed += 2;
+		BuffLen = 0;
 		}
+	memcpy(&m_pStreamSpillBuff[BuffLen],pReadHit,RecLen);
+	BuffLen += RecLen;
+	NumRecs += 1;
 	}
-gDiagnostics.DiagOut(eDLInfo,gszProcName,"%d raw sequence file%s parsed and reads loaded for aligning", NumInputFilesProcessed, NumInputFilesProcessed == 1 ? " was" : "s were");
-if(NumInputFilesProcessed == 0)
-	{
-	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Nothing to do, no raw sequence files to be filtered");
-	AcquireLock(true);
-	*pRslt = Rslt;
-	m_bAllReadsLoaded = true;
-	m_LoadReadsRslt = eBSFerrNoEntries;
-	ReleaseLock(true);
+
+if(NumRecs > 0 && (Rslt = AddStreamRun(true,RunStart,(m_StreamSNPFileLen + BuffLen) - RunStart,NumRecs,RunChromID)) < eBSFSuccess)
 	return(Rslt);
-	}
+return(FlushStreamSpill(true,BuffLen));
+}
 
-// can now update header with final numbers
-AcquireLock(true);
-m_FileHdr.NumRds = m_NumDescrReads;
-m_FileHdr.OrigNumReads = m_NumDescrReads;
-m_FileHdr.TotReadsLen = m_DataBuffOfs;
-m_FinalReadID = m_NumDescrReads;
-m_NumReadsLoaded = m_NumDescrReads;
-m_LoadReadsRslt = m_NumReadsLoaded > 0 ? eBSFSuccess : eBSFerrNoEntries;
-m_bAllReadsLoaded = true;
-*pRslt = Rslt;
-ReleaseLock(true);
-return(Rslt);
+// SortStreamRuns
+// Sort spilled runs by ascending ChromID then ascending file offset
+int
+CAligner::SortStreamRuns(const void *arg1, const void *arg2)
+{
+tsStreamRun *pEl1 = (tsStreamRun *)arg1;
+tsStreamRun *pEl2 = (tsStreamRun *)arg2;
+
+if(pEl1->ChromID < pEl2->ChromID)
+	return(-1);
+if(pEl1->ChromID > pEl2->ChromID)
+	return(1);
+if(pEl1->FileOfs < pEl2->FileOfs)
+	return(-1);
+if(pEl1->FileOfs > pEl2->FileOfs)
+	return(1);
+return(0);
 }
 
+// ProcessStreamedSNPs
+// Reloads the spilled reads, as many complete chromosomes at a time as will fit within the reads buffer used for streamed batches, and processes
+// each set of reloaded chromosomes for SNPs. Memory is bounded by the larger of the streamed batch size and the reads aligned onto the single
+// chromosome with the most aligned reads
+int
+CAligner::ProcessStreamedSNPs(int PhaseIdx)		// SNP processing is timed as this processing phase
+{
+int Rslt;
+UINT32 RunIdx;
+UINT32 FirstRunIdx;
+UINT32 EndRunIdx;
+UINT32 ChromID;
+UINT32 NumReads;
+UINT32 ReadID;
+int NumRead;
+INT64 ChromLen;
+INT64 LoadLen;
+INT64 LoadOfs;
+INT64 RunOfs;
+tsStreamRun *pRun;
+tsReadHit *pReadHit;
+UINT8 *pTmpAlloc;
+
+if((Rslt = BeginSNPs()) < eBSFSuccess)
+	return(Rslt);
+
+if(m_NumStreamSNPRuns > 1)
+	qsort(m_pStreamSNPRuns,m_NumStreamSNPRuns,sizeof(tsStreamRun),SortStreamRuns);
+
+RunIdx = 0;
+while(RunIdx < m_NumStreamSNPRuns)
+	{
+	// gather complete chromosomes whilst these fit within the reads buffer, but always at least one chromosome
+	FirstRunIdx = RunIdx;
+	LoadLen = 0;
+	NumReads = 0;
+	while(RunIdx < m_NumStreamSNPRuns)
+		{
+		ChromID = m_pStreamSNPRuns[RunIdx].ChromID;
+		ChromLen = 0;
+		for(EndRunIdx = RunIdx; EndRunIdx < m_NumStreamSNPRuns && m_pStreamSNPRuns[EndRunIdx].ChromID == ChromID; EndRunIdx++)
+			ChromLen += m_pStreamSNPRuns[EndRunIdx].RunLen;
+		if(LoadLen > 0 && (LoadLen + ChromLen) > (INT64)m_AllocdReadHitsMem)
+			break;
+		for(; RunIdx < EndRunIdx; RunIdx++)
+			NumReads += m_pStreamSNPRuns[RunIdx].NumRecs;
+		LoadLen += ChromLen;
+		}
+
+	if(m_pReadHits == NULL || LoadLen > (INT64)m_AllocdReadHitsMem)
+		{
+		size_t memreq = (size_t)LoadLen;
+#ifdef _WIN32
+		pTmpAlloc = (UINT8 *) realloc(m_pReadHits,memreq);
+		if(pTmpAlloc == NULL)
+			{
+#else
+		if(m_pReadHits == NULL)
+			pTmpAlloc = (UINT8 *)mmap(NULL,memreq, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, -1,0);
+		else
+			pTmpAlloc = (UINT8 *)mremap(m_pReadHits,m_AllocdReadHitsMem,memreq,MREMAP_MAYMOVE);
+		if(pTmpAlloc == MAP_FAILED)
+			{
+			pTmpAlloc = NULL;
+#endif
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessStreamedSNPs: Memory reallocation to %lld bytes failed - %s",(INT64)memreq,strerror(errno));
+			Reset(false);
+			return(eBSFerrMem);
+			}
+		m_pReadHits = (tsReadHit *)pTmpAlloc;
+		m_AllocdReadHitsMem = memreq;
+		}
+
+	// reload the spilled runs
+	LoadOfs = 0;
+	for(pRun = &m_pStreamSNPRuns[FirstRunIdx]; pRun < &m_pStreamSNPRuns[RunIdx]; pRun++)
+		{
+		NumRead = 0;
+		if(_lseeki64(m_hStreamSNPFile,pRun->FileOfs,SEEK_SET) == pRun->FileOfs)
+			for(RunOfs = 0; RunOfs < pRun->RunLen; RunOfs += NumRead)		// reads limited to max of 1GB at a time
+				if((NumRead = read(m_hStreamSNPFile,(UINT8 *)m_pReadHits + LoadOfs + RunOfs,(int)min(pRun->RunLen - RunOfs,(INT64)0x03fffffff))) <= 0)
+					break;
+		if(NumRead <= 0)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcessStreamedSNPs: unable to read %lld bytes from temporary file '%s' - %s",pRun->RunLen,m_szStreamSNPFile,strerror(errno));
+			Reset(false);
+			return(eBSFerrFileAccess);
+			}
+		LoadOfs += pRun->RunLen;
+		}
 
+	// reads from different batches may share ReadIDs so reassign
+	pReadHit = m_pReadHits;
+	for(ReadID = 1; ReadID <= NumReads; ReadID++)
+		{
+		pReadHit->ReadID = ReadID;
+		pReadHit->PrevSizeOf = 0;
+		pReadHit = (tsReadHit *)((UINT8 *)pReadHit + sizeof(tsReadHit) + pReadHit->ReadLen + pReadHit->DescrLen);
+		}
+	m_NumReadsLoaded = NumReads;
+	m_FinalReadID = NumReads;
+	m_UsedReadHitsMem = (size_t)LoadLen;
+	if((Rslt = SortReadHits(eRSMHitMatch,false,true)) < eBSFSuccess)
+		{
+		Reset(false);
+		return(Rslt);
+		}
+	if((Rslt = ProcessSNPChromSpans(PhaseIdx)) < eBSFSuccess)
+		return(Rslt);
+	}
+return(EndSNPs());
+}
 
 int
 CAligner::AddEntry(bool bIsPairRead,	// false if SE or PE1, true if this is the paired read PE2
@@ -10662,7 +13241,15 @@ m_PrevSizeOf = (UINT32)sizeof(tsReadHit) + ReadLen + DescrLen;
 
 // processing threads are only updated with actual number of loaded reads every 50K reads so as
 // to minimise disruption to the actual aligner threads which will also be serialised through m_hMtxIterReads
-UINT32 RptDiff = 50000;
+// If aligner threads are waiting on reads then update as soon as there is a full block of reads available for processing
+// m_NumReadsWaiting is only updated whilst serialised through m_hMtxIterReads so an atomic read is sufficient here
+UINT32 NumReadsWaiting;
+#ifdef _WIN32
+NumReadsWaiting = (UINT32)InterlockedCompareExchange((volatile LONG *)&m_NumReadsWaiting,0,0);
+#else
+NumReadsWaiting = __sync_fetch_and_add(&m_NumReadsWaiting,0);
+#endif
+UINT32 RptDiff = NumReadsWaiting > 0 ? cMaxReadsPerBlock : 50000;
 if(m_SampleNthRawRead > 1)
 	RptDiff = 1 + (RptDiff/m_SampleNthRawRead);
   
@@ -10671,6 +13258,14 @@ if(m_NumDescrReads > 0 && (m_NumDescrReads - m_NumReadsLoaded) >= RptDiff)
 	AcquireSerialise();
 	m_FinalReadID = m_NumDescrReads;
 	m_NumReadsLoaded = m_NumDescrReads;
+	if(m_NumReadsWaiting > 0)
+		{
+#ifdef _WIN32
+		SetEvent(m_hEvntReadsAvail);
+#else
+		pthread_cond_broadcast(&m_hCondReadsAvail);
+#endif
+		}
 	ReleaseSerialise();
 	}
 return(eBSFSuccess);
@@ -10804,7 +13399,7 @@ if(bIsPairReads)
 UINT32 PairReadID;
 
 PairReadID = (m_NumDescrReads/2) + 1;				// if bIsPairReads then start paired reads identifiers from this value and increment after each read processed
-if((Rslt=(teBSFrsltCodes)PE1Fasta.Open(pszPE1File,true))!=eBSFSuccess)
+if((Rslt=(teBSFrsltCodes)PE1Fasta.Open(pszPE1File,true,cDfltStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Load: Unable to open '%s' [%s] %s",pszPE1File,PE1Fasta.ErrText((teBSFrsltCodes)Rslt),PE1Fasta.GetErrMsg());
 	return(Rslt);
@@ -10830,7 +13425,7 @@ bIsFastq = PE1Fasta.IsFastq();
 
 if(bIsPairReads)	
 	{
-	if((Rslt=(teBSFrsltCodes)PE2Fasta.Open(pszPE2File,true))!=eBSFSuccess)
+	if((Rslt=(teBSFrsltCodes)PE2Fasta.Open(pszPE2File,true,cDfltStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 		{
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Load: Unable to open '%s' [%s] %s",pszPE2File,PE2Fasta.ErrText((teBSFrsltCodes)Rslt),PE2Fasta.GetErrMsg());
 		PE1Fasta.Close();
@@ -11338,6 +13933,15 @@ while((Rslt = (teBSFrsltCodes)(PE1ReadLen = PE1Fasta.ReadSequence(szPE1ReadBuff,
 		if(m_TermBackgoundThreads != 0)	// need to immediately self-terminate?
 			break;
 
+		// if streaming then hand over a full batch for alignment and reporting before starting the next batch
+		// batches are only ever handed over on read pair boundaries so partner reads are always within the same batch
+		if(m_StreamBatchReads > 0 && m_NumDescrReads >= m_StreamBatchReads)
+			{
+			if((Rslt=(teBSFrsltCodes)StreamBatchLoaded())!=eBSFSuccess)
+				break;
+			PairReadID = 1;
+			}
+
 		if(!bIsPairReads)
 			{
 			if((Rslt=(teBSFrsltCodes)AddEntry(false,0,FileID,PE1DescrLen,(char *)szPE1DescrBuff,PE1ReadLen,szPE1ReadBuff))!=eBSFSuccess)
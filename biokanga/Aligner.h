@@ -14,6 +14,11 @@ const unsigned int cMaxInFileSpecs = 100;	// allow user to specify upto this man
 
 const int cMaxWorkerThreads = 128;			// limiting max number of threads to this many
 const int cMaxReadsPerBlock = 4096;		// max number of reads allocated for processing per thread as a block (could increase but may end up with 1 thread doing more than fair share of workload)
+const int cWaitReadsAvailMS = 1000;		// threads waiting on reads to be loaded will recheck after at most this many milliseconds even if not signaled
+
+const int cAlignMemoSlots = 0x040000;		// per thread memoisation of read sequence alignments is into a hash table with this many slots (must be a power of 2)
+const int cAlignMemoSeqBytes = 0x01000000;	// per thread memoised read sequences are held in this many bytes
+const int cAlignMemoHits = 0x040000;		// per thread memoised alignments are held in this many hit loci
 
 const int cMaxIncludeChroms = 20;		// max number of include chromosomes regular expressions
 const int cMaxExcludeChroms = 20;		// max number of exclude chromosomes regular expressions
@@ -55,6 +60,15 @@ const double cMinSeqErrRate = 0.01;		// sets a floor on minimum sequencing error
 const double cDfltMinMarkerSNPProp = (1.0/3.0);	// polymorphic bases within marker sequences must be at no more than this proportion of total bases covering the marker loci to be accepted
 
 const int cAllocLociPValues = 100000;   // allocate for putative SNP loci in this many increments
+const int cMaxSNPThreads = 8;			// SNP processing is over at most this many chromosomes concurrently, each thread holds base counts for a complete chromosome
+const int cSNPThreadMemMarginDiv = 8;	// SNP processing threads limited so that all threads base counts plus 1/cSNPThreadMemMarginDiv margin are physically available
+const int cAllocSNPChromSpans = 100000; // allocate for chromosome spans of accepted reads, processed for SNPs, in this many increments
+const int cAllocSNPsBuff = 0x0100000;	// initially allocate for buffering of DiSNPs and TriSNPs with this many chars, doubled as may be required
+const int cMinFreeSNPsBuff = 4000;		// DiSNP and TriSNP buffers are extended whenever there are less than this many chars free
+
+const int cMaxWriteHitsThreads = 8;	// CSV or BED formatting of sorted read alignments is over at most this many threads
+const int cWriteHitsChunkReads = 50000;	// each formatting thread processes chunks of this many sorted reads
+const int cAllocWriteHitsBuff = 0x01000000; // initially allocate for buffering of a formatted chunk with this many chars, doubled as may be required
 
 const int cAllocLineBuffSize = 0x01fffffff; // 512MB buffer - when writing to results file then allow for buffering up to this many chars so as to reduce write frequency
 
@@ -63,6 +77,9 @@ const int cMaxMultiHits = 500;			// user can specify at most this many multihits
 const int cMaxAllHits = 100000;			// but if reporting all multihit loci then limit is increased to this value
 
 const int cAllocMultihits = 25000000;		// alloc/realloc for multihit loci in this many instance increments
+const size_t cInitAllocMultiAllMem = 0x10000000;	// initial allocation for holding all multiloci alignments, extended as each thread's arena is merged
+const size_t cAllocThreadMultiAll = 0x0400000;	// per thread arena for capturing all multiloci alignments is initially allocated this many bytes, doubled as may be required
+const int cAllocThreadMHitReads = 100000;	// per thread arena for capturing multihit reads is initially allocated for this many reads, doubled as may be required
 const int cDfltReadLen = 200;			 // assume reads plus descriptors combined of of this length - not critical as actual read lengths are processed
 const size_t cReadsHitReAlloc = 50000000; // realloc allocation to hold this many read instances
 
@@ -83,6 +100,7 @@ const int cClustScaleFact = 10;			// scores are scaled down by this factor
 const UINT32 cMHminScore = 50;			// any putative multimatch alignment score must be at least this to be accepted as the alignment for that read
 
 const int cReadHitBuffLen = 0xfffff;		// sets per thread buffer size for holding string output read hit records
+const int cKeyedSortMemMarginDiv = 8;		// keyed radix sorting of reads requires the keys plus scatter buffer plus 1/cKeyedSortMemMarginDiv margin to be physically available
 const int cDataBuffAlloc = 0x0fffffff;		// alloc to hold reads in this byte sized increments
 const int cRdsBuffAlloc =   0x07fffff;		// alloc to hold preprocessed reads (for stats) in this byte sized allocation
 
@@ -91,6 +109,14 @@ const int cMaxDescrLen = 128;				// allow for descriptors of upto this length
 const unsigned int cMinSeqLen = 15;			// sequences must be at least this length otherwise user is warned and sequence sloughed
 const unsigned int cDfltMinAcceptReadLen = 50; // by default reads after any end trimming must be at least this length to be accepted for alignment processing
 const unsigned int cDfltMaxAcceptReadLen = 500; // by default reads after any end trimming must be no longer than this length to be accepted for alignment processing
+
+const UINT32 cMinStreamBatchReads = 1000;		// if streaming reads through alignment in batches then batches must contain at least this many reads
+const UINT32 cMaxStreamBatchReads = 100000000;	// and no more than this many reads
+const int cNumStreamAlignCnts = 31;				// number of alignment stats counts accumulated over streamed batches
+const int cStreamSpillBuffSize = 0x03fffff;		// when streaming, SAM/BAM alignments and reads for SNP processing are spilled to temporary files through a buffer of this size
+const size_t cStreamMergeMem = 0x03fffffff;		// merging of spilled SAM/BAM alignment runs uses at most this many bytes for run read buffers over all runs
+const int cStreamMergeMinBuff = 0x0ffff;		// but each run read buffer is at least this size
+const int cAllocStreamRuns = 1000;				// spilled runs are tracked in allocation increments of this many runs
 const unsigned int cMaxSeqLen = 2000;	// sequences must be no longer than this length otherwise user is warned and sequence sloughed
 
 const int cPCRPrimerSubs = 5;				// user can specify for upto this many PCR hexamer primer subs in 5' flank over 12bp
@@ -100,6 +126,9 @@ const int cMaxSitePrefOfs = 100;			// allow octamer starts to be at most this aw
 
 const int cNumOctamers = 0x010000;			// number of different octamers (4^8) in m_OctSitePrefs[]
 
+const int cMaxPhaseMetrics = 32;			// at most this many distinct processing phases can be timed when reporting per phase metrics
+const int cMaxPhaseNameLen = 31;			// processing phase names are truncated to at most this length
+
 #pragma pack(1)
 
 // each read will be marked with the reason as to why that read was not accepted as being aligned
@@ -243,6 +272,14 @@ typedef enum TAG_eFMode {
 	eFMplaceholder				// used to set the enumeration range
 	} etFMode;
 
+// NUMA placement of alignment threads and memory
+typedef enum TAG_eNUMAMode {
+	eNUMAoff = 0,				// default is for no NUMA placement, threads and memory are placed by the operating system
+	eNUMAbind,					// alignment threads are bound round robin to NUMA nodes, thread scratch memory is local to each thread's node
+	eNUMAinterleave,			// as eNUMAbind but additionally the suffix array index pages are interleaved over all NUMA nodes
+	eNUMAplaceholder			// used to set the enumeration range
+	} etNUMAMode;
+
 // SAM can be generated as SAM, BAM, or BAM bgzf compressed
 typedef enum eSAMFormat {
 	etSAMFformat = 0,			// output SAM as SAM
@@ -277,6 +314,13 @@ typedef enum TAG_eReadsSortMode {
 		eRSMplaceholder			// used to limit the enumeration range
 } etReadsSortMode;
 
+typedef enum TAG_eWriteHitsBuff {
+		eWHBprimary = 0,		// formatted alignments for the primary results file
+		eWHBInDel,				// BED formatted microInDel alignments
+		eWHBJunct,				// BED formatted splice junction alignments
+		eWHBplaceholder			// used to limit the enumeration range
+} etWriteHitsBuff;
+
 typedef struct TAG_sSNPcnts {
 	etSeqBase RefBase;	// reference base
 	UINT32 NumRefBases;		// counts of reference base in reads covering this loci
@@ -337,9 +381,46 @@ typedef struct TAG_sSNPCentroid {
 	UINT32 NonRefBaseCnts[5]; // counts of each non-reference bases covering SNP
 } tsSNPCentroid;
 
+typedef struct TAG_sStreamBAMHdr {
+	UINT32 RecLen;			// total length of this spilled SAM/BAM alignment including this header
+	UINT64 KeyHi;			// spilled alignments are merged in ascending KeyHi.KeyLo order, which is the eRSMHitMatch read ordering
+	UINT64 KeyLo;
+	UINT32 ChromID;			// read aligned onto this chromosome, 0 if not accepted as aligned
+	UINT8 FlgAccepted;		// 1 if read was accepted as aligned
+} tsStreamBAMHdr;
+
 #pragma pack()
 
+typedef struct TAG_sStreamRun {
+	INT64 FileOfs;			// run of spilled records starts at this offset in the temporary spill file
+	INT64 RunLen;			// run is this many bytes long
+	UINT32 NumRecs;			// run contains this many spilled records
+	UINT32 ChromID;			// if spilled reads for SNP processing then all reads in this run are aligned onto this chromosome
+} tsStreamRun;
+
+typedef struct TAG_sStreamMergeRun {
+	INT64 FileOfs;			// next unread offset of this run in the temporary spill file
+	INT64 RemainLen;		// this many bytes of the run remain unread
+	UINT8 *pBuff;			// run read buffer
+	UINT32 BuffLen;			// read buffer currently contains this many bytes
+	UINT32 BuffOfs;			// current spilled alignment starts at this read buffer offset
+	UINT32 RunIdx;			// alignments with same keys are merged in run order
+} tsStreamMergeRun;
+
 #pragma pack(4)
+typedef struct TAG_sAlignMemo {
+	UINT32 SeqHash;					// hash over read sequence
+	UINT32 SeqLen;					// read sequence length, 0 if slot is unused
+	UINT32 SeqOfs;					// read sequence starts at this offset in thread's memoised sequences
+	UINT32 HitsOfs;					// hit loci start at this offset in thread's memoised hit loci
+	INT16 NumHits;					// number of memoised hit loci
+	INT16 HitRslt;					// alignment result
+	INT16 LowHitInstances;			// number of match instances for lowest number of mismatches
+	INT8 LowMMCnt;					// lowest number of mismatches
+	INT8 NxtLowMMCnt;				// next to lowest number of mismatches
+	INT8 InNxtLowMMCnt;				// read's next to lowest number of mismatches prior to alignment
+} tsAlignMemo;
+
 typedef struct TAG_sThreadMatchPars {
 	int ThreadIdx;					// index of this thread (1..m_NumThreads)
 	void *pThis;					// will be initialised to pt to CAligner instance
@@ -375,6 +456,24 @@ typedef struct TAG_sThreadMatchPars {
 	int OutBuffIdx;					// index at which to write next formated hit into szOutBuff
 	UINT8 *pszOutBuff;				// used to buffer multiple hit formated output records prior to writing to disk
 	tsHitLoci *pMultiHits;			// allocated to hold read multihit loci
+	UINT32 NumAlignMemos;			// number of read sequence alignments currently memoised in pAlignMemos
+	tsAlignMemo *pAlignMemos;		// allocated to hold cAlignMemoSlots memoised read sequence alignments
+	UINT32 MemoSeqsLen;				// pMemoSeqs currently holds this many bytes
+	UINT8 *pMemoSeqs;				// allocated to hold cAlignMemoSeqBytes of memoised read sequences
+	UINT32 NumMemoHits;				// pMemoHits currently holds this many hit loci
+	tsHitLoci *pMemoHits;			// allocated to hold cAlignMemoHits memoised hit loci
+	UINT32 NumMemoReused;			// returned number of reads which reused a memoised alignment
+	int NUMANode;					// if NUMA placement then thread was bound to this node index, -1 if not bound
+	UINT32 NumMultiAll;				// number of multiloci alignments (variable length tsReadHit's) captured in pMultiAll
+	size_t MultiAllLen;				// pMultiAll currently holds this many bytes
+	size_t AllocMultiAll;			// pMultiAll allocated to hold this many bytes
+	UINT8 *pMultiAll;				// arena capturing this thread's multiloci alignments when reporting all, merged into m_pMultiAll on thread completion
+	UINT32 NumMHitReads;			// number of multihit reads captured in pMHitReads
+	UINT32 AllocdMHitReads;			// pMHitReads allocated to hold this many reads
+	tsReadHit *pMHitReads;			// arena capturing this thread's multihit reads, merged into m_pMultiHits on thread completion
+	UINT32 NumUniqueMHits;			// number of captured multihit reads which were uniquely aligned
+	UINT32 NumProvMAligned;			// number of captured multihit reads which were provisionally multialigned
+	double AlignSecs;				// returned wall time in seconds this thread spent aligning
 } tsThreadMatchPars;
 
 typedef struct TAG_sClusterThreadPars {
@@ -447,6 +546,78 @@ typedef struct TAG_sPEThreadPars {
 
 	int Rslt;						// returned result code
 } tsPEThreadPars;
+
+typedef struct TAG_sSNPChromSpan {
+	UINT32 ChromID;					// accepted reads in this span are all aligned to this chromosome
+	UINT32 NumReads;				// number of accepted reads in this span
+	tsReadHit *pFirstReadHit;		// 1st accepted read in this span
+	tsReadHit *pLastReadHit;		// last accepted read in this span
+} tsSNPChromSpan;
+
+typedef struct TAG_sSNPThreadPars {
+	int ThreadIdx;					// uniquely identifies this thread
+	void *pThis;					// will be initialised to pt to CAligner instance
+
+#ifdef _WIN32
+	HANDLE threadHandle;			// handle as returned by _beginthreadex()
+	unsigned int threadID;			// identifier as set by _beginthreadex()
+#else
+	int threadRslt;					// result as returned by pthread_create ()
+	pthread_t threadID;				// identifier as set by pthread_create ()
+#endif
+
+	UINT32 SpanIdx;					// currently processing this chromosome span in m_pSNPChromSpans
+	tsSNPChromSpan *pSpan;			// currently processing this chromosome span
+	char szChromName[cMaxDatasetSpeciesChrom+1]; // span is on this chromosome
+	tsChromSNPs *pChromSNPs;		// allocated to hold base counts for chromosome currently being processed
+	size_t AllocLociPValuesMem;		// total memory currently allocated to pLociPValues
+	UINT32 NumCandidates;			// number of putative SNP loci in pLociPValues before FDR
+	UINT32 NumLociPValues;			// number of putative SNP loci in pLociPValues accepted after FDR
+	tsLociPValues *pLociPValues;	// allocated to hold putative SNP loci and their associated PValues
+	int MaxDiSNPSep;				// putative DiSNPs only processed if separation between the SNPs <= this many bp
+	size_t AllocDiSNPs;				// pszDiSNPs allocated to hold this many chars
+	size_t DiSNPsLen;				// pszDiSNPs currently holds this many chars
+	char *pszDiSNPs;				// buffers DiSNPs for chromosome currently being processed
+	size_t AllocTriSNPs;			// pszTriSNPs allocated to hold this many chars
+	size_t TriSNPsLen;				// pszTriSNPs currently holds this many chars
+	char *pszTriSNPs;				// buffers TriSNPs for chromosome currently being processed
+	tsSNPCentroid *pSNPCentroids;	// if processing SNP centroids then distributions accumulated by this thread
+
+	// outputs
+	UINT32 NumChromsProc;			// number of chromosome spans processed by this thread
+	INT64 LociBasesCovered;			// number of loci (bases) covered by aligned reads
+	INT64 LociBasesCoverage;		// number of read bases covering aligned to loci bases
+	int Rslt;						// returned result code
+} tsSNPThreadPars;
+
+typedef struct TAG_sWriteHitsThreadPars {
+	int ThreadIdx;					// uniquely identifies this thread
+	void *pThis;					// will be initialised to pt to CAligner instance
+
+#ifdef _WIN32
+	HANDLE threadHandle;			// handle as returned by _beginthreadex()
+	unsigned int threadID;			// identifier as set by _beginthreadex()
+#else
+	int threadRslt;					// result as returned by pthread_create ()
+	pthread_t threadID;				// identifier as set by pthread_create ()
+#endif
+
+	UINT32 ChunkIdx;				// currently formatting this chunk of sorted reads
+	UINT32 StartIdx;				// chunk starts with this read in m_ppReadHitsIdx
+	UINT32 EndIdx;					// and ends immediately before this read
+	tBSFEntryID PrevTargEntry;		// szChromName holds the name for this chromosome
+	char szChromName[128];			// name of chromosome last referenced by this thread
+	size_t AllocBuff[eWHBplaceholder];	// pszBuff[] allocated to hold this many chars
+	size_t BuffLen[eWHBplaceholder];	// pszBuff[] currently holds this many chars
+	char *pszBuff[eWHBplaceholder];	// buffers formatted alignments, for each output file, for chunk currently being processed
+	size_t AllocGzBuff;				// pGzBuff allocated to hold this many bytes
+	size_t GzBuffLen;				// pGzBuff currently holds this many bytes
+	UINT8 *pGzBuff;					// if primary results file is compressed then holds pszBuff[eWHBprimary] compressed as a gzip member
+
+	// outputs
+	UINT32 NumChunksProc;			// number of chunks formatted by this thread
+	int Rslt;						// returned result code
+} tsWriteHitsThreadPars;
 #pragma pack()
 
 // SOLiDmap
@@ -465,12 +636,29 @@ typedef struct TAG_sOctSitePrefs {
 	double RelScale; // relative normalisation scaling factor to use
 	} tsOctSitePrefs;
 
+// per processing phase metrics, if a phase is entered multiple times (e.g. streamed batches) then metrics are accumulated
+typedef struct TAG_sPhaseMetrics {
+	char szPhase[cMaxPhaseNameLen+1];	// processing phase name
+	int NumEntered;					// number of times this phase was entered
+	bool bActive;					// true whilst phase is being timed
+	double StartSecs;				// phase was first entered at this wall time (secs relative to alignment start)
+	double EnteredSecs;				// phase was most recently entered at this wall time
+	double EnteredCPUSecs;			// process CPU time when phase was most recently entered
+	double WallSecs;				// accumulated wall time
+	double CPUSecs;					// accumulated process CPU time (user + system over all threads)
+	INT64 PeakRSSKB;				// process peak resident set size (KB) as at the phase most recently completing
+	INT64 NumItems;					// accumulated number of items (reads, pairs, loci) processed in this phase
+	int NumThreads;					// number of threads for which work counts are in ThreadWork[]
+	INT64 ThreadWork[cMaxWorkerThreads];	// accumulated per thread work counts
+	} tsPhaseMetrics;
+
 
 
 class CAligner
 {
 
 	CMTqsort m_mtqsort;				// muti-threaded qsort
+	CMTRadixSort m_MTRadixSort;		// multithreaded radix sort of keys extracted from reads
 
 	CContaminants *m_pContaminants; // for use when trimming reads containing contaminants
 
@@ -492,13 +680,45 @@ class CAligner
 	UINT32 m_FinalReadID;			// final read identifier loaded as a preprocessed read (tsProcRead)
 	UINT32 m_PrevSizeOf;			// size (UINT8's) of the previously loaded tsReadHit - allows easy referencing of partner pairs
 
+	UINT32 m_StreamBatchReads;		// if > 0 then reads are streamed through alignment and reporting in batches of at most this many reads
+	bool m_bMemoReadSeqs;			// if true then each distinct read sequence is aligned once with duplicate read sequences reusing that alignment
+	etNUMAMode m_NUMAMode;			// NUMA placement of alignment threads and suffix array index memory
+	CNUMA m_NUMA;					// discovered NUMA topology
+	UINT32 m_TotMemoReused;			// number of reads which reused the memoised alignment of a prior read with identical sequence
+	UINT32 m_StreamBatchID;			// current streamed batch (1..N)
+	bool m_bStreamBatchReady;		// set by reads loader when a streamed batch has been loaded, reset once that batch has been aligned and reported
+	bool m_bStreamFinalBatch;		// set true when processing the final streamed batch
+	UINT32 m_StreamReadIDBase;		// number of reads in all previously processed batches, added to batch ReadIDs when reporting
+	UINT32 m_StreamAlignCnts[cNumStreamAlignCnts];	// alignment stats counts accumulated over all processed batches
+	bool m_bStreamSimReads;			// set true if any streamed batch was processed as simulated reads
+	UINT8 *m_pStreamSpillBuff;		// streamed SAM/BAM alignments and reads for SNP processing are buffered in this buffer prior to spilling
+	int m_hStreamBAMFile;			// streamed SAM/BAM alignments are spilled as a sorted run per batch into this temporary file
+	char m_szStreamBAMFile[_MAX_PATH];	// name of temporary SAM/BAM alignments spill file
+	INT64 m_StreamBAMFileLen;		// bytes written to SAM/BAM alignments spill file
+	UINT32 m_NumStreamBAMRuns;		// number of runs in m_pStreamBAMRuns
+	UINT32 m_AllocStreamBAMRuns;	// m_pStreamBAMRuns allocated to hold this many runs
+	tsStreamRun *m_pStreamBAMRuns;	// spilled SAM/BAM alignment runs
+	int m_hStreamSNPFile;			// streamed accepted reads for SNP processing are spilled as a sorted run per batch and chromosome into this temporary file
+	char m_szStreamSNPFile[_MAX_PATH];	// name of temporary SNP reads spill file
+	INT64 m_StreamSNPFileLen;		// bytes written to SNP reads spill file
+	UINT32 m_NumStreamSNPRuns;		// number of runs in m_pStreamSNPRuns
+	UINT32 m_AllocStreamSNPRuns;	// m_pStreamSNPRuns allocated to hold this many runs
+	tsStreamRun *m_pStreamSNPRuns;	// spilled SNP read runs
+
 	tsReadHit **m_ppReadHitsIdx;	// memory allocated to hold array of ptrs to read hits in m_pReadHits - usually sorted by some critera
 	UINT32 m_AllocdReadHitsIdx;		// how many elements for m_pReadHitsIdx have been allocated
 	etReadsSortMode	m_CurReadsSortMode;	// sort mode last used on m_ppReadHitsIdx
 
-	size_t m_AllocLociPValuesMem;   // total memory currently allocated to m_pLociPValues
-	UINT32 m_NumLociPValues;		// current number of LociPValues
-	tsLociPValues *m_pLociPValues; // allocated to hold putative SNP loci and their associated PValues
+	UINT32 m_AllocSNPChromSpans;	// m_pSNPChromSpans allocated to hold this many chromosome spans
+	UINT32 m_NumSNPChromSpans;		// m_pSNPChromSpans holds this many chromosome spans
+	UINT32 m_NxtSNPChromSpan;		// next chromosome span to be processed for SNPs by a thread
+	UINT32 m_NxtSNPCommitSpan;		// SNPs for this chromosome span are the next to be written out
+	bool m_bSNPTermThreads;			// set true if SNP processing threads are to terminate early because of errors
+	UINT32 m_NumWriteHitsChunks;	// sorted reads partitioned into this many chunks for CSV or BED formatting
+	UINT32 m_NxtWriteHitsChunk;		// next chunk to be formatted by a thread
+	UINT32 m_NxtWriteHitsCommit;	// formatted alignments for this chunk are the next to be written out
+	bool m_bWriteHitsTermThreads;	// set true if formatting threads are to terminate early because of errors
+	tsSNPChromSpan *m_pSNPChromSpans; // allocated to hold chromosome spans of accepted reads sorted by chromosome and loci
 	double m_QValue;				// QValue used in
 
 	etMLMode m_MLMode;				// how to process multiloci matching reads
@@ -541,7 +761,6 @@ class CAligner
 
 	int m_MinSNPreads;				// before SNP can be called there must be at least this number of reads covering the loci
 	double m_SNPNonRefPcnt;			// only process for SNP if more/equal than this percentage number of reads are non-ref at putative SNP loci (defaults to 25) 
-	int m_MaxDiSNPSep;				// putative DiSNPs only processed if separation between the SNPs <= this many bp
 
 	tBSFEntryID m_PrevSAMTargEntry; // used to determine when generating SAM output if the target chrom has already been loaded
 	char m_szSAMTargChromName[128];	// holds previously loaded SAM chrom
@@ -567,6 +786,9 @@ class CAligner
 	int m_PerThreadAllocdIdentNodes;    // each thread can use this many tsIdentNodes
 	int m_TotAllocdIdentNodes;			// total number of tsIdentNodes allocated
 	tsIdentNode *m_pAllocsIdentNodes;	// memory allocated to hold tsIdentNodes required by all threads
+	bool m_bRetainPools;				// true if allocations which can be reused by subsequent alignment runs, e.g. spooled jobs, are to be retained
+	int m_PoolIdentNodes;				// number of tsIdentNodes in retained pool
+	tsIdentNode *m_pPoolIdentNodes;		// retained pool of tsIdentNodes, reused by subsequent alignment runs if large enough
 
 	teSAMFormat m_SAMFormat;		// output SAM as SAM, BAM or BAM compressed with bgzf
 
@@ -619,6 +841,7 @@ class CAligner
 
 	char *m_pszSfxFile;				// target as suffix array
 	char *m_pszStatsFile;			// aligner induced substitutions stats file or paired end length distributions
+	char *m_pszMetricsFile;			// per processing phase timings and counters, CSV or JSON (if '.json' file extension) format
 	char *m_pszPEInsertDistFile;	// PE insert size distributions for each transcript or assembly sequence
 	char *m_pszMultiAlignFile;		// file to contain reads which are aligned to multiple locations
 	char *m_pszNoneAlignFile;		// file to contain reads which were non-alignable
@@ -635,7 +858,6 @@ class CAligner
 
 
 
-	tsChromSNPs *m_pChromSNPs;		// allocated for use in SNP processing
 	int m_TotNumSNPs;				// total number of SNPs discovered
 	
 	INT64 m_LociBasesCovered;		// total number of targeted loci (bases) covered by aligned reads when SNP processing - could be used for to determine fold coverage
@@ -645,6 +867,13 @@ class CAligner
 	char *m_pszLineBuff;			// allocated to hold output line buffering
 
 	CSfxArrayV3 *m_pSfxArray;		// suffix array holds genome of interest
+	CSfxArrayV3 *m_pResidentSfxArray;	// if not NULL then already loaded suffix array to use instead of loading from file, not owned by this instance
+	int m_SfxKMerIdxLen;			// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
+
+	CStopWatch m_MetricsStopWatch;	// processing phases are timed relative to when this stopwatch was started
+	int m_NumPhaseMetrics;			// number of processing phases in m_PhaseMetrics
+	int m_LoadReadsPhaseIdx;		// reads loading phase, completed by the reads loader thread
+	tsPhaseMetrics m_PhaseMetrics[cMaxPhaseMetrics];	// per processing phase metrics
 	char m_szTargSpecies[cMaxDatasetSpeciesChrom+1]; // suffix array was generated over this targeted species
 
 	CBEDfile *m_pPriorityRegionBED;	// to hold exact match priority regions
@@ -708,6 +937,13 @@ class CAligner
 	bool m_bMutexesCreated;		// will be set true if synchronisation mutexes have been created
 
 	unsigned long m_ProcessingStartSecs;	
+
+	UINT32 m_NumReadsWaiting;			// number of aligner threads currently waiting on the reads loader for more reads, updated only whilst serialised through m_hMtxIterReads
+	UINT32 m_ReadsQueueWaits;			// number of times aligner threads had to wait on the reads loader
+	INT64 m_ReadsQueueIdleUSecs;		// total microseconds aligner threads spent waiting on the reads loader
+	UINT32 m_ReadsQueueBlocks;			// number of read blocks handed out to aligner threads
+	INT64 m_ReadsQueueDepthSum;			// sum of queue depths (loaded but yet to be processed reads) sampled as each block was handed out
+	UINT32 m_ReadsQueueDepthMax;		// maximum queue depth sampled as a block was handed out
 	UINT8 m_TermBackgoundThreads; // if non-zero then all background threads are to immediately terminate processing
 
 	int m_ThreadLoadReadsRslt;
@@ -832,6 +1068,44 @@ class CAligner
 
 	int ReportAlignStats(void);		// report basic alignment statistics
 
+	static void ProcessResources(double *pCPUSecs,		// returned process CPU time (user + system over all threads)
+				  INT64 *pPeakRSSKB);				// returned process peak resident set size in KB
+	double MetricsWallSecs(void);					// returns wall time in seconds since metrics stopwatch started
+	int BeginPhase(const char *pszPhase);			// start timing named processing phase, returns phase index or -1 if no more phases can be timed
+	void EndPhase(int PhaseIdx,						// end timing this processing phase
+				  INT64 NumItems);					// which processed this many items
+	void AddPhaseThreadWork(int PhaseIdx,			// accumulate per thread work counts for this processing phase
+				  int ThreadIdx,					// work count is for this thread (0..N)
+				  INT64 Work);						// thread processed this many items
+	int WritePhaseMetrics(void);					// write per processing phase metrics to m_pszMetricsFile
+
+	int AlignStreamed(etPEproc PEproc,	// paired reads alignment processing mode
+				  int MinEditDist,		// accepted alignments must be at least this Hamming away from other putative alignments
+				  int PairMinLen,		// only accept paired reads with a combined sequence length of at least this
+				  int PairMaxLen,		// only accept paired reads with a combined sequence length of no more than this
+				  bool bPairStrand,		// accept paired ends if on same strand
+				  int PCRPrimerCorrect,	// if > 0 then correct substitutions in 5' 12bp until overall sub rate within m_MaxSubs
+				  int MinFlankExacts,	// trim matched reads on 5' and 3' flanks until at least this number of exactly matching bases in flanks
+				  int NumIncludeChroms,	// number of chromosome regular expressions to include
+				  int NumExcludeChroms);	// number of chromosome expressions to exclude
+
+	int StreamBatchLoaded(void);		// called by reads loader when a streamed batch has been loaded, returns after batch has been aligned and reported
+	void ReleaseStreamBatch(void);		// called after streamed batch has been aligned and reported, reads buffer is reused for next batch
+	int CreateStreamSpill(bool bSNPs);	// create temporary file into which SAM/BAM alignments (bSNPs false) or reads for SNP processing (bSNPs true) are spilled
+	int FlushStreamSpill(bool bSNPs,size_t BuffLen);	// write BuffLen bytes buffered in m_pStreamSpillBuff to the spill file
+	int AddStreamRun(bool bSNPs,INT64 FileOfs,INT64 RunLen,UINT32 NumRecs,UINT32 ChromID);	// record a spilled run
+	void DeleteStreamSpills(void);		// close and delete all temporary spill files
+	int SpillStreamBAMReads(bool bPEProc);	// format streamed batch alignments as SAM/BAM and spill these as a sorted run
+	int LoadStreamMergeRec(tsStreamMergeRun *pRun,UINT32 BuffSize);	// ensure the run's current spilled alignment is completely contained in the run read buffer
+	int MergeStreamBAMReads(void);		// merge all spilled SAM/BAM alignment runs into the SAM/BAM output file
+	int SpillStreamSNPReads(void);		// spill streamed batch accepted reads for subsequent SNP processing
+	int ProcessStreamedSNPs(int PhaseIdx);	// reload spilled reads, a bounded number of chromosomes at a time, and process these for SNPs
+	static int PackBAMalign(tsBAMalign *pBAMalign,UINT8 *pDst);		// pack alignment into pDst returning packed length
+	static int UnpackBAMalign(UINT8 *pSrc,tsBAMalign *pBAMalign);		// unpack alignment from pSrc returning packed length
+	static bool StreamMergeLess(tsStreamMergeRun *pRun1,tsStreamMergeRun *pRun2);	// true if current alignment in pRun1 is to be merged before that in pRun2
+	static void StreamMergeSiftDown(tsStreamMergeRun **ppHeap,UINT32 NumHeap,UINT32 Idx);	// restore merge heap ordering
+	static int SortStreamRuns(const void *arg1, const void *arg2);	// sort spilled runs by ascending ChromID then file offset
+
 	
 	UINT32							// Median insert length
 		MedianInsertLen(UINT32 NumInserts,				// number of insert lengths in pInsertLens
@@ -841,6 +1115,16 @@ class CAligner
 	int WriteSubDist(tsReadHit *pReadHit);
 
 	int WriteReadHits(bool bPEProc);		   // true if processing paired ends
+	int WriteSortedReadHits(void);			   // format alignments as CSV or BED over multiple threads, written out in sorted read order
+	bool ReserveWriteHitsBuff(tsWriteHitsThreadPars *pPars,	// formatting thread
+					etWriteHitsBuff BuffIdx,	// buffer for this output file
+					size_t MinFree);		   // ensure at least this many chars are available for appending
+	int FormatCSVReadHit(tsWriteHitsThreadPars *pPars,	// formatting thread
+					tsReadHit *pReadHit);	   // append this read's alignment(s) as CSV to pPars->pszBuff[eWHBprimary]
+	int FormatBEDReadHit(tsWriteHitsThreadPars *pPars,	// formatting thread
+					tsReadHit *pReadHit);	   // append this read's alignment as BED to the pPars->pszBuff[] for the output file to which it belongs
+	int CompressWriteHitsChunk(tsWriteHitsThreadPars *pPars,	// formatting thread
+					z_stream *pStrm);		   // compress pPars->pszBuff[eWHBprimary] as a gzip member into pPars->pGzBuff
 
 	// Write alignments as SAM or BAM format
 	int WriteBAMReadHits(etFMode ProcMode,	   // eFMsam or eFMsamAll
@@ -867,8 +1151,18 @@ class CAligner
 
 	char *Octamer2Txt(int Octamer);		 // Report on site octamer site preferencing distribution
 
-	int OutputSNPs(void);
-	int ProcessSNPs(void);
+	int ProcessSNPs(int PhaseIdx);			// SNP processing is timed as this processing phase
+	int BeginSNPs(void);					// write SNP file headers and initialise centroids prior to processing chromosome spans
+	int ProcessSNPChromSpans(int PhaseIdx);	// process currently loaded accepted reads, partitioned into chromosome spans, for SNPs
+	int EndSNPs(void);						// close SNP files and report centroids after all chromosome spans have been processed
+	int CountChromSNPs(tsSNPThreadPars *pPars);	// accumulate base counts over chromosome span
+	int IdentifySNPs(tsSNPThreadPars *pPars);	// identify SNPs, and DiSNPs/TriSNPs, from accumulated base counts
+	int OutputSNPs(tsSNPThreadPars *pPars);		// write out identified SNPs, and markers, for chromosome span
+	int GenSNPMarkerSeq(tsChromSNPs *pChromSNPs,	// base counts for chromosome containing putative SNP
+				UINT32 Loci,						// putative SNP at this loci
+				char *pszMarkerSeq);				// returned marker sequence
+	int ExtendSNPsBuff(char **ppszBuff,		// extend this DiSNPs or TriSNPs buffer
+				size_t *pAllocBuff);			// currently allocated to hold this many chars, updated with extended size
 
 	int ProcessSiteProbabilites(int RelSiteStartOfs); // offset the site octamer by this relative start offset (read start base == 0)
 	int WriteSitePrefs(void);
@@ -896,7 +1190,8 @@ class CAligner
 
 	int AssignMultiMatches(void); // false to cluster with uniques, true to cluster with multimatches
 
-	int AddMultiHit(tsReadHit *pReadHit);
+	int AddMultiHit(tsThreadMatchPars *pPars,	// capture into this thread's arena
+					tsReadHit *pReadHit);		// this multiloci alignment
 
 	int AddEntry(bool bIsPairRead,		// true if this is the paired read PE2
 		 UINT32 PairReadID,		// identifies partner of this read if paired read processing
@@ -932,14 +1227,42 @@ class CAligner
 
 	tsReadHit *LocateRead(UINT32 ReadID);	 // Locate read with requested ReadID
 
-	int AddMHitReads(UINT32 NumHits,		// number of multimatches loci in pHits
+	int AddMHitReads(tsThreadMatchPars *pPars,	// capture into this thread's arena
+		UINT32 NumHits,						// number of multimatches loci in pHits
 		tsReadHit *pHits);					// pts to array of hit loci
 
+	int MergeThreadArenas(tsThreadMatchPars *pPars);	// merge completed thread's captured multiloci alignments and multihit reads, then free thread's arenas
+
 	int SortReadHits(etReadsSortMode SortMode,		// sort mode required
 				bool bSeqSorted = false,			// used to optimise eRSMSeq processing, if it is known that reads are already sorted in sequence order (loaded from pre-processed .rds file)
 				bool bForce = false);				// if true then force sort
 
+	void HitMatchKey(tsReadHit *pReadHit,UINT64 *pKeyHi,UINT64 *pKeyLo);	// returns eRSMHitMatch ordering key for read
+	int SortReadHitsKeyed(etReadsSortMode SortMode);	// sorts m_ppReadHitsIdx using radix sort on keys extracted from the reads
+
 	void ResetThreadedIterReads(void);		 // must be called by master thread prior to worker threads calling ThreadedIterReads()
+	void WaitReadsAvail(void);				 // called with serialisation acquired, waits until signaled that more reads may be available or timeout; serialisation reacquired on return
+	void ReportReadsQueueStats(void);		 // report aligner thread reads queue depths and idle times
+
+	tsAlignMemo *LocateAlignMemo(tsThreadMatchPars *pPars,	// thread's memoised alignments
+				UINT32 SeqHash,						// hash over read sequence
+				int InNxtLowMMCnt,					// read's next to lowest number of mismatches prior to alignment
+				int SeqLen,							// read sequence length
+				etSeqBase *pSeq);					// read sequence
+	void AddAlignMemo(tsThreadMatchPars *pPars,		// thread's memoised alignments
+				tsAlignMemo *pAlignMemo,			// unused slot as returned by LocateAlignMemo()
+				UINT32 SeqHash,						// hash over read sequence
+				int InNxtLowMMCnt,					// read's next to lowest number of mismatches prior to alignment
+				int SeqLen,							// read sequence length
+				etSeqBase *pSeq,					// read sequence
+				int HitRslt,						// alignment result
+				int LowHitInstances,				// number of match instances for lowest number of mismatches
+				int LowMMCnt,						// lowest number of mismatches
+				int NxtLowMMCnt,					// next to lowest number of mismatches
+				int NumHits,						// number of hit loci in pHits
+				tsHitLoci *pHits);					// hit loci
+	void FreeAlignMemos(tsThreadMatchPars *pPars);	// free thread's memoised alignments
+	void FreeNUMAScratch(tsThreadMatchPars *pPars);	// free scratch memory allocated by a NUMA node bound thread
 
 	UINT32		// Returns the number of reads thus far loaded and processed for alignment
 		ApproxNumReadsProcessed(UINT32 *pNumProcessed,UINT32 *pNumLoaded);
@@ -989,12 +1312,14 @@ class CAligner
 	HANDLE m_hMtxIterReads;
 	HANDLE m_hMtxMHReads;
 	HANDLE m_hMtxMultiMatches;
+	HANDLE m_hEvntReadsAvail;				// manual reset event, signaled when more reads may be available for aligning
 	SRWLOCK m_hRwLock;
 	HANDLE m_hThreadLoadReads;
 #else
 	pthread_mutex_t m_hMtxIterReads;
 	pthread_mutex_t m_hMtxMHReads;
 	pthread_mutex_t m_hMtxMultiMatches;
+	pthread_cond_t m_hCondReadsAvail;		// signaled when more reads may be available for aligning, used with m_hMtxIterReads
 	pthread_rwlock_t m_hRwLock;
 #endif
 
@@ -1004,6 +1329,9 @@ public:
 	CAligner(void);
 	~CAligner(void);
 
+	void SetResidentSfx(CSfxArrayV3 *pSfxArray);	// use this already loaded suffix array instead of loading from file
+	void RetainPools(bool bRetain);					// retain reusable allocations between alignment runs by this instance
+
 	int
 		Align(etPMode PMode,					// processing mode
 				UINT32 SampleNthRawRead,		// sample every Nth raw read for processing (1..N)
@@ -1045,6 +1373,9 @@ public:
 				teSAMFormat SAMFormat,			// if SAM output format then could be SAM, BAM or BAM compressed dependent on the file extension used
 				int SitePrefsOfs,				// offset read start sites when processing  octamer preferencing, range -100..100
 				int NumThreads,					// number of worker threads to use
+				UINT32 StreamBatchReads,		// if > 0 then stream reads through alignment and reporting in batches of at most this many reads
+				bool bMemoReadSeqs,				// if true then each distinct read sequence is aligned once with duplicate read sequences reusing that alignment
+				etNUMAMode NUMAMode,			// NUMA placement of alignment threads and suffix array index memory
 				char *pszTrackTitle,			// track title if output format is UCSC BED
 				int NumPE1InputFiles,			// number of input PE1 or single ended file specs
 				char *pszPE1InputFiles[],		// names of input files (wildcards allowed unless processing paired ends) containing raw reads
@@ -1057,7 +1388,10 @@ public:
 				char *pszMarkerFile,			// Output markers to this file
 				char *pszSNPCentroidFile,		// Output SNP centorids (CSV format) to this file (default is for no centroid processing)
 				char *pszSfxFile,				// target as suffix array
+				teSfxLoadMode SfxLoadMode,		// how the suffix array is to be loaded: private memory, or read only shared mapping
+				int SfxKMerIdxLen,				// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
 				char *pszStatsFile,				// aligner induced substitutions stats file
+				char *pszMetricsFile,			// per processing phase timings and counters to this file
 				char *pszMultiAlignFile,		// file to contain reads which are aligned to multiple locations
 				char *pszNoneAlignFile,			// file to contain reads which were non-alignable
 				char *pszSitePrefsFile,			// file to contain aligned reads octamer preferencing
@@ -1071,7 +1405,10 @@ public:
 		int ProcAssignMultiMatches(tsClusterThreadPars *pPars);
 		int ProcCoredApprox(tsThreadMatchPars *pPars);
 		int ProcLoadReadFiles(tsLoadReadsThreadPars *pPars);
+		void SignalReadsAvail(void);		// wake any threads waiting on reads to be loaded or a streamed batch to be released
 		int	ProcessPairedEnds(tsPEThreadPars *pPars);
+		int ProcessSNPs(tsSNPThreadPars *pPars);
+		int WriteSortedReadHits(tsWriteHitsThreadPars *pPars);
 
 };
 
@@ -827,7 +827,7 @@ switch(SeqSrc) {
 		break;
 	}
 
-if((Rslt=Fasta.Open(pszFastaFile,true,(UINT32)cMaxAssembSeqLen * 2))!=eBSFSuccess)
+if((Rslt=Fasta.Open(pszFastaFile,true,(UINT32)cMaxAssembSeqLen * 2,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	if(Rslt != eBSFerrNotFasta)
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadFastaSeqs: Unable to open '%s' [%s] %s",pszFastaFile,Fasta.ErrText((teBSFrsltCodes)Rslt),Fasta.GetErrMsg());
@@ -51,7 +51,9 @@ ProcessArtefactReduce(etARPMode PMode,	// processing mode; currently eAR2Fasta,
 		char *pszInPE2files[],		    // input PE2 3' read files
 		char *pszContaminantFile,		// contaminants fasta file
 		char *pszOutFile,				// where to write filtered sequences
-		char *pszDupDistFile);			// write duplicate sequence distributions to this file
+		char *pszDupDistFile,			// write duplicate sequence distributions to this file
+		int KMerDistLen,				// K-mer length used when generating K-mer count distributions
+		char *pszKMerDistFile);			// if not NULL or empty then write K-mer count distribution to this file
 
 #ifdef _WIN32
 int ArtefactReduce(int argc, char* argv[])
@@ -99,6 +101,8 @@ bool bDedupeIndependent;		// if paired end preprocessing then treat as if single
 char szCheckpointFile[_MAX_PATH];	// if file of this name exists and is a checkpoint then resume processing from this checkpoint, otherwise create a checkpoint file
 char szOutFile[_MAX_PATH];	// packed and deduped sequences written to this file
 char szDupDistFile[_MAX_PATH];	// write duplicate sequence distributions to this file
+int KMerDistLen;				// K-mer length used when generating K-mer count distributions
+char szKMerDistFile[_MAX_PATH];	// if not empty then write K-mer count distribution to this file
 
 int NumPE1InputFiles;			// number of PE1 input files
 char *pszInPE1files[cKDNAMaxInFileSpecs];  // input PE1 5' read files
@@ -123,6 +127,8 @@ struct arg_file *inpe1files = arg_filen("i","inpe1","<file>",1,cKDNAMaxInFileSpe
 struct arg_file *inpe2files = arg_filen("I","inpe2","<file>",0,cKDNAMaxInFileSpecs,"Load 3' if paired end reads from fasta or fastq file(s)");
 struct arg_file *outfile = arg_file0("o","out","<file>",		"Output multifasta ('-m0') or packed sequences ('-m1') to this file");
 struct arg_file *dupdistfile = arg_file0("O","dupdist","<file>","Output duplicate distributions to this file");
+struct arg_file *kmerdistfile = arg_file0(NULL,"kmerdist","<file>","Output K-mer count distribution (CSV) of filtered reads to this file");
+struct arg_int *kmerdistlen = arg_int0(NULL,"kmerdistlen","<int>","K-mer length when generating K-mer count distribution (default 25, range 16..256)");
 
 struct arg_file *contaminantfile = arg_file0("c", "contaminants", "<file>", "Putative contaminant sequences fasta file");
 
@@ -147,7 +153,7 @@ struct arg_str *experimentdescr = arg_str0("W","experimentdescr","<str>",	"exper
 struct arg_end *end = arg_end(200);
 
 void *argtable[] = {help,version,FileLogLevel,LogFile,
-	                pmode,minphredscore,strand,maxns,iterativepasses,trim5,trim3,contaminantfile,minseqlen,trimseqlen,minoverlap,minflanklen,nodedupe,dedupepe,inpe1files,inpe2files,outfile,dupdistfile,
+	                pmode,minphredscore,strand,maxns,iterativepasses,trim5,trim3,contaminantfile,minseqlen,trimseqlen,minoverlap,minflanklen,nodedupe,dedupepe,inpe1files,inpe2files,outfile,dupdistfile,kmerdistfile,kmerdistlen,
 					summrslts,experimentname,experimentdescr,
 					threads,
 					end};
@@ -296,6 +302,8 @@ if (!argerrors)
 	bStrand = false;
 	MinPhredScore = 0;
 	strcpy(szDupDistFile,"DupInstDist");
+	KMerDistLen = cDfltKMerDistLen;
+	szKMerDistFile[0] = '\0';
 	NumPE2InputFiles = 0;
 	NumPE1InputFiles = 0;
 	pszInPE1files[0] = NULL;
@@ -343,6 +351,21 @@ if (!argerrors)
 			strcpy(szDupDistFile,dupdistfile->filename[0]);
 			CUtility::TrimQuotedWhitespcExtd(szDupDistFile);
 			}
+		if(kmerdistfile->count)
+			{
+			strncpy(szKMerDistFile,kmerdistfile->filename[0],_MAX_PATH);
+			szKMerDistFile[_MAX_PATH-1] = '\0';
+			CUtility::TrimQuotedWhitespcExtd(szKMerDistFile);
+			}
+		if(szKMerDistFile[0] != '\0')
+			{
+			KMerDistLen = kmerdistlen->count ? kmerdistlen->ival[0] : cDfltKMerDistLen;
+			if(KMerDistLen < cMinKMerDistLen || KMerDistLen > cMaxKMerDistLen)
+				{
+				gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: K-mer distribution length '--kmerdistlen=%d' specified outside of range %d..%d",KMerDistLen,cMinKMerDistLen,cMaxKMerDistLen);
+				return(1);
+				}
+			}
 		if(!inpe1files->count && szCheckpointFile[0]=='\0')
 			{
 			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: No input file(s) specified with with '-i<filespec>' option)");
@@ -646,6 +669,11 @@ if (!argerrors)
 			}
 	
 		gDiagnostics.DiagOutMsgOnly(eDLInfo,"Duplicate sequence instances distribution file name prefix : '%s'",szDupDistFile);
+		if(szKMerDistFile[0] != '\0')
+			{
+			gDiagnostics.DiagOutMsgOnly(eDLInfo,"K-mer count distribution file : '%s'",szKMerDistFile);
+			gDiagnostics.DiagOutMsgOnly(eDLInfo,"K-mer count distribution K-mer length : %d",KMerDistLen);
+			}
 		}
 	else
 		{
@@ -691,6 +719,11 @@ if (!argerrors)
 
 			ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szOutFile),"out",szOutFile);
 			ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szDupDistFile),"dupdist",szDupDistFile);
+			if(szKMerDistFile[0] != '\0')
+				{
+				ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szKMerDistFile),"kmerdist",szKMerDistFile);
+				ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(KMerDistLen),"kmerdistlen",&KMerDistLen);
+				}
 			}
 		else
 			{
@@ -711,7 +744,7 @@ if (!argerrors)
 #endif
 	gStopWatch.Start();
 	Rslt = ProcessArtefactReduce((etARPMode)PMode,szCheckpointFile,(etSfxSparsity)SfxSparsity,IterativePasses,MinPhredScore,bNoDedupe,bStrand,MaxNs,Trim5,Trim3, MinSeqLen,TrimSeqLen,MinOverlap,MinFlankLen,SampleNth,Zreads,bDedupeIndependent,NumThreads,bAffinity,
-							NumPE1InputFiles,pszInPE1files,NumPE2InputFiles,pszInPE2files,szContaminantFile, szOutFile, szDupDistFile);
+							NumPE1InputFiles,pszInPE1files,NumPE2InputFiles,pszInPE2files,szContaminantFile, szOutFile, szDupDistFile,KMerDistLen,szKMerDistFile);
 	Rslt = Rslt >=0 ? 0 : 1;
 	if(gExperimentID > 0)
 		{
@@ -758,7 +791,9 @@ ProcessArtefactReduce(etARPMode PMode,	// processing mode, currently eAR2Fasta,
 		char *pszInPE2files[],		    // input PE2 3' read files
 		char *pszContaminantFile,		// contaminants fasta file
 		char *pszOutFile,				// where to write filtered sequences
-		char *pszDupDistFile)			// write duplicate sequence distributions to this file
+		char *pszDupDistFile,			// write duplicate sequence distributions to this file
+		int KMerDistLen,				// K-mer length used when generating K-mer count distributions
+		char *pszKMerDistFile)			// if not NULL or empty then write K-mer count distribution to this file
 {
 int Rslt;
 CArtefactReduce *pArtefactReduce;
@@ -770,7 +805,7 @@ if((pArtefactReduce = new CArtefactReduce) == NULL)
 	}
 
 Rslt = pArtefactReduce->Process(PMode,pszCheckpointFile,SfxSparsity,IterativePasses,MinPhredScore,bNoDedupe,bStrand,MaxNs,Trim5,Trim3,MinSeqLen,TrimSeqLen,MinOverlap,MinFlankLen,
-								SampleNth,Zreads,bDedupeIndependent,NumThreads,	bAffinity, NumPE1InputFiles,pszInPE1files,NumPE2InputFiles,pszInPE2files,pszContaminantFile,pszOutFile,pszDupDistFile);
+								SampleNth,Zreads,bDedupeIndependent,NumThreads,	bAffinity, NumPE1InputFiles,pszInPE1files,NumPE2InputFiles,pszInPE2files,pszContaminantFile,pszOutFile,pszDupDistFile,KMerDistLen,pszKMerDistFile);
 
 delete pArtefactReduce;
 return(Rslt);
@@ -815,6 +850,25 @@ pthread_exit(NULL);
 #endif
 }
 
+#ifdef _WIN32
+unsigned __stdcall ThreadedKMerDist(void * pThreadPars)
+#else
+void * ThreadedKMerDist(void * pThreadPars)
+#endif
+{
+int Rslt = 0;
+tsThreadKmerDistPars *pPars = (tsThreadKmerDistPars *)pThreadPars; // makes it easier not having to deal with casts!
+CArtefactReduce *pThis = (CArtefactReduce *)pPars->pThis;
+Rslt = pThis->ProcKMerDist(pPars);
+pPars->Rslt = Rslt;
+#ifdef _WIN32
+_endthreadex(0);
+return(eBSFSuccess);
+#else
+pthread_exit(NULL);
+#endif
+}
+
 // generally relies on base classes constructors
 CArtefactReduce::CArtefactReduce(void)
 {
@@ -830,36 +884,38 @@ ARReset();
 void
 CArtefactReduce::ARInit(void)
 {
-m_pKMerSeqHashes = NULL; 
-m_pKMerSeqs = NULL;
+m_pKMerCntSlots = NULL;
 ARReset();
 }
 
 void
-CArtefactReduce::ARReset(void) 
+CArtefactReduce::FreeKMerCnts(void)
 {
-if(m_pKMerSeqHashes != NULL)
-	{
-	delete m_pKMerSeqHashes;
-	m_pKMerSeqHashes = NULL;
-	}
-if(m_pKMerSeqs != NULL)
+if(m_pKMerCntSlots != NULL)
 	{
 #ifdef _WIN32
-	free(m_pKMerSeqs);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
+	free(m_pKMerCntSlots);				// was allocated with malloc, or mmap, not c++'s new....
 #else
-	if(m_pKMerSeqs != MAP_FAILED)
-		munmap(m_pKMerSeqs,m_AllocdKMerSeqInstsMem);
+	if(m_pKMerCntSlots != MAP_FAILED)
+		munmap(m_pKMerCntSlots,m_AllocdKMerCntMem);
 #endif
-	m_pKMerSeqs = NULL;
+	m_pKMerCntSlots = NULL;
 	}
-
+m_AllocdKMerCntMem = 0;
+memset(m_KMerCntParts,0,sizeof(m_KMerCntParts));
 m_KMerSeqLen = 0;
-m_KMerSeqInstSize = 0;
-m_NumKMerSeqHashes = 0;
-m_UsedKMerSeqInsts = 0; 
-m_AllocdKMerSeqInsts = 0;
-m_AllocdKMerSeqInstsMem = 0;
+m_KMerCntWrds = 0;
+m_KMerCntSlotSize = 0;
+m_bKMerCntStrand = false;
+m_KMerCntStartPart = 0;
+m_KMerCntEndPart = 0;
+m_KMerCntOverflow = 0;
+}
+
+void
+CArtefactReduce::ARReset(void) 
+{
+FreeKMerCnts();
 m_LoadedMeanSeqLen = 0;
 m_LoadedMinSeqLen = 0;
 m_LoadedMaxSeqLen = 0; 
@@ -892,7 +948,9 @@ CArtefactReduce::Process(etARPMode PMode,	// processing mode, currently eAR2Fast
 		char *pszInPE2files[],		    // input PE2 3' read files
 		char *pszContaminantFile,		// contaminants fasta file
 		char *pszOutFile,				// where to write packed sequences
-		char *pszDupDistFile)			// write duplicate sequence distributions to this file
+		char *pszDupDistFile,			// write duplicate sequence distributions to this file
+		int KMerDistLen,				// K-mer length used when generating K-mer count distributions
+		char *pszKMerDistFile)			// if not NULL or empty then write K-mer count distribution to this file
 {
 int Rslt;
 int Idx;
@@ -1253,60 +1311,16 @@ if(!bNoDedupe)
 	GenRdsSfx(1);	// first SeqWrd only requires indexing
 	}
 
-#ifdef USEKMERCNTS     // K-mer count filtering is still being developed so currently is not fully implemented
-
-int KMerLenFilter =  MinSeqLen - 10; // arbitary, should be a configurable parameter
-
-if(KMerLenFilter)
+if(pszKMerDistFile != NULL && pszKMerDistFile[0] != '\0')
 	{
-	// allocate for KMer sequence instance processing
-	m_KMerSeqLen = KMerLenFilter;			
-	m_KMerSeqInstSize = (sizeof(tsKMerSeqInst) - 1) +  ((m_KMerSeqLen + 3) / 4);
-	m_AllocdKMerSeqInsts = cInitAllocKMerSeqInsts;
-	m_AllocdKMerSeqInstsMem = m_AllocdKMerSeqInsts * m_KMerSeqInstSize;
-#ifdef _WIN32
-	m_pKMerSeqs = (tsKMerSeqInst *)malloc(m_AllocdKMerSeqInstsMem);	// initial and with any luck perhaps the only allocation
-	if (m_pKMerSeqs == NULL)
-		{
-		gDiagnostics.DiagOut(eDLFatal, gszProcName, "ProcessReadsetDist: Memory allocation of %lld bytes for K-mer distributions - %s", (INT64)m_AllocdKMerSeqInstsMem, strerror(errno));
-		m_AllocdKMerSeqInstsMem = 0;
-		ARReset();
-		Reset();
-		return(eBSFerrMem);
-		}
-#else
-		// gnu malloc is still in the 32bit world and can't handle more than 2GB allocations
-	m_pKMerSeqs = (tsKMerSeqInst *)mmap(NULL, m_AllocdKMerSeqInstsMem, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	if (m_pKMerSeqs == MAP_FAILED)
+	if((Rslt = GenKMerDist(KMerDistLen,bStrand,cDfltKMerCntMem,pszKMerDistFile)) < eBSFSuccess)
 		{
-		gDiagnostics.DiagOut(eDLFatal, gszProcName, "ProcessReadsetDist: Memory allocation of %lld bytes  for K-mer distributions through mmap()  failed - %s", (INT64)m_AllocdKMerSeqInstsMem, strerror(errno));
-		m_pKMerSeqs = NULL;
-		m_AllocdKMerSeqInstsMem = 0;
 		ARReset();
-		Reset();
-		return(eBSFerrMem);
-		}
-#endif
-	memset(m_pKMerSeqs,0,m_AllocdKMerSeqInstsMem);
-	m_NumKMerSeqHashes = 0;
-	if((m_pKMerSeqHashes = new UINT32 [cMaxKMerSeqHashArrayEntries]) == NULL)
-		{
-		gDiagnostics.DiagOut(eDLFatal, gszProcName, "ProcessReadsetDist: Memory allocation of %d entries for K-mer hashes failed", cMaxKMerSeqHashArrayEntries);
-		m_AllocdKMerSeqInstsMem = 0;
-		ARReset();
-		Reset();
-		return(eBSFerrMem);
+		Reset(false);
+		return(Rslt);
 		}
 	}
 
-#else
-m_pKMerSeqs = NULL;
-m_KMerSeqLen = 0;
-m_KMerSeqInstSize = 0;
-m_AllocdKMerSeqInsts = 0;
-m_AllocdKMerSeqInstsMem = 0;
-#endif
-
 	// now identify those reads which are not overlapped on both 5' and 3' by some other read
 	// if not overlapped then remove as these are likely to contain sequencer errors
 if(MinOverlap != -1)
@@ -2586,156 +2600,596 @@ gDiagnostics.DiagOut(eDLDebug,gszProcName,"Thread %d overlapping sequence identi
 return(1);		// success
 }
 
-// AddReadKMers
-// Adds all unique KMer instances of length m_KMerSeqLen from pRead to m_pKMerSeqs
-int									// returns number of KMers of length m_KMerSeqLen accepted from pRead, 0 if none, < 0 if errors
-CArtefactReduce::AddReadKMers(int ReadLen,		// number of bases in read
-				etSeqBase *pRead)				// read sequence
-
+// GenKMerDist
+// Counts all KMers of length KMerLen in the loaded reads and generates the distribution of KMer instance counts
+// KMers are hash partitioned, with the KMers in each partition counted in an open addressing table into which threads concurrently
+// add KMer counts without locks. Each thread firstly pre-aggregates counts in a small cache resident table and only when
+// that table is half full are the pre-aggregated counts added to the partition tables.
+// Partition table memory is bounded by MaxMem; if the tables for all partitions can't be accomodated then the reads are
+// iterated in multiple passes with each pass counting a subset of partitions, the number of passes being doubled whenever a partition overflows
+int
+CArtefactReduce::GenKMerDist(int KMerLen,					// count KMers of this length (cMinKMerDistLen..cMaxKMerDistLen)
+					bool bStrand,					// if false then KMers and their reverse complements are counted as the same KMer
+					size_t MaxMem,					// partition tables counted in any single pass are limited to this much memory
+					char *pszKMerDist)				// optionally write KMer count distribution to this file
 {
-int Rslt;
+tsThreadKmerDistPars *pThreadParams;
+tsThreadKmerDistPars *pCurThread;
+tsKMerCntPartition *pPart;
+tsKMerCntSlot *pSlot;
+int ThreadIdx;
+int NumThreads;
+int NumAllocThreads;
+int PartIdx;
+int PartsPerPass;
+int NumPasses;
+int hKMerDistFile;
 int Idx;
-etSeqBase *pStart;
-int CurKMerLen;
-int NumKMers;
+int MaxCntIdx;
+int Rslt;
+UINT64 PartSlots;
+UINT64 SlotIdx;
+UINT64 NumDistinct;
+UINT64 NumKMers;
+UINT32 CurNumProcessed;
+UINT32 PrevNumProcessed;
 
-if(ReadLen < m_KMerSeqLen || ReadLen < cMinKMerDistLen)
-	return(0);
+if(KMerLen < cMinKMerDistLen || KMerLen > cMaxKMerDistLen)
+	return(eBSFerrParams);
 
-pStart = pRead;
-CurKMerLen = 0;
+FreeKMerCnts();
+memset(m_KMerCntDist,0,sizeof(m_KMerCntDist));
+m_KMerSeqLen = KMerLen;
+m_KMerCntWrds = (KMerLen + 31) / 32;
+m_KMerCntSlotSize = (int)(sizeof(tsKMerCntSlot) + ((m_KMerCntWrds - 1) * sizeof(UINT64)));
+m_bKMerCntStrand = bStrand;
+
+// partitions need never be larger than if every KMer was unique, optimistically reduce partition sizes until all partitions can be counted in a single pass
+// and only if partitions are still too large then reduce the partitions per pass; if any partition overflows then partitions per pass are halved
+PartsPerPass = cKMerCntPartitions;
+PartSlots = cMinKMerCntPartSlots;
+while(PartSlots < ((m_Sequences.Seqs2AssembLen / cKMerCntPartitions) * 4) / 3)
+	PartSlots <<= 1;
+while(PartSlots > cMinKMerCntPartSlots && (PartSlots * m_KMerCntSlotSize * PartsPerPass) > MaxMem)
+	PartSlots >>= 1;
+while(PartsPerPass > 1 && (PartSlots * m_KMerCntSlotSize * PartsPerPass) > MaxMem)
+	PartsPerPass >>= 1;
+
+m_AllocdKMerCntMem = (size_t)(PartSlots * m_KMerCntSlotSize * PartsPerPass);		// total partition table memory remains constant as partitions per pass is reduced
+#ifdef _WIN32
+m_pKMerCntSlots = (UINT8 *)malloc(m_AllocdKMerCntMem);
+if(m_pKMerCntSlots == NULL)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"GenKMerDist: Memory allocation of %lld bytes for K-mer counts - %s",(INT64)m_AllocdKMerCntMem,strerror(errno));
+	m_AllocdKMerCntMem = 0;
+	return(eBSFerrMem);
+	}
+#else
+	// gnu malloc is still in the 32bit world and can't handle more than 2GB allocations
+m_pKMerCntSlots = (UINT8 *)mmap(NULL,m_AllocdKMerCntMem,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+if(m_pKMerCntSlots == MAP_FAILED)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"GenKMerDist: Memory allocation of %lld bytes for K-mer counts through mmap() failed - %s",(INT64)m_AllocdKMerCntMem,strerror(errno));
+	m_pKMerCntSlots = NULL;
+	m_AllocdKMerCntMem = 0;
+	return(eBSFerrMem);
+	}
+#endif
+
+// balance number threads vs the number of sequences so as to minimise the thread startup costs
+if(m_Sequences.NumSeqs2Assemb < 10000)
+	NumThreads = 1;
+else
+	{
+	NumThreads = (m_Sequences.NumSeqs2Assemb + 9999) / 10000;
+	if(NumThreads > m_NumThreads)
+		NumThreads = m_NumThreads;
+	}
+
+if((pThreadParams = new tsThreadKmerDistPars[NumThreads])==NULL)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"GenKMerDist: Unable to allocate memory for threads...");
+	FreeKMerCnts();
+	return(eBSFerrMem);
+	}
+memset(pThreadParams,0,sizeof(tsThreadKmerDistPars) * NumThreads);
+NumAllocThreads = NumThreads;
+pCurThread = pThreadParams;
+for(ThreadIdx = 1; ThreadIdx <= NumThreads; ThreadIdx++,pCurThread++)
+	{
+	if((pCurThread->pLocalSlots = new UINT8 [cKMerCntLocalSlots * m_KMerCntSlotSize]) == NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"GenKMerDist: Unable to allocate memory for threads...");
+		for(pCurThread = pThreadParams, ThreadIdx = 1; ThreadIdx <= NumThreads; ThreadIdx++,pCurThread++)
+			if(pCurThread->pLocalSlots != NULL)
+				delete []pCurThread->pLocalSlots;
+		delete []pThreadParams;
+		FreeKMerCnts();
+		return(eBSFerrMem);
+		}
+	}
+
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Starting %d-mer distribution generation over %d partitions of %llu slots, %d partitions per pass...",
+						KMerLen,cKMerCntPartitions,PartSlots,PartsPerPass);
+
+#ifndef _WIN32
+	// increase the default stack of just 2MB
+	size_t defaultStackSize;
+	pthread_attr_t threadattr;
+	pthread_attr_init(&threadattr);
+	pthread_attr_getstacksize(&threadattr, &defaultStackSize);
+	if(defaultStackSize != cWorkThreadStackSize)
+		pthread_attr_setstacksize(&threadattr, cWorkThreadStackSize);
+#endif
+
+Rslt = eBSFSuccess;
+NumPasses = 0;
 NumKMers = 0;
-for(Idx = 0; Idx < ReadLen; Idx++, pRead++)
+m_KMerCntStartPart = 0;
+while(Rslt >= eBSFSuccess && m_KMerCntStartPart < cKMerCntPartitions)
 	{
-	if(*pRead > eBaseT)		// all accepted KMers must only contain A..T bases
+	// initialise partition tables for this pass
+	NumPasses += 1;
+	m_KMerCntEndPart = m_KMerCntStartPart + PartsPerPass - 1;
+	m_KMerCntOverflow = 0;
+	memset(m_pKMerCntSlots,0,m_AllocdKMerCntMem);
+	for(PartIdx = m_KMerCntStartPart; PartIdx <= m_KMerCntEndPart; PartIdx++)
+		{
+		pPart = &m_KMerCntParts[PartIdx];
+		pPart->NumSlots = PartSlots;
+		pPart->MaxUsedSlots = (PartSlots * 3) / 4;			// linear probing degrades rapidly when tables are any fuller
+		pPart->NumUsedSlots = 0;
+		pPart->pSlots = &m_pKMerCntSlots[(PartIdx - m_KMerCntStartPart) * PartSlots * m_KMerCntSlotSize];
+		}
+
+	m_Sequences.NumProcessed = 0;
+	m_FinalProcSeqID = m_Sequences.NumSeqs2Assemb;
+	m_NextProcSeqID = 1;
+	m_StartProcSeqID = 1;
+	m_NumProcSeqIDs = cMaxMultiSeqFlags;
+	m_ThreadsProcessing = NumThreads;
+	pCurThread = pThreadParams;
+	for(ThreadIdx = 1; ThreadIdx <= NumThreads; ThreadIdx++,pCurThread++)
+		{
+		pCurThread->ThreadIdx = ThreadIdx;
+		pCurThread->pThis = this;
+		pCurThread->KMerLen = KMerLen;
+		pCurThread->Rslt = 0;
+		pCurThread->TotNumReads = 0;
+		pCurThread->TotNumKMers = 0;
+		pCurThread->NumLocalSlots = 0;
+		memset(pCurThread->pLocalSlots,0,cKMerCntLocalSlots * m_KMerCntSlotSize);
+#ifdef _WIN32
+		pCurThread->threadHandle = (HANDLE)_beginthreadex(NULL,cWorkThreadStackSize,ThreadedKMerDist,pCurThread,0,&pCurThread->threadID);
+		if(pCurThread->threadHandle == NULL)
+			break;
+#else
+		pCurThread->threadRslt = pthread_create (&pCurThread->threadID , &threadattr , ThreadedKMerDist , pCurThread);
+		if(pCurThread->threadRslt != 0)
+			break;
+#endif
+		}
+	if(ThreadIdx <= NumThreads)			// not all threads could be started
+		{
+		if(ThreadIdx == 1)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"GenKMerDist: Unable to start any K-mer counting threads");
+			Rslt = eBSFerrInternal;
+			break;
+			}
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"GenKMerDist: Only able to start %d of %d K-mer counting threads",ThreadIdx - 1,NumThreads);
+		NumThreads = ThreadIdx - 1;		// started threads iterate over all remaining sequences
+		}
+
+	PrevNumProcessed = 0;
+	pCurThread = pThreadParams;
+	for(ThreadIdx = 0; ThreadIdx < NumThreads; ThreadIdx++,pCurThread++)
+		{
+#ifdef _WIN32
+		while(WAIT_TIMEOUT == WaitForSingleObject(pCurThread->threadHandle, 60000 * 10))
+			{
+			AcquireLock(false);
+			CurNumProcessed = m_Sequences.NumProcessed;
+			ReleaseLock(false);
+			if(CurNumProcessed > PrevNumProcessed)
+				gDiagnostics.DiagOut(eDLInfo,gszProcName,"Progress: %u sequences processed",CurNumProcessed);
+			PrevNumProcessed = CurNumProcessed;
+			}
+		CloseHandle( pCurThread->threadHandle);
+#else
+		struct timespec ts;
+		int JoinRlt;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += 60 * 10;
+		while((JoinRlt = pthread_timedjoin_np(pCurThread->threadID, NULL, &ts)) != 0)
+			{
+			AcquireLock(false);
+			CurNumProcessed = m_Sequences.NumProcessed;
+			ReleaseLock(false);
+			if(CurNumProcessed > PrevNumProcessed)
+				gDiagnostics.DiagOut(eDLInfo,gszProcName,"Progress: %u sequences processed",CurNumProcessed);
+			PrevNumProcessed = CurNumProcessed;
+			ts.tv_sec += 60;
+			}
+#endif
+		if(pCurThread->Rslt < eBSFSuccess)
+			Rslt = pCurThread->Rslt;
+		}
+	if(Rslt < eBSFSuccess)
+		break;
+
+	if(m_KMerCntOverflow)		// need to repeat this pass with less partitions per pass, each partition table being larger
 		{
-		CurKMerLen = 0;
-		pStart = pRead+1;
+		if(PartsPerPass == 1)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"GenKMerDist: Unable to count %d-mers in partition %d within %lld bytes of memory",KMerLen,m_KMerCntStartPart,(INT64)m_AllocdKMerCntMem);
+			Rslt = eBSFerrMem;
+			break;
+			}
+		PartsPerPass >>= 1;
+		PartSlots <<= 1;
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Partition overflowed, repeating pass with %d partitions of %llu slots per pass",PartsPerPass,PartSlots);
 		continue;
 		}
-	if(++CurKMerLen >= m_KMerSeqLen)
+
+	// accumulate KMer count distribution for the partitions counted in this pass
+	for(PartIdx = m_KMerCntStartPart; PartIdx <= m_KMerCntEndPart; PartIdx++)
 		{
-		if((Rslt = AddReadKMer(pStart++)) < 1)
-			return(Rslt);
-		NumKMers += 1;
+		pPart = &m_KMerCntParts[PartIdx];
+		for(SlotIdx = 0; SlotIdx < pPart->NumSlots; SlotIdx++)
+			{
+			pSlot = (tsKMerCntSlot *)&pPart->pSlots[SlotIdx * m_KMerCntSlotSize];
+			if(pSlot->Tag == cKMerCntSlotEmpty)
+				continue;
+			m_KMerCntDist[min(pSlot->Cnt,(UINT32)cMaxKMerCntDist)] += 1;
+			}
 		}
+	pCurThread = pThreadParams;
+	for(ThreadIdx = 0; ThreadIdx < NumThreads; ThreadIdx++,pCurThread++)
+		NumKMers += pCurThread->TotNumKMers;
+	gDiagnostics.DiagOut(eDLDiag,gszProcName,"Completed counting %d-mers in partitions %d..%d",KMerLen,m_KMerCntStartPart,m_KMerCntEndPart);
+	m_KMerCntStartPart = m_KMerCntEndPart + 1;
 	}
-return(NumKMers);
-}
+#ifndef _WIN32
+pthread_attr_destroy(&threadattr);		// no longer required
+#endif
 
-int									 // returns < 0 if errors, 1 if this is the first instance of the KMer sequence, 2..N if multiple instances previously added
-CArtefactReduce::AddReadKMer(etSeqBase *pKMerSeq)	// KMer bases, expected to be of at least length m_KMerSeqLen
-{
+pCurThread = pThreadParams;
+for(ThreadIdx = 0; ThreadIdx < NumAllocThreads; ThreadIdx++,pCurThread++)
+	delete []pCurThread->pLocalSlots;
+delete []pThreadParams;
+FreeKMerCnts();
+if(Rslt < eBSFSuccess)
+	return(Rslt);
+m_KMerSeqLen = KMerLen;
 
-UINT8 PackedSeqs[((cMaxKMerDistLen+3)/4)];	// to hold packed read bases of upto cMaxKMerDistLen in length
-UINT32 NxtSeqInst;
-size_t NxtSeqInstOfs;
-etSeqBase *pKMerBase;
-UINT8 *pPacked;
-UINT8 Packed;
-UINT32 KMerHash;
-UINT32 *pKMerWrd;
-int Idx;
-tsKMerSeqInst *pKMerSeqInst;
-tsKMerSeqInst *pNewKMerSeq;
-int NumInstances;
-
-pKMerBase = pKMerSeq;
-pPacked = PackedSeqs;
-KMerHash = 0;
-Packed = 0;
-for(Idx = 0; Idx < m_KMerSeqLen; Idx++,pKMerBase++)
+NumDistinct = 0;
+MaxCntIdx = 0;
+for(Idx = 1; Idx <= cMaxKMerCntDist; Idx++)
+	{
+	if(m_KMerCntDist[Idx] == 0)
+		continue;
+	NumDistinct += m_KMerCntDist[Idx];
+	MaxCntIdx = Idx;
+	}
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Completed: %llu %d-mers counted in %d passes, %llu distinct of which %llu are singletons",
+						NumKMers,KMerLen,NumPasses,NumDistinct,m_KMerCntDist[1]);
+
+if(gProcessingID > 0)
+	{
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"KMerDist",ePTInt32,sizeof(KMerLen),"KMerLen",&KMerLen);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"KMerDist",ePTUint64,sizeof(NumKMers),"KMers",&NumKMers);
+	gSQLiteSummaries.AddResult(gExperimentID, gProcessingID,(char *)"KMerDist",ePTUint64,sizeof(NumDistinct),"Distinct",&NumDistinct);
+	}
+
+if(pszKMerDist != NULL && pszKMerDist[0] != '\0')
 	{
-	if(!(Idx % 4))
+#ifdef _WIN32
+	if((hKMerDistFile = open(pszKMerDist, _O_RDWR | _O_BINARY | _O_SEQUENTIAL | _O_CREAT | _O_TRUNC, _S_IREAD | _S_IWRITE ))==-1)
+#else
+	if((hKMerDistFile = open(pszKMerDist, O_RDWR | O_CREAT |O_TRUNC, S_IREAD | S_IWRITE))==-1)
+#endif
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to create or truncate %s - %s",pszKMerDist,strerror(errno));
+		return(eBSFerrCreateFile);
+		}
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Output K-mer distribution file created/truncated: '%s'",pszKMerDist);
+
+	char szBuff[4096];
+	int BuffIdx = 0;
+	BuffIdx += sprintf(&szBuff[BuffIdx],"\"Instances\",\"NumKMers\"\n");
+	for(Idx = 1; Idx <= MaxCntIdx; Idx++)
 		{
-		if(Idx)
+		if(m_KMerCntDist[Idx] == 0)
+			continue;
+		BuffIdx += sprintf(&szBuff[BuffIdx],"%d,%llu\n",Idx,m_KMerCntDist[Idx]);
+		if(BuffIdx + 100 > (int)sizeof(szBuff))
 			{
-			*pPacked = Packed;
-			pPacked += 1;
+			BuffIdx = write(hKMerDistFile,szBuff,BuffIdx);
+			BuffIdx = 0;
 			}
-		Packed = 0;
 		}
-	else
-		Packed <<= 2;
-	Packed |= *pKMerBase;
-	if(Idx == m_KMerSeqLen-1)
-		*pPacked = Packed;
-	KMerHash <<= 1;
-	KMerHash += *pKMerBase;
+	if(BuffIdx > 0)
+		BuffIdx = write(hKMerDistFile,szBuff,BuffIdx);
+#ifdef _WIN32
+	_commit(hKMerDistFile);
+#else
+	fsync(hKMerDistFile);
+#endif
+	close(hKMerDistFile);
 	}
-KMerHash &= cKMerSeqHashMask;
+return(eBSFSuccess);
+}
+
+int
+CArtefactReduce::ProcKMerDist(tsThreadKmerDistPars *pPars)
+{
+int Rslt;
+tSeqID StartingSeqID;
+tSeqID EndingSeqID;
+tSeqID SeqID;
+tSeqWrd4 *pSeq;
+UINT32 SeqLen;
+UINT32 NumProcessed;
+int TooMAnyWarnings;
 
-// check if this packed Kmer sequence has been previously processed
-pKMerWrd = NULL;
-AcquireSerialise();
-if (m_NumKMerSeqHashes && (NxtSeqInst = m_pKMerSeqHashes[KMerHash]) != 0)		// seen at least one sequence previously with same hash?
+gDiagnostics.DiagOut(eDLDebug,gszProcName,"Thread %d startup for K-mer counting...",pPars->ThreadIdx);
+NumProcessed = 0;
+TooMAnyWarnings = 0;
+Rslt = eBSFSuccess;
+time_t Started = time(0);
+while(!m_KMerCntOverflow && GetSeqProcRange(&StartingSeqID,&EndingSeqID,cMaxMultiSeqFlags) > 0)
 	{
-	do {
-		NxtSeqInstOfs = (size_t)((NxtSeqInst - 1) * (UINT64)m_KMerSeqInstSize);
-		pKMerSeqInst = (tsKMerSeqInst *)((UINT8 *)m_pKMerSeqs + NxtSeqInstOfs);
-		if((UINT32 *)pKMerSeqInst->PackedSeqs == (UINT32 *)PackedSeqs)	
+	for(SeqID = StartingSeqID; SeqID <= EndingSeqID; SeqID++)
+		{
+		NumProcessed += 1;
+		if(!(NumProcessed % 2000))
 			{
-			if(!memcmp(pKMerSeqInst->PackedSeqs,PackedSeqs,(m_KMerSeqLen + 3) / 4))
+			time_t Now = time(0);
+			unsigned long ElapsedSecs = (unsigned long) (Now - Started);
+			if(ElapsedSecs >= 30)
 				{
-				pKMerSeqInst->NumInstances += 1;
-				NumInstances = (int)pKMerSeqInst->NumInstances;
-				ReleaseSerialise();
-				return(NumInstances);
+				AcquireLock(true);
+				m_Sequences.NumProcessed += NumProcessed;
+				ReleaseLock(true);
+				NumProcessed = 0;
+				Started = Now;
 				}
 			}
+		if((pSeq = GetSeqHeader(SeqID,NULL,NULL,&SeqLen,false)) == NULL)
+			{
+			if((TooMAnyWarnings+=1) < 10)
+				gDiagnostics.DiagOut(eDLWarn,gszProcName,"Thread %d Couldn't find sequence header for known sequence %d...",pPars->ThreadIdx,SeqID);
+			continue;
+			}
+		if((Rslt = AddReadKMers(pPars,(int)SeqLen,pSeq)) < eBSFSuccess)
+			break;
+		pPars->TotNumReads += 1;
 		}
-	while ((NxtSeqInst = pKMerSeqInst->NxtSeq) != 0);
+	if(Rslt < eBSFSuccess)
+		break;
 	}
+if(Rslt >= eBSFSuccess)
+	Rslt = FlushLocalKMers(pPars);
+AcquireLock(true);
+m_Sequences.NumProcessed += NumProcessed;
+ReleaseLock(true);
+gDiagnostics.DiagOut(eDLDebug,gszProcName,"Thread %d K-mer counting completed",pPars->ThreadIdx);
+return(Rslt < eBSFSuccess ? Rslt : eBSFSuccess);
+}
 
-// must be the first instance of this Kmer
-if(m_UsedKMerSeqInsts >= cMaxKMerSeqInsts)
+// HashKMer
+// Hashes packed KMer, low cKMerCntPartitionBits bits are used as the partition, next bits as the slot index, and high 32 bits as the slot tag
+UINT64
+CArtefactReduce::HashKMer(int NumWrds,			// KMer is packed into this many words
+				UINT64 *pKMer)					// packed KMer
+{
+UINT64 Hash = 0x9e3779b97f4a7c15;
+while(NumWrds--)
 	{
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Too many unique KMer instances: %u",cMaxKMerSeqInsts);
-	return(eBSFerrMaxEntries);
+	Hash ^= *pKMer++;
+	Hash *= 0xff51afd7ed558ccd;
+	Hash ^= Hash >> 33;
 	}
+Hash *= 0xc4ceb9fe1a85ec53;
+Hash ^= Hash >> 33;
+return(Hash);
+}
+
+// AddReadKMers
+// Adds all KMers of length m_KMerSeqLen from the packed read which hash to a partition counted in the current pass
+// KMers are extracted directly from the packed read words and rolled 2 bits at a time through the packed forward KMer and,
+// if not strand specific, through the packed reverse complement KMer
+int									// returns number of KMers of length m_KMerSeqLen accepted from pRead and hashed to a partition in the current pass, < 0 if errors
+CArtefactReduce::AddReadKMers(tsThreadKmerDistPars *pPars,	// thread into which KMers are to be pre-aggregated
+				int ReadLen,			// number of bases in read
+				tSeqWrd4 *pRead)		// packed read sequence
+{
+int Rslt;
+int Idx;
+int WrdIdx;
+int NumWrds;
+int TopBits;
+int NumKMers;
+int PartIdx;
+UINT64 TopMsk;
+UINT64 Hash;
+UINT64 Base;
+UINT64 *pKMer;
+tSeqWrd4 SeqWrd;
+UINT64 FwdKMer[cMaxKMerCntWrds];
+UINT64 RevKMer[cMaxKMerCntWrds];
+
+if(ReadLen < m_KMerSeqLen)
+	return(0);
 
-// realloc memory as required to hold this new instance
-if(m_AllocdKMerSeqInsts >= m_UsedKMerSeqInsts)
+NumWrds = m_KMerCntWrds;
+TopBits = 2 * (m_KMerSeqLen - ((NumWrds - 1) * 32));		// bits used in the most significant word
+TopMsk = TopBits == 64 ? (UINT64)-1 : (((UINT64)1 << TopBits) - 1);
+memset(FwdKMer,0,sizeof(FwdKMer));
+memset(RevKMer,0,sizeof(RevKMer));
+NumKMers = 0;
+SeqWrd = 0;
+for(Idx = 0; Idx < ReadLen; Idx++)
 	{
-	tsKMerSeqInst *pAllocd;
-	UINT32 ReallocInstsTo;
-	ReallocInstsTo = min((size_t)(UINT64)m_AllocdKMerSeqInsts+cReallocKMerSeqInsts,cMaxKMerSeqInsts);
+	if(!(Idx % 15))
+		SeqWrd = *pRead++;
+	Base = (SeqWrd >> 28) & 0x03;
+	SeqWrd <<= 2;
+
+	for(WrdIdx = 0; WrdIdx < NumWrds - 1; WrdIdx++)
+		FwdKMer[WrdIdx] = (FwdKMer[WrdIdx] << 2) | (FwdKMer[WrdIdx+1] >> 62);
+	FwdKMer[NumWrds - 1] = (FwdKMer[NumWrds - 1] << 2) | Base;
+	FwdKMer[0] &= TopMsk;
+	if(!m_bKMerCntStrand)
+		{
+		for(WrdIdx = NumWrds - 1; WrdIdx > 0; WrdIdx--)
+			RevKMer[WrdIdx] = (RevKMer[WrdIdx] >> 2) | (RevKMer[WrdIdx-1] << 62);
+		RevKMer[0] = (RevKMer[0] >> 2) | ((0x03 - Base) << (TopBits - 2));
+		}
+	if(Idx + 1 < m_KMerSeqLen)
+		continue;
 
-	size_t memreq = ReallocInstsTo * (size_t)m_KMerSeqInstSize;
+	pKMer = FwdKMer;
+	if(!m_bKMerCntStrand)
+		{
+		for(WrdIdx = 0; WrdIdx < NumWrds - 1 && FwdKMer[WrdIdx] == RevKMer[WrdIdx]; WrdIdx++);
+		if(RevKMer[WrdIdx] < FwdKMer[WrdIdx])
+			pKMer = RevKMer;
+		}
+	Hash = HashKMer(NumWrds,pKMer);
+	PartIdx = (int)(Hash & (cKMerCntPartitions - 1));
+	if(PartIdx < m_KMerCntStartPart || PartIdx > m_KMerCntEndPart)
+		continue;
+	if((Rslt = AddLocalKMer(pPars,Hash,pKMer)) < eBSFSuccess)
+		return(Rslt);
+	NumKMers += 1;
+	}
+pPars->TotNumKMers += NumKMers;
+return(NumKMers);
+}
 
-#ifdef _WIN32
-	pAllocd = (tsKMerSeqInst *)realloc(m_pKMerSeqs, memreq);
-#else
-	pAllocd = (tsKMerSeqInst *)mremap(m_pKMerSeqs,m_AllocdKMerSeqInstsMem,memreq,MREMAP_MAYMOVE);
-	if(pAllocd == MAP_FAILED)
-		pAllocd = NULL;
-#endif
-	if(pAllocd == NULL)
+// AddLocalKMer
+// Pre-aggregates KMer counts into thread local open addressing table, flushing counts into the partition tables when half full
+int									// returns < 0 if errors, otherwise number of slots used in thread local table
+CArtefactReduce::AddLocalKMer(tsThreadKmerDistPars *pPars,	// pre-aggregate into this thread's local table
+				UINT64 Hash,			// KMer hash
+				UINT64 *pKMer)			// packed KMer
+{
+int Rslt;
+UINT32 Tag;
+UINT32 SlotIdx;
+tsKMerCntSlot *pSlot;
+
+Tag = (UINT32)(Hash >> 32) | 0x80000000;
+SlotIdx = (UINT32)(Hash >> cKMerCntPartitionBits) & (cKMerCntLocalSlots - 1);
+while(1)
+	{
+	pSlot = (tsKMerCntSlot *)&pPars->pLocalSlots[SlotIdx * m_KMerCntSlotSize];
+	if(pSlot->Tag == cKMerCntSlotEmpty)
+		break;
+	if(pSlot->Tag == Tag && !memcmp(pSlot->KMer,pKMer,m_KMerCntWrds * sizeof(UINT64)))
 		{
-		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Memory re-allocation to %d bytes - %s",memreq,strerror(errno));
-		ReleaseSerialise();
-		return(eBSFerrMem);
+		pSlot->Cnt += 1;
+		return(pPars->NumLocalSlots);
 		}
-	m_pKMerSeqs = pAllocd;
-	m_AllocdKMerSeqInstsMem = memreq;
-	m_AllocdKMerSeqInsts = ReallocInstsTo;
+	SlotIdx = (SlotIdx + 1) & (cKMerCntLocalSlots - 1);
 	}
+pSlot->Tag = Tag;
+pSlot->Cnt = 1;
+memcpy(pSlot->KMer,pKMer,m_KMerCntWrds * sizeof(UINT64));
+if((pPars->NumLocalSlots += 1) >= cKMerCntLocalFlush)
+	{
+	if((Rslt = FlushLocalKMers(pPars)) < eBSFSuccess)
+		return(Rslt);
+	}
+return(pPars->NumLocalSlots);
+}
 
-pNewKMerSeq = &m_pKMerSeqs[m_UsedKMerSeqInsts];
-pNewKMerSeq->NumInstances = 1;
-pNewKMerSeq->Flags = 0;
-pNewKMerSeq->NxtSeq = 0;
-memcpy(pNewKMerSeq->PackedSeqs,PackedSeqs,(m_KMerSeqLen + 3) / 4);
-if (pKMerSeqInst == NULL)
+// FlushLocalKMers
+// Adds all thread pre-aggregated counts into the partition tables and clears the thread local table
+int									// returns < 0 if errors, eBSFSuccess if all pre-aggregated counts flushed into partitions
+CArtefactReduce::FlushLocalKMers(tsThreadKmerDistPars *pPars)	// flush this thread's pre-aggregated counts
+{
+int SlotIdx;
+tsKMerCntSlot *pSlot;
+
+if(pPars->NumLocalSlots == 0)
+	return(eBSFSuccess);
+for(SlotIdx = 0; SlotIdx < cKMerCntLocalSlots; SlotIdx++)
 	{
-	 m_pKMerSeqHashes[KMerHash] = m_UsedKMerSeqInsts + 1;
-	 m_NumKMerSeqHashes += 1;
+	pSlot = (tsKMerCntSlot *)&pPars->pLocalSlots[SlotIdx * m_KMerCntSlotSize];
+	if(pSlot->Tag == cKMerCntSlotEmpty)
+		continue;
+	if(!AddPartKMer(HashKMer(m_KMerCntWrds,pSlot->KMer),pSlot->KMer,pSlot->Cnt))
+		break;					// partition overflowed, this pass will be repeated so no point in continuing
+	}
+memset(pPars->pLocalSlots,0,cKMerCntLocalSlots * m_KMerCntSlotSize);
+pPars->NumLocalSlots = 0;
+return(eBSFSuccess);
+}
+
+// AddPartKMer
+// Adds KMer count into the partition table without locking
+// An empty slot is claimed by atomically exchanging its tag with cKMerCntSlotClaimed, the KMer and count are then written and only then is the tag set
+// so any other thread probing a claimed slot waits for the tag to be set before comparing KMers; counts are atomically incremented
+bool								// false if partition has overflowed
+CArtefactReduce::AddPartKMer(UINT64 Hash,		// KMer hash
+				UINT64 *pKMer,			// packed KMer
+				UINT32 Cnt)				// add this many instances
+{
+UINT32 Tag;
+UINT32 CurTag;
+UINT64 SlotIdx;
+tsKMerCntSlot *pSlot;
+tsKMerCntPartition *pPart;
+
+if(m_KMerCntOverflow)
+	return(false);
+pPart = &m_KMerCntParts[Hash & (cKMerCntPartitions - 1)];
+Tag = (UINT32)(Hash >> 32) | 0x80000000;
+SlotIdx = (Hash >> cKMerCntPartitionBits) & (pPart->NumSlots - 1);
+while(1)
+	{
+	pSlot = (tsKMerCntSlot *)&pPart->pSlots[SlotIdx * m_KMerCntSlotSize];
+	if((CurTag = *(volatile UINT32 *)&pSlot->Tag) == cKMerCntSlotEmpty)
+		{
+		if(pPart->NumUsedSlots >= pPart->MaxUsedSlots)
+			{
+			m_KMerCntOverflow = 1;
+			return(false);
+			}
+#ifdef _WIN32
+		if(InterlockedCompareExchange((volatile LONG *)&pSlot->Tag,cKMerCntSlotClaimed,cKMerCntSlotEmpty) != cKMerCntSlotEmpty)
+#else
+		if(__sync_val_compare_and_swap(&pSlot->Tag,cKMerCntSlotEmpty,cKMerCntSlotClaimed) != cKMerCntSlotEmpty)
+#endif
+			continue;			// another thread claimed slot so retry
+		memcpy(pSlot->KMer,pKMer,m_KMerCntWrds * sizeof(UINT64));
+		pSlot->Cnt = Cnt;
+#ifdef _WIN32
+		InterlockedIncrement64((volatile LONG64 *)&pPart->NumUsedSlots);
+		MemoryBarrier();
+#else
+		__sync_fetch_and_add(&pPart->NumUsedSlots,1);
+		__sync_synchronize();
+#endif
+		*(volatile UINT32 *)&pSlot->Tag = Tag;
+		return(true);
+		}
+	while(CurTag == cKMerCntSlotClaimed)			// KMer still being written into slot by another thread
+		CurTag = *(volatile UINT32 *)&pSlot->Tag;
+	if(CurTag == Tag && !memcmp(pSlot->KMer,pKMer,m_KMerCntWrds * sizeof(UINT64)))
+		{
+#ifdef _WIN32
+		InterlockedExchangeAdd((volatile LONG *)&pSlot->Cnt,(LONG)Cnt);
+#else
+		__sync_fetch_and_add(&pSlot->Cnt,Cnt);
+#endif
+		return(true);
+		}
+	SlotIdx = (SlotIdx + 1) & (pPart->NumSlots - 1);
 	}
-else
-	pKMerSeqInst->NxtSeq = m_UsedKMerSeqInsts + 1;
-m_UsedKMerSeqInsts += 1;
-ReleaseSerialise();
-return(1);
 }
 
 
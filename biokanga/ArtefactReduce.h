@@ -2,13 +2,22 @@
 
 const int cMinKMerDistLen = 16;		// minimum allowed length KMer length processed when analysing Kmer distributions in read sequences	
 const int cMaxKMerDistLen = 256;	// max allowed length KMer length 
+const int cDfltKMerDistLen = 25;	// default KMer length when generating KMer count distributions
 
-const size_t cInitAllocKMerSeqInsts = 10000000;						// initially allocate to hold this many KMer sequence instances
-const size_t cReallocKMerSeqInsts = (cInitAllocKMerSeqInsts/2);		// then extend as may be required by this many instances
-const size_t cMaxKMerSeqInsts = 0xfffffff0;							// subject to available memory, can process at most this many unique KMer sequence instances
+const int cMaxKMerCntWrds = (cMaxKMerDistLen + 31) / 32;			// KMers are packed 32 bases per UINT64 so require at most this many words
 
-const UINT32 cKMerSeqHashMask =    0x0fffff;						// hashing mask (cMaxKMerSeqHashArrayEntries - 1)
-const UINT32 cMaxKMerSeqHashArrayEntries = (cKMerSeqHashMask + 1);  // alloc hash array to hold this many entries, must be at least 1 + maximal sized sized hash
+const int cKMerCntPartitionBits = 8;								// KMers are hash partitioned over 2^cKMerCntPartitionBits partitions
+const int cKMerCntPartitions = (1 << cKMerCntPartitionBits);		// number of KMer count partitions
+const UINT64 cMinKMerCntPartSlots = 0x1000;							// partition open addressing tables have at least this many slots (must be power of 2)
+const size_t cDfltKMerCntMem = ((size_t)4096 * 1024 * 1024);		// by default partition tables counted in any single pass are limited to this much memory
+
+const int cKMerCntLocalSlots = 0x1000;								// each thread pre-aggregates KMer counts into a cache resident table with this many slots (must be power of 2)
+const int cKMerCntLocalFlush = (cKMerCntLocalSlots / 2);			// pre-aggregated counts are flushed into partitions when this many local slots have been used
+
+const UINT32 cKMerCntSlotEmpty = 0;									// slot tag if slot is unused
+const UINT32 cKMerCntSlotClaimed = 1;								// slot tag if slot has been claimed and the KMer is still being written
+
+const int cMaxKMerCntDist = 10000;									// KMer count distributions are binned up to this many instances, last bin also accumulates any higher counts
 
 const size_t cWorkThreadStackSize = (1024*1024*2);					// working threads (can be multiple) stack size
 
@@ -65,12 +74,11 @@ typedef struct TAG_sThreadIdentDuplicatePars {
 } tsThreadIdentDuplicatePars;
 
 
-typedef struct TAG_sKMerSeqInst {
-	UINT32 NxtSeq;				// offset (multiply by m_KMerSeqInstSize ) into m_pKMerSeqs[] at which next KMer sequence with same hash starts or 0 if no same hashed KMer 
-	UINT32 NumInstances;		// number of instances of this KMer
-	UINT8 Flags:8;				// to hold sundry flags
-	UINT8 PackedSeqs[1];		// to contain the packed m_KMerSeqLen sequence, packed at 4 bases per byte 
-	} tsKMerSeqInst;
+typedef struct TAG_sKMerCntSlot {
+	UINT32 Tag;					// cKMerCntSlotEmpty, cKMerCntSlotClaimed, or high 32 bits of KMer hash with bit 31 set
+	UINT32 Cnt;					// number of instances of this KMer
+	UINT64 KMer[1];				// KMer packed 2 bits per base into m_KMerCntWrds words, 5' base in the most significant used bits of KMer[0]
+	} tsKMerCntSlot;
 
 typedef struct TAG_sThreadKmerDistPars {
 	int ThreadIdx;					// index of this thread (1..m_NumThreads)
@@ -85,6 +93,9 @@ typedef struct TAG_sThreadKmerDistPars {
 	int Rslt;						// returned result code
 	int KMerLen;					// KMer length
 	INT64 TotNumReads;				// total number of reads processed by this thread
+	INT64 TotNumKMers;				// total number of KMers counted by this thread
+	int NumLocalSlots;				// number of slots currently used in pLocalSlots
+	UINT8 *pLocalSlots;				// cKMerCntLocalSlots slots into which this thread pre-aggregates KMer counts
 } tsThreadKmerDistPars;
 
 
@@ -121,6 +132,13 @@ typedef struct TAG_sThreadIdentOverlapPars {
 
 #pragma pack()
 
+typedef struct TAG_sKMerCntPartition {
+	UINT64 NumSlots;			// open addressing table has this many slots (power of 2)
+	UINT64 MaxUsedSlots;		// partition has overflowed if more than this many slots would be used
+	volatile UINT64 NumUsedSlots;	// currently this many slots are used
+	UINT8 *pSlots;				// partition table slots, each of m_KMerCntSlotSize bytes
+	} tsKMerCntPartition;
+
 class CArtefactReduce : public CKangadna
 {
 
@@ -131,14 +149,16 @@ class CArtefactReduce : public CKangadna
 	int m_LoadedMaxSeqLen;			// max length of any read loaded post contaminate filtering and flank trimming 
 
 	int m_KMerSeqLen;				// current KMer sequence length
-	int m_KMerSeqInstSize;			// size of a complete tsKMerSeqInst containing m_KMerSeqLen bases
-	int m_NumKMerSeqHashes;			// number of hashes currently used in m_pKMerSeqHashes
-	UINT32 *m_pKMerSeqHashes;		// array, indexed by hashes over KMerSeq sequences, holding offsets (mult by m_KMerSeqInstSize) into packed m_pKMerSeqs at which KMer sequence instance starts 
-
-	UINT32 m_UsedKMerSeqInsts;		// this many KMer tsKMerSeqInst instances have been used 
-	UINT32 m_AllocdKMerSeqInsts;	// allocation was for this many KMer tsKMerSeqInst instances
-	size_t m_AllocdKMerSeqInstsMem;	// allocation was for this size
-	tsKMerSeqInst *m_pKMerSeqs;		// allocated to hold tsKMerSeqInst instances
+	int m_KMerCntWrds;				// KMers are packed into this many UINT64 words
+	int m_KMerCntSlotSize;			// size of a tsKMerCntSlot containing m_KMerCntWrds words
+	bool m_bKMerCntStrand;			// if false then the canonical KMer (lower of KMer and its reverse complement) is counted
+	int m_KMerCntStartPart;			// current pass is counting KMers hashed to partitions m_KMerCntStartPart..m_KMerCntEndPart inclusive
+	int m_KMerCntEndPart;
+	volatile UINT32 m_KMerCntOverflow;	// set non-zero if any partition in the current pass has overflowed
+	size_t m_AllocdKMerCntMem;		// allocation size for m_pKMerCntSlots
+	UINT8 *m_pKMerCntSlots;			// allocated to hold the slots for all partitions counted in the current pass
+	tsKMerCntPartition m_KMerCntParts[cKMerCntPartitions];	// KMer count partitions
+	UINT64 m_KMerCntDist[cMaxKMerCntDist+1];	// number of distinct KMers having each number of instances
 
 	int
 		RemoveDuplicates(bool bPEdups,			// can optionally request that duplicates are for both PE1 and PE2 being duplicates
@@ -149,12 +169,29 @@ class CArtefactReduce : public CKangadna
 						int MinFlankLen,            // minimum required non-overlap flank (in bp)
 						int NumIterations = 1); 	// because of artefact errors tending to be at end of reads (both 5' and 3') then by default 1 iterations of passes are utilised 
 
-	int									// returns number of KMers of length m_KMerSeqLen accepted from pRead, 0 if none, < 0 if errors
-		AddReadKMers(int ReadLen,		// number of bases in read
-				etSeqBase *pRead);			// read sequence
+	void FreeKMerCnts(void);			// free memory allocated for KMer counting
+
+	static UINT64						// returned hash
+		HashKMer(int NumWrds,			// KMer is packed into this many words
+				UINT64 *pKMer);			// packed KMer
 
-	int									 // returns < 0 if errors, 1 if this is the first instance of the KMer sequence, 2..N if multiple instances previously added
-		AddReadKMer(etSeqBase *pKMerSeq);	// KMer bases, expected to be of at least length m_KMerSeqLen
+	int									// returns number of KMers of length m_KMerSeqLen accepted from pRead and hashed to a partition in the current pass, < 0 if errors
+		AddReadKMers(tsThreadKmerDistPars *pPars,	// thread into which KMers are to be pre-aggregated
+				int ReadLen,			// number of bases in read
+				tSeqWrd4 *pRead);		// packed read sequence
+
+	int									// returns < 0 if errors, otherwise number of slots used in thread local table
+		AddLocalKMer(tsThreadKmerDistPars *pPars,	// pre-aggregate into this thread's local table
+				UINT64 Hash,			// KMer hash
+				UINT64 *pKMer);			// packed KMer
+
+	int									// returns < 0 if errors, eBSFSuccess if all pre-aggregated counts flushed into partitions
+		FlushLocalKMers(tsThreadKmerDistPars *pPars);	// flush this thread's pre-aggregated counts
+
+	bool								// false if partition has overflowed
+		AddPartKMer(UINT64 Hash,		// KMer hash
+				UINT64 *pKMer,			// packed KMer
+				UINT32 Cnt);			// add this many instances
 
 public:
 	CArtefactReduce(void);
@@ -189,7 +226,9 @@ public:
 			char *pszInPE2files[],		    // input PE2 3' read files
 			char *pszContaminantFile,		// contaminants fasta file
 			char *pszOutFile,				// where to write filtered sequences
-			char *pszDupDistFile);			// write duplicate sequence distributions to this file
+			char *pszDupDistFile,			// write duplicate sequence distributions to this file
+			int KMerDistLen,				// K-mer length used when generating K-mer count distributions
+			char *pszKMerDistFile);			// if not NULL or empty then write K-mer count distribution to this file
 
 	int
 		IdentifyDuplicates(bool bPEdups,			// request that duplicates are for both PE1 and PE2 being duplicates
@@ -208,6 +247,14 @@ public:
 
 	int ProcIdentOverlaps(tsThreadIdentOverlapPars *pPars);
 
+	int
+		GenKMerDist(int KMerLen,					// count KMers of this length (cMinKMerDistLen..cMaxKMerDistLen)
+					bool bStrand,					// if false then KMers and their reverse complements are counted as the same KMer
+					size_t MaxMem = cDfltKMerCntMem, // partition tables counted in any single pass are limited to this much memory
+					char *pszKMerDist = NULL);		// optionally write KMer count distribution to this file
+
+	int ProcKMerDist(tsThreadKmerDistPars *pPars);	// potentially called by multiple threads!
+
 
 };
 
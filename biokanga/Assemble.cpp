@@ -46,7 +46,8 @@ deNovoAssemble(etdeNovoPMode PMode,		// processing mode, currently either eAMEAs
 		int PE2SESteps,					// when less than this many steps remaining then treat PE1 and PE2 as individual SE sequences if excessive lengths (defaults to 2, set 0 to disable)");
 		int OrientatePE,				// PE end orientations 0: sense/antisense, 1: sense/sense, 2: antisense/sense, 3: antisense/antisense 
 		int NumThreads,					// number of worker threads to use
-		bool bAffinity,					// thread to core affinity
+		bool bAffinity,					// bind threads round robin to NUMA nodes and interleave sequences over all nodes
+		int Checkpoint,					// 0: no checkpoints, 1: checkpoint at end of each pass, 2: resume from latest checkpoint and continue checkpointing
 		char *pszPE1File,				// optional input high confidence seed PE1 sequences file
 		char *pszPE2File,				// optional input high confidence seed PE2 sequences file
 		char *pszSeedContigsFile,		// optional input high confidence seed SE contigs file
@@ -73,7 +74,8 @@ int Rslt = 0;   			// function result code >= 0 represents success, < 0 on failu
 
 int NumberOfProcessors;		// number of installed CPUs
 int NumThreads;				// number of threads (0 defaults to number of CPUs)
-bool bAffinity;				// thread to core affinity
+bool bAffinity;				// bind threads round robin to NUMA nodes and interleave sequences over all nodes
+int Checkpoint;				// 0: no checkpoints, 1: checkpoint at end of each pass, 2: resume from latest checkpoint and continue checkpointing
 
 int PMode;					// processing mode, currently either eAMEAssemble (default), eAMESAssemble (stringent) or eAMQAssemble (quick)
 
@@ -165,6 +167,10 @@ struct arg_str *experimentname = arg_str0("w","experimentname","<str>",		"experi
 struct arg_str *experimentdescr = arg_str0("W","experimentdescr","<str>",	"experiment description SQLite3 database file");
 
 struct arg_int *threads = arg_int0("T","threads","<int>",		"number of processing threads 0..128 (defaults to 0 which sets threads to number of CPU cores)");
+struct arg_lit *numa = arg_lit0(NULL,"numa",					"bind processing threads round robin to NUMA nodes and interleave sequences and suffix array over all nodes (default is no NUMA placement)");
+
+struct arg_lit *checkpoint = arg_lit0(NULL,"checkpoint",		"checkpoint assembly to '<outfile>.ckpt' at the end of each pass (default is no checkpoints)");
+struct arg_lit *resume = arg_lit0(NULL,"resume",				"resume assembly from latest valid checkpoint, with same parameters as the checkpointed assembly, and continue checkpointing");
 
 struct arg_end *end = arg_end(200);
 
@@ -173,7 +179,7 @@ void *argtable[] = {help,version,FileLogLevel,LogFile,
 					initseovlp,finseovlp,initpeovlp,finpeovlp,minpe2seovlp,pe2sesteps,
 					orientatepe,inpe1file,inpe2file,seedcontigsfile,inartreducfile,outfile,
 					summrslts,experimentname,experimentdescr,
-					threads,
+					threads,numa,checkpoint,resume,
 					end};
 
 char **pAllArgs;
@@ -645,9 +651,7 @@ if (!argerrors)
 	SYSTEM_INFO SystemInfo;
 	GetSystemInfo(&SystemInfo);
 	NumberOfProcessors = SystemInfo.dwNumberOfProcessors;
-	bAffinity = false;
 #else
-	bAffinity = false;
 	NumberOfProcessors = sysconf(_SC_NPROCESSORS_ONLN);
 #endif
 	int MaxAllowedThreads = min(cMaxWorkerThreads,NumberOfProcessors);	// limit to be at most cMaxWorkerThreads
@@ -660,46 +664,8 @@ if (!argerrors)
 		NumThreads = MaxAllowedThreads;
 		}
 
-	if(bAffinity)
-		{
-		// try and set thread affinities
-#ifndef _WIN32
-		int AffinityIdx;
-		int CoresPerCPU;		
-		int ReqAffinity;
-		int ReqCores = NumThreads;
-		pthread_t Me = pthread_self(); 
-		cpu_set_t CurCpuSet;
-		cpu_set_t NewCpuSet;
-		CPU_ZERO(&NewCpuSet);
-		pthread_getaffinity_np(Me, sizeof(CurCpuSet), &CurCpuSet);		// get current affinity set
-		CoresPerCPU = 0;
-		for(AffinityIdx=0; AffinityIdx < CPU_SETSIZE; AffinityIdx++)	// determine number of CPUs to which affinity is enabled
-			{
-			if(CPU_ISSET(AffinityIdx,&CurCpuSet))
-				CoresPerCPU += 1;
-			}
-		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Info: %d CPUs (%d cores) available",CoresPerCPU, NumberOfProcessors);
-		// number of CPUs with affinity known, estimate cores per CPU
-
-		CoresPerCPU = NumberOfProcessors/CoresPerCPU;
-	
-		// now cores per CPU has been guestimated then try and set affinity for CPU's
-		ReqAffinity = 0;
-		for(AffinityIdx=0; AffinityIdx < CPU_SETSIZE; AffinityIdx++)
-			{
-			if(CPU_ISSET(AffinityIdx,&CurCpuSet))
-				{
-				CPU_SET(AffinityIdx,&NewCpuSet);
-				ReqCores -= CoresPerCPU;
-				ReqAffinity += 1;
-				if(ReqCores < 1)
-					break;
-				}
-			}
-		pthread_setaffinity_np(Me,sizeof(NewCpuSet), &NewCpuSet);
-#endif
-		}
+	bAffinity = numa->count ? true : false;
+	Checkpoint = resume->count ? 2 : checkpoint->count ? 1 : 0;
 
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing parameters:");
 	const char *pszDescr;
@@ -786,6 +752,8 @@ if (!argerrors)
 		gDiagnostics.DiagOutMsgOnly(eDLInfo,"This processing reference: %s",szExperimentName);
 
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Number of threads : %d",NumThreads);
+	gDiagnostics.DiagOutMsgOnly(eDLInfo,"NUMA placement : %s",bAffinity ? "Yes" : "No");
+	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Checkpoints : %s",Checkpoint == 2 ? "Resume from latest checkpoint" : Checkpoint == 1 ? "Yes" : "No");
 
 	if(gExperimentID > 0)
 		{
@@ -827,6 +795,8 @@ if (!argerrors)
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szOutFile),"out",szOutFile);
 
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(NumThreads),"threads",&NumThreads);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTBool,sizeof(bAffinity),"numa",&bAffinity);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(Checkpoint),"checkpoint",&Checkpoint);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(NumberOfProcessors),"cpus",&NumberOfProcessors);
 
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szSQLiteDatabase),"sumrslts",szSQLiteDatabase);
@@ -839,7 +809,7 @@ if (!argerrors)
 #endif
 	gStopWatch.Start();
 	Rslt = deNovoAssemble((etdeNovoPMode)PMode,TrimEnds,MinSeqLen,TrimPE2SE,AllowSE2PE == 0 ? false : true,SenseStrandOnly ? true : false,SingleEnded ? true : false,MaxPasses,PassThres,NReduceThresSteps,Subs100bp,End12Subs,
-							InitSEOvlp,FinSEOvlp,InitPEOvlp,FinPEOvlp,MinPE2SEOvlp,PE2SESteps,OrientatePE,NumThreads,bAffinity,szPE1File,szPE2File,szSeedContigsFile,szInArtReducfile,szOutFile);
+							InitSEOvlp,FinSEOvlp,InitPEOvlp,FinPEOvlp,MinPE2SEOvlp,PE2SESteps,OrientatePE,NumThreads,bAffinity,Checkpoint,szPE1File,szPE2File,szSeedContigsFile,szInArtReducfile,szOutFile);
 	Rslt = Rslt >=0 ? 0 : 1;
 	if(gExperimentID > 0)
 		{
@@ -881,7 +851,8 @@ deNovoAssemble(etdeNovoPMode PMode,			// processing mode, currently either eAMEA
 		int PE2SESteps,						// when less than this many steps remaining then treat PE1 and PE2 as individual SE sequences if excessive lengths (defaults to 2, set 0 to disable)");
 		int OrientatePE,					// PE end orientations 0: sense/antisense, 1: sense/sense, 2: antisense/sense, 3: antisense/antisense 
 		int NumThreads,						// number of worker threads to use
-		bool bAffinity,						// thread to core affinity
+		bool bAffinity,						// bind threads round robin to NUMA nodes and interleave sequences over all nodes
+		int Checkpoint,						// 0: no checkpoints, 1: checkpoint at end of each pass, 2: resume from latest checkpoint and continue checkpointing
 		char *pszPE1File,					// optional input high confidence seed PE1 sequences file
 		char *pszPE2File,					// optional input high confidence seed PE2 sequences file
 		char *pszSeedContigsFile,			// optional input high confidence seed SE contigs file
@@ -961,7 +932,7 @@ if(pszInArtReducfile == NULL || pszInArtReducfile[0] == '\0')
 
 if((Rslt = pAssemble->AssembReads(PMode,TrimEnds,MinSeqLen,TrimPE2SE,bSenseStrandOnly,bAllowSE2PE,bSingleEnded,MaxPasses,PassThres,NReduceThresSteps,Subs100bp * 10,MaxEnd12Subs,
 									InitSEOvlp,FinSEOvlp,InitPEOvlp,FinPEOvlp,MinPE2SEOvlp,PE2SESteps,
-									OrientatePE,pszPE1File,pszPE2File,pszSeedContigsFile,pszInArtReducfile,pszOutFile)) < eBSFSuccess)
+									OrientatePE,pszPE1File,pszPE2File,pszSeedContigsFile,pszInArtReducfile,pszOutFile,Checkpoint)) < eBSFSuccess)
 	return(Rslt);
 
 // write out sequences here
@@ -2559,7 +2559,7 @@ m_bAllQuerySeqsLoaded = false;
 m_LoadQuerySeqsRslt = eBSFSuccess;		// presumed success, changed if any processing errors
 ReleaseLock(true);
 
-if((Rslt=Fasta.Open(m_pszInputFile,true))!=eBSFSuccess)
+if((Rslt=Fasta.Open(m_pszInputFile,true,cDfltStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	if(Rslt != eBSFerrNotFasta)
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"ProcLoadQuerySeqsFile: Unable to open '%s' [%s] %s",m_pszInputFile,Fasta.ErrText((teBSFrsltCodes)Rslt),Fasta.GetErrMsg());
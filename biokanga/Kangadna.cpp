@@ -37,6 +37,7 @@ m_pPartialSeqs2Assemb = NULL;
 m_pAcceptLevDist = NULL; 
 m_pBlockNsLoci = NULL;
 memset(&m_Sequences,0,sizeof(m_Sequences));
+memset(&m_AltSfx,0,sizeof(m_AltSfx));
 m_pszLineBuff = NULL;
 m_hInFile = -1;
 m_hOutFile = -1;
@@ -280,6 +281,17 @@ if(m_Sequences.pSuffixArray != NULL)
 #endif	
 	m_Sequences.pSuffixArray = NULL;
 	}
+if(m_AltSfx.pSuffixArray != NULL)
+	{
+#ifdef _WIN32
+	free(m_AltSfx.pSuffixArray);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
+#else
+	if(m_AltSfx.pSuffixArray != MAP_FAILED)
+		munmap(m_AltSfx.pSuffixArray,m_AltSfx.AllocMemSfx);
+#endif	
+	m_AltSfx.pSuffixArray = NULL;
+	}
+memset(&m_AltSfx,0,sizeof(m_AltSfx));
 
 if(m_Sequences.pSeqs2Assemb != NULL)
 	{
@@ -328,11 +340,33 @@ if(maxThreads < 0 || maxThreads > cMaxWorkerThreads)
 		return(eBSFerrParams);
 m_NumThreads = maxThreads;
 m_bAffinity = bAffinity;
+if(m_bAffinity)
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"NUMA placement: threads will be bound round robin over %d NUMA nodes, sequences and suffix array interleaved over all nodes",m_NUMA.Discover());
 m_MTqsort.SetMaxThreads(maxThreads);
 CreateMutexes();
 return(eBSFSuccess);
 }
 
+void
+CKangadna::BindThreadToNUMANode(int ThreadIdx)	// if NUMA placement then bind calling thread (1..m_NumThreads) to it's round robin allocated node
+{
+int NodeIdx;
+if(!m_bAffinity)
+	return;
+NodeIdx = m_NUMA.NodeForThread(ThreadIdx - 1);
+if(m_NUMA.BindThreadToNode(NodeIdx) != eBSFSuccess)
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"BindThreadToNUMANode: Unable to bind thread %d to NUMA node %d",ThreadIdx,m_NUMA.NodeID(NodeIdx));
+}
+
+void
+CKangadna::InterleaveNUMA(void *pMem,size_t MemLen)	// if NUMA placement then interleave pages of pMem over all nodes
+{
+if(!m_bAffinity || pMem == NULL)
+	return;
+if(m_NUMA.InterleaveMem(pMem,MemLen) != eBSFSuccess)
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"InterleaveNUMA: Unable to interleave %llu bytes over %d NUMA nodes",(UINT64)MemLen,m_NUMA.NumNodes());
+}
+
 void
 CKangadna::SetDedupePE(bool bDedupeIndependent)		// dedupe policy on paired ends
 {
@@ -361,6 +395,17 @@ if(m_Sequences.pSuffixArray != NULL)
 	}
 m_Sequences.NumSuffixEls = 0;			// number of elements in suffix array
 m_Sequences.AllocMemSfx = 0;				// allocated memory size for suffix array
+if(m_AltSfx.pSuffixArray != NULL)
+	{
+#ifdef _WIN32
+	free(m_AltSfx.pSuffixArray);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
+#else
+	if(m_AltSfx.pSuffixArray != MAP_FAILED)
+		munmap(m_AltSfx.pSuffixArray,m_AltSfx.AllocMemSfx);
+#endif	
+	m_AltSfx.pSuffixArray = NULL;
+	}
+memset(&m_AltSfx,0,sizeof(m_AltSfx));
 return(eBSFSuccess);
 }
 
@@ -1035,6 +1080,7 @@ if(CurWorkSetSize != m_CurMaxMemWorkSetBytes)
 m_Sequences.AllocMemSeqStarts = 0;
 m_Sequences.AllocMemSeqs2Assemb = 0;
 m_Sequences.AllocMemSfx = 0;
+m_Sequences.pTmpRevCplSeqs = NULL;
 m_Sequences.pSeqStarts = NULL;
 m_Sequences.pSeqs2Assemb = NULL;
 m_Sequences.pSuffixArray = NULL;
@@ -1222,6 +1268,7 @@ if(m_Sequences.pSeqs2Assemb == NULL)
 		return(eBSFerrMem);
 		}
 #endif
+	InterleaveNUMA(m_Sequences.pSeqs2Assemb,(size_t)m_Sequences.AllocMemSeqs2Assemb);
 	}
 
 memset(m_Sequences.pSeqs2Assemb,0,(size_t)m_Sequences.AllocMemSeqs2Assemb);	// commits the memory!
@@ -1451,6 +1498,7 @@ void * ThreadedFiltReads(void * pThreadPars)
 int Rslt = 0;
 tsThreadFiltReadsPars *pPars = (tsThreadFiltReadsPars *)pThreadPars; // makes it easier not having to deal with casts!
 CKangadna *pThis = (CKangadna *)pPars->pThis;
+pThis->BindThreadToNUMANode(pPars->ThreadIdx);
 Rslt = pThis->ProcReadsThread(pPars);
 pPars->Rslt = Rslt;
 #ifdef _WIN32
@@ -2053,7 +2101,7 @@ if((Rslt=(teBSFrsltCodes)FastaPE1.FastaEstSizes(pszPE1File,NULL,NULL,NULL,NULL,N
 	return(Rslt);
 	}
 
-if((Rslt=(teBSFrsltCodes)FastaPE1.Open(pszPE1File,true,cMaxStageBuffSize))!=eBSFSuccess)
+if((Rslt=(teBSFrsltCodes)FastaPE1.Open(pszPE1File,true,cMaxStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadRawReads: Unable to open '%s' [%s] %s",pszPE1File,FastaPE1.ErrText((teBSFrsltCodes)Rslt),FastaPE1.GetErrMsg());
 	delete pFiltReadsPars;
@@ -2082,7 +2130,7 @@ if(m_Sequences.bPESeqs)
 		return(Rslt);
 		}
 
-	if((Rslt=(teBSFrsltCodes)FastaPE2.Open(pszPE2File,true,cMaxStageBuffSize))!=eBSFSuccess)
+	if((Rslt=(teBSFrsltCodes)FastaPE2.Open(pszPE2File,true,cMaxStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 		{
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadRawReads: Unable to open '%s' [%s] %s",pszPE2File,FastaPE2.ErrText((teBSFrsltCodes)Rslt),FastaPE2.GetErrMsg());
 		delete pFiltReadsPars;
@@ -2530,7 +2578,7 @@ if((Rslt=(teBSFrsltCodes)FastaPE1.FastaEstSizes(pszPE1File,NULL,NULL,NULL,NULL,N
 	return(Rslt);
 	}
 
-if((Rslt=(teBSFrsltCodes)FastaPE1.Open(pszPE1File,true,cMaxStageBuffSize))!=eBSFSuccess)
+if((Rslt=(teBSFrsltCodes)FastaPE1.Open(pszPE1File,true,cMaxStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadRawReads: Unable to open '%s' [%s] %s",pszPE1File,FastaPE1.ErrText((teBSFrsltCodes)Rslt),FastaPE1.GetErrMsg());
 	delete pPE1RawReadsBuff;
@@ -2570,7 +2618,7 @@ if(m_Sequences.bPESeqs)
 		return(Rslt);
 		}
 
-	if((Rslt=(teBSFrsltCodes)FastaPE2.Open(pszPE2File,true,cMaxStageBuffSize))!=eBSFSuccess)
+	if((Rslt=(teBSFrsltCodes)FastaPE2.Open(pszPE2File,true,cMaxStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 		{
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadRawReads: Unable to open '%s' [%s] %s",pszPE2File,FastaPE2.ErrText((teBSFrsltCodes)Rslt),FastaPE2.GetErrMsg());
 		FastaPE1.Close();
@@ -3250,7 +3298,7 @@ if((pPE2RawReadsBuff = new UINT8 [cMaxRawSeqLen+16]) == NULL)				// 16 as a smal
 	return(eBSFerrMem);
 	}
 
-if((Rslt=(teBSFrsltCodes)FastaPE1.Open(pszPE1File,true,cMaxStageBuffSize))!=eBSFSuccess)
+if((Rslt=(teBSFrsltCodes)FastaPE1.Open(pszPE1File,true,cMaxStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadSeedPEs: Unable to open '%s' [%s] %s",pszPE1File,FastaPE1.ErrText((teBSFrsltCodes)Rslt),FastaPE1.GetErrMsg());
 	delete pPE1RawReadsBuff;
@@ -3271,7 +3319,7 @@ if(FastaPE1.IsSOLiD())
 	}
 bIsPE1Fastq = FastaPE1.IsFastq();
 
-if((Rslt=(teBSFrsltCodes)FastaPE2.Open(pszPE2File,true,cMaxStageBuffSize))!=eBSFSuccess)
+if((Rslt=(teBSFrsltCodes)FastaPE2.Open(pszPE2File,true,cMaxStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadSeedPEs: Unable to open '%s' [%s] %s",pszPE2File,FastaPE2.ErrText((teBSFrsltCodes)Rslt),FastaPE2.GetErrMsg());
 	FastaPE1.Close();
@@ -3676,7 +3724,7 @@ if((pRawContigsBuff = new UINT8 [cMaxRawSeqLen+16]) == NULL)					// 16 as a smal
 	return(eBSFerrMem);
 	}
 
-if((Rslt=(teBSFrsltCodes)Fasta.Open(pszContigsFile,true,cMaxStageBuffSize))!=eBSFSuccess)
+if((Rslt=(teBSFrsltCodes)Fasta.Open(pszContigsFile,true,cMaxStageBuffSize,cDfltFastaBlocks,m_NumThreads))!=eBSFSuccess)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"LoadSeedContigs: Unable to open '%s' [%s] %s",pszContigsFile,Fasta.ErrText((teBSFrsltCodes)Rslt),Fasta.GetErrMsg());
 	delete pRawContigsBuff;
@@ -6273,6 +6321,7 @@ if(m_Sequences.pSeqStarts == NULL || m_Sequences.AllocMemSeqStarts == 0)
 		return(eBSFerrMem);
 		}
 #endif
+	InterleaveNUMA(m_Sequences.pSeqStarts,(size_t)m_Sequences.AllocMemSeqStarts);
 	memset(m_Sequences.pSeqStarts,0,(size_t)m_Sequences.AllocMemSeqStarts); // commits the memory!
 	m_Sequences.NumSeqStarts = 0;
 	UINT64 CurWorkSetSize = 0;
@@ -6329,6 +6378,7 @@ if(bGenFlags)
 			return(eBSFerrMem);
 			}
 #endif
+		InterleaveNUMA(m_Sequences.pSeqFlags,(size_t)m_Sequences.AllocMemSeqFlags);
 		memset(m_Sequences.pSeqFlags,0,(size_t)m_Sequences.AllocMemSeqFlags); // commits the memory!
 		m_Sequences.NumSeqFlags = 0;
 		UINT64 CurWorkSetSize = 0;
@@ -6506,6 +6556,7 @@ if(m_Sequences.pSuffixArray == NULL || m_Sequences.AllocMemSfx == 0)
 		return(eBSFerrMem);
 		}
 #endif
+	InterleaveNUMA(m_Sequences.pSuffixArray,(size_t)m_Sequences.AllocMemSfx);
 	memset(m_Sequences.pSuffixArray,0,(size_t)m_Sequences.AllocMemSfx); // commits the memory!
 
 	UINT64 CurWorkSetSize = 0;
@@ -6637,6 +6688,280 @@ gDiagnostics.DiagOut(eDLDiag,gszProcName,"GenRdsSfx: Suffix array generation com
 return(eBSFSuccess);
 }
 
+// ExchangeRdsSfx
+// Exchanges the current suffix array with the alternate suffix array so that suffix arrays over both sense and reverse complemented
+// sequences can be retained between assembly passes
+void
+CKangadna::ExchangeRdsSfx(void)
+{
+tsSfxArray TmpSfx;
+TmpSfx = m_AltSfx;
+m_AltSfx.SfxElSize = m_Sequences.SfxElSize;
+m_AltSfx.NumSuffixEls = m_Sequences.NumSuffixEls;
+m_AltSfx.AllocMemSfx = m_Sequences.AllocMemSfx;
+m_AltSfx.pSuffixArray = m_Sequences.pSuffixArray;
+m_Sequences.SfxElSize = TmpSfx.SfxElSize;
+m_Sequences.NumSuffixEls = TmpSfx.NumSuffixEls;
+m_Sequences.AllocMemSfx = TmpSfx.AllocMemSfx;
+m_Sequences.pSuffixArray = TmpSfx.pSuffixArray;
+}
+
+// RemapRdsSfx
+// After the concatenated sequences have been updated, e.g. following a merge pass, then the current suffix array is updated by
+// removing the suffixes of sequences not retained unchanged and relocating the suffixes of retained sequences to their updated offsets
+// Sequences retained unchanged must have been concatenated in the same relative order as previously so that the suffix array remains sorted
+// NOTE: m_Sequences.pSeqStarts and m_Sequences.pSeqFlags must be those generated when the suffix array was generated
+// NOTE: if bRevCpl then the suffix array was generated after PackedRevCplAllIncPEs() had exchanged PE1 and PE2 sequences, and
+//		 both sequences of any pair must have been retained unchanged for that pair to be retained
+INT64							// number of suffix elements retained in current suffix array, < 0 if errors
+CKangadna::RemapRdsSfx(bool bRevCpl,				// true if current suffix array was generated over the reverse complemented sequences (PE1 and PE2 exchanged)
+					UINT64 PrevSeqs2AssembOfs,		// sequences were concatenated to this offset when the suffix array was generated
+					UINT64 *pPrevToNewStarts)		// indexed by previous sequence identifier - 1, start offset of that sequence after concatenated sequences were updated or 0 if sequence not retained unchanged
+{
+UINT64 SfxIdx;
+UINT64 NumRetained;
+UINT64 SeqWrdIdx;
+UINT64 NewSeqWrdIdx;
+UINT64 PE2End;
+UINT64 PE1RevCplStart;
+UINT32 SeqIdx;
+UINT32 Lo;
+UINT32 Hi;
+UINT32 Mid;
+UINT32 NumSeqStarts;
+UINT64 *pSeqStarts;
+UINT16 *pSeqFlags;
+UINT8 *pArr5;
+UINT8 *pRetained5;
+UINT32 *pArr4;
+
+if(m_Sequences.pSuffixArray == NULL || pPrevToNewStarts == NULL || m_Sequences.pSeqStarts == NULL || m_Sequences.NumSeqStarts == 0 ||
+	(bRevCpl && (m_Sequences.pSeqFlags == NULL || m_Sequences.NumSeqFlags < m_Sequences.NumSeqStarts)))
+	return(eBSFerrInternal);
+
+pSeqStarts = m_Sequences.pSeqStarts;
+pSeqFlags = m_Sequences.pSeqFlags;
+NumSeqStarts = m_Sequences.NumSeqStarts;
+pArr4 = (UINT32 *)m_Sequences.pSuffixArray;
+pArr5 = (UINT8 *)m_Sequences.pSuffixArray;
+pRetained5 = pArr5;
+NumRetained = 0;
+for(SfxIdx = 0; SfxIdx < m_Sequences.NumSuffixEls; SfxIdx++)
+	{
+	if(m_Sequences.SfxElSize == 5)
+		SeqWrdIdx = Unpack5(&pArr5[SfxIdx * 5]);
+	else
+		SeqWrdIdx = pArr4[SfxIdx];
+
+	// locate the sequence whose start is the highest start <= SeqWrdIdx
+	Lo = 0;
+	Hi = NumSeqStarts - 1;
+	while(Lo < Hi)
+		{
+		Mid = Lo + ((Hi - Lo + 1) / 2);
+		if(pSeqStarts[Mid] <= SeqWrdIdx)
+			Lo = Mid;
+		else
+			Hi = Mid - 1;
+		}
+	SeqIdx = Lo;
+
+	if(!bRevCpl || !(pSeqFlags[SeqIdx] & cFlgSeqPE))
+		{
+		if((NewSeqWrdIdx = pPrevToNewStarts[SeqIdx]) == 0)
+			continue;
+		NewSeqWrdIdx += SeqWrdIdx - pSeqStarts[SeqIdx];
+		}
+	else
+		{
+		// pair occupies same offsets as when not reverse complemented, but with the PE2 sequence preceding the PE1 sequence
+		if(pSeqFlags[SeqIdx] & cFlgSeqPE2)
+			SeqIdx -= 1;
+		if(SeqIdx + 1 >= NumSeqStarts || pPrevToNewStarts[SeqIdx] == 0 || pPrevToNewStarts[SeqIdx+1] == 0)
+			continue;
+		PE2End = SeqIdx + 2 < NumSeqStarts ? pSeqStarts[SeqIdx+2] : PrevSeqs2AssembOfs;
+		PE1RevCplStart = pSeqStarts[SeqIdx] + (PE2End - pSeqStarts[SeqIdx+1]);
+		if(SeqWrdIdx >= PE1RevCplStart)			// suffix is in the PE1
+			NewSeqWrdIdx = pPrevToNewStarts[SeqIdx] + (PE2End - pSeqStarts[SeqIdx+1]) + (SeqWrdIdx - PE1RevCplStart);
+		else									// suffix is in the PE2
+			NewSeqWrdIdx = pPrevToNewStarts[SeqIdx] + (SeqWrdIdx - pSeqStarts[SeqIdx]);
+		}
+
+	if(m_Sequences.SfxElSize == 5)
+		pRetained5 = Pack5(NewSeqWrdIdx,pRetained5);
+	else
+		pArr4[NumRetained] = (UINT32)NewSeqWrdIdx;
+	NumRetained += 1;
+	}
+if(m_Sequences.SfxElSize == 5)
+	Pack5(0xffffffffff,pRetained5);
+else
+	pArr4[NumRetained] = 0xffffffff;
+m_Sequences.NumSuffixEls = NumRetained;
+return((INT64)NumRetained);
+}
+
+// MergeRdsSfx
+// Suffixes of the flagged sequences are sorted and then merged into the current suffix array, the current suffix array is expected to
+// contain suffixes for all other sequences as would have been indexed by GenRdsSfx() with the same FirstNSeqWrds and ExcludeLastNSeqWrds
+// Because suffixes with identical sequences are ordered by offset the merged suffix array is the same as if regenerated by GenRdsSfx()
+teBSFrsltCodes
+CKangadna::MergeRdsSfx(int FirstNSeqWrds, 			// max number of SeqWrds (0 to index all), starting from 1st, to index in each read sequence
+					int ExcludeLastNSeqWrds,		// exclude last N SeqWrds in each read sequence from indexing, 0 to index FirstNSeqWrds
+					UINT8 *pNewSeqs)				// indexed by sequence ordinal - 1, non-zero if that sequence is to have it's suffixes sorted and merged into current suffix array
+{
+UINT32 SeqIdx;
+UINT32 SeqFlags;
+UINT32 CurSeqLen;
+UINT32 NumSeqWrds;
+UINT32 NumIdxWrds;
+UINT32 WrdIdx;
+UINT64 SeqWrdIdx;
+UINT64 NumNewEls;
+UINT64 ReqAllocMem;
+UINT64 Idx;
+UINT64 RetainedIdx;
+UINT64 NewIdx;
+UINT64 RetainedWrdIdx;
+UINT64 NewWrdIdx;
+tSeqWrd4 *pSeqWrd;
+UINT8 *pNewEls;
+UINT8 *pArr5;
+UINT32 *pArr4;
+int ElSize;
+
+if(m_Sequences.pSuffixArray == NULL || pNewSeqs == NULL)
+	return(eBSFerrInternal);
+
+if(FirstNSeqWrds < 0)
+	FirstNSeqWrds = 0;
+if(ExcludeLastNSeqWrds < 0)
+	ExcludeLastNSeqWrds = 0;
+if(FirstNSeqWrds == 1)
+	ExcludeLastNSeqWrds = 0;
+ElSize = m_Sequences.SfxElSize;
+
+// iterate over sequences twice, firstly to determine the number of new suffix elements and then to generate these elements
+pNewEls = NULL;
+NumNewEls = 0;
+for(int Phase = 0; Phase < 2; Phase++)
+	{
+	pSeqWrd = (tSeqWrd4 *)m_Sequences.pSeqs2Assemb + 1;
+	SeqWrdIdx = 1;
+	Idx = 0;
+	for(SeqIdx = 0; SeqIdx < m_Sequences.NumSeqs2Assemb; SeqIdx++)
+		{
+		GetSeqHeader(pSeqWrd,NULL,NULL,&SeqFlags,&CurSeqLen,false);
+		NumSeqWrds = (CurSeqLen + 14) / 15;
+		if(pNewSeqs[SeqIdx])
+			{
+			NumIdxWrds = CurSeqLen / 15;				// only complete SeqWrds are indexed
+			if(FirstNSeqWrds && NumIdxWrds > (UINT32)FirstNSeqWrds)
+				NumIdxWrds = FirstNSeqWrds;
+			if(ExcludeLastNSeqWrds && NumIdxWrds > max(1,(int)NumSeqWrds - ExcludeLastNSeqWrds))
+				NumIdxWrds = max(1,(int)NumSeqWrds - ExcludeLastNSeqWrds);
+			if(Phase == 0)
+				NumNewEls += NumIdxWrds;
+			else
+				for(WrdIdx = 0; WrdIdx < NumIdxWrds; WrdIdx++,Idx++)
+					{
+					if(ElSize == 5)
+						Pack5(SeqWrdIdx + 3 + WrdIdx,&pNewEls[Idx * 5]);
+					else
+						((UINT32 *)pNewEls)[Idx] = (UINT32)(SeqWrdIdx + 3 + WrdIdx);
+					}
+			}
+		SeqWrdIdx += 3 + NumSeqWrds;
+		pSeqWrd += 3 + NumSeqWrds;
+		}
+	if(Phase == 1 || NumNewEls == 0)
+		break;
+
+	if(ElSize == 4 && (m_Sequences.NumSuffixEls + NumNewEls + 16 > cMaxSfxBlkEls || SeqWrdIdx > cMaxSfxBlkEls)) // element size would need to increase, caller will need to regenerate
+		return(eBSFerrMaxEntries);
+
+	// ensure suffix array can hold the merged elements plus terminating element
+	ReqAllocMem = (m_Sequences.NumSuffixEls + NumNewEls + 16) * (UINT64)ElSize;
+	if(m_Sequences.AllocMemSfx < ReqAllocMem)
+		{
+		void *pAllocd;
+		size_t memreq = (size_t)((ReqAllocMem * 110) / 100);		// 10% to allow for subsequent merges
+#ifdef _WIN32
+		pAllocd = realloc(m_Sequences.pSuffixArray,memreq);
+#else
+		pAllocd = mremap(m_Sequences.pSuffixArray,m_Sequences.AllocMemSfx,memreq,MREMAP_MAYMOVE);
+		if(pAllocd == MAP_FAILED)
+			pAllocd = NULL;
+#endif
+		if(pAllocd == NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"MergeRdsSfx: Suffix array memory re-allocation to %llu bytes - %s",(UINT64)memreq,strerror(errno));
+			return(eBSFerrMem);
+			}
+		m_Sequences.pSuffixArray = pAllocd;
+		m_Sequences.AllocMemSfx = (UINT64)memreq;
+		UINT64 CurWorkSetSize = 0;
+		CurWorkSetSize = m_Sequences.AllocMemSeqs2Assemb + m_Sequences.AllocMemSeqStarts + m_Sequences.AllocMemSfx + m_Sequences.AllocMemSeqFlags + m_AltSfx.AllocMemSfx;
+		if(CurWorkSetSize != m_CurMaxMemWorkSetBytes)
+			SetMaxMemWorkSetSize((size_t)CurWorkSetSize);
+		}
+
+	if((pNewEls = new UINT8 [(size_t)(NumNewEls * ElSize)]) == NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"MergeRdsSfx: Memory allocation of %llu bytes for new suffix elements failed",NumNewEls * ElSize);
+		return(eBSFerrMem);
+		}
+	}
+
+gDiagnostics.DiagOut(eDLDiag,gszProcName,"MergeRdsSfx: Sorting %llu new suffix elements for merging into %llu existing elements..",NumNewEls,m_Sequences.NumSuffixEls);
+if(NumNewEls == 0)
+	return(eBSFSuccess);
+
+m_xpConcatSeqs = (UINT8 *)m_Sequences.pSeqs2Assemb;
+m_MTqsort.qsort(pNewEls,NumNewEls,ElSize,ElSize == 5 ? Sfx5SortSeqWrd4Func : SfxSortSeqWrd4Func);
+
+// merge from the highest elements down so merged elements can be written in place into the current suffix array
+// where retained and new suffixes have identical sequences then the retained suffixes are ordered before the new suffixes
+pArr4 = (UINT32 *)m_Sequences.pSuffixArray;
+pArr5 = (UINT8 *)m_Sequences.pSuffixArray;
+RetainedIdx = m_Sequences.NumSuffixEls;
+NewIdx = NumNewEls;
+Idx = m_Sequences.NumSuffixEls + NumNewEls;
+if(ElSize == 5)
+	Pack5(0xffffffffff,&pArr5[Idx * 5]);
+else
+	pArr4[Idx] = 0xffffffff;
+while(NewIdx > 0)
+	{
+	Idx -= 1;
+	if(ElSize == 5)
+		{
+		NewWrdIdx = Unpack5(&pNewEls[(NewIdx-1) * 5]);
+		RetainedWrdIdx = RetainedIdx > 0 ? Unpack5(&pArr5[(RetainedIdx-1) * 5]) : 0;
+		}
+	else
+		{
+		NewWrdIdx = ((UINT32 *)pNewEls)[NewIdx-1];
+		RetainedWrdIdx = RetainedIdx > 0 ? pArr4[RetainedIdx-1] : 0;
+		}
+	if(RetainedIdx > 0 && SfxCmpSeqWrd4(RetainedWrdIdx,NewWrdIdx) > 0)
+		{
+		RetainedIdx -= 1;
+		NewWrdIdx = RetainedWrdIdx;
+		}
+	else
+		NewIdx -= 1;
+	if(ElSize == 5)
+		Pack5(NewWrdIdx,&pArr5[Idx * 5]);
+	else
+		pArr4[Idx] = (UINT32)NewWrdIdx;
+	}
+delete []pNewEls;
+m_Sequences.NumSuffixEls += NumNewEls;
+gDiagnostics.DiagOut(eDLDiag,gszProcName,"MergeRdsSfx: Suffix array contains %lld index elements size %d bytes",m_Sequences.NumSuffixEls,ElSize);
+return(eBSFSuccess);
+}
+
 // ChunkedWrite
 // Seeks to specified 64bit file offset and writes to disk as chunks of no more than INT_MAX/16  
 teBSFrsltCodes
@@ -7120,6 +7445,16 @@ return(Len);
 // GetPackedSeq3BaseLen
 // Returns -1 if errors
 
+// SfxCmpSeqWrd4
+// Compares suffixes at SeqIdx1 and SeqIdx2, suffixes with identical sequences compare as equal
+int
+CKangadna::SfxCmpSeqWrd4(UINT64 SeqIdx1, UINT64 SeqIdx2)
+{
+tSeqWrd4 *pSeq1 =  (tSeqWrd4 *)&m_xpConcatSeqs[SeqIdx1 * 4];
+tSeqWrd4 *pSeq2 = (tSeqWrd4 *)&m_xpConcatSeqs[SeqIdx2 * 4];
+return(CmpPackedSeqs(pSeq1,pSeq2,cMaxSortSfxLen));
+}
+
 int  // SfxSortFunc for UINT32 suffix elements
 CKangadna::SfxSortSeqWrd4Func(const void *arg1, const void *arg2)
 {
@@ -7352,6 +7687,123 @@ return(Rslt);
 }
 
 
+// Bit-parallel packed base comparisons
+// Bases are packed 15 per tSeqWrd4 with base 0 in bits 29..28, so the 15 bases starting at any base offset are realigned from at most two adjacent words into a 30bit chunk
+// Chunks are then compared with a single XOR, with mismatching bases identified by non-zero 2bit lanes, instead of iterating base by base
+const tSeqWrd4 cSeqWrd4LaneLSBs = 0x15555555;	// LSB of each of the 15 2bit base lanes
+
+static inline tSeqWrd4					// returns Len (1..15) bases starting at base offset Ofs realigned so base at Ofs is in bits 29..28
+PackedChunk(tSeqWrd4 *pSeq,				// packed bases (no header words)
+			int Ofs,					// starting base offset
+			int Len)					// number of bases required, words beyond those containing these bases are not accessed
+{
+tSeqWrd4 *pWrd = &pSeq[Ofs / 15];
+int Shf = 2 * (Ofs % 15);
+if(Shf == 0)
+	return(pWrd[0] & cSeqWrd4Msk);
+if((Ofs % 15) + Len <= 15)
+	return((pWrd[0] << Shf) & cSeqWrd4Msk);
+return(((pWrd[0] << Shf) | ((pWrd[1] & cSeqWrd4Msk) >> (30 - Shf))) & cSeqWrd4Msk);
+}
+
+static inline tSeqWrd4					// returns lane LSBs for the initial NumLanes (clamped to 0..15) lanes
+PackedLanes(int NumLanes)
+{
+if(NumLanes <= 0)
+	return(0);
+if(NumLanes >= 15)
+	return(cSeqWrd4LaneLSBs);
+return(cSeqWrd4LaneLSBs & ~((((tSeqWrd4)1) << (2 * (15 - NumLanes))) - 1));
+}
+
+static inline tSeqWrd4					// returns lane LSBs of those lanes in which bases differ
+PackedMMs(tSeqWrd4 Chunk1,tSeqWrd4 Chunk2)
+{
+tSeqWrd4 Diff = Chunk1 ^ Chunk2;
+return((Diff | (Diff >> 1)) & cSeqWrd4LaneLSBs);
+}
+
+static inline int						// number of bits set
+PackedPopCnt(tSeqWrd4 Bits)
+{
+Bits = Bits - ((Bits >> 1) & 0x55555555);
+Bits = (Bits & 0x33333333) + ((Bits >> 2) & 0x33333333);
+return((int)((((Bits + (Bits >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24));
+}
+
+static inline int						// returns lane (0..14) of first set lane LSB, 15 if none set
+PackedFirstLane(tSeqWrd4 Lanes)
+{
+Lanes |= Lanes >> 2;					// smear down into all following lanes
+Lanes |= Lanes >> 4;
+Lanes |= Lanes >> 8;
+Lanes |= Lanes >> 16;
+return(15 - PackedPopCnt(Lanes & cSeqWrd4LaneLSBs));
+}
+
+static inline int						// number of bases in a partial sequence word, the lane following the last base is the last lane containing 00
+PackedPartBases(tSeqWrd4 SeqWrd)
+{
+tSeqWrd4 Lanes = ~(SeqWrd | (SeqWrd >> 1)) & cSeqWrd4LaneLSBs;
+if(!Lanes)
+	return(-1);
+return(14 - (PackedPopCnt((Lanes & (~Lanes + 1)) - 1) / 2));
+}
+
+// CountPackedSubs
+// Counts substitutions between Len bases of Seq1 and Seq2, 15 bases at a time
+// If End12Len then substitutions within the initial End12Len bases, and within the final End12Len bases if not already in the initial bases, are counted
+// against their own limits as when counting base by base
+bool
+CKangadna::CountPackedSubs(int Len,				// count substitutions over this many bases
+			tSeqWrd4 *pSeq1,					// Seq1 packed bases (no header words)
+			int Seq1Ofs,						// starting from this base offset in Seq1
+			tSeqWrd4 *pSeq2,					// Seq2 packed bases (no header words)
+			int Seq2Ofs,						// starting from this base offset in Seq2
+			int End12Len,						// if non-zero then substitutions within this many initial and final bases are counted against Max5Subs and Max3Subs
+			int Max5Subs,						// allow at most this many substitutions within initial End12Len bases
+			int Max3Subs,						// allow at most this many substitutions within final End12Len bases
+			int MaxSubs,						// allow at most this many substitutions over remaining bases
+			int *pNumSubs)						// returned total number of substitutions
+{
+int Ofs;
+int ChunkLen;
+int End3Ofs;
+int Num5Subs;
+int Num3Subs;
+int NumSubs;
+tSeqWrd4 MMs;
+tSeqWrd4 EndLanes;
+
+End3Ofs = End12Len ? max(End12Len,Len - End12Len) : Len;	// bases at or after this offset are in the final End12Len bases
+Num5Subs = 0;
+Num3Subs = 0;
+NumSubs = 0;
+for(Ofs = 0; Ofs < Len; Ofs += 15)
+	{
+	ChunkLen = min(15,Len - Ofs);
+	MMs = PackedMMs(PackedChunk(pSeq1,Seq1Ofs + Ofs,ChunkLen),PackedChunk(pSeq2,Seq2Ofs + Ofs,ChunkLen)) & PackedLanes(ChunkLen);
+	if(!MMs)
+		continue;
+	if(Ofs < End12Len || (Ofs + ChunkLen) > End3Ofs)
+		{
+		EndLanes = PackedLanes(End12Len - Ofs);
+		Num5Subs += PackedPopCnt(MMs & EndLanes);
+		MMs &= ~EndLanes;
+		EndLanes = cSeqWrd4LaneLSBs & ~PackedLanes(End3Ofs - Ofs);
+		Num3Subs += PackedPopCnt(MMs & EndLanes);
+		MMs &= ~EndLanes;
+		if(Num5Subs > Max5Subs || Num3Subs > Max3Subs)
+			return(false);
+		}
+	if(MMs && (NumSubs += PackedPopCnt(MMs)) > MaxSubs)
+		return(false);
+	}
+if(pNumSubs != NULL)
+	*pNumSubs = Num5Subs + Num3Subs + NumSubs;
+return(true);
+}
+
 int											// 0 Seq1 == Seq2, -1 if Seq1 < Seq2, +1 if Seq1 > Seq2
 CKangadna::CmpPackedSeqs(tSeqWrd4 *pProbeSeq,	// Seq1 (probe) packed sequence
 			  tSeqWrd4 *pTargSeq,				// Seq2 (target) packed sequence
@@ -7359,6 +7811,8 @@ CKangadna::CmpPackedSeqs(tSeqWrd4 *pProbeSeq,	// Seq1 (probe) packed sequence
 {
 int NumSeq1Bases;
 int NumSeq2Bases;
+int NumCmpBases;
+int MMLane;
 if(!MaxCmpLen || pProbeSeq == NULL || pTargSeq == NULL)
 	return(0);
 
@@ -7412,43 +7866,22 @@ if(SeqWrd1 & cSeqWrd4MSWHdr || SeqWrd2 & cSeqWrd4MSWHdr) // check if finished ei
 	return(0);
 	}
 
-// determine number of bases in SeqWrd1
-if(SeqWrd1 > cSeqWrd4Msk)
-	{
-	BaseMsk = 0x03;
-	for(NumSeq1Bases = 14; NumSeq1Bases >= 0; NumSeq1Bases--,BaseMsk <<= 2)
-		if(!(BaseMsk & SeqWrd1))
-			break;
-	}
-else
-	NumSeq1Bases = 15;
-
-// determine number of bases in SeqWrd2
-if(SeqWrd2 > cSeqWrd4Msk)
-	{
-	BaseMsk = 0x03;
-	for(NumSeq2Bases = 14; NumSeq2Bases >= 0; NumSeq2Bases--,BaseMsk <<= 2)
-		if(!(BaseMsk & SeqWrd2))
-			break;
-	}
-else
-	NumSeq2Bases = 15;
+// determine number of bases in SeqWrd1 and SeqWrd2
+NumSeq1Bases = SeqWrd1 > cSeqWrd4Msk ? PackedPartBases(SeqWrd1) : 15;
+NumSeq2Bases = SeqWrd2 > cSeqWrd4Msk ? PackedPartBases(SeqWrd2) : 15;
 
-BaseMsk = 0x30000000;
-do
+// compare the bases common to both words, at least the initial base is always compared
+NumCmpBases = max(1,min(NumSeq1Bases,NumSeq2Bases));
+if(MaxCmpLen > 0 && MaxCmpLen < NumCmpBases)
+	NumCmpBases = MaxCmpLen;
+MMLane = PackedFirstLane(PackedMMs(SeqWrd1,SeqWrd2) & PackedLanes(NumCmpBases));
+if(MMLane < 15)
 	{
-	if((SeqWrd1 & BaseMsk) < (SeqWrd2 & BaseMsk))
-		return(-1);
-	if((SeqWrd1 & BaseMsk) > (SeqWrd2 & BaseMsk))
-		return(1);
-	MaxCmpLen -= 1;
-	if(!MaxCmpLen)
-		return(0);
-	BaseMsk >>= 2;
-	NumSeq1Bases -= 1;
-	NumSeq2Bases -= 1;
+	BaseMsk = 0x03 << (2 * (14 - MMLane));
+	return((SeqWrd1 & BaseMsk) < (SeqWrd2 & BaseMsk) ? -1 : 1);
 	}
-while(NumSeq1Bases > 0 && NumSeq2Bases > 0);
+if(MaxCmpLen == NumCmpBases)
+	return(0);
 
 if(NumSeq1Bases < NumSeq2Bases)
 	return(-1);
@@ -7574,7 +8007,6 @@ if(pSeqA == NULL || pSeqB == NULL)
 
 OverlapLen = 0;
 
-tSeqWrd4 BaseMsk;
 tSeqWrd4 *pSeq1 = pSeqA;
 tSeqWrd4 *pSeq2 =  pSeqB;
 tSeqWrd4 SeqWrd1;
@@ -7612,39 +8044,15 @@ while(!((SeqWrd1 = *pSeq1++) & cSeqWrd4MSWHdr || (SeqWrd2 = *pSeq2++) & cSeqWrd4
 		return(OverlapLen);
 
 	// either part words or there was a mismatch within words
-	// determine number of bases in SeqWrd1
-	if(SeqWrd1 & cSeqWrd4LSWHdr)		// SeqWrd1 will have bits 30 or 31 set if a part word
-		{
-		BaseMsk = 0x03;
-		for(NumSeq1Bases = 14; NumSeq1Bases >= 0; NumSeq1Bases--,BaseMsk <<= 2)
-			if(!(BaseMsk & SeqWrd1))
-				break;
-		}
-	else
-		NumSeq1Bases = 15;
-
-	// determine number of bases in SeqWrd2
-	if(SeqWrd2 & cSeqWrd4LSWHdr)		// SeqWrd2 will have bits 30 or 31 set if a part word
-		{
-		BaseMsk = 0x03;
-		for(NumSeq2Bases = 14; NumSeq2Bases >= 0; NumSeq2Bases--,BaseMsk <<= 2)
-			if(!(BaseMsk & SeqWrd2))
-				break;
-		}
-	else
-		NumSeq2Bases = 15;
+	// determine number of bases in SeqWrd1 and SeqWrd2, SeqWrds will have bits 30 or 31 set if a part word
+	NumSeq1Bases = SeqWrd1 & cSeqWrd4LSWHdr ? PackedPartBases(SeqWrd1) : 15;
+	NumSeq2Bases = SeqWrd2 & cSeqWrd4LSWHdr ? PackedPartBases(SeqWrd2) : 15;
 
-	// do a minimal number of base compares 
+	// bases common to both words are matching up to the first mismatch
 	MaxPartialCmpBases = min(NumSeq1Bases,NumSeq2Bases);
-	BaseMsk = 0x30000000;
-	while(MaxPartialCmpBases--) {
-		if((SeqWrd1 & BaseMsk) != (SeqWrd2 & BaseMsk)) 
-			break;
-		OverlapLen += 1;				// still matching base for base
-		if(MaxLen && (OverlapLen >= MaxLen))
-				return(OverlapLen);
-		BaseMsk >>= 2;
-		}
+	OverlapLen += min(MaxPartialCmpBases,PackedFirstLane(PackedMMs(SeqWrd1,SeqWrd2) & PackedLanes(MaxPartialCmpBases)));
+	if(MaxLen && (OverlapLen >= MaxLen))
+		return(MaxLen);
 	break;
 	}
 
@@ -7665,15 +8073,8 @@ CKangadna::IsMatched(int ReqMatchLen,		// required match length
 {
 int Max3End12Subs;
 int	KbpLen;
-tSeqWrd4 *pStartSeq1;
-tSeqWrd4 *pStartSeq2;
-tSeqWrd4 CurSeq1Wrd;
-tSeqWrd4 CurSeq2Wrd;
 int AllowNumSubs;
 int NumMMs;
-int Num5MMs;
-int Num3MMs;
-int NumBasesChkd;
 
 // some sanity checks
 if(ReqMatchLen < 16 || (Seq1Ofs + ReqMatchLen) > Seq1Len || (Seq2Ofs + ReqMatchLen) > Seq2Len || 
@@ -7709,55 +8110,12 @@ while(*pSeq2 & cSeqWrd4MSWHdr)
 	pSeq2 += 1;
 	}
 
-// fetch and rotate into the MSbits the initial base
-pStartSeq1 = &pSeq1[Seq1Ofs/15];
-CurSeq1Wrd = *pStartSeq1++;
-CurSeq1Wrd <<= 2 * (Seq1Ofs % 15); 
-Seq1Ofs += 1;
-
-pStartSeq2 = &pSeq2[Seq2Ofs/15];
-CurSeq2Wrd = *pStartSeq2++;
-CurSeq2Wrd <<= 2 * (Seq2Ofs % 15);
-Seq2Ofs += 1;
-
-NumBasesChkd = 0;
-NumMMs = 0;
-Num5MMs = 0;
-Num3MMs = 0;
-for(NumBasesChkd = 0; NumBasesChkd < ReqMatchLen; NumBasesChkd+=1, Seq1Ofs+=1, Seq2Ofs+=1)
-	{
-	if((CurSeq1Wrd & 0x030000000) != (CurSeq2Wrd  & 0x030000000))
-		{
-		if(MaxEnd12Subs && (NumBasesChkd < 12 || NumBasesChkd >= (ReqMatchLen - 12)))
-			{
-			if(NumBasesChkd < 12)
-				{
-				if(++Num5MMs > MaxEnd12Subs)
-					break;
-				}
-			else
-				{
-				if(++Num3MMs > Max3End12Subs)
-					break;
-				}
-			}
-		else
-			if(++NumMMs > AllowNumSubs)
-				break;
-		}
-
-	if(!(Seq1Ofs%15))
-		CurSeq1Wrd = *pStartSeq1++;
-	else
-		CurSeq1Wrd <<= 2;
-	if(!(Seq2Ofs%15))
-		CurSeq2Wrd = *pStartSeq2++;
-	else
-	    CurSeq2Wrd <<= 2;
-	}
-if(pNumSubs != NULL && NumBasesChkd == ReqMatchLen)
-	*pNumSubs = NumMMs + Num5MMs + Num3MMs;
-return(NumBasesChkd == ReqMatchLen);
+// count substitutions 15 bases at a time, returning as soon as any of the allowed number of substitutions is exceeded
+if(!CountPackedSubs(ReqMatchLen,pSeq1,Seq1Ofs,pSeq2,Seq2Ofs,MaxEnd12Subs ? 12 : 0,MaxEnd12Subs,Max3End12Subs,AllowNumSubs,&NumMMs))
+	return(false);
+if(pNumSubs != NULL)
+	*pNumSubs = NumMMs;
+return(true);
 }
 
 // GetOverlapAB will process for overlaps in which SeqA (SeqB), completely or 5' overlaps, SeqB (SeqA)
@@ -7773,10 +8131,8 @@ CKangadna::GetOverlapAB(int MinOverlap,		// seq1 and seqB must overlap by at lea
 			int MaxEnd12Subs,				// allow at the initial 12bp of the 5' or 3' of overlap to have this many base mismatches in addition to the overall allowed MaxSubs (expected to be in range 0..6) 
 			int *pNumSubs)					// number of substitutions actually required
 {
-int CurNumSubs;
+int TmpLen;
 int Max3End12Subs;
-int Cur5EndSubs;
-int Cur3EndSubs;
 int ABNumSubs;
 int SeqALeft;
 int ABMaxOverlapLen;
@@ -7786,20 +8142,7 @@ int SeqBLeft;
 int BAMaxOverlapLen;
 
 int FirstSeqAOfs;
-int CurSeqAOfs;
-int CurSeqBOfs;
-tSeqWrd4 CurSeqABase;
-tSeqWrd4 CurSeqBBase;
 tSeqWrd4 *pStartSeqA;
-tSeqWrd4 *pCurSeqA;
-tSeqWrd4 *pCurSeqB;
-
-tSeqWrd4 FirstSeqAWrd;
-tSeqWrd4 FirstSeqBWrd;
-tSeqWrd4 CurSeqAWrd;
-tSeqWrd4 CurSeqBWrd;
-tSeqWrd4 FirstSeqABase;
-tSeqWrd4 FirstSeqBBase;
 
 int KbpLen;
 int CurMaxKbpNumSubs;
@@ -7835,36 +8178,11 @@ while(*pSeqB & cSeqWrd4MSWHdr)
 pStartSeqA = pSeqA;
 
 // initally look for overlaps of SeqA onto SeqB; then look for overlap of SeqB onto SeqA and choose the maximal with minimum subs as a tiebreaker
-CurNumSubs = 0;
-Cur5EndSubs = 0;
-Cur3EndSubs = 0;
-CurSeqAOfs = 0;
-
 ABNumSubs = 0;
 SeqALeft = 0;
 ABMaxOverlapLen = 0;
-FirstSeqBWrd = *pSeqB;
-FirstSeqBBase = FirstSeqBWrd & 0x30000000; 
 for(FirstSeqAOfs = 0; FirstSeqAOfs <= (SeqALen - MinOverlap); FirstSeqAOfs++)
 	{
-	if(!(FirstSeqAOfs % 15))
-		FirstSeqAWrd = *pSeqA++ & cSeqWrd4Msk;
-	else
-		FirstSeqAWrd <<= 2;
-	if((FirstSeqABase = (FirstSeqAWrd & 0x30000000)) != FirstSeqBBase && !(MaxEnd12Subs || MaxSubsPerK)) // if mismatches when no subs allowed then try next SeqA base
-		continue;
-
-	CurNumSubs = 0;
-	Cur5EndSubs = 0;
-	Cur3EndSubs = 0;
-	CurSeqAWrd = FirstSeqAWrd;
-	CurSeqBWrd = FirstSeqBWrd;
-	CurSeqABase = FirstSeqABase;
-	CurSeqBBase = FirstSeqBBase;
-	CurSeqAOfs = FirstSeqAOfs;
-
-	pCurSeqA = pSeqA;
-	pCurSeqB = pSeqB;
 	ABMaxOverlapLen = min(SeqALen - FirstSeqAOfs,SeqBLen);	// current max overlap possible of A onto B
 	Max3End12Subs = MaxEnd12Subs;
 	
@@ -7879,46 +8197,8 @@ for(FirstSeqAOfs = 0; FirstSeqAOfs <= (SeqALen - MinOverlap); FirstSeqAOfs++)
 			Max3End12Subs = max(1,(MaxEnd12Subs * (ABMaxOverlapLen - 11)) / 12);
 		}
 
-	for(CurSeqBOfs = 0; CurSeqBOfs < ABMaxOverlapLen; CurSeqBOfs++)
+	if(CountPackedSubs(ABMaxOverlapLen,pSeqA,FirstSeqAOfs,pSeqB,0,MaxEnd12Subs ? 12 : 0,MaxEnd12Subs,Max3End12Subs,CurMaxKbpNumSubs,&ABNumSubs))
 		{
-		if(CurSeqBOfs > 0)
-			{
-			if(!(++CurSeqAOfs % 15))
-				CurSeqAWrd = *pCurSeqA++ & cSeqWrd4Msk;
-			else
-				CurSeqAWrd <<= 2;
-			CurSeqABase = CurSeqAWrd & 0x30000000;
-			}
-
-		if(!(CurSeqBOfs % 15))
-			CurSeqBWrd = *pCurSeqB++ & cSeqWrd4Msk;
-		else
-			CurSeqBWrd <<= 2;
-		CurSeqBBase = CurSeqBWrd & 0x30000000;
-
-		if(CurSeqABase != CurSeqBBase)
-			{
-			if(MaxEnd12Subs)
-				{
-				if(CurSeqBOfs < 12)
-					Cur5EndSubs += 1;
-				else
-					{
-					if(CurSeqBOfs < (ABMaxOverlapLen - 12))
-						CurNumSubs += 1;
-					else
-						Cur3EndSubs += 1;
-					}
-				}
-			else
-				CurNumSubs += 1;
-			if(Cur5EndSubs > MaxEnd12Subs || Cur3EndSubs > Max3End12Subs || CurNumSubs > CurMaxKbpNumSubs)
-				break;
-			}
-		}
-	if(CurSeqBOfs == ABMaxOverlapLen)
-		{
-		ABNumSubs = Cur5EndSubs + Cur3EndSubs + CurNumSubs;
 		SeqALeft = FirstSeqAOfs;
 		break;
 		}
@@ -7942,40 +8222,16 @@ if(bNoSeqBOvrlapA || ((ABMaxOverlapLen == min(SeqALen,SeqBLen)) && ABNumSubs <=
 // now look for overlaps of SeqB onto SeqA
 
 pSeqA = pSeqB;			// exchange the sequences and their respective lengths
-CurNumSubs = SeqALen;
+TmpLen = SeqALen;
 SeqALen = SeqBLen;
 pSeqB = pStartSeqA;
-SeqBLen = CurNumSubs;
+SeqBLen = TmpLen;
 
-CurNumSubs = 0;
-Cur5EndSubs = 0;
-Cur3EndSubs = 0;
-CurSeqAOfs = 0;
 BANumSubs = 0;
 SeqBLeft = 0;
 BAMaxOverlapLen = 0;
-FirstSeqBWrd = *pSeqB;
-FirstSeqBBase = FirstSeqBWrd & 0x30000000; 
 for(FirstSeqAOfs = 0; FirstSeqAOfs <= (SeqALen - MinOverlap); FirstSeqAOfs++)
 	{
-	if(!(FirstSeqAOfs % 15))
-		FirstSeqAWrd = *pSeqA++ & cSeqWrd4Msk;
-	else
-		FirstSeqAWrd <<= 2;
-	if((FirstSeqABase = (FirstSeqAWrd & 0x30000000)) != FirstSeqBBase && !(MaxEnd12Subs || MaxSubsPerK)) // if mismatches when no subs allowed then try next SeqA base
-		continue;
-
-	CurNumSubs = 0;
-	Cur5EndSubs = 0;
-	Cur3EndSubs = 0;
-	CurSeqAWrd = FirstSeqAWrd;
-	CurSeqBWrd = FirstSeqBWrd;
-	CurSeqABase = FirstSeqABase;
-	CurSeqBBase = FirstSeqBBase;
-	CurSeqAOfs = FirstSeqAOfs;
-
-	pCurSeqA = pSeqA;
-	pCurSeqB = pSeqB;
 	BAMaxOverlapLen = min(SeqALen - FirstSeqAOfs,SeqBLen);	// sequences were exchanged so actually current max overlap possible of B onto A
 	Max3End12Subs = MaxEnd12Subs;
 	
@@ -7990,46 +8246,8 @@ for(FirstSeqAOfs = 0; FirstSeqAOfs <= (SeqALen - MinOverlap); FirstSeqAOfs++)
 			Max3End12Subs = max(1,(MaxEnd12Subs * (BAMaxOverlapLen - 11)) / 12);
 		}
 
-	for(CurSeqBOfs = 0; CurSeqBOfs < BAMaxOverlapLen; CurSeqBOfs++)
-		{
-		if(CurSeqBOfs > 0)
-			{
-			if(!(++CurSeqAOfs % 15))
-				CurSeqAWrd = *pCurSeqA++ & cSeqWrd4Msk;
-			else
-				CurSeqAWrd <<= 2;
-			CurSeqABase = CurSeqAWrd & 0x30000000;
-			}
-
-		if(!(CurSeqBOfs % 15))
-			CurSeqBWrd = *pCurSeqB++ & cSeqWrd4Msk;
-		else
-			CurSeqBWrd <<= 2;
-		CurSeqBBase = CurSeqBWrd & 0x30000000;
-
-		if(CurSeqABase != CurSeqBBase)
-			{
-			if(MaxEnd12Subs)
-				{
-				if(CurSeqBOfs < 12)
-					Cur5EndSubs += 1;
-				else
-					{
-					if(CurSeqBOfs < (BAMaxOverlapLen - 12))
-						CurNumSubs += 1;
-					else
-						Cur3EndSubs += 1;
-					}
-				}
-			else
-				CurNumSubs += 1;
-			if(Cur5EndSubs > MaxEnd12Subs || Cur3EndSubs > Max3End12Subs || CurNumSubs > CurMaxKbpNumSubs)
-				break;
-			}
-		}
-	if(CurSeqBOfs == BAMaxOverlapLen)
+	if(CountPackedSubs(BAMaxOverlapLen,pSeqA,FirstSeqAOfs,pSeqB,0,MaxEnd12Subs ? 12 : 0,MaxEnd12Subs,Max3End12Subs,CurMaxKbpNumSubs,&BANumSubs))
 		{
-		BANumSubs = Cur5EndSubs + Cur3EndSubs + CurNumSubs;
 		SeqBLeft = FirstSeqAOfs;
 		break;
 		}
@@ -323,6 +323,13 @@ typedef struct TAG_sSequences {		// contains sequences and sparse suffix for seq
 		};
 } tsSequences;
 
+typedef struct TAG_sSfxArray {		// suffix array retained whilst not being the current suffix array in tsSequences
+	UINT32	SfxElSize;				// suffix element size - either 4, <= cMaxSfxBlkEls, or 5 if > cMaxSfxBlkEls
+	UINT64 NumSuffixEls;			// number of elements in suffix array
+	UINT64 AllocMemSfx;				// allocated memory size for suffix array
+	void *pSuffixArray;				// suffix array, element sizes may be either 4 or 5 bytes as specified by SfxElSize
+} tsSfxArray;
+
 typedef struct TAG_sEstSeqs {
 	bool bCalcMeanSeqLen;			// set true when ever the mean sequence length needs to be re-calculated
 	UINT32 NumFiles;				// number of files from which these estimates were derived 
@@ -448,7 +455,8 @@ friend class CPacBio;					// CPacBio requires access to all members of this clas
 	int m_NumThreads;			// max number of processing threads to use 
 	int m_ThreadsProcessing;	// number of threads dispatched to handle current processing task, decremented as each thread completes current task phase
 	
-	bool m_bAffinity;			// thread to core affinity
+	bool m_bAffinity;			// if true then processing threads are bound round robin to NUMA nodes and sequences plus suffix array are interleaved over all nodes
+	CNUMA m_NUMA;				// discovered NUMA topology
 
 	char *m_pszLineBuff;			// allocd for buffering of output assembled contigs
 	int m_LineBuffLen;				// current number of chars buffered in m_pszLineBuff
@@ -460,6 +468,7 @@ friend class CPacBio;					// CPacBio requires access to all members of this clas
 	UINT64 m_BaseWinMaxMem;			// windows base max working set memory in bytes when process initially started
 
 	tsSequences m_Sequences;			//  5' (eSTypePE1) and 3' (eSTtypePE2) sequences
+	tsSfxArray m_AltSfx;			// alternate suffix array, e.g. over the reverse complemented sequences, exchanged with the current suffix array by ExchangeRdsSfx()
 
 	tsEstSeqs m_SeqEsts;			// estimates of sequence lengths + total number of sequences for each sequence type
 
@@ -668,6 +677,18 @@ friend class CPacBio;					// CPacBio requires access to all members of this clas
 				tSeqWrd4 *pSeq2,			// Seq2 (target) packed sequence
 				int MaxLen=0);				// if non-zero then immediately return as soon as OverlapLen is at least this length - no need to exhustively find the maximal overlap
 
+	static bool								// true if substitutions are within all limits, false as soon as any limit is exceeded
+		CountPackedSubs(int Len,			// count substitutions over this many bases
+			tSeqWrd4 *pSeq1,				// Seq1 packed bases (no header words)
+			int Seq1Ofs,					// starting from this base offset in Seq1
+			tSeqWrd4 *pSeq2,				// Seq2 packed bases (no header words)
+			int Seq2Ofs,					// starting from this base offset in Seq2
+			int End12Len,					// if non-zero then substitutions within this many initial and final bases are counted against Max5Subs and Max3Subs
+			int Max5Subs,					// allow at most this many substitutions within initial End12Len bases
+			int Max3Subs,					// allow at most this many substitutions within final End12Len bases
+			int MaxSubs,					// allow at most this many substitutions over remaining bases
+			int *pNumSubs);					// returned total number of substitutions
+
 	bool									// true if Seq1 matches Seq2 for MatchLen
 	IsMatched(int ReqMatchLen,				// required match length
 			int Seq1Ofs,					// base offset in Seq1 at which to to start match
@@ -689,6 +710,7 @@ friend class CPacBio;					// CPacBio requires access to all members of this clas
 						tSeqWrd4 *pSeq);		// Seq1 (probe) packed sequence to shift left
 
 
+	static int SfxCmpSeqWrd4(UINT64 SeqIdx1, UINT64 SeqIdx2);	// compares suffixes when merging suffix arrays
 	static int SfxSortSeqWrd4Func(const void *arg1, const void *arg2);
 	static int Sfx5SortSeqWrd4Func(const void *arg1, const void *arg2);
 
@@ -946,6 +968,8 @@ public:
 	void ResetTypeSeqs(void);
 	void SetCtgDescr(char *pszCtgDescr);	// set contig descriptor prefix
 	teBSFrsltCodes SetNumThreads(int maxThreads,bool bAffinity=false);
+	void BindThreadToNUMANode(int ThreadIdx);				// if NUMA placement then bind calling thread (1..m_NumThreads) to it's round robin allocated node
+	void InterleaveNUMA(void *pMem,size_t MemLen);			// if NUMA placement then interleave pages of pMem over all nodes
 
 	void SetPMode(int PMode = 0);							// set processing mode
 
@@ -1154,6 +1178,17 @@ static const int cLevenshteinPacBioMismatch = 2;  // PacBio has very low rates o
 		                     int ExcludeLastNSeqWrds = 0,	// exclude last N SeqWrds in each read sequence from indexing, 0 to index FirstNSeqWrds
 							 bool bExclPE = false);	    // true to exclude sequences marked as being PE from being indexed
 
+	void ExchangeRdsSfx(void);			// exchange the current suffix array with the alternate suffix array in m_AltSfx
+
+	INT64							// number of suffix elements retained in current suffix array, < 0 if errors
+		RemapRdsSfx(bool bRevCpl,				// true if current suffix array was generated over the reverse complemented sequences (PE1 and PE2 exchanged)
+					UINT64 PrevSeqs2AssembOfs,	// sequences were concatenated to this offset when the suffix array was generated
+					UINT64 *pPrevToNewStarts);	// indexed by previous sequence identifier - 1, start offset of that sequence after concatenated sequences were updated or 0 if sequence not retained unchanged
+
+	teBSFrsltCodes MergeRdsSfx(int FirstNSeqWrds, 			// max number of SeqWrds (0 to index all), starting from 1st, to index in each read sequence
+								int ExcludeLastNSeqWrds,	// exclude last N SeqWrds in each read sequence from indexing, 0 to index FirstNSeqWrds
+								UINT8 *pNewSeqs);			// indexed by sequence ordinal - 1, non-zero if that sequence is to have it's suffixes sorted and merged into current suffix array
+
 	teBSFrsltCodes AllocSeqs2AssembMem(UINT64 ReqAllocSize);	// alloc/realloc to at least ReqAllocSize (bytes)
 
 	teBSFrsltCodes AllocBlockNsLoci(UINT32 ReqAllocBlocks);		// alloc/realloc to at least ReqAllocSize (tsBlockNsLoci)
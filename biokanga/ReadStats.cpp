@@ -2604,17 +2604,25 @@ CFasta FastaPE1;
 CFasta FastaPE2;
 
 CSAMfile SAMfile;
+int NumInflateThreads;
 
 bIsSAMfile = false;
 bIsPE1Fastq = false;
 
+// input files are processed concurrently, one file or file pair per worker thread, so any surplus threads are used for BGZF inflating
+NumInflateThreads = m_NumThreads / max(1,min(m_NumThreads,m_NumPE1InFiles));
+if(m_bPEProc)
+	NumInflateThreads /= 2;
+if(NumInflateThreads < 1)
+	NumInflateThreads = 1;
+
 // if not paired ends then check if a SAM/BAM file 
 if(m_bPEProc == false)
 	bIsSAMfile = CSAMfile::IsSAM(pPE1File->szFileName, false) == eSFTSAMUnknown ? false : true;
 
 if(bIsSAMfile)
 	{
-	if((Rslt = (teBSFrsltCodes)SAMfile.Open(pPE1File->szFileName)) != eBSFSuccess)
+	if((Rslt = (teBSFrsltCodes)SAMfile.Open(pPE1File->szFileName,NumInflateThreads)) != eBSFSuccess)
 		{
 		gDiagnostics.DiagOut(eDLFatal, gszProcName, "(Instance %d) Thread %d: Unable to open '%s' [%s] %s", pThread->ProcessingID, pThread->ThreadIdx, pPE1File->szFileName, FastaPE1.ErrText((teBSFrsltCodes)Rslt), FastaPE1.GetErrMsg());
 		return(Rslt);
@@ -2622,7 +2630,7 @@ if(bIsSAMfile)
 	}
 else
 	{
-	if ((Rslt = (teBSFrsltCodes)FastaPE1.Open(pPE1File->szFileName, true, cDfltStageBuffSize)) != eBSFSuccess)
+	if ((Rslt = (teBSFrsltCodes)FastaPE1.Open(pPE1File->szFileName, true, cDfltStageBuffSize, cDfltFastaBlocks, NumInflateThreads)) != eBSFSuccess)
 		{
 		gDiagnostics.DiagOut(eDLFatal, gszProcName, "(Instance %d) Thread %d: Unable to open '%s' [%s] %s", pThread->ProcessingID, pThread->ThreadIdx, pPE1File->szFileName, FastaPE1.ErrText((teBSFrsltCodes)Rslt), FastaPE1.GetErrMsg());
 		return(Rslt);
@@ -2637,7 +2645,7 @@ else
 
 	if (m_bPEProc)
 		{
-		if ((Rslt = (teBSFrsltCodes)FastaPE2.Open(pPE2File->szFileName, true, cDfltStageBuffSize)) != eBSFSuccess)
+		if ((Rslt = (teBSFrsltCodes)FastaPE2.Open(pPE2File->szFileName, true, cDfltStageBuffSize, cDfltFastaBlocks, NumInflateThreads)) != eBSFSuccess)
 			{
 			gDiagnostics.DiagOut(eDLFatal, gszProcName, "(Instance %d) Thread %d: Unable to open '%s' [%s] %s", pThread->ProcessingID, pThread->ThreadIdx, pPE2File->szFileName, FastaPE2.ErrText((teBSFrsltCodes)Rslt), FastaPE2.GetErrMsg());
 			FastaPE1.Close();
@@ -54,6 +54,7 @@ Process(etPMode PMode,		// processing mode
 		bool bReadHamDist,	// true if hamming distributions from each sampled read to all other genome subsequences to be generated
 		etFMode FMode,		// output format
 		int NumThreads,		// number of worker threads to use
+		int RandSeed,		// if > 0 then seed random number generators with this value, otherwise seed from current time
 		char Strand,		// generate for this strand '+' or '-' or for both '*'
 		int NumReads,		// number of reads required (will be doubled if paired end reads)
 		int ReadLen,		// read lengths
@@ -108,6 +109,7 @@ bool bDedupe;				// true if unique reads only to be generated
 int DfltHamming;			// if >= 0 then the default Hamming edit distance to use
 int NumberOfProcessors;		// number of installed CPUs
 int NumThreads;				// number of threads (0 defaults to number of CPUs)
+int RandSeed;				// if > 0 then seed random number generators with this value so simulations are reproducible
 bool bReadHamDist;			// true if hamming distributions from each sampled read to all other genome subsequences to be generated
 int SNPrate;				// generate SNPs at this rate per million bases
 
@@ -183,6 +185,7 @@ struct arg_file *outfile = arg_file1("o","out","<file>",		"output simulated (or
 struct arg_file *outpefile = arg_file0("O","outpe","<file>",	"output simulated (N/2) paired end reads to this file");
 struct arg_file *outsnpfile = arg_file0("u","outsnp","<file>",	"output simulated SNP loci to this BED file, if no SNP rate specified then defaults to 1000 per Mbp");
 struct arg_int *threads = arg_int0("T","threads","<int>",		"number of processing threads 0..128 (defaults to 0 which sets threads to number of CPU cores)");
+struct arg_int *randseed = arg_int0("y","seed","<int>",		"seed random number generators with this value for reproducible simulations, 0 to seed from current time (default 0)");
 struct arg_lit  *dedupe = arg_lit0("d","dedupe",                "generate unique read sequences only");
 struct arg_int *hamming = arg_int0("e","hamming","<int>",		"if specified and < 0, then dynamically generate Hamming edit distances, otherwise use this static distance (default = static generation with Hamming 0)");
 struct arg_lit  *readhamdist = arg_lit0("r","readhamdist",      "generate hamming distribution from each simulated read to all other subsequences of same length in genome");
@@ -213,7 +216,7 @@ void *argtable[] = {help,version,FileLogLevel,LogFile,
 					indelsize,indelrate,strand,readlen,cutmin,cutmax,dedupe,hamming,featfile,
 					infile,inmnase,hammfile,outpefile,outfile,outsnpfile,summrslts,
 					experimentname,experimentdescr,
-					threads,
+					threads,randseed,
 					end};
 
 char **pAllArgs;
@@ -806,6 +809,13 @@ if (!argerrors)
 		NumThreads = MaxAllowedThreads;
 		}
 
+	RandSeed = randseed->count ? randseed->ival[0] : 0;
+	if(RandSeed < 0)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Random number generator seed '-y%d' must be 0 or greater",RandSeed);
+		exit(1);
+		}
+
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing parameters:");
 
 	const char *pszDescr;
@@ -958,6 +968,10 @@ if (!argerrors)
 		}
 
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"number of threads : %d",NumThreads);
+	if(RandSeed > 0)
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"random number generator seed : %d",RandSeed);
+	else
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"random number generator seed : from current time");
 
 	if(gExperimentID > 0)
 		{
@@ -978,6 +992,7 @@ if (!argerrors)
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(DfltHamming),"hamming",&DfltHamming);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(bTrueInt),"readhamdist",bReadHamDist  == true ? &bTrueInt : &bFalseInt);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(NumThreads),"threads",&NumThreads);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(RandSeed),"seed",&RandSeed);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(SNPrate),"snprate",&SNPrate);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(Region),"genomicregion",&Region);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(UpDnRegLen),"updnreglen",&UpDnRegLen);
@@ -1016,6 +1031,7 @@ if (!argerrors)
 			ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szFeatFile),"featfile",szFeatFile);
 
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(NumThreads),"threads",&NumThreads);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(RandSeed),"seed",&RandSeed);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,sizeof(NumberOfProcessors),"cpus",&NumberOfProcessors);
 
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szSQLiteDatabase),"sumrslts",szSQLiteDatabase);
@@ -1029,7 +1045,7 @@ if (!argerrors)
 	gStopWatch.Start();
 	Rslt = Process((etPMode)PMode,SEMode,bPEgen,PEmin,PEmax,PropRandReads,
 			DistCluster,SeqErrRate,bSeqErrProfile,SNPrate,
-						InDelSize,InDelRate,bReadHamDist,(etFMode)FMode,NumThreads,Strand,NumReads,
+						InDelSize,InDelRate,bReadHamDist,(etFMode)FMode,NumThreads,RandSeed,Strand,NumReads,
 						ReadLen,Artef5Rate,NumArtef5Seqs,pszArtef5Seqs,Artef3Rate,NumArtef3Seqs,pszArtef3Seqs,
 						CutMin,CutMax,bDedupe,DfltHamming,Region,UpDnRegLen,szFeatFile,szInFile,szProfFile,szHammFile,szOutPEFile,szOutFile,szSNPFile);
 	Rslt = Rslt >=0 ? 0 : 1;
@@ -1068,6 +1084,7 @@ Process(etPMode PMode,		// processing mode
 		bool bReadHamDist,	// true if hamming distributions from each sampled read to all other genome subsequences to be generated
 		etFMode FMode,		// output format
 		int NumThreads,		// number of worker threads to use
+		int RandSeed,		// if > 0 then seed random number generators with this value, otherwise seed from current time
 		char Strand,		// generate for this strand '+' or '-' or for both '*'
 		int NumReads,		// number of reads required (will be doubled if paired end reads)
 		int ReadLen,		// read lengths
@@ -1102,7 +1119,7 @@ if((pSimReads = new CSimReads) == NULL)
 
 Rslt = pSimReads->GenSimReads(PMode, SEMode, bPEgen, PEmin, PEmax, PropRandReads, DistCluster,
 		SeqErrRate,	bSeqErrProfile,	SNPrate, InDelSize,	InDelRate, bReadHamDist, FMode,
-		NumThreads,	Strand,	NumReads, ReadLen,	Artef5Rate,	NumArtef5Seqs, pszArtef5Seqs,Artef3Rate,NumArtef3Seqs,	
+		NumThreads,	RandSeed, Strand,	NumReads, ReadLen,	Artef5Rate,	NumArtef5Seqs, pszArtef5Seqs,Artef3Rate,NumArtef3Seqs,	
 		pszArtef3Seqs,	CutMin,	CutMax,	bDedupe,DfltHamming,Region,	UpDnRegLen,	pszFeatFile,pszInFile,pszProfFile,pszHammFile,pszOutPEFile,	pszOutFile,	pszOutSNPs);
 delete pSimReads;
 return(Rslt);
@@ -2440,7 +2457,7 @@ if(pszOutSNPs != NULL && pszOutSNPs[0] != '\0')
 else
 	hFile = -1;
 
-TRandomCombined<CRandomMother,CRandomMersenne> RG((int)time(0));
+TRandomCombined<CRandomMother,CRandomMersenne> RG(RGseeds.IRandom(1,INT_MAX));
 BuffOfs = 0;
 SNPiD = 0;
 for(ChromID = 0; ChromID < m_NumChromSeqs; ChromID++,pChromSeq++)
@@ -3227,6 +3244,7 @@ CSimReads::GenSimReads(etPMode PMode,		// processing mode
 		bool bReadHamDist,	// true if hamming distributions from each sampled read to all other genome subsequences to be generated
 		etFMode FMode,		// output format
 		int NumThreads,		// number of worker threads to use
+		int RandSeed,		// if > 0 then seed random number generators with this value, otherwise seed from current time
 		char Strand,		// generate for this strand '+' or '-' or for both '*'
 		int NumReads,		// number of reads required (will be 2x this number if generating paired ends)
 		int ReadLen,		// read lengths
@@ -3270,7 +3288,7 @@ int MinChromLen;
 
 Init();
 
-RGseeds.RandomInit((int)time(NULL));
+RGseeds.RandomInit(RandSeed > 0 ? RandSeed : (int)time(NULL));
 
 m_PMode = PMode;
 m_FMode = FMode;
@@ -3513,7 +3531,6 @@ PrevNumGenReads = 0;
 ReadsOfs = 0;
 TotReportedReads = 0;
 bFirst =true;
-TRandomCombined<CRandomMother,CRandomMersenne> RGseeds((int)time(0));
 do {
 	// initialise all worker thread parameters and start the threads
 	if(!bDedupe)
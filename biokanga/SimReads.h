@@ -269,6 +269,7 @@ public:
 				bool bReadHamDist,	// true if hamming distributions from each sampled read to all other genome subsequences to be generated
 				etFMode FMode,		// output format
 				int NumThreads,		// number of worker threads to use
+				int RandSeed,		// if > 0 then seed random number generators with this value, otherwise seed from current time
 				char Strand,		// generate for this strand '+' or '-' or for both '*'
 				int NumReads,		// number of reads required (will be 2x this number if generating paired ends)
 				int ReadLen,		// read lengths
@@ -37,12 +37,20 @@ m_NReduceThresSteps = 0;
 m_pAllocdThreadSeqs = NULL;
 m_AllocdThreadSeqsSize = 0;
 memset(m_ThreadSeqBlocks,0,sizeof(m_ThreadSeqBlocks));
+m_IncrSfxFirstNSeqWrds[0] = 0;
+m_IncrSfxFirstNSeqWrds[1] = 0;
+m_NumIncrSfxNewSeqs = 0;
+m_AllocdIncrSfxNewSeqs = 0;
+m_pIncrSfxNewSeqs = NULL;
+m_bCkptActive = false;
+memset(&m_CkptPars,0,sizeof(m_CkptPars));
 }
 
 
 // relies on base classes destructors
 CdeNovoAssemb::~CdeNovoAssemb(void)
 {
+EndCkpt();
 if(m_pAllocdThreadSeqs != NULL)
 	{
 #ifdef _WIN32
@@ -53,6 +61,8 @@ if(m_pAllocdThreadSeqs != NULL)
 #endif	
 	m_pAllocdThreadSeqs = NULL;
 	}
+if(m_pIncrSfxNewSeqs != NULL)
+	delete []m_pIncrSfxNewSeqs;
 }
 
 teBSFrsltCodes
@@ -129,10 +139,13 @@ CdeNovoAssemb::AssembReads(etdeNovoPMode PMode,		// processing mode, currently e
 					char *pszPE2File,				// optional input high confidence seed PE2 sequences file
 					char *pszSeedContigsFile,		// optional input high confidence seed SE contigs file
 					char *pszInArtReducfile,		// optional input preprocessed artefact reduced packed reads from this file
-					char *pszAssembFragsFile)		// where to write assembled sequence fragments as contigs ("SE" appended)
+					char *pszAssembFragsFile,		// where to write assembled sequence fragments as contigs ("SE" appended)
+					int Checkpoint)					// 0: no checkpoints, 1: checkpoint at end of each pass, 2: resume from latest checkpoint and continue checkpointing
 {
 int Rslt;
 int CurPass;				// incremented every merge pass over sequences
+int FirstNSeqWrds;			// index this many initial SeqWrds of each sequence
+bool bRetainRevCplSfx;		// true if suffix array over reverse complemented sequences is being retained between passes
 int CurMinReqPEPrimOverlap;	// if primary probe is overlapping onto a PE then the initial primary overlap (onto PE1 or PE2) must be of at least this length
 int CurMinReqPESecOverlap;	// if primary probe was overlapping onto a PE then the secondary probe overlap (onto PE1 or PE2) must be of at least this length
 int CurMinReqPESumOverlap;	// if primary probe was overlapping onto a PE then the sum of the PE1 and PE2 overlap must be of at least this length
@@ -168,37 +181,72 @@ int RemainingThresSteps;  // remaining threhold reduction steps
 UINT32 PrevNumPartialSeqs2Assemb;
 UINT32 PrevNumSeqs2Assemb;
 
+tsAssembCkpt Ckpt;		// assembly state as checkpointed at the start of each pass
+char szCkptFile[_MAX_PATH+16];
+int ResumedPass;		// if resumed then number of passes which had been completed when checkpointed, 0 if not resumed
+
 m_bSenseStrandOnly = bSenseStrandOnly;		// sequences from sense strand specific
 m_bSingleEnded = bSingleEnded;				// treat all sequences as being single ended even if loaded as paired ends
 
 m_TrimInputEnds = TrimInputEnds;
 m_TrimPE2SE = TrimPE2SE;
 
-// firstly, if specified then load any high confidence seed contigs or SE fragments
-// these are likely to be longer than any SE/PE reads and thus will take longer to process for overlaps
-if(pszSeedContigsFile != NULL && pszSeedContigsFile[0] != '\0')
-	if((Rslt = LoadSeedContigs(pszSeedContigsFile,TrimInputEnds,MinInputSeqLen))  < eBSFSuccess)
-		return((teBSFrsltCodes)Rslt);
+// if resuming then load the latest valid checkpoint, falling back to the previous checkpoint if the latest is missing or incomplete
+ResumedPass = 0;
+if(Checkpoint == 2)
+	{
+	sprintf(szCkptFile,"%s.ckpt",pszAssembFragsFile);
+	if((Rslt = LoadCkpt(szCkptFile,&Ckpt)) == eBSFerrOpnFile)
+		{
+		strcat(szCkptFile,".prev");
+		Rslt = LoadCkpt(szCkptFile,&Ckpt);
+		}
+	if(Rslt == eBSFSuccess)
+		{
+		if(Ckpt.PMode != (INT32)PMode || (Ckpt.bSenseStrandOnly ? true : false) != bSenseStrandOnly || (Ckpt.bSingleEnded ? true : false) != bSingleEnded)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"AssembReads: Checkpoint '%s' was written with a different processing mode, sense strand or single ended option",szCkptFile);
+			return(eBSFerrParams);
+			}
+		ResumedPass = Ckpt.CurPass;
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"AssembReads: Resuming assembly from checkpoint '%s' after pass %d",szCkptFile,ResumedPass);
+		}
+	else
+		{
+		if(Rslt != eBSFerrOpnFile)
+			return((teBSFrsltCodes)Rslt);
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"AssembReads: No valid checkpoint to resume from, starting assembly from input sequences");
+		}
+	}
 
-// if specified then load packed artefact reduced reads
-if(pszInArtReducfile != NULL && pszInArtReducfile[0] != '\0')
-	if((Rslt = LoadPackedSeqsFromFile(pszInArtReducfile)) < eBSFSuccess)
-		return((teBSFrsltCodes)Rslt);
+if(ResumedPass == 0)
+	{
+	// firstly, if specified then load any high confidence seed contigs or SE fragments
+	// these are likely to be longer than any SE/PE reads and thus will take longer to process for overlaps
+	if(pszSeedContigsFile != NULL && pszSeedContigsFile[0] != '\0')
+		if((Rslt = LoadSeedContigs(pszSeedContigsFile,TrimInputEnds,MinInputSeqLen))  < eBSFSuccess)
+			return((teBSFrsltCodes)Rslt);
 
-// next, if specified then load filtered PE1 and PE2 reads
-if(pszPE1File != NULL && pszPE1File[0] != '\0')
-	if((Rslt = LoadSeedPEs(pszPE1File,pszPE2File,OrientatePE,TrimInputEnds,MinInputSeqLen))  < eBSFSuccess)
-		return((teBSFrsltCodes)Rslt);
+	// if specified then load packed artefact reduced reads
+	if(pszInArtReducfile != NULL && pszInArtReducfile[0] != '\0')
+		if((Rslt = LoadPackedSeqsFromFile(pszInArtReducfile)) < eBSFSuccess)
+			return((teBSFrsltCodes)Rslt);
 
-// initialise header flags
-gDiagnostics.DiagOut(eDLInfo,gszProcName,"AssembReads: Initialising sequence headers ...");
-if(bSingleEnded)
-	{
-	UpdateAllSeqHeaderFlags(0,~(cFlgNonOverlap),false);			// any PEs are now single ended
-	m_Sequences.bPESeqs = false;					
+	// next, if specified then load filtered PE1 and PE2 reads
+	if(pszPE1File != NULL && pszPE1File[0] != '\0')
+		if((Rslt = LoadSeedPEs(pszPE1File,pszPE2File,OrientatePE,TrimInputEnds,MinInputSeqLen))  < eBSFSuccess)
+			return((teBSFrsltCodes)Rslt);
+
+	// initialise header flags
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"AssembReads: Initialising sequence headers ...");
+	if(bSingleEnded)
+		{
+		UpdateAllSeqHeaderFlags(0,~(cFlgNonOverlap),false);			// any PEs are now single ended
+		m_Sequences.bPESeqs = false;					
+		}
+	else
+		UpdateAllSeqHeaderFlags(0,~(cFlgSeqPE2 | cFlgSeqPE | cFlgNonOverlap),false);  // just retain flags for paired end or single end sequences 
 	}
-else
-	UpdateAllSeqHeaderFlags(0,~(cFlgSeqPE2 | cFlgSeqPE | cFlgNonOverlap),false);  // just retain flags for paired end or single end sequences 
 
 if(MaxPasses < 0)	// caller just wanted the sequences loaded?
 	{
@@ -212,21 +260,104 @@ if(MaxPasses < 0)	// caller just wanted the sequences loaded?
 	}
 
 // there will be multiple passes until assembly is deemed to have completed
-CurPass = 0;
-MergedPercentage = 100.0;			// ensure will not terminate on 1st pass without trying to merge! 
-bNewThres = false;
-bProcPE = false;
-bAtInterThres = false;
-bAtMinThres = false;
-AllowedSubsKbp = 0;
-AllowedEnd12Subs = 0;
-bUsingSubs = false;
-RemainingThresSteps = NReduceThresSteps;
-
-CurMinPETotSeqLen2SE = (cMinPETotSeqLen2SE*3)/2;
-CurMinPESeqLen2SE = (cMinPESeqLen2SE*3)/2;
+m_IncrSfxFirstNSeqWrds[0] = 0;		// suffix arrays will be generated on the first pass
+m_IncrSfxFirstNSeqWrds[1] = 0;
+m_NumIncrSfxNewSeqs = 0;
+if(ResumedPass > 0)					// continuing with the pass counters and thresholds as checkpointed
+	{
+	CurPass = Ckpt.CurPass;
+	CurMinReqPEPrimOverlap = Ckpt.CurMinReqPEPrimOverlap;
+	CurMinReqPESecOverlap = Ckpt.CurMinReqPESecOverlap;
+	CurMinReqPESumOverlap = Ckpt.CurMinReqPESumOverlap;
+	CurMinReqSEPrimOverlap = Ckpt.CurMinReqSEPrimOverlap;
+	CurMinPEMergeOverlap = Ckpt.CurMinPEMergeOverlap;
+	CurMinPETotSeqLen2SE = Ckpt.CurMinPETotSeqLen2SE;
+	CurMinPESeqLen2SE = Ckpt.CurMinPESeqLen2SE;
+	AllowedSubsKbp = Ckpt.AllowedSubsKbp;
+	AllowedEnd12Subs = Ckpt.AllowedEnd12Subs;
+	RemainingThresSteps = Ckpt.RemainingThresSteps;
+	MergedPercentage = Ckpt.MergedPercentage;
+	bUsingSubs = Ckpt.bUsingSubs ? true : false;
+	bNewThres = Ckpt.bNewThres ? true : false;
+	bProcPE = Ckpt.bProcPE ? true : false;
+	bAtMinThres = Ckpt.bAtMinThres ? true : false;
+	bAtInterThres = Ckpt.bAtInterThres ? true : false;
+
+	m_NReduceThresSteps = Ckpt.NReduceThresSteps;
+	m_MinReqPESumOverlap = Ckpt.MinReqPESumOverlap;
+	m_MinReqPEPrimOverlap = Ckpt.MinReqPEPrimOverlap;
+	m_MinReqPESecOverlap = Ckpt.MinReqPESecOverlap;
+	m_InitialReqPESumOverlap = Ckpt.InitialReqPESumOverlap;
+	m_InitialReqPEPrimOverlap = Ckpt.InitialReqPEPrimOverlap;
+	m_InitialReqPESecOverlap = Ckpt.InitialReqPESecOverlap;
+	m_InitialReqSEPrimOverlap = Ckpt.InitialReqSEPrimOverlap;
+	m_MinReqSEPrimOverlap = Ckpt.MinReqSEPrimOverlap;
+	m_MinPE2SEOvlp = Ckpt.MinPE2SEOvlp;
+	m_MinReqPESepDist = Ckpt.MinReqPESepDist;
+	m_MaxReqPESepDist = Ckpt.MaxReqPESepDist;
+	m_MinReqMergeLen = Ckpt.MinReqMergeLen;
+	m_bProcPE = bProcPE;
+	}
+else
+	{
+	CurPass = 0;
+	MergedPercentage = 100.0;			// ensure will not terminate on 1st pass without trying to merge! 
+	bNewThres = false;
+	bProcPE = false;
+	bAtInterThres = false;
+	bAtMinThres = false;
+	AllowedSubsKbp = 0;
+	AllowedEnd12Subs = 0;
+	bUsingSubs = false;
+	RemainingThresSteps = NReduceThresSteps;
+
+	CurMinPETotSeqLen2SE = (cMinPETotSeqLen2SE*3)/2;
+	CurMinPESeqLen2SE = (cMinPESeqLen2SE*3)/2;
+	}
 
 while(m_Sequences.NumSeqs2Assemb) {       
+	// checkpoint sequences, pass counters and thresholds as at the end of the previous pass
+	// sequences are written by a background thread whilst the index for this pass is being generated
+	if(Checkpoint && CurPass > ResumedPass)
+		{
+		memset(&Ckpt,0,sizeof(Ckpt));
+		Ckpt.PMode = (INT32)PMode;
+		Ckpt.bSenseStrandOnly = bSenseStrandOnly ? 1 : 0;
+		Ckpt.bSingleEnded = bSingleEnded ? 1 : 0;
+		Ckpt.CurPass = CurPass;
+		Ckpt.CurMinReqPEPrimOverlap = CurMinReqPEPrimOverlap;
+		Ckpt.CurMinReqPESecOverlap = CurMinReqPESecOverlap;
+		Ckpt.CurMinReqPESumOverlap = CurMinReqPESumOverlap;
+		Ckpt.CurMinReqSEPrimOverlap = CurMinReqSEPrimOverlap;
+		Ckpt.CurMinPEMergeOverlap = CurMinPEMergeOverlap;
+		Ckpt.CurMinPETotSeqLen2SE = CurMinPETotSeqLen2SE;
+		Ckpt.CurMinPESeqLen2SE = CurMinPESeqLen2SE;
+		Ckpt.AllowedSubsKbp = AllowedSubsKbp;
+		Ckpt.AllowedEnd12Subs = AllowedEnd12Subs;
+		Ckpt.RemainingThresSteps = RemainingThresSteps;
+		Ckpt.MergedPercentage = MergedPercentage;
+		Ckpt.bUsingSubs = bUsingSubs ? 1 : 0;
+		Ckpt.bNewThres = bNewThres ? 1 : 0;
+		Ckpt.bProcPE = bProcPE ? 1 : 0;
+		Ckpt.bAtMinThres = bAtMinThres ? 1 : 0;
+		Ckpt.bAtInterThres = bAtInterThres ? 1 : 0;
+
+		Ckpt.NReduceThresSteps = m_NReduceThresSteps;
+		Ckpt.MinReqPESumOverlap = m_MinReqPESumOverlap;
+		Ckpt.MinReqPEPrimOverlap = m_MinReqPEPrimOverlap;
+		Ckpt.MinReqPESecOverlap = m_MinReqPESecOverlap;
+		Ckpt.InitialReqPESumOverlap = m_InitialReqPESumOverlap;
+		Ckpt.InitialReqPEPrimOverlap = m_InitialReqPEPrimOverlap;
+		Ckpt.InitialReqPESecOverlap = m_InitialReqPESecOverlap;
+		Ckpt.InitialReqSEPrimOverlap = m_InitialReqSEPrimOverlap;
+		Ckpt.MinReqSEPrimOverlap = m_MinReqSEPrimOverlap;
+		Ckpt.MinPE2SEOvlp = m_MinPE2SEOvlp;
+		Ckpt.MinReqPESepDist = m_MinReqPESepDist;
+		Ckpt.MaxReqPESepDist = m_MaxReqPESepDist;
+		Ckpt.MinReqMergeLen = m_MinReqMergeLen;
+		StartCkpt(pszAssembFragsFile,&Ckpt);
+		}
+
 	CurPass += 1;
 	bSubsIncr = false;
 
@@ -258,12 +389,27 @@ while(m_Sequences.NumSeqs2Assemb) {
 	// generate index - if no subs specified then index is required on just on initial SeqWrd of sequence, otherwise it is over 
 	// the 1st 4 SeqWrds as this allows subs in the first 60 bases to be discovered
 	// as an memory optimisation don't create index over the last 2 SeqWrds (could be between 16 and 30 bases in these)     
-	if((Rslt=GenRdsSfx(AllowedSubsKbp == 0 && AllowedEnd12Subs == 0 ? 1 : 4, 2)) < eBSFSuccess)
-		return((teBSFrsltCodes)Rslt);
+	// if the index was incrementally updated when the previous pass combined sequences then only need to regenerate if the number of indexed SeqWrds has changed
+	FirstNSeqWrds = AllowedSubsKbp == 0 && AllowedEnd12Subs == 0 ? 1 : 4;
+	if(m_IncrSfxFirstNSeqWrds[0] != FirstNSeqWrds)
+		{
+		if((Rslt=GenRdsSfx(FirstNSeqWrds, 2)) < eBSFSuccess)
+			{
+			EndCkpt();
+			return((teBSFrsltCodes)Rslt);
+			}
+		m_IncrSfxFirstNSeqWrds[0] = FirstNSeqWrds;
+		}
 
 	// generate array of sequence starts plus array of flags from sequence headers
 	if((Rslt=GenSeqStarts(true,false)) < eBSFSuccess)
+		{
+		EndCkpt();
 		return((teBSFrsltCodes)Rslt);
+		}
+
+	// checkpoint must have been completely written before sequences are modified by this pass
+	EndCkpt();
 
 #ifdef _DEBUG
 #ifdef _WIN32
@@ -400,9 +546,37 @@ while(m_Sequences.NumSeqs2Assemb) {
 		// reverse complement all sequences including PE's
 		PackedRevCplAllIncPEs();
 
-		// regenerate the index on the reverse complemented sequences
-		if((Rslt=GenRdsSfx(AllowedSubsKbp == 0 && AllowedEnd12Subs == 0 ? 1 : 4,2)) < eBSFSuccess)
-			return((teBSFrsltCodes)Rslt);
+		// index on the reverse complemented sequences is retained from the previous pass, and any new or changed sequences merged into it, unless needing to be regenerated 
+		// index on the sense sequences is retained as the alternate index ready for the next pass 
+		// retaining both indexes doubles the suffix array memory so if insufficient memory then the one suffix array is regenerated for both sense and antisense every pass
+		bRetainRevCplSfx = RetainRevCplSfx();
+		if(bRetainRevCplSfx)
+			{
+			ExchangeRdsSfx();
+			Rslt = eBSFSuccess;
+			if(m_IncrSfxFirstNSeqWrds[1] == FirstNSeqWrds && m_NumIncrSfxNewSeqs > 0)
+				{
+				if((Rslt = MergeRdsSfx(FirstNSeqWrds,2,m_pIncrSfxNewSeqs)) < eBSFSuccess)
+					{
+					if(Rslt != eBSFerrMaxEntries)
+						return((teBSFrsltCodes)Rslt);
+					m_IncrSfxFirstNSeqWrds[1] = 0;
+					}
+				}
+			}
+		else
+			{
+			m_IncrSfxFirstNSeqWrds[0] = 0;		// sense index will be overwritten so must be regenerated on next pass
+			m_IncrSfxFirstNSeqWrds[1] = 0;
+			}
+		m_NumIncrSfxNewSeqs = 0;
+		if(m_IncrSfxFirstNSeqWrds[1] != FirstNSeqWrds)
+			{
+			if((Rslt=GenRdsSfx(FirstNSeqWrds,2)) < eBSFSuccess)
+				return((teBSFrsltCodes)Rslt);
+			if(bRetainRevCplSfx)
+				m_IncrSfxFirstNSeqWrds[1] = FirstNSeqWrds;
+			}
 
 		// generate array of sequence starts but do not overwrite existing array of existing flags as these will have been updated during the overlap onto sense processing
 		if((Rslt=GenSeqStarts(false,false)) < eBSFSuccess)
@@ -418,6 +592,8 @@ while(m_Sequences.NumSeqs2Assemb) {
 
 		// reverse complement all sequences including PE's back to their original sense
 		PackedRevCplAllIncPEs();
+		if(bRetainRevCplSfx)
+			ExchangeRdsSfx();
 		// generate array of sequence starts but do not overwrite existing array of existing flags
 		if((Rslt=GenSeqStarts(false,false)) < eBSFSuccess)
 			return((teBSFrsltCodes)Rslt);
@@ -506,6 +682,223 @@ while(m_Sequences.NumSeqs2Assemb) {
 return((teBSFrsltCodes)Rslt);
 }
 
+#ifdef _WIN32
+unsigned __stdcall ThreadedAssembCkpt(void * pThreadPars)
+#else
+void * ThreadedAssembCkpt(void * pThreadPars)
+#endif
+{
+int Rslt = 0;
+tsThreadAssembCkptPars *pPars = (tsThreadAssembCkptPars *)pThreadPars; // makes it easier not having to deal with casts!
+CdeNovoAssemb *pThis = (CdeNovoAssemb *)pPars->pThis;
+Rslt = pThis->WriteCkpt(pPars);
+pPars->Rslt = Rslt;
+#ifdef _WIN32
+_endthreadex(0);
+return(eBSFSuccess);
+#else
+pthread_exit(NULL);
+#endif
+}
+
+// StartCkpt
+// Checkpoint files contain the packed sequences in the same format as written by SavePackedSeqsToFile(), but with sequence header flags retained, followed by the assembly state
+// The packed sequences are written directly from m_Sequences.pSeqs2Assemb by a background thread so these must not be modified until EndCkpt() has returned
+int
+CdeNovoAssemb::StartCkpt(char *pszAssembFragsFile,		// checkpoint file is this file with ".ckpt" appended
+						tsAssembCkpt *pCkpt)			// assembly state to checkpoint along with the sequences
+{
+tsThreadAssembCkptPars *pPars;
+
+EndCkpt();					// can only be one checkpoint being written at any time
+pPars = &m_CkptPars;
+memset(pPars,0,sizeof(tsThreadAssembCkptPars));
+pPars->pThis = this;
+sprintf(pPars->szCkptFile,"%s.ckpt",pszAssembFragsFile);
+
+pPars->Hdr.Magic[0] = 'p';
+pPars->Hdr.Magic[1] = 'r';
+pPars->Hdr.Magic[2] = 'd';
+pPars->Hdr.Magic[3] = 's';
+pPars->Hdr.Version = cPPCRdsFileVersion;
+memmove(&pPars->Hdr.Sequences,&m_Sequences,sizeof(pPars->Hdr.Sequences));
+memset(pPars->Hdr.Sequences.Padd4Ptrs,0,sizeof(pPars->Hdr.Sequences.Padd4Ptrs));	// pointers are meaningless when reloaded
+pPars->Hdr.NumRawFiles = m_NumRawFiles;
+memmove(&pPars->Hdr.SrcFiles,&m_SrcFiles,sizeof(m_SrcFiles));
+pPars->Hdr.FileSize = sizeof(tsPPCRdsFileHdr);
+pPars->Hdr.Sequences.AllocMemSeqs2Assemb = (m_Sequences.Seqs2AssembOfs + 16) * m_Sequences.SeqWrdBytes; // could have overallocated...
+if(pPars->Hdr.Sequences.AllocMemSeqs2Assemb > m_Sequences.AllocMemSeqs2Assemb)
+	pPars->Hdr.Sequences.AllocMemSeqs2Assemb = m_Sequences.AllocMemSeqs2Assemb;
+pPars->Hdr.Sequences.OfsSeqs2Assemb = pPars->Hdr.FileSize;
+pPars->Hdr.FileSize += pPars->Hdr.Sequences.AllocMemSeqs2Assemb;
+pPars->pSeqs2Assemb = m_Sequences.pSeqs2Assemb;
+
+memmove(&pPars->Ckpt,pCkpt,sizeof(tsAssembCkpt));
+pPars->Ckpt.Magic[0] = 'a';
+pPars->Ckpt.Magic[1] = 'c';
+pPars->Ckpt.Magic[2] = 'k';
+pPars->Ckpt.Magic[3] = 'p';
+pPars->Ckpt.Version = cAssembCkptVersion;
+pPars->Ckpt.PackedFileSize = pPars->Hdr.FileSize;
+pPars->Ckpt.NumSeqs2Assemb = m_Sequences.NumSeqs2Assemb;
+pPars->Ckpt.Seqs2AssembOfs = m_Sequences.Seqs2AssembOfs;
+
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"StartCkpt: Writing checkpoint after pass %d to '%s' ...",pCkpt->CurPass,pPars->szCkptFile);
+#ifdef _WIN32
+pPars->threadHandle = (HANDLE)_beginthreadex(NULL,cWorkThreadStackSize,ThreadedAssembCkpt,pPars,0,&pPars->threadID);
+if(pPars->threadHandle == 0)
+#else
+pthread_attr_t threadattr; 
+pthread_attr_init(&threadattr);
+pthread_attr_setstacksize(&threadattr, cWorkThreadStackSize);
+pPars->threadRslt = pthread_create (&pPars->threadID , &threadattr , ThreadedAssembCkpt , pPars);
+pthread_attr_destroy(&threadattr);
+if(pPars->threadRslt != 0)
+#endif
+	{
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"StartCkpt: Unable to start thread to write checkpoint '%s'",pPars->szCkptFile);
+	return(eBSFerrInternal);
+	}
+m_bCkptActive = true;
+return(eBSFSuccess);
+}
+
+// EndCkpt
+// Waits for any checkpoint being written to be completed
+// A failure to write a checkpoint is not treated as fatal, assembly continues and the previously written checkpoint remains as the latest valid checkpoint
+int
+CdeNovoAssemb::EndCkpt(void)
+{
+if(!m_bCkptActive)
+	return(eBSFSuccess);
+#ifdef _WIN32
+while(WAIT_TIMEOUT == WaitForSingleObject(m_CkptPars.threadHandle, 60000));
+CloseHandle(m_CkptPars.threadHandle);
+#else
+struct timespec ts;
+clock_gettime(CLOCK_REALTIME, &ts);
+ts.tv_sec += 60;
+while(pthread_timedjoin_np(m_CkptPars.threadID, NULL, &ts) != 0)
+	ts.tv_sec += 60;
+#endif
+m_bCkptActive = false;
+if(m_CkptPars.Rslt < eBSFSuccess)
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"EndCkpt: Unable to write checkpoint '%s', continuing assembly",m_CkptPars.szCkptFile);
+else
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"EndCkpt: Completed writing checkpoint '%s'",m_CkptPars.szCkptFile);
+return(m_CkptPars.Rslt);
+}
+
+// WriteCkpt
+// Checkpoint is written to a temporary file which, only after having been completely written and synced to disk, replaces the existing checkpoint
+// The existing checkpoint is retained as the previous checkpoint so there will always be at least one complete checkpoint should processing be terminated at any time
+int
+CdeNovoAssemb::WriteCkpt(tsThreadAssembCkptPars *pPars)
+{
+int Rslt;
+int hFile;
+char szTmpFile[_MAX_PATH+32];
+char szPrevFile[_MAX_PATH+32];
+
+sprintf(szTmpFile,"%s.tmp",pPars->szCkptFile);
+sprintf(szPrevFile,"%s.prev",pPars->szCkptFile);
+
+#ifdef _WIN32
+if((hFile = open(szTmpFile, _O_RDWR | _O_BINARY | _O_SEQUENTIAL | _O_CREAT | _O_TRUNC, _S_IREAD | _S_IWRITE ))==-1)
+#else
+if((hFile = open(szTmpFile, O_RDWR | O_CREAT |O_TRUNC, S_IREAD | S_IWRITE))==-1)
+#endif
+	{
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"WriteCkpt: Unable to create or truncate %s - %s",szTmpFile,strerror(errno));
+	return(eBSFerrCreateFile);
+	}
+
+Rslt = ChunkedWrite(hFile,szTmpFile,0,(UINT8 *)&pPars->Hdr,sizeof(tsPPCRdsFileHdr));
+if(Rslt == eBSFSuccess)
+	Rslt = ChunkedWrite(hFile,szTmpFile,pPars->Hdr.Sequences.OfsSeqs2Assemb,(UINT8 *)pPars->pSeqs2Assemb,pPars->Hdr.Sequences.AllocMemSeqs2Assemb);
+if(Rslt == eBSFSuccess)
+	Rslt = ChunkedWrite(hFile,szTmpFile,pPars->Hdr.FileSize,(UINT8 *)&pPars->Ckpt,sizeof(tsAssembCkpt));
+#ifdef _WIN32
+if(Rslt == eBSFSuccess && _commit(hFile) != 0)
+#else
+if(Rslt == eBSFSuccess && fsync(hFile) != 0)
+#endif
+	{
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"WriteCkpt: Unable to sync %s to disk - %s",szTmpFile,strerror(errno));
+	Rslt = eBSFerrFileAccess;
+	}
+close(hFile);
+if(Rslt != eBSFSuccess)
+	{
+	remove(szTmpFile);
+	return(Rslt);
+	}
+
+remove(szPrevFile);
+if(rename(pPars->szCkptFile,szPrevFile) != 0 && errno != ENOENT)
+	{
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"WriteCkpt: Unable to rename %s to %s - %s",pPars->szCkptFile,szPrevFile,strerror(errno));
+	return(eBSFerrFileAccess);
+	}
+if(rename(szTmpFile,pPars->szCkptFile) != 0)
+	{
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"WriteCkpt: Unable to rename %s to %s - %s",szTmpFile,pPars->szCkptFile,strerror(errno));
+	return(eBSFerrFileAccess);
+	}
+return(eBSFSuccess);
+}
+
+// LoadCkpt
+// Validates checkpoint file and, only if valid, then loads the packed sequences and returns the assembly state
+// Returns eBSFerrOpnFile if the checkpoint does not exist or is not a complete checkpoint
+int
+CdeNovoAssemb::LoadCkpt(char *pszCkptFile,				// load from this checkpoint file
+						tsAssembCkpt *pCkpt)			// returned assembly state
+{
+int Rslt;
+int hFile;
+INT64 FileLen;
+tsPPCRdsFileHdr Hdr;
+tsAssembCkpt Ckpt;
+
+if((hFile = open(pszCkptFile,O_READSEQ)) == -1)
+	{
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"LoadCkpt: Unable to open checkpoint %s - %s",pszCkptFile,strerror(errno));
+	return(eBSFerrOpnFile);
+	}
+FileLen = _lseeki64(hFile,0,SEEK_END);		// -1 if unable to seek, rejected as being shorter than the headers
+if(FileLen < (INT64)(sizeof(tsPPCRdsFileHdr) + sizeof(tsAssembCkpt)) ||
+	ChunkedRead(hFile,pszCkptFile,0,(UINT8 *)&Hdr,sizeof(tsPPCRdsFileHdr)) != eBSFSuccess ||
+	Hdr.Magic[0] != 'p' || Hdr.Magic[1] != 'r' || Hdr.Magic[2] != 'd' || Hdr.Magic[3] != 's' ||
+	Hdr.Version != cPPCRdsFileVersion ||
+	(UINT64)FileLen != (Hdr.FileSize + (UINT64)sizeof(tsAssembCkpt)) ||
+	ChunkedRead(hFile,pszCkptFile,Hdr.FileSize,(UINT8 *)&Ckpt,sizeof(tsAssembCkpt)) != eBSFSuccess ||
+	Ckpt.Magic[0] != 'a' || Ckpt.Magic[1] != 'c' || Ckpt.Magic[2] != 'k' || Ckpt.Magic[3] != 'p' ||
+	Ckpt.Version != cAssembCkptVersion ||
+	Ckpt.PackedFileSize != Hdr.FileSize ||
+	Ckpt.NumSeqs2Assemb != Hdr.Sequences.NumSeqs2Assemb ||
+	Ckpt.Seqs2AssembOfs != Hdr.Sequences.Seqs2AssembOfs ||
+	Ckpt.CurPass < 1)
+	{
+	close(hFile);
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"LoadCkpt: %s is not a complete checkpoint",pszCkptFile);
+	return(eBSFerrOpnFile);
+	}
+close(hFile);
+
+if((Rslt = LoadPackedSeqsFromFile(pszCkptFile)) < eBSFSuccess)
+	return(Rslt == eBSFerrOpnFile ? eBSFerrFileAccess : Rslt);
+
+// subsequent checkpoints will be replacing this checkpoint file so no longer keep it open
+if(m_hInSeqTypesFile != -1)
+	{
+	close(m_hInSeqTypesFile);
+	m_hInSeqTypesFile = -1;
+	}
+memmove(pCkpt,&Ckpt,sizeof(tsAssembCkpt));
+return(eBSFSuccess);
+}
+
 
 // PEs (PE1, PE2) can be converted to be processed as if two separate SE sequences if:
 // a) MinPETotSeqLen2SE is > 0 and
@@ -554,10 +947,42 @@ tSeqWrd4 *pTrimSeqWrd;
 
 INT64 PartialSeqsLen;
 
+UINT32 PrevNumSeqs;
+UINT64 PrevSeqs2AssembOfs;
+UINT32 FirstUnmergedPartial;
+UINT32 NumUnmerged;
+UINT32 *pUnmergedSeqIDs;
+UINT64 *pPrevToNewStarts;
+int Rslt;
+
+pUnmergedSeqIDs = NULL;
+pPrevToNewStarts = NULL;
+PrevNumSeqs = m_Sequences.NumSeqs2Assemb;
+PrevSeqs2AssembOfs = m_Sequences.Seqs2AssembOfs;
+
 // if at least one partial then need to iterate over all sequences and add those which have not been flagged as (cFlgAsmbSeed | cFlgAsmbExtn | cFlgAsmbCplt) to
 // the partial sequences ready for the next merge pass
 if(m_NumPartialSeqs2Assemb)	// almost certainly there will be at least one but better check!
 	{
+	// if retaining suffix arrays between passes then need to know which sequences were retained unchanged and their new offsets
+	if(m_IncrSfxFirstNSeqWrds[0] || m_IncrSfxFirstNSeqWrds[1])
+		{
+		pUnmergedSeqIDs = new UINT32 [PrevNumSeqs + 1];
+		pPrevToNewStarts = new UINT64 [PrevNumSeqs + 1];
+		if(pUnmergedSeqIDs == NULL || pPrevToNewStarts == NULL)
+			{
+			if(pUnmergedSeqIDs != NULL)
+				delete []pUnmergedSeqIDs;
+			if(pPrevToNewStarts != NULL)
+				delete []pPrevToNewStarts;
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"CombinePartialsWithUnmerged: Memory allocation for %u sequence offsets failed",PrevNumSeqs);
+			return(eBSFerrMem);
+			}
+		memset(pPrevToNewStarts,0,sizeof(UINT64) * (PrevNumSeqs + 1));
+		}
+	FirstUnmergedPartial = m_NumPartialSeqs2Assemb + 1;
+	NumUnmerged = 0;
+
 	// identify those sequences which were not merged and treat these as if merged so they will be retained for next pass
 	NumSEs = 0;
 	NumPEs = 0;
@@ -592,7 +1017,38 @@ if(m_NumPartialSeqs2Assemb)	// almost certainly there will be at least one but b
 
 		// add to partials ready for next merge pass
 		if((PartialSeqsLen = SavePartialSeqs(PE1SeqLen,pPE1SeqWrd,PE2SeqLen,pPE2SeqWrd)) < (INT64)0)
+			{
+			if(pUnmergedSeqIDs != NULL)
+				{
+				delete []pUnmergedSeqIDs;
+				delete []pPrevToNewStarts;
+				}
 			return((int)PartialSeqsLen);
+			}
+		if(pUnmergedSeqIDs != NULL)
+			{
+			if(pPE2SeqWrd != NULL)
+				pUnmergedSeqIDs[NumUnmerged++] = SeqID - 1;
+			pUnmergedSeqIDs[NumUnmerged++] = SeqID;
+			}
+		}
+
+	if(pUnmergedSeqIDs != NULL)
+		{
+		if(m_pIncrSfxNewSeqs == NULL || m_AllocdIncrSfxNewSeqs < m_NumPartialSeqs2Assemb)
+			{
+			if(m_pIncrSfxNewSeqs != NULL)
+				delete []m_pIncrSfxNewSeqs;
+			m_AllocdIncrSfxNewSeqs = m_NumPartialSeqs2Assemb + (m_NumPartialSeqs2Assemb / 10);
+			if((m_pIncrSfxNewSeqs = new UINT8 [m_AllocdIncrSfxNewSeqs]) == NULL)
+				{
+				m_AllocdIncrSfxNewSeqs = 0;
+				delete []pUnmergedSeqIDs;
+				delete []pPrevToNewStarts;
+				gDiagnostics.DiagOut(eDLFatal,gszProcName,"CombinePartialsWithUnmerged: Memory allocation for %u sequence flags failed",m_NumPartialSeqs2Assemb);
+				return(eBSFerrMem);
+				}
+			}
 		}
 
 	// all sequences to be retained for next pass are now in m_pPartialSeqs2Assemb, copy these back into m_Sequences.pSeqs2Assemb
@@ -695,6 +1151,17 @@ if(m_NumPartialSeqs2Assemb)	// almost certainly there will be at least one but b
 			m_Sequences.Seqs2AssembLen += TrimSeqLen;
 			m_Sequences.NumSeqs2Assemb += 1;
 
+			if(pUnmergedSeqIDs != NULL)	// unmerged sequences copied back without any trimming or PE to SE reclassification are unchanged
+				{
+				if(SeqID >= FirstUnmergedPartial && !bTrim15bp && CvtPEs2SE == 0)
+					{
+					pPrevToNewStarts[pUnmergedSeqIDs[SeqID - FirstUnmergedPartial] - 1] = m_Sequences.Seqs2AssembOfs;
+					m_pIncrSfxNewSeqs[m_Sequences.NumSeqs2Assemb - 1] = 0;
+					}
+				else
+					m_pIncrSfxNewSeqs[m_Sequences.NumSeqs2Assemb - 1] = 1;
+				}
+
 			if((pPackSeq = (tSeqWrd4 *)SetSeqHeader(pPackSeq,m_Sequences.NumSeqs2Assemb,1,SeqFlags,TrimSeqLen,NULL))==NULL)
 				{
 				gDiagnostics.DiagOut(eDLFatal,gszProcName,"CombinePartialsWithUnmerged: SetSeqHeader() failed");
@@ -770,6 +1237,91 @@ if(memreq < m_AllocdPartialSeqs2Assemb)
 	m_pPartialSeqs2Assemb = pAllocd;
 	m_AllocdPartialSeqs2Assemb = (UINT64)memreq;
 	}
+
+if(pPrevToNewStarts != NULL)
+	{
+	Rslt = UpdateIncrSfx(PrevNumSeqs,PrevSeqs2AssembOfs,pPrevToNewStarts);
+	delete []pUnmergedSeqIDs;
+	delete []pPrevToNewStarts;
+	if(Rslt < eBSFSuccess)
+		return(Rslt);
+	}
+return(eBSFSuccess);
+}
+
+// RetainRevCplSfx
+// Retaining the suffix array over the reverse complemented sequences between passes requires a second suffix array, the same size as that over the sense sequences
+// Once allocated it continues to be retained, otherwise it is only allocated if that memory plus a margin is physically available
+bool
+CdeNovoAssemb::RetainRevCplSfx(void)
+{
+UINT64 AvailMem;
+UINT64 ReqMem;
+if(m_AltSfx.pSuffixArray != NULL)
+	return(true);
+AvailMem = CUtility::AvailPhysMem();
+ReqMem = m_Sequences.AllocMemSfx + (m_Sequences.AllocMemSfx / cIncrSfxMemMarginDiv);
+if(AvailMem == 0 || AvailMem >= ReqMem)
+	return(true);
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"AssembReads: Insufficient memory (%llu bytes available, %llu required) to retain the reverse complemented suffix array, suffix arrays will be regenerated",AvailMem,ReqMem);
+return(false);
+}
+
+// UpdateIncrSfx
+// Suffix arrays generated on the previous pass are updated to reflect the combined sequences, rather than being regenerated from all sequences on the next pass
+// Suffixes of sequences which were merged or otherwise changed are removed, suffixes of sequences retained unchanged are relocated to the retained sequence offsets,
+// then suffixes of the new or changed sequences are sorted and merged into the sense suffix array
+// Merging into the reverse complemented suffix array is deferred until the sequences have been reverse complemented on the next pass
+int
+CdeNovoAssemb::UpdateIncrSfx(UINT32 PrevNumSeqs,				// number of sequences before combining
+						UINT64 PrevSeqs2AssembOfs,			// sequences were concatenated to this offset before combining
+						UINT64 *pPrevToNewStarts)			// indexed by previous sequence identifier - 1, start offset of that sequence after combining or 0 if sequence not retained unchanged
+{
+int Rslt;
+INT64 NumRetained;
+UINT32 SeqIdx;
+UINT32 NumNewSeqs;
+
+NumNewSeqs = 0;
+for(SeqIdx = 0; SeqIdx < m_Sequences.NumSeqs2Assemb; SeqIdx++)
+	if(m_pIncrSfxNewSeqs[SeqIdx])
+		NumNewSeqs += 1;
+
+// if most sequences have changed then sorting all suffixes will be about as quick 
+if(m_Sequences.NumSeqStarts != PrevNumSeqs || ((UINT64)NumNewSeqs * 100) > ((UINT64)m_Sequences.NumSeqs2Assemb * cMaxIncrSfxNewPercent))
+	{
+	m_IncrSfxFirstNSeqWrds[0] = 0;
+	m_IncrSfxFirstNSeqWrds[1] = 0;
+	m_NumIncrSfxNewSeqs = 0;
+	return(eBSFSuccess);
+	}
+
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"CombinePartialsWithUnmerged: Incrementally updating suffix arrays with %u new or changed sequences out of %u ...",NumNewSeqs,m_Sequences.NumSeqs2Assemb);
+
+if(m_IncrSfxFirstNSeqWrds[0])
+	{
+	if((NumRetained = RemapRdsSfx(false,PrevSeqs2AssembOfs,pPrevToNewStarts)) < 0)
+		Rslt = (int)NumRetained;
+	else
+		Rslt = NumNewSeqs > 0 ? MergeRdsSfx(m_IncrSfxFirstNSeqWrds[0],2,m_pIncrSfxNewSeqs) : eBSFSuccess;
+	if(Rslt < eBSFSuccess)
+		{
+		if(Rslt == eBSFerrMem)
+			return(Rslt);
+		m_IncrSfxFirstNSeqWrds[0] = 0;			// suffix array will be regenerated on next pass
+		}
+	}
+
+if(m_IncrSfxFirstNSeqWrds[1])
+	{
+	ExchangeRdsSfx();
+	NumRetained = RemapRdsSfx(true,PrevSeqs2AssembOfs,pPrevToNewStarts);
+	ExchangeRdsSfx();
+	if(NumRetained < 0)
+		m_IncrSfxFirstNSeqWrds[1] = 0;
+	else
+		m_NumIncrSfxNewSeqs = NumNewSeqs;
+	}
 return(eBSFSuccess);
 }
 
@@ -782,6 +1334,7 @@ void * ThreadedOverlapExtend(void * pThreadPars)
 int Rslt = 0;
 tsThreadOverlapExtendPars *pPars = (tsThreadOverlapExtendPars *)pThreadPars; // makes it easier not having to deal with casts!
 CdeNovoAssemb *pThis = (CdeNovoAssemb *)pPars->pThis;
+pThis->BindThreadToNUMANode(pPars->ThreadIdx);
 Rslt = pThis->ProcOverlapExtend(pPars);
 pPars->Rslt = Rslt;
 #ifdef _WIN32
@@ -10,6 +10,9 @@
 const size_t cWorkThreadStackSize = (1024*1024*2);	// working threads (can be multiple) stack size
 const int cMaxPEExtndLen = ((cMinPETotSeqLen2SE * 3)/2);	// only allow PE extended length (sum of PE1 and PE2 lengths) to grow to this limit if no overlaps of PE1 onto PE2
 const int cMinErrSeedLen = 60;						// when allowing for substitutions then use this minimum seed length
+const int cMaxIncrSfxNewPercent = 50;				// if more than this percentage of sequences are new or changed by a merge pass then suffix arrays are regenerated instead of incrementally updated
+const int cIncrSfxMemMarginDiv = 8;					// reverse complemented suffix array only retained between passes if its size plus 1/cIncrSfxMemMarginDiv margin is physically available
+const int cAssembCkptVersion = 1;					// assembly checkpoint state version
 
 typedef enum TAG_edeNovoPMode {
 	eAMEAssemble,				// standard de Novo assemble
@@ -103,6 +106,68 @@ typedef struct TAG_sThreadOverlapExtendPars {
 	UINT32 NumPE2Overlapping;		// number of PE2 sequences which overlapped other sequences
 } tsThreadOverlapExtendPars;
 
+// assembly state at the start of a merge pass, appended to the packed sequences in checkpoint files so that assembly can be resumed from that pass
+typedef struct TAG_sAssembCkpt {
+	UINT8 Magic[4];					// checkpoint state magic signature 'ackp'
+	INT32 Version;					// checkpoint state version
+	UINT64 PackedFileSize;			// state was appended to packed sequences with this file size
+	UINT32 NumSeqs2Assemb;			// packed sequences contained this many sequences
+	UINT64 Seqs2AssembOfs;			// packed sequences were concatenated to this offset
+	INT32 PMode;					// processing mode
+	UINT8 bSenseStrandOnly;			// sequences from sense strand specific
+	UINT8 bSingleEnded;				// all sequences treated as being single ended
+
+	INT32 CurPass;					// number of completed merge passes
+	INT32 CurMinReqPEPrimOverlap;	// current thresholds as at the start of the next pass
+	INT32 CurMinReqPESecOverlap;
+	INT32 CurMinReqPESumOverlap;
+	INT32 CurMinReqSEPrimOverlap;
+	INT32 CurMinPEMergeOverlap;
+	INT32 CurMinPETotSeqLen2SE;
+	INT32 CurMinPESeqLen2SE;
+	INT32 AllowedSubsKbp;
+	INT32 AllowedEnd12Subs;
+	INT32 RemainingThresSteps;
+	double MergedPercentage;
+	UINT8 bUsingSubs;
+	UINT8 bNewThres;
+	UINT8 bProcPE;
+	UINT8 bAtMinThres;
+	UINT8 bAtInterThres;
+
+	INT32 NReduceThresSteps;		// thresholds as established on the first pass
+	INT32 MinReqPESumOverlap;
+	INT32 MinReqPEPrimOverlap;
+	INT32 MinReqPESecOverlap;
+	INT32 InitialReqPESumOverlap;
+	INT32 InitialReqPEPrimOverlap;
+	INT32 InitialReqPESecOverlap;
+	INT32 InitialReqSEPrimOverlap;
+	INT32 MinReqSEPrimOverlap;
+	INT32 MinPE2SEOvlp;
+	INT32 MinReqPESepDist;
+	INT32 MaxReqPESepDist;
+	INT32 MinReqMergeLen;
+} tsAssembCkpt;
+
+typedef struct TAG_sThreadAssembCkptPars {
+	void *pThis;					// will be initialised to pt to CdeNovoAssemb instance
+
+#ifdef _WIN32
+	HANDLE threadHandle;			// handle as returned by _beginthreadex()
+	unsigned int threadID;			// identifier as set by _beginthreadex()
+#else
+	int threadRslt;					// result as returned by pthread_create ()
+	pthread_t threadID;				// identifier as set by pthread_create ()
+#endif
+	int Rslt;						// returned result code
+
+	char szCkptFile[_MAX_PATH+16];	// checkpoint file, written first to this file with ".tmp" appended
+	void *pSeqs2Assemb;				// packed sequences to be written
+	tsPPCRdsFileHdr Hdr;			// packed sequences file header as at the start of the pass
+	tsAssembCkpt Ckpt;				// assembly state as at the start of the pass
+} tsThreadAssembCkptPars;
+
 #pragma pack()
 
 class CdeNovoAssemb : public CKangadna
@@ -124,6 +189,32 @@ class CdeNovoAssemb : public CKangadna
 
 	bool m_bProcPE;						// true if assembly processing includes PE sequences, false if for SE or contigs only
 
+	int m_IncrSfxFirstNSeqWrds[2];		// suffix arrays over sense [0], and reverse complemented [1], sequences retained from previous pass index this many initial SeqWrds, 0 if to be regenerated
+	UINT32 m_NumIncrSfxNewSeqs;			// number of sequences, new or changed by previous pass, whose suffixes are yet to be merged into the reverse complemented suffix array
+	UINT32 m_AllocdIncrSfxNewSeqs;		// m_pIncrSfxNewSeqs allocated to hold this many flags
+	UINT8 *m_pIncrSfxNewSeqs;			// flags, indexed by sequence identifier - 1, those sequences which are new or changed by previous pass
+
+	bool m_bCkptActive;					// true whilst a checkpoint is being written by a background thread
+	tsThreadAssembCkptPars m_CkptPars;	// checkpoint being written
+
+	int				// start writing checkpoint, sequences are written by a background thread and must not be modified until EndCkpt() has been called
+			StartCkpt(char *pszAssembFragsFile,			// checkpoint file is this file with ".ckpt" appended
+						tsAssembCkpt *pCkpt);			// assembly state to checkpoint along with the sequences
+
+	int				// wait for any checkpoint being written to complete, returns checkpoint write result
+			EndCkpt(void);
+
+	int				// load checkpoint, returns eBSFSuccess if loaded, eBSFerrOpnFile if no valid checkpoint
+			LoadCkpt(char *pszCkptFile,					// load from this checkpoint file
+						tsAssembCkpt *pCkpt);			// returned assembly state
+
+	bool RetainRevCplSfx(void);			// true if suffix array over reverse complemented sequences can be retained between passes, otherwise both suffix arrays are regenerated every pass
+
+	int				// incrementally update suffix arrays after sequences have been combined, suffix arrays will be regenerated if too many sequences changed
+			UpdateIncrSfx(UINT32 PrevNumSeqs,				// number of sequences before combining
+						UINT64 PrevSeqs2AssembOfs,			// sequences were concatenated to this offset before combining
+						UINT64 *pPrevToNewStarts);			// indexed by previous sequence identifier - 1, start offset of that sequence after combining or 0 if sequence not retained unchanged
+
 	int	// returns 0: no merges, 1: merge but no extension, 2: merge with extension
 		MergeOverlaps(tsThreadOverlapExtendPars *pPars);
 
@@ -180,7 +271,8 @@ public:
 								char *pszPE2File,		  // optional input high confidence seed PE2 sequences file
 								char *pszSeedContigsFile, // optional input high confidence seed SE contigs file
 								char *pszInArtReducfile,  // optional input preprocessed artefact reduced packed reads from this file
-								char *pszAssembFragsFile);  // where to write assembled sequence fragments as contigs ("SE" appended)
+								char *pszAssembFragsFile,	// where to write assembled sequence fragments as contigs ("SE" appended)
+								int Checkpoint = 0);		// 0: no checkpoints, 1: checkpoint at end of each pass, 2: resume from latest checkpoint and continue checkpointing
 
 	teBSFrsltCodes LoadSeqsOnly(bool bSenseStrandOnly,			// process sequences as strand specific
 								bool bSingleEnded,				// treat all sequences as being single ended even if loaded as paired ends
@@ -213,5 +305,7 @@ public:
 
 
 	int ProcOverlapExtend(tsThreadOverlapExtendPars *pPars);	// threaded processing for overlaps
+
+	int WriteCkpt(tsThreadAssembCkptPars *pPars);				// threaded writing of checkpoint
 };
 
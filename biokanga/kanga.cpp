@@ -18,6 +18,7 @@
 #include "../libbiokanga/commhdrs.h"
 #else
 #include <sys/mman.h>
+#include <sys/wait.h>
 #include <pthread.h>
 #include "../libbiokanga/commhdrs.h"
 #endif
@@ -26,6 +27,25 @@
 #include "biokanga.h"
 #include "Aligner.h"
 
+CSfxArrayV3 *gpResidentSfxArray = NULL;		// if not NULL then suffix array which is resident when processing spooled alignment jobs
+char gszResidentSfxFile[_MAX_PATH];			// resident suffix array was loaded from this file
+bool gbResidentBisulfite = false;			// resident suffix array was loaded for bisulfite processing
+bool gbResidentSOLiD = false;				// resident suffix array was loaded for colorspace processing
+CAligner *gpResidentAligner = NULL;			// if not NULL then aligner instance, with its retained allocations, which is reused by each spooled alignment job
+bool gbSpoolValidateJob = false;			// true if only validating a spooled alignment job's parameters, exits with 0 if parameters are valid
+
+int
+ProcessSpooledJobs(char *pszProcName,			// server process name, used when processing jobs
+		char *pszSpoolDir,				// spool directory containing jobs
+		char *pszSfxFile,				// resident suffix array file
+		teSfxLoadMode SfxLoadMode,		// how the suffix array is to be loaded: private memory, or read only shared mapping
+		int SfxKMerIdxLen,				// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
+		bool bBisulfite,				// if true then process for bisulfite methylation patterning
+		bool bSOLiD,					// if true then processing in colorspace
+		char *pszLogFile,				// server diagnostics log file, restored after each job
+		int ScreenLogLevel,				// server screen diagnostics level
+		int FileLogLevel);				// server file diagnostics level
+
 
 int
 Process(etPMode PMode,					// processing mode
@@ -68,6 +88,9 @@ Process(etPMode PMode,					// processing mode
 		teSAMFormat SAMFormat,			// if SAM output format then could be SAM, BAM or BAM compressed dependent on the file extension used
 		int SitePrefsOfs,				// offset read start sites when processing  octamer preferencing, range -100..100
 		int NumThreads,					// number of worker threads to use
+		UINT32 StreamBatchReads,		// if > 0 then stream reads through alignment and reporting in batches of at most this many reads
+		bool bMemoReadSeqs,				// if true then each distinct read sequence is aligned once with duplicate read sequences reusing that alignment
+		etNUMAMode NUMAMode,			// NUMA placement of alignment threads and suffix array index memory
 		char *pszTrackTitle,			// track title if output format is UCSC BED
 		int NumPE1InputFiles,			// number of input PE1 or single ended file specs
 		char *pszPE1InputFiles[],		// names of input files (wildcards allowed unless processing paired ends) containing raw reads
@@ -80,7 +103,10 @@ Process(etPMode PMode,					// processing mode
 		char *pszMarkerFile,			// Output markers to this file
 		char *pszSNPCentroidFile,		// Output SNP centorids (CSV format) to this file (default is for no centroid processing)
 		char *pszSfxFile,				// target as suffix array
+		teSfxLoadMode SfxLoadMode,		// how the suffix array is to be loaded: private memory, or read only shared mapping
+		int SfxKMerIdxLen,				// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
 		char *pszStatsFile,				// aligner induced substitutions stats file
+		char *pszMetricsFile,			// per processing phase timings and counters to this file
 		char *pszMultiAlignFile,		// file to contain reads which are aligned to multiple locations
 		char *pszNoneAlignFile,			// file to contain reads which were non-alignable
 		char *pszSitePrefsFile,			// file to contain aligned reads octamer preferencing
@@ -121,6 +147,9 @@ teSAMFormat SAMFormat;		// if SAM output format then could be either SAM or BAM
 
 int NumberOfProcessors;		// number of installed CPUs
 int NumThreads;				// number of threads (0 defaults to number of CPUs)
+int StreamBatchReads;		// if > 0 then stream reads through alignment and reporting in batches of at most this many reads
+bool bMemoReadSeqs;			// if true then each distinct read sequence is aligned once with duplicate read sequences reusing that alignment
+int NUMAMode;				// NUMA placement of alignment threads and suffix array index memory
 int Quality;				// quality scoring for fastq sequence files
 int MinEditDist;			// any matches must have at least this edit distance to the next best match
 int MaxSubs;				// maximum number of substitutions allowed per 100bp of read length
@@ -149,6 +178,8 @@ bool bLocateBestMatches;			// instead of unique matches then return multiple bes
 char szTrackTitle[cMaxDatasetSpeciesChrom];		// track title if output format is UCSC BED
 char szRsltsFile[_MAX_PATH];			// results to this file
 char szTargFile[_MAX_PATH];				// align against this target suffix array genome file
+int SfxLoadMode;			// suffix array loading: 0 private memory (default), 1 read only shared mapping, 2 read only shared mapping with pages prefaulted
+int SfxKMerIdxLen;			// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
 
 int NumPE1InputFiles;					// number of input PE1 or single ended file spe
 char *pszPE1InputFiles[cMaxInFileSpecs];		// names of input files (wildcards allowed unless processing paired ends) containing raw reads
@@ -175,6 +206,8 @@ char szLociConstraintsFile[_MAX_PATH];  // optional loci base constraints from t
 char szContamFile[_MAX_PATH];			// optional file containing contaminant sequences
 
 char szStatsFile[_MAX_PATH];			// optional output basic distribution counts/stats to this file
+char szMetricsFile[_MAX_PATH];			// optional output per processing phase timings and counters to this file
+char szSpoolDir[_MAX_PATH];				// if resident server mode then process alignment jobs submitted to this spool directory
 char szMultiAlignFile[_MAX_PATH];		// optional output file to contain reads which are aligned to multiple locations
 char szNoneAlignFile[_MAX_PATH];		// optional output file to contain reads which could not be aligned
 char szSitePrefsFile[_MAX_PATH];		// optional output file to contain aligned reads start site octamer preferencing
@@ -223,12 +256,16 @@ struct arg_lit  *chimericrpt = arg_lit0("0","chimericrpt",     "report chimeric
 
 struct arg_int *qual = arg_int0("g","quality","<int>",		    "fastq quality scoring - 0 - Sanger or Illumina 1.8+, 1 = Illumina 1.3+, 2 = Solexa < 1.3, 3 = Ignore quality (default = 3)");
 struct arg_file *sfxfile = arg_file1("I","sfx","<file>",		"align against this suffix array (kangax generated) file");
-struct arg_file *outfile = arg_file1("o","out","<file>",		"output alignments to this file");
+struct arg_int *sfxload = arg_int0(NULL,"sfxload","<int>",		"suffix array loading: 0 private memory (default), 1 read only mapping shared with concurrent alignment processes, 2 as 1 but prefaulted into memory");
+struct arg_int *sfxkmeridx = arg_int0(NULL,"sfxkmeridx","<int>",	"maximum K-mer length of suffix array interval lookup table: 0 no table, or 6..14 (default 0)");
+struct arg_file *outfile = arg_file0("o","out","<file>",		"output alignments to this file");
+struct arg_file *spooldir = arg_file0(NULL,"spooldir","<dir>",	"resident server mode: load suffix array once then process alignment parameter files submitted to this directory as '<name>.job'");
 
 struct arg_int  *microindellen = arg_int0("a","microindellen","<int>", "accept microInDels inclusive of this length: 0 to 20 (default = 0 or no microIndels)");
 struct arg_int  *splicejunctlen = arg_int0("A","splicejunctlen","<int>", "aligning RNA-seq, force flank trim, accept splice junctions separated by at most this distance: 25 to 100000 (default = 0 for DNA non-spliced aligning)");
 
 struct arg_file *statsfile = arg_file0("O","stats","<file>",	"output aligner induced substitution distribution stats (not supported for '-M6' output mode) or paired end length distributions to this file");
+struct arg_file *metricsfile = arg_file0(NULL,"metrics","<file>",	"output per processing phase timings and counters to this file, JSON format if file extension is '.json' otherwise CSV");
 struct arg_file *nonealignfile = arg_file0("j","nonealign","<file>",	"output unalignable reads to this file ");
 struct arg_file *multialignfile = arg_file0("J","multialign","<file>",	"output multialigned reads to this file");
 
@@ -257,6 +294,9 @@ struct arg_str  *title = arg_str0("t","title","<string>",       "track title");
 struct arg_str  *ExcludeChroms = arg_strn("Z","chromexclude",	"<string>",0,cMaxExcludeChroms,"high priority - regular expressions defining chromosomes to exclude");
 struct arg_str  *IncludeChroms = arg_strn("z","chromeinclude",	"<string>",0,cMaxIncludeChroms,"low priority - regular expressions defining chromosomes to include");
 struct arg_int *threads = arg_int0("T","threads","<int>",		"number of processing threads 0..128 (defaults to 0 which sets threads to number of CPU cores)");
+struct arg_int *streambatch = arg_int0(NULL,"streambatch","<int>",	"stream reads through alignment and reporting in batches of this many reads (default 0 to load all reads, range 1000..100000000)");
+struct arg_lit *memoreadseqs = arg_lit0(NULL,"memoreadseqs","align each distinct read sequence once with duplicate read sequences reusing that alignment (default is to align every read)");
+struct arg_int *numa = arg_int0(NULL,"numa","<int>",		"NUMA placement: 0 - none (default), 1 - bind alignment threads round robin to NUMA nodes, 2 - also interleave suffix array pages over all nodes");
 
 struct arg_int *maxmlmatches = arg_int0("R","maxmulti","<int>",	"allow any read to match at most this many genome loci then process according to mlmode (default is 5)");
 struct arg_lit *clampmaxmulti = arg_lit0("X","clampmaxmulti",	 "treat reads mapping to more than limit set with '-R<n>' as if exactly <n> matches (default is not to further process reads exceeding limit set with '-R<n>')");
@@ -289,8 +329,8 @@ void *argtable[] = {help,version,FileLogLevel,LogFile,
 					summrslts,experimentname,experimentdescr,
 					pmode,samplenthrawread,alignstrand,minchimericlen,chimericrpt,pecircularised,peinsertlendist,microindellen,splicejunctlen,solid,pcrartefactwinlen,qual,mlmode,trim5,trim3,minacceptreadlen,maxacceptreadlen,maxmlmatches,rptsamseqsthres,clampmaxmulti,bisulfite,
 					mineditdist,maxsubs,maxns,minflankexacts,pcrprimercorrect,minsnpreads,markerlen,markerpolythres,qvalue,snpnonrefpcnt,format,title,priorityregionfile,nofiltpriority,bestmatches,
-					pe1inputfiles,peproc,pairminlen,pairmaxlen,pairstrand,pe2inputfiles,sfxfile,snpfile,centroidfile,
-					outfile,nonealignfile,multialignfile,statsfile,siteprefsfile,siteprefsofs,lociconstraintsfile,contamsfile,ExcludeChroms,IncludeChroms,threads,
+					pe1inputfiles,peproc,pairminlen,pairmaxlen,pairstrand,pe2inputfiles,sfxfile,sfxload,sfxkmeridx,snpfile,centroidfile,
+					outfile,nonealignfile,multialignfile,statsfile,metricsfile,spooldir,siteprefsfile,siteprefsofs,lociconstraintsfile,contamsfile,ExcludeChroms,IncludeChroms,threads,streambatch,memoreadseqs,numa,
 					end};
 
 char **pAllArgs;
@@ -358,6 +398,44 @@ if (!argerrors)
 	gExperimentID = 0;
 	gProcessID = 0;
 	gProcessingID = 0;
+
+	// if resident server mode then only the suffix array loading parameters are applicable, all other parameters are per job
+	if(spooldir->count)
+		{
+		if(gpResidentSfxArray != NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Resident server mode '--spooldir' can not be requested by an alignment job");
+			exit(1);
+			}
+		strncpy(szSpoolDir,spooldir->filename[0],_MAX_PATH);
+		szSpoolDir[_MAX_PATH-1] = '\0';
+		CUtility::TrimQuotes(szSpoolDir);
+		strncpy(szTargFile,sfxfile->filename[0],_MAX_PATH);
+		szTargFile[_MAX_PATH-1] = '\0';
+		SfxLoadMode = sfxload->count ? sfxload->ival[0] : (int)eSfxLoadPrivate;
+		if(SfxLoadMode < eSfxLoadPrivate || SfxLoadMode >= eSfxLoadPlaceholder)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Suffix array loading mode '--sfxload=%d' must be in range %d..%d",SfxLoadMode,eSfxLoadPrivate,eSfxLoadPlaceholder-1);
+			exit(1);
+			}
+		SfxKMerIdxLen = sfxkmeridx->count ? sfxkmeridx->ival[0] : 0;
+		if(SfxKMerIdxLen != 0 && (SfxKMerIdxLen < cMinSfxKMerIdxLen || SfxKMerIdxLen > cMaxSfxKMerIdxLen))
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Suffix array interval lookup K-mer length '--sfxkmeridx=%d' must be either 0 or in range %d..%d",SfxKMerIdxLen,cMinSfxKMerIdxLen,cMaxSfxKMerIdxLen);
+			exit(1);
+			}
+		bBisulfite = bisulfite->count ? true : false;
+		bSOLiD = solid->count ? true : false;
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"Resident server mode, processing alignment jobs submitted to directory: '%s'",szSpoolDir);
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"Resident suffix array: '%s'",szTargFile);
+		CStopWatch ServerStopWatch;
+		ServerStopWatch.Start();
+		Rslt = ProcessSpooledJobs(argv[0],szSpoolDir,szTargFile,(teSfxLoadMode)SfxLoadMode,SfxKMerIdxLen,bBisulfite,bSOLiD,szLogFile,iScreenLogLevel,iFileLogLevel);
+		Rslt = Rslt >=0 ? 0 : 1;
+		ServerStopWatch.Stop();
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Exit code: %d Total processing time: %s",Rslt,ServerStopWatch.Read());
+		exit(Rslt);
+		}
 	szSQLiteDatabase[0] = '\0';
 	szExperimentName[0] = '\0';
 	szExperimentDescr[0] = '\0';
@@ -379,7 +457,7 @@ if (!argerrors)
 	szSQLiteDatabase[0] = '\0';
 	szExperimentDescr[0] = '\0';
 
-	if(summrslts->count)
+	if(summrslts->count && !gbSpoolValidateJob)
 		{
 		strncpy(szSQLiteDatabase,summrslts->filename[0],sizeof(szSQLiteDatabase)-1);
 		szSQLiteDatabase[sizeof(szSQLiteDatabase)-1] = '\0';
@@ -439,6 +517,7 @@ if (!argerrors)
 	szLociConstraintsFile[0] = '0';
 	szContamFile[0] = '0';
 	szStatsFile[0] = '\0';
+	szMetricsFile[0] = '\0';
 	szMultiAlignFile[0] = '\0';
 	szNoneAlignFile[0] = '\0';
 	szSitePrefsFile[0] = '\0';
@@ -840,6 +919,25 @@ if (!argerrors)
 		}
 
 	strcpy(szTargFile,sfxfile->filename[0]);
+
+	SfxLoadMode = sfxload->count ? sfxload->ival[0] : (int)eSfxLoadPrivate;
+	if(SfxLoadMode < eSfxLoadPrivate || SfxLoadMode >= eSfxLoadPlaceholder)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Suffix array loading mode '--sfxload=%d' must be in range %d..%d",SfxLoadMode,eSfxLoadPrivate,eSfxLoadPlaceholder-1);
+		exit(1);
+		}
+
+	SfxKMerIdxLen = sfxkmeridx->count ? sfxkmeridx->ival[0] : 0;
+	if(SfxKMerIdxLen != 0 && (SfxKMerIdxLen < cMinSfxKMerIdxLen || SfxKMerIdxLen > cMaxSfxKMerIdxLen))
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Suffix array interval lookup K-mer length '--sfxkmeridx=%d' must be either 0 or in range %d..%d",SfxKMerIdxLen,cMinSfxKMerIdxLen,cMaxSfxKMerIdxLen);
+		exit(1);
+		}
+	if(!outfile->count)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: No output file '-o<file>' specified");
+		exit(1);
+		}
 	strcpy(szRsltsFile,outfile->filename[0]);
 
 	SAMFormat = etSAMFformat;
@@ -1025,6 +1123,15 @@ if (!argerrors)
 		}
 	else
 		szStatsFile[0] = '\0';
+
+	if(metricsfile->count)
+		{
+		strncpy(szMetricsFile,metricsfile->filename[0],_MAX_PATH);
+		szMetricsFile[_MAX_PATH-1] = '\0';
+		CUtility::TrimQuotes(szMetricsFile);
+		}
+	else
+		szMetricsFile[0] = '\0';
 	
 	SitePrefsOfs = siteprefsofs->count ? siteprefsofs->ival[0] : cDfltRelSiteStartOfs;
 	if(abs(SitePrefsOfs) > cMaxSitePrefOfs)
@@ -1081,6 +1188,47 @@ if (!argerrors)
 		bFiltPriorityRegions = false;
 		}
 
+	bMemoReadSeqs = memoreadseqs->count ? true : false;
+
+	NUMAMode = numa->count ? numa->ival[0] : (int)eNUMAoff;
+	if(NUMAMode < (int)eNUMAoff || NUMAMode >= (int)eNUMAplaceholder)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: NUMA placement '--numa=%d' must be in range %d..%d",NUMAMode,(int)eNUMAoff,(int)eNUMAplaceholder-1);
+		exit(1);
+		}
+
+	StreamBatchReads = streambatch->count ? streambatch->ival[0] : 0;
+	if(StreamBatchReads != 0)
+		{
+		if(StreamBatchReads < (int)cMinStreamBatchReads || StreamBatchReads > (int)cMaxStreamBatchReads)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Streamed batch size '--streambatch=%d' must be either 0 or in range %u..%u",StreamBatchReads,cMinStreamBatchReads,cMaxStreamBatchReads);
+			exit(1);
+			}
+		// streaming only supports processing which can be completed using the reads within a single batch, or
+		// for SAM/BAM output and SNP processing, completed by merging sorted runs spilled from each batch
+		const char *pszNoStream = NULL;
+		if(MLMode >= eMLuniq)
+			pszNoStream = "multiloci clustering or reporting all multiloci '-r3', '-r4' or '-r5'";
+		else
+			if(PCRartefactWinLen >= 0)
+				pszNoStream = "PCR differential amplification artefact reduction '-k<n>'";
+			else
+				if(szStatsFile[0] != '\0' || szSitePrefsFile[0] != '\0')
+					pszNoStream = "stats '-O<file>' or site preferencing '-8<file>' output";
+				else
+					if(bChimericRpt)
+						pszNoStream = "chimeric trimming reporting '-0'";
+					else
+						if(PEproc == ePEdefault && (microInDelLen > 0 || SpliceJunctLen > 0))
+							pszNoStream = "single ended microInDel '-a<n>' or splice junction '-A<n>' alignments";
+		if(pszNoStream != NULL)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: Streamed batches '--streambatch=%d' not supported with %s",StreamBatchReads,pszNoStream);
+			exit(1);
+			}
+		}
+
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing parameters:");
 
 	const char *pszDescr;
@@ -1256,11 +1404,27 @@ if (!argerrors)
 		gDiagnostics.DiagOutMsgOnly(eDLInfo,"Output paired end sequence length distribution to file: '%s'",szStatsFile[0] == '\0' ? "none specified" : szStatsFile);
 		}
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"input target sequence(s) suffix array file: '%s'",szTargFile);
+	switch(SfxLoadMode) {
+		case eSfxLoadPrivate:
+			gDiagnostics.DiagOutMsgOnly(eDLInfo,"suffix array loading: private memory");
+			break;
+		case eSfxLoadMapShared:
+			gDiagnostics.DiagOutMsgOnly(eDLInfo,"suffix array loading: read only shared mapping");
+			break;
+		case eSfxLoadMapPopulate:
+			gDiagnostics.DiagOutMsgOnly(eDLInfo,"suffix array loading: read only shared mapping, prefaulted");
+			break;
+		}
+	if(SfxKMerIdxLen == 0)
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"suffix array interval lookup table: none");
+	else
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"suffix array interval lookup table K-mer length: at most %d",SfxKMerIdxLen);
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"output results file: '%s'",szRsltsFile);
 
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Output none-aligned reads to fasta file: '%s'",szNoneAlignFile[0] == '\0' ? "none specified" : szNoneAlignFile);
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Output reads with multiple alignments to fasta file: '%s'",szMultiAlignFile[0] == '\0' ? "none specified" : szMultiAlignFile);
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Output aligner induced substitution distributions to file: '%s'",szStatsFile[0] == '\0' ? "none specified" : szStatsFile);
+	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Output per processing phase timings and counters to file: '%s'",szMetricsFile[0] == '\0' ? "none specified" : szMetricsFile);
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Loci base constraints file: '%s'",szLociConstraintsFile[0] == '\0' ? "none specified" : szLociConstraintsFile);
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Contaminant sequences file: '%s'",szContamFile[0] == '\0' ? "none specified" : szContamFile);
 
@@ -1342,6 +1506,23 @@ if (!argerrors)
 		gDiagnostics.DiagOutMsgOnly(eDLInfo,"This processing reference: %s",szExperimentName);
 
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"number of threads : %d",NumThreads);
+	if(StreamBatchReads > 0)
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"stream reads through alignment in batches of : %d reads",StreamBatchReads);
+	else
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"stream reads through alignment in batches : No, all reads loaded");
+	gDiagnostics.DiagOutMsgOnly(eDLInfo,"align each distinct read sequence once : %s",bMemoReadSeqs ? "Yes" : "No");
+	switch(NUMAMode) {
+		case eNUMAoff:
+			pszDescr = "none";
+			break;
+		case eNUMAbind:
+			pszDescr = "bind alignment threads to NUMA nodes";
+			break;
+		case eNUMAinterleave:
+			pszDescr = "bind alignment threads to NUMA nodes and interleave suffix array pages";
+			break;
+		}
+	gDiagnostics.DiagOutMsgOnly(eDLInfo,"NUMA placement : '%s'",pszDescr);
 
 	if(gExperimentID > 0)
 		{
@@ -1409,8 +1590,11 @@ if (!argerrors)
 
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szPriorityRegionFile),"priorityregionfile",szPriorityRegionFile);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szTargFile),"sfx",szTargFile);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,(int)sizeof(SfxLoadMode),"sfxload",&SfxLoadMode);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,(int)sizeof(SfxKMerIdxLen),"sfxkmeridx",&SfxKMerIdxLen);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szRsltsFile),"out",szRsltsFile);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szStatsFile),"stats",szStatsFile);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szMetricsFile),"metrics",szMetricsFile);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szNoneAlignFile),"nonealign",szNoneAlignFile);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szMultiAlignFile),"multialign",szMultiAlignFile);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szSitePrefsFile),"siteprefs",szSitePrefsFile);
@@ -1421,6 +1605,9 @@ if (!argerrors)
 
 		
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,(int)sizeof(NumThreads),"threads",&NumThreads);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,(int)sizeof(StreamBatchReads),"streambatch",&StreamBatchReads);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTBool,(int)sizeof(bMemoReadSeqs),"memoreadseqs",&bMemoReadSeqs);
+		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,(int)sizeof(NUMAMode),"numa",&NUMAMode);
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTInt32,(int)sizeof(NumberOfProcessors),"cpus",&NumberOfProcessors);
 
 		ParamID = gSQLiteSummaries.AddParameter(gExperimentID, gProcessingID,ePTText,(int)strlen(szSQLiteDatabase),"sumrslts",szSQLiteDatabase);
@@ -1429,6 +1616,10 @@ if (!argerrors)
 		}
 
 
+	// if only validating a spooled alignment job's parameters then the job can now be processed by the resident server
+	if(gbSpoolValidateJob)
+		exit(0);
+
 #ifdef _WIN32
 	SetPriorityClass(GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS);
 #endif
@@ -1438,9 +1629,9 @@ if (!argerrors)
 					MinSNPreads,QValue,SNPNonRefPcnt,MarkerLen,MarkerPolyThres,PCRartefactWinLen,(etMLMode)MLMode,
 					MaxMLmatches,bClampMaxMLmatches,bLocateBestMatches,
 					MaxNs,MinEditDist,MaxSubs,Trim5,Trim3,MinAcceptReadLen,MaxAcceptReadLen,MinFlankExacts,PCRPrimerCorrect, MaxRptSAMSeqsThres,
-					(etFMode)FMode,SAMFormat,SitePrefsOfs,NumThreads,szTrackTitle,
-					NumPE1InputFiles,pszPE1InputFiles,NumPE2InputFiles,pszPE2InputFiles,szPriorityRegionFile,bFiltPriorityRegions,szRsltsFile, szSNPFile, szMarkerFile, szSNPCentroidFile, szTargFile,
-					szStatsFile,szMultiAlignFile,szNoneAlignFile,szSitePrefsFile,szLociConstraintsFile,szContamFile,NumIncludeChroms,pszIncludeChroms,NumExcludeChroms,pszExcludeChroms);
+					(etFMode)FMode,SAMFormat,SitePrefsOfs,NumThreads,(UINT32)StreamBatchReads,bMemoReadSeqs,(etNUMAMode)NUMAMode,szTrackTitle,
+					NumPE1InputFiles,pszPE1InputFiles,NumPE2InputFiles,pszPE2InputFiles,szPriorityRegionFile,bFiltPriorityRegions,szRsltsFile, szSNPFile, szMarkerFile, szSNPCentroidFile, szTargFile,(teSfxLoadMode)SfxLoadMode,SfxKMerIdxLen,
+					szStatsFile,szMetricsFile,szMultiAlignFile,szNoneAlignFile,szSitePrefsFile,szLociConstraintsFile,szContamFile,NumIncludeChroms,pszIncludeChroms,NumExcludeChroms,pszExcludeChroms);
 	Rslt = Rslt >=0 ? 0 : 1;
 	if(gExperimentID > 0)
 		{
@@ -1457,6 +1648,12 @@ _ASSERTE( _CrtCheckMemory());
 #endif
 
 	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Exit code: %d Total processing time: %s",Rslt,gStopWatch.Read());
+	if(gpResidentAligner != NULL)		// spooled job processed by the resident server which continues with the next job
+		{
+		// release this job's parsed options; pAllArgs references static storage within CUtility::arg_parsefromfile() which is reused by the next job
+		arg_free(argtable);
+		return(Rslt);
+		}
 	exit(Rslt);
 	}
 else
@@ -1514,6 +1711,9 @@ Process(etPMode PMode,					// processing mode
 		teSAMFormat SAMFormat,			// if SAM output format then could be SAM, BAM or BAM compressed dependent on the file extension used
 		int SitePrefsOfs,				// offset read start sites when processing  octamer preferencing, range -100..100
 		int NumThreads,					// number of worker threads to use
+		UINT32 StreamBatchReads,		// if > 0 then stream reads through alignment and reporting in batches of at most this many reads
+		bool bMemoReadSeqs,				// if true then each distinct read sequence is aligned once with duplicate read sequences reusing that alignment
+		etNUMAMode NUMAMode,			// NUMA placement of alignment threads and suffix array index memory
 		char *pszTrackTitle,			// track title if output format is UCSC BED
 		int NumPE1InputFiles,			// number of input PE1 or single ended file specs
 		char *pszPE1InputFiles[],		// names of input files (wildcards allowed unless processing paired ends) containing raw reads
@@ -1526,7 +1726,10 @@ Process(etPMode PMode,					// processing mode
 		char *pszMarkerFile,			// Output markers to this file
 		char *pszSNPCentroidFile,		// Output SNP centorids (CSV format) to this file (default is for no centroid processing)
 		char *pszSfxFile,				// target as suffix array
+		teSfxLoadMode SfxLoadMode,		// how the suffix array is to be loaded: private memory, or read only shared mapping
+		int SfxKMerIdxLen,				// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
 		char *pszStatsFile,				// aligner induced substitutions stats file
+		char *pszMetricsFile,			// per processing phase timings and counters to this file
 		char *pszMultiAlignFile,		// file to contain reads which are aligned to multiple locations
 		char *pszNoneAlignFile,			// file to contain reads which were non-alignable
 		char *pszSitePrefsFile,			// file to contain aligned reads octamer preferencing
@@ -1540,11 +1743,24 @@ Process(etPMode PMode,					// processing mode
 int Rslt;
 CAligner *pAligner;
 
-if((pAligner = new CAligner)==NULL)
+// if processing a spooled job then reuse the resident aligner instance, and use the resident suffix array if it was loaded from the same file and for same processing mode
+if(gpResidentAligner != NULL)
 	{
-	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: Unable to instantiate CAligner");
-	return(eBSFerrObj);
+	pAligner = gpResidentAligner;
+	if(!stricmp(pszSfxFile,gszResidentSfxFile) && bBisulfite == gbResidentBisulfite && bSOLiD == gbResidentSOLiD)
+		pAligner->SetResidentSfx(gpResidentSfxArray);
+	else
+		{
+		pAligner->SetResidentSfx(NULL);
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"Alignment job suffix array '%s' or processing mode differs from that resident, loading suffix array for this job",pszSfxFile);
+		}
 	}
+else
+	if((pAligner = new CAligner)==NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Fatal: Unable to instantiate CAligner");
+		return(eBSFerrObj);
+		}
 
 Rslt = pAligner->Align(PMode,			// processing mode
 			SampleNthRawRead,			// sample every Nth raw read (or read pair) for processing (1..10000)
@@ -1586,6 +1802,9 @@ Rslt = pAligner->Align(PMode,			// processing mode
 			SAMFormat,					// if SAM output format then could be SAM, BAM or BAM compressed dependent on the file extension used
 			SitePrefsOfs,				// offset read start sites when processing  octamer preferencing, range -100..100
 			NumThreads,					// number of worker threads to use
+			StreamBatchReads,			// if > 0 then stream reads through alignment and reporting in batches of at most this many reads
+			bMemoReadSeqs,				// if true then each distinct read sequence is aligned once with duplicate read sequences reusing that alignment
+			NUMAMode,					// NUMA placement of alignment threads and suffix array index memory
 			pszTrackTitle,				// track title if output format is UCSC BED
 			NumPE1InputFiles,			// number of input PE1 or single ended file specs
 			pszPE1InputFiles,			// names of input files (wildcards allowed unless processing paired ends) containing raw reads
@@ -1598,7 +1817,10 @@ Rslt = pAligner->Align(PMode,			// processing mode
 			pszMarkerFile,				// Output markers to this file
 			pszSNPCentroidFile,			// Output SNP centorids (CSV format) to this file (default is for no centroid processing)
 			pszSfxFile,					// target as suffix array
+			SfxLoadMode,				// how the suffix array is to be loaded: private memory, or read only shared mapping
+			SfxKMerIdxLen,				// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
 			pszStatsFile,				// aligner induced substitutions stats file
+			pszMetricsFile,				// per processing phase timings and counters to this file
 			pszMultiAlignFile,			// file to contain reads which are aligned to multiple locations
 			pszNoneAlignFile,			// file to contain reads which were non-alignable
 			pszSitePrefsFile,			// file to contain aligned reads octamer preferencing
@@ -1609,6 +1831,188 @@ Rslt = pAligner->Align(PMode,			// processing mode
 			NumExcludeChroms,			// number of chromosome expressions to exclude
 			ppszExcludeChroms);			// array of exclude chromosome regular expressions);
 
-delete pAligner;
+if(pAligner != gpResidentAligner)
+	delete pAligner;
 return(Rslt);
-}
\ No newline at end of file
+}
+
+// ProcessSpooledJobs
+// Resident alignment server mode: the suffix array is loaded once and then alignment jobs submitted to the spool directory are processed in job file name order
+// A job is an alignment parameter file, as would be specified with '@<file>', placed into the spool directory with a '.job' extension
+// Jobs are claimed by renaming to '.run' and, on completion, renamed to '.done' or '.failed'
+// Job parameter parsing exits on any parameter error so each job's parameters are first validated in a forked child process, valid
+// jobs are then processed by the server using a resident aligner instance which retains its reusable allocations between jobs
+// Server terminates when a file named 'biokanga.stop' is placed into the spool directory
+// Requires fork(), not supported on Windows
+int
+ProcessSpooledJobs(char *pszProcName,			// server process name, used when processing jobs
+		char *pszSpoolDir,				// spool directory containing jobs
+		char *pszSfxFile,				// resident suffix array file
+		teSfxLoadMode SfxLoadMode,		// how the suffix array is to be loaded: private memory, or read only shared mapping
+		int SfxKMerIdxLen,				// maximum K-mer length of suffix interval lookup table, 0 if no lookup table
+		bool bBisulfite,				// if true then process for bisulfite methylation patterning
+		bool bSOLiD,					// if true then processing in colorspace
+		char *pszLogFile,				// server diagnostics log file, restored after each job
+		int ScreenLogLevel,				// server screen diagnostics level
+		int FileLogLevel)				// server file diagnostics level
+{
+#ifdef _WIN32
+gDiagnostics.DiagOut(eDLFatal,gszProcName,"Resident alignment server mode '--spooldir' is not supported on Windows");
+return(eBSFerrParams);
+#else
+int Rslt;
+int Len;
+int JobStatus;
+int NumJobs;
+int NumJobsFailed;
+pid_t JobPid;
+char szJobsPattern[_MAX_PATH];
+char szStopFile[_MAX_PATH];
+char szJobFile[_MAX_PATH];
+char szRunFile[_MAX_PATH];
+char szRsltFile[_MAX_PATH];
+char szJobParam[_MAX_PATH+1];
+char *pszJobArgv[3];
+char szServerLogFile[_MAX_PATH];
+CSfxArrayV3 *pSfxArray;
+CAligner *pAligner;
+CStopWatch JobStopWatch;
+
+strncpy(szServerLogFile,pszLogFile,_MAX_PATH);
+szServerLogFile[_MAX_PATH-1] = '\0';
+if((pSfxArray = new CSfxArrayV3()) == NULL)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to instantiate CSfxArrayV3");
+	return(eBSFerrObj);
+	}
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Loading resident suffix array file '%s'", pszSfxFile);
+pSfxArray->SetLoadMode(SfxLoadMode);
+pSfxArray->AcceptSampledSfx(true);
+if((Rslt=pSfxArray->Open(pszSfxFile,false,bBisulfite,bSOLiD))!=eBSFSuccess || (Rslt=pSfxArray->SetTargBlock(1)) < eBSFSuccess)
+	{
+	while(pSfxArray->NumErrMsgs())
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,pSfxArray->GetErrMsg());
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to load resident suffix array file '%s'",pszSfxFile);
+	delete pSfxArray;
+	return(Rslt);
+	}
+if(SfxKMerIdxLen > 0 && !bBisulfite)
+	{
+	if((Rslt = pSfxArray->GenSfxKMerIdx(SfxKMerIdxLen)) < 0)
+		{
+		while(pSfxArray->NumErrMsgs())
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,pSfxArray->GetErrMsg());
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to generate suffix array interval lookup table");
+		delete pSfxArray;
+		return(Rslt);
+		}
+	if(Rslt > 0)
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Generated suffix array interval lookup table for %d-mers",Rslt);
+	}
+
+if((pAligner = new CAligner) == NULL)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to instantiate CAligner");
+	delete pSfxArray;
+	return(eBSFerrObj);
+	}
+pAligner->RetainPools(true);
+
+gpResidentAligner = pAligner;
+gpResidentSfxArray = pSfxArray;
+strncpy(gszResidentSfxFile,pszSfxFile,_MAX_PATH);
+gszResidentSfxFile[_MAX_PATH-1] = '\0';
+gbResidentBisulfite = bBisulfite;
+gbResidentSOLiD = bSOLiD;
+
+strcpy(szJobsPattern,pszSpoolDir);
+Len = (int)strlen(szJobsPattern);
+if(Len > 0 && szJobsPattern[Len-1] != '/')
+	strcat(szJobsPattern,"/");
+strcpy(szStopFile,szJobsPattern);
+strcat(szStopFile,"biokanga.stop");
+strcat(szJobsPattern,"*.job");
+
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Resident suffix array loaded, now processing alignment jobs submitted as '%s'",szJobsPattern);
+NumJobs = 0;
+NumJobsFailed = 0;
+CSimpleGlob glob(SG_GLOB_FULLSORT | SG_GLOB_ONLYFILE);
+while(1)
+	{
+	if(access(szStopFile,F_OK) == 0)
+		{
+		remove(szStopFile);
+		break;
+		}
+
+	glob.Init();
+	if(glob.Add(szJobsPattern) < SG_SUCCESS || glob.FileCount() == 0)
+		{
+		sleep(1);
+		continue;
+		}
+
+	// claim the first job, other servers could be processing jobs from the same spool directory
+	strncpy(szJobFile,glob.File(0),_MAX_PATH-5);
+	szJobFile[_MAX_PATH-5] = '\0';
+	Len = (int)strlen(szJobFile);
+	strcpy(szRunFile,szJobFile);
+	strcpy(&szRunFile[Len-4],".run");
+	if(rename(szJobFile,szRunFile) != 0)
+		continue;
+
+	gDiagnostics.DiagOut(eDLInfo,gszProcName,"Processing alignment job '%s'",szJobFile);
+	JobStopWatch.Reset();
+	JobStopWatch.Start();
+	sprintf(szJobParam,"@%s",szRunFile);
+	pszJobArgv[0] = pszProcName;
+	pszJobArgv[1] = szJobParam;
+	pszJobArgv[2] = NULL;
+	fflush(stdout);
+	if((JobPid = fork()) == 0)
+		{
+		// validation is in child process, kanga() will exit() with 0 if job parameters are valid
+		gbSpoolValidateJob = true;
+		kanga(2,pszJobArgv);
+		exit(1);
+		}
+	JobStatus = -1;
+	if(JobPid == -1)
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Unable to fork process for validating alignment job '%s' - %s",szJobFile,strerror(errno));
+	else
+		while(waitpid(JobPid,&JobStatus,0) == -1 && errno == EINTR);
+
+	// parameters are valid so process job using the resident aligner
+	Rslt = -1;
+	if(JobPid != -1 && WIFEXITED(JobStatus) && WEXITSTATUS(JobStatus) == 0)
+		{
+		gStopWatch.Reset();
+		Rslt = kanga(2,pszJobArgv);
+		gDiagnostics.Open(szServerLogFile,(etDiagLevel)ScreenLogLevel,(etDiagLevel)FileLogLevel,true);
+		}
+	JobStopWatch.Stop();
+
+	NumJobs += 1;
+	strcpy(szRsltFile,szJobFile);
+	if(Rslt == 0)
+		{
+		strcpy(&szRsltFile[Len-4],".done");
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"Completed alignment job '%s' in %s",szJobFile,JobStopWatch.Read());
+		}
+	else
+		{
+		NumJobsFailed += 1;
+		strcpy(&szRsltFile[Len-4],".failed");
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"Failed alignment job '%s' after %s",szJobFile,JobStopWatch.Read());
+		}
+	rename(szRunFile,szRsltFile);
+	}
+
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"Resident alignment server stopping, processed %d jobs of which %d failed",NumJobs,NumJobsFailed);
+gpResidentAligner = NULL;
+gpResidentSfxArray = NULL;
+delete pAligner;
+delete pSfxArray;
+return(eBSFSuccess);
+#endif
+}
@@ -41,6 +41,9 @@ CreateBioseqSuffixFile(int Mode,
 					   int MinSeqLen,			// only accept for indexing sequences which are at least this length
 						int SimGenomeSize,		// if 1..120 then simulating indexing of a genome of this size in Gbp.
 					   int MaxThreads,			// max threads
+					   bool bQSortSfx,			// true if suffix array to be sorted using multithreaded qsort instead of induced sorting
+					   bool bPackSeq,			// true if concatenated sequences to be written 2bit packed
+					   int SfxSampleStep,		// suffix array contains only suffixes starting at multiples of this step (1 if all suffixes)
    					   bool bSOLiD,				// true if to process for colorspace (SOLiD)
 						int NumInputFiles,			// number of input file specs
 						char *pszInputFiles[],		// names of input files (wildcards allowed)
@@ -81,6 +84,9 @@ char szTitle[cMBSFShortFileDescrLen];
 char szRefSpecies[cMaxDatasetSpeciesChrom];
 int iMode;									// processing mode
 bool bSOLiD;								// colorspace (SOLiD) generation
+bool bQSortSfx;								// true if suffix array to be sorted using multithreaded qsort instead of induced sorting
+bool bPackSeq;								// true if concatenated sequences to be written 2bit packed
+int SfxSampleStep;							// suffix array contains only suffixes starting at multiples of this step (1 if all suffixes)
 int NumberOfProcessors;						// number of installed CPUs
 int NumThreads;								// number of threads (0 defaults to number of CPUs)
 
@@ -107,6 +113,9 @@ struct arg_str *Descr = arg_str0("d","descr","<string>",		"full description");
 struct arg_str *Title = arg_str0("t","title","<string>",		"short title");
 struct arg_str *RefSpecies = arg_str1("r","ref","<string>",		"reference species");
 struct arg_int *threads = arg_int0("T","threads","<int>",		"number of processing threads 0..128 (defaults to 0 which sets threads to number of CPU cores)");
+struct arg_lit  *qsortsfx = arg_lit0("Q","qsortsfx",            "sort suffix array using multithreaded qsort instead of linear time induced sorting");
+struct arg_lit  *packseq = arg_lit0("P","packseq",              "store sequences 2bit packed, index file is smaller but requires this or a later release (not for colorspace)");
+struct arg_int  *sfxsample = arg_int0("S","sfxsample","<int>",  "sample suffix array, retaining every Nth suffix 1..16 (default 1 retains all), only usable when aligning with this or a later release");
 struct arg_file *summrslts = arg_file0("q","sumrslts","<file>",		"Output results summary to this SQLite3 database file");
 struct arg_str *experimentname = arg_str0("w","experimentname","<str>",		"experiment name SQLite3 database file");
 struct arg_str *experimentdescr = arg_str0("W","experimentdescr","<str>",	"experiment description SQLite3 database file");
@@ -115,7 +124,7 @@ struct arg_end *end = arg_end(200);
 void *argtable[] = {help,version,FileLogLevel,LogFile,
 					summrslts,experimentname,experimentdescr,
 					Mode,minseqlen,simgenomesize,solid,infiles,OutFile,RefSpecies,Descr,Title,
-					threads,end};
+					threads,qsortsfx,packseq,sfxsample,end};
 
 char **pAllArgs;
 int argerrors;
@@ -267,6 +276,19 @@ if (!argerrors)
 		SimGenomeSize = 0;
 
 	bSOLiD = solid->count ? true : false;
+	bQSortSfx = qsortsfx->count ? true : false;
+	bPackSeq = packseq->count ? true : false;
+	if(bPackSeq && bSOLiD)
+		{
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"Warning: colorspace indexes can't be 2bit packed, '-P' ignored");
+		bPackSeq = false;
+		}
+	SfxSampleStep = sfxsample->count ? sfxsample->ival[0] : 1;
+	if(SfxSampleStep < 1 || SfxSampleStep > cMaxSfxSampleStep)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Error: suffix array sampling step '-S%d' must be specified in range 1..%d",SfxSampleStep,cMaxSfxSampleStep);
+		exit(1);
+		}
 
 	int Idx;
 
@@ -395,6 +417,12 @@ if (!argerrors)
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Title text: '%s'",szTitle);
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Descriptive text: '%s'",szDescription);
 	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Number of threads : %d",NumThreads);
+	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Suffix array sorting: '%s'",bQSortSfx ? "multithreaded qsort" : "induced sorting");
+	gDiagnostics.DiagOutMsgOnly(eDLInfo,"Sequences 2bit packed: '%s'",bPackSeq ? "Yes" : "No");
+	if(SfxSampleStep == 1)
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"Suffix array sampling: all suffixes");
+	else
+		gDiagnostics.DiagOutMsgOnly(eDLInfo,"Suffix array sampling: every %dth suffix",SfxSampleStep);
 
 	if(szExperimentName[0] != '\0')
 		gDiagnostics.DiagOutMsgOnly(eDLInfo,"This processing reference: %s",szExperimentName);
@@ -403,7 +431,7 @@ if (!argerrors)
 	SetPriorityClass(GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS);
 #endif
 	gStopWatch.Start();
-	Rslt = CreateBioseqSuffixFile(iMode,MinSeqLen,SimGenomeSize,NumThreads,bSOLiD,NumInputFileSpecs,pszInputFileSpecs,szOutputFileSpec,szRefSpecies,szDescription,szTitle);
+	Rslt = CreateBioseqSuffixFile(iMode,MinSeqLen,SimGenomeSize,NumThreads,bQSortSfx,bPackSeq,SfxSampleStep,bSOLiD,NumInputFileSpecs,pszInputFileSpecs,szOutputFileSpec,szRefSpecies,szDescription,szTitle);
 	Rslt = Rslt >=0 ? 0 : 1;
 	if(gExperimentID > 0)
 		{
@@ -775,6 +803,9 @@ CreateBioseqSuffixFile(int Mode,
 						int MinSeqLen,			// only accept for indexing sequences which are at least this length
 						int SimGenomeSize,		// if 1..1000 then simulating indexing of a genome of this size in Gbp.
 					   int MaxThreads,			// max threads
+					   bool bQSortSfx,			// true if suffix array to be sorted using multithreaded qsort instead of induced sorting
+					   bool bPackSeq,			// true if concatenated sequences to be written 2bit packed
+					   int SfxSampleStep,		// suffix array contains only suffixes starting at multiples of this step (1 if all suffixes)
    					   bool bSOLiD,				// true if to process for colorspace (SOLiD)
 						int NumInputFiles,			// number of input file specs
 						char *pszInputFiles[],		// names of input files (wildcards allowed)
@@ -839,6 +870,9 @@ if(m_pSfxFile == NULL)
 	}
 
 m_pSfxFile->SetMaxQSortThreads(MaxThreads);
+m_pSfxFile->SetSAISSort(!bQSortSfx);
+m_pSfxFile->SetPackedSeq(bPackSeq);
+m_pSfxFile->SetSfxSampleStep(SfxSampleStep);
 
 if(Mode == 2 && (pszDestSfxFile == NULL || pszDestSfxFile[0]=='\0'))
 	Rslt=m_pSfxFile->Open(false,bSOLiD);
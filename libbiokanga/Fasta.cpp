@@ -16,8 +16,21 @@ CFasta::CFasta(void)
 {
 m_hFile = -1;
 m_gzFile = NULL;
+m_pBGZF = NULL;
+m_NumBGZFCkpts = 0;
+m_AllocdBGZFCkpts = 0;
+m_pBGZFCkpts = NULL;
 memset(m_FastaBlocks, 0, sizeof(m_FastaBlocks));
 m_pCurFastaBlock = NULL;
+m_bThreadActive = false;
+m_bTermThread = false;
+#ifdef _WIN32
+m_threadHandle = NULL;
+m_threadID = 0;
+m_JobMutex = NULL;
+m_JobReqEvent = NULL;
+m_JobAckEvent = NULL;
+#endif
 Cleanup();
 }
 
@@ -29,6 +42,7 @@ Cleanup();
 void
 CFasta::Cleanup(void)
 {
+StopReadAhead();		// background thread must be terminated before the file is closed
 if(m_hFile >= 0)
 	{
 	if(!m_bRead)
@@ -47,14 +61,32 @@ if(m_gzFile != NULL)
 	gzclose(m_gzFile);
 	m_gzFile = NULL;
 	}
+if(m_pBGZF != NULL)
+	{
+	bgzf_close(m_pBGZF);
+	m_pBGZF = NULL;
+	}
+m_BGZFOfs = 0;
+if(m_pBGZFCkpts != NULL)
+	{
+	delete []m_pBGZFCkpts;
+	m_pBGZFCkpts = NULL;
+	}
+m_NumBGZFCkpts = 0;
+m_AllocdBGZFCkpts = 0;
 
-for (int Idx = 0; Idx < cNumFastaBlocks; Idx++)
+for (int Idx = 0; Idx < cMaxFastaBlocks; Idx++)
 	{
 	if (m_FastaBlocks[Idx].pBlock != NULL)
-		delete m_FastaBlocks[Idx].pBlock;
+		delete []m_FastaBlocks[Idx].pBlock;
 	}
 memset(m_FastaBlocks, 0, sizeof(m_FastaBlocks));
 m_pCurFastaBlock = NULL;
+m_NumFastaBlocks = 0;
+m_NxtFillBlock = 0;
+m_NxtParseBlock = 0;
+m_NumFilledBlocks = 0;
+m_bReadAheadEOF = false;
 m_FileDescrOfs = 0;
 m_FileReadDescrOfs = 0;
 m_szDescriptor[0] = '\0';
@@ -79,7 +111,9 @@ return(m_StatFileSize);
 int
 CFasta::Open(char *pszFile,						// fasta or fastq file path+name to open
 			 bool Read,							// TRUE if opening for read, FALSE for write
-			 unsigned long BufferSize)			// use this size buffer for staging
+			 unsigned long BufferSize,			// use this size buffer for staging
+			 int NumBlocks,						// when reading then split staging buffer into this many blocks, blocks are readahead by a background thread if 2 or more
+			 int NumThreads)					// when reading BGZF compressed files then inflate using this many threads
 {
 int Rslt;
 if(pszFile == NULL || *pszFile == '\0')
@@ -111,6 +145,29 @@ if(Read)		// read
 
 	// if file has extension of ".gz' then assume that this file has been compressed and needs processing with gzopen/gzread/gzclose
 	int NameLen = (int)strlen(pszFile);
+	if(NameLen >= 4 && !stricmp(".gz",&pszFile[NameLen-3]) && NumThreads > 1 && bgzf_is_bgzf(pszFile))
+		{
+		// BGZF (bgzip'd) files are a series of independently compressed blocks which can be inflated in parallel
+		if(NumThreads > cMaxFastaBGZFThreads)
+			NumThreads = cMaxFastaBGZFThreads;
+		if((m_pBGZF = bgzf_open(pszFile,"r"))==NULL)
+			{
+			AddErrMsg("CFasta::Open","Unable to open %s as a BGZF file - %s",pszFile,strerror(errno));
+			Rslt = eBSFerrOpnFile;
+			Cleanup();
+			return(Rslt);
+			}
+		if(bgzf_mt(m_pBGZF,NumThreads,cFastaBGZFSubBlks)!=0)
+			{
+			AddErrMsg("CFasta::Open","Unable to start %d threads for BGZF decompression of %s",NumThreads,pszFile);
+			Rslt = eBSFerrInternal;
+			Cleanup();
+			return(Rslt);
+			}
+		m_BGZFOfs = 0;
+		m_bIsGZ = true;
+		}
+	else
 	if(NameLen >= 4 && !stricmp(".gz",&pszFile[NameLen-3]))
 		{
 		if((m_gzFile = gzopen(pszFile,"r"))==NULL)
@@ -185,6 +242,20 @@ else			// write
 if((UINT64)BufferSize > (m_StatFileSize+100))			// a little additional never hurts!
 	BufferSize = (UINT32)(m_StatFileSize + 100);
 
+// when reading then the staging buffer is split over NumBlocks so total memory is as if single buffered
+// readahead is pointless if the whole file fits into a single minimum sized block
+if(!Read || NumBlocks < 2 || (!m_bIsGZ && BufferSize <= cMinStageBuffSize))
+	NumBlocks = 1;
+else
+	{
+	if(NumBlocks > cMaxFastaBlocks)
+		NumBlocks = cMaxFastaBlocks;
+	BufferSize /= NumBlocks;
+	if(BufferSize < cMinStageBuffSize)
+		BufferSize = cMinStageBuffSize;
+	}
+m_NumFastaBlocks = NumBlocks;
+
 memset(m_FastaBlocks, 0, sizeof(m_FastaBlocks));
 
 m_pCurFastaBlock = &m_FastaBlocks[0];
@@ -196,9 +267,9 @@ if (m_pCurFastaBlock->pBlock == NULL)
 	return(eBSFerrMem);
 	}
 m_pCurFastaBlock->AllocSize = BufferSize;
-if (m_bRead && cNumFastaBlocks > 1)
+if (m_NumFastaBlocks > 1)
 	{
-	for (int Idx = 1; Idx < cNumFastaBlocks; Idx++)
+	for (int Idx = 1; Idx < m_NumFastaBlocks; Idx++)
 		{
 		m_FastaBlocks[Idx].pBlock = new UINT8[BufferSize];
 		if (m_FastaBlocks[Idx].pBlock == NULL)
@@ -314,7 +385,7 @@ if(NameLen >= 4 && !stricmp(".gz",&pszFile[NameLen-3]))
 	{
 	if((gzdFile = gzopen(pszFile,"r"))==NULL)
 		{
-		delete pBuff;
+		delete []pBuff;
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"FastaEstSizes: Unable to open gzip file '%s'",pszFile);
 		return(0);
 		}
@@ -333,7 +404,7 @@ else
 	if((hFile = open(pszFile,O_READSEQ))== -1)
 		{
 		gDiagnostics.DiagOut(eDLFatal,gszProcName,"FastaEstSizes: Unable to open %s - %s",pszFile,strerror(errno));
-		delete pBuff;
+		delete []pBuff;
 		return(0);
 		}
 	NumInBuff = read(hFile,pBuff,BuffSize);
@@ -344,7 +415,7 @@ else
 if(NumInBuff < 10)			// what kind of fasta file would be this small :-)
 	{
 	gDiagnostics.DiagOut(eDLFatal,gszProcName,"FastaEstSizes: Unable to estimate sizes for file '%s', file exists but is only %d long",pszFile,NumInBuff);
-	delete pBuff;
+	delete []pBuff;
 	return(0);
 	}
 pBuff[NumInBuff] = 0;
@@ -437,7 +508,7 @@ while((Chr = *pChr++) != '\0')
 		}
 	}
 
-delete pBuff;
+delete []pBuff;
 
 if(!bIsGZ)
 	{
@@ -513,12 +584,22 @@ bool bSkipEOL;		// true if remainder of current line not to be parsed
 bool bIscsfasta;	// true if file has been determined to be SOLiD csfasta format
 bool bIsfasta;		// true if file has been determined to be basespace
 
-if(m_gzFile == NULL && m_hFile == -1)
+if(m_gzFile == NULL && m_pBGZF == NULL && m_hFile == -1)
 	return(eBSFerrFileClosed);
 
 if((pszBuff = new char [cChkFastaSize]) == NULL)
 	return(eBSFerrMem);
 
+if(m_pBGZF != NULL)
+	{
+	BuffCnt = (int)bgzf_read(m_pBGZF,pszBuff,cChkFastaSize-1);
+	if(SeekBGZF(0)!=0)
+		{
+		delete []pszBuff;	
+		return(eBSFerrFileAccess);
+		}
+	}
+else
 if(m_gzFile != NULL)
 	{
 	gzseek(m_gzFile,0,SEEK_SET);
@@ -532,7 +613,7 @@ else
 	BuffCnt = read(m_hFile,pszBuff,cChkFastaSize-1);
 	if(_lseeki64(m_hFile,0,SEEK_SET)!=0)	
 		{
-		delete pszBuff;	
+		delete []pszBuff;	
 		return(eBSFerrFileAccess);
 		}
 	}
@@ -540,7 +621,7 @@ else
 if(BuffCnt < 4)		// not interested in fasta or fastq sequences which are too short!
 	{
 	AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file - '%s' file too short, less than 4 chrs", m_szFile);
-	delete pszBuff;	
+	delete []pszBuff;	
 	return(eBSFerrNotFasta);
 	}
 
@@ -549,7 +630,7 @@ if((pszBuff[0] == 'b' && pszBuff[1] == 'i' && pszBuff[2] == 'o') ||
    (pszBuff[0] == 's' && pszBuff[1] == 'f' && pszBuff[2] == 'x'))
 	{
 	AddErrMsg("CFasta::CheckIsFasta","Not a fasta file, could be a bioseq/biosfx file - '%s'", m_szFile);
-	delete pszBuff;	
+	delete []pszBuff;	
 	return(eBSFerrNotFasta);
 	}
 
@@ -586,7 +667,7 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 	if(!isspace(*pChr) && (*pChr < 0x20 || (unsigned char)*pChr > 0x7f))
 		{
 		AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - illegal chr 0x%x", CurLineNum,ChrPsn, m_szFile,*pChr);
-		delete pszBuff;	
+		delete []pszBuff;	
 		return(eBSFerrNotFasta);
 		}
 	
@@ -633,7 +714,7 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 					break;
 				}
 			AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - unexpected chr '%c'",CurLineNum,ChrPsn, m_szFile,*pChr);
-			delete pszBuff;	
+			delete []pszBuff;	
 			return(eBSFerrNotFasta);
 
 		case 1:	// presumed fasta and expecting either descriptor or sequence
@@ -657,7 +738,7 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 					break;
 				}
 			AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - illegal chr '%c'",CurLineNum,ChrPsn, m_szFile,*pChr);
-			delete pszBuff;	
+			delete []pszBuff;	
 			return(eBSFerrNotFasta);
 
 		case 2:	// presumed fasta file and reading the descriptor line
@@ -714,7 +795,7 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 						break;
 					}
 			AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - non-sequence chr '%c'",CurLineNum,ChrPsn, m_szFile,*pChr);
-			delete pszBuff;	
+			delete []pszBuff;	
 			return(eBSFerrNotFasta);
 		
 		case 4:	// presumed fastq file and seq identifier line
@@ -742,7 +823,7 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 					if(bIsFastQSOLiD && Base != '.')
 						{
 						AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - expected SOLiD base representation", CurLineNum,ChrPsn,m_szFile);
-						delete pszBuff;	
+						delete []pszBuff;	
 						return(eBSFerrNotFasta);
 						}
 					NumSeqChrs+=1;
@@ -757,14 +838,14 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 						continue;
 						}
 					AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - unexpected SOLiD base representation", CurLineNum,ChrPsn,m_szFile);
-					delete pszBuff;	
+					delete []pszBuff;	
 					return(eBSFerrNotFasta);
 						
 				default:
 					break;
 				}
 			AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - non-sequence chr '%d'", CurLineNum,ChrPsn,m_szFile,*pChr);
-			delete pszBuff;	
+			delete []pszBuff;	
 			return(eBSFerrNotFasta);
 
 		case 6:	// presumed fastq file and reading the duplicate seq ident line
@@ -780,7 +861,7 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 				continue;
 				}
 			AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - expected '+' not chr '%c'", CurLineNum,ChrPsn,m_szFile,*pChr);
-			delete pszBuff;	
+			delete []pszBuff;	
 			return(eBSFerrNotFasta);
 
 		case 7:					// processing fastq duplicate seq identifier line
@@ -802,7 +883,7 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 			if(NumQualChrs != NumSeqChrs)
 				{
 				AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d - '%s' - sequence length (%d) not same as quality length (%d)", CurLineNum,m_szFile,NumSeqChrs,NumQualChrs);
-				delete pszBuff;	
+				delete []pszBuff;	
 				return(eBSFerrNotFasta);
 				}
 			CurLineNum += 1;
@@ -822,11 +903,11 @@ for(BuffIdx = 0; BuffIdx < BuffCnt; BuffIdx++,pChr++)
 				continue;
 				}
 			AddErrMsg("CFasta::CheckIsFasta","Errors whilst reading file near line %d#%d - '%s' - expected '@' not chr '%c'", CurLineNum,ChrPsn,m_szFile,*pChr);
-			delete pszBuff;	
+			delete []pszBuff;	
 			return(eBSFerrNotFasta);
 		}
 	}
-delete pszBuff;	
+delete []pszBuff;	
 m_bIsFastQ = FileState >= 4 ? true : false;
 m_bIscsfasta = bIscsfasta;
 return(eBSFSuccess);	
@@ -853,11 +934,15 @@ return(m_bIscsfasta);
 int
 CFasta::Reset(INT64 FileOfs)
 {
-if(m_hFile == -1 && m_gzFile == NULL)
+if(m_hFile == -1 && m_gzFile == NULL && m_pBGZF == NULL)
 	return(eBSFerrClosed);		
+StopReadAhead();
 INT64 SeekPsn;
 if(m_hFile != -1)
 	SeekPsn = _lseeki64(m_hFile,FileOfs,SEEK_SET);
+else
+	if(m_pBGZF != NULL)
+		SeekPsn = SeekBGZF(FileOfs);
 else
 	SeekPsn = gzseek(m_gzFile,(long)FileOfs,SEEK_SET);
 if(SeekPsn != FileOfs)
@@ -883,6 +968,372 @@ return(eBSFSuccess);
 }
 
 
+// AddBGZFCkpt
+// Records the BGZF virtual file offset corresponding to the current uncompressed offset, checkpoints are in increasing offset order
+void
+CFasta::AddBGZFCkpt(void)
+{
+tsBGZFCkpt *pTmp;
+if(m_NumBGZFCkpts > 0 && m_pBGZFCkpts[m_NumBGZFCkpts-1].UncomprOfs >= m_BGZFOfs)	// already checkpointed when previously read
+	return;
+if(m_pBGZFCkpts == NULL || m_NumBGZFCkpts == m_AllocdBGZFCkpts)
+	{
+	if((pTmp = new tsBGZFCkpt [m_AllocdBGZFCkpts + cAllocBGZFCkpts]) == NULL)
+		return;
+	if(m_pBGZFCkpts != NULL)
+		{
+		memcpy(pTmp,m_pBGZFCkpts,sizeof(tsBGZFCkpt) * m_NumBGZFCkpts);
+		delete []m_pBGZFCkpts;
+		}
+	m_pBGZFCkpts = pTmp;
+	m_AllocdBGZFCkpts += cAllocBGZFCkpts;
+	}
+m_pBGZFCkpts[m_NumBGZFCkpts].UncomprOfs = m_BGZFOfs;
+m_pBGZFCkpts[m_NumBGZFCkpts++].VirtOfs = bgzf_tell(m_pBGZF);
+}
+
+// SeekBGZF
+// BGZF virtual file offsets are not offsets into the uncompressed content so seeks are to the virtual offset of the closest checkpoint
+// at or before FileOfs, recorded as blocks were read, followed by reading through to FileOfs
+INT64								// returns uncompressed offset seeked to, -1 if errors
+CFasta::SeekBGZF(INT64 FileOfs)		// seek to this uncompressed offset
+{
+UINT8 *pSkipBuff;
+int ReqLen;
+int ReadLen;
+int Lo;
+int Hi;
+int Mid;
+INT64 VirtOfs;
+
+VirtOfs = 0;
+m_BGZFOfs = 0;
+if(FileOfs > 0 && m_NumBGZFCkpts > 0)
+	{
+	Lo = 0;
+	Hi = m_NumBGZFCkpts - 1;
+	while(Lo < Hi)				// locate last checkpoint with UncomprOfs <= FileOfs
+		{
+		Mid = (Lo + Hi + 1) / 2;
+		if(m_pBGZFCkpts[Mid].UncomprOfs <= FileOfs)
+			Lo = Mid;
+		else
+			Hi = Mid - 1;
+		}
+	if(m_pBGZFCkpts[Lo].UncomprOfs <= FileOfs)
+		{
+		VirtOfs = m_pBGZFCkpts[Lo].VirtOfs;
+		m_BGZFOfs = m_pBGZFCkpts[Lo].UncomprOfs;
+		}
+	}
+if(bgzf_seek(m_pBGZF,VirtOfs,SEEK_SET) != 0)
+	{
+	m_BGZFOfs = 0;
+	return(-1);
+	}
+if(FileOfs <= m_BGZFOfs)
+	return(m_BGZFOfs);
+if((pSkipBuff = new UINT8 [BGZF_MAX_BLOCK_SIZE]) == NULL)
+	return(-1);
+while(m_BGZFOfs < FileOfs)
+	{
+	ReqLen = (int)min((INT64)BGZF_MAX_BLOCK_SIZE,FileOfs - m_BGZFOfs);
+	if((ReadLen = (int)bgzf_read(m_pBGZF,pSkipBuff,ReqLen)) <= 0)
+		break;
+	m_BGZFOfs += ReadLen;
+	}
+delete []pSkipBuff;
+return(m_BGZFOfs);
+}
+
+// FillBlock
+// Reads next chunk of file content into pBlock, returns number of chars read (0 if EOF, < 0 if errors)
+// Called by the background readahead thread if readahead active, otherwise by the parsing thread
+int
+CFasta::FillBlock(tsFastaBlock *pBlock)
+{
+INT64 FileOfs;			// will contain file offset corresponding to block read from file
+if(m_pBGZF != NULL)
+	{
+	FileOfs = m_BGZFOfs;
+	AddBGZFCkpt();
+	pBlock->BuffCnt = (INT32)bgzf_read(m_pBGZF, pBlock->pBlock, pBlock->AllocSize);
+	if(pBlock->BuffCnt > 0)
+		m_BGZFOfs += pBlock->BuffCnt;
+	}
+else
+if(m_gzFile != NULL)
+	{
+	FileOfs = gztell(m_gzFile);
+	pBlock->BuffCnt = gzread(m_gzFile, pBlock->pBlock, pBlock->AllocSize);
+	}
+else
+	{
+	FileOfs = _lseeki64(m_hFile,0,SEEK_CUR);
+	pBlock->BuffCnt = read(m_hFile, pBlock->pBlock, pBlock->AllocSize);
+	}
+if(pBlock->BuffCnt > 0)
+	{
+	pBlock->BuffIdx = 0;
+	pBlock->FileOfs = FileOfs;
+	}
+return(pBlock->BuffCnt);
+}
+
+// ReadNextBlock
+// Makes the next block of file content the current block to be parsed
+// If readahead is active then the block will normally have already been read by the background thread
+// Returns number of chars in new current block (0 if EOF, < 0 if errors)
+int
+CFasta::ReadNextBlock(void)
+{
+if(m_NumFastaBlocks < 2)			// no readahead, synchronously read into current block
+	return(FillBlock(m_pCurFastaBlock));
+
+if(!m_bThreadActive && StartReadAhead() != eBSFSuccess)
+	{
+	m_pCurFastaBlock->BuffCnt = -1;
+	return(-1);
+	}
+
+#ifdef _WIN32
+WaitForSingleObject(m_JobMutex,INFINITE);
+while(m_NumFilledBlocks == 0 && !m_bReadAheadEOF)
+	{
+	ReleaseMutex(m_JobMutex);
+	WaitForSingleObject(m_JobAckEvent,cFastaSigWaitSecs * 1000);
+	WaitForSingleObject(m_JobMutex,INFINITE);
+	}
+#else
+struct timespec abstime;
+pthread_mutex_lock(&m_JobMutex);
+while(m_NumFilledBlocks == 0 && !m_bReadAheadEOF)
+	{
+	clock_gettime(CLOCK_REALTIME,&abstime);
+	abstime.tv_sec += cFastaSigWaitSecs;
+	pthread_cond_timedwait(&m_JobAckEvent,&m_JobMutex,&abstime);
+	}
+#endif
+if(m_NumFilledBlocks > 0)		// if none then EOF (or error) block was previously returned and is still current
+	{
+	m_pCurFastaBlock = &m_FastaBlocks[m_NxtParseBlock];
+	m_NxtParseBlock = (m_NxtParseBlock + 1) % m_NumFastaBlocks;
+	m_NumFilledBlocks -= 1;
+	// block previously being parsed is now available to background thread for filling
+#ifdef _WIN32
+	SetEvent(m_JobReqEvent);
+#else
+	pthread_cond_signal(&m_JobReqEvent);
+#endif
+	}
+#ifdef _WIN32
+ReleaseMutex(m_JobMutex);
+#else
+pthread_mutex_unlock(&m_JobMutex);
+#endif
+return(m_pCurFastaBlock->BuffCnt);
+}
+
+// StartReadAhead
+// Creates background thread which reads blocks ahead of the block currently being parsed
+// Thread starts reading from the current file position into the block following the current block
+int
+CFasta::StartReadAhead(void)
+{
+if(m_bThreadActive)
+	return(eBSFSuccess);
+
+m_NxtFillBlock = (int)((m_pCurFastaBlock - m_FastaBlocks) + 1) % m_NumFastaBlocks;
+m_NxtParseBlock = m_NxtFillBlock;
+m_NumFilledBlocks = 0;
+m_bReadAheadEOF = false;
+m_bTermThread = false;
+
+#ifdef _WIN32
+if((m_JobMutex = CreateMutex(NULL,false,NULL))==NULL)
+#else
+if(pthread_mutex_init (&m_JobMutex,NULL)!=0)
+#endif
+	{
+	AddErrMsg("CFasta::StartReadAhead","Fatal: unable to create m_JobMutex");
+	return(eBSFerrInternal);
+	}
+
+#ifdef _WIN32
+if((m_JobReqEvent = CreateEvent(NULL,false,false,NULL))==NULL)
+#else
+if(pthread_cond_init(&m_JobReqEvent,NULL)!=0)
+#endif
+	{
+	AddErrMsg("CFasta::StartReadAhead","Fatal: unable to create m_JobReqEvent");
+#ifdef _WIN32
+	CloseHandle(m_JobMutex);
+	m_JobMutex = NULL;
+#else
+	pthread_mutex_destroy(&m_JobMutex);
+#endif
+	return(eBSFerrInternal);
+	}
+
+#ifdef _WIN32
+if((m_JobAckEvent = CreateEvent(NULL,false,false,NULL))==NULL)
+#else
+if(pthread_cond_init(&m_JobAckEvent,NULL)!=0)
+#endif
+	{
+	AddErrMsg("CFasta::StartReadAhead","Fatal: unable to create m_JobAckEvent");
+#ifdef _WIN32
+	CloseHandle(m_JobMutex);
+	m_JobMutex = NULL;
+	CloseHandle(m_JobReqEvent);
+	m_JobReqEvent = NULL;
+#else
+	pthread_mutex_destroy(&m_JobMutex);
+	pthread_cond_destroy(&m_JobReqEvent);
+#endif
+	return(eBSFerrInternal);
+	}
+
+#ifdef _WIN32
+if((m_threadHandle = (HANDLE)_beginthreadex(NULL,0x0fffff,ThreadedReadAhead,this,0,&m_threadID))==NULL)
+	{
+	AddErrMsg("CFasta::StartReadAhead","Fatal: unable to create background readahead thread");
+	CloseHandle(m_JobMutex);
+	m_JobMutex = NULL;
+	CloseHandle(m_JobReqEvent);
+	m_JobReqEvent = NULL;
+	CloseHandle(m_JobAckEvent);
+	m_JobAckEvent = NULL;
+	return(eBSFerrInternal);
+	}
+#else
+if((m_threadRslt = pthread_create (&m_threadID , NULL , ThreadedReadAhead , this ))!=0)
+	{
+	AddErrMsg("CFasta::StartReadAhead","Fatal: unable to create background readahead thread");
+	pthread_mutex_destroy(&m_JobMutex);
+	pthread_cond_destroy(&m_JobReqEvent);
+	pthread_cond_destroy(&m_JobAckEvent);
+	return(eBSFerrInternal);
+	}
+#endif
+m_bThreadActive = true;
+return(eBSFSuccess);
+}
+
+// StopReadAhead
+// Terminates background readahead thread if active
+// Must be called before any file seeks as the background thread will otherwise be concurrently reading from the file
+void
+CFasta::StopReadAhead(void)
+{
+if(!m_bThreadActive)
+	return;
+#ifdef _WIN32
+WaitForSingleObject(m_JobMutex,INFINITE);
+m_bTermThread = true;
+SetEvent(m_JobReqEvent);
+ReleaseMutex(m_JobMutex);
+WaitForSingleObject(m_threadHandle,INFINITE);
+CloseHandle(m_threadHandle);
+CloseHandle(m_JobMutex);
+CloseHandle(m_JobReqEvent);
+CloseHandle(m_JobAckEvent);
+m_threadHandle = NULL;
+m_JobMutex = NULL;
+m_JobReqEvent = NULL;
+m_JobAckEvent = NULL;
+#else
+pthread_mutex_lock(&m_JobMutex);
+m_bTermThread = true;
+pthread_cond_signal(&m_JobReqEvent);
+pthread_mutex_unlock(&m_JobMutex);
+pthread_join(m_threadID,NULL);
+pthread_mutex_destroy(&m_JobMutex);
+pthread_cond_destroy(&m_JobReqEvent);
+pthread_cond_destroy(&m_JobAckEvent);
+#endif
+m_bThreadActive = false;
+m_bTermThread = false;
+m_NumFilledBlocks = 0;
+m_bReadAheadEOF = false;
+}
+
+// ThreadedReadAhead
+// Background thread fills blocks, in ring order, following the block currently being parsed
+// Filling stops when all blocks other than that being parsed are filled, and resumes when signalled through m_JobReqEvent that a block has been parsed
+// Filled blocks are notified to the parsing thread through m_JobAckEvent
+#ifdef _WIN32
+unsigned __stdcall CFasta::ThreadedReadAhead(void * pThreadPars)
+#else
+void *CFasta::ThreadedReadAhead(void * pThreadPars)
+#endif
+{
+CFasta *pFasta = (CFasta *)pThreadPars;
+tsFastaBlock *pBlock;
+int BuffCnt;
+
+while(1) {
+#ifdef _WIN32
+	WaitForSingleObject(pFasta->m_JobMutex,INFINITE);
+	while(!pFasta->m_bTermThread && (pFasta->m_bReadAheadEOF || pFasta->m_NumFilledBlocks >= pFasta->m_NumFastaBlocks - 1))
+		{
+		ReleaseMutex(pFasta->m_JobMutex);
+		WaitForSingleObject(pFasta->m_JobReqEvent,cFastaSigWaitSecs * 1000);
+		WaitForSingleObject(pFasta->m_JobMutex,INFINITE);
+		}
+	if(pFasta->m_bTermThread)
+		{
+		ReleaseMutex(pFasta->m_JobMutex);
+		break;
+		}
+	pBlock = &pFasta->m_FastaBlocks[pFasta->m_NxtFillBlock];
+	ReleaseMutex(pFasta->m_JobMutex);
+#else
+	struct timespec abstime;
+	pthread_mutex_lock(&pFasta->m_JobMutex);
+	while(!pFasta->m_bTermThread && (pFasta->m_bReadAheadEOF || pFasta->m_NumFilledBlocks >= pFasta->m_NumFastaBlocks - 1))
+		{
+		clock_gettime(CLOCK_REALTIME,&abstime);
+		abstime.tv_sec += cFastaSigWaitSecs;
+		pthread_cond_timedwait(&pFasta->m_JobReqEvent,&pFasta->m_JobMutex,&abstime);
+		}
+	if(pFasta->m_bTermThread)
+		{
+		pthread_mutex_unlock(&pFasta->m_JobMutex);
+		break;
+		}
+	pBlock = &pFasta->m_FastaBlocks[pFasta->m_NxtFillBlock];
+	pthread_mutex_unlock(&pFasta->m_JobMutex);
+#endif
+
+	BuffCnt = pFasta->FillBlock(pBlock);	// block is not accessed by parsing thread until notified as filled
+
+#ifdef _WIN32
+	WaitForSingleObject(pFasta->m_JobMutex,INFINITE);
+#else
+	pthread_mutex_lock(&pFasta->m_JobMutex);
+#endif
+	pFasta->m_NxtFillBlock = (pFasta->m_NxtFillBlock + 1) % pFasta->m_NumFastaBlocks;
+	pFasta->m_NumFilledBlocks += 1;
+	if(BuffCnt <= 0)					// EOF or errors, parsing thread will handle when block is parsed
+		pFasta->m_bReadAheadEOF = true;
+#ifdef _WIN32
+	SetEvent(pFasta->m_JobAckEvent);
+	ReleaseMutex(pFasta->m_JobMutex);
+#else
+	pthread_cond_signal(&pFasta->m_JobAckEvent);
+	pthread_mutex_unlock(&pFasta->m_JobMutex);
+#endif
+	}
+
+#ifdef _WIN32
+_endthreadex(0);
+return(eBSFSuccess);
+#else
+pthread_exit(NULL);
+#endif
+}
+
 // ReadSequence
 // Returns upto Max2Read bases from fasta or fastq input file
 // Sloughs all whitespace and non-alpha characters within sequences
@@ -912,14 +1363,13 @@ CFasta::ReadSequence(void *pRetSeq,		// where to return sequence, can be NULL if
 bool bInDescriptor;		// true whilst processing descriptor or fastq sequence identifier characters
 bool bMoreToDo;
 char Chr;
-INT64 FileOfs;			// will contain file offset corresponding to last buffer read from file
 int SeqLen = 0;
 char *pAscii = (char *)pRetSeq;
 int Rslt;
 bool bSloughEOL;	// if true then skip to end of current line
 int PrevSOLiDbase;
 
-if (m_gzFile == NULL && m_hFile == -1 || m_pCurFastaBlock == NULL || m_pCurFastaBlock->pBlock == NULL)
+if (m_gzFile == NULL && m_pBGZF == NULL && m_hFile == -1 || m_pCurFastaBlock == NULL || m_pCurFastaBlock->pBlock == NULL)
 	return(eBSFerrClosed);
 if(!m_bRead)
 	return(eBSFerrRead);
@@ -967,21 +1417,8 @@ PrevSOLiDbase = 0;
 while(bMoreToDo) {
 	if (m_pCurFastaBlock->BuffIdx >= m_pCurFastaBlock->BuffCnt)	// time to refill m_pBuffer with another (up to) m_BuffSize chars?
 		{
-		if(m_gzFile != NULL)
-			{
-			FileOfs = gztell(m_gzFile);
-			m_pCurFastaBlock->BuffCnt = gzread(m_gzFile, m_pCurFastaBlock->pBlock, m_pCurFastaBlock->AllocSize);
-			}
-		else
-			{
-			FileOfs = _lseeki64(m_hFile,0,SEEK_CUR);
-			m_pCurFastaBlock->BuffCnt = read(m_hFile, m_pCurFastaBlock->pBlock, m_pCurFastaBlock->AllocSize);
-			}
-
-		if (m_pCurFastaBlock->BuffCnt <= 0)
+		if (ReadNextBlock() <= 0)
 			break;
-		m_pCurFastaBlock->BuffIdx = 0;
-		m_pCurFastaBlock->FileOfs = FileOfs;
 		}
 
 	while (m_pCurFastaBlock->BuffIdx < m_pCurFastaBlock->BuffCnt)
@@ -1151,7 +1588,7 @@ int Cnt;
 int CmpLen;
 int FilePsn;
 
-if(m_gzFile == NULL && m_hFile == -1 )
+if(m_gzFile == NULL && m_pBGZF == NULL && m_hFile == -1 )
 	return(eBSFerrClosed);
 if(!m_bRead)
 	return(eBSFerrRead);
@@ -1165,6 +1602,10 @@ if(bFromStart)
 	m_FastqSeqIdx = 0;
 	m_FastqSeqQLen = 0;
 
+	StopReadAhead();
+	if(m_pBGZF != NULL)
+		FilePsn = (int)SeekBGZF(0);
+	else
 	if(m_gzFile != NULL)
 		FilePsn = gzseek(m_gzFile,0,SEEK_SET);
 	else
@@ -1206,12 +1647,11 @@ int
 CFasta::ParseFastQblockQ(void)	
 {
 char Chr;
-INT64 FileOfs;			// will contain file offset corresponding to last buffer read from file
 int ParseState;
 int SeqLen = 0;
 bool bIsFastQSOLiD;	// some fastq files (from NCBA SRA SRP000191) have SOLiD sequences
 char PrvBase;		// used if decoding SOLiD sequences
-if (m_gzFile == NULL && m_hFile == -1 || m_pCurFastaBlock == NULL || m_pCurFastaBlock->pBlock == NULL)
+if (m_gzFile == NULL && m_pBGZF == NULL && m_hFile == -1 || m_pCurFastaBlock == NULL || m_pCurFastaBlock->pBlock == NULL)
 	return(eBSFerrClosed);
 if(!m_bRead)
 	return(eBSFerrRead);
@@ -1224,21 +1664,8 @@ ParseState = 0;
 while(ParseState < 6) {
 	if (m_pCurFastaBlock->BuffIdx >= m_pCurFastaBlock->BuffCnt)
 		{
-		if(m_gzFile != NULL)
-			{
-			FileOfs = gztell(m_gzFile);
-			m_pCurFastaBlock->BuffCnt = gzread(m_gzFile, m_pCurFastaBlock->pBlock, m_pCurFastaBlock->AllocSize);
-			}
-		else
-			{
-			FileOfs = _lseeki64(m_hFile,0,SEEK_CUR);
-			m_pCurFastaBlock->BuffCnt = read(m_hFile, m_pCurFastaBlock->pBlock, m_pCurFastaBlock->AllocSize);
-			}
-
-		if (m_pCurFastaBlock->BuffCnt <= 0)
+		if (ReadNextBlock() <= 0)
 			break;
-		m_pCurFastaBlock->BuffIdx = 0;
-		m_pCurFastaBlock->FileOfs = FileOfs;
 		}
 	while (ParseState < 6 && m_pCurFastaBlock->BuffIdx < m_pCurFastaBlock->BuffCnt)
 		{
@@ -1455,7 +1882,7 @@ int CpyLen;
 int CpyFromIdx;
 char *pAscii = (char *)pSeq;
    
-if (m_gzFile == NULL && m_hFile == -1 || m_pCurFastaBlock == NULL || m_pCurFastaBlock->pBlock == NULL)
+if (m_gzFile == NULL && m_pBGZF == NULL && m_hFile == -1 || m_pCurFastaBlock == NULL || m_pCurFastaBlock->pBlock == NULL)
 	return(eBSFerrClosed);
 
 if(!m_bRead)
@@ -1467,6 +1894,10 @@ if(bFromStart)
 	m_pCurFastaBlock->BuffCnt = 0;
 	m_pCurFastaBlock->BuffIdx = 0;
 	m_DescrAvail = false;
+	StopReadAhead();
+	if(m_pBGZF != NULL)
+		FileOfs = (int)SeekBGZF(0);
+	else
 	if(m_gzFile != NULL)
 		FileOfs = gzseek(m_gzFile,0,SEEK_SET);
 	else
@@ -1569,7 +2000,7 @@ return(SeqLen);
 int							// returns strlen of available descriptor or 0 if none
 CFasta::ReadDescriptor(char *pszDescriptor,int MaxLen)
 {
-if(m_gzFile == NULL && m_hFile == -1)
+if(m_gzFile == NULL && m_pBGZF == NULL && m_hFile == -1)
 	return(eBSFerrClosed);
 
 if(!m_bRead)
@@ -1593,7 +2024,7 @@ return(m_DescriptorLen);
 int							// returns strlen of available quality scores or 0 if none
 CFasta::ReadQValues(char *pszValues,int MaxLen)
 {
-if(m_gzFile == NULL && m_hFile == -1)
+if(m_gzFile == NULL && m_pBGZF == NULL && m_hFile == -1)
 	return(eBSFerrClosed);
 
 if(!m_bRead)
@@ -1,5 +1,6 @@
 #pragma once
 #include "./commdefs.h"
+#include "./bgzf.h"
 
 /*
 Fastq scoring schema (from http://en.wikipedia.org/wiki/FASTQ_format )
@@ -31,7 +32,11 @@ const unsigned long cDfltStageBuffSize = 0x03ffffff;  // 64M buffer as default
 const unsigned long cMaxStageBuffSize = 0x07ffffff;	 // 128M buffer as maximum
 const unsigned long cMinStageBuffSize = 0x0fffff;	 // 1M buffer as minimum
 
-const int cNumFastaBlocks = 1;						 // when readahead disk buffering implemented then set to be 2 or more
+const int cMaxFastaBlocks = 8;						 // allow for at most this many buffered fasta blocks when reading with readahead
+const int cDfltFastaBlocks = 2;						 // default is to double buffer, one block being parsed whilst the next is read by the background thread
+const int cMaxFastaBGZFThreads = 16;				 // BGZF compressed files are inflated using at most this many threads
+const int cFastaBGZFSubBlks = 8;					 // and each BGZF inflating thread can have this many blocks read ahead
+const int cFastaSigWaitSecs = 5;					 // background readahead thread wakes every cFastaSigWaitSecs sec just in case a signalling event missed
 
 const unsigned int cMaxGenFastaLineLen = 79;		// limit generated Fasta lines to this length
 const unsigned int cMaxFastaDescrLen   = 8192;	    // Fasta descriptor lines can be concatenated..
@@ -39,6 +44,7 @@ const unsigned int cMaxFastQSeqLen = cMaxReadLen;	// Allow FastQ sequences to be
 
 const int cgzAllocInBuffer = 0x1ffffff;				// gz processing input buffer size
 const int cgzAllocOutBuffer = 0x1ffffff;			// gz processing output buffer size
+const int cAllocBGZFCkpts = 1000;					// allocate BGZF seek checkpoints in this many increments
 
 #pragma pack(1)
 typedef struct TAG_sFastaBlock
@@ -49,12 +55,23 @@ typedef struct TAG_sFastaBlock
 	INT32 AllocSize;			// block was allocated to buffer at most this many chars in Fasta[]
 	UINT8 *pBlock;				// allocated to hold a block of fasta file content
 	} tsFastaBlock;
+
+typedef struct TAG_sBGZFCkpt
+	{
+	INT64 UncomprOfs;			// offset in uncompressed content
+	INT64 VirtOfs;				// corresponding BGZF virtual file offset as returned by bgzf_tell()
+	} tsBGZFCkpt;
 #pragma pack()
 
 class CFasta : public CErrorCodes
 {
 	int m_hFile;				// opened for write fasta
 	gzFile m_gzFile;			// opened for read (could be compressed) fasta or fastq
+	BGZF *m_pBGZF;				// opened for read if BGZF compressed fasta or fastq and inflating multithreaded
+	INT64 m_BGZFOfs;			// offset in uncompressed content of next char to be read from m_pBGZF
+	int m_NumBGZFCkpts;			// number of BGZF seek checkpoints
+	int m_AllocdBGZFCkpts;		// allocated to hold at most this number of checkpoints
+	tsBGZFCkpt *m_pBGZFCkpts;	// uncompressed offset to BGZF virtual offset checkpoints, one per block read, used to seek without reading from start of file
 	char m_szFile[_MAX_PATH];	// to hold fasta file path+name
 	UINT64 m_StatFileSize;		// file size as returned by stat() when file initially opened
 	bool m_bIsGZ;				// true if processing a gz compressed file
@@ -64,7 +81,37 @@ class CFasta : public CErrorCodes
 	bool m_bRead;				// TRUE if reading fasta file, FALSE if write to fasta file
 
 	tsFastaBlock *m_pCurFastaBlock;    // buffered fasta block currently being processed
-	tsFastaBlock m_FastaBlocks[cNumFastaBlocks];    // allow for at most cNumFastaBlocks buffered fasta file blocks; currently not implemented but in future will allow for readahead of blocks
+	tsFastaBlock m_FastaBlocks[cMaxFastaBlocks];    // allow for at most cMaxFastaBlocks buffered fasta file blocks, blocks after the current are readahead by a background thread
+
+	int m_NumFastaBlocks;		// number of blocks allocated in m_FastaBlocks[], readahead only if 2 or more
+	int m_NxtFillBlock;			// background thread will next fill this block
+	int m_NxtParseBlock;		// next block to be parsed after the current block
+	int m_NumFilledBlocks;		// number of blocks filled by background thread but not yet parsed
+	bool m_bReadAheadEOF;		// set true by background thread after EOF or read error, no more blocks will be filled
+
+	bool m_bThreadActive;		// true if background readahead thread has been started
+	bool m_bTermThread;			// set true to request background readahead thread to self terminate
+#ifdef _WIN32
+static	unsigned __stdcall ThreadedReadAhead(void * pThreadPars);
+	HANDLE m_threadHandle;		// handle as returned by beginthreadex
+	UINT32 m_threadID;			// identifier as set by beginthreadex
+	HANDLE m_JobReqEvent;		// signalled when a block has been freed for filling, or thread is to terminate
+	HANDLE m_JobAckEvent;		// signalled by background thread when a block has been filled
+	HANDLE m_JobMutex;			// used to serialise access by main and background thread to block ring state
+#else
+	int m_threadRslt;			// result as returned by pthread_create ()
+	pthread_t m_threadID;		// identifier as set by pthread_create ()
+	pthread_mutex_t m_JobMutex;	// used to serialise access by main and background thread to block ring state
+	pthread_cond_t m_JobReqEvent;
+	pthread_cond_t m_JobAckEvent;
+static	void *ThreadedReadAhead(void * pThreadPars);
+#endif
+	int StartReadAhead(void);	// starts background readahead thread
+	void StopReadAhead(void);	// terminates background readahead thread, must be called before any file seeks
+	int FillBlock(tsFastaBlock *pBlock);	// reads next file content into pBlock
+	INT64 SeekBGZF(INT64 FileOfs);	// seek to uncompressed offset in BGZF file
+	void AddBGZFCkpt(void);			// record BGZF virtual offset of current uncompressed offset
+	int ReadNextBlock(void);	// makes next block of file content the current block to be parsed, returns number of chars in block
 
 	bool m_DescrAvail;			// true if NEW descriptor available, reset by ReadDescriptor()
 	char m_szDescriptor[cMaxFastaDescrLen+1];	// to hold last descriptor parsed
@@ -88,7 +135,7 @@ public:
 	~CFasta(void);
 	void Cleanup(void);
 	int Reset(INT64 FileOfs = 0l);				// reset context to that following an Open() with option to start processing at FileOfs
-	int Open(char *pszFile,bool Read = true,unsigned long BufferSize = cDfltStageBuffSize);
+	int Open(char *pszFile,bool Read = true,unsigned long BufferSize = cDfltStageBuffSize,int NumBlocks = cDfltFastaBlocks,int NumThreads = 1);
 	bool IsFastq(void);							// true if opened file is in fastq format
 	bool IsSOLiD(void);							// true if opened file is in SOLiD or colorspace format
 	UINT64 InitialFileSize(void);				// file size when initially opened for reading
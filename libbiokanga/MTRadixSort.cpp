@@ -0,0 +1,252 @@
+/*
+ * CSIRO Open Source Software License Agreement (GPLv3)
+ * Copyright (c) 2017, Commonwealth Scientific and Industrial Research Organisation (CSIRO) ABN 41 687 119 230.
+ * See LICENSE for the complete license information (https://github.com/csiro-crop-informatics/biokanga/LICENSE)
+ * Contact: Alex Whan <alex.whan@csiro.au>
+ */
+
+// Multithreaded least significant digit radix sort of fixed size 128bit keys
+// Callers extract keys from their elements into a tsRadixSortEl array, which is then sorted without further referencing the elements
+// Digits which are identical in all keys are skipped so keys which use only a few bits require only a few passes
+
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#if _WIN32
+#include <process.h>
+#include "../libbiokanga/commhdrs.h"
+#else
+#include <sys/mman.h>
+#include <pthread.h>
+#include "../libbiokanga/commhdrs.h"
+#endif
+
+// constructor
+CMTRadixSort::CMTRadixSort(void)
+{
+m_MaxThreads = cDfltRadixSortThreads;
+m_NumThreads = 0;
+m_CurDigit = 0;
+m_pSrc = NULL;
+m_pDst = NULL;
+memset(m_Threads,0,sizeof(m_Threads));
+}
+
+// destructor
+CMTRadixSort::~CMTRadixSort(void)
+{
+}
+
+// SetMaxThreads
+// Sets maximum number of threads to use, if 0 then resets to cMaxRadixSortThreads
+void 
+CMTRadixSort::SetMaxThreads(int MaxThreads)
+{
+if(MaxThreads <= 0 || MaxThreads > cMaxRadixSortThreads)
+	MaxThreads = cMaxRadixSortThreads;
+m_MaxThreads = MaxThreads;
+}
+
+// ThreadStart
+// Thread start - simply unpacks it's args into a call to ProcessPhase
+#ifdef _WIN32
+unsigned int __stdcall CMTRadixSort::ThreadStart(void *args)
+#else
+void *CMTRadixSort::ThreadStart(void *args)
+#endif
+{
+tsRadixSortThread *pThread = (tsRadixSortThread *)args;
+pThread->pThis->ProcessPhase(pThread);
+#ifdef _WIN32
+_endthreadex(0);
+return(eBSFSuccess);
+#else
+pthread_exit(NULL);
+#endif
+}
+
+// ProcessPhase
+// Processes current phase over a single thread partition
+void
+CMTRadixSort::ProcessPhase(tsRadixSortThread *pThread)
+{
+INT64 Idx;
+tsRadixSortEl *pEl;
+UINT64 FirstHi;
+UINT64 FirstLo;
+UINT64 DiffHi;
+UINT64 DiffLo;
+int Shift;
+bool bHi;
+
+bHi = m_CurDigit >= 8 ? true : false;
+Shift = (m_CurDigit & 0x07) * 8;
+pEl = &m_pSrc[pThread->StartIdx];
+switch(pThread->Phase) {
+	case 0:			// accumulate which key bits differ from the first key
+		FirstHi = m_pSrc[0].KeyHi;
+		FirstLo = m_pSrc[0].KeyLo;
+		DiffHi = 0;
+		DiffLo = 0;
+		for(Idx = pThread->StartIdx; Idx <= pThread->EndIdx; Idx++, pEl++)
+			{
+			DiffHi |= pEl->KeyHi ^ FirstHi;
+			DiffLo |= pEl->KeyLo ^ FirstLo;
+			}
+		pThread->DiffHi = DiffHi;
+		pThread->DiffLo = DiffLo;
+		break;
+
+	case 1:			// count number of elements in each digit bucket
+		memset(pThread->Buckets,0,sizeof(pThread->Buckets));
+		if(bHi)
+			for(Idx = pThread->StartIdx; Idx <= pThread->EndIdx; Idx++, pEl++)
+				pThread->Buckets[(pEl->KeyHi >> Shift) & 0x0ff] += 1;
+		else
+			for(Idx = pThread->StartIdx; Idx <= pThread->EndIdx; Idx++, pEl++)
+				pThread->Buckets[(pEl->KeyLo >> Shift) & 0x0ff] += 1;
+		break;
+
+	case 2:			// scatter elements into their digit buckets, Buckets[] were set to the index at which this partition's bucket elements start
+		if(bHi)
+			for(Idx = pThread->StartIdx; Idx <= pThread->EndIdx; Idx++, pEl++)
+				m_pDst[pThread->Buckets[(pEl->KeyHi >> Shift) & 0x0ff]++] = *pEl;
+		else
+			for(Idx = pThread->StartIdx; Idx <= pThread->EndIdx; Idx++, pEl++)
+				m_pDst[pThread->Buckets[(pEl->KeyLo >> Shift) & 0x0ff]++] = *pEl;
+		break;
+	}
+}
+
+// RunPhase
+// Runs Phase over all thread partitions, the calling thread processes the first partition
+void
+CMTRadixSort::RunPhase(int Phase)
+{
+int ThreadIdx;
+tsRadixSortThread *pThread;
+
+for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
+	m_Threads[ThreadIdx].Phase = Phase;
+
+pThread = &m_Threads[1];
+for(ThreadIdx = 1; ThreadIdx < m_NumThreads; ThreadIdx++, pThread++)
+	{
+#ifdef _WIN32
+	if((pThread->threadHandle = (HANDLE)_beginthreadex(NULL,0x0fffff,ThreadStart,pThread,0,&pThread->threadID))==NULL)
+		ProcessPhase(pThread);					// unable to start thread so process partition on this thread
+#else
+	if((pThread->threadRslt = pthread_create (&pThread->threadID , NULL , ThreadStart , pThread ))!=0)
+		ProcessPhase(pThread);					// unable to start thread so process partition on this thread
+#endif
+	}
+
+ProcessPhase(&m_Threads[0]);
+
+pThread = &m_Threads[1];
+for(ThreadIdx = 1; ThreadIdx < m_NumThreads; ThreadIdx++, pThread++)
+	{
+#ifdef _WIN32
+	if(pThread->threadHandle != NULL)
+		{
+		WaitForSingleObject(pThread->threadHandle,INFINITE);
+		CloseHandle(pThread->threadHandle);
+		pThread->threadHandle = NULL;
+		}
+#else
+	if(pThread->threadRslt == 0)
+		pthread_join(pThread->threadID,NULL);
+#endif
+	}
+}
+
+// Sort
+// Stable sort of elements ascending on KeyHi then KeyLo
+int												// eBSFSuccess, or eBSFerrMem if unable to allocate temporary sort memory
+CMTRadixSort::Sort(tsRadixSortEl *pEls,			// elements to be sorted ascending on KeyHi then KeyLo, elements with equal keys retain their relative ordering
+			INT64 NumEls)						// number of elements to be sorted
+{
+tsRadixSortEl *pTmp;
+tsRadixSortEl *pSwap;
+tsRadixSortThread *pThread;
+INT64 ElsPerThread;
+INT64 StartIdx;
+INT64 BucketIdx;
+UINT64 DiffHi;
+UINT64 DiffLo;
+int ThreadIdx;
+int Bucket;
+int Digit;
+
+if(pEls == NULL || NumEls < 2)
+	return(eBSFSuccess);
+
+if((pTmp = (tsRadixSortEl *)malloc((size_t)NumEls * sizeof(tsRadixSortEl)))==NULL)
+	return(eBSFerrMem);
+
+// partition elements over threads
+m_NumThreads = (int)min((INT64)m_MaxThreads,(NumEls + cMinRadixElsPerThread - 1) / cMinRadixElsPerThread);
+if(m_NumThreads < 1)
+	m_NumThreads = 1;
+ElsPerThread = NumEls / m_NumThreads;
+StartIdx = 0;
+pThread = m_Threads;
+for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++, pThread++)
+	{
+	memset(pThread,0,sizeof(tsRadixSortThread));
+	pThread->pThis = this;
+	pThread->ThreadIdx = ThreadIdx + 1;
+	pThread->StartIdx = StartIdx;
+	pThread->EndIdx = ThreadIdx == m_NumThreads - 1 ? NumEls - 1 : StartIdx + ElsPerThread - 1;
+	StartIdx = pThread->EndIdx + 1;
+	}
+
+// only need to sort on those digits which are not the same in all keys
+m_pSrc = pEls;
+m_pDst = pTmp;
+m_CurDigit = 0;
+RunPhase(0);
+DiffHi = 0;
+DiffLo = 0;
+for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++)
+	{
+	DiffHi |= m_Threads[ThreadIdx].DiffHi;
+	DiffLo |= m_Threads[ThreadIdx].DiffLo;
+	}
+
+for(Digit = 0; Digit < cRadixDigits; Digit++)
+	{
+	if(!(((Digit >= 8 ? DiffHi : DiffLo) >> ((Digit & 0x07) * 8)) & 0x0ff))
+		continue;
+	m_CurDigit = Digit;
+	RunPhase(1);
+
+	// bucket elements from lower indexed partitions preceed those from higher indexed partitions so sort is stable
+	BucketIdx = 0;
+	for(Bucket = 0; Bucket < cRadixBuckets; Bucket++)
+		{
+		pThread = m_Threads;
+		for(ThreadIdx = 0; ThreadIdx < m_NumThreads; ThreadIdx++, pThread++)
+			{
+			StartIdx = pThread->Buckets[Bucket];
+			pThread->Buckets[Bucket] = BucketIdx;
+			BucketIdx += StartIdx;
+			}
+		}
+	RunPhase(2);
+	pSwap = m_pSrc;
+	m_pSrc = m_pDst;
+	m_pDst = pSwap;
+	}
+
+if(m_pSrc != pEls)		// odd number of passes, sorted elements are in the temporary buffer
+	memcpy(pEls,m_pSrc,(size_t)NumEls * sizeof(tsRadixSortEl));
+free(pTmp);
+m_pSrc = NULL;
+m_pDst = NULL;
+return(eBSFSuccess);
+}
+
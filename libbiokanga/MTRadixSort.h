@@ -0,0 +1,66 @@
+#pragma once
+
+const int cMaxRadixSortThreads = 64;		// allow for a max of this many radix sort threads
+const int cDfltRadixSortThreads = 8;		// default is for this many radix sort threads
+const INT64 cMinRadixElsPerThread = 100000;	// each thread to sort at least this many elements, less than this and thread startup costs dominate
+const int cRadixDigits = 16;				// keys are 128bits (KeyHi,KeyLo) processed as 16 8bit digits
+const int cRadixBuckets = 256;				// each 8bit digit has this many buckets
+
+#pragma pack(1)
+
+// elements to be sorted are fixed size keys, extracted by the caller, referencing the actual elements
+typedef struct TAG_sRadixSortEl {
+	UINT64 KeyHi;				// most significant 64bits of sort key
+	UINT64 KeyLo;				// least significant 64bits of sort key
+	void *pEl;					// referenced element
+} tsRadixSortEl;
+
+typedef struct TAG_sRadixSortThread {
+	class CMTRadixSort *pThis;
+	int ThreadIdx;				// uniquely identifies this thread
+	int Phase;					// 0: accumulate differences in key bits, 1: count digit bucket occurances, 2: scatter into buckets
+	INT64 StartIdx;				// process elements starting at this index
+	INT64 EndIdx;				// through to this element index inclusive
+	UINT64 DiffHi;				// bits which differ in KeyHi
+	UINT64 DiffLo;				// bits which differ in KeyLo
+	INT64 Buckets[cRadixBuckets]; // bucket counts when counting, then next bucket index when scattering
+#ifdef _WIN32
+	HANDLE threadHandle;		// handle as returned by _beginthreadex()
+	unsigned int threadID;		// identifier as set by _beginthreadex()
+#else
+	int threadRslt;				// result as returned by pthread_create ()
+	pthread_t threadID;			// identifier as set by pthread_create ()
+#endif
+} tsRadixSortThread;
+
+#pragma pack()
+
+class CMTRadixSort
+{
+	int m_MaxThreads;							// limit number of threads to be no more than this, defaults to be cDfltRadixSortThreads unless user overrides with call to SetMaxThreads
+	int m_NumThreads;							// number of threads used for current sort
+	int m_CurDigit;								// currently sorting on this digit (0..15), 0 is least significant
+	tsRadixSortEl *m_pSrc;						// elements to be sorted on m_CurDigit
+	tsRadixSortEl *m_pDst;						// elements sorted on m_CurDigit are scattered into here
+	tsRadixSortThread m_Threads[cMaxRadixSortThreads];	// per thread partition of elements
+
+	void RunPhase(int Phase);					// runs Phase over all thread partitions, returns when all partitions processed
+	void ProcessPhase(tsRadixSortThread *pThread);	// processes phase on a single thread partition
+
+#ifdef _WIN32
+	static unsigned int __stdcall ThreadStart(void *args);
+#else
+	static void *ThreadStart(void *args);
+#endif
+
+public:
+	CMTRadixSort(void);
+	~CMTRadixSort(void);
+
+	void SetMaxThreads(int MaxThreads);			// sets maximum number of threads to use, if 0 then resets to cMaxRadixSortThreads
+
+	int											// eBSFSuccess, or eBSFerrMem if unable to allocate temporary sort memory
+		Sort(tsRadixSortEl *pEls,				// elements to be sorted ascending on KeyHi then KeyLo, elements with equal keys retain their relative ordering
+			INT64 NumEls);						// number of elements to be sorted
+};
+
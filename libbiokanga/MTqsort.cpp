@@ -26,21 +26,90 @@
 CMTqsort::CMTqsort(void)
 {
 m_MaxThreads = cDfltSortThreads;
-m_CurThreads = 0;
-memset(m_ThreadArgs,0,sizeof(m_ThreadArgs));
+m_ElSize = 0;
+m_CompareFunc = NULL;
+m_pSortPart = NULL;
+m_NumPoolThreads = 0;
+memset(m_bPoolSlotUsed,0,sizeof(m_bPoolSlotUsed));
+m_bTermPool = false;
+m_bSortActive = false;
+m_SortGen = 0;
+m_pDeques = NULL;
+m_NumIdle = 0;
+m_NumActive = 0;
+m_NumQueued = 0;
 #ifdef _WIN32
 InitializeSRWLock(&m_hRwLock);
 #else
+m_PoolPID = 0;
 pthread_rwlock_init (&m_hRwLock,NULL);
 #endif
+InitPoolLocks();
 }
 
 // destructor
 CMTqsort::~CMTqsort(void)
 {
+int Slot;
+TermPool();
 #ifndef _WIN32
+if(m_pDeques != NULL)
+	for(Slot = 0; Slot < cMaxSortThreads; Slot++)
+		pthread_mutex_destroy(&m_pDeques[Slot].hLock);
+pthread_cond_destroy(&m_hPoolCond);
+pthread_mutex_destroy(&m_hPoolLock);
 pthread_rwlock_destroy(&m_hRwLock);
 #endif
+if(m_pDeques != NULL)
+	delete []m_pDeques;
+}
+
+// InitPoolLocks
+// Initialise pool and any deque locks
+void
+CMTqsort::InitPoolLocks(void)
+{
+#ifdef _WIN32
+InitializeSRWLock(&m_hPoolLock);
+InitializeConditionVariable(&m_hPoolCond);
+#else
+pthread_mutex_init(&m_hPoolLock,NULL);
+pthread_cond_init(&m_hPoolCond,NULL);
+#endif
+InitDeques();
+}
+
+// InitDeques
+// Initialise any allocated deques as empty
+void
+CMTqsort::InitDeques(void)
+{
+int Slot;
+if(m_pDeques == NULL)
+	return;
+for(Slot = 0; Slot < cMaxSortThreads; Slot++)
+	{
+	m_pDeques[Slot].Top = 0;
+	m_pDeques[Slot].Bottom = 0;
+#ifdef _WIN32
+	InitializeSRWLock(&m_pDeques[Slot].hLock);
+#else
+	pthread_mutex_init(&m_pDeques[Slot].hLock,NULL);
+#endif
+	}
+}
+
+// AtomicAdd
+// Atomically add Incr to *pVal, returns the updated value
+// Full memory barrier so a thread incrementing one counter and then reading another will observe any prior update by a thread doing the converse
+INT32
+CMTqsort::AtomicAdd(volatile INT32 *pVal,INT32 Incr)
+{
+#ifdef _WIN32
+return(InterlockedExchangeAdd((volatile LONG *)pVal,Incr) + Incr);
+#else
+return(__sync_add_and_fetch(pVal,Incr));
+#endif
 }
 
 // AcquireLock
@@ -77,50 +146,79 @@ pthread_rwlock_unlock(&m_hRwLock);
 #endif
 }
 
-// SetMaxThreads
-// Sets maximum number of threads to use, if 0 then resets to cMaxSortThreads
-void 
-CMTqsort::SetMaxThreads(int MaxThreads)
+// AcquirePoolLock
+// Aquire exclusive lock on pool and pending partition state
+void
+CMTqsort::AcquirePoolLock(void)
 {
-if(MaxThreads <= 0 || MaxThreads > cMaxSortThreads)
-	MaxThreads = cMaxSortThreads;
-AcquireLock(true);
-m_MaxThreads = MaxThreads;
-ReleaseLock(true);
+#ifdef _WIN32
+AcquireSRWLockExclusive(&m_hPoolLock);
+#else
+pthread_mutex_lock(&m_hPoolLock);
+#endif
 }
 
-
-// _qsort_start
-// Thread start - simply unpacks it's args into a call to mtqsort
-#ifdef WIN32
-unsigned int __stdcall CMTqsort::_qsort_start (void *args)
+// ReleasePoolLock
+void
+CMTqsort::ReleasePoolLock(void)
 {
+#ifdef _WIN32
+ReleaseSRWLockExclusive(&m_hPoolLock);
 #else
-void * CMTqsort::_qsort_start (void *args)
+pthread_mutex_unlock(&m_hPoolLock);
+#endif
+}
+
+// WaitPoolCond
+// Wait for pool state to be signalled as changed, pool lock must be held by caller and will be held on return
+// If TimeoutSecs > 0 then returns false if not signalled within TimeoutSecs
+bool
+CMTqsort::WaitPoolCond(int TimeoutSecs)
 {
-pthread_detach(pthread_self());
+#ifdef _WIN32
+if(!SleepConditionVariableSRW(&m_hPoolCond,&m_hPoolLock,TimeoutSecs > 0 ? (DWORD)TimeoutSecs * 1000 : INFINITE,0))
+	return(GetLastError() != ERROR_TIMEOUT);
+return(true);
+#else
+if(TimeoutSecs <= 0)
+	{
+	pthread_cond_wait(&m_hPoolCond,&m_hPoolLock);
+	return(true);
+	}
+struct timespec ts;
+clock_gettime(CLOCK_REALTIME, &ts);
+ts.tv_sec += TimeoutSecs;
+return(pthread_cond_timedwait(&m_hPoolCond,&m_hPoolLock,&ts) != ETIMEDOUT);
 #endif
-tsCMTqsort_args *pArgs = (tsCMTqsort_args *)args;
+}
 
-// use library qsort as should be more optimised than this classes _mtqsort so use it..
-if(pArgs->NumEls < (cMinUseLibQsort * 2))
-	::qsort(pArgs->pArray, (size_t)pArgs->NumEls, pArgs->ElSize, pArgs->CompareFunc);
-else
-	pArgs->pThis->_mtqsort(true,pArgs->pArray, pArgs->NumEls, pArgs->ElSize, pArgs->CompareFunc);
-
-// one less thread sorting, allow other threads to start up
-pArgs->pThis->AcquireLock(true);
-if(pArgs->pThis->m_CurThreads > 0)
-	pArgs->pThis->m_CurThreads -= 1;
-pArgs->ElSize = 0;						// releases for other threads to use
-pArgs->pThis->ReleaseLock(true);
-#ifdef WIN32
-ExitThread(1);
+// SignalPoolCond
+// Signal all waiting threads that pool state has changed
+void
+CMTqsort::SignalPoolCond(void)
+{
+#ifdef _WIN32
+WakeAllConditionVariable(&m_hPoolCond);
 #else
-return NULL;
+pthread_cond_broadcast(&m_hPoolCond);
 #endif
 }
 
+// SetMaxThreads
+// Sets maximum number of threads to use, if 0 then resets to cMaxSortThreads
+void 
+CMTqsort::SetMaxThreads(int MaxThreads)
+{
+if(MaxThreads <= 0 || MaxThreads > cMaxSortThreads)
+	MaxThreads = cMaxSortThreads;
+AcquireLock(true);
+if(m_MaxThreads != MaxThreads)
+	{
+	TermPool();				// pool will be restarted with the new number of threads when next required
+	m_MaxThreads = MaxThreads;
+	}
+ReleaseLock(true);
+}
 
 
 // Exchange
@@ -235,212 +333,341 @@ switch(ElSize) {
 	}
 }
 
-// InsertSort
-// Insertion sort used when the number of elements in partition is below cInsertSortMinLen
-void
-CMTqsort::InsertSort(UINT8 *pLeft,	// pts to leftmost element		
-	    UINT8 *pRight,				// pts to rightmost element
-		size_t ElSize,				// size in bytes of each element
-		comparer CompareFunc)		// function to compare pairs of elements
+// _pool_start
+// Pool thread start - processes queued partitions until pool is terminated or thread released as idle
+#ifdef WIN32
+unsigned int __stdcall CMTqsort::_pool_start (void *args)
+{
+#else
+void * CMTqsort::_pool_start (void *args)
 {
-UINT8 *pProbe;
-UINT8 *pMax;
-
-while (pRight > pLeft) {
-	pMax = pLeft;
-    for (pProbe = pLeft + ElSize; pProbe <= pRight; pProbe += ElSize)
-	   if (CompareFunc( pProbe, pMax) > 0)
-                pMax = pProbe;
-    Exchange(pMax, pRight, ElSize);
-	pRight -= ElSize;
-    }
+#endif
+tsPoolThreadPars *pPars = (tsPoolThreadPars *)args;
+pPars->pThis->ProcParts(pPars->Slot,false);
+#ifdef WIN32
+return(0);
+#else
+return NULL;
+#endif
 }
 
+// StartPool
+// Start pool threads, calling thread also processes partitions so pool is sized at one less than m_MaxThreads
+// Pool threads are detached, each releasing itself after cPoolIdleSecs without a sort being started
+void
+CMTqsort::StartPool(void)
+{
+int Slot;
+#ifdef _WIN32
+HANDLE hThread;
+unsigned int threadID;			// identifier as set by _beginthreadex()
+#else
+pthread_t threadID;
+pthread_attr_t threadattr;
+// a forked child process inherits the pool state but not the threads, so a new pool is required
+if(m_PoolPID != 0 && m_PoolPID != getpid())
+	{
+	m_NumPoolThreads = 0;
+	memset(m_bPoolSlotUsed,0,sizeof(m_bPoolSlotUsed));
+	m_NumIdle = 0;
+	m_NumActive = 0;
+	m_NumQueued = 0;
+	m_bTermPool = false;
+	m_bSortActive = false;
+	InitPoolLocks();
+	m_PoolPID = 0;
+	}
+#endif
+if(m_MaxThreads <= 1)
+	return;
+if(m_pDeques == NULL)
+	{
+	if((m_pDeques = new tsMTqsortDeque [cMaxSortThreads]) == NULL)
+		return;
+	InitDeques();
+	}
 
+AcquirePoolLock();
+if(m_NumPoolThreads >= m_MaxThreads - 1)
+	{
+	ReleasePoolLock();
+	return;
+	}
+#ifndef _WIN32
+pthread_attr_init(&threadattr);
+pthread_attr_setdetachstate(&threadattr,PTHREAD_CREATE_DETACHED);
+#endif
+for(Slot = 1; Slot < m_MaxThreads && m_NumPoolThreads < m_MaxThreads - 1; Slot++)
+	{
+	if(m_bPoolSlotUsed[Slot])
+		continue;
+	m_PoolThreadPars[Slot].pThis = this;
+	m_PoolThreadPars[Slot].Slot = Slot;
+#ifdef _WIN32
+	if((hThread = (HANDLE)_beginthreadex(NULL,0x0fffff,_pool_start,(void *)&m_PoolThreadPars[Slot],0,&threadID))==NULL)
+		break;
+	CloseHandle(hThread);
+#else
+	if(pthread_create(&threadID,&threadattr,_pool_start,(void *)&m_PoolThreadPars[Slot])!=0)
+		break;
+#endif
+	m_bPoolSlotUsed[Slot] = true;
+	m_NumPoolThreads += 1;
+	}
+#ifndef _WIN32
+pthread_attr_destroy(&threadattr);
+m_PoolPID = getpid();
+#endif
+ReleasePoolLock();
+}
 
+// TermPool
+// Terminate any pool threads, waits for all pool threads to exit
+void
+CMTqsort::TermPool(void)
+{
+if(m_NumPoolThreads == 0)
+	return;
+#ifndef _WIN32
+if(m_PoolPID != getpid())		// pool was started by parent process, threads are not present in this forked child
+	{
+	m_NumPoolThreads = 0;
+	memset(m_bPoolSlotUsed,0,sizeof(m_bPoolSlotUsed));
+	return;
+	}
+#endif
+AcquirePoolLock();
+m_bTermPool = true;
+SignalPoolCond();
+while(m_NumPoolThreads > 0)		// each pool thread signals as it exits
+	WaitPoolCond();
+m_bTermPool = false;
+ReleasePoolLock();
+}
 
+// PushPart
+// Queue partition onto the bottom of deque owned by Slot, waking any idle threads so they can steal it
+bool							// true if partition was queued, false if deque full and caller needs to do the sort
+CMTqsort::PushPart(int Slot,		// onto deque owned by this slot
+			  UINT8 *pLeft,		// pts to leftmost element of partition
+			  UINT8 *pRight)		// pts to rightmost element
+{
+tsMTqsortDeque *pDeque = &m_pDeques[Slot];
+#ifdef _WIN32
+AcquireSRWLockExclusive(&pDeque->hLock);
+#else
+pthread_mutex_lock(&pDeque->hLock);
+#endif
+if(pDeque->Bottom == cMaxPartStack)
+	{
+#ifdef _WIN32
+	ReleaseSRWLockExclusive(&pDeque->hLock);
+#else
+	pthread_mutex_unlock(&pDeque->hLock);
+#endif
+	return(false);
+	}
+pDeque->Parts[pDeque->Bottom].pCurLeft = pLeft;
+pDeque->Parts[pDeque->Bottom++].pCurRight = pRight;
+#ifdef _WIN32
+ReleaseSRWLockExclusive(&pDeque->hLock);
+#else
+pthread_mutex_unlock(&pDeque->hLock);
+#endif
+AtomicAdd(&m_NumQueued,1);
+if(m_NumIdle > 0)				// idle threads increment m_NumIdle before checking m_NumQueued so will not miss this partition
+	{
+	AcquirePoolLock();
+	SignalPoolCond();
+	ReleasePoolLock();
+	}
+return(true);
+}
 
-bool							// true if thread was available for handling this partition sort, false if caller needs to do the sort
-CMTqsort::ThreadQSort(void *pArray,
-				size_t NumEls,
-				size_t ElSize,
-				comparer CompareFunc)
+// PopPart
+// Pop the most recently queued partition from bottom of deque owned by Slot
+bool
+CMTqsort::PopPart(int Slot,				// deque owned by this slot
+			  tsSubPartStackEl *pPart)		// returned partition
 {
-int Idx;
-tsCMTqsort_args *pArgs;
+bool bPopped;
+tsMTqsortDeque *pDeque = &m_pDeques[Slot];
+if(pDeque->Bottom == pDeque->Top)	// unlocked early check, only the owner can add partitions
+	return(false);
 #ifdef _WIN32
-HANDLE threadHandle;			// handle as returned by _beginthreadex()
-unsigned int threadID;			// identifier as set by _beginthreadex()
+AcquireSRWLockExclusive(&pDeque->hLock);
+#else
+pthread_mutex_lock(&pDeque->hLock);
+#endif
+if((bPopped = pDeque->Bottom > pDeque->Top) == true)
+	{
+	*pPart = pDeque->Parts[--pDeque->Bottom];
+	if(pDeque->Bottom == pDeque->Top)
+		pDeque->Bottom = pDeque->Top = 0;
+	}
+#ifdef _WIN32
+ReleaseSRWLockExclusive(&pDeque->hLock);
 #else
-int threadRslt;					// result as returned by pthread_create ()
-pthread_t threadID;				// identifier as set by pthread_create ()
+pthread_mutex_unlock(&pDeque->hLock);
 #endif
+if(bPopped)
+	AtomicAdd(&m_NumQueued,-1);
+return(bPopped);
+}
 
-AcquireLock(true);
-if(m_CurThreads < m_MaxThreads)
+// StealPart
+// Steal the oldest, and therefore largest, partition from the top of the first non-empty deque owned by any other slot
+bool
+CMTqsort::StealPart(int Slot,				// thief owns this slot
+			  tsSubPartStackEl *pPart)		// returned partition
+{
+int Idx;
+int VictimSlot;
+bool bStolen;
+tsMTqsortDeque *pDeque;
+if(m_NumQueued == 0)
+	return(false);
+bStolen = false;
+for(Idx = 1; Idx < m_MaxThreads && !bStolen; Idx++)
 	{
-	m_CurThreads += 1;			// will be starting a new thread
-	pArgs = m_ThreadArgs;
-	for(Idx = 0; Idx < m_MaxThreads; Idx++,pArgs++)
-		{
-		if(pArgs->ElSize == 0)	// this thread arg is currently avail for reuse
-			break;
-		}
-	if(Idx == m_MaxThreads)		// double check there was a free thread arg 
+	VictimSlot = (Slot + Idx) % m_MaxThreads;		// start with next slot so thieves are spread over the victims
+	pDeque = &m_pDeques[VictimSlot];
+	if(pDeque->Bottom == pDeque->Top)		// unlocked early check
+		continue;
+#ifdef _WIN32
+	AcquireSRWLockExclusive(&pDeque->hLock);
+#else
+	pthread_mutex_lock(&pDeque->hLock);
+#endif
+	if((bStolen = pDeque->Bottom > pDeque->Top) == true)
 		{
-		ReleaseLock(true);
-		return(false);
+		*pPart = pDeque->Parts[pDeque->Top++];
+		if(pDeque->Bottom == pDeque->Top)
+			pDeque->Bottom = pDeque->Top = 0;
 		}
-	pArgs->pThis = this;
-	pArgs->NumEls = NumEls;
-	pArgs->pArray = pArray;
-	pArgs->ElSize = ElSize;
-	pArgs->CompareFunc = CompareFunc;
-	ReleaseLock(true);
-
-#ifdef WIN32
-	threadHandle = (HANDLE)_beginthreadex(NULL,0x0fffff,_qsort_start,(void*)pArgs,0,&threadID);
+#ifdef _WIN32
+	ReleaseSRWLockExclusive(&pDeque->hLock);
 #else
-    threadRslt = pthread_create(&threadID, NULL , _qsort_start, (void*)pArgs);
+	pthread_mutex_unlock(&pDeque->hLock);
 #endif
-	return(true);
 	}
-ReleaseLock(true);
-return(false);
+if(bStolen)
+	AtomicAdd(&m_NumQueued,-1);
+return(bStolen);
 }
 
-void 
-CMTqsort::_mtqsort (bool bUseThreads,		// if true then can create threads to handle sub-partitions
-				void *pArray,				// array containing elements to be sorted
-				INT64 NumEls,					// number of elements in array
-				size_t ElSize,					// size in bytes of each element
-				comparer CompareFunc)			// function to compare pairs of elements
+// ProcParts
+// Process queued partitions, first from the thread's own deque and then by stealing from other deques
+// Pool threads call with bCaller false and remain processing until the pool is terminated or no sort has been started for cPoolIdleSecs
+// Thread which initiated the sort calls with bCaller true and returns when there are no partitions queued or being processed - sort has completed
+// A thread counts itself as active before popping or stealing so a sort is never seen as completed whilst a partition is in transit
+void
+CMTqsort::ProcParts(int Slot,		// thread owns this deque slot
+				bool bCaller)		// true if thread initiated the sort
 {
-UINT8 *pCurPartStart;							// current partition start
-UINT8 *pCurPartEnd;								// current partition end
-UINT8 *pCurPartMid;								// pivot point in current partition, hopefully will be the median value so partition will be split into two equal sized sub partitions!
-UINT8 *pLow;									// used when traversing partition starting from start towards end 
-UINT8 *pHigh;									// used when traversing partition starting from end towards start 
-size_t NumElsCurPart;							// number of elements in current sub-partition
-tsSubPartStackEl SubPartStackEls[cMaxPartStack];		// stack of sub-partitions to yet to be processed 
-tsSubPartStackEl *pSubPartStackEl;				// stack ptr
-
-if (NumEls < 2)									// anything to sort?		
-    return;                
-
-pSubPartStackEl = &SubPartStackEls[0];                 
-pCurPartStart = (UINT8 *)pArray;
-pCurPartEnd = (UINT8 *)pArray + ElSize * (NumEls-1);    
-
-recurse:
+tsSubPartStackEl Part;
+UINT32 IdleSortGen;					// pool thread has been idle since this sort completed
+time_t IdleStartSecs;				// and started idling at this time
+int IdleRemainSecs;
+IdleSortGen = 0;
+IdleStartSecs = 0;
+while(1)
 	{
-    NumElsCurPart = (pCurPartEnd - pCurPartStart) / ElSize + 1;        
-	if(!bUseThreads || !((NumEls/NumElsCurPart >= 4) && NumElsCurPart > (cMinUseLibQsort * 2) && 
-		NumElsCurPart < cMaxUseThreadQsort &&
-		ThreadQSort(pCurPartStart,NumElsCurPart,ElSize, CompareFunc)))
+	AtomicAdd(&m_NumActive,1);
+	if(PopPart(Slot,&Part) || StealPart(Slot,&Part))
 		{
-		if (NumElsCurPart <= cMergeSortThres)										// with small number of els then more efficent to do a insert sort than continueing with the qsort
-			InsertSort(pCurPartStart, pCurPartEnd, ElSize, CompareFunc);
-		else 
-			 {		
-			 // select a pivot as being the median of 3, with luck this may result in a near even split of the current partition
-			 pCurPartMid = pCurPartStart + (NumElsCurPart / 2) * ElSize;
-			 if (CompareFunc( pCurPartStart, pCurPartMid) > 0)
-				Exchange(pCurPartStart, pCurPartMid, ElSize);
-			if (CompareFunc( pCurPartStart, pCurPartEnd) > 0)
-				Exchange(pCurPartStart, pCurPartEnd, ElSize);
-			if (CompareFunc( pCurPartMid, pCurPartEnd) > 0)
-				Exchange(pCurPartMid, pCurPartEnd, ElSize);
-        
-			pLow = pCurPartStart;
-			pHigh = pCurPartEnd;
-
-			while(1) 
-				{
-				 if (pCurPartMid > pLow) 
-					do  {
-						pLow += ElSize;
-						} 
-					while (pLow < pCurPartMid && CompareFunc( pLow, pCurPartMid) <= 0);
-				
-
-				if (pCurPartMid <= pLow)
-					do  {
-						pLow += ElSize;
-						} while (pLow <= pCurPartEnd && CompareFunc( pLow, pCurPartMid) <= 0);
-				
-				do  {
-					pHigh -= ElSize;
-					} 
-				while (pHigh > pCurPartMid && CompareFunc(pHigh, pCurPartMid) > 0);
-			
-				if (pHigh < pLow)
-					break;
-
-				Exchange(pLow, pHigh, ElSize);
-
-				if (pCurPartMid == pHigh)
-					pCurPartMid = pLow;
-				}
-
+		(this->*m_pSortPart)(Slot,Part.pCurLeft,Part.pCurRight);
+		if(AtomicAdd(&m_NumActive,-1) == 0 && m_NumQueued == 0)	// sort completed, wake calling thread
+			{
+			AcquirePoolLock();
+			SignalPoolCond();
+			ReleasePoolLock();
+			}
+		continue;
+		}
+	AtomicAdd(&m_NumActive,-1);
 
-			pHigh += ElSize;
-			if (pCurPartMid < pHigh)
-				do  {
-					pHigh -= ElSize;
-					} 
-				while (pHigh > pCurPartMid && CompareFunc(pHigh, pCurPartMid) == 0);
-			
-			if (pCurPartMid >= pHigh)
-				do  {
-					pHigh -= ElSize;
-					} 
-				while (pHigh > pCurPartStart && CompareFunc(pHigh, pCurPartMid) == 0);
-			
-
-			if (pHigh - pCurPartStart >= pCurPartEnd - pLow ) 
+	AcquirePoolLock();
+	if(bCaller)
+		{
+		if(m_NumActive == 0 && m_NumQueued == 0)
+			break;
+		}
+	else
+		if(m_bTermPool)
+			break;
+	AtomicAdd(&m_NumIdle,1);
+	if(m_NumQueued == 0)
+		{
+		if(!bCaller && !m_bSortActive)
+			{
+			// idle time is from when the last sort completed, other threads being released also signal so wakeups don't restart the timing
+			if(IdleStartSecs == 0 || IdleSortGen != m_SortGen)
 				{
-				if (pCurPartStart < pHigh) 
-					{
-					pSubPartStackEl->pCurLeft = pCurPartStart;
-					pSubPartStackEl->pCurRight = pHigh;
-					pSubPartStackEl += 1;
- 					}                   
-
-				if (pLow < pCurPartEnd) 
-					{
-					pCurPartStart = pLow;
-					goto recurse;       
-					}
+				IdleSortGen = m_SortGen;
+				IdleStartSecs = time(NULL);
 				}
-			else 
+			IdleRemainSecs = cPoolIdleSecs - (int)(time(NULL) - IdleStartSecs);
+			if(IdleRemainSecs <= 0)		// no sort started for cPoolIdleSecs so release this pool thread
 				{
-				if(pLow < pCurPartEnd) 
-					{
-					pSubPartStackEl->pCurLeft = pLow;
-					pSubPartStackEl->pCurRight = pCurPartEnd;
-					pSubPartStackEl += 1;
-					}
-
-				if(pCurPartStart < pHigh) 
-					{
-					pCurPartEnd = pHigh;
-					goto recurse;           
-					}
+				AtomicAdd(&m_NumIdle,-1);
+				break;
 				}
+			WaitPoolCond(IdleRemainSecs);
 			}
+		else
+			WaitPoolCond();
 		}
+	AtomicAdd(&m_NumIdle,-1);
+	ReleasePoolLock();
 	}
 
-pSubPartStackEl -= 1;
-if (pSubPartStackEl >= &SubPartStackEls[0]) 
+if(!bCaller)	// pool thread exiting, slot is available for a replacement thread
 	{
-	pCurPartStart = pSubPartStackEl->pCurLeft;
-	pCurPartEnd = pSubPartStackEl->pCurRight;
-	goto recurse; 
+	m_bPoolSlotUsed[Slot] = false;
+	m_NumPoolThreads -= 1;
+	SignalPoolCond();
 	}
+ReleasePoolLock();
+}
 
-return;       
+// Sort
+// Sort processing common to both untyped and typed sorts
+// Calling thread starts by partitioning the complete array, queuing the larger sub-partitions onto it's deque from where idle pool threads steal them,
+// pool threads in turn queue their larger sub-partitions onto their own deques
+void
+CMTqsort::Sort(void *pArray,				// array containing elements to be sorted
+				INT64 NumEls,				// number of elements in array
+				size_t ElSize,				// size in bytes of each element
+				comparer CompareFunc,		// function to compare pairs of elements
+				tpSortPart pSortPart)		// function to sort partitions
+{
+AcquireLock(true);			// sorts using same instance are serialised
+if(NumEls >= (cMinPoolPartEls * 2))
+	StartPool();
+m_ElSize = ElSize;
+m_CompareFunc = CompareFunc;
+m_pSortPart = pSortPart;
+
+AcquirePoolLock();
+m_bSortActive = true;
+m_SortGen += 1;
+m_NumActive = 1;
+ReleasePoolLock();
+
+(this->*pSortPart)(0,(UINT8 *)pArray,(UINT8 *)pArray + ElSize * (NumEls-1));
+AtomicAdd(&m_NumActive,-1);
+
+// help process any partitions still queued and wait for pool threads to complete their partitions
+if(m_pDeques != NULL)
+	ProcParts(0,true);
+
+// pool threads now idle waiting for the next sort, signal so they will start timing their release
+AcquirePoolLock();
+m_bSortActive = false;
+SignalPoolCond();
+ReleasePoolLock();
+ReleaseLock(true);
 }
 
 // threaded qsort 
@@ -450,43 +677,11 @@ CMTqsort::qsort(void *pArray,
 				size_t ElSize,
 				comparer CompareFunc)
 {
-int CurThreads;
 if(pArray == NULL || NumEls <= 1 || ElSize < 1 || CompareFunc == NULL)
 	return;
 
 if(NumEls < cMinUseLibQsort)
 	return(::qsort(pArray,(size_t)NumEls,ElSize,CompareFunc));
 
-m_CurThreads = 1;		// this thread counts as the first, additional threads will be created to process sub-partitions up the limit of m_MaxThreads
-memset(m_ThreadArgs,0,sizeof(m_ThreadArgs));
-
-// start sort processing
-_mtqsort(true, pArray,NumEls,ElSize,CompareFunc);
-
-// spin-wait for all threads which may still be processing sub-partitions to complete
-do {
-	AcquireLock(false);
-	CurThreads = m_CurThreads;
-	ReleaseLock(false);
-	if(CurThreads > 1)
-#ifdef _WIN32
-		Sleep(500);
-#else
-		sleep(1);
-#endif	
-	}
-while(CurThreads > 1);
+Sort(pArray,NumEls,ElSize,CompareFunc,&CMTqsort::SortPart<tsMTqsortVoidOps>);
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
@@ -5,7 +5,8 @@ const int cDfltSortThreads = 8;		// default is for this many sort threads
 const int cMaxPartStack = 100;		// qsort at most should only require 1 + log2(ElsToSort) stack entries so allow for full 2^64 entries plus a few spare
 const int cMergeSortThres = 16;		// switch from qsort to insert sort if <= this number of els to sort
 const INT64 cMinUseLibQsort = 25000; // use library qsort if less than this number of elements to be sorted
-const INT64 cMaxUseThreadQsort = 8000000000; // if more than this number of elements in current partition then keep sub-dividing until less or equal
+const INT64 cMinPoolPartEls = (cMinUseLibQsort * 2); // only partitions of at least this many elements are queued where they can be stolen by other threads
+const int cPoolIdleSecs = 5;		// pool threads are released if no sort has been started for this many seconds
 
 typedef int (*comparer)(const void *, const void *);
 
@@ -17,65 +18,307 @@ typedef struct TAG_sSubPartStackEl {
 	UINT8 *pCurRight;						// right boundary for this stacked sub-partition
 } tsSubPartStackEl;
 
-typedef struct TAG_CMTqsort_args {
-  class CMTqsort *pThis;
-  void *pArray;				// array containing elements to be sorted 
-  INT64 NumEls;				// number of elements in array 
-  size_t ElSize;			// size in bytes of each element
-  comparer CompareFunc;	    // function to compare pairs of elements
-} tsCMTqsort_args;
-
 #pragma pack()
 
+// each sorting thread owns a deque of partitions; the owner pushes and pops at the bottom, other threads when idle steal from the top
+// which holds the oldest and therefore largest partitions
+// partitions are only queued after the larger of two sub-partitions so a deque holds at most 1 + log2(ElsToSort) partitions
+typedef struct TAG_sMTqsortDeque {
+	volatile int Top;						// next partition to be stolen
+	volatile int Bottom;					// next free slot for owner push
+#ifdef WIN32
+	SRWLOCK hLock;							// serialises owner and thieves
+#else
+	pthread_mutex_t hLock;					// serialises owner and thieves
+#endif
+	tsSubPartStackEl Parts[cMaxPartStack];	// queued partitions
+} tsMTqsortDeque;
+
+// element operations used when elements are only known at runtime by their size and are compared through a function ptr
+struct tsMTqsortVoidOps {
+	static inline size_t ElSize(size_t ElSize) { return(ElSize); }
+	static inline int Compare(comparer CompareFunc,const UINT8 *pEl1,const UINT8 *pEl2) { return(CompareFunc(pEl1,pEl2)); }
+	static inline void Exchange(UINT8 *pEl1,UINT8 *pEl2,size_t ElSize);
+};
+
+// element operations used when elements are of known type T and comparer is known at compile time so it can be inlined
+template <class T, comparer CompareFunc> struct tsMTqsortTypedOps {
+	static inline size_t ElSize(size_t) { return(sizeof(T)); }
+	static inline int Compare(comparer,const UINT8 *pEl1,const UINT8 *pEl2) { return(CompareFunc(pEl1,pEl2)); }
+	static inline void Exchange(UINT8 *pEl1,UINT8 *pEl2,size_t) { T Tmp = *(T *)pEl1; *(T *)pEl1 = *(T *)pEl2; *(T *)pEl2 = Tmp; }
+};
+
 class CMTqsort
 {
-	int m_MaxThreads;							// limit number of threads to be no more than this, defaults to be cMaxSortThreads unless user overrides with call to SetMaxThreads
-	int m_CurThreads;							// current number of threads
+	typedef void (CMTqsort::*tpSortPart)(int Slot,UINT8 *pLeft,UINT8 *pRight); // sorts a single partition, instantiated for either untyped or typed elements
 
-	tsCMTqsort_args m_ThreadArgs[cMaxSortThreads];	// for holding thread args
+	typedef struct TAG_sPoolThreadPars {
+		CMTqsort *pThis;						// pool thread is processing for this instance
+		int Slot;								// pool thread owns this deque slot (1..cMaxSortThreads-1), calling thread owns slot 0
+	} tsPoolThreadPars;
 
-	void Exchange(UINT8 *pEl1,			    // exchange this element
-	  UINT8 *pEl2,					// with this element
-	  size_t ElSize);				// size in bytes of each element
+	int m_MaxThreads;							// limit number of threads to be no more than this, defaults to be cDfltSortThreads unless user overrides with call to SetMaxThreads
 
-	void InsertSort(UINT8 *pLeft,	// pts to leftmost element		
-	    UINT8 *pRight,				// pts to rightmost element
-		size_t ElSize,				// size in bytes of each element
-		comparer CompareFunc);		// function to compare pairs of elements
+	// parameters for the sort currently being processed
+	size_t m_ElSize;							// size in bytes of each element
+	comparer m_CompareFunc;						// function to compare pairs of elements
+	tpSortPart m_pSortPart;						// function to sort a partition
 
-	bool							// true if thread was available for handling this partition sort, false if caller needs to do the sort
-		ThreadQSort(void *pArray,  	// array containing elements to be sorted
-				size_t NumEls,					// number of elements in array
-				size_t ElSize,					// size in bytes of each element
-				comparer CompareFunc);			// function to compare pairs of elements
+	// pool of detached sort threads, started by sorts large enough to benefit and released after cPoolIdleSecs without a sort being started
+	int m_NumPoolThreads;						// number of threads in pool
+	bool m_bPoolSlotUsed[cMaxSortThreads];		// slots owned by pool threads
+	tsPoolThreadPars m_PoolThreadPars[cMaxSortThreads]; // parameters for each pool thread slot
+#ifndef WIN32
+	pid_t m_PoolPID;							// process which started the pool threads, a forked child process will need to start it's own pool
+#endif
+	bool m_bTermPool;							// set true to request pool threads to terminate
+	bool m_bSortActive;							// set true whilst a sort is being processed
+	UINT32 m_SortGen;							// incremented as each sort is started, pool threads time their release from the last sort
+	tsMTqsortDeque *m_pDeques;					// allocated on first pool start, one deque per slot
+	volatile INT32 m_NumIdle;					// number of threads currently waiting for partitions to be queued
+	volatile INT32 m_NumActive;					// number of threads, including the calling thread, currently processing partitions
+	volatile INT32 m_NumQueued;					// number of partitions queued over all deques
+
+	template <class Ops> void InsertSort(UINT8 *pLeft,	// pts to leftmost element		
+	    UINT8 *pRight);							// pts to rightmost element
+
+	template <class Ops> void SortPart(int Slot,	// sorting thread owns this deque slot
+		UINT8 *pLeft,								// pts to leftmost element of partition to sort
+		UINT8 *pRight);								// pts to rightmost element
+
+	bool										// true if partition was queued where it can be stolen, false if caller needs to do the sort
+		PushPart(int Slot,						// onto deque owned by this slot
+			  UINT8 *pLeft,						// pts to leftmost element of partition
+			  UINT8 *pRight);					// pts to rightmost element
+
+	bool PopPart(int Slot,						// pop most recently queued partition from deque owned by this slot
+			  tsSubPartStackEl *pPart);			// returned partition
 
-	void _mtqsort(bool bUseThreads,						// if true then can create threads to handle sub-partitions
-				void *pArray,				// array containing elements to be sorted
+	bool StealPart(int Slot,					// steal oldest partition from any deque other than that owned by this slot
+			  tsSubPartStackEl *pPart);			// returned partition
+
+	static INT32 AtomicAdd(volatile INT32 *pVal,INT32 Incr);	// atomically add Incr to *pVal and return the updated value
+
+	void Sort(void *pArray,						// array containing elements to be sorted
 				INT64 NumEls,					// number of elements in array
 				size_t ElSize,					// size in bytes of each element
-				comparer CompareFunc);			// function to compare pairs of elements
+				comparer CompareFunc,			// function to compare pairs of elements
+				tpSortPart pSortPart);			// function to sort partitions
+
+	void ProcParts(int Slot,					// process queued partitions as the thread owning this deque slot
+				bool bCaller);					// if bCaller then returns when sort completed else when pool thread is to be released
+
+	void StartPool(void);						// start pool threads
+	void TermPool(void);						// terminate any pool threads
+	void InitPoolLocks(void);					// initialise pool and deque locks
+	void InitDeques(void);						// initialise any allocated deques as empty
 
 #ifdef WIN32
-	SRWLOCK m_hRwLock;
-	static unsigned int __stdcall _qsort_start (void *args);
+	SRWLOCK m_hRwLock;							// serialises sorts and changes to max threads
+	SRWLOCK m_hPoolLock;						// protects pool and pending partition state
+	CONDITION_VARIABLE m_hPoolCond;				// signalled on pending partitions, sort completion, or pool termination
+	static unsigned int __stdcall _pool_start (void *args);
 #else
-	pthread_rwlock_t m_hRwLock;
-	static void * _qsort_start (void *args);
+	pthread_rwlock_t m_hRwLock;					// serialises sorts and changes to max threads
+	pthread_mutex_t m_hPoolLock;				// protects pool and pending partition state
+	pthread_cond_t m_hPoolCond;					// signalled on pending partitions, sort completion, or pool termination
+	static void * _pool_start (void *args);
 #endif
 
 	void AcquireLock(bool bExclusive);
 	void ReleaseLock(bool bExclusive);
+	void AcquirePoolLock(void);
+	void ReleasePoolLock(void);
+	bool WaitPoolCond(int TimeoutSecs = 0);		// returns false if TimeoutSecs > 0 and timed out
+	void SignalPoolCond(void);
 
 public:
 	CMTqsort(void);
 	~CMTqsort(void);
 
+	static void Exchange(UINT8 *pEl1,			// exchange this element
+	  UINT8 *pEl2,								// with this element
+	  size_t ElSize);							// size in bytes of each element
+
 	void SetMaxThreads(int MaxThreads);
 
 	void qsort(void *pArray,					// array containing elements to be sorted
 				INT64 NumEls,					// number of elements in array
 				size_t ElSize,					// size in bytes of each element
 				comparer CompareFunc);			// function to compare pairs of elements
+
+	// typed sort, element exchanges are by type T and calls to CompareFunc can be inlined
+	// e.g. m_mtqsort.qsort<tsReadHit *,SortReadIDs>(m_ppReadHitsIdx,m_NumReadsLoaded);
+	template <class T, comparer CompareFunc> void qsort(T *pArray,	// array containing elements to be sorted
+				INT64 NumEls)					// number of elements in array
+		{
+		if(pArray == NULL || NumEls <= 1)
+			return;
+		Sort(pArray,NumEls,sizeof(T),CompareFunc,&CMTqsort::SortPart<tsMTqsortTypedOps<T,CompareFunc> >);
+		}
 };
 
+inline void
+tsMTqsortVoidOps::Exchange(UINT8 *pEl1,UINT8 *pEl2,size_t ElSize)
+{
+CMTqsort::Exchange(pEl1,pEl2,ElSize);
+}
+
+// InsertSort
+// Insertion sort used when the number of elements in partition is <= cMergeSortThres
+template <class Ops> void
+CMTqsort::InsertSort(UINT8 *pLeft,	// pts to leftmost element		
+	    UINT8 *pRight)				// pts to rightmost element
+{
+UINT8 *pProbe;
+UINT8 *pMax;
+const size_t ElSize = Ops::ElSize(m_ElSize);
+
+while (pRight > pLeft) {
+	pMax = pLeft;
+    for (pProbe = pLeft + ElSize; pProbe <= pRight; pProbe += ElSize)
+	   if (Ops::Compare(m_CompareFunc, pProbe, pMax) > 0)
+                pMax = pProbe;
+	if(pMax != pRight)
+		Ops::Exchange(pMax, pRight, ElSize);
+	pRight -= ElSize;
+    }
+}
+
+// SortPart
+// Sorts a partition, the larger sub-partitions are queued onto this thread's deque from where idle threads may steal them, smaller sub-partitions are stacked locally
+template <class Ops> void 
+CMTqsort::SortPart(int Slot,		// sorting thread owns this deque slot
+				UINT8 *pLeft,		// pts to leftmost element of partition to sort
+				UINT8 *pRight)		// pts to rightmost element
+{
+UINT8 *pCurPartStart;							// current partition start
+UINT8 *pCurPartEnd;								// current partition end
+UINT8 *pCurPartMid;								// pivot point in current partition, hopefully will be the median value so partition will be split into two equal sized sub partitions!
+UINT8 *pLow;									// used when traversing partition starting from start towards end 
+UINT8 *pHigh;									// used when traversing partition starting from end towards start 
+size_t NumElsCurPart;							// number of elements in current sub-partition
+tsSubPartStackEl SubPartStackEls[cMaxPartStack];		// stack of sub-partitions to yet to be processed 
+tsSubPartStackEl *pSubPartStackEl;				// stack ptr
+const size_t ElSize = Ops::ElSize(m_ElSize);
+const comparer CompareFunc = m_CompareFunc;
+const size_t MinPoolPartBytes = m_NumPoolThreads > 0 ? (size_t)cMinPoolPartEls * ElSize : (size_t)-1;
+
+if (pLeft >= pRight)									// anything to sort?		
+    return;                
+
+pSubPartStackEl = &SubPartStackEls[0];                 
+pCurPartStart = pLeft;
+pCurPartEnd = pRight;    
+
+recurse:
+	{
+    NumElsCurPart = (pCurPartEnd - pCurPartStart) / ElSize + 1;        
+	if (NumElsCurPart <= cMergeSortThres)										// with small number of els then more efficent to do a insert sort than continueing with the qsort
+		InsertSort<Ops>(pCurPartStart, pCurPartEnd);
+	else 
+		 {		
+		 // select a pivot as being the median of 3, with luck this may result in a near even split of the current partition
+		 pCurPartMid = pCurPartStart + (NumElsCurPart / 2) * ElSize;
+		 if (Ops::Compare(CompareFunc, pCurPartStart, pCurPartMid) > 0)
+			Ops::Exchange(pCurPartStart, pCurPartMid, ElSize);
+		if (Ops::Compare(CompareFunc, pCurPartStart, pCurPartEnd) > 0)
+			Ops::Exchange(pCurPartStart, pCurPartEnd, ElSize);
+		if (Ops::Compare(CompareFunc, pCurPartMid, pCurPartEnd) > 0)
+			Ops::Exchange(pCurPartMid, pCurPartEnd, ElSize);
+    
+		pLow = pCurPartStart;
+		pHigh = pCurPartEnd;
+
+		while(1) 
+			{
+			 if (pCurPartMid > pLow) 
+				do  {
+					pLow += ElSize;
+					} 
+				while (pLow < pCurPartMid && Ops::Compare(CompareFunc, pLow, pCurPartMid) <= 0);
+			
+
+			if (pCurPartMid <= pLow)
+				do  {
+					pLow += ElSize;
+					} while (pLow <= pCurPartEnd && Ops::Compare(CompareFunc, pLow, pCurPartMid) <= 0);
+			
+			do  {
+				pHigh -= ElSize;
+				} 
+			while (pHigh > pCurPartMid && Ops::Compare(CompareFunc, pHigh, pCurPartMid) > 0);
+		
+			if (pHigh < pLow)
+				break;
+
+			Ops::Exchange(pLow, pHigh, ElSize);
+
+			if (pCurPartMid == pHigh)
+				pCurPartMid = pLow;
+			}
+
+
+		pHigh += ElSize;
+		if (pCurPartMid < pHigh)
+			do  {
+				pHigh -= ElSize;
+				} 
+			while (pHigh > pCurPartMid && Ops::Compare(CompareFunc, pHigh, pCurPartMid) == 0);
+		
+		if (pCurPartMid >= pHigh)
+			do  {
+				pHigh -= ElSize;
+				} 
+			while (pHigh > pCurPartStart && Ops::Compare(CompareFunc, pHigh, pCurPartMid) == 0);
+		
+		// the larger sub-partition is queued onto this thread's deque, if too small to be worth stealing then stacked for later local processing
+		if (pHigh - pCurPartStart >= pCurPartEnd - pLow ) 
+			{
+			if (pCurPartStart < pHigh) 
+				{
+				if((size_t)(pHigh - pCurPartStart) < MinPoolPartBytes || !PushPart(Slot,pCurPartStart,pHigh))
+					{
+					pSubPartStackEl->pCurLeft = pCurPartStart;
+					pSubPartStackEl->pCurRight = pHigh;
+					pSubPartStackEl += 1;
+					}
+ 				}                   
+
+			if (pLow < pCurPartEnd) 
+				{
+				pCurPartStart = pLow;
+				goto recurse;       
+				}
+			}
+		else 
+			{
+			if(pLow < pCurPartEnd) 
+				{
+				if((size_t)(pCurPartEnd - pLow) < MinPoolPartBytes || !PushPart(Slot,pLow,pCurPartEnd))
+					{
+					pSubPartStackEl->pCurLeft = pLow;
+					pSubPartStackEl->pCurRight = pCurPartEnd;
+					pSubPartStackEl += 1;
+					}
+				}
+
+			if(pCurPartStart < pHigh) 
+				{
+				pCurPartEnd = pHigh;
+				goto recurse;           
+				}
+			}
+		}
+	}
+
+// locally stacked sub-partitions are processed by this thread, queued sub-partitions not stolen are popped by ProcParts() after returning
+if(--pSubPartStackEl >= &SubPartStackEls[0]) 
+	{
+	pCurPartStart = pSubPartStackEl->pCurLeft;
+	pCurPartEnd = pSubPartStackEl->pCurRight;
+	goto recurse; 
+	}
 
+return;       
+}
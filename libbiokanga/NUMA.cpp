@@ -0,0 +1,239 @@
+/*
+ * CSIRO Open Source Software License Agreement (GPLv3)
+ * Copyright (c) 2017, Commonwealth Scientific and Industrial Research Organisation (CSIRO) ABN 41 687 119 230.
+ * See LICENSE for the complete license information (https://github.com/csiro-crop-informatics/biokanga/LICENSE)
+ * Contact: Alex Whan <alex.whan@csiro.au>
+ */
+
+// NUMA node discovery, thread to node binding, and memory page interleaving
+// On Linux the topology is discovered from sysfs and the mbind syscall is used directly so there is no dependency on libnuma
+// On Windows the topology is discovered with GetNumaNodeProcessorMask, only the first processor group is supported, and interleaving is not supported
+
+#include "stdafx.h"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#if _WIN32
+#include <process.h>
+#include "../libbiokanga/commhdrs.h"
+#else
+#include <sys/syscall.h>
+#include <sched.h>
+#include <pthread.h>
+#include "../libbiokanga/commhdrs.h"
+
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3				// as in numaif.h
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1<<1)				// as in numaif.h
+#endif
+#endif
+
+CNUMA::CNUMA(void)
+{
+m_NumNodes = 0;
+memset(m_NodeIDs,0,sizeof(m_NodeIDs));
+memset(m_NumNodeCPUs,0,sizeof(m_NumNodeCPUs));
+memset(m_NodeCPUMasks,0,sizeof(m_NodeCPUMasks));
+}
+
+CNUMA::~CNUMA(void)
+{
+}
+
+// ParseCPUList
+// Parses comma separated list of CPUs or CPU ranges, e.g. "0-7,16-23", setting corresponding bits in pCPUMask
+// Returns number of CPUs parsed
+int
+CNUMA::ParseCPUList(char *pszCPUList,	// parse CPU list, e.g. "0-7,16-23", as in Linux sysfs 'cpulist' files
+					UINT64 *pCPUMask)	// setting bits in this CPU mask, returns number of CPUs parsed
+{
+int NumCPUs;
+int StartCPU;
+int EndCPU;
+char *pEnd;
+
+NumCPUs = 0;
+while(*pszCPUList != '\0')
+	{
+	while(*pszCPUList == ',' || isspace(*pszCPUList))
+		pszCPUList++;
+	if(!isdigit(*pszCPUList))
+		break;
+	StartCPU = (int)strtol(pszCPUList,&pEnd,10);
+	EndCPU = StartCPU;
+	pszCPUList = pEnd;
+	if(*pszCPUList == '-')
+		{
+		EndCPU = (int)strtol(pszCPUList+1,&pEnd,10);
+		pszCPUList = pEnd;
+		}
+	for(; StartCPU <= EndCPU && StartCPU < cMaxNUMACPUs; StartCPU++)
+		{
+		pCPUMask[StartCPU / 64] |= (UINT64)1 << (StartCPU % 64);
+		NumCPUs += 1;
+		}
+	}
+return(NumCPUs);
+}
+
+// Discover
+// Discover NUMA nodes and the CPUs on each node
+// Returns number of nodes, if unable to discover topology then a single node is assumed
+int
+CNUMA::Discover(void)
+{
+m_NumNodes = 0;
+memset(m_NodeIDs,0,sizeof(m_NodeIDs));
+memset(m_NumNodeCPUs,0,sizeof(m_NumNodeCPUs));
+memset(m_NodeCPUMasks,0,sizeof(m_NodeCPUMasks));
+
+#ifdef _WIN32
+ULONG HighestNode;
+ULONGLONG NodeMask;
+UCHAR Node;
+if(GetNumaHighestNodeNumber(&HighestNode))
+	{
+	for(Node = 0; Node <= HighestNode && m_NumNodes < cMaxNUMANodes; Node++)
+		{
+		if(!GetNumaNodeProcessorMask(Node,&NodeMask) || NodeMask == 0)
+			continue;
+		m_NodeIDs[m_NumNodes] = Node;
+		m_NodeCPUMasks[m_NumNodes][0] = (UINT64)NodeMask;
+		for(; NodeMask != 0; NodeMask &= NodeMask - 1)
+			m_NumNodeCPUs[m_NumNodes] += 1;
+		m_NumNodes += 1;
+		}
+	}
+#else
+FILE *pFile;
+char szNodes[1024];
+char szCPUList[4096];
+char szPath[_MAX_PATH];
+UINT64 NodesMask[(cMaxNUMANodes + 63) / 64];
+int Node;
+
+memset(NodesMask,0,sizeof(NodesMask));
+if((pFile = fopen("/sys/devices/system/node/online","r")) != NULL)
+	{
+	if(fgets(szNodes,sizeof(szNodes),pFile) != NULL)
+		{
+		UINT64 CPUMask[cNUMACPUMaskWords];			// node list has same format as CPU lists
+		memset(CPUMask,0,sizeof(CPUMask));
+		ParseCPUList(szNodes,CPUMask);
+		memcpy(NodesMask,CPUMask,sizeof(NodesMask));
+		}
+	fclose(pFile);
+	}
+for(Node = 0; Node < cMaxNUMANodes; Node++)
+	{
+	if(!(NodesMask[Node / 64] & ((UINT64)1 << (Node % 64))))
+		continue;
+	sprintf(szPath,"/sys/devices/system/node/node%d/cpulist",Node);
+	if((pFile = fopen(szPath,"r")) == NULL)
+		continue;
+	if(fgets(szCPUList,sizeof(szCPUList),pFile) != NULL &&
+		(m_NumNodeCPUs[m_NumNodes] = ParseCPUList(szCPUList,m_NodeCPUMasks[m_NumNodes])) > 0)	// memory only nodes have no CPUs
+		{
+		m_NodeIDs[m_NumNodes] = Node;
+		m_NumNodes += 1;
+		}
+	else
+		{
+		m_NumNodeCPUs[m_NumNodes] = 0;
+		memset(m_NodeCPUMasks[m_NumNodes],0,sizeof(m_NodeCPUMasks[m_NumNodes]));
+		}
+	fclose(pFile);
+	}
+#endif
+
+if(m_NumNodes == 0)		// unable to discover, treat as single node with no CPU binding
+	{
+	m_NumNodes = 1;
+	m_NodeIDs[0] = 0;
+	m_NumNodeCPUs[0] = 0;
+	}
+return(m_NumNodes);
+}
+
+int
+CNUMA::NumNodes(void)
+{
+return(m_NumNodes == 0 ? Discover() : m_NumNodes);
+}
+
+int
+CNUMA::NodeID(int NodeIdx)
+{
+if(NodeIdx < 0 || NodeIdx >= NumNodes())
+	return(eBSFerrParams);
+return(m_NodeIDs[NodeIdx]);
+}
+
+int
+CNUMA::NodeForThread(int ThreadIdx)
+{
+if(ThreadIdx < 0)
+	return(eBSFerrParams);
+return(ThreadIdx % NumNodes());
+}
+
+// BindThreadToNode
+// Binds calling thread to the CPUs of node NodeIdx so that memory subsequently first touched by the thread will be allocated from that node
+// If a single node, or node CPUs unknown, then thread is left unbound
+int
+CNUMA::BindThreadToNode(int NodeIdx)
+{
+if(NodeIdx < 0 || NodeIdx >= NumNodes())
+	return(eBSFerrParams);
+if(m_NumNodes == 1 || m_NumNodeCPUs[NodeIdx] == 0)
+	return(eBSFSuccess);
+#ifdef _WIN32
+if(SetThreadAffinityMask(GetCurrentThread(),(DWORD_PTR)m_NodeCPUMasks[NodeIdx][0]) == 0)
+	return(eBSFerrInternal);
+#else
+cpu_set_t CpuSet;
+int CPU;
+CPU_ZERO(&CpuSet);
+for(CPU = 0; CPU < cMaxNUMACPUs && CPU < CPU_SETSIZE; CPU++)
+	if(m_NodeCPUMasks[NodeIdx][CPU / 64] & ((UINT64)1 << (CPU % 64)))
+		CPU_SET(CPU,&CpuSet);
+if(pthread_setaffinity_np(pthread_self(),sizeof(CpuSet),&CpuSet) != 0)
+	return(eBSFerrInternal);
+#endif
+return(eBSFSuccess);
+}
+
+// InterleaveMem
+// Interleaves pages of pMem over all nodes, any pages already touched are migrated
+// Memory should have been allocated with mmap so as to be page aligned and not shared with other allocations
+int
+CNUMA::InterleaveMem(void *pMem,size_t MemLen)
+{
+if(pMem == NULL || MemLen == 0)
+	return(eBSFerrParams);
+if(NumNodes() == 1)
+	return(eBSFSuccess);
+#ifdef _WIN32
+return(eBSFSuccess);		// no Windows equivalent to mbind on already allocated memory
+#else
+unsigned long NodeMask[2];
+size_t PageSize;
+UINT8 *pStart;
+int NodeIdx;
+
+memset(NodeMask,0,sizeof(NodeMask));
+for(NodeIdx = 0; NodeIdx < m_NumNodes; NodeIdx++)
+	if(m_NodeIDs[NodeIdx] < (int)(sizeof(unsigned long) * 8))
+		NodeMask[0] |= 1UL << m_NodeIDs[NodeIdx];
+PageSize = (size_t)sysconf(_SC_PAGESIZE);
+pStart = (UINT8 *)((size_t)pMem & ~(PageSize - 1));
+MemLen += (UINT8 *)pMem - pStart;
+if(syscall(SYS_mbind,pStart,MemLen,MPOL_INTERLEAVE,NodeMask,sizeof(unsigned long) * 8 + 1,MPOL_MF_MOVE) != 0)
+	return(eBSFerrInternal);
+return(eBSFSuccess);
+#endif
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// NUMA node discovery, binding of threads to the CPUs of a node, and interleaving of memory pages over all nodes
+// On hosts with a single node, or on which the NUMA topology can't be discovered, all nodes are treated as being a single node
+// and binding or interleaving are simply no-ops
+
+const int cMaxNUMANodes = 64;				// allow for at most this many NUMA nodes
+const int cMaxNUMACPUs = 1024;				// allow for at most this many CPUs over all nodes
+const int cNUMACPUMaskWords = (cMaxNUMACPUs + 63) / 64;	// CPU masks are held as this many 64bit words
+
+class CNUMA
+{
+	int m_NumNodes;									// number of NUMA nodes discovered, 1 if unable to discover
+	int m_NodeIDs[cMaxNUMANodes];					// operating system identifiers of each discovered node
+	int m_NumNodeCPUs[cMaxNUMANodes];				// number of CPUs on each node
+	UINT64 m_NodeCPUMasks[cMaxNUMANodes][cNUMACPUMaskWords];	// CPUs on each node
+
+	int ParseCPUList(char *pszCPUList,				// parse CPU list, e.g. "0-7,16-23", as in Linux sysfs 'cpulist' files
+					UINT64 *pCPUMask);				// setting bits in this CPU mask, returns number of CPUs parsed
+
+public:
+	CNUMA(void);
+	~CNUMA(void);
+
+	int Discover(void);								// discover NUMA nodes and their CPUs, returns number of nodes discovered
+	int NumNodes(void);								// returns number of nodes discovered
+	int NodeID(int NodeIdx);						// returns operating system identifier of node NodeIdx (0..NumNodes()-1)
+	int NodeForThread(int ThreadIdx);				// returns node index (0..NumNodes()-1) on which thread ThreadIdx (0..N) is to be placed, threads are round robin placed over nodes
+	int BindThreadToNode(int NodeIdx);				// bind calling thread to the CPUs of node NodeIdx, any subsequent first touched memory is local to that node
+	int InterleaveMem(void *pMem,size_t MemLen);	// interleave pages of pMem over all nodes, pages already touched are migrated
+};
@@ -55,6 +55,7 @@ const char m_BasesMap[] = {'=','A','C','M','G','R','S','V','T','W','Y','H','K','
 CSAMfile::CSAMfile(void)
 {
 m_pBGZF = NULL;
+m_pIdxVAOfss = NULL;
 m_hOutSAMfile = -1;
 m_hOutBAIfile = -1;
 m_gzOutSAMfile = NULL;
@@ -176,6 +177,15 @@ if(m_p16KOfsVirtAddrs != NULL)
 	m_p16KOfsVirtAddrs = NULL;
 	}
 
+if(m_pIdxVAOfss != NULL)
+	{
+	free(m_pIdxVAOfss);
+	m_pIdxVAOfss = NULL;
+	}
+m_NumIdxVAOfss = 0;
+m_AllocIdxVAOfss = 0;
+m_bBGZFmt = false;
+
 if(m_pRefSeqs != NULL)
 	{
 	free(m_pRefSeqs);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
@@ -346,7 +356,8 @@ return(SAMType);
 
 
 int					// open and initiate processing for SAM/BAM reads processing
-CSAMfile::Open(char *pszSAMFile)	// SAM(gz) or BAM file name
+CSAMfile::Open(char *pszSAMFile,	// SAM(gz) or BAM file name
+				int NumThreads)		// if BAM then BGZF inflate using this many threads
 {
 if(pszSAMFile == NULL || pszSAMFile[0] == '\0')
 	return(eBSFerrParams);
@@ -429,6 +440,13 @@ if(m_SAMFileType >= eSFTBAM)
 		Reset();
 		return(eBSFerrOpnFile);
 		}
+	// remaining blocks can be read ahead and inflated in parallel
+	if(NumThreads > 1 && bgzf_mt(m_pInBGZF,NumThreads,cBGZFSubBlks) != 0)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"Open: unable to initialise for multithreaded BGZF processing on file '%s'",m_szSAMfileName);
+		Reset();
+		return(eBSFerrOpnFile);
+		}
 	m_bInEOF = false;
 	m_CurBAMLen = 100;
 	m_CurInBAMIdx = 4;
@@ -1383,7 +1401,8 @@ int										// create and initiate processing for SAM or BAM - with optional in
 CSAMfile::Create(eSAMFileType SAMType,	// file type, expected to be either eSFTSAM or eSFTBAM_BAI or eSFTBAM_CSI 
 				char *pszSAMFile,		// SAM(gz) or BAM file name
 				int ComprLev,			// if BAM then BGZF compress at this requested level (0..9)
-				char *pszVer)			// version text to use in generated SAM/BAM headers - if NULL then defaults to cszProgVer
+				char *pszVer,			// version text to use in generated SAM/BAM headers - if NULL then defaults to cszProgVer
+				int NumThreads)			// if BAM then BGZF compress using this many threads
 {
 if(SAMType < eSFTSAM || SAMType > eSFTBAM_CSI || pszSAMFile == NULL || pszSAMFile[0] == '\0')
 	return(eBSFerrParams);
@@ -1510,6 +1529,16 @@ if(SAMType >= eSFTBAM)
 		return(eBSFerrMem);
 		}
 	m_hOutSAMfile = -1;
+
+	// deflating is the dominant cost when writing BAM so if multiple threads then deflate BGZF blocks in parallel
+	if(NumThreads > 1)
+		{
+		if(bgzf_mt(m_pBGZF,NumThreads,cBGZFSubBlks) != 0)
+			gDiagnostics.DiagOut(eDLWarn,gszProcName,"Create: unable to initialise multithreaded BGZF compression on file '%s', continuing single threaded",m_szSAMfileName);
+		else
+			m_bBGZFmt = true;
+		}
+
 	m_pBAM[0] = (UINT8)'B';
 	m_pBAM[1] = (UINT8)'A';
 	m_pBAM[2] = (UINT8)'M';
@@ -1812,6 +1841,23 @@ if(m_CurBAILen == 0 || m_SAMFileType < eSFTBAM_BAI)
 if((m_hOutBAIfile == -1 && m_SAMFileType == eSFTBAM_BAI) || (m_pgzOutCSIfile == NULL && m_SAMFileType == eSFTBAM_CSI) || m_pBAI == NULL)
 	return(eBSFerrFileClosed);
 
+// if multithreaded BGZF then resolve provisional virtual addresses, may need to wait for referenced blocks to be written
+if(m_NumIdxVAOfss)
+	{
+	INT64 VA;
+	for(UINT32 Idx = 0; Idx < m_NumIdxVAOfss; Idx++)
+		{
+		if((VA = bgzf_mt_vaddr(m_pBGZF,*(INT64 *)&m_pBAI[m_pIdxVAOfss[Idx]])) < 0)
+			{
+			gDiagnostics.DiagOut(eDLFatal,gszProcName,"UpdateSAIIndex: BGZF write failed");
+			Reset();
+			return(eBSFerrWrite);
+			}
+		*(INT64 *)&m_pBAI[m_pIdxVAOfss[Idx]] = VA;
+		}
+	m_NumIdxVAOfss = 0;
+	}
+
 if(m_SAMFileType == eSFTBAM_BAI)
 	{
 	if(!CUtility::SafeWrite(m_hOutBAIfile,m_pBAI,m_CurBAILen))
@@ -1835,6 +1881,27 @@ return(BGZFWritten);
 }
 
 
+int
+CSAMfile::AddIdxVAOfs(size_t BAIOfs)		// if multithreaded BGZF then records offset in m_pBAI of a provisional virtual address
+{
+if(!m_bBGZFmt)
+	return(eBSFSuccess);
+if(m_pIdxVAOfss == NULL || m_NumIdxVAOfss == m_AllocIdxVAOfss)
+	{
+	UINT32 *pTmp;
+	if((pTmp = (UINT32 *)realloc(m_pIdxVAOfss,sizeof(UINT32) * (m_AllocIdxVAOfss + cAllocIdxVAOfss))) == NULL)
+		{
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"UpdateSAIIndex: unable to realloc memory for index virtual addresses");
+		Reset();
+		return(eBSFerrMem);
+		}
+	m_pIdxVAOfss = pTmp;
+	m_AllocIdxVAOfss += cAllocIdxVAOfss;
+	}
+m_pIdxVAOfss[m_NumIdxVAOfss++] = (UINT32)BAIOfs;
+return(eBSFSuccess);
+}
+
 int
 CSAMfile::UpdateSAIIndex(bool bFinal)	// true if this is the final index update
 {
@@ -1871,6 +1938,8 @@ if(m_NumBinsWithChunks > 0)
 				{
 				*(UINT64 *)pSAI = pBAIbin->StartVA;
 				pSAI += 2;
+				if((Rslt = AddIdxVAOfs(m_CurBAILen)) < eBSFSuccess)
+					return(Rslt);
 				m_CurBAILen += 8;
 				}
 			*pSAI++ = pBAIbin->NumChunks; // number of chunks following
@@ -1881,6 +1950,8 @@ if(m_NumBinsWithChunks > 0)
 				pSAI += 2;
 				*(UINT64 *)pSAI = pBAIChunks->EndVA;
 				pSAI += 2;
+				if((Rslt = AddIdxVAOfs(m_CurBAILen)) < eBSFSuccess || (Rslt = AddIdxVAOfs(m_CurBAILen + 8)) < eBSFSuccess)
+					return(Rslt);
 				m_CurBAILen += 16;
 				pBAIChunks = &m_pBAIChunks[pBAIChunks->NextChunk];
 
@@ -1908,6 +1979,9 @@ if(m_NumBinsWithChunks > 0)
 		m_CurBAILen += 4;
 		memcpy(pSAI,m_p16KOfsVirtAddrs,m_NumOf16Kbps * sizeof(UINT64));
 		pSAI += m_NumOf16Kbps * 2;
+		for(UINT32 Idx = 0; Idx < m_NumOf16Kbps; Idx++)
+			if((Rslt = AddIdxVAOfs(m_CurBAILen + (Idx * sizeof(UINT64)))) < eBSFSuccess)
+				return(Rslt);
 		m_CurBAILen += m_NumOf16Kbps * sizeof(UINT64);
 		}
 	}
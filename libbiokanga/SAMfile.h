@@ -31,6 +31,8 @@ const size_t cMaxCSIRefSeqLen = 0x7fffffff; // CSI indexes have no inherient lim
 
 const int cMaxRptSAMSeqsThres = 10000;	// default number of chroms to report if SAM output
 const int cDfltComprLev = 6;			// default compression level if BAM output
+const int cBGZFSubBlks = 8;				// if multithreaded BGZF processing then allow this many blocks per thread to be queued, each queued block slot costs 128KB
+const UINT32 cAllocIdxVAOfss = 100000;	// allocate for provisional index virtual address offsets in this many increments
 
 const size_t cAllocBAMSize = (size_t)0x003ffffff;	// initial allocation for  to hold BAM header which includes the sequence names + sequence lengths
 const size_t cAllocSAMSize = (size_t)0x01fffffff;	// initial allocation for holding SAM header and subsequently the alignments 
@@ -127,6 +129,10 @@ class CSAMfile
 	eSAMFileType m_SAMFileType;				// SAM/BAM/BAI file to be processed
 	int m_ComprLev;							// BGZF compression level
 	BGZF* m_pBGZF;							// BAM is BGZF compressed 
+	bool m_bBGZFmt;							// true if BAM BGZF compression is multithreaded, virtual addresses are then provisional until resolved
+	UINT32 m_NumIdxVAOfss;					// number of provisional virtual address offsets in m_pIdxVAOfss
+	UINT32 m_AllocIdxVAOfss;				// number of offsets allocated for m_pIdxVAOfss
+	UINT32 *m_pIdxVAOfss;					// offsets in m_pBAI of provisional virtual addresses to be resolved before the index is written to disk
 
 	size_t m_AllocRefSeqsSize;				// currently allocated m_pRefSeqs memory size in bytes
 	UINT32 m_NumRefSeqNames;				// number of reference sequence names
@@ -225,6 +231,7 @@ class CSAMfile
 				UINT64 EndVA,				// chunk alignment BAM record ends at this virtual address
 				UINT32 End);				// chunk ends at this loci
 	
+	int AddIdxVAOfs(size_t BAIOfs);			 // if multithreaded BGZF then records offset in m_pBAI of a provisional virtual address
 	int WriteIdxToDisk(void);				 // write index to disk, returns number of bytes written, can be 0 if none attempted to be written, < 0 if errors
 	int UpdateSAIIndex(bool bFinal = false); // alignments to current sequence completed, update SAI file with bins/chunks for this sequence
 
@@ -250,7 +257,8 @@ public:
 			  INT32 *pEstScoreSchema);		// currently will always return 0: no scoring 
 
 	int										// open and initiate processing for SAM/BAM reads processing
-		Open(char *pszSAMFile);				// expected to be a SAM(gz) or if extension '.BAM' then a BAM file
+		Open(char *pszSAMFile,				// expected to be a SAM(gz) or if extension '.BAM' then a BAM file
+				int NumThreads = 1);		// if BAM then BGZF inflate using this many threads
 
 
 	UINT32
@@ -282,7 +290,8 @@ public:
 		Create(eSAMFileType SAMType,		// file type, expected to be either eSFTSAM or eSFTBAM_BAI or eSFTBAM_CSI 
 				char *pszSAMFile,			// SAM(gz) or BAM file name
 				int ComprLev = cDfltComprLev,	// if BAM then BGZF compress at this requested level (0..9)
-				char *pszVer = NULL);		// version text to use in generated SAM/BAM headers - if NULL then defaults to cszProgVer
+				char *pszVer = NULL,		// version text to use in generated SAM/BAM headers - if NULL then defaults to cszProgVer
+				int NumThreads = 1);		// if BAM then BGZF compress using this many threads
 
 		// reference sequence names are expected to be presorted in seqname ascending alpha order and then AddRefSeq'd in that ascending order
 	int AddRefSeq(char *pszSpecies,			// sequence from this species
@@ -23,6 +23,7 @@ static int gMaxBaseCmpLen = (5 * cMaxReadLen);   // used to limit the number of
 static int QSortSeqCmp32(const void *p1,const void *p2);
 static int QSortSeqCmp40(const void *p1,const void *p2);
 static int QSortEntryNames(const void *p1,const void *p2);
+static void SelectSeqCmpKernels(void);
 
 static UINT8 *gpSfxArray = NULL;
 static etSeqBase *gpSeq = NULL;
@@ -62,9 +63,24 @@ m_MaxIter = cDfltMaxIter;
 m_bInMemSfx = false;
 m_MaxQSortThreads = cDfltSortThreads;
 m_MTqsort.SetMaxThreads(m_MaxQSortThreads);
+m_bSAISSort = true;
+m_bPackSeqReq = false;
+m_bPackedSeq = false;
+m_SfxSampleReq = 1;
+m_SfxSampleStep = 1;
+m_bAcceptSampled = false;
+m_SfxLoadMode = eSfxLoadPrivate;
+m_bNUMAInterleave = false;
+m_pSfxMapBase = NULL;
+m_SfxMapLen = 0;
+m_SfxKMerIdxLen = 0;
+m_SfxKMerIdxBlockID = 0;
+m_pSfxKMerIdx = NULL;
+m_AllocSfxKMerIdxMem = 0;
 m_MaxSfxBlockEls = cMaxAllowConcatSeqLen;
 m_CASSeqFlags = 0;
 gMaxBaseCmpLen = (5 * cMaxReadLen);
+SelectSeqCmpKernels();
 
 #ifdef _WIN32
 m_threadID = 0;
@@ -97,6 +113,17 @@ if(m_bThreadActive)	// if processing reads against sfx blocks then need to termi
 #endif
 	}
 
+FreeSfxKMerIdx();
+
+#ifndef _WIN32
+if(m_pSfxMapBase != NULL)		// suffix block was mapped directly from file, not allocated
+	{
+	munmap(m_pSfxMapBase,m_SfxMapLen);
+	m_pSfxMapBase = NULL;
+	m_pSfxBlock = NULL;
+	}
+#endif
+
 if(m_pSfxBlock != NULL)
 	{
 #ifdef _WIN32
@@ -182,6 +209,18 @@ if(m_hFile != -1)
 
 memset(&m_SfxHeader,0,sizeof(m_SfxHeader));
 
+FreeSfxKMerIdx();
+
+#ifndef _WIN32
+if(m_pSfxMapBase != NULL)		// suffix block was mapped directly from file, not allocated
+	{
+	munmap(m_pSfxMapBase,m_SfxMapLen);
+	m_pSfxMapBase = NULL;
+	m_SfxMapLen = 0;
+	m_pSfxBlock = NULL;
+	}
+#endif
+
 if(m_pSfxBlock != NULL)
 	{
 #ifdef _WIN32
@@ -239,6 +278,8 @@ m_bBisulfite = false;
 m_bColorspace = false;
 m_MaxIter = cDfltMaxIter;
 m_bV3File = false;
+m_bPackedSeq = false;
+m_SfxSampleStep = 1;
 m_bInMemSfx = false;
 m_MaxMMExploreInDel = cMaxMMExploreInDel;
 m_MaxInDelLen = cMaxMicroInDelLen;
@@ -257,6 +298,12 @@ CSfxArrayV3::SetMaxQSortThreads(int MaxThreads)			// sets maximum number of thre
 m_MTqsort.SetMaxThreads(MaxThreads);
 }
 
+void
+CSfxArrayV3::SetSAISSort(bool bSAISSort)			// if true then suffix arrays are constructed using linear time induced sorting, otherwise multithreaded qsort is used
+{
+m_bSAISSort = bSAISSort;
+}
+
 int						// returns the previously utilised MaxBaseCmpLen
 CSfxArrayV3::SetMaxBaseCmpLen(int MaxBaseCmpLen)		// sets maximum number of bases which need to be compared for equality in multithreaded qsorts, will be clamped to be in range 10..(5*cMaxReadLen)
 {
@@ -287,7 +334,7 @@ m_SfxHeader.Magic[0] = 's';
 m_SfxHeader.Magic[1] = 'f';
 m_SfxHeader.Magic[2] = 'x';
 m_SfxHeader.Magic[3] = '5';
-m_SfxHeader.Version = cSFXVersion;	        // file structure version
+m_SfxHeader.Version = cSFXVersionUnpacked;	        // file structure version, updated to cSFXVersion if sequences are 2bit packed
 m_SfxHeader.FileLen = sizeof(tsSfxHeaderV3);	// current file length (nxt write psn)
 m_SfxHeader.szDatasetName[0] = '\0';
 m_SfxHeader.szDescription[0] = '\0';
@@ -316,6 +363,27 @@ if(m_bColorspace)
 else
 	m_SfxHeader.Attributes &= ~0x02;
 
+if(m_bPackedSeq)
+	m_SfxHeader.Attributes |= 0x04;
+else
+	m_SfxHeader.Attributes &= ~0x04;
+
+m_SfxHeader.Attributes &= ~(0x0ff << cSfxSampleAttrShf);
+if(m_SfxSampleStep > 1)
+	m_SfxHeader.Attributes |= (UINT32)m_SfxSampleStep << cSfxSampleAttrShf;
+
+// only files containing 2bit packed sequences or sampled suffix arrays need the V6 file structure, otherwise remain readable by earlier releases
+if(m_bPackedSeq || m_SfxSampleStep > 1)
+	{
+	m_SfxHeader.Magic[3] = '6';
+	m_SfxHeader.Version = cSFXVersion;
+	}
+else
+	{
+	m_SfxHeader.Magic[3] = '5';
+	m_SfxHeader.Version = cSFXVersionUnpacked;
+	}
+
 pHdr = &m_SfxHeader;
 if(_lseeki64(m_hFile,0,SEEK_SET) ||
 		write(m_hFile,pHdr,WrtLen)!=WrtLen)
@@ -432,7 +500,6 @@ if(m_pSfxBlock == NULL || m_pSfxBlock->BlockID == 0 || m_pSfxBlock->ConcatSeqLen
 
 // if bisulfite processing then need to map all occurences of eBaseT to be eBaseC, and all occurances of eBaseA to be eBaseG
 // do the sort, and then restore back to original values. Means that the memory requirements are greatly increased....
-//CSAIS SAIS;
 if(m_bBisulfite)
 	{
 	pBisBases = m_pBisulfateBases;
@@ -455,13 +522,15 @@ if(m_bBisulfite)
 		TransformToColorspace(m_pSfxBlock->SeqSuffix,m_pSfxBlock->ConcatSeqLen,m_pSfxBlock->SeqSuffix);
 		}
 
-	QSortSeq((INT64)m_pSfxBlock->ConcatSeqLen,m_pBisulfateBases,m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen]);
+	if(!m_bSAISSort || SAISSortSeq((INT64)m_pSfxBlock->ConcatSeqLen,m_pBisulfateBases,m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen]) < 0)
+		QSortSeq((INT64)m_pSfxBlock->ConcatSeqLen,m_pBisulfateBases,m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen]);
 	}
 else
 	{
 	if(m_bColorspace)
 		TransformToColorspace(m_pSfxBlock->SeqSuffix,m_pSfxBlock->ConcatSeqLen,m_pSfxBlock->SeqSuffix);
-	QSortSeq(m_pSfxBlock->ConcatSeqLen,m_pSfxBlock->SeqSuffix,m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen]);
+	if(!m_bSAISSort || SAISSortSeq(m_pSfxBlock->ConcatSeqLen,m_pSfxBlock->SeqSuffix,m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen]) < 0)
+		QSortSeq(m_pSfxBlock->ConcatSeqLen,m_pSfxBlock->SeqSuffix,m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen]);
 	}
 
 if (m_bColorspace)	// set hi nibbles of sequence to be original sequence
@@ -469,23 +538,38 @@ if (m_bColorspace)	// set hi nibbles of sequence to be original sequence
 
 if (!m_bInMemSfx)
 	{
+	if(m_SfxSampleStep > 1)
+		SampleSfxArray();
+
 	// set block size and file offset for suffix block into header
 	m_SfxHeader.NumSfxBlocks = 1;
-	m_SfxHeader.SfxBlockSize = sizeof(tsSfxBlock) + m_pSfxBlock->ConcatSeqLen - 1 + ((size_t)m_pSfxBlock->ConcatSeqLen * m_pSfxBlock->SfxElSize);
+	m_SfxHeader.SfxBlockSize = sizeof(tsSfxBlock) + m_pSfxBlock->ConcatSeqLen - 1 + ((size_t)NumSfxArrayEls(m_pSfxBlock) * m_pSfxBlock->SfxElSize);
 	m_SfxHeader.SfxBlockOfs = m_SfxHeader.FileLen;
 
 	// now write...
-	WrtLen = sizeof(tsSfxBlock) + m_pSfxBlock->ConcatSeqLen - 1;
-	if((Rslt=ChunkedWrite(m_SfxHeader.FileLen,(UINT8 *)m_pSfxBlock,WrtLen))!=eBSFSuccess)
+	if(m_bPackedSeq)
 		{
-		AddErrMsg("CSfxArrayV3::SfxBlock2Disk","Unable to write suffix block sequence to disk");
-		Reset(false);
-		return(Rslt);
+		if((Rslt=PackedSeq2Disk())!=eBSFSuccess)
+			{
+			AddErrMsg("CSfxArrayV3::SfxBlock2Disk","Unable to write suffix block packed sequence to disk");
+			Reset(false);
+			return(Rslt);
+			}
 		}
+	else
+		{
+		WrtLen = sizeof(tsSfxBlock) + m_pSfxBlock->ConcatSeqLen - 1;
+		if((Rslt=ChunkedWrite(m_SfxHeader.FileLen,(UINT8 *)m_pSfxBlock,WrtLen))!=eBSFSuccess)
+			{
+			AddErrMsg("CSfxArrayV3::SfxBlock2Disk","Unable to write suffix block sequence to disk");
+			Reset(false);
+			return(Rslt);
+			}
 
-	m_SfxHeader.FileLen += WrtLen;
+		m_SfxHeader.FileLen += WrtLen;
+		}
 
-	WrtLen = (INT64)m_pSfxBlock->SfxElSize * m_pSfxBlock->ConcatSeqLen;
+	WrtLen = (INT64)m_pSfxBlock->SfxElSize * NumSfxArrayEls(m_pSfxBlock);
 	if((Rslt=ChunkedWrite(m_SfxHeader.FileLen,(UINT8 *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen],WrtLen))!=eBSFSuccess)
 		{
 		AddErrMsg("CSfxArrayV3::SfxBlock2Disk","Unable to write suffix block array to disk");
@@ -493,6 +577,8 @@ if (!m_bInMemSfx)
 		return(Rslt);
 		}
 	m_SfxHeader.FileLen += WrtLen;
+	if(m_bPackedSeq)			// block size in file is less than when loaded into memory
+		m_SfxHeader.SfxBlockSize = m_SfxHeader.FileLen - m_SfxHeader.SfxBlockOfs;
 
 	m_pSfxBlock->BlockID = 0;
 	m_pSfxBlock->NumEntries = 0;
@@ -573,7 +659,7 @@ if(8 != read(m_hFile,&HdrVer,8))
 if(tolower(HdrVer[0]) != 's' ||
 	tolower(HdrVer[1]) != 'f' ||
 	tolower(HdrVer[2]) != 'x' ||
-	(tolower(HdrVer[3]) < '3' || tolower(HdrVer[3]) > '5'))
+	(tolower(HdrVer[3]) < '3' || tolower(HdrVer[3]) > '6'))
 	{
 	AddErrMsg("CSfxArrayV3::Disk2Hdr","%s opened but invalid magic signature - not a Biokanga generated suffix array file",pszFile);
 	Reset(false);			// closes opened file..
@@ -609,7 +695,7 @@ if(m_bV3File)
 		}
 	memcpy(&m_SfxHeader,&SfxHeaderVv,sizeof(tsSfxHeaderVv));
 	m_SfxHeader.Magic[3] = '5';
-	m_SfxHeader.Version = cSFXVersion;
+	m_SfxHeader.Version = cSFXVersionUnpacked;
 	memcpy(&m_SfxHeader.szDescription,&SfxHeaderVv.szDescription,sizeof(SfxHeaderVv.szDescription));
 	memcpy(&m_SfxHeader.szTitle,&SfxHeaderVv.szTitle,sizeof(SfxHeaderVv.szTitle));
 	}
@@ -626,6 +712,16 @@ else
 
 m_bBisulfite = m_SfxHeader.Attributes & 0x01 ? true : false;
 m_bColorspace = m_SfxHeader.Attributes & 0x02 ? true : false;
+m_bPackedSeq = m_SfxHeader.Attributes & 0x04 ? true : false;
+m_SfxSampleStep = (m_SfxHeader.Attributes >> cSfxSampleAttrShf) & 0x0ff;
+if(m_SfxSampleStep < 1)
+	m_SfxSampleStep = 1;
+if(m_SfxSampleStep > cMaxSfxSampleStep)
+	{
+	AddErrMsg("CSfxArrayV3::Disk2Hdr","%s has unsupported suffix array sampling step %d",pszFile,m_SfxSampleStep);
+	Reset(false);			// closes opened file..
+	return(eBSFerrFileType);
+	}
 m_bHdrDirty = false;
 return(eBSFSuccess);
 }
@@ -941,6 +1037,8 @@ if(bCreate)
 	m_bCreate = true;
 	m_bBisulfite = bBisulfite;
 	m_bColorspace = bColorspace;
+	m_bPackedSeq = m_bPackSeqReq && !bColorspace;		// colorspace indexes retain the original bases in the hi nibbles so can't be packed
+	m_SfxSampleStep = m_SfxSampleReq;
 	}
 else // else opening existing file
 	{
@@ -968,6 +1066,13 @@ else // else opening existing file
 		Reset(false);			// closes opened file..
 		return(eBSFerrFileType);
 		}
+	// sampled suffix arrays are only supported by callers which locate cores through FirstCoreHit()/NextCoreHit()
+	if(m_SfxSampleStep > 1 && !m_bAcceptSampled)
+		{
+		AddErrMsg("CSfxArrayV3::Open","BiosfxV3 file '%s' contains a sampled suffix array (every %dth suffix) which is only supported when aligning reads",pszFile,m_SfxSampleStep);
+		Reset(false);			// closes opened file..
+		return(eBSFerrFileType);
+		}
 
 	// load any directory entries
 	if((Rslt=Disk2Entries()) < eBSFSuccess)
@@ -976,18 +1081,61 @@ else // else opening existing file
 		return(eBSFerrFileAccess);
 		}
 
+	// packed sequences are only a storage format and must be unpacked into private memory, so can't be shared by mapping
+	if(m_bPackedSeq && m_SfxLoadMode != eSfxLoadPrivate)
+		{
+		AddErrMsg("CSfxArrayV3::Open","BiosfxV3 file '%s' contains 2bit packed sequences so can't be mapped and shared, load into private memory or regenerate the index without packed sequences",pszFile);
+		Reset(false);			// closes opened file..
+		return(eBSFerrFileType);
+		}
+
+	// if requested then try mapping the suffix block read only directly from file, no background readahead thread is then required
+	// if unable to map then fall back to loading into private memory
+	if(m_SfxLoadMode != eSfxLoadPrivate && m_SfxHeader.NumSfxBlocks > 0)
+		{
+		if((Rslt = MapSfxBlock()) == eBSFSuccess)
+			{
+			m_CASSeqFlags = 0;
+			// mapped suffix array pages are in the shared page cache, placed on whichever node first faulted them, so can't be interleaved
+			if(m_bNUMAInterleave)
+				{
+				CNUMA NUMA;
+				if(NUMA.NumNodes() > 1)
+					gDiagnostics.DiagOut(eDLWarn,gszProcName,"Open: suffix array mapped from '%s' is not interleaved over %d NUMA nodes, load into private memory if interleaving is required",pszFile,NUMA.NumNodes());
+				}
+			return(eBSFSuccess);
+			}
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"Open: unable to map suffix block from '%s', loading into private memory instead",pszFile);
+		}
+
+	// if sequences packed then memory required is for the unpacked suffix block
+	UINT64 SfxBlockMem;
+	SfxBlockMem = m_SfxHeader.SfxBlockSize;
+	if(m_bPackedSeq && m_SfxHeader.NumSfxBlocks > 0)
+		{
+		tsSfxBlock SfxBlockHdr;
+		tsSfxPackedSeqHdr PackedHdr;
+		if((Rslt = Disk2PackedSeqHdr(&SfxBlockHdr,&PackedHdr))!=eBSFSuccess)
+			{
+			AddErrMsg("CSfxArrayV3::Open","Unable to read packed suffix block header from '%s'",pszFile);
+			Reset(false);
+			return(Rslt);
+			}
+		SfxBlockMem = sizeof(tsSfxBlock) - 1 + SfxBlockHdr.ConcatSeqLen + ((UINT64)NumSfxArrayEls(&SfxBlockHdr) * SfxBlockHdr.SfxElSize);
+		}
+
 	// allocate suffix block memory
 #ifdef _WIN32
-	m_pSfxBlock = (tsSfxBlock *) malloc((size_t)m_SfxHeader.SfxBlockSize);
+	m_pSfxBlock = (tsSfxBlock *) malloc((size_t)SfxBlockMem);
 	if(m_pSfxBlock == NULL)
 		{
-		AddErrMsg("CSfxArrayV3::Open","Fatal: unable to allocate %lld bytes contiguous memory for index",(INT64)m_SfxHeader.SfxBlockSize);
+		AddErrMsg("CSfxArrayV3::Open","Fatal: unable to allocate %lld bytes contiguous memory for index",(INT64)SfxBlockMem);
 		Reset(false);
 		return(eBSFerrMem);
 		}
 #else
 	// gnu malloc is still in the 32bit world and seems to have issues if more than 2GB allocation
-	m_pSfxBlock = (tsSfxBlock *)mmap(NULL,m_SfxHeader.SfxBlockSize, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, -1,0);
+	m_pSfxBlock = (tsSfxBlock *)mmap(NULL,SfxBlockMem, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, -1,0);
 	if(m_pSfxBlock == MAP_FAILED)
 		{
 		AddErrMsg("CSfxArrayV3::Open","Fatal: unable to allocate block memory");
@@ -995,8 +1143,15 @@ else // else opening existing file
 		Reset(false);
 		return(eBSFerrMem);
 		}
+	// interleave policy is set before the block is loaded so pages are interleaved as first touched by the loading thread rather than all allocated from the loading thread's node
+	if(m_bNUMAInterleave)
+		{
+		CNUMA NUMA;
+		if(NUMA.InterleaveMem(m_pSfxBlock,(size_t)SfxBlockMem) != eBSFSuccess)
+			gDiagnostics.DiagOut(eDLWarn,gszProcName,"Open: unable to interleave suffix block memory over %d NUMA nodes",NUMA.NumNodes());
+		}
 #endif
-	m_AllocSfxBlockMem = (size_t)m_SfxHeader.SfxBlockSize;
+	m_AllocSfxBlockMem = (size_t)SfxBlockMem;
 	m_pSfxBlock->BlockID = 0;
 	m_pSfxBlock->NumEntries = 0;
 	m_pSfxBlock->ConcatSeqLen = 0;
@@ -1771,7 +1926,11 @@ do {
 			INT64 BlkOfs;
 			BlkOfs = 0;
 			BlockSize = pSfxArray->m_SfxHeader.SfxBlockSize - BlkOfs;
-			if((Rslt=pSfxArray->ChunkedRead(pSfxArray->m_SfxHeader.SfxBlockOfs,((UINT8 *)pSfxArray->m_pSfxBlock) + BlkOfs,BlockSize)) < eBSFSuccess)
+			if(pSfxArray->m_bPackedSeq)
+				Rslt = pSfxArray->Disk2PackedSeq(pSfxArray->m_pSfxBlock);
+			else
+				Rslt=pSfxArray->ChunkedRead(pSfxArray->m_SfxHeader.SfxBlockOfs,((UINT8 *)pSfxArray->m_pSfxBlock) + BlkOfs,BlockSize);
+			if(Rslt < eBSFSuccess)
 				{
 				pSfxArray->m_ReqBlockID = 0;
 				pSfxArray->m_ReqBlockRslt = Rslt;	// error reading from disk, let main thread know
@@ -1838,12 +1997,15 @@ CSfxArrayV3::Disk2SfxBlock(int BlockID)
 teBSFrsltCodes Rslt;
 
 
-if(m_pSfxBlock == NULL || !m_bThreadActive)
+if(m_pSfxBlock == NULL || (!m_bThreadActive && m_pSfxMapBase == NULL))
 	return(eBSFerrInternal);
 
 if(BlockID < 1 || m_SfxHeader.NumSfxBlocks == 0 || (UINT32)BlockID > m_SfxHeader.NumSfxBlocks)
 	return(eBSFerrParams);
 
+if(m_pSfxMapBase != NULL)		// mapped from file, block is always resident
+	return(m_pSfxBlock->BlockID == BlockID ? eBSFSuccess : eBSFerrInternal);
+
 
 do {
 #ifdef _WIN32
@@ -1889,204 +2051,795 @@ pthread_mutex_unlock(&m_JobMutex);
 return(Rslt);
 }
 
-int
-CSfxArrayV3::Next(int PrevBlockID)
-{
-if(PrevBlockID < 0 || (UINT32)PrevBlockID >= m_SfxHeader.NumSfxBlocks)
-	return(0);
-return(PrevBlockID + 1);
-}
-
-// SetTargBlock
-// specifies which block is to be loaded for subsequent sequence matches
-int
-CSfxArrayV3::SetTargBlock(int BlockID)
-{
-return(Disk2SfxBlock(BlockID));
-}
-
-int										// if non-zero then returned number of identifiers 
-CSfxArrayV3::ChkDupEntries(int MaxIdents,		// maximum number of identifers to return in pIdents (caller allocates to hold returned identifiers)
-					  UINT32 *pIdents)		// checks if there are duplicate entry names and reports identifier
+// MapSfxBlock
+// Maps the suffix block read only and shared directly from the opened suffix file
+// Multiple processes mapping the same suffix file will then share the same physical pages through the page cache
+// Only supported on Linux, on Windows an error is returned and caller is expected to fall back to loading into private memory
+teBSFrsltCodes
+CSfxArrayV3::MapSfxBlock(void)
 {
-int NumDups;
-bool bInDup;
-tsSfxEntry **ppEntries;
-tsSfxEntry *pCurEntry;
-tsSfxEntry *pPrevEntry;
-
-UINT32 Idx;
+#ifdef _WIN32
+return(eBSFerrMem);
+#else
+struct stat64 FileStat;
+INT64 PageSize;
+INT64 MapOfs;
+int MapFlags;
+UINT8 *pMapBase;
+tsSfxBlock *pSfxBlock;
+
+if(m_hFile == -1 || (INT64)m_SfxHeader.SfxBlockSize < (INT64)sizeof(tsSfxBlock))
+	return(eBSFerrParams);
 
-if(m_pEntriesBlock == NULL || MaxIdents > 0 && pIdents == NULL) 
-	return(eBSFerrEntry);
-if(m_pEntriesBlock->NumEntries < 2)
-	return(0);
+// mapping must not extend past end of file otherwise accesses would SIGBUS
+if(fstat64(m_hFile,&FileStat) != 0 || (INT64)FileStat.st_size < (INT64)(m_SfxHeader.SfxBlockOfs + m_SfxHeader.SfxBlockSize))
+	{
+	AddErrMsg("CSfxArrayV3::MapSfxBlock","Suffix file '%s' is truncated, unable to map suffix block",m_szFile);
+	return(eBSFerrFileAccess);
+	}
 
-if((ppEntries = new tsSfxEntry * [m_pEntriesBlock->NumEntries]) == NULL)
+// mmap offsets must be page aligned
+PageSize = (INT64)sysconf(_SC_PAGESIZE);
+MapOfs = (INT64)m_SfxHeader.SfxBlockOfs & ~(PageSize - 1);
+m_SfxMapLen = (size_t)((INT64)m_SfxHeader.SfxBlockOfs - MapOfs + (INT64)m_SfxHeader.SfxBlockSize);
+MapFlags = MAP_SHARED;
+#ifdef MAP_POPULATE
+if(m_SfxLoadMode == eSfxLoadMapPopulate)
+	MapFlags |= MAP_POPULATE;
+#endif
+pMapBase = (UINT8 *)mmap(NULL,m_SfxMapLen,PROT_READ,MapFlags,m_hFile,(off_t)MapOfs);
+if(pMapBase == MAP_FAILED)
 	{
-	AddErrMsg("CSfxArrayV3::ChkDupEntries","unable to allocate memory for sorting %d entry pointers",m_pEntriesBlock->NumEntries);
+	AddErrMsg("CSfxArrayV3::MapSfxBlock","Unable to map %lld bytes of suffix block from '%s' - %s",(INT64)m_SfxMapLen,m_szFile,strerror(errno));
+	m_SfxMapLen = 0;
 	return(eBSFerrMem);
 	}
-
-for(Idx = 0; Idx < m_pEntriesBlock->NumEntries; Idx++)
-	ppEntries[Idx] = &m_pEntriesBlock->Entries[Idx];
-
-// now sort on entries names
-m_MTqsort.qsort(ppEntries,m_pEntriesBlock->NumEntries,sizeof(tsSfxEntry *),QSortEntryNames);
-
-// iterate looking for duplicates
-NumDups = 0;
-bInDup = false;
-pPrevEntry = ppEntries[0];
-for(Idx = 1; Idx < m_pEntriesBlock->NumEntries && NumDups < MaxIdents; Idx++)
+pSfxBlock = (tsSfxBlock *)(pMapBase + ((INT64)m_SfxHeader.SfxBlockOfs - MapOfs));
+if(pSfxBlock->BlockID != 1 || !(pSfxBlock->SfxElSize == 4 || pSfxBlock->SfxElSize == 5))
 	{
-	pCurEntry = ppEntries[Idx];
-	if(stricmp((char *)pCurEntry->szSeqName,(char *)pPrevEntry->szSeqName))
-		{
-		pPrevEntry = pCurEntry;
-		bInDup = false;
-		continue;
-		}
-	if(!bInDup && MaxIdents && NumDups < MaxIdents)
-		{
-		*pIdents++ = pPrevEntry->EntryID;
-		NumDups += 1;
-		bInDup = true;
-		}
-	else
-		if(!MaxIdents)
-			{
-			NumDups = 1;
-			break;
-			}
+	AddErrMsg("CSfxArrayV3::MapSfxBlock","Suffix block in '%s' is not in expected format",m_szFile);
+	munmap(pMapBase,m_SfxMapLen);
+	m_SfxMapLen = 0;
+	return(eBSFerrFileType);
 	}
-delete ppEntries;
-return(NumDups);
-}
 
+// suffix searches are random access over the whole block, so readahead would be wasted unless prefaulting
+madvise(pMapBase,m_SfxMapLen,m_SfxLoadMode == eSfxLoadMapPopulate ? MADV_WILLNEED : MADV_RANDOM);
 
-UINT16											// returned flags prior to this call
-CSfxArrayV3::SetResetIdentFlags(UINT32 EntryID,	// atomic set/reset flags for this entry
-					UINT16 SetFlags,			// set these flags then
-					UINT16 ResetFlags)			// reset these flags
-{
-UINT32 fBlockID;
-UINT16 Flags;
-if(SetFlags == 0 && ResetFlags == 0)
-	return(GetIdentFlags(EntryID));
+m_pSfxMapBase = pMapBase;
+m_pSfxBlock = pSfxBlock;
+m_AllocSfxBlockMem = 0;
+return(eBSFSuccess);
+#endif
+}
 
-if(m_pEntriesBlock == NULL || EntryID < 1 || EntryID > m_pEntriesBlock->NumEntries)
-	return(eBSFerrEntry);
-SerialiseBaseFlags();
-fBlockID = m_pEntriesBlock->Entries[EntryID-1].fBlockID;
-Flags = (fBlockID >> 8) & 0x0ffff;
-Flags |= SetFlags;
-Flags &= ~ResetFlags;
-m_pEntriesBlock->Entries[EntryID-1].fBlockID = ((UINT32)Flags << 8) | fBlockID & 0x0ff;
-ReleaseBaseFlags();
-return((fBlockID >> 8) & 0x0ffff);
+void
+CSfxArrayV3::SetLoadMode(teSfxLoadMode LoadMode)
+{
+if(LoadMode < eSfxLoadPrivate || LoadMode >= eSfxLoadPlaceholder)
+	LoadMode = eSfxLoadPrivate;
+m_SfxLoadMode = LoadMode;
 }
 
-UINT16					// returned flags
-CSfxArrayV3::GetIdentFlags(UINT32 EntryID)
+void
+CSfxArrayV3::SetNUMAInterleave(bool bInterleave)
 {
-UINT32 Flags;
-if(m_pEntriesBlock == NULL || EntryID < 1 || EntryID > m_pEntriesBlock->NumEntries)
-	return(eBSFerrEntry);
-SerialiseBaseFlags();
-Flags = m_pEntriesBlock->Entries[EntryID-1].fBlockID;
-ReleaseBaseFlags();
-return((Flags >> 8) & 0x0ffff);
+m_bNUMAInterleave = bInterleave;
 }
 
+bool
+CSfxArrayV3::IsMapped(void)
+{
+return(m_pSfxMapBase != NULL ? true : false);
+}
 
 void
-CSfxArrayV3::InitAllIdentFlags(UINT16 Flags)		// initialise all entries to have these flags
+CSfxArrayV3::SetPackedSeq(bool bPackedSeq)
 {
-UINT32 EntryID;
-UINT32 fBlockID;
-UINT32 SetFlags;
-tsSfxEntry *pSfxEntry;
-if(m_pEntriesBlock == NULL || m_pEntriesBlock->NumEntries < 1)
-	return;
-SetFlags = (UINT32)Flags << 8;
-pSfxEntry = m_pEntriesBlock->Entries;
-SerialiseBaseFlags();
-for(EntryID = 0; EntryID < m_pEntriesBlock->NumEntries; EntryID++,pSfxEntry++)
-	{
-	fBlockID = pSfxEntry->fBlockID & 0x0ff;
-	fBlockID |= SetFlags;
-	pSfxEntry->fBlockID = fBlockID;
-	}
-ReleaseBaseFlags();
-return;
+m_bPackSeqReq = bPackedSeq;
 }
 
-
-int
-CSfxArrayV3::GetIdentName(UINT32 EntryID,int MaxLen,char *pszSeqIdent)
+bool
+CSfxArrayV3::IsPackedSeq(void)
 {
-if(m_pEntriesBlock == NULL || EntryID < 1 || (UINT32)EntryID > m_pEntriesBlock->NumEntries)
-	return(eBSFerrEntry);
-strncpy(pszSeqIdent,(const char *)m_pEntriesBlock->Entries[EntryID-1].szSeqName,MaxLen);
-pszSeqIdent[MaxLen-1] = '\0';
-return(eBSFSuccess);
+return(m_bPackedSeq);
 }
 
-int		// returns identifer for specified sequence name
-CSfxArrayV3::GetIdent(char *pszSeqIdent)
+void
+CSfxArrayV3::SetSfxSampleStep(int SampleStep)
 {
-UINT32 Idx;
-if(m_pEntriesBlock == NULL || m_pEntriesBlock->NumEntries < 1)
-	return(eBSFerrEntry);
-for(Idx = 0; Idx < m_pEntriesBlock->NumEntries; Idx++)
-	{
-	if(!stricmp(pszSeqIdent,(const char *)m_pEntriesBlock->Entries[Idx].szSeqName))
-		return((int)Idx+1);
-	}
-return(eBSFerrEntry);
+if(SampleStep < 1)
+	SampleStep = 1;
+else
+	if(SampleStep > cMaxSfxSampleStep)
+		SampleStep = cMaxSfxSampleStep;
+m_SfxSampleReq = SampleStep;
 }
 
 int
-CSfxArrayV3::GetNumEntries(void)
+CSfxArrayV3::GetSfxSampleStep(void)
 {
-if(m_pEntriesBlock == NULL)
-	return(eBSFerrEntry);
-return(m_pEntriesBlock->NumEntries);
+return(m_SfxSampleStep);
 }
 
-UINT32
-CSfxArrayV3::GetSeqLen(UINT32 EntryID)
+void
+CSfxArrayV3::AcceptSampledSfx(bool bAccept)
 {
-tsSfxEntry *pEntry;
-if(m_pEntriesBlock == NULL || EntryID < 1 || (UINT32)EntryID > m_pEntriesBlock->NumEntries)
-	return(0);
-pEntry = &m_pEntriesBlock->Entries[EntryID-1];
-return(pEntry->SeqLen);
+m_bAcceptSampled = bAccept;
 }
 
-// returns total length of all sequences
-UINT64
-CSfxArrayV3::GetTotSeqsLen(void)
+// NumSfxArrayEls
+// Returns number of suffix array elements in pSfxBlock, if sampled then only suffixes starting at multiples of m_SfxSampleStep are present
+INT64
+CSfxArrayV3::NumSfxArrayEls(tsSfxBlock *pSfxBlock)
 {
-UINT64 Idx;
-UINT64 TotLen;
-tsSfxEntry *pEntry;
-if(m_pEntriesBlock == NULL || !m_pEntriesBlock->NumEntries)
-	return((size_t)eBSFerrEntry);
-TotLen = 0;
-pEntry = &m_pEntriesBlock->Entries[0];
-for(Idx = 0; Idx < m_pEntriesBlock->NumEntries; Idx++,pEntry++)
-	TotLen += pEntry->SeqLen;
-return(TotLen);
+if(m_SfxSampleStep <= 1)
+	return((INT64)pSfxBlock->ConcatSeqLen);
+return(((INT64)pSfxBlock->ConcatSeqLen + m_SfxSampleStep - 1) / m_SfxSampleStep);
 }
 
-// returns minimum length of any sequence in currently loaded entries block
-UINT32 
-CSfxArrayV3::GetMinSeqLen(void)							
+// SampleSfxArray
+// Compacts the sorted suffix array in place, retaining in sorted order only those suffixes starting at multiples of m_SfxSampleStep
+void
+CSfxArrayV3::SampleSfxArray(void)
 {
-UINT64 Idx;
-UINT32 MinLen;
+INT64 SrcIdx;
+INT64 Loci;
+UINT8 *pSrc;
+UINT8 *pDst;
+int SfxElSize;
+void *pSfxArray;
+
+SfxElSize = m_pSfxBlock->SfxElSize;
+pSfxArray = (void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen];
+pDst = (UINT8 *)pSfxArray;
+for(SrcIdx = 0; SrcIdx < (INT64)m_pSfxBlock->ConcatSeqLen; SrcIdx++)
+	{
+	Loci = SfxOfsToLoci(SfxElSize,pSfxArray,SrcIdx);
+	if(Loci % m_SfxSampleStep)
+		continue;
+	pSrc = (UINT8 *)pSfxArray + (SrcIdx * SfxElSize);
+	if(pDst != pSrc)
+		memmove(pDst,pSrc,SfxElSize);
+	pDst += SfxElSize;
+	}
+}
+
+// StartCoreSfx
+// Locates the first suffix exactly matching the core suffix starting at pIter->SampleOfs
+bool
+CSfxArrayV3::StartCoreSfx(tsCoreHitIter *pIter)
+{
+INT64 SfxIdx;
+SfxIdx = LocateFirstExact(&pIter->pCore[pIter->SampleOfs],pIter->CoreLen - pIter->SampleOfs,(etSeqBase *)&m_pSfxBlock->SeqSuffix[0],
+							m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen],0,0,NumSfxArrayEls(m_pSfxBlock)-1);
+if(SfxIdx == 0)        // 0 if no core suffix matches
+	return(false);
+pIter->SfxIdx = SfxIdx - 1;
+pIter->bIntervalStart = true;
+return(true);
+}
+
+// NextCoreSfx
+// Advances to the next suffix if it is still exactly matching the core suffix starting at pIter->SampleOfs
+bool
+CSfxArrayV3::NextCoreSfx(tsCoreHitIter *pIter)
+{
+int Cmp;
+int SfxLen;
+INT64 Loci;
+etSeqBase *pTarg;
+void *pSfxArray;
+
+pTarg = (etSeqBase *)&m_pSfxBlock->SeqSuffix[0];
+pSfxArray = (void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen];
+SfxLen = pIter->CoreLen - pIter->SampleOfs;
+
+// ensure not about to iterate past end of suffix array!
+if((pIter->SfxIdx + 1) >= NumSfxArrayEls(m_pSfxBlock) || ((Loci = SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,pIter->SfxIdx+1)) + SfxLen) > (INT64)m_pSfxBlock->ConcatSeqLen)
+	return(false);
+
+// check that this new putative core is still matching
+if(m_bBisulfite)
+	Cmp = BSCmpProbeTarg(&pIter->pCore[pIter->SampleOfs],&pTarg[Loci],SfxLen);
+else
+	{
+	int Ofs;
+	UINT8 El1;
+	UINT8 El2;
+	etSeqBase *pEl1= &pIter->pCore[pIter->SampleOfs];
+	etSeqBase *pEl2 = &pTarg[Loci];
+	Cmp = 0;
+	for(Ofs=0; Ofs < SfxLen; Ofs++)
+		{
+		El2 = *pEl2++ & 0x0f;
+		if(El2 == eBaseEOS)
+			{
+			Cmp = -1;
+			break;
+			}
+		El1 = *pEl1++ & 0x0f;
+		if(El1 != El2)
+			{
+			Cmp = El1 > El2 ? 1 : -1;
+			break;
+			}
+		}
+	}
+if(Cmp != 0)				// will be non-zero if target no longer matches
+	return(false);
+pIter->SfxIdx += 1;
+return(true);
+}
+
+// CoreHitLoci
+// Sets pIter->Loci to the start of the core matched by the current suffix
+// If sampled then the core prefix preceding the suffix has also to be matched, returns false if not matching
+bool
+CSfxArrayV3::CoreHitLoci(tsCoreHitIter *pIter)
+{
+int Ofs;
+UINT8 El1;
+UINT8 El2;
+INT64 Loci;
+etSeqBase *pEl1;
+etSeqBase *pEl2;
+
+Loci = SfxOfsToLoci(m_pSfxBlock->SfxElSize,(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen],pIter->SfxIdx);
+if(pIter->SampleOfs > 0)
+	{
+	if(Loci < pIter->SampleOfs)
+		return(false);
+	Loci -= pIter->SampleOfs;
+	pEl1 = pIter->pCore;
+	pEl2 = &m_pSfxBlock->SeqSuffix[Loci];
+	if(m_bBisulfite)
+		{
+		if(BSCmpProbeTarg(pEl1,pEl2,pIter->SampleOfs) != 0)
+			return(false);
+		}
+	else
+		for(Ofs = 0; Ofs < pIter->SampleOfs; Ofs++)
+			{
+			El2 = *pEl2++ & 0x0f;
+			El1 = *pEl1++ & 0x0f;
+			if(El2 == eBaseEOS || El1 != El2)
+				return(false);
+			}
+	}
+pIter->Loci = Loci;
+return(true);
+}
+
+// FirstCoreHit
+// Locates the first target loci exactly matching the core
+// If the suffix array is sampled then each core instance is located by whichever of the core suffixes starting within the first m_SfxSampleStep bases starts at a sampled loci
+// Returns false if no instances of core
+bool
+CSfxArrayV3::FirstCoreHit(tsCoreHitIter *pIter,	// locates first target loci exactly matching core
+				etSeqBase *pCore,			// core to locate
+				int CoreLen)				// core length
+{
+pIter->pCore = pCore;
+pIter->CoreLen = CoreLen;
+pIter->NumCopies = 0;
+pIter->Loci = 0;
+for(pIter->SampleOfs = 0; pIter->SampleOfs < m_SfxSampleStep && pIter->SampleOfs < CoreLen; pIter->SampleOfs++)
+	if(StartCoreSfx(pIter))
+		return(NextCoreHit(pIter,0,0));
+return(false);
+}
+
+// NextCoreHit
+// Locates the next target loci exactly matching the core
+// If caller has processed 100 hits then the number of copies is estimated and if more than CurMaxIter then iteration terminates
+// Returns false if no more instances or too many copies
+bool
+CSfxArrayV3::NextCoreHit(tsCoreHitIter *pIter,	// locates next target loci exactly matching core, false if no more or too many copies
+				int IterCnt,				// number of hits processed by caller thus far
+				int CurMaxIter)				// if > 0 then max allowed iterations
+{
+INT64 LastSfxIdx;
+do {
+	if(pIter->bIntervalStart)
+		pIter->bIntervalStart = false;
+	else
+		{
+		if(IterCnt == 100 && !pIter->NumCopies)
+			{
+			// check how many more exact copies there are of the current probe subsequence, if too many then don't bother exploring these
+			LastSfxIdx = LocateLastExact(&pIter->pCore[pIter->SampleOfs],pIter->CoreLen - pIter->SampleOfs,(etSeqBase *)&m_pSfxBlock->SeqSuffix[0],m_pSfxBlock->SfxElSize,
+								(void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen],0,pIter->SfxIdx-1,NumSfxArrayEls(m_pSfxBlock)-1);
+			pIter->NumCopies = LastSfxIdx > 0 ? (UINT32)min((INT64)(1 + LastSfxIdx - pIter->SfxIdx) * m_SfxSampleStep,(INT64)0x07fffffff) : 0;
+			if(CurMaxIter && pIter->NumCopies > (UINT32)CurMaxIter)		// only checking at the 100th iteration allows a little slack
+				return(false);
+			}
+		if(!NextCoreSfx(pIter))
+			{
+			// no more suffixes matching, if sampled then try the next core suffix
+			do {
+				if(++pIter->SampleOfs >= m_SfxSampleStep || pIter->SampleOfs >= pIter->CoreLen)
+					return(false);
+				}
+			while(!StartCoreSfx(pIter));
+			pIter->bIntervalStart = false;
+			}
+		}
+	}
+while(!CoreHitLoci(pIter));
+return(true);
+}
+
+// PackedSeq2Disk
+// Writes the suffix block header and concatenated sequences, 2bit packed, at the current file write psn
+// Non-canonical bases and repeat masked bases are written as runs following the packed bases
+// Caller is expected to then write the suffix array elements
+teBSFrsltCodes
+CSfxArrayV3::PackedSeq2Disk(void)
+{
+teBSFrsltCodes Rslt;
+tsSfxPackedSeqHdr PackedHdr;
+tsSfxSeqRun *pExcepts;
+tsSfxSeqRun *pMasked;
+tsSfxSeqRun *pTmpRuns;
+UINT64 AllocExcepts;
+UINT64 AllocMasked;
+UINT8 *pPacked;
+UINT8 *pBase;
+UINT8 Val;
+UINT64 Idx;
+INT64 WrtLen;
+
+memset(&PackedHdr,0,sizeof(PackedHdr));
+PackedHdr.PackedSeqSize = (m_pSfxBlock->ConcatSeqLen + 3) / 4;
+if((pPacked = (UINT8 *)calloc((size_t)PackedHdr.PackedSeqSize,1))==NULL)
+	{
+	AddErrMsg("CSfxArrayV3::PackedSeq2Disk","Unable to allocate %lld bytes for packed sequences",(INT64)PackedHdr.PackedSeqSize);
+	return(eBSFerrMem);
+	}
+AllocExcepts = 10000;
+AllocMasked = 10000;
+pExcepts = (tsSfxSeqRun *)malloc((size_t)AllocExcepts * sizeof(tsSfxSeqRun));
+pMasked = (tsSfxSeqRun *)malloc((size_t)AllocMasked * sizeof(tsSfxSeqRun));
+if(pExcepts == NULL || pMasked == NULL)
+	{
+	AddErrMsg("CSfxArrayV3::PackedSeq2Disk","Unable to allocate memory for sequence runs");
+	free(pPacked);
+	if(pExcepts != NULL)
+		free(pExcepts);
+	if(pMasked != NULL)
+		free(pMasked);
+	return(eBSFerrMem);
+	}
+
+pBase = m_pSfxBlock->SeqSuffix;
+for(Idx = 0; Idx < m_pSfxBlock->ConcatSeqLen; Idx++,pBase++)
+	{
+	Val = *pBase & ~cRptMskFlg;
+	if(Val <= eBaseT)
+		pPacked[Idx >> 2] |= Val << ((Idx & 0x03) * 2);
+	else
+		{
+		if(PackedHdr.NumExcepts && pExcepts[PackedHdr.NumExcepts-1].Val == Val && pExcepts[PackedHdr.NumExcepts-1].Len < cMaxSfxSeqRunLen &&
+				(pExcepts[PackedHdr.NumExcepts-1].Ofs + pExcepts[PackedHdr.NumExcepts-1].Len) == Idx)
+			pExcepts[PackedHdr.NumExcepts-1].Len += 1;
+		else
+			{
+			if(PackedHdr.NumExcepts == AllocExcepts)
+				{
+				if((pTmpRuns = (tsSfxSeqRun *)realloc(pExcepts,(size_t)(AllocExcepts * 2) * sizeof(tsSfxSeqRun)))==NULL)
+					{
+					Rslt = eBSFerrMem;
+					break;
+					}
+				pExcepts = pTmpRuns;
+				AllocExcepts *= 2;
+				}
+			pExcepts[PackedHdr.NumExcepts].Ofs = Idx;
+			pExcepts[PackedHdr.NumExcepts].Len = 1;
+			pExcepts[PackedHdr.NumExcepts++].Val = Val;
+			}
+		}
+
+	if(*pBase & cRptMskFlg)
+		{
+		if(PackedHdr.NumMasked && pMasked[PackedHdr.NumMasked-1].Len < cMaxSfxSeqRunLen &&
+				(pMasked[PackedHdr.NumMasked-1].Ofs + pMasked[PackedHdr.NumMasked-1].Len) == Idx)
+			pMasked[PackedHdr.NumMasked-1].Len += 1;
+		else
+			{
+			if(PackedHdr.NumMasked == AllocMasked)
+				{
+				if((pTmpRuns = (tsSfxSeqRun *)realloc(pMasked,(size_t)(AllocMasked * 2) * sizeof(tsSfxSeqRun)))==NULL)
+					{
+					Rslt = eBSFerrMem;
+					break;
+					}
+				pMasked = pTmpRuns;
+				AllocMasked *= 2;
+				}
+			pMasked[PackedHdr.NumMasked].Ofs = Idx;
+			pMasked[PackedHdr.NumMasked].Len = 1;
+			pMasked[PackedHdr.NumMasked++].Val = cRptMskFlg;
+			}
+		}
+	}
+
+if(Idx != m_pSfxBlock->ConcatSeqLen)
+	{
+	AddErrMsg("CSfxArrayV3::PackedSeq2Disk","Unable to reallocate memory for sequence runs");
+	free(pPacked);
+	free(pExcepts);
+	free(pMasked);
+	return(Rslt);
+	}
+
+// suffix array elements immediately follow the runs
+PackedHdr.SfxElsOfs = sizeof(tsSfxBlock) - 1 + sizeof(tsSfxPackedSeqHdr) + PackedHdr.PackedSeqSize +
+						((PackedHdr.NumExcepts + PackedHdr.NumMasked) * sizeof(tsSfxSeqRun));
+
+Rslt = ChunkedWrite(m_SfxHeader.FileLen,(UINT8 *)m_pSfxBlock,sizeof(tsSfxBlock) - 1);
+m_SfxHeader.FileLen += sizeof(tsSfxBlock) - 1;
+if(Rslt == eBSFSuccess)
+	{
+	Rslt = ChunkedWrite(m_SfxHeader.FileLen,(UINT8 *)&PackedHdr,sizeof(tsSfxPackedSeqHdr));
+	m_SfxHeader.FileLen += sizeof(tsSfxPackedSeqHdr);
+	}
+if(Rslt == eBSFSuccess)
+	{
+	Rslt = ChunkedWrite(m_SfxHeader.FileLen,pPacked,(INT64)PackedHdr.PackedSeqSize);
+	m_SfxHeader.FileLen += PackedHdr.PackedSeqSize;
+	}
+if(Rslt == eBSFSuccess && PackedHdr.NumExcepts)
+	{
+	WrtLen = (INT64)PackedHdr.NumExcepts * sizeof(tsSfxSeqRun);
+	Rslt = ChunkedWrite(m_SfxHeader.FileLen,(UINT8 *)pExcepts,WrtLen);
+	m_SfxHeader.FileLen += WrtLen;
+	}
+if(Rslt == eBSFSuccess && PackedHdr.NumMasked)
+	{
+	WrtLen = (INT64)PackedHdr.NumMasked * sizeof(tsSfxSeqRun);
+	Rslt = ChunkedWrite(m_SfxHeader.FileLen,(UINT8 *)pMasked,WrtLen);
+	m_SfxHeader.FileLen += WrtLen;
+	}
+// caller writes the suffix array elements at SfxElsOfs
+free(pPacked);
+free(pExcepts);
+free(pMasked);
+return(Rslt);
+}
+
+// Disk2PackedSeqHdr
+// Reads and validates the suffix block header (excluding SeqSuffix) and the following packed sequence header
+teBSFrsltCodes
+CSfxArrayV3::Disk2PackedSeqHdr(tsSfxBlock *pSfxBlockHdr,tsSfxPackedSeqHdr *pPackedHdr)
+{
+teBSFrsltCodes Rslt;
+UINT64 MinSfxElsOfs;
+INT64 RdOfs;
+
+RdOfs = m_SfxHeader.SfxBlockOfs;
+if((Rslt = ChunkedRead(RdOfs,(UINT8 *)pSfxBlockHdr,sizeof(tsSfxBlock) - 1))!=eBSFSuccess)
+	return(Rslt);
+RdOfs += sizeof(tsSfxBlock) - 1;
+if((Rslt = ChunkedRead(RdOfs,(UINT8 *)pPackedHdr,sizeof(tsSfxPackedSeqHdr)))!=eBSFSuccess)
+	return(Rslt);
+
+MinSfxElsOfs = sizeof(tsSfxBlock) - 1 + sizeof(tsSfxPackedSeqHdr) + pPackedHdr->PackedSeqSize + ((pPackedHdr->NumExcepts + pPackedHdr->NumMasked) * sizeof(tsSfxSeqRun));
+if(pSfxBlockHdr->BlockID != 1 || !(pSfxBlockHdr->SfxElSize == 4 || pSfxBlockHdr->SfxElSize == 5) ||
+	pPackedHdr->PackedSeqSize != (pSfxBlockHdr->ConcatSeqLen + 3) / 4 ||
+	pPackedHdr->SfxElsOfs < MinSfxElsOfs ||
+	(pPackedHdr->SfxElsOfs + ((UINT64)NumSfxArrayEls(pSfxBlockHdr) * pSfxBlockHdr->SfxElSize)) != m_SfxHeader.SfxBlockSize)
+	{
+	AddErrMsg("CSfxArrayV3::Disk2PackedSeqHdr","Packed suffix block in '%s' is not in expected format",m_szFile);
+	return(eBSFerrFileType);
+	}
+return(eBSFSuccess);
+}
+
+// Disk2PackedSeq
+// Loads suffix block containing 2bit packed sequences into pSfxBlock, unpacking the sequences, followed by the suffix array elements
+teBSFrsltCodes
+CSfxArrayV3::Disk2PackedSeq(tsSfxBlock *pSfxBlock)
+{
+teBSFrsltCodes Rslt;
+tsSfxPackedSeqHdr PackedHdr;
+tsSfxSeqRun *pRuns;
+tsSfxSeqRun *pRun;
+UINT64 NumRuns;
+UINT64 Idx;
+UINT64 RunIdx;
+UINT64 PackedIdx;
+UINT64 ChunkLen;
+INT64 RdOfs;
+UINT8 *pUnpackBuff;
+UINT8 *pPacked;
+UINT8 *pBase;
+UINT8 Packed;
+
+if((Rslt = Disk2PackedSeqHdr(pSfxBlock,&PackedHdr))!=eBSFSuccess)
+	return(Rslt);
+if((sizeof(tsSfxBlock) - 1 + pSfxBlock->ConcatSeqLen + ((UINT64)NumSfxArrayEls(pSfxBlock) * pSfxBlock->SfxElSize)) > m_AllocSfxBlockMem)
+	{
+	AddErrMsg("CSfxArrayV3::Disk2PackedSeq","Packed suffix block in '%s' is larger than memory allocated",m_szFile);
+	return(eBSFerrFileType);
+	}
+RdOfs = m_SfxHeader.SfxBlockOfs + sizeof(tsSfxBlock) - 1 + sizeof(tsSfxPackedSeqHdr);
+
+// packed bases are read and unpacked a chunk at a time
+if((pUnpackBuff = (UINT8 *)malloc(cSfxUnpackBuffSize))==NULL)
+	{
+	AddErrMsg("CSfxArrayV3::Disk2PackedSeq","Unable to allocate memory for unpacking sequences");
+	return(eBSFerrMem);
+	}
+pBase = pSfxBlock->SeqSuffix;
+Idx = 0;
+for(PackedIdx = 0; PackedIdx < PackedHdr.PackedSeqSize; PackedIdx += ChunkLen)
+	{
+	ChunkLen = min(PackedHdr.PackedSeqSize - PackedIdx,(UINT64)cSfxUnpackBuffSize);
+	if((Rslt = ChunkedRead(RdOfs,pUnpackBuff,(INT64)ChunkLen))!=eBSFSuccess)
+		{
+		free(pUnpackBuff);
+		return(Rslt);
+		}
+	RdOfs += ChunkLen;
+	pPacked = pUnpackBuff;
+	for(; Idx < (PackedIdx + ChunkLen) * 4 && Idx < pSfxBlock->ConcatSeqLen; Idx += 4, pBase += 4)
+		{
+		Packed = *pPacked++;
+		pBase[0] = Packed & 0x03;
+		if(Idx + 4 <= pSfxBlock->ConcatSeqLen)
+			{
+			pBase[1] = (Packed >> 2) & 0x03;
+			pBase[2] = (Packed >> 4) & 0x03;
+			pBase[3] = (Packed >> 6) & 0x03;
+			}
+		else
+			{
+			if(Idx + 1 < pSfxBlock->ConcatSeqLen)
+				pBase[1] = (Packed >> 2) & 0x03;
+			if(Idx + 2 < pSfxBlock->ConcatSeqLen)
+				pBase[2] = (Packed >> 4) & 0x03;
+			}
+		}
+	}
+free(pUnpackBuff);
+
+// apply the non-canonical and repeat masked runs
+NumRuns = PackedHdr.NumExcepts + PackedHdr.NumMasked;
+if(NumRuns)
+	{
+	if((pRuns = (tsSfxSeqRun *)malloc((size_t)NumRuns * sizeof(tsSfxSeqRun)))==NULL)
+		{
+		AddErrMsg("CSfxArrayV3::Disk2PackedSeq","Unable to allocate memory for %lld sequence runs",(INT64)NumRuns);
+		return(eBSFerrMem);
+		}
+	if((Rslt = ChunkedRead(RdOfs,(UINT8 *)pRuns,(INT64)NumRuns * sizeof(tsSfxSeqRun)))!=eBSFSuccess)
+		{
+		free(pRuns);
+		return(Rslt);
+		}
+	pRun = pRuns;
+	for(RunIdx = 0; RunIdx < NumRuns; RunIdx++, pRun++)
+		{
+		if(pRun->Ofs > pSfxBlock->ConcatSeqLen || pRun->Len > (pSfxBlock->ConcatSeqLen - pRun->Ofs))
+			{
+			AddErrMsg("CSfxArrayV3::Disk2PackedSeq","Packed suffix block in '%s' has sequence run outside of concatenated sequences",m_szFile);
+			free(pRuns);
+			return(eBSFerrFileType);
+			}
+		pBase = &pSfxBlock->SeqSuffix[pRun->Ofs];
+		if(RunIdx < PackedHdr.NumExcepts)
+			memset(pBase,pRun->Val,pRun->Len);
+		else
+			for(Idx = 0; Idx < pRun->Len; Idx++)
+				*pBase++ |= cRptMskFlg;
+		}
+	free(pRuns);
+	}
+
+// finally the suffix array elements
+return(ChunkedRead(m_SfxHeader.SfxBlockOfs + PackedHdr.SfxElsOfs,&pSfxBlock->SeqSuffix[pSfxBlock->ConcatSeqLen],(INT64)NumSfxArrayEls(pSfxBlock) * pSfxBlock->SfxElSize));
+}
+
+int
+CSfxArrayV3::Next(int PrevBlockID)
+{
+if(PrevBlockID < 0 || (UINT32)PrevBlockID >= m_SfxHeader.NumSfxBlocks)
+	return(0);
+return(PrevBlockID + 1);
+}
+
+// SetTargBlock
+// specifies which block is to be loaded for subsequent sequence matches
+int
+CSfxArrayV3::SetTargBlock(int BlockID)
+{
+return(Disk2SfxBlock(BlockID));
+}
+
+int										// if non-zero then returned number of identifiers 
+CSfxArrayV3::ChkDupEntries(int MaxIdents,		// maximum number of identifers to return in pIdents (caller allocates to hold returned identifiers)
+					  UINT32 *pIdents)		// checks if there are duplicate entry names and reports identifier
+{
+int NumDups;
+bool bInDup;
+tsSfxEntry **ppEntries;
+tsSfxEntry *pCurEntry;
+tsSfxEntry *pPrevEntry;
+
+UINT32 Idx;
+
+if(m_pEntriesBlock == NULL || MaxIdents > 0 && pIdents == NULL) 
+	return(eBSFerrEntry);
+if(m_pEntriesBlock->NumEntries < 2)
+	return(0);
+
+if((ppEntries = new tsSfxEntry * [m_pEntriesBlock->NumEntries]) == NULL)
+	{
+	AddErrMsg("CSfxArrayV3::ChkDupEntries","unable to allocate memory for sorting %d entry pointers",m_pEntriesBlock->NumEntries);
+	return(eBSFerrMem);
+	}
+
+for(Idx = 0; Idx < m_pEntriesBlock->NumEntries; Idx++)
+	ppEntries[Idx] = &m_pEntriesBlock->Entries[Idx];
+
+// now sort on entries names
+m_MTqsort.qsort(ppEntries,m_pEntriesBlock->NumEntries,sizeof(tsSfxEntry *),QSortEntryNames);
+
+// iterate looking for duplicates
+NumDups = 0;
+bInDup = false;
+pPrevEntry = ppEntries[0];
+for(Idx = 1; Idx < m_pEntriesBlock->NumEntries && NumDups < MaxIdents; Idx++)
+	{
+	pCurEntry = ppEntries[Idx];
+	if(stricmp((char *)pCurEntry->szSeqName,(char *)pPrevEntry->szSeqName))
+		{
+		pPrevEntry = pCurEntry;
+		bInDup = false;
+		continue;
+		}
+	if(!bInDup && MaxIdents && NumDups < MaxIdents)
+		{
+		*pIdents++ = pPrevEntry->EntryID;
+		NumDups += 1;
+		bInDup = true;
+		}
+	else
+		if(!MaxIdents)
+			{
+			NumDups = 1;
+			break;
+			}
+	}
+delete ppEntries;
+return(NumDups);
+}
+
+
+UINT16											// returned flags prior to this call
+CSfxArrayV3::SetResetIdentFlags(UINT32 EntryID,	// atomic set/reset flags for this entry
+					UINT16 SetFlags,			// set these flags then
+					UINT16 ResetFlags)			// reset these flags
+{
+UINT32 fBlockID;
+UINT16 Flags;
+if(SetFlags == 0 && ResetFlags == 0)
+	return(GetIdentFlags(EntryID));
+
+if(m_pEntriesBlock == NULL || EntryID < 1 || EntryID > m_pEntriesBlock->NumEntries)
+	return(eBSFerrEntry);
+SerialiseBaseFlags();
+fBlockID = m_pEntriesBlock->Entries[EntryID-1].fBlockID;
+Flags = (fBlockID >> 8) & 0x0ffff;
+Flags |= SetFlags;
+Flags &= ~ResetFlags;
+m_pEntriesBlock->Entries[EntryID-1].fBlockID = ((UINT32)Flags << 8) | fBlockID & 0x0ff;
+ReleaseBaseFlags();
+return((fBlockID >> 8) & 0x0ffff);
+}
+
+UINT16					// returned flags
+CSfxArrayV3::GetIdentFlags(UINT32 EntryID)
+{
+UINT32 Flags;
+if(m_pEntriesBlock == NULL || EntryID < 1 || EntryID > m_pEntriesBlock->NumEntries)
+	return(eBSFerrEntry);
+SerialiseBaseFlags();
+Flags = m_pEntriesBlock->Entries[EntryID-1].fBlockID;
+ReleaseBaseFlags();
+return((Flags >> 8) & 0x0ffff);
+}
+
+
+void
+CSfxArrayV3::InitAllIdentFlags(UINT16 Flags)		// initialise all entries to have these flags
+{
+UINT32 EntryID;
+UINT32 fBlockID;
+UINT32 SetFlags;
+tsSfxEntry *pSfxEntry;
+if(m_pEntriesBlock == NULL || m_pEntriesBlock->NumEntries < 1)
+	return;
+SetFlags = (UINT32)Flags << 8;
+pSfxEntry = m_pEntriesBlock->Entries;
+SerialiseBaseFlags();
+for(EntryID = 0; EntryID < m_pEntriesBlock->NumEntries; EntryID++,pSfxEntry++)
+	{
+	fBlockID = pSfxEntry->fBlockID & 0x0ff;
+	fBlockID |= SetFlags;
+	pSfxEntry->fBlockID = fBlockID;
+	}
+ReleaseBaseFlags();
+return;
+}
+
+
+int
+CSfxArrayV3::GetIdentName(UINT32 EntryID,int MaxLen,char *pszSeqIdent)
+{
+if(m_pEntriesBlock == NULL || EntryID < 1 || (UINT32)EntryID > m_pEntriesBlock->NumEntries)
+	return(eBSFerrEntry);
+strncpy(pszSeqIdent,(const char *)m_pEntriesBlock->Entries[EntryID-1].szSeqName,MaxLen);
+pszSeqIdent[MaxLen-1] = '\0';
+return(eBSFSuccess);
+}
+
+int		// returns identifer for specified sequence name
+CSfxArrayV3::GetIdent(char *pszSeqIdent)
+{
+UINT32 Idx;
+if(m_pEntriesBlock == NULL || m_pEntriesBlock->NumEntries < 1)
+	return(eBSFerrEntry);
+for(Idx = 0; Idx < m_pEntriesBlock->NumEntries; Idx++)
+	{
+	if(!stricmp(pszSeqIdent,(const char *)m_pEntriesBlock->Entries[Idx].szSeqName))
+		return((int)Idx+1);
+	}
+return(eBSFerrEntry);
+}
+
+int
+CSfxArrayV3::GetNumEntries(void)
+{
+if(m_pEntriesBlock == NULL)
+	return(eBSFerrEntry);
+return(m_pEntriesBlock->NumEntries);
+}
+
+UINT32
+CSfxArrayV3::GetSeqLen(UINT32 EntryID)
+{
+tsSfxEntry *pEntry;
+if(m_pEntriesBlock == NULL || EntryID < 1 || (UINT32)EntryID > m_pEntriesBlock->NumEntries)
+	return(0);
+pEntry = &m_pEntriesBlock->Entries[EntryID-1];
+return(pEntry->SeqLen);
+}
+
+// returns total length of all sequences
+UINT64
+CSfxArrayV3::GetTotSeqsLen(void)
+{
+UINT64 Idx;
+UINT64 TotLen;
+tsSfxEntry *pEntry;
+if(m_pEntriesBlock == NULL || !m_pEntriesBlock->NumEntries)
+	return((size_t)eBSFerrEntry);
+TotLen = 0;
+pEntry = &m_pEntriesBlock->Entries[0];
+for(Idx = 0; Idx < m_pEntriesBlock->NumEntries; Idx++,pEntry++)
+	TotLen += pEntry->SeqLen;
+return(TotLen);
+}
+
+// returns minimum length of any sequence in currently loaded entries block
+UINT32 
+CSfxArrayV3::GetMinSeqLen(void)							
+{
+UINT64 Idx;
+UINT32 MinLen;
 tsSfxEntry *pEntry;
 if(m_pEntriesBlock == NULL || !m_pEntriesBlock->NumEntries)
 	return(eBSFerrEntry);
@@ -2194,6 +2947,11 @@ tsSfxEntry *pEntry;
 etSeqBase *pSeq;
 if(m_pEntriesBlock == NULL || EntryID < 1 || (UINT32)EntryID > m_pEntriesBlock->NumEntries || m_bColorspace)
 	return(eBSFerrEntry);
+if(m_pSfxMapBase != NULL)	// flags can't be set if suffix block is mapped read only
+	{
+	AddErrMsg("CSfxArrayV3::SetBaseFlags","Unable to set base flags in read only mapped suffix block");
+	return(eBSFerrFileAccess);
+	}
 pEntry = &m_pEntriesBlock->Entries[EntryID-1];
 
 if(Loci >= pEntry->SeqLen)	// requested start offset must be less or equal than the end of sequence
@@ -2240,6 +2998,11 @@ etSeqBase *pSeq2;
 
 if(m_pEntriesBlock == NULL || EntryID1 < 1 || (UINT32)EntryID1 > m_pEntriesBlock->NumEntries || EntryID2 < 1 || (UINT32)EntryID2 > m_pEntriesBlock->NumEntries|| m_bColorspace)
 	return(eBSFerrEntry);
+if(m_pSfxMapBase != NULL)	// flags can't be set if suffix block is mapped read only
+	{
+	AddErrMsg("CSfxArrayV3::SetBaseFlags","Unable to set base flags in read only mapped suffix block");
+	return(eBSFerrFileAccess);
+	}
 
 
 pEntry1 = &m_pEntriesBlock->Entries[EntryID1-1];
@@ -2395,33 +3158,293 @@ while(Len--)
 return(RetLen);
 }
 
-// ExactMatchLen
-// Returns the exact match length, up to MaxMatchLen, 3' to pProbe and pTarg 
-// Extends  probe against target taking into account the eBaseEOS terminator
-int													// length of exact match
-CSfxArrayV3::ExactMatchLen(etSeqBase *pProbe,		// determine exactly matching length between probe
-							etSeqBase *pTarg,		// and target sequences
-							int MaxMatchLen)		// for up to this length
+// Vectorised base comparison kernels
+// Probe and target bases are compared 16 (SSE4.2) or 32 (AVX2) bases at a time after masking off the upper nibble flags
+// Kernel used is selected at runtime, by SelectSeqCmpKernels(), dependent on the processor capabilities with scalar kernels used
+// if neither SSE4.2 nor AVX2 are available or if not an x86 build
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define SFX_SIMD_SEQCMP 1
+#ifdef _WIN32
+#include <intrin.h>
+#define SFX_TARGET_SSE42
+#define SFX_TARGET_AVX2
+static inline int SfxCtz(UINT32 Bits) { unsigned long Idx; _BitScanForward(&Idx,Bits); return((int)Idx); }
+static inline int SfxPopCnt(UINT32 Bits) { return((int)__popcnt(Bits)); }
+#else
+#include <immintrin.h>
+#define SFX_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define SFX_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#define SfxCtz(Bits) __builtin_ctz(Bits)
+#define SfxPopCnt(Bits) __builtin_popcount(Bits)
+#endif
+#endif
+
+typedef int (*tpfnMMCount)(etSeqBase *pProbe,etSeqBase *pTarg,int Len,int MaxMM);
+typedef int (*tpfnMatchLen)(etSeqBase *pProbe,etSeqBase *pTarg,int Len);
+
+// scalar kernels, always available
+// MMCount returns number of mismatches, or > MaxMM if more than MaxMM mismatches or target contains eBaseEOS
+static int
+MMCountScalar(etSeqBase *pProbe,etSeqBase *pTarg,int Len,int MaxMM)
+{
+int NumMM = 0;
+UINT8 TargBase;
+while(Len-- > 0)
+	{
+	TargBase = *pTarg++ & 0x0f;
+	if(TargBase == eBaseEOS)		// mustn't match across entry sequences
+		return(MaxMM + 1);
+	if((*pProbe++ & 0x0f) != TargBase && ++NumMM > MaxMM)
+		return(NumMM);
+	}
+return(NumMM);
+}
+
+// ExactLen returns number of leading bases, up to Len, which exactly match and are canonical
+static int
+ExactLenScalar(etSeqBase *pProbe,etSeqBase *pTarg,int Len)
 {
 int MatchLen;
 UINT8 El1;
 UINT8 El2;
-if(pProbe == NULL || pTarg == NULL || MaxMatchLen == 0)
-	return(0);
-for(MatchLen=0; MatchLen < MaxMatchLen; MatchLen++)
+for(MatchLen=0; MatchLen < Len; MatchLen++)
 	{
 	El2 = *pTarg++ & 0x0f;
 	if(El2 > eBaseT)
 		break;
 	El1 = *pProbe++ & 0x0f;
-	if(El1 > eBaseT)
-		break;
 	if(El1 != El2)
 		break;
 	}
 return(MatchLen);
 }
 
+// FirstDiff returns offset of first base which differs, or target is eBaseEOS, else Len if all Len bases match
+static int
+FirstDiffScalar(etSeqBase *pProbe,etSeqBase *pTarg,int Len)
+{
+int Psn;
+UINT8 El2;
+for(Psn=0; Psn < Len; Psn++)
+	{
+	El2 = *pTarg++ & 0x0f;
+	if(El2 == eBaseEOS || (*pProbe++ & 0x0f) != El2)
+		break;
+	}
+return(Psn);
+}
+
+#ifdef SFX_SIMD_SEQCMP
+SFX_TARGET_SSE42 static int
+MMCountSSE42(etSeqBase *pProbe,etSeqBase *pTarg,int Len,int MaxMM)
+{
+int NumMM = 0;
+const __m128i Nibble = _mm_set1_epi8(0x0f);
+const __m128i EOS = _mm_set1_epi8(eBaseEOS);
+__m128i Probe;
+__m128i Targ;
+while(Len >= 16)
+	{
+	Probe = _mm_and_si128(_mm_loadu_si128((const __m128i *)pProbe),Nibble);
+	Targ = _mm_and_si128(_mm_loadu_si128((const __m128i *)pTarg),Nibble);
+	if(_mm_movemask_epi8(_mm_cmpeq_epi8(Targ,EOS)))
+		return(MaxMM + 1);
+	NumMM += SfxPopCnt(~(UINT32)_mm_movemask_epi8(_mm_cmpeq_epi8(Probe,Targ)) & 0x0ffff);
+	if(NumMM > MaxMM)
+		return(NumMM);
+	pProbe += 16;
+	pTarg += 16;
+	Len -= 16;
+	}
+return(NumMM + MMCountScalar(pProbe,pTarg,Len,MaxMM - NumMM));
+}
+
+SFX_TARGET_SSE42 static int
+ExactLenSSE42(etSeqBase *pProbe,etSeqBase *pTarg,int Len)
+{
+int MatchLen = 0;
+UINT32 Bits;
+const __m128i Nibble = _mm_set1_epi8(0x0f);
+const __m128i BaseT = _mm_set1_epi8(eBaseT);
+__m128i Probe;
+__m128i Targ;
+while(Len - MatchLen >= 16)
+	{
+	Probe = _mm_and_si128(_mm_loadu_si128((const __m128i *)pProbe),Nibble);
+	Targ = _mm_and_si128(_mm_loadu_si128((const __m128i *)pTarg),Nibble);
+	Bits = (UINT32)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(Probe,Targ),_mm_cmpeq_epi8(_mm_min_epu8(Targ,BaseT),Targ)));
+	if(Bits != 0x0ffff)
+		return(MatchLen + SfxCtz(~Bits));
+	pProbe += 16;
+	pTarg += 16;
+	MatchLen += 16;
+	}
+return(MatchLen + ExactLenScalar(pProbe,pTarg,Len - MatchLen));
+}
+
+SFX_TARGET_SSE42 static int
+FirstDiffSSE42(etSeqBase *pProbe,etSeqBase *pTarg,int Len)
+{
+int Psn = 0;
+UINT32 Bits;
+const __m128i Nibble = _mm_set1_epi8(0x0f);
+const __m128i EOS = _mm_set1_epi8(eBaseEOS);
+__m128i Probe;
+__m128i Targ;
+while(Len - Psn >= 16)
+	{
+	Probe = _mm_and_si128(_mm_loadu_si128((const __m128i *)pProbe),Nibble);
+	Targ = _mm_and_si128(_mm_loadu_si128((const __m128i *)pTarg),Nibble);
+	Bits = (UINT32)_mm_movemask_epi8(_mm_andnot_si128(_mm_cmpeq_epi8(Targ,EOS),_mm_cmpeq_epi8(Probe,Targ)));
+	if(Bits != 0x0ffff)
+		return(Psn + SfxCtz(~Bits));
+	pProbe += 16;
+	pTarg += 16;
+	Psn += 16;
+	}
+return(Psn + FirstDiffScalar(pProbe,pTarg,Len - Psn));
+}
+
+SFX_TARGET_AVX2 static int
+MMCountAVX2(etSeqBase *pProbe,etSeqBase *pTarg,int Len,int MaxMM)
+{
+int NumMM = 0;
+const __m256i Nibble = _mm256_set1_epi8(0x0f);
+const __m256i EOS = _mm256_set1_epi8(eBaseEOS);
+__m256i Probe;
+__m256i Targ;
+while(Len >= 32)
+	{
+	Probe = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)pProbe),Nibble);
+	Targ = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)pTarg),Nibble);
+	if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(Targ,EOS)))
+		return(MaxMM + 1);
+	NumMM += SfxPopCnt(~(UINT32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Probe,Targ)));
+	if(NumMM > MaxMM)
+		return(NumMM);
+	pProbe += 32;
+	pTarg += 32;
+	Len -= 32;
+	}
+return(NumMM + MMCountSSE42(pProbe,pTarg,Len,MaxMM - NumMM));
+}
+
+SFX_TARGET_AVX2 static int
+ExactLenAVX2(etSeqBase *pProbe,etSeqBase *pTarg,int Len)
+{
+int MatchLen = 0;
+UINT32 Bits;
+const __m256i Nibble = _mm256_set1_epi8(0x0f);
+const __m256i BaseT = _mm256_set1_epi8(eBaseT);
+__m256i Probe;
+__m256i Targ;
+while(Len - MatchLen >= 32)
+	{
+	Probe = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)pProbe),Nibble);
+	Targ = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)pTarg),Nibble);
+	Bits = (UINT32)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(Probe,Targ),_mm256_cmpeq_epi8(_mm256_min_epu8(Targ,BaseT),Targ)));
+	if(Bits != 0xffffffff)
+		return(MatchLen + SfxCtz(~Bits));
+	pProbe += 32;
+	pTarg += 32;
+	MatchLen += 32;
+	}
+return(MatchLen + ExactLenSSE42(pProbe,pTarg,Len - MatchLen));
+}
+
+SFX_TARGET_AVX2 static int
+FirstDiffAVX2(etSeqBase *pProbe,etSeqBase *pTarg,int Len)
+{
+int Psn = 0;
+UINT32 Bits;
+const __m256i Nibble = _mm256_set1_epi8(0x0f);
+const __m256i EOS = _mm256_set1_epi8(eBaseEOS);
+__m256i Probe;
+__m256i Targ;
+while(Len - Psn >= 32)
+	{
+	Probe = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)pProbe),Nibble);
+	Targ = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)pTarg),Nibble);
+	Bits = (UINT32)_mm256_movemask_epi8(_mm256_andnot_si256(_mm256_cmpeq_epi8(Targ,EOS),_mm256_cmpeq_epi8(Probe,Targ)));
+	if(Bits != 0xffffffff)
+		return(Psn + SfxCtz(~Bits));
+	pProbe += 32;
+	pTarg += 32;
+	Psn += 32;
+	}
+return(Psn + FirstDiffSSE42(pProbe,pTarg,Len - Psn));
+}
+#endif
+
+static tpfnMMCount gpfnMMCount = MMCountScalar;
+static tpfnMatchLen gpfnExactLen = ExactLenScalar;
+static tpfnMatchLen gpfnFirstDiff = FirstDiffScalar;
+
+// SelectSeqCmpKernels
+// Selects the base comparison kernels best suited to the processor capabilities
+// Can be called multiple times, kernel selection will be the same on each call
+static void
+SelectSeqCmpKernels(void)
+{
+#ifdef SFX_SIMD_SEQCMP
+bool bSSE42;
+bool bAVX2;
+#ifdef _WIN32
+int CPUInfo[4];
+__cpuid(CPUInfo,0);
+int MaxFunc = CPUInfo[0];
+__cpuid(CPUInfo,1);
+bSSE42 = (CPUInfo[2] & (1 << 20)) && (CPUInfo[2] & (1 << 23)) ? true : false;	// SSE4.2 and POPCNT
+bAVX2 = false;
+if(bSSE42 && MaxFunc >= 7 && (CPUInfo[2] & (1 << 27)) && (CPUInfo[2] & (1 << 28)) && (_xgetbv(0) & 0x06) == 0x06)	// OSXSAVE, AVX, and OS saving YMM state
+	{
+	__cpuidex(CPUInfo,7,0);
+	bAVX2 = (CPUInfo[1] & (1 << 5)) ? true : false;
+	}
+#else
+__builtin_cpu_init();
+bSSE42 = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt");
+bAVX2 = bSSE42 && __builtin_cpu_supports("avx2");
+#endif
+if(bAVX2)
+	{
+	gpfnMMCount = MMCountAVX2;
+	gpfnExactLen = ExactLenAVX2;
+	gpfnFirstDiff = FirstDiffAVX2;
+	}
+else
+	if(bSSE42)
+		{
+		gpfnMMCount = MMCountSSE42;
+		gpfnExactLen = ExactLenSSE42;
+		gpfnFirstDiff = FirstDiffSSE42;
+		}
+#endif
+}
+
+// CountMismatches
+// Counts mismatches between probe and target over Len bases, early terminating once more than MaxMM mismatches
+// Returns the number of mismatches, or > MaxMM if either more than MaxMM mismatches or the target contains an eBaseEOS terminator
+// Note: bisulfite and colorspace matching rules are not applied
+int
+CSfxArrayV3::CountMismatches(etSeqBase *pProbe,etSeqBase *pTarg,int Len,int MaxMM)
+{
+return((*gpfnMMCount)(pProbe,pTarg,Len,MaxMM));
+}
+
+// ExactMatchLen
+// Returns the exact match length, up to MaxMatchLen, 3' to pProbe and pTarg 
+// Extends  probe against target taking into account the eBaseEOS terminator
+int													// length of exact match
+CSfxArrayV3::ExactMatchLen(etSeqBase *pProbe,		// determine exactly matching length between probe
+							etSeqBase *pTarg,		// and target sequences
+							int MaxMatchLen)		// for up to this length
+{
+if(pProbe == NULL || pTarg == NULL || MaxMatchLen <= 0)
+	return(0);
+return((*gpfnExactLen)(pProbe,pTarg,MaxMatchLen));
+}
+
 
 // CmpProbeTarg
 // Compares probe against target taking into account the eBaseEOS terminator
@@ -2431,18 +3454,13 @@ CSfxArrayV3::CmpProbeTarg(etSeqBase *pEl1,etSeqBase *pEl2,int Len)
 int Psn;
 UINT8 El1;
 UINT8 El2;
-for(Psn=0; Psn < Len; Psn++)
-	{
-	El2 = *pEl2++ & 0x0f;
-	if(El2 == eBaseEOS)
-		return(-1);
-	El1 = *pEl1++ & 0x0f;
-	if(El1 > El2)
-		return(1);
-	if(El1 < El2)
-		return(-1);
-	}
-return(0);
+if((Psn = (*gpfnFirstDiff)(pEl1,pEl2,Len)) >= Len)
+	return(0);
+El2 = pEl2[Psn] & 0x0f;
+if(El2 == eBaseEOS)
+	return(-1);
+El1 = pEl1[Psn] & 0x0f;
+return(El1 > El2 ? 1 : -1);
 }
 
 
@@ -4785,8 +5803,6 @@ INT64 LastTargIdx;
 UINT32 NumCopies;
 
 etSeqBase BisBase;
-UINT8 ProbeBase;
-UINT8 TargBase;
 
 int Cmp;
 int CurNumCoreSlides;
@@ -4945,24 +5961,10 @@ do
 				{
 				pTargBase = &pTarg[TargSeqLeftIdx];
 				pProbeBase = pProbeSeq;
-				CurMMCnt = 0;
 				CoreMMCnt = 0;
 				bool bPairMM = false;
-				for(PatIdx = 0; PatIdx < (UINT32)TargMatchLen; PatIdx++,pTargBase++,pProbeBase++)
-					{
-					TargBase = *pTargBase & 0x0f;
-					ProbeBase = *pProbeBase & 0x0f;
-					if(TargBase == eBaseEOS)		// mustn't match across entry sequences
-						break;
-
-					if(ProbeBase == TargBase)
-						continue;
-
-					// execution here only if mismatch
-					if(++CurMMCnt > MaxTotMM)
-						break;
-					}
-				if(PatIdx != TargMatchLen)
+				CurMMCnt = CountMismatches(pProbeBase,pTargBase,TargMatchLen,MaxTotMM);
+				if(CurMMCnt > MaxTotMM)
 					continue;
 
 				// check for self matches
@@ -5175,6 +6177,7 @@ CSfxArrayV3::IfAnyAlignments(UINT32 ReadID,					// identifies this read
 int CurCoreSegOfs;				// current core segment relative start
 int IterCnt;					// count iterator for current segment target matches
 int CurMMCnt;					// total number of mismatches for current target sequence being processed
+int MMLimit;					// mismatch limit when using the vectorised mismatch counting
 int CoreMMCnt;					// total number of mismatches for current target core being processed
 int LowMMCnt;					// least number of substitutions thus far required for match against target
 int NxtLowMMCnt;				// next best least number of substitutions thus far required for match against target
@@ -5383,69 +6386,79 @@ do
 					bool bPairMM = false;
 					if (m_bBisulfite)
 						BisBase = GetBisBase(TargMatchLen, pTargBase, pProbeBase);
-					for (PatIdx = 0; PatIdx < (UINT32)TargMatchLen; PatIdx++, pTargBase++, pProbeBase++)
+				if (!m_bColorspace && !m_bBisulfite)		// basespace with no bisulfite rules so can use the vectorised mismatch counting
 					{
-						TargBase = *pTargBase & 0x0f;
-						ProbeBase = *pProbeBase & 0x0f;
-						if (TargBase == eBaseEOS)		// mustn't match across entry sequences
-							break;
-
-						if (m_bColorspace)		// in colorspace, unpaired mismatches are sequencer errors but still treat as if a substitution
+					MMLimit = min(MaxTotMM,NxtLowMMCnt - 1);
+					CurMMCnt = CountMismatches(pProbeBase,pTargBase,TargMatchLen,max(0,MMLimit));
+					if (CurMMCnt > 0 && CurMMCnt > MMLimit)	// no mismatches is always accepted
+						continue;
+					}
+				else
+					{
+						for (PatIdx = 0; PatIdx < (UINT32)TargMatchLen; PatIdx++, pTargBase++, pProbeBase++)
 						{
-							if (!bPairMM && TargBase != ProbeBase)
+							TargBase = *pTargBase & 0x0f;
+							ProbeBase = *pProbeBase & 0x0f;
+							if (TargBase == eBaseEOS)		// mustn't match across entry sequences
+								break;
+
+							if (m_bColorspace)		// in colorspace, unpaired mismatches are sequencer errors but still treat as if a substitution
 							{
-								if (PatIdx < ((UINT32)TargMatchLen - 1))
+								if (!bPairMM && TargBase != ProbeBase)
 								{
-									if ((pTargBase[1] & 0x0f) == (pProbeBase[1] & 0x0f))
+									if (PatIdx < ((UINT32)TargMatchLen - 1))
 									{
-										if (++CurMMCnt > MaxTotMM)
-											break;
-										if (CurMMCnt >= NxtLowMMCnt)
-											break;
-										continue;
+										if ((pTargBase[1] & 0x0f) == (pProbeBase[1] & 0x0f))
+										{
+											if (++CurMMCnt > MaxTotMM)
+												break;
+											if (CurMMCnt >= NxtLowMMCnt)
+												break;
+											continue;
+										}
 									}
+									// accept as being a mismatch
+									bPairMM = true;
+								}
+								else
+								{
+									bPairMM = false;
+									continue;
 								}
-								// accept as being a mismatch
-								bPairMM = true;
 							}
-							else
+							else				// in basespace
 							{
-								bPairMM = false;
-								continue;
-							}
-						}
-						else				// in basespace
-						{
-							if (ProbeBase == TargBase)
-								continue;
+								if (ProbeBase == TargBase)
+									continue;
 
-							if (m_bBisulfite)
-							{
-								if (TargBase == eBaseC || TargBase == eBaseG)
+								if (m_bBisulfite)
 								{
-									switch (BisBase)
+									if (TargBase == eBaseC || TargBase == eBaseG)
 									{
-										case eBaseA:		// only allow A
-											if (ProbeBase == eBaseA && TargBase == eBaseG)
-												continue;
-											break; // mismatch
-										case eBaseT:		// only allow T
-											if (ProbeBase == eBaseT && TargBase == eBaseC)
-												continue;
-											break; // mismatch
+										switch (BisBase)
+										{
+											case eBaseA:		// only allow A
+												if (ProbeBase == eBaseA && TargBase == eBaseG)
+													continue;
+												break; // mismatch
+											case eBaseT:		// only allow T
+												if (ProbeBase == eBaseT && TargBase == eBaseC)
+													continue;
+												break; // mismatch
+										}
 									}
 								}
 							}
-						}
 
-						// execution here only if mismatch
-						if (++CurMMCnt > MaxTotMM)
-							break;
-						if (CurMMCnt >= NxtLowMMCnt)
-							break;
+							// execution here only if mismatch
+							if (++CurMMCnt > MaxTotMM)
+								break;
+							if (CurMMCnt >= NxtLowMMCnt)
+								break;
+						}
+					if (PatIdx != TargMatchLen)
+						continue;
 					}
-				if (PatIdx != TargMatchLen)
-					continue;
 
 				// processing continues here only if number of mismatches over whole probe accepted
 				return(eHRhits);
@@ -5713,6 +6726,7 @@ CSfxArrayV3::LocateCoreMultiples(UINT32 ExtdProcFlags,	// flags indicating if lo
 int CurCoreSegOfs;				// current core segment relative start
 int IterCnt;					// count iterator for current segment target matches
 int CurMMCnt;					// total number of mismatches for current target sequence being processed
+int MMLimit;					// mismatch limit when using the vectorised mismatch counting
 int CoreMMCnt;					// total number of mismatches for current target core being processed
 int LowMMCnt;					// least number of substitutions thus far required for match against target
 int NxtLowMMCnt;				// next best least number of substitutions thus far required for match against target
@@ -5720,7 +6734,7 @@ int LowHitInstances;			// number of hit instances thus far for hits with LowMMCn
 etSeqBase *pProbeBase;
 etSeqBase *pTargBase;
 char CurStrand;
-INT64 TargIdx;
+tsCoreHitIter CoreHit;			// iterates exactly matching core hits
 
 UINT32 MinProbeChimericLen;
 char BestChimericStrand;
@@ -5741,8 +6755,6 @@ UINT32 NumTargSeqProc;
 
 bool bFirstIter;				// set false after the first subsequence core returned by LocateFirstExact has been processed
 
-INT64 LastTargIdx;
-UINT32 NumCopies;
 
 UINT32 PatIdx;
 INT64 TargSeqLeftIdx;
@@ -5753,14 +6765,11 @@ etSeqBase BisBase;
 UINT8 ProbeBase;
 UINT8 TargBase;
 
-int Cmp;
 int CurNumCoreSlides;
 int CurCoreDelta;
 tsHitLoci *pCurHit;
 
 etSeqBase *pTarg;			// target sequence
-void *pSfxArray;			// target sequence suffix array
-INT64 SfxLen;				// number of suffixs in pSfxArray
 tsSfxEntry *pEntry;
 BisBase=eBaseN;
 
@@ -5783,8 +6792,6 @@ if(*pLowHitInstances >= 1 && *pLowMMCnt == 0 && (*pNxtLowMMCnt - *pLowMMCnt) < M
 	return(eHRMMDelta);
 
 pTarg = (etSeqBase *)&m_pSfxBlock->SeqSuffix[0];
-pSfxArray = (void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen];
-SfxLen = m_pSfxBlock->ConcatSeqLen;
 
 
 if(*pLowHitInstances <= 0 || *pLowMMCnt < 0 || *pNxtLowMMCnt < 0)	// if never seen any previous matches then ensure substitution counts are initialised
@@ -5833,93 +6840,37 @@ do
 	CurNumCoreSlides = 0;
 	memset(pHashArray,0,sizeof(pHashArray));
 	CurNumIdentNodes = 0;
-	for(CurCoreSegOfs = 0;
-		CurNumCoreSlides < MaxNumCoreSlides &&
-		CurCoreSegOfs <= (ProbeLen - CoreLen) &&
-		CurCoreDelta > CoreLen/3 &&
-		CurNumIdentNodes < NumAllocdIdentNodes;	// can only allow upto cMaxNumIdentNodes to be saved
-	    CurNumCoreSlides += 1,
-	    CurCoreSegOfs += CurCoreDelta)
-		{
-		if(CurNumCoreSlides >= MaxNumCoreSlides)
-			break;
-		if((CurCoreSegOfs + CoreLen + CurCoreDelta) > ProbeLen)
-			CurCoreDelta = ProbeLen - (CurCoreSegOfs + CoreLen);
-
-		TargIdx = LocateFirstExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,0,SfxLen-1);
-		if(TargIdx == 0)        // 0 if no core segment matches
-			continue;			// try for match on next core segment after shifting core to right
-
-		TargIdx -= 1;
-		IterCnt = 0;
-		NumCopies = 0;
-		bFirstIter = true;		// set false after the first subsequence core returned by LocateFirstExact has been processed
-		while(!CurMaxIter || IterCnt < CurMaxIter)
-			{
-			if(CurNumIdentNodes >= NumAllocdIdentNodes)
-				break;
-
-			if(!bFirstIter) {
-
-				// ensure not about to iterate past end of suffix array!
-				if((TargIdx + 1) >= (INT64)m_pSfxBlock->ConcatSeqLen || (SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1) + CoreLen) >  (INT64)m_pSfxBlock->ConcatSeqLen)
-					break;
-
-				if(IterCnt == 100 && !NumCopies)
-					{
-					// check how many more exact copies there are of the current probe subsequence, if too many then don't bother exploring these
-					LastTargIdx = LocateLastExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,TargIdx-1,SfxLen-1);
-					NumCopies = LastTargIdx > 0 ? (UINT32)(1 + LastTargIdx - TargIdx) : 0;
-					if(CurMaxIter && NumCopies > (UINT32)CurMaxIter)		// only checking at the 100th iteration allows a little slack
-						break;										// try next core segment
-					}
-
-				// check that this new putative core is still matching
-				pTargBase = &pTarg[SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1)];
-				pProbeBase = &pProbeSeq[CurCoreSegOfs];
-				if(m_bBisulfite)
-					Cmp = BSCmpProbeTarg(pProbeBase,pTargBase,CoreLen);
-				else
-					{
-					int Ofs;
-					UINT8 El1;
-					UINT8 El2;
-					etSeqBase *pEl1= pProbeBase;
-					etSeqBase *pEl2 = pTargBase;
-					Cmp = 0;
-					for(Ofs=0; Ofs < CoreLen; Ofs++)
-						{
-						El2 = *pEl2++ & 0x0f;
-						if(El2 == eBaseEOS)
-							{
-							Cmp = -1;
-							break;
-							}
-						El1 = *pEl1++ & 0x0f;
-						if(El1 > El2)
-							{
-							Cmp = 1;
-							break;
-							}
-						if(El1 < El2)
-							{
-							Cmp = -1;
-							break;
-							}
-						}
-					}
+	for(CurCoreSegOfs = 0;
+		CurNumCoreSlides < MaxNumCoreSlides &&
+		CurCoreSegOfs <= (ProbeLen - CoreLen) &&
+		CurCoreDelta > CoreLen/3 &&
+		CurNumIdentNodes < NumAllocdIdentNodes;	// can only allow upto cMaxNumIdentNodes to be saved
+	    CurNumCoreSlides += 1,
+	    CurCoreSegOfs += CurCoreDelta)
+		{
+		if(CurNumCoreSlides >= MaxNumCoreSlides)
+			break;
+		if((CurCoreSegOfs + CoreLen + CurCoreDelta) > ProbeLen)
+			CurCoreDelta = ProbeLen - (CurCoreSegOfs + CoreLen);
 
-				if(Cmp != 0)				// will be non-zero if target no longer matches
-					break;					// try next core segment
-				TargIdx += 1;
-				}
+		if(!FirstCoreHit(&CoreHit,&pProbeSeq[CurCoreSegOfs],CoreLen))        // false if no core segment matches
+			continue;			// try for match on next core segment after shifting core to right
+		IterCnt = 0;
+		bFirstIter = true;		// set false after the first core hit returned by FirstCoreHit has been processed
+		while(!CurMaxIter || IterCnt < CurMaxIter)
+			{
+			if(CurNumIdentNodes >= NumAllocdIdentNodes)
+				break;
+
+			if(!bFirstIter && !NextCoreHit(&CoreHit,IterCnt,CurMaxIter))
+				break;					// try next core segment
 
 			bFirstIter = false;
-			if(SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) < (UINT32)CurCoreSegOfs)
+			if(CoreHit.Loci < (UINT32)CurCoreSegOfs)
 				continue;
 
 			TargMatchLen = ProbeLen;
-			TargSeqLeftIdx = SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) - CurCoreSegOfs;
+			TargSeqLeftIdx = CoreHit.Loci - CurCoreSegOfs;
 			ProbeSeqLeftIdx = 0;
 
 			pEntry = MapChunkHit2Entry(TargSeqLeftIdx);
@@ -5929,7 +6880,7 @@ do
 				continue;
 
 			// check if target already processed
-			TargSeqID = (UINT32)(1 + SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) - (UINT32)CurCoreSegOfs);
+			TargSeqID = (UINT32)(1 + CoreHit.Loci - (UINT32)CurCoreSegOfs);
 			Hash = (TargSeqID & cHashEntries);
 			if((pCurIdentNode = pHashArray[Hash])==NULL)
 				{
@@ -6090,68 +7041,78 @@ do
 				if(m_bBisulfite)
 					BisBase = GetBisBase(TargMatchLen,pTargBase,pProbeBase);
 
-				for(PatIdx = 0; PatIdx < (UINT32)TargMatchLen; PatIdx++,pTargBase++,pProbeBase++)
+				if(!m_bColorspace && !m_bBisulfite)		// basespace with no bisulfite rules so can use the vectorised mismatch counting
 					{
-					TargBase = *pTargBase & 0x0f;
-					ProbeBase = *pProbeBase & 0x0f;
-					if(TargBase == eBaseEOS)		// mustn't match across entry sequences
-						break;
-
-					if(m_bColorspace)		// in colorspace, unpaired mismatches are sequencer errors but still treat as if a substitution
+					MMLimit = min(MaxTotMM,NxtLowMMCnt - 1);
+					CurMMCnt = CountMismatches(pProbeBase,pTargBase,TargMatchLen,max(0,MMLimit));
+					if(CurMMCnt > 0 && CurMMCnt > MMLimit)	// no mismatches is always accepted
+						continue;
+					}
+				else
+					{
+					for(PatIdx = 0; PatIdx < (UINT32)TargMatchLen; PatIdx++,pTargBase++,pProbeBase++)
 						{
-						if(!bPairMM && TargBase != ProbeBase)
+						TargBase = *pTargBase & 0x0f;
+						ProbeBase = *pProbeBase & 0x0f;
+						if(TargBase == eBaseEOS)		// mustn't match across entry sequences
+							break;
+
+						if(m_bColorspace)		// in colorspace, unpaired mismatches are sequencer errors but still treat as if a substitution
 							{
-							if(PatIdx < ((UINT32)TargMatchLen-1))
+							if(!bPairMM && TargBase != ProbeBase)
 								{
-								if((pTargBase[1] & 0x0f) == (pProbeBase[1] & 0x0f))
+								if(PatIdx < ((UINT32)TargMatchLen-1))
 									{
-									if(++CurMMCnt > MaxTotMM)
-										break;
-									if(CurMMCnt >= NxtLowMMCnt)
-										break;
-									continue;
+									if((pTargBase[1] & 0x0f) == (pProbeBase[1] & 0x0f))
+										{
+										if(++CurMMCnt > MaxTotMM)
+											break;
+										if(CurMMCnt >= NxtLowMMCnt)
+											break;
+										continue;
+										}
 									}
+								// accept as being a mismatch
+								bPairMM = true;
+								}
+							else
+								{
+								bPairMM = false;
+								continue;
 								}
-							// accept as being a mismatch
-							bPairMM = true;
 							}
-						else
+						else				// in basespace
 							{
-							bPairMM = false;
-							continue;
-							}
-						}
-					else				// in basespace
-						{
-						if(ProbeBase == TargBase)
-							continue;
+							if(ProbeBase == TargBase)
+								continue;
 
-						if(m_bBisulfite)
-							{
-							if(TargBase == eBaseC || TargBase == eBaseG)
+							if(m_bBisulfite)
 								{
-								switch(BisBase) {
-									case eBaseA:		// only allow A
-										if(ProbeBase == eBaseA && TargBase == eBaseG)
-											continue;
-										break; // mismatch
-									case eBaseT:		// only allow T
-										if(ProbeBase == eBaseT && TargBase == eBaseC)
-											continue;
-										break; // mismatch
+								if(TargBase == eBaseC || TargBase == eBaseG)
+									{
+									switch(BisBase) {
+										case eBaseA:		// only allow A
+											if(ProbeBase == eBaseA && TargBase == eBaseG)
+												continue;
+											break; // mismatch
+										case eBaseT:		// only allow T
+											if(ProbeBase == eBaseT && TargBase == eBaseC)
+												continue;
+											break; // mismatch
+										}
 									}
 								}
 							}
-						}
 
-					// execution here only if mismatch
-					if(++CurMMCnt > MaxTotMM)
-						break;
-					if(CurMMCnt >= NxtLowMMCnt)
-						break;
+						// execution here only if mismatch
+						if(++CurMMCnt > MaxTotMM)
+							break;
+						if(CurMMCnt >= NxtLowMMCnt)
+							break;
+						}
+					if(PatIdx != TargMatchLen)
+						continue;
 					}
-				if(PatIdx != TargMatchLen)
-					continue;
 
 				// processing continues here only if number of mismatches over whole probe accepted
 				if(CurMMCnt < LowMMCnt)	// if fewer mismatches than any previous match then this is a new unique putative hit
@@ -6674,7 +7635,7 @@ int LowHitInstances;			// number of hit instances thus far for hits with LowMMCn
 etSeqBase *pProbeBase;
 etSeqBase *pTargBase;
 char CurStrand;
-INT64 TargIdx;
+tsCoreHitIter CoreHit;			// iterates exactly matching core hits
 
 tsIdentNode *pHashArray[cHashEntries+1];		// hash array holding ptrs to identifier nodes
 tsIdentNode *pIdentNodes = pAllocsIdentNodes;	// identifier nodes
@@ -6688,8 +7649,6 @@ UINT32 NumTargSeqProc;
 
 bool bFirstIter;				// set false after the first subsequence core returned by LocateFirstExact has been processed
 
-INT64 LastTargIdx;
-UINT32 NumCopies;
 
 UINT32 PatIdx;
 INT64 TargSeqLeftIdx;
@@ -6700,7 +7659,6 @@ etSeqBase BisBase;
 UINT8 ProbeBase;
 UINT8 TargBase;
 
-int Cmp;
 int CurNumCoreSlides;
 int CurCoreDelta;
 tsHitLoci *pCurHit;
@@ -6708,8 +7666,6 @@ tsHitLoci *pCurHit;
 bool bMatchesSloughed;
 
 etSeqBase *pTarg;			// target sequence
-void *pSfxArray;			// target sequence suffix array
-INT64 SfxLen;				// number of suffixs in pSfxArray
 tsSfxEntry *pEntry;
 BisBase=eBaseN;
 
@@ -6718,8 +7674,6 @@ if(m_pSfxBlock == NULL || m_pSfxBlock->ConcatSeqLen == 0)
 	return(eBSFerrInternal);
 
 pTarg = (etSeqBase *)&m_pSfxBlock->SeqSuffix[0];
-pSfxArray = (void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen];
-SfxLen = m_pSfxBlock->ConcatSeqLen;
 
 
 LowHitInstances = 0;
@@ -6761,80 +7715,24 @@ do
 		if((CurCoreSegOfs + CoreLen + CurCoreDelta) > ProbeLen)
 			CurCoreDelta = ProbeLen - (CurCoreSegOfs + CoreLen);
 
-		TargIdx = LocateFirstExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,0,SfxLen-1);
-		if(TargIdx == 0)        // 0 if no core segment matches
+		if(!FirstCoreHit(&CoreHit,&pProbeSeq[CurCoreSegOfs],CoreLen))        // false if no core segment matches
 			continue;			// try for match on next core segment after shifting core to right
-
-		TargIdx -= 1;
 		IterCnt = 0;
-		NumCopies = 0;
-		bFirstIter = true;		// set false after the first subsequence core returned by LocateFirstExact has been processed
+		bFirstIter = true;		// set false after the first core hit returned by FirstCoreHit has been processed
 		while(!CurMaxIter || IterCnt < CurMaxIter)
 			{
 			if(CurNumIdentNodes >= NumAllocdIdentNodes)
 				break;
 
-			if(!bFirstIter) {
-
-				// ensure not about to iterate past end of suffix array!
-				if((TargIdx + 1) >= (INT64)m_pSfxBlock->ConcatSeqLen || (SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1) + CoreLen) >  (INT64)m_pSfxBlock->ConcatSeqLen)
-					break;
-
-				if(IterCnt == 100 && !NumCopies)
-					{
-					// check how many more exact copies there are of the current probe subsequence, if too many then don't bother exploring these
-					LastTargIdx = LocateLastExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,TargIdx-1,SfxLen-1);
-					NumCopies = LastTargIdx > 0 ? (UINT32)(1 + LastTargIdx - TargIdx) : 0;
-					if(CurMaxIter && NumCopies > (UINT32)CurMaxIter)		// only checking at the 100th iteration allows a little slack
-						break;										// try next core segment
-					}
-
-				// check that this new putative core is still matching
-				pTargBase = &pTarg[SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1)];
-				pProbeBase = &pProbeSeq[CurCoreSegOfs];
-				if(m_bBisulfite)
-					Cmp = BSCmpProbeTarg(pProbeBase,pTargBase,CoreLen);
-				else
-					{
-					int Ofs;
-					UINT8 El1;
-					UINT8 El2;
-					etSeqBase *pEl1= pProbeBase;
-					etSeqBase *pEl2 = pTargBase;
-					Cmp = 0;
-					for(Ofs=0; Ofs < CoreLen; Ofs++)
-						{
-						El2 = *pEl2++ & 0x0f;
-						if(El2 == eBaseEOS)
-							{
-							Cmp = -1;
-							break;
-							}
-						El1 = *pEl1++ & 0x0f;
-						if(El1 > El2)
-							{
-							Cmp = 1;
-							break;
-							}
-						if(El1 < El2)
-							{
-							Cmp = -1;
-							break;
-							}
-						}
-					}
-
-				if(Cmp != 0)				// will be non-zero if target no longer matches
-					break;					// try next core segment
-				TargIdx += 1;
-				}
+			if(!bFirstIter && !NextCoreHit(&CoreHit,IterCnt,CurMaxIter))
+				break;					// try next core segment
 
 			bFirstIter = false;
-			if(SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) < (UINT32)CurCoreSegOfs)
+			if(CoreHit.Loci < (UINT32)CurCoreSegOfs)
 				continue;
 
 			TargMatchLen = ProbeLen;
-			TargSeqLeftIdx = SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) - CurCoreSegOfs;
+			TargSeqLeftIdx = CoreHit.Loci - CurCoreSegOfs;
 			ProbeSeqLeftIdx = 0;
 
 			// ensure comparisons are still within start/end range of target sequence/assembly
@@ -6842,7 +7740,7 @@ do
 				continue;
 
 			// check if target already processed
-			TargSeqID = (UINT32)(1 + SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) - (UINT32)CurCoreSegOfs);
+			TargSeqID = (UINT32)(1 + CoreHit.Loci - (UINT32)CurCoreSegOfs);
 			Hash = (TargSeqID & cHashEntries);
 			if((pCurIdentNode = pHashArray[Hash])==NULL)
 				{
@@ -6875,64 +7773,73 @@ do
 				bool bPairMM = false;
 				if(m_bBisulfite)
 					BisBase = GetBisBase(TargMatchLen,pTargBase,pProbeBase);
-				for(PatIdx = 0; PatIdx < (UINT32)TargMatchLen; PatIdx++,pTargBase++,pProbeBase++)
+				if(!m_bColorspace && !m_bBisulfite)		// basespace with no bisulfite rules so can use the vectorised mismatch counting
 					{
-					TargBase = *pTargBase & 0x0f;
-					ProbeBase = *pProbeBase & 0x0f;
-					if(TargBase == eBaseEOS)		// mustn't match across entry sequences
-						break;
-
-					if(m_bColorspace)		// in colorspace, unpaired mismatches are sequencer errors but still treat as if a substitution
+					CurMMCnt = CountMismatches(pProbeBase,pTargBase,TargMatchLen,MaxTotMM);
+					if(CurMMCnt > MaxTotMM)
+						continue;
+					}
+				else
+					{
+					for(PatIdx = 0; PatIdx < (UINT32)TargMatchLen; PatIdx++,pTargBase++,pProbeBase++)
 						{
-						if(!bPairMM && TargBase != ProbeBase)
+						TargBase = *pTargBase & 0x0f;
+						ProbeBase = *pProbeBase & 0x0f;
+						if(TargBase == eBaseEOS)		// mustn't match across entry sequences
+							break;
+
+						if(m_bColorspace)		// in colorspace, unpaired mismatches are sequencer errors but still treat as if a substitution
 							{
-							if(PatIdx < ((UINT32)TargMatchLen-1))
+							if(!bPairMM && TargBase != ProbeBase)
 								{
-								if((pTargBase[1] & 0x0f) == (pProbeBase[1] & 0x0f))
+								if(PatIdx < ((UINT32)TargMatchLen-1))
 									{
-									if(++CurMMCnt > MaxTotMM)
-										break;
-									continue;
+									if((pTargBase[1] & 0x0f) == (pProbeBase[1] & 0x0f))
+										{
+										if(++CurMMCnt > MaxTotMM)
+											break;
+										continue;
+										}
 									}
+								// accept as being a mismatch
+								bPairMM = true;
+								}
+							else
+								{
+								bPairMM = false;
+								continue;
 								}
-							// accept as being a mismatch
-							bPairMM = true;
 							}
-						else
+						else				// in basespace
 							{
-							bPairMM = false;
-							continue;
-							}
-						}
-					else				// in basespace
-						{
-						if(ProbeBase == TargBase)
-							continue;
+							if(ProbeBase == TargBase)
+								continue;
 
-						if(m_bBisulfite)
-							{
-							if(TargBase == eBaseC || TargBase == eBaseG)
+							if(m_bBisulfite)
 								{
-								switch(BisBase) {
-									case eBaseA:		// only allow A
-										if(ProbeBase == eBaseA && TargBase == eBaseG)
-											continue;
-										break; // mismatch
-									case eBaseT:		// only allow T
-										if(ProbeBase == eBaseT && TargBase == eBaseC)
-											continue;
-										break; // mismatch
+								if(TargBase == eBaseC || TargBase == eBaseG)
+									{
+									switch(BisBase) {
+										case eBaseA:		// only allow A
+											if(ProbeBase == eBaseA && TargBase == eBaseG)
+												continue;
+											break; // mismatch
+										case eBaseT:		// only allow T
+											if(ProbeBase == eBaseT && TargBase == eBaseC)
+												continue;
+											break; // mismatch
+										}
 									}
 								}
 							}
-						}
 
-					// execution here only if mismatch
-					if(++CurMMCnt > MaxTotMM)
-						break;
+						// execution here only if mismatch
+						if(++CurMMCnt > MaxTotMM)
+							break;
+						}
+					if(PatIdx != TargMatchLen)
+						continue;
 					}
-				if(PatIdx != TargMatchLen)
-					continue;
 
 				// need to ensure only the hits with lowest number of mismatches are being retained
 				pCurHit = NULL;
@@ -7043,7 +7950,7 @@ int IterCnt;					// count iterator for current segment target matches
 etSeqBase *pProbeBase;
 etSeqBase *pTargBase;
 char CurStrand;
-INT64 TargIdx;
+tsCoreHitIter CoreHit;			// iterates exactly matching core hits
 
 UINT32 NumTargSeqProc;
 
@@ -7055,8 +7962,6 @@ INT64 ProbeSeqLeftIdx;
 int TargMatchLen;
 
 int SpliceJunctLenLimit;
-INT64 LastTargIdx;
-UINT32 NumCopies;
 
 etSeqBase BisBase;
 
@@ -7067,12 +7972,9 @@ int RsltRightSplice;
 int RsltLeftSplice;
 int BestScoreInstances;
 
-int Cmp;
 tsHitLoci *pCurHit;
 tsSfxEntry *pEntry;
 etSeqBase *pTarg;			// target sequence
-void *pSfxArray;			// target sequence suffix array
-INT64 SfxLen;				// number of suffixs in pSfxArray
 BisBase=eBaseN;
 
 // ensure suffix array block loaded for iteration!
@@ -7080,8 +7982,6 @@ if(m_pSfxBlock == NULL || m_pSfxBlock->ConcatSeqLen == 0)
 	return(eBSFerrInternal);
 
 pTarg = (etSeqBase *)&m_pSfxBlock->SeqSuffix[0];
-pSfxArray = (void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen];
-SfxLen = m_pSfxBlock->ConcatSeqLen;
 
 if(MaxTotMM > cMaxJunctAlignMM)		// silently clamp
 	MaxTotMM = cMaxJunctAlignMM;
@@ -7118,85 +8018,36 @@ do
 			case 1:
 				CurCoreSegOfs = ProbeLen - CoreLen;
 				break;
-			}
-		TargIdx = LocateFirstExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,0,SfxLen-1);
-		if(TargIdx == 0)        // 0 if no core segment matches
-			continue;			// try for match on next core segment after shifting core to right
-		TargIdx -= 1;
-		IterCnt = 0;
-		NumCopies = 0;
-		bFirstIter = true;		// set false after the first subsequence core returned by LocateFirstExact has been processed
-		while(!CurMaxIter || IterCnt < CurMaxIter)
-			{
-			if(!bFirstIter) {
-
-				// ensure not about to iterate past end of suffix array!
-				if((TargIdx + 1) >= (INT64)m_pSfxBlock->ConcatSeqLen || (SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1) + (Phase == 0 ? ProbeLen : CoreLen)) >=  (INT64)m_pSfxBlock->ConcatSeqLen)
-					break;
-
-				if(IterCnt == 100 && !NumCopies)
-					{
-					// check how many more exact copies there are of the current probe subsequence, if too many then don't bother exploring these
-					LastTargIdx = LocateLastExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,TargIdx-1,SfxLen-1);
-					NumCopies = LastTargIdx > 0 ? (UINT32)(1 + LastTargIdx - TargIdx) : 0;
-					if(CurMaxIter && NumCopies > (UINT32)CurMaxIter)		// only checking at the 100th iteration allows a little slack
-						break;										// try next core segment
-					}
-
-				// check that this new putative core is still matching
-				pTargBase = &pTarg[SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1)];
-				pProbeBase = &pProbeSeq[CurCoreSegOfs];
-				if(m_bBisulfite)
-					Cmp = BSCmpProbeTarg(pProbeBase,pTargBase,CoreLen);
-				else
-					{
-					int Ofs;
-					UINT8 El1;
-					UINT8 El2;
-					etSeqBase *pEl1= pProbeBase;
-					etSeqBase *pEl2 = pTargBase;
-					Cmp = 0;
-					for(Ofs=0; Ofs < CoreLen; Ofs++)
-						{
-						El2 = *pEl2++ & 0x0f;
-						if(El2 == eBaseEOS)
-							{
-							Cmp = -1;
-							break;
-							}
-						El1 = *pEl1++ & 0x0f;
-						if(El1 > El2)
-							{
-							Cmp = 1;
-							break;
-							}
-						if(El1 < El2)
-							{
-							Cmp = -1;
-							break;
-							}
-						}
-					}
-
-				if(Cmp != 0)				// will be non-zero if target no longer matches
+			}
+		if(!FirstCoreHit(&CoreHit,&pProbeSeq[CurCoreSegOfs],CoreLen))        // false if no core segment matches
+			continue;			// try for match on next core segment after shifting core to right
+		IterCnt = 0;
+		bFirstIter = true;		// set false after the first core hit returned by FirstCoreHit has been processed
+		while(!CurMaxIter || IterCnt < CurMaxIter)
+			{
+			if(!bFirstIter)
+				{
+				if(!NextCoreHit(&CoreHit,IterCnt,CurMaxIter))
 					break;					// try next core segment
-				TargIdx += 1;
+				// ensure not about to iterate past end of targeted sequences
+				if((CoreHit.Loci + (Phase == 0 ? ProbeLen : CoreLen)) >=  (INT64)m_pSfxBlock->ConcatSeqLen)
+					break;
 				}
 
 			bFirstIter = false;
 
-			if(SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) < (UINT32)CurCoreSegOfs)
+			if(CoreHit.Loci < (UINT32)CurCoreSegOfs)
 				continue;
 
 			TargMatchLen = ProbeLen;
-			TargSeqLeftIdx = SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) - CurCoreSegOfs;
+			TargSeqLeftIdx = CoreHit.Loci - CurCoreSegOfs;
 			ProbeSeqLeftIdx = 0;
 
 			// ensure comparisons are still within start/end range of target sequence/assembly
 			if((TargSeqLeftIdx + ProbeLen) >= (INT64)m_pSfxBlock->ConcatSeqLen)
 				continue;
 
-			pEntry = MapChunkHit2Entry(SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx));
+			pEntry = MapChunkHit2Entry(CoreHit.Loci);
 			if(pEntry == NULL)
 				continue;
 			if(TargSeqLeftIdx < (INT64)pEntry->StartOfs || ((TargSeqLeftIdx +  ProbeLen) > (INT64)pEntry->EndOfs))
@@ -7369,9 +8220,7 @@ int IterCnt;					// count iterator for current segment target matches
 etSeqBase *pProbeBase;
 etSeqBase *pTargBase;
 char CurStrand;
-INT64 TargIdx;
-INT64 LastTargIdx;
-UINT32 NumCopies;
+tsCoreHitIter CoreHit;			// iterates exactly matching core hits
 
 UINT32 NumTargSeqProc;
 
@@ -7389,12 +8238,9 @@ int RsltRightInDel;
 int RsltLeftInDel;
 int BestScoreInstances;
 
-int Cmp;
 tsHitLoci *pCurHit;
 tsSfxEntry *pEntry;
 etSeqBase *pTarg;			// target sequence
-void *pSfxArray;			// target sequence suffix array
-INT64 SfxLen;				// number of suffixs in pSfxArray
 BisBase=eBaseN;
 
 // ensure suffix array block loaded for iteration!
@@ -7402,8 +8248,6 @@ if(m_pSfxBlock == NULL || m_pSfxBlock->ConcatSeqLen == 0)
 	return(eBSFerrInternal);
 
 pTarg = (etSeqBase *)&m_pSfxBlock->SeqSuffix[0];
-pSfxArray = (void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen];
-SfxLen = m_pSfxBlock->ConcatSeqLen;
 
 
 pCurHit = NULL;
@@ -7439,78 +8283,23 @@ do
 				CurCoreSegOfs = ProbeLen - CoreLen;
 				break;
 			}
-		TargIdx = LocateFirstExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,0,SfxLen-1);
-		if(TargIdx == 0)        // 0 if no core segment matches
+		if(!FirstCoreHit(&CoreHit,&pProbeSeq[CurCoreSegOfs],CoreLen))        // false if no core segment matches
 			continue;			// try for match on next core segment after shifting core to right
-		TargIdx -= 1;
 		IterCnt = 0;
-		NumCopies = 0;
-		bFirstIter = true;		// set false after the first subsequence core returned by LocateFirstExact has been processed
+		bFirstIter = true;		// set false after the first core hit returned by FirstCoreHit has been processed
 		while(!CurMaxIter || IterCnt < CurMaxIter)
 			{
-			if(!bFirstIter) {
-
-				// ensure not about to iterate past end of suffix array!
-				if((TargIdx + 1) >= (INT64)m_pSfxBlock->ConcatSeqLen || (SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1) + CoreLen) >  (INT64)m_pSfxBlock->ConcatSeqLen)
-					break;
-
-				if(IterCnt == 100 && !NumCopies)
-					{
-					// check how many more exact copies there are of the current probe subsequence, if too many then don't bother exploring these
-					LastTargIdx = LocateLastExact(&pProbeSeq[CurCoreSegOfs],CoreLen,pTarg,m_pSfxBlock->SfxElSize,pSfxArray,0,TargIdx-1,SfxLen-1);
-					NumCopies = LastTargIdx > 0 ? (UINT32)(1 + LastTargIdx - TargIdx) : 0;
-					if(CurMaxIter && NumCopies > (UINT32)CurMaxIter)		// only checking at the 100th iteration allows a little slack
-						break;										// try next core segment
-					}
-
-				// check that this new putative core is still matching
-				pTargBase = &pTarg[SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx+1)];
-				pProbeBase = &pProbeSeq[CurCoreSegOfs];
-				if(m_bBisulfite)
-					Cmp = BSCmpProbeTarg(pProbeBase,pTargBase,CoreLen);
-				else
-					{
-					int Ofs;
-					UINT8 El1;
-					UINT8 El2;
-					etSeqBase *pEl1= pProbeBase;
-					etSeqBase *pEl2 = pTargBase;
-					Cmp = 0;
-					for(Ofs=0; Ofs < CoreLen; Ofs++)
-						{
-						El2 = *pEl2++ & 0x0f;
-						if(El2 == eBaseEOS)
-							{
-							Cmp = -1;
-							break;
-							}
-						El1 = *pEl1++ & 0x0f;
-						if(El1 > El2)
-							{
-							Cmp = 1;
-							break;
-							}
-						if(El1 < El2)
-							{
-							Cmp = -1;
-							break;
-							}
-						}
-					}
-
-				if(Cmp != 0)				// will be non-zero if target no longer matches
-					break;					// try next core segment
-				TargIdx += 1;
-				}
+			if(!bFirstIter && !NextCoreHit(&CoreHit,IterCnt,CurMaxIter))
+				break;					// try next core segment
 
 			bFirstIter = false;
-			if(SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) < (UINT32)CurCoreSegOfs)
+			if(CoreHit.Loci < (UINT32)CurCoreSegOfs)
 				continue;
 
 			TargMatchLen = ProbeLen;
-			TargSeqLeftIdx = SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx) - CurCoreSegOfs;
+			TargSeqLeftIdx = CoreHit.Loci - CurCoreSegOfs;
 			ProbeSeqLeftIdx = 0;
-			pEntry = MapChunkHit2Entry(SfxOfsToLoci(m_pSfxBlock->SfxElSize,pSfxArray,TargIdx));
+			pEntry = MapChunkHit2Entry(CoreHit.Loci);
 			if(pEntry == NULL)
 				continue;
 			if(TargSeqLeftIdx < (INT64)pEntry->StartOfs || ((TargSeqLeftIdx +  ProbeLen - 1) > (INT64)pEntry->EndOfs))
@@ -7761,6 +8550,190 @@ return(0);
 
 
 
+// FreeSfxKMerIdx
+// Releases any suffix interval lookup table
+void
+CSfxArrayV3::FreeSfxKMerIdx(void)
+{
+if(m_pSfxKMerIdx != NULL)
+	{
+#ifdef _WIN32
+	free(m_pSfxKMerIdx);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
+#else
+	if(m_pSfxKMerIdx != MAP_FAILED)
+		munmap(m_pSfxKMerIdx,m_AllocSfxKMerIdxMem);
+#endif
+	m_pSfxKMerIdx = NULL;
+	}
+m_AllocSfxKMerIdxMem = 0;
+m_SfxKMerIdxLen = 0;
+m_SfxKMerIdxBlockID = 0;
+}
+
+int
+CSfxArrayV3::GetSfxKMerIdxLen(void)					// returns K-mer length of suffix interval lookup table, 0 if no table
+{
+return(m_pSfxKMerIdx == NULL ? 0 : m_SfxKMerIdxLen);
+}
+
+// GenSfxKMerIdx
+// Generates a lookup table, indexed by K-mer, of the suffix array interval containing all suffixes prefixed by that K-mer
+// LocateFirstExact() and LocateLastExact() then start their binary searches within this interval instead of over the full suffix array,
+// replacing the first 2*K or so search iterations, each likely to be a cache miss into both suffix array and sequence, by a single table lookup
+// Table elements are sized as suffix array elements, the K-mer length is reduced from MaxKMerLen so that the table is no larger than about 1/4 of the suffix array
+// Suffixes containing a non-canonical base within their first K bases sort after all canonical continuations of the preceding prefix and
+// so are bucketed with the last K-mer having that prefix, intervals may therefore contain a few suffixes not prefixed by the K-mer
+// which are simply excluded by the subsequent binary searches
+// If the suffix array was not sorted over at least K bases then the lookup table is not generated and 0 returned
+int										// K-mer length used, 0 if no table generated, < 0 if errors
+CSfxArrayV3::GenSfxKMerIdx(int MaxKMerLen)	// generate suffix interval lookup table for K-mers of at most this length
+{
+int KMerLen;
+int SfxElSize;
+int Ofs;
+INT64 NumSfxEls;
+INT64 NumKMers;
+INT64 SfxIdx;
+INT64 Loci;
+INT64 KMerIdx;
+INT64 PrevKMerIdx;
+INT64 NxtKMerIdx;
+UINT8 *pIdx;
+UINT8 Base;
+etSeqBase *pTarg;
+etSeqBase *pBase;
+void *pSfxArray;
+
+FreeSfxKMerIdx();
+if(MaxKMerLen == 0)
+	return(0);
+if(m_pSfxBlock == NULL || m_bBisulfite || MaxKMerLen < cMinSfxKMerIdxLen || MaxKMerLen > cMaxSfxKMerIdxLen)
+	return(eBSFerrParams);
+
+NumSfxEls = NumSfxArrayEls(m_pSfxBlock);
+for(KMerLen = MaxKMerLen; KMerLen >= cMinSfxKMerIdxLen; KMerLen--)
+	if(((INT64)1 << (2 * KMerLen)) <= NumSfxEls / 4)
+		break;
+if(KMerLen < cMinSfxKMerIdxLen)		// suffix array too small to be worth the effort
+	return(0);
+
+SfxElSize = m_pSfxBlock->SfxElSize;
+NumKMers = (INT64)1 << (2 * KMerLen);
+m_AllocSfxKMerIdxMem = (size_t)((NumKMers + 1) * SfxElSize);
+#ifdef _WIN32
+m_pSfxKMerIdx = (UINT8 *) malloc(m_AllocSfxKMerIdxMem);
+if(m_pSfxKMerIdx == NULL)
+	{
+	AddErrMsg("CSfxArrayV3::GenSfxKMerIdx","Unable to allocate %lld bytes for suffix interval lookup table",(INT64)m_AllocSfxKMerIdxMem);
+	m_AllocSfxKMerIdxMem = 0;
+	return(eBSFerrMem);
+	}
+#else
+m_pSfxKMerIdx = (UINT8 *)mmap(NULL,m_AllocSfxKMerIdxMem, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, -1,0);
+if(m_pSfxKMerIdx == MAP_FAILED)
+	{
+	AddErrMsg("CSfxArrayV3::GenSfxKMerIdx","Unable to allocate %lld bytes for suffix interval lookup table",(INT64)m_AllocSfxKMerIdxMem);
+	m_pSfxKMerIdx = NULL;
+	m_AllocSfxKMerIdxMem = 0;
+	return(eBSFerrMem);
+	}
+#endif
+
+pTarg = (etSeqBase *)&m_pSfxBlock->SeqSuffix[0];
+pSfxArray = (void *)&m_pSfxBlock->SeqSuffix[m_pSfxBlock->ConcatSeqLen];
+
+// suffixes are iterated in sorted order, each K-mer entry is set to the index of the first suffix having a prefix >= that K-mer
+PrevKMerIdx = -1;
+NxtKMerIdx = 0;
+for(SfxIdx = 0; SfxIdx < NumSfxEls; SfxIdx++)
+	{
+	Loci = SfxOfsToLoci(SfxElSize,pSfxArray,SfxIdx);
+	pBase = &pTarg[Loci];
+	KMerIdx = 0;
+	for(Ofs = 0; Ofs < KMerLen; Ofs++,pBase++)
+		{
+		if((Loci + Ofs) >= (INT64)m_pSfxBlock->ConcatSeqLen || (Base = (*pBase & 0x0f)) > eBaseT)
+			{
+			// non-canonical, suffix sorts after all K-mers sharing the canonical prefix
+			KMerIdx = ((KMerIdx + 1) << (2 * (KMerLen - Ofs))) - 1;
+			break;
+			}
+		KMerIdx = (KMerIdx << 2) | Base;
+		}
+	if(KMerIdx < PrevKMerIdx)			// suffixes not sorted over at least KMerLen bases, lookup table can't be used
+		{
+		FreeSfxKMerIdx();
+		return(0);
+		}
+	PrevKMerIdx = KMerIdx;
+	for(; NxtKMerIdx <= KMerIdx; NxtKMerIdx++)
+		{
+		pIdx = &m_pSfxKMerIdx[NxtKMerIdx * SfxElSize];
+		*(UINT32 *)pIdx = (UINT32)SfxIdx;
+		if(SfxElSize == 5)
+			pIdx[4] = (UINT8)(SfxIdx >> 32);
+		}
+	}
+for(; NxtKMerIdx <= NumKMers; NxtKMerIdx++)
+	{
+	pIdx = &m_pSfxKMerIdx[NxtKMerIdx * SfxElSize];
+	*(UINT32 *)pIdx = (UINT32)NumSfxEls;
+	if(SfxElSize == 5)
+		pIdx[4] = (UINT8)(NumSfxEls >> 32);
+	}
+
+m_SfxKMerIdxLen = KMerLen;
+m_SfxKMerIdxBlockID = m_pSfxBlock->BlockID;
+return(KMerLen);
+}
+
+// SfxKMerIdxRange
+// If a suffix interval lookup table is available then narrows SfxLo and SfxHi to be within the interval containing all suffixes prefixed by pProbe
+// Probes shorter than the table K-mer length use the interval spanning all K-mers which they prefix
+// Returns false if no match is possible within the narrowed range
+bool
+CSfxArrayV3::SfxKMerIdxRange(etSeqBase *pProbe,		// narrows suffix index range to that containing suffixes prefixed by this probe
+				  int ProbeLen,					// probe length
+				  INT64 *pSfxLo,				// low index in suffix array, updated with narrowed low index
+				  INT64 *pSfxHi)				// high index in suffix array, updated with narrowed high index
+{
+int Ofs;
+int PrefixLen;
+int SfxElSize;
+UINT8 Base;
+INT64 KMerLo;
+INT64 KMerHi;
+INT64 IdxLo;
+INT64 IdxHi;
+
+if(m_pSfxKMerIdx == NULL || m_bBisulfite || m_pSfxBlock == NULL || m_pSfxBlock->BlockID != m_SfxKMerIdxBlockID)
+	return(true);
+
+PrefixLen = min(ProbeLen,m_SfxKMerIdxLen);
+KMerLo = 0;
+for(Ofs = 0; Ofs < PrefixLen; Ofs++)
+	{
+	if((Base = (pProbe[Ofs] & 0x0f)) > eBaseT)
+		break;
+	KMerLo = (KMerLo << 2) | Base;
+	}
+if(Ofs == 0)					// can only narrow on a canonical prefix
+	return(true);
+KMerHi = (KMerLo + 1) << (2 * (m_SfxKMerIdxLen - Ofs));
+KMerLo <<= 2 * (m_SfxKMerIdxLen - Ofs);
+
+SfxElSize = m_pSfxBlock->SfxElSize;
+IdxLo = SfxOfsToLoci(SfxElSize,m_pSfxKMerIdx,KMerLo);
+IdxHi = SfxOfsToLoci(SfxElSize,m_pSfxKMerIdx,KMerHi) - 1;
+if(Ofs < PrefixLen)				// probe contains non-canonical base, could only be matching suffixes bucketed with the last K-mer having the canonical prefix
+	IdxLo = SfxOfsToLoci(SfxElSize,m_pSfxKMerIdx,KMerHi - 1);
+if(IdxLo > *pSfxLo)
+	*pSfxLo = IdxLo;
+if(IdxHi < *pSfxHi)
+	*pSfxHi = IdxHi;
+return(*pSfxHi >= *pSfxLo);
+}
+
 INT64			// index+1 in pSfxArray of first exactly matching probe or 0 if no match
 CSfxArrayV3::LocateFirstExact(etSeqBase *pProbe,  // pts to probe sequence
 				  int ProbeLen,					// probe length to exactly match over
@@ -7773,13 +8746,13 @@ CSfxArrayV3::LocateFirstExact(etSeqBase *pProbe,  // pts to probe sequence
 {
 etSeqBase *pEl1;
 etSeqBase *pEl2;
-UINT8 El1;
-UINT8 El2;
 
 int CmpRslt;
-int Ofs;
 INT64 Mark;
 INT64 TargPsn;
+
+if(TargStart == 0 && pTarg == (etSeqBase *)&m_pSfxBlock->SeqSuffix[0] && !SfxKMerIdxRange(pProbe,ProbeLen,&SfxLo,&SfxHi))
+	return(0);
 do {
 	pEl1 = pProbe;
 	TargPsn = ((INT64)SfxLo + SfxHi) / 2L;
@@ -7787,29 +8760,7 @@ do {
 	if(m_bBisulfite)
 		CmpRslt = BSCmpProbeTarg(pEl1,pEl2,ProbeLen);
 	else
-		{
-		CmpRslt = 0;
-		for(Ofs=0; Ofs < ProbeLen; Ofs++)
-			{
-			El2 = *pEl2++ & 0x0f;
-			if(El2 == eBaseEOS)
-				{
-				CmpRslt = -1;
-				break;
-				}
-			El1 = *pEl1++ & 0x0f;
-			if(El1 > El2)
-				{
-				CmpRslt = 1;
-				break;
-				}
-			if(El1 < El2)
-				{
-				CmpRslt = -1;
-				break;
-				}
-			}
-		}
+		CmpRslt = CmpProbeTarg(pProbe,pEl2,ProbeLen);
 
 	if(!CmpRslt)	// if a match then may not be the lowest indexed match
 		{
@@ -7829,30 +8780,7 @@ do {
 			if(m_bBisulfite)
 				CmpRslt = BSCmpProbeTarg(pEl1,pEl2,ProbeLen);
 			else
-				{
-				pEl1 = pProbe;
-				CmpRslt = 0;
-				for(Ofs=0; Ofs < ProbeLen; Ofs++)
-					{
-					El2 = *pEl2++ & 0x0f;
-					if(El2 == eBaseEOS)
-						{
-						CmpRslt = -1;
-						break;
-						}
-					El1 = *pEl1++ & 0x0f;
-					if(El1 > El2)
-						{
-						CmpRslt = 1;
-						break;
-						}
-					if(El1 < El2)
-						{
-						CmpRslt = -1;
-						break;
-						}
-					}
-				}
+				CmpRslt = CmpProbeTarg(pProbe,pEl2,ProbeLen);
 			if(CmpRslt == 0)				// 0 if still matching
 				continue;
 			SfxLo = TargPsn + 1;
@@ -7922,15 +8850,17 @@ CSfxArrayV3::LocateLastExact(etSeqBase *pProbe, // pts to probe sequence
 {
 etSeqBase *pEl1;
 etSeqBase *pEl2;
-UINT8 El1;
-UINT8 El2;
 
 int CmpRslt;
-int Ofs;
 INT64 Mark;
 INT64 TargPsn;
-INT64 SfxHiMax = SfxHi;
-INT64 SfxLoMax = SfxLo;
+INT64 SfxHiMax;
+INT64 SfxLoMax;
+
+if(TargStart == 0 && pTarg == (etSeqBase *)&m_pSfxBlock->SeqSuffix[0] && !SfxKMerIdxRange(pProbe,ProbeLen,&SfxLo,&SfxHi))
+	return(0);
+SfxHiMax = SfxHi;
+SfxLoMax = SfxLo;
 do {
 	pEl1 = pProbe;
 	TargPsn = ((INT64)SfxLo + SfxHi) / 2L;
@@ -7938,29 +8868,7 @@ do {
 	if(m_bBisulfite)
 		CmpRslt = BSCmpProbeTarg(pEl1,pEl2,ProbeLen);
 	else
-		{
-		CmpRslt = 0;
-		for(Ofs=0; Ofs < ProbeLen; Ofs++)
-			{
-			El2 = *pEl2++ & 0x0f;
-			if(El2 == eBaseEOS)
-				{
-				CmpRslt = -1;
-				break;
-				}
-			El1 = *pEl1++ & 0x0f;
-			if(El1 > El2)
-				{
-				CmpRslt = 1;
-				break;
-				}
-			if(El1 < El2)
-				{
-				CmpRslt = -1;
-				break;
-				}
-			}
-		}
+		CmpRslt = CmpProbeTarg(pProbe,pEl2,ProbeLen);
 
 	if(!CmpRslt)	// if a match then may not be the highest indexed match
 		{
@@ -7980,30 +8888,7 @@ do {
 			if(m_bBisulfite)
 				CmpRslt = BSCmpProbeTarg(pEl1,pEl2,ProbeLen);
 			else
-				{
-				pEl1 = pProbe;
-				CmpRslt = 0;
-				for(Ofs=0; Ofs < ProbeLen; Ofs++)
-					{
-					El2 = *pEl2++ & 0x0f;
-					if(El2 == eBaseEOS)
-						{
-						CmpRslt = -1;
-						break;
-						}
-					El1 = *pEl1++ & 0x0f;
-					if(El1 > El2)
-						{
-						CmpRslt = 1;
-						break;
-						}
-					if(El1 < El2)
-						{
-						CmpRslt = -1;
-						break;
-						}
-					}
-				}
+				CmpRslt = CmpProbeTarg(pProbe,pEl2,ProbeLen);
 			if(CmpRslt == 0)				// 0 if still matching
 				continue;
 			SfxHi = TargPsn - 1;
@@ -8393,6 +9278,11 @@ if((EndPutTargLoci - StartPutTargLoci) >= 1000)		// if a relatively large insert
 	}
 else  // else if relatively small maximum insert size ( < 1000bp ) as is likely with WGS DNA then quicker to do a linear scan for target loci against which the read can be matched
 	{
+	// scanning is directly against the targeted chrom sequence so putative loci must be constrained to be fully contained within that chrom
+	if((pPutChromSeq = GetPtrSeq(ChromID,0))==NULL || TargSeqLen < (UINT32)ReadLen)
+		return(0);
+	if((EndPutTargLoci + (UINT32)ReadLen) > TargSeqLen)
+		EndPutTargLoci = TargSeqLen - (UINT32)ReadLen;
 	for(PutHitLoci = StartPutTargLoci; PutHitLoci <= EndPutTargLoci; PutHitLoci++)
 		{
 		Rslt = AdaptiveTrim(ReadLen, ReadSeq, &pPutChromSeq[PutHitLoci], MinPutLen, MaxAllowedMM, 3, &TrimSeqLen, &Trim5Flank, &Trim3Flank, &MaxChimericMMs);
@@ -9483,6 +10373,88 @@ switch(SfxElSize) {
 return(0);
 }
 
+// SAISSortSeq
+// Constructs the suffix array over the concatenated sequences in linear time using induced sorting (SA-IS)
+// Suffixes are fully ordered on the low nibble of each base, this is a refinement of the ordering generated by QSortSeq() which
+// only compares suffixes for at most gMaxBaseCmpLen bases, so either can be used interchangeably when subsequently searching the index
+// Returns -2 if unable to allocate working memory, caller can then fallback to QSortSeq()
+int
+CSfxArrayV3::SAISSortSeq(INT64 SeqLen,		// total concatenated sequence length
+						etSeqBase *pSeq,	// pts to start of concatenated sequences
+						int SfxElSize,		// suffix element size (will be either 4 or 5)
+						void *pArray)		// allocated to hold suffix elements
+{
+CSAIS SAIS;
+INT64 *pSA64;
+UINT8 *pIdx;
+size_t AllocSA64Mem;
+UINT64 AvailMem;
+INT64 Idx;
+int Rslt;
+
+if(SfxElSize != 4 && SfxElSize != 5)
+	return(-1);
+if(SeqLen <= 0)
+	return(0);
+
+// if 4 byte elements and less than 2G suffixes then can directly induce the suffix array inplace
+if(SfxElSize == 4 && SeqLen < (INT64)0x07fffffff)
+	{
+	if((Rslt = SAIS.sais_nibble(pSeq,(INT32 *)pArray,(INT32)SeqLen)) != 0)
+		{
+		gDiagnostics.DiagOut(eDLWarn,gszProcName,"SAISSortSeq: induced sorting failed (%d), will use qsort",Rslt);
+		return(-2);
+		}
+	return(0);
+	}
+
+// requiring a 64bit working suffix array which after inducing is packed down into the 4 or 5 byte suffix elements
+// with overcommitted memory the allocation could succeed and the process subsequently be OOM killed whilst inducing, so check
+// up front that the working array plus a margin is physically available and if not then fallback to qsort which sorts inplace
+AllocSA64Mem = (size_t)SeqLen * sizeof(INT64);
+AvailMem = CUtility::AvailPhysMem();
+if(AvailMem != 0 && ((UINT64)AllocSA64Mem + (UINT64)AllocSA64Mem/cSAISMemMarginDiv) > AvailMem)
+	{
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"SAISSortSeq: induced sorting requires %llu bytes but only %llu bytes available, will use qsort",(UINT64)AllocSA64Mem,AvailMem);
+	return(-2);
+	}
+#ifdef _WIN32
+pSA64 = (INT64 *) malloc(AllocSA64Mem);
+#else
+// gnu malloc is still in the 32bit world and seems to have issues if more than 2GB allocation
+// pages are populated at allocation so that any shortfall is detected now rather than whilst inducing
+pSA64 = (INT64 *)mmap(NULL,AllocSA64Mem, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1,0);
+if(pSA64 == MAP_FAILED)
+	pSA64 = NULL;
+#endif
+if(pSA64 == NULL)
+	{
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"SAISSortSeq: unable to allocate %llu bytes for induced sorting, will use qsort",(UINT64)AllocSA64Mem);
+	return(-2);
+	}
+
+if((Rslt = SAIS.sais_nibble(pSeq,pSA64,SeqLen)) == 0)
+	{
+	pIdx = (UINT8 *)pArray;
+	for(Idx = 0; Idx < SeqLen; Idx++)
+		{
+		*(UINT32 *)pIdx = (UINT32)(pSA64[Idx] & 0x0ffffffff);
+		pIdx += 4;
+		if(SfxElSize == 5)
+			*pIdx++ = (UINT8)((pSA64[Idx] >> 32) & 0x00ff);
+		}
+	}
+else
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"SAISSortSeq: induced sorting failed (%d), will use qsort",Rslt);
+
+#ifdef _WIN32
+free(pSA64);
+#else
+munmap(pSA64,AllocSA64Mem);
+#endif
+return(Rslt == 0 ? 0 : -2);
+}
+
 // QSortSeqCmp32
 // qsorts suffix elements whereby each element occupies 32bits, 4 bytes, and is an offset into gpSeq[]
 static int QSortSeqCmp32(const void *p1,const void *p2)
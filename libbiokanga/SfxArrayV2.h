@@ -2,7 +2,8 @@
 #include "./commdefs.h"
 
 // new release
-const int cSFXVersion = 5;				// current file structure version
+const int cSFXVersion = 6;				// current file structure version
+const int cSFXVersionUnpacked = 5;		// file structure version written if concatenated sequences are not 2bit packed, readable by earlier releases
 const int cSFXVersionBack = 3;			// can handle previous file structures back to this version
 
 const int cSigWaitSecs = 5;				// background readahead thread wakes every cSigWaitSecs sec just in case a signalling event missed
@@ -11,6 +12,17 @@ const int cSigTermWaitSecs = 2;			// background readahead thread is allowed at m
 
 const int cDfltMaxIter = 50000;			// default max iterations per subsegmented sequence when matching that subsegment
 const int cMaxKmerLen = 18;				// limit on length of KMers which can be frequency counted when checking for over-occurrences
+const int cSAISMemMarginDiv = 8;		// induced sorting with a 64bit working array requires that array plus 1/cSAISMemMarginDiv margin to be physically available
+
+const int cMinSfxKMerIdxLen = 6;		// suffix interval lookup tables are indexed by K-mers of at least this length
+const int cMaxSfxKMerIdxLen = 14;		// and at most this length
+const int cDfltSfxKMerIdxLen = 12;		// default maximum K-mer length for suffix interval lookup tables
+
+const UINT32 cMaxSfxSeqRunLen = 0xffffffff;	// packed sequence runs are limited to this many bases, longer runs are split
+const size_t cSfxUnpackBuffSize = 0x0ffffff;	// packed bases are read and unpacked in chunks of this size
+
+const int cMaxSfxSampleStep = 16;		// sampled suffix arrays contain at least every 16th suffix
+const UINT32 cSfxSampleAttrShf = 8;		// sampling step is held in header Attributes bits 8..15, 0 if all suffixes present
 
 const int cMaxNumIdentNodes = 1024000;	// allow at most this many TargSeqIDs to be hash linked per thread
 const int cHashEntries = 0x03fff;		// TargSeqID start loci are hashed into this many entries
@@ -73,8 +85,33 @@ typedef enum etHRslt {
 	eHRRMMDelta						    // same but with a reduced MMDelta differential
 } tHRslt;
 
+// how an existing suffix file is to be loaded for subsequent searches
+typedef enum TAG_eSfxLoadMode {
+	eSfxLoadPrivate = 0,				// default is to read suffix block into a private memory allocation using a background readahead thread
+	eSfxLoadMapShared,					// map suffix block read only and shared so concurrent processes share the same physical pages
+	eSfxLoadMapPopulate,				// as eSfxLoadMapShared but pages are prefaulted into memory when mapped
+	eSfxLoadPlaceholder					// used to set the enumeration range
+} teSfxLoadMode;
+
 #pragma pack(1)
 
+// V6 files with Attributes bit 2 set contain the concatenated sequences 2bit packed
+// On disk the suffix block is then tsSfxBlock (excluding SeqSuffix), tsSfxPackedSeqHdr, the packed bases, the non-canonical base runs,
+// the repeat masked runs, and finally the suffix array elements. Sequences are unpacked into a tsSfxBlock when loaded, packing only
+// reduces the index file size and load I/O, and as the unpacked sequences are private such files can't be mapped with eSfxLoadMapShared or eSfxLoadMapPopulate.
+typedef struct TAG_sSfxPackedSeqHdr {
+	UINT64 PackedSeqSize;				// number of bytes holding the 2bit packed bases, 4 bases per byte with 1st base in bits 0..1
+	UINT64 NumExcepts;					// number of tsSfxSeqRun runs of non-canonical bases (eBaseN, eBaseEOS etc) which follow the packed bases
+	UINT64 NumMasked;					// number of tsSfxSeqRun runs of repeat masked (cRptMskFlg) bases which follow the non-canonical runs
+	UINT64 SfxElsOfs;					// suffix array elements start at this offset from the suffix block
+	} tsSfxPackedSeqHdr;
+
+typedef struct TAG_sSfxSeqRun {
+	UINT64 Ofs;							// run starts at this offset into concatenated sequences
+	UINT32 Len;							// run is this many bases, at most cMaxSfxSeqRunLen
+	UINT8 Val;							// non-canonical base value (excluding cRptMskFlg) for this run, cRptMskFlg if a repeat masked run
+	} tsSfxSeqRun;
+
 // each entry for sequences is described by the following fixed size structure
 typedef struct TAG_sSfxEntry {
 	UINT32 EntryID;						// identifies each entry (1..n), unique within this suffix file
@@ -144,6 +181,17 @@ typedef struct TAG_sQueryAlignNodes {
 	UINT32 HiScorePathNextIdx;							// if > 0 then idex-1 of next node on currently highest scoring path; 0 if no other nodes on path
 } tsQueryAlignNodes;
 
+// iterates the target loci of exact matches to a probe core, locating cores by their suffixes if the suffix array is sampled
+typedef struct TAG_sCoreHitIter {
+	etSeqBase *pCore;					// core being located
+	int CoreLen;						// core length
+	int SampleOfs;						// offset in core of the suffix currently being matched, always 0 if all suffixes present
+	bool bIntervalStart;				// true if SfxIdx is the first suffix in a newly located interval and yet to be checked
+	INT64 SfxIdx;						// current suffix array index
+	INT64 Loci;							// target loci at which the current exactly matching core starts
+	UINT32 NumCopies;					// estimated number of exact copies of the core, 0 if not yet estimated
+	} tsCoreHitIter;
+
 typedef struct TAG_sQualTarg {
 	UINT32 TargEntryID;		// identifies sequence
 	UINT8  Hits;			// against which there are this many hits (clamped to be at most 255)
@@ -302,6 +350,11 @@ class CSfxArrayV3 : public CErrorCodes, protected CEndian
 	bool m_bInMemSfx;							// true if in-memory suffix processing only - no file I/O
 	int m_hFile;							    // opened/created file handle
 	bool m_bV3File;								// suffix file opened was a V3 file
+	bool m_bPackSeqReq;							// if true then concatenated sequences are to be written 2bit packed when creating a suffix file
+	bool m_bPackedSeq;							// TRUE if concatenated sequences in opened/created suffix file are 2bit packed
+	int m_SfxSampleReq;							// suffix array to be sampled at this step when creating a suffix file
+	int m_SfxSampleStep;						// suffix array in opened/created suffix file contains only suffixes starting at multiples of this step (1 if all suffixes)
+	bool m_bAcceptSampled;						// if true then suffix files with sampled suffix arrays can be opened
 	char m_szFile[_MAX_PATH+1];				    // file name as opened/created
 	bool m_bHdrDirty;							// TRUE if header has been updated and should be written to disk
 	bool m_bCreate;								// TRUE if file opened in create mode
@@ -323,6 +376,7 @@ class CSfxArrayV3 : public CErrorCodes, protected CEndian
 
 	int m_MaxQSortThreads;						// max number of threads to use when sorting
 	CMTqsort m_MTqsort;							// multithreaded qsort
+	bool m_bSAISSort;							// true if suffix array to be constructed using linear time induced sorting (SA-IS), false if multithreaded qsort
 
 	UINT32 m_MaxKMerOccs;						// if there are more than MaxKMerOccs instances of a Kmer then these will be classified as an over-occurance
 	size_t m_AllocOccKMerClasMem;				// allocation memory size for m_pOccKMerClas 
@@ -359,6 +413,14 @@ static	void *ThreadedPrereadBlocks(void * pThreadPars);
 	tsSfxEntriesBlock *m_pEntriesBlock;			// loaded entries block
 	tsSfxBlock *m_pSfxBlock;					// loaded suffix block
 	UINT64 m_AllocSfxBlockMem;					// memory allocation size for loaded suffix blocks
+	teSfxLoadMode m_SfxLoadMode;				// how suffix blocks are to be loaded from an existing suffix file
+	bool m_bNUMAInterleave;						// if true then pages of suffix blocks loaded into private memory are interleaved over all NUMA nodes
+	UINT8 *m_pSfxMapBase;						// if suffix block was mapped from file then the page aligned mapping base
+	size_t m_SfxMapLen;							// and length of that mapping
+	int m_SfxKMerIdxLen;						// K-mer length indexing suffix interval lookup table, 0 if no table
+	int m_SfxKMerIdxBlockID;					// suffix interval lookup table was generated for this suffix block
+	UINT8 *m_pSfxKMerIdx;						// suffix interval lookup table, (4^m_SfxKMerIdxLen)+1 suffix array indexes sized as suffix elements
+	size_t m_AllocSfxKMerIdxMem;				// memory allocation size for suffix interval lookup table
 	UINT64 m_AllocEntriesBlockMem;				// memory allocation size for loaded entry block
 	UINT64 m_AllocBisulfiteMem;					// memory allocation size for loaded bisulfite
     UINT8 *m_pBisulfateBases;					// used whilst constructing sfx array if bisulfite processing
@@ -373,6 +435,27 @@ static	void *ThreadedPrereadBlocks(void * pThreadPars);
 	teBSFrsltCodes Entries2Disk(void);			// writes entries to file
 	teBSFrsltCodes SfxBlock2Disk(void);			// writes sfx block to file
 	teBSFrsltCodes Disk2SfxBlock(int BlockID);	// loads specified sfx block from file
+	teBSFrsltCodes MapSfxBlock(void);			// maps suffix block read only and shared directly from opened file
+	teBSFrsltCodes PackedSeq2Disk(void);		// writes concatenated sequences 2bit packed to file
+	teBSFrsltCodes Disk2PackedSeqHdr(tsSfxBlock *pSfxBlockHdr,tsSfxPackedSeqHdr *pPackedHdr); // reads and validates the headers of a suffix block containing 2bit packed sequences
+	teBSFrsltCodes Disk2PackedSeq(tsSfxBlock *pSfxBlock);	// loads and unpacks 2bit packed concatenated sequences, followed by the suffix array, from file
+	void FreeSfxKMerIdx(void);					// releases any suffix interval lookup table
+	bool SfxKMerIdxRange(etSeqBase *pProbe,		// narrows suffix index range to that containing suffixes prefixed by this probe
+				  int ProbeLen,					// probe length
+				  INT64 *pSfxLo,				// low index in suffix array, updated with narrowed low index
+				  INT64 *pSfxHi);				// high index in suffix array, updated with narrowed high index
+
+	INT64 NumSfxArrayEls(tsSfxBlock *pSfxBlock);	// returns number of elements in suffix array of pSfxBlock allowing for any sampling
+	void SampleSfxArray(void);					// retains only those suffixes starting at multiples of m_SfxSampleStep in the sorted suffix array
+	bool StartCoreSfx(tsCoreHitIter *pIter);	// locates first suffix exactly matching core suffix starting at pIter->SampleOfs
+	bool NextCoreSfx(tsCoreHitIter *pIter);		// advances to next suffix if still exactly matching core suffix starting at pIter->SampleOfs
+	bool CoreHitLoci(tsCoreHitIter *pIter);		// sets loci of core hit for current suffix, false if any sampled core prefix not matching
+	bool FirstCoreHit(tsCoreHitIter *pIter,		// locates first target loci exactly matching core
+					etSeqBase *pCore,			// core to locate
+					int CoreLen);				// core length
+	bool NextCoreHit(tsCoreHitIter *pIter,		// locates next target loci exactly matching core, false if no more or too many copies
+					int IterCnt,				// number of hits processed by caller thus far
+					int CurMaxIter);			// if > 0 then max allowed iterations
 
 	teBSFrsltCodes Flush2Disk(void);			// flush and commit to disk
 
@@ -398,6 +481,7 @@ static	void *ThreadedPrereadBlocks(void * pThreadPars);
 					etSeqBase *pSeq);	// pSeq to process for count of non-canonical
 
 	int CmpProbeTarg(etSeqBase *pEl1,etSeqBase *pEl2,int Len);
+	int CountMismatches(etSeqBase *pProbe,etSeqBase *pTarg,int Len,int MaxMM); // mismatch count, or > MaxMM if more than MaxMM mismatches or target contains eBaseEOS
 	int BSCmpProbeTarg(etSeqBase *pEl1,etSeqBase *pEl2,int Len);
 
 	int											// length of exact match
@@ -975,6 +1059,22 @@ public:
 						void *pArray);		// allocated to hold suffix elements
 	void SetMaxQSortThreads(int MaxThreads);			// sets maximum number of threads to use in multithreaded qsorts
 
+	int	SAISSortSeq(INT64 SeqLen,		// total concatenated sequence length
+						etSeqBase *pSeq,	// pts to start of concatenated sequences
+						int SfxElSize,		// suffix element size (will be either 4 or 5)
+						void *pArray);		// allocated to hold suffix elements
+	void SetSAISSort(bool bSAISSort = true);	// if true (default) then suffix arrays are constructed using linear time induced sorting, otherwise multithreaded qsort is used
+	void SetLoadMode(teSfxLoadMode LoadMode = eSfxLoadPrivate); // sets how suffix blocks are to be loaded by subsequent Open() of an existing suffix file
+	bool IsMapped(void);						// returns true if currently loaded suffix block is a read only file mapping
+	void SetNUMAInterleave(bool bInterleave = true); // if true then suffix block pages loaded into private memory by subsequent Open() are interleaved over all NUMA nodes
+	void SetPackedSeq(bool bPackedSeq = true);	// if true then subsequently created suffix files will contain the concatenated sequences 2bit packed
+	bool IsPackedSeq(void);						// returns true if opened suffix file contains 2bit packed concatenated sequences
+	void SetSfxSampleStep(int SampleStep = 1);	// subsequently created suffix files will contain only suffixes starting at multiples of SampleStep (1..cMaxSfxSampleStep)
+	int GetSfxSampleStep(void);					// returns suffix array sampling step of opened suffix file, 1 if all suffixes present
+	void AcceptSampledSfx(bool bAccept = true);	// if true then suffix files with sampled suffix arrays can be opened, only aligning with AlignReads() and LocateBestMatches() supports these
+	int GenSfxKMerIdx(int MaxKMerLen = cDfltSfxKMerIdxLen); // generates suffix interval lookup table for currently loaded suffix block, returns K-mer length used (0 if no table) or < 0 if errors
+	int GetSfxKMerIdxLen(void);					// returns K-mer length of suffix interval lookup table, 0 if no table
+
 	int						// returns the previously utilised MaxBaseCmpLen
 		SetMaxBaseCmpLen(int MaxBaseCmpLen);		// sets maximum number of bases which need to be compared for equality in multithreaded qsorts, will be clamped to be in range 10..(5*cMaxReadLen)
 
@@ -308,7 +308,7 @@ Written = 0;
 while(Written >= 0 && Max2Write > 0)
 	{
 	BuffLen = (int)min(Max2Write,(size_t)(cgzAllocOutBuffer * 9) / 10);			// limit writes to max of 90% cgzAllocOutBuffer bytes at a time
-	Written = gzwrite(pgzFile,pBuff,BuffLen);
+	Written = gzwrite(pgzFile,pByte,BuffLen);
 	if(Written <= 0)
 		{
 		printf("SafeWrite_gz: gzwrite %d bytes failed",BuffLen);
@@ -1063,3 +1063,38 @@ CUtility::SleepMillisecs(UINT32 milliseconds) // cross-platform sleep function
 #endif
 }
 
+// AvailPhysMem
+// Returns physical memory, in bytes, currently available for allocation without paging, 0 if unable to determine
+// On Linux allocations are overcommitted so allocation success does not imply memory is available, callers with very large
+// transient working arrays can check against this before committing to an algorithm which would otherwise be OOM killed
+UINT64
+CUtility::AvailPhysMem(void)
+{
+#ifdef WIN32
+MEMORYSTATUSEX MemStatus;
+MemStatus.dwLength = sizeof(MemStatus);
+if(!GlobalMemoryStatusEx(&MemStatus))
+	return(0);
+return((UINT64)MemStatus.ullAvailPhys);
+#else
+FILE *pMemInfo;
+char szLine[200];
+UINT64 MemKB;
+UINT64 AvailMem;
+AvailMem = 0;
+if((pMemInfo = fopen("/proc/meminfo","r")) != NULL)	// MemAvailable includes reclaimable page cache
+	{
+	while(fgets(szLine,sizeof(szLine),pMemInfo) != NULL)
+		if(sscanf(szLine,"MemAvailable: %llu kB",&MemKB) == 1)
+			{
+			AvailMem = MemKB * 1024;
+			break;
+			}
+	fclose(pMemInfo);
+	}
+if(AvailMem == 0)
+	AvailMem = (UINT64)sysconf(_SC_AVPHYS_PAGES) * (UINT64)sysconf(_SC_PAGESIZE);
+return(AvailMem);
+#endif
+}
+
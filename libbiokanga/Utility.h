@@ -108,5 +108,7 @@ public:
 
 	static void SleepMillisecs(UINT32 milliseconds); // cross-platform sleep function
 
+	static UINT64 AvailPhysMem(void);		// returns physical memory, in bytes, currently available for allocation without paging; 0 if unable to determine
+
 
 };
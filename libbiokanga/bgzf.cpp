@@ -234,34 +234,39 @@ fp->block_offset = 0;
 return comp_size;
 }
 
-// Inflate the block in fp->compressed_block into fp->uncompressed_block
-static size_t inflate_block(BGZF* fp, int block_length)
+static int bgzf_uncompress(void *dst, int *dlen, void *src, int slen)
 {
 z_stream zs;
 zs.zalloc = NULL;
 zs.zfree = NULL;
-zs.next_in = (Bytef *)fp->compressed_block + 18;
-zs.avail_in = block_length - 16;
-zs.next_out = (Bytef *)fp->uncompressed_block;
-zs.avail_out = BGZF_MAX_BLOCK_SIZE;
+zs.next_in = (Bytef *)src + 18;
+zs.avail_in = slen - 16;
+zs.next_out = (Bytef *)dst;
+zs.avail_out = *dlen;
 
 if (inflateInit2(&zs, -15) != Z_OK) 
-	{
-	fp->errcode |= BGZF_ERR_ZLIB;
 	return -1;
-	}
 if (inflate(&zs, Z_FINISH) != Z_STREAM_END) 
 	{
 	inflateEnd(&zs);
-	fp->errcode |= BGZF_ERR_ZLIB;
 	return -1;
 	}
 if (inflateEnd(&zs) != Z_OK) 
+	return -1;
+*dlen = zs.total_out;
+return 0;
+}
+
+// Inflate the block in fp->compressed_block into fp->uncompressed_block
+static size_t inflate_block(BGZF* fp, int block_length)
+{
+int uncomp_size = BGZF_MAX_BLOCK_SIZE;
+if (bgzf_uncompress(fp->uncompressed_block, &uncomp_size, fp->compressed_block, block_length) != 0) 
 	{
 	fp->errcode |= BGZF_ERR_ZLIB;
 	return -1;
 	}
-return zs.total_out;
+return uncomp_size;
 }
 
 static int check_header(const UINT8 *header)
@@ -332,11 +337,17 @@ static int load_block_from_cache(BGZF *fp, INT64 block_address) {return 0;}
 static void cache_block(BGZF *fp, int size) {}
 #endif
 
+static int mt_read_init(BGZF *fp, int n_threads, int n_sub_blks);
+static int mt_read_block(BGZF *fp);
+static INT64 next_block_address(BGZF *fp);
+
 int bgzf_read_block(BGZF *fp)
 {
 UINT8 header[BLOCK_HEADER_LENGTH], *compressed_block;
 size_t count, size = 0, block_length, remaining;
 INT64 block_address;
+if (fp->mt != NULL)
+	return mt_read_block(fp);
 block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
 if (fp->cache_size && load_block_from_cache(fp, block_address)) 
 	return 0;
@@ -406,17 +417,708 @@ while (bytes_read < length)
 	}
 if (fp->block_offset == fp->block_length) 
 	{
-	fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+	fp->block_address = next_block_address(fp);
 	fp->block_offset = fp->block_length = 0;
 	}
 return bytes_read;
 }
 
 
+/***************************
+ * Multithreaded compression
+ ***************************/
+
+// When multithreaded then completed uncompressed blocks are queued into a ring of slots, worker threads deflate queued blocks in parallel and a
+// single writer thread writes the deflated blocks in their queued order. Because compressed block sizes are unknown at the time alignments are
+// being added, whilst multithreaded fp->block_address holds the sequence number of the current block rather than its file offset. Virtual addresses
+// returned by bgzf_tell() are therefore provisional and must be resolved into file virtual addresses with bgzf_mt_vaddr()
+#ifdef _WIN32
+#define MT_LOCK(m) EnterCriticalSection(&(m)->lock)
+#define MT_UNLOCK(m) LeaveCriticalSection(&(m)->lock)
+#define MT_WAIT(m,cv) SleepConditionVariableCS(&(m)->cv,&(m)->lock,INFINITE)
+#define MT_BROADCAST(m,cv) WakeAllConditionVariable(&(m)->cv)
+#else
+#define MT_LOCK(m) pthread_mutex_lock(&(m)->lock)
+#define MT_UNLOCK(m) pthread_mutex_unlock(&(m)->lock)
+#define MT_WAIT(m,cv) pthread_cond_wait(&(m)->cv,&(m)->lock)
+#define MT_BROADCAST(m,cv) pthread_cond_broadcast(&(m)->cv)
+#endif
+
+#define MT_SLOT_FREE 0			// slot available to be filled with an uncompressed block
+#define MT_SLOT_QUEUED 1		// slot holds an uncompressed block queued for deflating
+#define MT_SLOT_DEFLATED 2		// slot holds a deflated block ready to be written
+
+typedef struct {
+	int state;					// MT_SLOT_FREE, MT_SLOT_QUEUED or MT_SLOT_DEFLATED
+	int ulen;					// uncompressed block length
+	int clen;					// compressed block length
+	void *ublk;					// uncompressed block
+	void *cblk;					// compressed block
+	INT64 addr;					// file offset of compressed block, only used when reading
+} mtslot_t;
+
+typedef struct {
+	BGZF *fp;					// multithreading for this BGZF
+	int n_threads;				// number of deflating worker threads
+	int n_slots;				// number of slots in ring
+	mtslot_t *slots;			// ring of slots
+	INT64 n_queued;				// number of blocks queued
+	INT64 n_dispatched;			// number of queued blocks taken by worker threads for deflating
+	INT64 n_written;			// number of blocks written
+	INT64 base_addr;			// file offset at which multithreading started
+	INT64 curr_addr;			// file offset at which next block will be written
+	INT64 *blk_addr;			// file offset of each written block indexed by block sequence number
+	INT64 n_alloc_addr;			// number of allocated blk_addr
+	int errcode;				// BGZF_ERR_ZLIB or BGZF_ERR_IO if any errors in worker or writer threads
+	int term;					// set to request worker and writer threads to terminate once all queued blocks written
+	int n_started;				// number of worker threads started
+	int writer_started;			// set if writer thread was started
+#ifdef _WIN32
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cv_work;		// signalled when blocks queued or terminating
+	CONDITION_VARIABLE cv_write;	// signalled when blocks deflated or terminating
+	CONDITION_VARIABLE cv_free;		// signalled when blocks written
+	HANDLE *threads;
+	HANDLE writer;
+#else
+	pthread_mutex_t lock;
+	pthread_cond_t cv_work;			// signalled when blocks queued or terminating
+	pthread_cond_t cv_write;		// signalled when blocks deflated or terminating
+	pthread_cond_t cv_free;			// signalled when blocks written
+	pthread_t *threads;
+	pthread_t writer;
+#endif
+} mtaux_t;
+
+#ifdef _WIN32
+static unsigned __stdcall mt_worker(void *arg)
+#else
+static void *mt_worker(void *arg)
+#endif
+{
+mtaux_t *mt = (mtaux_t *)arg;
+mtslot_t *slot;
+int clen;
+int rslt;
+
+MT_LOCK(mt);
+while(1)
+	{
+	while(mt->n_dispatched == mt->n_queued && !mt->term)
+		MT_WAIT(mt,cv_work);
+	if(mt->n_dispatched == mt->n_queued)	// must be terminating with nothing left to deflate
+		break;
+	slot = &mt->slots[mt->n_dispatched % mt->n_slots];
+	mt->n_dispatched += 1;
+	MT_UNLOCK(mt);
+
+	clen = BGZF_MAX_BLOCK_SIZE;
+	rslt = bgzf_compress(slot->cblk,&clen,slot->ublk,slot->ulen,mt->fp->compress_level);
+
+	MT_LOCK(mt);
+	if(rslt != 0)
+		{
+		mt->errcode |= BGZF_ERR_ZLIB;
+		clen = 0;
+		}
+	slot->clen = clen;
+	slot->state = MT_SLOT_DEFLATED;
+	MT_BROADCAST(mt,cv_write);
+	}
+MT_UNLOCK(mt);
+return 0;
+}
+
+#ifdef _WIN32
+static unsigned __stdcall mt_writer(void *arg)
+#else
+static void *mt_writer(void *arg)
+#endif
+{
+mtaux_t *mt = (mtaux_t *)arg;
+mtslot_t *slot;
+INT64 *pTmp;
+
+MT_LOCK(mt);
+while(1)
+	{
+	slot = &mt->slots[mt->n_written % mt->n_slots];
+	while(!(mt->n_written < mt->n_queued && slot->state == MT_SLOT_DEFLATED) && !(mt->term && mt->n_written == mt->n_queued))
+		MT_WAIT(mt,cv_write);
+	if(mt->n_written == mt->n_queued)	// must be terminating with nothing left to write
+		break;
+	if(mt->n_written == mt->n_alloc_addr)
+		{
+		if((pTmp = (INT64 *)realloc(mt->blk_addr,sizeof(INT64) * (size_t)(mt->n_alloc_addr * 2))) == NULL)
+			mt->errcode |= BGZF_ERR_IO;
+		else
+			{
+			mt->blk_addr = pTmp;
+			mt->n_alloc_addr *= 2;
+			}
+		}
+	MT_UNLOCK(mt);
+
+	if(slot->clen > 0 && fwrite(slot->cblk, 1, slot->clen, (FILE *)mt->fp->fp) != (size_t)slot->clen)
+		slot->clen = -1;
+
+	MT_LOCK(mt);
+	if(slot->clen < 0)
+		mt->errcode |= BGZF_ERR_IO;
+	if(mt->n_written < mt->n_alloc_addr)
+		mt->blk_addr[mt->n_written] = mt->curr_addr;
+	if(slot->clen > 0)
+		mt->curr_addr += slot->clen;
+	mt->n_written += 1;
+	slot->state = MT_SLOT_FREE;
+	MT_BROADCAST(mt,cv_free);
+	}
+MT_UNLOCK(mt);
+return 0;
+}
+
+// releases multithreading resources, any queued blocks are written before returning
+// returns any errors from the worker or writer threads
+static int mt_destroy(mtaux_t *mt)
+{
+int i;
+int errcode;
+
+MT_LOCK(mt);
+mt->term = 1;
+MT_BROADCAST(mt,cv_work);
+MT_BROADCAST(mt,cv_write);
+MT_UNLOCK(mt);
+#ifdef _WIN32
+for(i = 0; i < mt->n_started; i++)
+	{
+	WaitForSingleObject(mt->threads[i],INFINITE);
+	CloseHandle(mt->threads[i]);
+	}
+if(mt->writer_started)
+	{
+	WaitForSingleObject(mt->writer,INFINITE);
+	CloseHandle(mt->writer);
+	}
+DeleteCriticalSection(&mt->lock);
+#else
+for(i = 0; i < mt->n_started; i++)
+	pthread_join(mt->threads[i],NULL);
+if(mt->writer_started)
+	pthread_join(mt->writer,NULL);
+pthread_mutex_destroy(&mt->lock);
+pthread_cond_destroy(&mt->cv_work);
+pthread_cond_destroy(&mt->cv_write);
+pthread_cond_destroy(&mt->cv_free);
+#endif
+if(mt->slots != NULL)
+	{
+	for(i = 0; i < mt->n_slots; i++)
+		{
+		if(mt->slots[i].ublk != NULL)
+			free(mt->slots[i].ublk);
+		if(mt->slots[i].cblk != NULL)
+			free(mt->slots[i].cblk);
+		}
+	free(mt->slots);
+	}
+if(mt->blk_addr != NULL)
+	free(mt->blk_addr);
+if(mt->threads != NULL)
+	free(mt->threads);
+errcode = mt->errcode;
+free(mt);
+return errcode;
+}
+
+int bgzf_mt(BGZF *fp, int n_threads, int n_sub_blks)
+{
+mtaux_t *mt;
+int i;
+
+if(fp == NULL || fp->mt != NULL || n_threads < 1 || n_sub_blks < 1)
+	return -1;
+if(n_threads == 1)		// single threaded, no point in multithreading
+	return 0;
+if(!fp->is_write)
+	return mt_read_init(fp, n_threads, n_sub_blks);
+if(fp->block_address != 0 || fp->block_offset != 0)		// must be enabled before any writes
+	return -1;
+
+if((mt = (mtaux_t *)calloc(1, sizeof(mtaux_t))) == NULL)
+	return -1;
+mt->fp = fp;
+mt->n_threads = n_threads;
+mt->n_slots = n_threads * n_sub_blks * 2;		// double buffered so blocks can continue to be queued whilst previously queued blocks are being deflated
+mt->n_alloc_addr = 16384;
+mt->base_addr = mt->curr_addr = ftello64((FILE *)fp->fp);
+if(mt->base_addr < 0)
+	mt->base_addr = mt->curr_addr = 0;
+mt->slots = (mtslot_t *)calloc(mt->n_slots, sizeof(mtslot_t));
+mt->blk_addr = (INT64 *)malloc(sizeof(INT64) * (size_t)mt->n_alloc_addr);
+#ifdef _WIN32
+mt->threads = (HANDLE *)calloc(n_threads, sizeof(HANDLE));
+#else
+mt->threads = (pthread_t *)calloc(n_threads, sizeof(pthread_t));
+#endif
+if(mt->slots == NULL || mt->blk_addr == NULL || mt->threads == NULL)
+	{
+	if(mt->slots != NULL) free(mt->slots);
+	if(mt->blk_addr != NULL) free(mt->blk_addr);
+	if(mt->threads != NULL) free(mt->threads);
+	free(mt);
+	return -1;
+	}
+for(i = 0; i < mt->n_slots; i++)
+	{
+	mt->slots[i].ublk = malloc(BGZF_MAX_BLOCK_SIZE);
+	mt->slots[i].cblk = malloc(BGZF_MAX_BLOCK_SIZE);
+	}
+
+#ifdef _WIN32
+InitializeCriticalSection(&mt->lock);
+InitializeConditionVariable(&mt->cv_work);
+InitializeConditionVariable(&mt->cv_write);
+InitializeConditionVariable(&mt->cv_free);
+#else
+pthread_mutex_init(&mt->lock,NULL);
+pthread_cond_init(&mt->cv_work,NULL);
+pthread_cond_init(&mt->cv_write,NULL);
+pthread_cond_init(&mt->cv_free,NULL);
+#endif
+
+for(i = 0; i < mt->n_slots; i++)
+	if(mt->slots[i].ublk == NULL || mt->slots[i].cblk == NULL)
+		{
+		mt_destroy(mt);
+		return -1;
+		}
+
+for(i = 0; i < n_threads; i++)
+	{
+#ifdef _WIN32
+	if((mt->threads[i] = (HANDLE)_beginthreadex(NULL,0x0fffff,mt_worker,mt,0,NULL)) == NULL)
+		break;
+#else
+	if(pthread_create(&mt->threads[i],NULL,mt_worker,mt) != 0)
+		break;
+#endif
+	mt->n_started += 1;
+	}
+if(mt->n_started == n_threads)
+	{
+#ifdef _WIN32
+	if((mt->writer = (HANDLE)_beginthreadex(NULL,0x0fffff,mt_writer,mt,0,NULL)) != NULL)
+		mt->writer_started = 1;
+#else
+	if(pthread_create(&mt->writer,NULL,mt_writer,mt) == 0)
+		mt->writer_started = 1;
+#endif
+	}
+if(!mt->writer_started)
+	{
+	mt_destroy(mt);
+	return -1;
+	}
+fp->mt = mt;
+return 0;
+}
+
+// queues the current uncompressed block for deflating and writing, blocks if all slots are currently in use
+static int mt_queue(BGZF *fp)
+{
+mtaux_t *mt = (mtaux_t *)fp->mt;
+mtslot_t *slot;
+void *pTmp;
+
+MT_LOCK(mt);
+slot = &mt->slots[mt->n_queued % mt->n_slots];
+while(slot->state != MT_SLOT_FREE && !mt->errcode)
+	MT_WAIT(mt,cv_free);
+if(mt->errcode)
+	{
+	fp->errcode |= mt->errcode;
+	MT_UNLOCK(mt);
+	return -1;
+	}
+pTmp = slot->ublk;				// swap buffers rather than copying
+slot->ublk = fp->uncompressed_block;
+fp->uncompressed_block = pTmp;
+slot->ulen = fp->block_offset;
+slot->clen = 0;
+slot->state = MT_SLOT_QUEUED;
+mt->n_queued += 1;
+MT_BROADCAST(mt,cv_work);
+MT_UNLOCK(mt);
+fp->block_address += 1;			// whilst multithreading this is the block sequence number
+fp->block_offset = 0;
+return 0;
+}
+
+INT64 bgzf_mt_vaddr(BGZF *fp, INT64 vaddr)
+{
+mtaux_t *mt;
+INT64 blk;
+INT64 addr;
+
+if(fp == NULL || fp->mt == NULL)
+	return vaddr;
+mt = (mtaux_t *)fp->mt;
+blk = vaddr >> 16;
+MT_LOCK(mt);
+if(blk >= mt->n_queued)		// in current, not yet queued, block; located immediately following all queued blocks
+	{
+	while(mt->n_written < mt->n_queued && !mt->errcode)
+		MT_WAIT(mt,cv_free);
+	addr = mt->curr_addr;
+	}
+else
+	{
+	while(mt->n_written <= blk && !mt->errcode)
+		MT_WAIT(mt,cv_free);
+	addr = blk < mt->n_alloc_addr ? mt->blk_addr[blk] : -1;
+	}
+if(mt->errcode)
+	{
+	fp->errcode |= mt->errcode;
+	addr = -1;
+	}
+MT_UNLOCK(mt);
+if(addr < 0)
+	return -1;
+return (addr << 16) | (vaddr & 0xFFFF);
+}
+
+/*****************************
+ * Multithreaded decompression
+ *****************************/
+
+// When multithreaded reading then a single reader thread reads compressed blocks, in file order, into a ring of slots, worker threads inflate
+// the read blocks in parallel, and bgzf_read_block() returns the inflated blocks in their file order. BGZF blocks are independently
+// compressed with their compressed lengths in the block headers so blocks can be read without first being inflated
+#define MT_SLOT_READ 3			// slot holds a compressed block queued for inflating
+#define MT_SLOT_INFLATED 4		// slot holds an inflated block ready to be returned
+
+typedef struct {
+	BGZF *fp;					// multithreading for this BGZF
+	int n_threads;				// number of inflating worker threads
+	int n_sub_blks;				// number of blocks per worker thread which can be readahead
+	int n_slots;				// number of slots in ring
+	mtslot_t *slots;			// ring of slots
+	INT64 n_read;				// number of blocks read from file
+	INT64 n_dispatched;			// number of read blocks taken by worker threads for inflating
+	INT64 n_consumed;			// number of inflated blocks returned by bgzf_read_block()
+	INT64 next_addr;			// file offset of block following the last returned block
+	int eof;					// set by reader thread on EOF or errors, no more blocks will be read
+	int errcode;				// BGZF_ERR_HEADER, BGZF_ERR_IO or BGZF_ERR_ZLIB if any errors in worker or reader threads
+	int term;					// set to request worker and reader threads to terminate
+	int n_started;				// number of worker threads started
+	int reader_started;			// set if reader thread was started
+#ifdef _WIN32
+	CRITICAL_SECTION lock;
+	CONDITION_VARIABLE cv_work;		// signalled when blocks read, EOF or terminating
+	CONDITION_VARIABLE cv_read;		// signalled when blocks inflated, EOF or terminating
+	CONDITION_VARIABLE cv_free;		// signalled when blocks returned or terminating
+	HANDLE *threads;
+	HANDLE reader;
+#else
+	pthread_mutex_t lock;
+	pthread_cond_t cv_work;			// signalled when blocks read, EOF or terminating
+	pthread_cond_t cv_read;			// signalled when blocks inflated, EOF or terminating
+	pthread_cond_t cv_free;			// signalled when blocks returned or terminating
+	pthread_t *threads;
+	pthread_t reader;
+#endif
+} mtraux_t;
+
+#ifdef _WIN32
+static unsigned __stdcall mt_inflater(void *arg)
+#else
+static void *mt_inflater(void *arg)
+#endif
+{
+mtraux_t *mt = (mtraux_t *)arg;
+mtslot_t *slot;
+int ulen;
+int rslt;
+
+MT_LOCK(mt);
+while(1)
+	{
+	while(mt->n_dispatched == mt->n_read && !mt->eof && !mt->term)
+		MT_WAIT(mt,cv_work);
+	if(mt->term || mt->n_dispatched == mt->n_read)	// terminating, or EOF with nothing left to inflate
+		break;
+	slot = &mt->slots[mt->n_dispatched % mt->n_slots];
+	mt->n_dispatched += 1;
+	MT_UNLOCK(mt);
+
+	ulen = BGZF_MAX_BLOCK_SIZE;
+	rslt = bgzf_uncompress(slot->ublk,&ulen,slot->cblk,slot->clen);
+
+	MT_LOCK(mt);
+	if(rslt != 0)
+		{
+		mt->errcode |= BGZF_ERR_ZLIB;
+		ulen = 0;
+		}
+	slot->ulen = ulen;
+	slot->state = MT_SLOT_INFLATED;
+	MT_BROADCAST(mt,cv_read);
+	}
+MT_UNLOCK(mt);
+return 0;
+}
+
+#ifdef _WIN32
+static unsigned __stdcall mt_reader(void *arg)
+#else
+static void *mt_reader(void *arg)
+#endif
+{
+mtraux_t *mt = (mtraux_t *)arg;
+mtslot_t *slot;
+UINT8 *cblk;
+INT64 addr;
+size_t count;
+int block_length;
+int errcode;
+
+MT_LOCK(mt);
+while(1)
+	{
+	slot = &mt->slots[mt->n_read % mt->n_slots];
+	while(slot->state != MT_SLOT_FREE && !mt->term)
+		MT_WAIT(mt,cv_free);
+	if(mt->term)
+		break;
+	MT_UNLOCK(mt);
+
+	errcode = 0;
+	block_length = 0;
+	cblk = (UINT8 *)slot->cblk;
+	addr = _bgzf_tell((_bgzf_file_t)mt->fp->fp);
+	count = _bgzf_read((FILE *)mt->fp->fp, cblk, BLOCK_HEADER_LENGTH);
+	if(count != 0)
+		{
+		if (count != BLOCK_HEADER_LENGTH || !check_header(cblk))
+			errcode = BGZF_ERR_HEADER;
+		else
+			{
+			block_length = unpackInt16(&cblk[16]) + 1; // +1 because when writing this number, we used "-1"
+			count = _bgzf_read((FILE *)mt->fp->fp, &cblk[BLOCK_HEADER_LENGTH], block_length - BLOCK_HEADER_LENGTH);
+			if(count != (size_t)(block_length - BLOCK_HEADER_LENGTH))
+				errcode = BGZF_ERR_IO;
+			}
+		}
+
+	MT_LOCK(mt);
+	if(count == 0 || errcode)			// EOF or errors, no more blocks will be read
+		{
+		mt->errcode |= errcode;
+		mt->eof = 1;
+		MT_BROADCAST(mt,cv_work);
+		MT_BROADCAST(mt,cv_read);
+		break;
+		}
+	slot->clen = block_length;
+	slot->addr = addr;
+	slot->state = MT_SLOT_READ;
+	mt->n_read += 1;
+	MT_BROADCAST(mt,cv_work);
+	}
+MT_UNLOCK(mt);
+return 0;
+}
+
+// releases multithreaded decompression resources, any read ahead blocks are discarded
+static void mt_read_destroy(mtraux_t *mt)
+{
+int i;
+
+MT_LOCK(mt);
+mt->term = 1;
+MT_BROADCAST(mt,cv_work);
+MT_BROADCAST(mt,cv_read);
+MT_BROADCAST(mt,cv_free);
+MT_UNLOCK(mt);
+#ifdef _WIN32
+for(i = 0; i < mt->n_started; i++)
+	{
+	WaitForSingleObject(mt->threads[i],INFINITE);
+	CloseHandle(mt->threads[i]);
+	}
+if(mt->reader_started)
+	{
+	WaitForSingleObject(mt->reader,INFINITE);
+	CloseHandle(mt->reader);
+	}
+DeleteCriticalSection(&mt->lock);
+#else
+for(i = 0; i < mt->n_started; i++)
+	pthread_join(mt->threads[i],NULL);
+if(mt->reader_started)
+	pthread_join(mt->reader,NULL);
+pthread_mutex_destroy(&mt->lock);
+pthread_cond_destroy(&mt->cv_work);
+pthread_cond_destroy(&mt->cv_read);
+pthread_cond_destroy(&mt->cv_free);
+#endif
+if(mt->slots != NULL)
+	{
+	for(i = 0; i < mt->n_slots; i++)
+		{
+		if(mt->slots[i].ublk != NULL)
+			free(mt->slots[i].ublk);
+		if(mt->slots[i].cblk != NULL)
+			free(mt->slots[i].cblk);
+		}
+	free(mt->slots);
+	}
+if(mt->threads != NULL)
+	free(mt->threads);
+free(mt);
+}
+
+// starts reader and inflating worker threads, blocks are read starting from the current file offset
+static int mt_read_init(BGZF *fp, int n_threads, int n_sub_blks)
+{
+mtraux_t *mt;
+int i;
+
+if((mt = (mtraux_t *)calloc(1, sizeof(mtraux_t))) == NULL)
+	return -1;
+mt->fp = fp;
+mt->n_threads = n_threads;
+mt->n_sub_blks = n_sub_blks;
+mt->n_slots = n_threads * n_sub_blks * 2;		// double buffered so blocks can continue to be read whilst previously read blocks are being inflated
+mt->next_addr = _bgzf_tell((_bgzf_file_t)fp->fp);
+mt->slots = (mtslot_t *)calloc(mt->n_slots, sizeof(mtslot_t));
+#ifdef _WIN32
+mt->threads = (HANDLE *)calloc(n_threads, sizeof(HANDLE));
+#else
+mt->threads = (pthread_t *)calloc(n_threads, sizeof(pthread_t));
+#endif
+if(mt->slots == NULL || mt->threads == NULL)
+	{
+	if(mt->slots != NULL) free(mt->slots);
+	if(mt->threads != NULL) free(mt->threads);
+	free(mt);
+	return -1;
+	}
+for(i = 0; i < mt->n_slots; i++)
+	{
+	mt->slots[i].ublk = malloc(BGZF_MAX_BLOCK_SIZE);
+	mt->slots[i].cblk = malloc(BGZF_MAX_BLOCK_SIZE);
+	}
+
+#ifdef _WIN32
+InitializeCriticalSection(&mt->lock);
+InitializeConditionVariable(&mt->cv_work);
+InitializeConditionVariable(&mt->cv_read);
+InitializeConditionVariable(&mt->cv_free);
+#else
+pthread_mutex_init(&mt->lock,NULL);
+pthread_cond_init(&mt->cv_work,NULL);
+pthread_cond_init(&mt->cv_read,NULL);
+pthread_cond_init(&mt->cv_free,NULL);
+#endif
+
+for(i = 0; i < mt->n_slots; i++)
+	if(mt->slots[i].ublk == NULL || mt->slots[i].cblk == NULL)
+		{
+		mt_read_destroy(mt);
+		return -1;
+		}
+
+for(i = 0; i < n_threads; i++)
+	{
+#ifdef _WIN32
+	if((mt->threads[i] = (HANDLE)_beginthreadex(NULL,0x0fffff,mt_inflater,mt,0,NULL)) == NULL)
+		break;
+#else
+	if(pthread_create(&mt->threads[i],NULL,mt_inflater,mt) != 0)
+		break;
+#endif
+	mt->n_started += 1;
+	}
+if(mt->n_started == n_threads)
+	{
+#ifdef _WIN32
+	if((mt->reader = (HANDLE)_beginthreadex(NULL,0x0fffff,mt_reader,mt,0,NULL)) != NULL)
+		mt->reader_started = 1;
+#else
+	if(pthread_create(&mt->reader,NULL,mt_reader,mt) == 0)
+		mt->reader_started = 1;
+#endif
+	}
+if(!mt->reader_started)
+	{
+	mt_read_destroy(mt);
+	return -1;
+	}
+fp->mt = mt;
+return 0;
+}
+
+// returns the next inflated block, in file order, as the current uncompressed block; fp->block_length will be 0 if EOF
+static int mt_read_block(BGZF *fp)
+{
+mtraux_t *mt = (mtraux_t *)fp->mt;
+mtslot_t *slot;
+void *pTmp;
+
+MT_LOCK(mt);
+slot = &mt->slots[mt->n_consumed % mt->n_slots];
+while(!(mt->n_consumed < mt->n_read && slot->state == MT_SLOT_INFLATED) && !(mt->eof && mt->n_consumed == mt->n_read) && !mt->errcode)
+	MT_WAIT(mt,cv_read);
+if(mt->errcode)
+	{
+	fp->errcode |= mt->errcode;
+	MT_UNLOCK(mt);
+	return -1;
+	}
+if(mt->n_consumed == mt->n_read)		// EOF, no data read
+	{
+	MT_UNLOCK(mt);
+	fp->block_length = 0;
+	return 0;
+	}
+pTmp = slot->ublk;				// swap buffers rather than copying
+slot->ublk = fp->uncompressed_block;
+fp->uncompressed_block = pTmp;
+if (fp->block_length != 0) 
+	fp->block_offset = 0; // Do not reset offset if this read follows a seek.
+fp->block_address = slot->addr;
+fp->block_length = slot->ulen;
+mt->next_addr = slot->addr + slot->clen;
+slot->state = MT_SLOT_FREE;
+mt->n_consumed += 1;
+MT_BROADCAST(mt,cv_free);
+MT_UNLOCK(mt);
+return 0;
+}
+
+// file offset of the block following the current block
+// when multithreaded reading then the actual file offset will be beyond any blocks which have been read ahead
+static INT64 next_block_address(BGZF *fp)
+{
+if(!fp->is_write && fp->mt != NULL)
+	return ((mtraux_t *)fp->mt)->next_addr;
+return _bgzf_tell((_bgzf_file_t)fp->fp);
+}
+
+
 int bgzf_flush(BGZF *fp)
 {
 if (!fp->is_write) 
 	return 0;
+if (fp->mt != NULL)
+	{
+	if (fp->block_offset > 0 && mt_queue(fp) != 0)
+		return -1;
+	return 0;
+	}
 while (fp->block_offset > 0) 
 	{
 	int block_length;
@@ -471,6 +1173,12 @@ if (fp->is_write)
 	{
 	if (bgzf_flush(fp) != 0) 
 		return -1;
+	if (fp->mt != NULL)		// wait for all queued blocks to be written then continue single threaded
+		{
+		mtaux_t *mt = (mtaux_t *)fp->mt;
+		fp->mt = NULL;
+		fp->errcode |= mt_destroy(mt);
+		}
 	fp->compress_level = -1;
 	block_length = deflate_block(fp, 0); // write an empty block
 	count = fwrite(fp->compressed_block, 1, block_length, (FILE *)fp->fp);
@@ -480,6 +1188,13 @@ if (fp->is_write)
 		return -1;
 		}
 	}
+else
+	if (fp->mt != NULL)		// terminate readahead and inflating threads before closing file
+		{
+		mtraux_t *mt = (mtraux_t *)fp->mt;
+		fp->mt = NULL;
+		mt_read_destroy(mt);
+		}
 ret = fp->is_write? fclose((FILE *)fp->fp) : _bgzf_close((FILE *)fp->fp);
 if (ret != 0) 
 	return -1;
@@ -501,6 +1216,8 @@ int bgzf_check_EOF(BGZF *fp)
 static UINT8 magic[29] = "\037\213\010\4\0\0\0\0\0\377\6\0\102\103\2\0\033\0\3\0\0\0\0\0\0\0\0\0";
 UINT8 buf[28];
 INT64 offset;
+if (fp->mt != NULL)		// file offset is owned by readahead thread whilst multithreaded
+	return 0;
 offset = _bgzf_tell((_bgzf_file_t)fp->fp);
 if (_bgzf_seek((FILE *)fp->fp, -28, SEEK_END) < 0) 
 	return 0;
@@ -514,6 +1231,8 @@ INT64 bgzf_seek(BGZF* fp, INT64 pos, int where)
 {
 int block_offset;
 INT64 block_address;
+int n_threads = 0;
+int n_sub_blks = 0;
 
 if (fp->is_write || where != SEEK_SET) 
 	{
@@ -521,6 +1240,15 @@ if (fp->is_write || where != SEEK_SET)
 	return -1;
 	}
 
+if (fp->mt != NULL)		// multithreaded reading, discard any readahead blocks and restart threads at the new file offset
+	{
+	mtraux_t *mt = (mtraux_t *)fp->mt;
+	n_threads = mt->n_threads;
+	n_sub_blks = mt->n_sub_blks;
+	fp->mt = NULL;
+	mt_read_destroy(mt);
+	}
+
 block_offset = pos & 0xFFFF;
 block_address = pos >> 16;
 if (_bgzf_seek((FILE *)fp->fp, block_address, SEEK_SET) < 0) 
@@ -532,6 +1260,8 @@ if (_bgzf_seek((FILE *)fp->fp, block_address, SEEK_SET) < 0)
 fp->block_length = 0;  // indicates current block has not been loaded
 fp->block_address = block_address;
 fp->block_offset = block_offset;
+if (n_threads > 1 && mt_read_init(fp, n_threads, n_sub_blks) != 0)
+	return -1;
 return 0;
 }
 
@@ -562,7 +1292,7 @@ if (fp->block_offset >= fp->block_length)
 c = ((unsigned char*)fp->uncompressed_block)[fp->block_offset++];
 if (fp->block_offset == fp->block_length) 
 	{
-    fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+    fp->block_address = next_block_address(fp);
     fp->block_offset = 0;
     fp->block_length = 0;
 	}
@@ -591,6 +1321,7 @@ do {
 			state = -1; 
 			break; 
 			}
+		buf = (unsigned char*)fp->uncompressed_block;	// block buffers are swapped when multithreaded
 		}
 	for (l = fp->block_offset; l < fp->block_length && buf[l] != delim; ++l);
 	if (l < fp->block_length) 
@@ -607,7 +1338,7 @@ do {
 	fp->block_offset += l + 1;
 	if (fp->block_offset >= fp->block_length) 
 		{
-		fp->block_address = _bgzf_tell((_bgzf_file_t)fp->fp);
+		fp->block_address = next_block_address(fp);
 		fp->block_offset = 0;
 		fp->block_length = 0;
 		} 
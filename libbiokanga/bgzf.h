@@ -202,14 +202,28 @@ extern "C" {
 	int bgzf_read_block(BGZF *fp);
 
 	/**
-	 * Enable multi-threading (only effective on writing)
+	 * Enable multi-threading
+	 * When writing then blocks are deflated in parallel, must be enabled before any writes
+	 * When reading then blocks are read ahead and inflated in parallel, blocks are returned in file order
+	 * Whilst multithreaded reading bgzf_check_EOF() is not supported, bgzf_seek() discards all read ahead blocks
 	 *
-	 * @param fp          BGZF file handler; must be opened for writing
-	 * @param n_threads   #threads used for writing
-	 * @param n_sub_blks  #blocks processed by each thread; a value 64-256 is recommended
+	 * @param fp          BGZF file handler
+	 * @param n_threads   #threads used for deflating or inflating
+	 * @param n_sub_blks  #blocks queued for each thread, each queued slot costs 128KB; a value of 4-8 is recommended
 	 */
 	int bgzf_mt(BGZF *fp, int n_threads, int n_sub_blks);
 
+	/**
+	 * Resolve a virtual file offset, as returned by bgzf_tell() whilst multithreaded, into the actual virtual file offset
+	 * Whilst multithreaded bgzf_tell() returns the block sequence number in place of the block file offset as
+	 * compressed block sizes are only known once deflated, waits for the referenced block to be written if required
+	 *
+	 * @param fp          BGZF file handler
+	 * @param vaddr       virtual file offset as returned by bgzf_tell()
+	 * @return            actual virtual file offset, vaddr unchanged if not multithreaded, or -1 on error
+	 */
+	INT64 bgzf_mt_vaddr(BGZF *fp, INT64 vaddr);
+
 #ifdef __cplusplus
 }
 #endif
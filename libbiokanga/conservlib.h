@@ -10,6 +10,8 @@
 #include "./SeqTrans.h"
 #include "./Diagnostics.h"
 #include "./MTqsort.h"
+#include "./MTRadixSort.h"
+#include "./NUMA.h"
 #include "./Fasta.h"
 #include "./BEDfile.h"
 #include "./BioSeqFile.h"
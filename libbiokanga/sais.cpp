@@ -339,3 +339,165 @@ CSAIS::sais_int_bwt(const int *T, int *U, int *A, int n, int k) {
   pidx += 1;
   return pidx;
 }
+
+// Templated SA-IS variants which are instantiated for both 32 and 64bit suffix indexes
+// When cs is 1 then symbols are the low nibble of each byte in T, otherwise T is the reduced string of saidx typed names generated by the previous recursion level
+#define chrT(i) (cs == 1 ? (saidx)(((const unsigned char *)T)[i] & 0x0f) : ((const saidx *)T)[i])
+
+template <typename saidx> void
+CSAIS::getCountsT(const void *T, saidx *C, saidx n, saidx k, int cs) {
+  saidx i;
+  for(i = 0; i < k; ++i) { C[i] = 0; }
+  for(i = 0; i < n; ++i) { ++C[chrT(i)]; }
+}
+
+template <typename saidx> void
+CSAIS::getBucketsT(const saidx *C, saidx *B, saidx k, int end) {
+  saidx i, sum = 0;
+  if(end) { for(i = 0; i < k; ++i) { sum += C[i]; B[i] = sum; } }
+  else { for(i = 0; i < k; ++i) { sum += C[i]; B[i] = sum - C[i]; } }
+}
+
+template <typename saidx> void
+CSAIS::induceSAT(const void *T, saidx *SA, saidx *C, saidx *B, saidx n, saidx k, int cs) {
+  saidx *b, i, j;
+  saidx c0, c1;
+  /* compute SAl */
+  if(C == B) { getCountsT(T, C, n, k, cs); }
+  getBucketsT(C, B, k, 0); /* find starts of buckets */
+  j = n - 1;
+  b = SA + B[c1 = chrT(j)];
+  *b++ = ((0 < j) && (chrT(j - 1) < c1)) ? ~j : j;
+  for(i = 0; i < n; ++i) {
+    j = SA[i], SA[i] = ~j;
+    if(0 < j) {
+      --j;
+      if((c0 = chrT(j)) != c1)
+		{
+		B[c1] = (saidx)(b - SA);
+		b = SA + B[c1 = c0];
+		}
+      *b++ = ((0 < j) && (chrT(j - 1) < c1)) ? ~j : j;
+    }
+  }
+  /* compute SAs */
+  if(C == B) { getCountsT(T, C, n, k, cs); }
+  getBucketsT(C, B, k, 1); /* find ends of buckets */
+  for(i = n - 1, b = SA + B[c1 = 0]; 0 <= i; --i) {
+    if(0 < (j = SA[i])) {
+      --j;
+      if((c0 = chrT(j)) != c1)
+		{
+		B[c1] = (saidx)(b - SA);
+		b = SA + B[c1 = c0];
+		}
+      *--b = ((j == 0) || (chrT(j - 1) > c1)) ? ~j : j;
+    } else {
+      SA[i] = ~j;
+    }
+  }
+}
+
+/* find the suffix array SA of T[0..n-1] in {0..k-1}^n
+   use a working space (excluding T and SA) of at most 2n+O(1) for a constant alphabet */
+template <typename saidx> int
+CSAIS::sais_mainT(const void *T, saidx *SA, saidx fs, saidx n, saidx k, int cs) {
+  saidx *C, *B, *RA;
+  saidx i, j, c, m, p, q, plen, qlen, name;
+  saidx c0, c1;
+  int diff;
+
+  /* stage 1: reduce the problem by at least 1/2
+     sort all the S-substrings */
+  if(k <= fs) {
+    C = SA + n;
+    B = (k <= (fs - k)) ? C + k : C;
+  } else {
+    if((C = (saidx *)malloc((size_t)k * sizeof(saidx))) == NULL) { return -2; }
+    B = C;
+  }
+  getCountsT(T, C, n, k, cs); getBucketsT(C, B, k, 1); /* find ends of buckets */
+  for(i = 0; i < n; ++i) { SA[i] = 0; }
+  for(i = n - 2, c = 0, c1 = chrT(n - 1); 0 <= i; --i, c1 = c0) {
+    if((c0 = chrT(i)) < (c1 + c)) { c = 1; }
+    else if(c != 0) { SA[--B[c1]] = i + 1, c = 0; }
+  }
+  induceSAT(T, SA, C, B, n, k, cs);
+  if(fs < k) { free(C); }
+
+  /* compact all the sorted substrings into the first m items of SA
+     2*m must be not larger than n (proveable) */
+  for(i = 0, m = 0; i < n; ++i) {
+    p = SA[i];
+    if((0 < p) && (chrT(p - 1) > (c0 = chrT(p)))) {
+      for(j = p + 1; (j < n) && (c0 == (c1 = chrT(j))); ++j) { }
+      if((j < n) && (c0 < c1)) { SA[m++] = p; }
+    }
+  }
+  j = m + (n >> 1);
+  for(i = m; i < j; ++i) { SA[i] = 0; } /* init the name array buffer */
+  /* store the length of all substrings */
+  for(i = n - 2, j = n, c = 0, c1 = chrT(n - 1); 0 <= i; --i, c1 = c0) {
+    if((c0 = chrT(i)) < (c1 + c)) { c = 1; }
+    else if(c != 0) { SA[m + ((i + 1) >> 1)] = j - i - 1; j = i + 1; c = 0; }
+  }
+  /* find the lexicographic names of all substrings */
+  for(i = 0, name = 0, q = n, qlen = 0; i < m; ++i) {
+    p = SA[i], plen = SA[m + (p >> 1)], diff = 1;
+    if(plen == qlen) {
+      for(j = 0; (j < plen) && (chrT(p + j) == chrT(q + j)); ++j) { }
+      if(j == plen) { diff = 0; }
+    }
+    if(diff != 0) { ++name, q = p, qlen = plen; }
+    SA[m + (p >> 1)] = name;
+  }
+
+  /* stage 2: solve the reduced problem
+     recurse if names are not yet unique */
+  if(name < m) {
+    RA = SA + n + fs - m;
+    for(i = m + (n >> 1) - 1, j = m - 1; m <= i; --i) {
+      if(SA[i] != 0) { RA[j--] = SA[i] - 1; }
+    }
+    if(sais_mainT(RA, SA, fs + n - m * 2, m, name, sizeof(saidx)) != 0) { return -2; }
+    for(i = n - 2, j = m - 1, c = 0, c1 = chrT(n - 1); 0 <= i; --i, c1 = c0) {
+      if((c0 = chrT(i)) < (c1 + c)) { c = 1; }
+      else if(c != 0) { RA[j--] = i + 1, c = 0; } /* get p1 */
+    }
+    for(i = 0; i < m; ++i) { SA[i] = RA[SA[i]]; } /* get index */
+  }
+
+  /* stage 3: induce the result for the original problem */
+  if(k <= fs) {
+    C = SA + n;
+    B = (k <= (fs - k)) ? C + k : C;
+  } else {
+    if((C = (saidx *)malloc((size_t)k * sizeof(saidx))) == NULL) { return -2; }
+    B = C;
+  }
+  /* put all left-most S characters into their buckets */
+  getCountsT(T, C, n, k, cs); getBucketsT(C, B, k, 1); /* find ends of buckets */
+  for(i = m; i < n; ++i) { SA[i] = 0; } /* init SA[m..n-1] */
+  for(i = m - 1; 0 <= i; --i) {
+    j = SA[i], SA[i] = 0;
+    SA[--B[chrT(j)]] = j;
+  }
+  induceSAT(T, SA, C, B, n, k, cs);
+  if(fs < k) { free(C); }
+  return 0;
+}
+#undef chrT
+
+int
+CSAIS::sais_nibble(const unsigned char *T, INT32 *SA, INT32 n) {
+  if((T == NULL) || (SA == NULL) || (n < 0)) { return -1; }
+  if(n <= 1) { if(n == 1) { SA[0] = 0; } return 0; }
+  return sais_mainT<INT32>(T, SA, 0, n, 16, 1);
+}
+
+int
+CSAIS::sais_nibble(const unsigned char *T, INT64 *SA, INT64 n) {
+  if((T == NULL) || (SA == NULL) || (n < 0)) { return -1; }
+  if(n <= 1) { if(n == 1) { SA[0] = 0; } return 0; }
+  return sais_mainT<INT64>(T, SA, 0, n, 16, 1);
+}
@@ -11,6 +11,13 @@ class CSAIS
 		use a working space (excluding T and SA) of at most 2n+O(1) for a constant alphabet */
 	int sais_main(const unsigned char *T, int *SA, int fs, int n, int k, int cs, int isbwt);
 
+	// templated variants used when inducing suffix arrays over concatenated genome sequences, these can be instantiated with either 32 or 64bit suffix indexes
+	// when cs == 1 then only the low nibble (bits 0..3) of each byte in T is used as the symbol, upper bits hold repeat masking or other flags which must not affect ordering
+	template <typename saidx> void getCountsT(const void *T, saidx *C, saidx n, saidx k, int cs);
+	template <typename saidx> void getBucketsT(const saidx *C, saidx *B, saidx k, int end);
+	template <typename saidx> void induceSAT(const void *T, saidx *SA, saidx *C, saidx *B, saidx n, saidx k, int cs);
+	template <typename saidx> int sais_mainT(const void *T, saidx *SA, saidx fs, saidx n, saidx k, int cs);
+
 public:
 	CSAIS(void){};
 	~CSAIS(void){};
@@ -20,4 +27,9 @@ public:
 	int sais_bwt(const unsigned char *T, unsigned char *U, int *A, int n);
 	int sais_int_bwt(const int *T, int *U, int *A, int n, int k);
 
+	// suffix array of T[0..n-1] with symbols taken from the low nibble of each base, 32bit suffix indexes so n must be less than 2^31
+	int sais_nibble(const unsigned char *T, INT32 *SA, INT32 n);
+	// suffix array of T[0..n-1] with symbols taken from the low nibble of each base, 64bit suffix indexes for very large concatenated sequences
+	int sais_nibble(const unsigned char *T, INT64 *SA, INT64 n);
+
 };
@@ -37,6 +37,8 @@ m_pGraphInEdges = NULL;
 m_pTransitStack = NULL;
 m_pComponents = NULL;
 m_pPathTraceBacks = NULL;
+m_pPathScoreMem = NULL;
+m_NumThreads = 1;
 m_bMutexesCreated = false;
 m_CASSerialise = 0;
 m_CASLock = 0;
@@ -241,6 +243,8 @@ m_UsedGraphInEdges = 0;
 m_AllocdTraceBacks = 0;
 m_UsedTraceBacks = 0;
 
+FreePathScoring();
+
 m_CurTransitDepth = 0;
 m_MaxTransitDepth = 0;
 
@@ -1660,168 +1664,349 @@ else // From evaluated as sense in current path
 return(-1);   // would not extend From vertex by at least 50bp
 }
 
-static int CurStackDepth = 0;
-static int MaxStackDepth = 0;
+// FreePathScoring
+// Free memory allocated for path scoring
+void
+CAssembGraph::FreePathScoring(void)
+{
+if(m_pPathScoreMem != NULL)
+	{
+#ifdef _WIN32
+	free(m_pPathScoreMem);				// was allocated with malloc/realloc, or mmap/mremap, not c++'s new....
+#else
+	if(m_pPathScoreMem != MAP_FAILED)
+		munmap(m_pPathScoreMem,m_AllocdPathScoreMem);
+#endif	
+	m_pPathScoreMem = NULL;
+	}
+m_AllocdPathScoreMem = 0;
+m_pScoreVertices = NULL;
+m_pScoreCompOfs = NULL;
+m_pPathStateStacks = NULL;
+m_pPathStates = NULL;
+m_NxtScoreComponentIdx = 0;
+m_NumScoredComponents = 0;
+m_NumScoredCycles = 0;
+}
 
-UINT64
-CAssembGraph::ScorePaths(tVertID VertexID)	// score all paths starting with outgoing edges from this 'From' vertex
+// AllocPathScoring
+// Allocate and initialise path scoring states for both orientations of all vertices
+// Vertices are ordered by component, and each component is given its own partition of the traversal and component stacks, so components can be concurrently scored
+int											// eBSFSuccess or otherwise
+CAssembGraph::AllocPathScoring(void)
 {
-UINT64 EdgeScore;
-UINT64 HighestScore;
-UINT32 HighestScoreEdgeID;
-UINT32 Idx;
-UINT8 ToOvlpClass;
-UINT8 FromOvlpClass;
-int FromExtdLen;
+size_t AllocMem;
+UINT32 VertexIdx;
+UINT32 CompIdx;
 tsGraphVertex *pVertex;
-tsGraphVertex *pToNxtVertex;
-tsGraphOutEdge *pEdge;
-
-pVertex = &m_pGraphVertices[VertexID-1];
-
-// vertex may have already been committed as part of a previously accepted highest scoring path
-if(pVertex->flgPathAccepted)
-	return(0);
 
-// if score already generated for paths originating at this vertex then no need to regenerate ...
-if(pVertex->flgPathScored)
-	return(pVertex->PathScore);
-
-CurStackDepth = 1;
-pVertex->RecurseDepth = 1;
-pEdge = &m_pGraphOutEdges[pVertex->OutEdgeID-1];
-for(Idx = 0; Idx < pVertex->DegreeOut; Idx++,pEdge++)
+FreePathScoring();
+AllocMem = ((size_t)m_UsedGraphVertices * sizeof(tVertID)) +			// vertices ordered by component
+			((size_t)(m_NumComponents + 1) * sizeof(UINT32)) +			// offsets of first vertex in each component
+			((size_t)m_UsedGraphVertices * 4 * sizeof(UINT32)) +		// traversal and component stacks, each stack can hold both states of all vertices in a component
+			((size_t)m_UsedGraphVertices * 2 * sizeof(tsPathState));	// sense and antisense states for each vertex
+#ifdef _WIN32
+m_pPathScoreMem = malloc(AllocMem);	
+if(m_pPathScoreMem == NULL)
 	{
-	pToNxtVertex = &m_pGraphVertices[pEdge->ToVertexID-1];
-	if(pToNxtVertex->RecurseDepth == 0)
-		pToNxtVertex->RecurseDepth = pVertex->RecurseDepth+1;
-	else
-		continue;
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"AllocPathScoring: path scoring memory allocation of %llu bytes failed - %s",(UINT64)AllocMem,strerror(errno));
+	return(eBSFerrMem);
+	}
+memset(m_pPathScoreMem,0,AllocMem);
+#else
+m_pPathScoreMem = mmap(NULL,AllocMem, PROT_READ |  PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS, -1,0);
+if(m_pPathScoreMem == MAP_FAILED)
+	{
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"AllocPathScoring: path scoring memory allocation of %llu bytes failed - %s",(UINT64)AllocMem,strerror(errno));
+	m_pPathScoreMem = NULL;
+	return(eBSFerrMem);
 	}
+#endif
+m_AllocdPathScoreMem = AllocMem;
+m_pScoreVertices = (tVertID *)m_pPathScoreMem;
+m_pScoreCompOfs = (UINT32 *)&m_pScoreVertices[m_UsedGraphVertices];
+m_pPathStateStacks = &m_pScoreCompOfs[m_NumComponents + 1];
+m_pPathStates = (tsPathState *)&m_pPathStateStacks[(size_t)m_UsedGraphVertices * 4];
+
+// counting sort of vertices into component order
+pVertex = m_pGraphVertices;
+for(VertexIdx = 0; VertexIdx < m_UsedGraphVertices; VertexIdx++, pVertex++)
+	if(pVertex->ComponentID >= 1 && pVertex->ComponentID <= m_NumComponents)
+		m_pScoreCompOfs[pVertex->ComponentID] += 1;
+for(CompIdx = 1; CompIdx <= m_NumComponents; CompIdx++)
+	m_pScoreCompOfs[CompIdx] += m_pScoreCompOfs[CompIdx-1];
+pVertex = m_pGraphVertices;
+for(VertexIdx = 0; VertexIdx < m_UsedGraphVertices; VertexIdx++, pVertex++)
+	if(pVertex->ComponentID >= 1 && pVertex->ComponentID <= m_NumComponents)
+		m_pScoreVertices[m_pScoreCompOfs[pVertex->ComponentID-1]++] = pVertex->VertexID;
+for(CompIdx = m_NumComponents; CompIdx > 0; CompIdx--)		// offsets were advanced to the start of the following component so restore
+	m_pScoreCompOfs[CompIdx] = m_pScoreCompOfs[CompIdx-1];
+m_pScoreCompOfs[0] = 0;
+return(eBSFSuccess);
+}
 
-// iterate each of the outgoing edges scoring paths
+// ScoreState
+// Score paths originating from a vertex state
+// All states reachable from this state have been scored other than those in the same cycle and discovered before this state, paths are not extended back into the cycle through these
+void
+CAssembGraph::ScoreState(UINT32 StateIdx)	// score paths from this state given that all states reachable from it have been scored
+{
+UINT32 Idx;
+UINT8 ToOvlpClass;
+UINT32 ScoreAlignLen;
+UINT32 HighScoreAlignLen;
+UINT64 HighestScore;
+tEdgeID HighestScoreEdgeID;
+tsGraphVertex *pVertex;
+tsGraphOutEdge *pEdge;
+tsPathState *pState;
+tsPathState *pToState;
+
+pState = &m_pPathStates[StateIdx];
+pVertex = &m_pGraphVertices[StateIdx >> 1];
+HighScoreAlignLen = 0;
 HighestScore = 0;
 HighestScoreEdgeID = 0;
-pEdge = &m_pGraphOutEdges[pVertex->OutEdgeID-1];
-for(Idx = 0; Idx < pVertex->DegreeOut; Idx++,pEdge++)
+if(pVertex->OutEdgeID != 0)
 	{
-	FromOvlpClass = 0;     // as the From vertex is the first in path to be explored then initially always treat as sense
-	ToOvlpClass = 0;
-	if((FromExtdLen=OverlapAcceptable(pEdge,FromOvlpClass,&ToOvlpClass)) > 0)	// explore if edge represents a 'From' extension assuming initial sense
+	pEdge = &m_pGraphOutEdges[pVertex->OutEdgeID-1];
+	for(Idx = 0; Idx < pVertex->DegreeOut; Idx++,pEdge++)
 		{
-		EdgeScore = pEdge->Score;
-		EdgeScore += ScorePath(pVertex->RecurseDepth+1,pEdge,ToOvlpClass,&ToOvlpClass);		// score paths starting with this edge
-		if(EdgeScore > HighestScore)	// if path score higher than any previously seen for VertexID then note the edge
+		if(pEdge->ToVertexID == pEdge->FromVertexID)
+			continue;
+		ToOvlpClass = 0;
+		if(OverlapAcceptable(pEdge,StateIdx & 0x01,&ToOvlpClass) <= 0)
+			continue;
+		pToState = &m_pPathStates[((pEdge->ToVertexID-1) * 2) + (ToOvlpClass & 0x01)];
+		if(!pToState->flgScored)		// would be extending back into current cycle
+			continue;
+
+		ScoreAlignLen = ((pEdge->FromSeqLen + pEdge->ToSeqLen) - pEdge->ScoreAlignLen ) + pEdge->Score; // higher scores for longer resultant combined subsequences and for higher scoring alignment
+		if(pToState->PathScore > HighestScore || (pToState->PathScore == HighestScore && ScoreAlignLen > HighScoreAlignLen))
 			{
-			HighestScore = EdgeScore;
-			HighestScoreEdgeID =  pVertex->OutEdgeID + Idx;
+			HighScoreAlignLen = ScoreAlignLen;
+			HighestScore = pToState->PathScore;
+			HighestScoreEdgeID = pVertex->OutEdgeID + Idx;
 			}
 		}
 	}
 
-// iterated all paths starting with vertex outgoing edges and noted the highest scoring
-pVertex->flgPathScored = 1;
-if(HighestScore == 0)	// 0 if a terminating vertex with no accepted outgoing edges
-	{
-	pVertex->PathScore = (UINT64)pVertex->SeqLen;
-	pVertex->flgPathTerm = 1;
-	}
+pState->flgScored = 1;
+if(HighestScore == 0)	// 0 if classing as terminating vertex with no accepted outgoing edges
+	pState->PathScore = pVertex->SeqLen;
 else
-	pVertex->PathScore = HighestScore + pEdge->ScoreAlignLen;
-pVertex->PathScoreEdgeID =  HighestScoreEdgeID;
-return(pVertex->PathScore);
+	pState->PathScore = HighestScore + HighScoreAlignLen;
+pState->PathScoreEdgeID = HighestScoreEdgeID;
 }
 
-UINT64											// highest scoring of any path from pEdge
-CAssembGraph::ScorePath(UINT32 Depth,			// current recursive depth - used to detect circular paths
-				  tsGraphOutEdge *pEdge,		// score paths starting with this edge
-				UINT8 FromOvlpClass,	// From vertex overlap classification; bit 0 set if From vertex evaluated as antisense in current path
-				UINT8 *pToOvlpClass)		// returned To vertex overlap classification; bit 0 set if To vertex is evaluated as antisense in current path
+// ScoreComponentPaths
+// Score all paths in a component in time linear with the number of vertices and edges in that component
+// Vertex states are iteratively traversed depth first identifying strongly connected states (cycles) as per Tarjan, strongly connected states are completed in reverse topological order
+// so when completed all states reachable from these states, other than those in the same cycle, have been scored. Within a cycle states are scored in reverse of discovery order
+// with paths only extending to states discovered later which condenses the cycle into acyclic paths. Scoring is then dynamic programming over the condensed graph.
+// The highest scoring path, which always starts from a sense vertex, is then marked on the vertices ready for GenTraceBackPath()
+UINT32									// number of cycles condensed
+CAssembGraph::ScoreComponentPaths(tsComponent *pComponent)	// score all paths in this component and mark vertices on the highest scoring path
 {
 UINT32 Idx;
-int FromSeqExtn;
-tsGraphVertex *pToVertex;
-tsGraphVertex *pToNxtVertex;
-tsGraphOutEdge *pToEdge;
+UINT32 NumVertices;
+UINT32 NumCycles;
+UINT32 CycleLen;
+UINT32 DFSIdx;
+UINT32 DFSDepth;
+UINT32 SCCDepth;
+UINT32 StateIdx;
+UINT32 ToStateIdx;
+UINT32 MemberIdx;
 UINT8 ToOvlpClass;
-tVertID HighestScoreToVertexID;
-UINT64 EdgeScore;
-UINT64 HighestScore;
-UINT32 HighestScoreEdgeID;
-UINT32 HighScoreAlignLen;
-UINT32 ScoreAlignLen;
+tVertID *pVertexIDs;
+UINT32 *pDFSStack;
+UINT32 *pSCCStack;
+tsGraphVertex *pVertex;
+tsGraphOutEdge *pEdge;
+tsPathState *pState;
+tsPathState *pToState;
+
+NumVertices = m_pScoreCompOfs[pComponent->ComponentID] - m_pScoreCompOfs[pComponent->ComponentID-1];
+pVertexIDs = &m_pScoreVertices[m_pScoreCompOfs[pComponent->ComponentID-1]];
+pDFSStack = &m_pPathStateStacks[(size_t)m_pScoreCompOfs[pComponent->ComponentID-1] * 4];
+pSCCStack = &pDFSStack[NumVertices * 2];
+
+pComponent->NumTraceBacks = 0;
+pComponent->StartTraceBackID = 0;
+pComponent->PathStartVertexID = 0;
+pComponent->PathScore = 0;
+pComponent->PathLength = 0;
+for(Idx = 0; Idx < NumVertices; Idx++)
+	{
+	pVertex = &m_pGraphVertices[pVertexIDs[Idx]-1];
+	pVertex->RecurseDepth = 0;
+	pVertex->flgPathScored = 0;
+	pVertex->flgPathTerm = 0;
+	pVertex->PathScore = 0;
+	pVertex->PathScoreEdgeID = 0;
+	}
+
+NumCycles = 0;
+DFSIdx = 0;
+SCCDepth = 0;
+for(Idx = 0; Idx < NumVertices; Idx++)
+	{
+	pVertex = &m_pGraphVertices[pVertexIDs[Idx]-1];
+	if(pVertex->flgPathAccepted)	// vertex may have already been committed as part of a previously accepted highest scoring path
+		continue;
+	StateIdx = (pVertex->VertexID-1) * 2;	// paths start from the vertex as sense
+	pState = &m_pPathStates[StateIdx];
+	if(pState->DFSIdx != 0)			// already discovered when traversing from some other vertex
+		continue;
+	pState->DFSIdx = pState->LowLink = ++DFSIdx;
+	pState->flgOnStack = 1;
+	pSCCStack[SCCDepth++] = StateIdx;
+	pDFSStack[0] = StateIdx;
+	DFSDepth = 1;
+	while(DFSDepth > 0)
+		{
+		StateIdx = pDFSStack[DFSDepth-1];
+		pState = &m_pPathStates[StateIdx];
+		pVertex = &m_pGraphVertices[StateIdx >> 1];
+		if(pState->NxtEdgeIdx < pVertex->DegreeOut)	// explore next outgoing edge
+			{
+			pEdge = &m_pGraphOutEdges[pVertex->OutEdgeID - 1 + pState->NxtEdgeIdx++];
+			if(pEdge->ToVertexID == pEdge->FromVertexID)
+				continue;
+			ToOvlpClass = 0;
+			if(OverlapAcceptable(pEdge,StateIdx & 0x01,&ToOvlpClass) <= 0)
+				continue;
+			ToStateIdx = ((pEdge->ToVertexID-1) * 2) + (ToOvlpClass & 0x01);
+			pToState = &m_pPathStates[ToStateIdx];
+			if(pToState->DFSIdx == 0)		// not previously discovered so descend
+				{
+				pToState->DFSIdx = pToState->LowLink = ++DFSIdx;
+				pToState->flgOnStack = 1;
+				pSCCStack[SCCDepth++] = ToStateIdx;
+				pDFSStack[DFSDepth++] = ToStateIdx;
+				}
+			else
+				if(pToState->flgOnStack && pToState->DFSIdx < pState->LowLink)	// edge back into a cycle
+					pState->LowLink = pToState->DFSIdx;
+			continue;
+			}
 
-if(CurStackDepth > MaxStackDepth)
-	{
-	MaxStackDepth = CurStackDepth;
-	if(MaxStackDepth > 1 && (MaxStackDepth % 5000) == 0)
-		gDiagnostics.DiagOut(eDLWarn,gszProcName,"ScorePath: Recursion depth %u",MaxStackDepth);
+		// all outgoing edges from this state have been explored
+		DFSDepth -= 1;
+		if(DFSDepth > 0)
+			{
+			pToState = &m_pPathStates[pDFSStack[DFSDepth-1]];
+			if(pState->LowLink < pToState->LowLink)
+				pToState->LowLink = pState->LowLink;
+			}
+		if(pState->LowLink == pState->DFSIdx)		// state is the root of strongly connected states so can score these states
+			{
+			CycleLen = 0;
+			do {
+				MemberIdx = pSCCStack[--SCCDepth];
+				m_pPathStates[MemberIdx].flgOnStack = 0;
+				ScoreState(MemberIdx);
+				CycleLen += 1;
+				}
+			while(MemberIdx != StateIdx);
+			if(CycleLen > 1)
+				NumCycles += 1;
+			}
+		}
 	}
 
-// if score already generated for paths originating at this vertex then no need to regenerate ...
-pToVertex = &m_pGraphVertices[pEdge->ToVertexID-1];
-if(pToVertex->flgPathScored)
-	return(pToVertex->PathScore);
-pToVertex->RecurseDepth = Depth;
-
-// need to mark all ToVertices with current Depth so can check circular references
-pToEdge = &m_pGraphOutEdges[pToVertex->OutEdgeID-1];
-for(Idx = 0; Idx < pToVertex->DegreeOut; Idx++,pToEdge++)
+// highest scoring path starts from a sense vertex
+for(Idx = 0; Idx < NumVertices; Idx++)
 	{
-	pToNxtVertex = &m_pGraphVertices[pToEdge->ToVertexID-1];
-	if(pToNxtVertex->RecurseDepth == 0)
-		pToNxtVertex->RecurseDepth = Depth + 1;
-	else
-		continue;
+	pState = &m_pPathStates[(pVertexIDs[Idx]-1) * 2];
+	if(pState->flgScored && pState->PathScore > pComponent->PathScore)
+		{
+		pComponent->PathScore = pState->PathScore;
+		pComponent->PathStartVertexID = pVertexIDs[Idx];
+		}
 	}
 
-	// recursively iterate each of the outgoing edges scoring paths
-HighScoreAlignLen = 0;
-HighestScore = 0;
-HighestScoreEdgeID = 0;
-HighestScoreToVertexID = 0;
-pToEdge = &m_pGraphOutEdges[pToVertex->OutEdgeID-1];
-for(Idx = 0; Idx < pToVertex->DegreeOut; Idx++,pToEdge++)
+// mark vertices on the highest scoring path, the same vertex could be reached again in the other orientation so path is terminated if a vertex is revisited
+if(pComponent->PathStartVertexID != 0)
 	{
-	if(pToEdge->ToVertexID == pEdge->FromVertexID)
-		continue;
-	pToNxtVertex = &m_pGraphVertices[pToEdge->ToVertexID-1];
-	if(pToNxtVertex->RecurseDepth > 0 &&  pToNxtVertex->RecurseDepth < Depth)
-		continue;
-	ToOvlpClass = 0;
-	if((FromSeqExtn = OverlapAcceptable(pToEdge,FromOvlpClass,&ToOvlpClass)) > 0)
+	StateIdx = (pComponent->PathStartVertexID-1) * 2;
+	while(1)
 		{
-		if(!pToNxtVertex->flgPathScored)
+		pState = &m_pPathStates[StateIdx];
+		pVertex = &m_pGraphVertices[StateIdx >> 1];
+		pVertex->flgPathScored = 1;
+		pVertex->PathScore = pState->PathScore;
+		pVertex->PathScoreEdgeID = pState->PathScoreEdgeID;
+		if(pState->PathScoreEdgeID == 0)
 			{
-			CurStackDepth += 1;
-			EdgeScore = ScorePath(Depth+1,pToEdge,ToOvlpClass);
-			CurStackDepth -= 1;
+			pVertex->flgPathTerm = 1;
+			break;
 			}
-		else
-			EdgeScore = pToNxtVertex->PathScore;
-
-		ScoreAlignLen = ((pToEdge->FromSeqLen + pToEdge->ToSeqLen) - pToEdge->ScoreAlignLen ) + pToEdge->Score; // higher scores for longer resultant combined subsequences and for higher scoring alignment
-		if(EdgeScore > HighestScore || (EdgeScore == HighestScore && ScoreAlignLen > HighScoreAlignLen))
+		pEdge = &m_pGraphOutEdges[pState->PathScoreEdgeID-1];
+		if(m_pGraphVertices[pEdge->ToVertexID-1].flgPathScored)
 			{
-			HighScoreAlignLen = ScoreAlignLen;
-			HighestScore = EdgeScore;
-			HighestScoreEdgeID = pToVertex->OutEdgeID + Idx;
-			HighestScoreToVertexID = pToEdge->ToVertexID;
+			pVertex->flgPathTerm = 1;
+			pVertex->PathScoreEdgeID = 0;
+			break;
 			}
+		ToOvlpClass = 0;
+		OverlapAcceptable(pEdge,StateIdx & 0x01,&ToOvlpClass);
+		StateIdx = ((pEdge->ToVertexID-1) * 2) + (ToOvlpClass & 0x01);
 		}
 	}
+return(NumCycles);
+}
 
-pToVertex->flgPathScored = 1;
-if(HighestScore == 0)	// 0 if classing as terminating vertex with no accepted outgoing edges
+#ifdef _WIN32
+unsigned __stdcall ThreadedScorePaths(void * pThreadPars)
+#else
+void *ThreadedScorePaths(void * pThreadPars)
+#endif
+{
+int Rslt;
+tsThreadScorePathsPars *pPars = (tsThreadScorePathsPars *)pThreadPars;			// makes it easier not having to deal with casts!
+CAssembGraph *pAssembGraph = (CAssembGraph *)pPars->pThis;
+
+Rslt = pAssembGraph->ThreadScorePaths(pPars);
+pPars->Rslt = Rslt;
+#ifdef _WIN32
+_endthreadex(0);
+return(eBSFSuccess);
+#else
+pthread_exit(NULL);
+#endif
+}
+
+// ThreadScorePaths
+// Each thread takes the next component to be scored until all components have been scored
+// Components are disjoint, sharing no vertices or edges, so no serialisation is required whilst scoring a component
+int										 // eBSFSuccess or otherwise
+CAssembGraph::ThreadScorePaths(tsThreadScorePathsPars *pPars)	// thread scoring components until all components scored
+{
+UINT32 NumCycles;
+tsComponent *pComponent;
+
+while(1)
 	{
-	pToVertex->flgPathTerm = 1;
-	pToVertex->PathScore = pToVertex->SeqLen;
+	AcquireCASLock();
+	if(m_bTerminate || m_NxtScoreComponentIdx >= m_NumComponents)
+		{
+		ReleaseCASLock();
+		break;
+		}
+	pComponent = &m_pComponents[m_NxtScoreComponentIdx++];
+	ReleaseCASLock();
+
+	NumCycles = ScoreComponentPaths(pComponent);
+	pPars->NumScored += 1;
+
+	AcquireCASLock();
+	m_NumScoredComponents += 1;
+	m_NumScoredCycles += NumCycles;
+	ReleaseCASLock();
 	}
-else
-	pToVertex->PathScore = HighestScore + HighScoreAlignLen;
-pToVertex->PathScoreEdgeID =  HighestScoreEdgeID;
-pToVertex->RecurseDepth = 0;
-return(pToVertex->PathScore);
+return(eBSFSuccess);
 }
 
 
@@ -1942,14 +2127,14 @@ return(PathLen);
 int												 // eBSFSuccess or otherwise
 CAssembGraph::FindHighestScoringPaths(void)		 // score all possible paths and record highest scoring path for each component
 {
+int Rslt;
 size_t AllocMem;
-tVertID Idx;
+int NumThreads;
+int ThreadIdx;
 tComponentID CurCompID;
-tVertID CurVertexID;
-tsGraphVertex *pVertexA;
-tsGraphVertex *pVertex;
 tsComponent *pComponent;
-UINT64 PathScore;
+tsThreadScorePathsPars *pThreadPars;
+tsThreadScorePathsPars *pThreadPar;
 
 // graph processing
 gDiagnostics.DiagOut(eDLInfo,gszProcName,"FindHighestScoringPaths: Starting ...");
@@ -1978,37 +2163,84 @@ if(m_pPathTraceBacks == NULL)				// initialisation may be required
 	}
 m_UsedTraceBacks = 0;
 
-pComponent = m_pComponents;
-for(CurCompID = 1; CurCompID <= m_NumComponents; CurCompID++,pComponent++)
+if((Rslt = AllocPathScoring()) != eBSFSuccess)
+	return(Rslt);
+
+// components are scored in parallel, each thread scoring the next unscored component
+NumThreads = min(m_NumThreads,(int)max((UINT32)1,m_NumComponents));
+if(NumThreads < 1)
+	NumThreads = 1;
+if((pThreadPars = new tsThreadScorePathsPars [NumThreads]) == NULL)
 	{
-	pComponent->NumTraceBacks = 0;
-	pComponent->StartTraceBackID = 0;
-	pVertex = m_pGraphVertices;	
-	for(CurVertexID = 1; CurVertexID <= m_UsedGraphVertices; CurVertexID++,pVertex++)
+	gDiagnostics.DiagOut(eDLFatal,gszProcName,"FindHighestScoringPaths: Unable to allocate memory for threads...");
+	FreePathScoring();
+	return(eBSFerrMem);
+	}
+memset(pThreadPars,0,sizeof(tsThreadScorePathsPars) * NumThreads);
+pThreadPar = pThreadPars;
+for(ThreadIdx = 1; ThreadIdx <= NumThreads; ThreadIdx++, pThreadPar++)
+	{
+	pThreadPar->ThreadIdx = ThreadIdx;
+	pThreadPar->pThis = this;
+#ifdef _WIN32
+	pThreadPar->threadHandle = (HANDLE)_beginthreadex(NULL, 0x0fffff, ThreadedScorePaths, pThreadPar, 0, &pThreadPar->threadID);
+	if(pThreadPar->threadHandle == NULL)
+		break;
+#else
+	pThreadPar->threadRslt = pthread_create(&pThreadPar->threadID, NULL, ThreadedScorePaths, pThreadPar);
+	if(pThreadPar->threadRslt != 0)
+		break;
+#endif
+	}
+if(ThreadIdx <= NumThreads)			// not all threads could be started
+	{
+	if(ThreadIdx == 1)
 		{
-		if(pVertex->ComponentID != CurCompID)
-			continue;
-		pVertexA = m_pGraphVertices;
-		for(Idx = 0; Idx < m_UsedGraphVertices; Idx++,pVertexA++)
-			{
-			if(pVertexA->ComponentID != CurCompID)
-				continue;
-			pVertexA->RecurseDepth = 0;
-			pVertexA->flgPathScored = 0;
-			pVertexA->flgPathTerm = 0;
-			pVertexA->RecurseDepth = 0;
-			pVertexA->PathScore = 0;
-			pVertexA->PathScoreEdgeID = 0;
-			}
-		PathScore = ScorePaths(CurVertexID);
-		if(PathScore > 0 && PathScore > pComponent->PathScore)
-			{
-			pComponent->PathScore = PathScore;
-			pComponent->PathStartVertexID = CurVertexID;
-			pComponent->PathLength = GenTraceBackPath(pComponent);
-			}
+		gDiagnostics.DiagOut(eDLFatal,gszProcName,"FindHighestScoringPaths: Unable to start any path scoring threads");
+		delete [] pThreadPars;
+		FreePathScoring();
+		return(eBSFerrInternal);
+		}
+	gDiagnostics.DiagOut(eDLWarn,gszProcName,"FindHighestScoringPaths: Only able to start %d of %d path scoring threads",ThreadIdx - 1,NumThreads);
+	NumThreads = ThreadIdx - 1;		// started threads continue scoring until all components scored, only join those started
+	}
+
+pThreadPar = pThreadPars;
+for(ThreadIdx = 0; ThreadIdx < NumThreads; ThreadIdx++, pThreadPar++)
+	{
+#ifdef _WIN32
+	while(WAIT_TIMEOUT == WaitForSingleObject(pThreadPar->threadHandle, cPathScoreProgressSecs * 1000))
+		{
+		AcquireCASLock();
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"FindHighestScoringPaths: Progress: %u of %u components scored",m_NumScoredComponents,m_NumComponents);
+		ReleaseCASLock();
 		}
+	CloseHandle(pThreadPar->threadHandle);
+#else
+	struct timespec ts;
+	int JoinRlt;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += cPathScoreProgressSecs;
+	while((JoinRlt = pthread_timedjoin_np(pThreadPar->threadID, NULL, &ts)) != 0)
+		{
+		AcquireCASLock();
+		gDiagnostics.DiagOut(eDLInfo,gszProcName,"FindHighestScoringPaths: Progress: %u of %u components scored",m_NumScoredComponents,m_NumComponents);
+		ReleaseCASLock();
+		ts.tv_sec += cPathScoreProgressSecs;
+		}
+#endif
+	}
+delete [] pThreadPars;
+gDiagnostics.DiagOut(eDLInfo,gszProcName,"FindHighestScoringPaths: %u components scored, %u cycles condensed",m_NumScoredComponents,m_NumScoredCycles);
+
+// tracebacks are generated serially as the traceback memory may need to be reallocated
+pComponent = m_pComponents;
+for(CurCompID = 1; CurCompID <= m_NumComponents; CurCompID++,pComponent++)
+	{
+	if(pComponent->PathStartVertexID != 0 && pComponent->PathScore > 0)
+		pComponent->PathLength = GenTraceBackPath(pComponent);
 	}
+FreePathScoring();
 
 UINT32 ComponentIdx;
 pComponent = m_pComponents;
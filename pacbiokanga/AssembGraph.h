@@ -31,6 +31,8 @@ const double cReallocTraceBacks   =   0.3;	    // then, as may be required, real
 
 const UINT32 cMaxDiscRemaps = 1000;					// remap disconnected graph identifiers list limit
 
+const int cPathScoreProgressSecs = 60;				// report path scoring progress at this interval in seconds
+
 typedef enum TAG_eVerticesSortOrder {
 	eVSOUnsorted = 0,	//  unsorted or sort order indeterminate
 	eVSOVertexID,		// sorted by vertex identifier ascending
@@ -133,6 +135,18 @@ typedef struct TAG_sComponent {
 	UINT32 StartTraceBackID;			// path starts with this traceback
 } tsComponent;
 
+// path scoring state for a vertex when that vertex is evaluated as either sense or antisense in a path
+// states are indexed as ((VertexID-1) * 2) + (OvlpClass & 0x01) so that both orientations of each vertex are scored independently
+typedef struct TAG_sPathState {
+	UINT64 PathScore;					// highest score for any path originating from this vertex state
+	tEdgeID PathScoreEdgeID;			// highest scoring path continues with this outgoing edge, 0 if path terminates at this vertex state
+	UINT32 DFSIdx;						// order (1..N) in which state was discovered within component, 0 if not yet discovered
+	UINT32 LowLink;						// lowest DFSIdx of any state reachable on the component stack - used to condense cycles
+	UINT8 NxtEdgeIdx;					// next outgoing edge (0..DegreeOut-1) to be explored from this state
+	UINT8 flgOnStack:1;					// state currently on the strongly connected component stack
+	UINT8 flgScored:1;					// PathScore and PathScoreEdgeID have been generated
+} tsPathState;
+
 
 typedef struct TAG_sRemapComponentID {
 	tComponentID From;		// map from	
@@ -141,6 +155,20 @@ typedef struct TAG_sRemapComponentID {
 
 #pragma pack()
 
+typedef struct TAG_sThreadScorePathsPars {
+	int ThreadIdx;					// uniquely identifies this thread
+	void *pThis;					// will be initialised to pt to class instance
+#ifdef _WIN32
+	HANDLE threadHandle;			// handle as returned by _beginthreadex()
+	unsigned int threadID;			// identifier as set by _beginthreadex()
+#else
+	int threadRslt;					// result as returned by pthread_create ()
+	pthread_t threadID;				// identifier as set by pthread_create ()
+#endif
+	int Rslt;						// processing result
+	UINT32 NumScored;				// number of components path scored by this thread
+} tsThreadScorePathsPars;
+
 class CAssembGraph
 {
 	CMTqsort m_MTqsort;				// multithreaded sorting
@@ -179,6 +207,16 @@ class CAssembGraph
 	UINT32 m_AllocdTraceBacks;			// allocd to hold this many tracebacks
 	tsPathTraceBack *m_pPathTraceBacks; // to hold all path tracebacks
 
+	size_t m_AllocdPathScoreMem;		// memory allocated for path scoring
+	void *m_pPathScoreMem;				// allocated to hold path scoring states, component vertices and stacks
+	tsPathState *m_pPathStates;			// two states, sense and antisense, for each vertex
+	tVertID *m_pScoreVertices;			// vertex identifiers ordered by component
+	UINT32 *m_pScoreCompOfs;			// m_pScoreVertices[m_pScoreCompOfs[ComponentID-1]] is first vertex in component; m_NumComponents+1 entries
+	UINT32 *m_pPathStateStacks;			// traversal and component stacks, partitioned by component so components can be scored concurrently
+	UINT32 m_NxtScoreComponentIdx;		// next component (index into m_pComponents) to be path scored
+	UINT32 m_NumScoredComponents;		// number of components path scored
+	UINT32 m_NumScoredCycles;			// number of cycles (strongly connected states) condensed whilst path scoring
+
 
 	UINT32 m_NumDiscRemaps;				// number of disconnected graph identifiers requiring remaps
 	tsRemapComponentID m_DiscRemaps[cMaxDiscRemaps];	// to hold disconnected graph identifiers requiring remaps
@@ -258,6 +296,12 @@ class CAssembGraph
 	UINT32  ClearEdgeTravFwdRevs(void);
 	UINT32	ClearDiscCompIDs(void);
 
+	void FreePathScoring(void);				// free memory allocated for path scoring
+	int AllocPathScoring(void);				// allocate and initialise for path scoring all components
+	void ScoreState(UINT32 StateIdx);		// score paths from this state given that all states reachable from it have been scored
+	UINT32									// number of cycles condensed
+		ScoreComponentPaths(tsComponent *pComponent);	// score all paths in this component and mark vertices on the highest scoring path
+
 public:
 	CAssembGraph(void);
 	~CAssembGraph(void);
@@ -315,16 +359,8 @@ public:
 				UINT8 FromOvlpClass = 0,	// From vertex overlap classification; bit 0 set if From vertex evaluated as antisense in current path
 				UINT8 *pToOvlpClass = NULL);		// returned To vertex overlap classification; bit 0 set if To vertex is evaluated as antisense in current path
 
-	UINT64
-		ScorePaths(tVertID VertexID);			// score all paths starting with outgoing edges from this vertex
-
-	UINT64										// highest scoring of any path from pEdge
-		ScorePath(UINT32 Depth,					// current recursive depth - used to detect circular paths
-				  tsGraphOutEdge *pEdge,		// score paths starting with this edge
-				UINT8 FromOvlpClass = 0,	// From vertex overlap classification; bit 0 set if From vertex evaluated as antisense in current path
-				UINT8 *pToOvlpClass = NULL);	// returned To vertex overlap classification; bit 0 set if To vertex is evaluated as antisense in current path
-
-
+	int										 // eBSFSuccess or otherwise
+		ThreadScorePaths(tsThreadScorePathsPars *pPars);	// thread scoring components until all components scored
 
 	int										 // eBSFSuccess or otherwise
 		FindHighestScoringPaths(void);		 // score all possible paths and record highest scoring path for each component